@@ -275,6 +275,7 @@ class InfoCmd : public Cmd {
  private:
   InfoSection info_section_;
   bool rescan_ = false;  // whether to rescan the keyspace
+  bool verify_ = false;  // whether the rescan walks the keys even with key counters
   bool off_ = false;
   std::set<std::string> keyspace_scan_dbs_;
   const static std::string kInfoSection;
@@ -295,6 +296,7 @@ class InfoCmd : public Cmd {
   void DoInitial() override;
   void Clear() override {
     rescan_ = false;
+    verify_ = false;
     off_ = false;
     keyspace_scan_dbs_.clear();
   }
@@ -559,6 +561,21 @@ class ClearReplicationIDCmd : public Cmd {
   void DoInitial() override;
 };
 
+class RebalanceCmd : public Cmd {
+ public:
+  RebalanceCmd(const std::string& name, int arity, uint32_t flag)
+      : Cmd(name, arity, flag, static_cast<uint32_t>(AclCategory::ADMIN)) {}
+  void Do() override;
+  void Split(const HintKeys& hint_keys) override {};
+  void Merge() override {};
+  Cmd* Clone() override { return new RebalanceCmd(*this); }
+
+ private:
+  void DoInitial() override;
+  void Clear() override { max_slots_ = 64; }
+  int64_t max_slots_ = 64;
+};
+
 class DisableWalCmd : public Cmd {
  public:
   DisableWalCmd(const std::string& name, int arity, uint32_t flag) : Cmd(name, arity, flag) {}
@@ -55,6 +55,7 @@ const std::string kCmdNameHello = "hello";
 const std::string kCmdNameCommand = "command";
 const std::string kCmdNameDiskRecovery = "diskrecovery";
 const std::string kCmdNameClearReplicationID = "clearreplicationid";
+const std::string kCmdNameRebalance = "rebalance";
 const std::string kCmdNameDisableWal = "disablewal";
 const std::string kCmdNameLastSave = "lastsave";
 const std::string kCmdNameCache = "cache";
@@ -143,6 +143,10 @@ class PikaConf : public pstd::BaseConf {
     std::shared_lock l(rwlock_);
     return best_delete_min_ratio_;
   }
+  int ttl_compact_horizon_seconds() {
+    std::shared_lock l(rwlock_);
+    return ttl_compact_horizon_seconds_;
+  }
   CompactionStrategy compaction_strategy() {
     std::shared_lock l(rwlock_);
     return compaction_strategy_;
@@ -270,6 +274,10 @@ class PikaConf : public pstd::BaseConf {
     std::shared_lock l(rwlock_);
     return bgsave_prefix_;
   }
+  bool dump_incremental() {
+    std::shared_lock l(rwlock_);
+    return dump_incremental_;
+  }
   std::string user_blacklist_string() {
     std::shared_lock l(rwlock_);
     return pstd::StringConcat(user_blacklist_, COMMA);
@@ -361,6 +369,74 @@ class PikaConf : public pstd::BaseConf {
     std::shared_lock l(rwlock_);
     return share_block_cache_;
   }
+  const std::string& data_format() {
+    std::shared_lock l(rwlock_);
+    return data_format_;
+  }
+  int meta_version_cache_capacity() {
+    std::shared_lock l(rwlock_);
+    return meta_version_cache_capacity_;
+  }
+  int zset_rank_index_threshold() {
+    std::shared_lock l(rwlock_);
+    return zset_rank_index_threshold_;
+  }
+  int list_chunk_size() {
+    std::shared_lock l(rwlock_);
+    return list_chunk_size_;
+  }
+  int hash_max_inline_entries() {
+    std::shared_lock l(rwlock_);
+    return hash_max_inline_entries_;
+  }
+  int hash_max_inline_value() {
+    std::shared_lock l(rwlock_);
+    return hash_max_inline_value_;
+  }
+  int set_max_inline_entries() {
+    std::shared_lock l(rwlock_);
+    return set_max_inline_entries_;
+  }
+  int set_max_inline_value() {
+    std::shared_lock l(rwlock_);
+    return set_max_inline_value_;
+  }
+  int scan_worker_num() {
+    std::shared_lock l(rwlock_);
+    return scan_worker_num_;
+  }
+  bool key_counters() {
+    std::shared_lock l(rwlock_);
+    return key_counters_;
+  }
+  bool strings_merge() {
+    std::shared_lock l(rwlock_);
+    return strings_merge_;
+  }
+  int bitmap_chunk_size() {
+    std::shared_lock l(rwlock_);
+    return bitmap_chunk_size_;
+  }
+  int expiry_reap_rate() {
+    std::shared_lock l(rwlock_);
+    return expiry_reap_rate_;
+  }
+  int lazyfree_range_threshold() {
+    std::shared_lock l(rwlock_);
+    return lazyfree_range_threshold_;
+  }
+  int open_worker_num() {
+    std::shared_lock l(rwlock_);
+    return open_worker_num_;
+  }
+  bool lazy_open() {
+    std::shared_lock l(rwlock_);
+    return lazy_open_;
+  }
+  int64_t sst_delete_rate_bytes() {
+    std::shared_lock l(rwlock_);
+    return sst_delete_rate_bytes_;
+  }
   bool wash_data() {
     std::shared_lock l(rwlock_);
     return wash_data_;
@@ -969,6 +1045,7 @@ class PikaConf : public pstd::BaseConf {
   int force_compact_min_delete_ratio_;
   int dont_compact_sst_created_in_seconds_;
   int best_delete_min_ratio_;
+  int ttl_compact_horizon_seconds_ = 3600;
   CompactionStrategy compaction_strategy_;
 
   int64_t resume_check_interval_ = 60; // seconds
@@ -1005,6 +1082,7 @@ class PikaConf : public pstd::BaseConf {
   std::string default_db_;
   std::string bgsave_path_;
   std::string bgsave_prefix_;
+  bool dump_incremental_ = false;
   std::string pidfile_;
   std::atomic<bool> slow_cmd_pool_;
 
@@ -1037,6 +1115,23 @@ class PikaConf : public pstd::BaseConf {
   int64_t block_cache_ = 0;
   int64_t num_shard_bits_ = 0;
   bool share_block_cache_ = false;
+  std::string data_format_ = "v1";
+  int meta_version_cache_capacity_ = 100000;
+  int zset_rank_index_threshold_ = 0;
+  int list_chunk_size_ = 0;
+  int hash_max_inline_entries_ = 0;
+  int hash_max_inline_value_ = 64;
+  int set_max_inline_entries_ = 0;
+  int set_max_inline_value_ = 64;
+  int scan_worker_num_ = 1;
+  bool key_counters_ = false;
+  bool strings_merge_ = false;
+  int bitmap_chunk_size_ = 0;
+  int expiry_reap_rate_ = 0;
+  int lazyfree_range_threshold_ = 0;
+  int open_worker_num_ = 0;
+  bool lazy_open_ = false;
+  int64_t sst_delete_rate_bytes_ = 0;
   bool enable_partitioned_index_filters_ = false;
   bool cache_index_and_filter_blocks_ = false;
   bool pin_l0_filter_and_index_blocks_in_cache_ = false;
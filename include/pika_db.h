@@ -122,13 +122,19 @@ class DB : public std::enable_shared_from_this<DB>, public pstd::noncopyable {
   }
 
   // KeyScan use;
-  void KeyScan();
+  // verify walks the keys even when the storage keeps key counters
+  void KeyScan(bool verify = false);
   bool IsKeyScaning();
-  void RunKeyScan();
+  void RunKeyScan(bool verify = false);
   void StopKeyScan();
   void ScanDatabase(const storage::DataType& type);
   KeyScanInfo GetKeyScanInfo();
 
+  // Rebalance use;
+  // moves at most max_slots slots from the busiest instances to the idlest
+  void Rebalance(int64_t max_slots);
+  bool IsRebalancing();
+
   // Compact use;
   void Compact(const storage::DataType& type);
   void CompactRange(const storage::DataType& type, const std::string& start, const std::string& end);
@@ -155,7 +161,7 @@ class DB : public std::enable_shared_from_this<DB>, public pstd::noncopyable {
   void PrepareRsync();
   bool IsBgSaving();
   BgSaveInfo bgsave_info();
-  pstd::Status GetKeyNum(std::vector<storage::KeyInfo>* key_info);
+  pstd::Status GetKeyNum(std::vector<storage::KeyInfo>* key_info, bool verify = false);
 
  private:
   bool opened_ = false;
@@ -179,6 +185,12 @@ class DB : public std::enable_shared_from_this<DB>, public pstd::noncopyable {
   void InitKeyScan();
   pstd::Mutex key_scan_protector_;
   KeyScanInfo key_scan_info_;
+  /*
+   * Rebalance use
+   */
+  static void DoRebalance(void* arg);
+  void RunRebalance(int64_t max_slots);
+  std::atomic<bool> rebalancing_ = false;
   /*
    * Cache used
    */
@@ -201,6 +213,8 @@ class DB : public std::enable_shared_from_this<DB>, public pstd::noncopyable {
 
 struct BgTaskArg {
   std::shared_ptr<DB> db;
+  bool verify = false;
+  int64_t max_slots = 0;
 };
 
 #endif
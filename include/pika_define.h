@@ -366,7 +366,7 @@ const std::string kInnerReplOk = "ok";
 const std::string kInnerReplWait = "wait";
 
 const unsigned int kMaxBitOpInputKey = 12800;
-const int kMaxBitOpInputBit = 21;
+const int kMaxBitOpInputBit = 32;
 /*
  * db sync
  */
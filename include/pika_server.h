@@ -56,6 +56,7 @@ enum TaskType {
   kResetReplState,
   kPurgeLog,
   kStartKeyScan,
+  kStartKeyScanVerify,
   kStopKeyScan,
   kBgSave,
   kCompactRangeAll,
@@ -111,6 +112,7 @@ class PikaServer : public pstd::noncopyable {
   bool IsBgSaving();
   bool IsKeyScaning();
   bool IsCompacting();
+  uint64_t LazyfreePendingRanges();
   bool IsDBExist(const std::string& db_name);
   bool IsDBBinlogIoError(const std::string& db_name);
   std::shared_ptr<DB> GetDB(const std::string& db_name);
@@ -334,7 +334,7 @@ class ZUnionstoreCmd : public ZsetUIstoreParentCmd {
  private:
   void DoInitial() override;
   // used for write binlog
-  std::map<std::string, double> value_to_dest_;
+  std::vector<storage::ScoreMember> value_to_dest_;
   rocksdb::Status s_;
   void DoBinlog() override;
 };
@@ -886,15 +886,17 @@ void InfoCmd::DoInitial() {
 
       return;
     }
-    // info keyspace [ 0 | 1 | off ]
+    // info keyspace [ 0 | 1 | verify | off ]
     // info keyspace 1 db0,db1
     // info keyspace 0 db0,db1
+    // info keyspace verify db0,db1
     // info keyspace off db0,db1
-    if (argv_[2] == "1") {
+    if (argv_[2] == "1" || argv_[2] == "verify") {
       if (g_pika_server->IsCompacting()) {
         res_.SetRes(CmdRes::kErrOther, "The compact operation is executing, Try again later");
       } else {
         rescan_ = true;
+        verify_ = argv_[2] == "verify";
       }
     } else if (argv_[2] == "off") {
       off_ = true;
@@ -1090,6 +1092,7 @@ void InfoCmd::InfoStats(std::string& info) {
   tmp_stream << "is_compact:" << (g_pika_server->IsCompacting() ? "Yes" : "No") << "\r\n";
   tmp_stream << "compact_cron:" << g_pika_conf->compact_cron() << "\r\n";
   tmp_stream << "compact_interval:" << g_pika_conf->compact_interval() << "\r\n";
+  tmp_stream << "lazyfree_pending_ranges:" << g_pika_server->LazyfreePendingRanges() << "\r\n";
   time_t current_time_s = time(nullptr);
   PikaServer::BGSlotsReload bgslotsreload_info = g_pika_server->bgslots_reload();
   bool is_reloading = g_pika_server->GetSlotsreloading();
@@ -1344,7 +1347,8 @@ void InfoCmd::InfoKeyspace(std::string& info) {
   }
   info.append(tmp_stream.str());
   if (rescan_) {
-    g_pika_server->DoSameThingSpecificDB(keyspace_scan_dbs_, {TaskType::kStartKeyScan});
+    g_pika_server->DoSameThingSpecificDB(keyspace_scan_dbs_,
+                                         {verify_ ? TaskType::kStartKeyScanVerify : TaskType::kStartKeyScan});
   }
 }
 
@@ -1761,6 +1765,12 @@ void ConfigCmd::ConfigGet(std::string& ret) {
     EncodeString(&config_body, g_pika_conf->bgsave_prefix());
   }
 
+  if (pstd::stringmatch(pattern.data(), "dump-incremental", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "dump-incremental");
+    EncodeString(&config_body, g_pika_conf->dump_incremental() ? "yes" : "no");
+  }
+
   if (pstd::stringmatch(pattern.data(), "pidfile", 1) != 0) {
     elements += 2;
     EncodeString(&config_body, "pidfile");
@@ -1845,6 +1855,108 @@ void ConfigCmd::ConfigGet(std::string& ret) {
     EncodeString(&config_body, g_pika_conf->share_block_cache() ? "yes" : "no");
   }
 
+  if (pstd::stringmatch(pattern.data(), "data-format", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "data-format");
+    EncodeString(&config_body, g_pika_conf->data_format());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "meta-version-cache-capacity", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "meta-version-cache-capacity");
+    EncodeNumber(&config_body, g_pika_conf->meta_version_cache_capacity());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "zset-rank-index-threshold", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "zset-rank-index-threshold");
+    EncodeNumber(&config_body, g_pika_conf->zset_rank_index_threshold());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "list-chunk-size", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "list-chunk-size");
+    EncodeNumber(&config_body, g_pika_conf->list_chunk_size());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "hash-max-inline-entries", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "hash-max-inline-entries");
+    EncodeNumber(&config_body, g_pika_conf->hash_max_inline_entries());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "hash-max-inline-value", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "hash-max-inline-value");
+    EncodeNumber(&config_body, g_pika_conf->hash_max_inline_value());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "set-max-inline-entries", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "set-max-inline-entries");
+    EncodeNumber(&config_body, g_pika_conf->set_max_inline_entries());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "set-max-inline-value", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "set-max-inline-value");
+    EncodeNumber(&config_body, g_pika_conf->set_max_inline_value());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "scan-worker-num", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "scan-worker-num");
+    EncodeNumber(&config_body, g_pika_conf->scan_worker_num());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "key-counters", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "key-counters");
+    EncodeString(&config_body, g_pika_conf->key_counters() ? "yes" : "no");
+  }
+
+  if (pstd::stringmatch(pattern.data(), "strings-merge", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "strings-merge");
+    EncodeString(&config_body, g_pika_conf->strings_merge() ? "yes" : "no");
+  }
+
+  if (pstd::stringmatch(pattern.data(), "bitmap-chunk-size", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "bitmap-chunk-size");
+    EncodeNumber(&config_body, g_pika_conf->bitmap_chunk_size());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "expiry-reap-rate", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "expiry-reap-rate");
+    EncodeNumber(&config_body, g_pika_conf->expiry_reap_rate());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "lazyfree-range-threshold", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "lazyfree-range-threshold");
+    EncodeNumber(&config_body, g_pika_conf->lazyfree_range_threshold());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "open-worker-num", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "open-worker-num");
+    EncodeNumber(&config_body, g_pika_conf->open_worker_num());
+  }
+
+  if (pstd::stringmatch(pattern.data(), "lazy-open", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "lazy-open");
+    EncodeString(&config_body, g_pika_conf->lazy_open() ? "yes" : "no");
+  }
+
+  if (pstd::stringmatch(pattern.data(), "sst-delete-rate-bytes", 1) != 0) {
+    elements += 2;
+    EncodeString(&config_body, "sst-delete-rate-bytes");
+    EncodeNumber(&config_body, g_pika_conf->sst_delete_rate_bytes());
+  }
+
   if (pstd::stringmatch(pattern.data(), "enable-partitioned-index-filters", 1) != 0) {
     elements += 2;
     EncodeString(&config_body, "enable-partitioned-index-filters");
@@ -3486,6 +3598,31 @@ void ClearReplicationIDCmd::Do() {
   res_.SetRes(CmdRes::kOk, "ReplicationID is cleared");
 }
 
+void RebalanceCmd::DoInitial() {
+  if (!CheckArg(argv_.size()) || argv_.size() > 2) {
+    res_.SetRes(CmdRes::kWrongNum, kCmdNameRebalance);
+    return;
+  }
+  if (argv_.size() == 2 && ((pstd::string2int(argv_[1].data(), argv_[1].size(), &max_slots_) == 0) || max_slots_ <= 0)) {
+    res_.SetRes(CmdRes::kInvalidInt);
+    return;
+  }
+}
+
+void RebalanceCmd::Do() {
+  std::shared_ptr<DB> db = g_pika_server->GetDB(db_name_);
+  if (!db) {
+    res_.SetRes(CmdRes::kInvalidDB);
+    return;
+  }
+  if (db->IsRebalancing()) {
+    res_.SetRes(CmdRes::kErrOther, "The rebalance operation is executing, Try again later");
+    return;
+  }
+  db->Rebalance(max_slots_);
+  res_.SetRes(CmdRes::kOk);
+}
+
 void DisableWalCmd::DoInitial() {
   if (!CheckArg(argv_.size())) {
     res_.SetRes(CmdRes::kWrongNum, kCmdNameDisableWal);
@@ -33,7 +33,7 @@ void BitSetCmd::DoInitial() {
     res_.SetRes(CmdRes::kInvalidBitOffsetInt);
     return;
   }
-  // value no bigger than 2^18
+  // offset below 2^32, a bitmap of at most 512MB like redis
   if ((bit_offset_ >> kMaxBitOpInputBit) > 0) {
     res_.SetRes(CmdRes::kInvalidBitOffsetInt);
     return;
@@ -144,7 +144,7 @@ void BitCountCmd::DoInitial() {
 }
 
 void BitCountCmd::Do() {
-  int32_t count = 0;
+  int64_t count = 0;
   if (count_all_) {
     s_ = db_->storage()->BitCount(key_, start_offset_, end_offset_, &count, false);
   } else {
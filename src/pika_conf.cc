@@ -105,6 +105,10 @@ int PikaConf::Load() {
   }
   GetConfStr("dump-prefix", &bgsave_prefix_);
 
+  std::string di;
+  GetConfStr("dump-incremental", &di);
+  dump_incremental_ = di == "yes";
+
   GetConfInt("expire-logs-nums", &expire_logs_nums_);
   if (expire_logs_nums_ <= 10) {
     expire_logs_nums_ = 10;
@@ -330,6 +334,11 @@ int PikaConf::Load() {
     best_delete_min_ratio_ = 10;
   }
 
+  GetConfInt("ttl-compact-horizon-seconds", &ttl_compact_horizon_seconds_);
+  if (ttl_compact_horizon_seconds_ < 0) {
+    ttl_compact_horizon_seconds_ = 0;
+  }
+
   std::string cs_;
   GetConfStr("compaction-strategy", &cs_);
   if (cs_ == "full-compact") {
@@ -555,6 +564,86 @@ int PikaConf::Load() {
   GetConfStr("share-block-cache", &sbc);
   share_block_cache_ = sbc == "yes";
 
+  GetConfStr("data-format", &data_format_);
+  if (data_format_ != "v1" && data_format_ != "v2") {
+    data_format_ = "v1";
+  }
+
+  GetConfInt("meta-version-cache-capacity", &meta_version_cache_capacity_);
+  if (meta_version_cache_capacity_ < 0) {
+    meta_version_cache_capacity_ = 0;
+  }
+
+  GetConfInt("zset-rank-index-threshold", &zset_rank_index_threshold_);
+  if (zset_rank_index_threshold_ < 0) {
+    zset_rank_index_threshold_ = 0;
+  }
+
+  GetConfInt("list-chunk-size", &list_chunk_size_);
+  if (list_chunk_size_ < 0) {
+    list_chunk_size_ = 0;
+  }
+
+  GetConfInt("hash-max-inline-entries", &hash_max_inline_entries_);
+  if (hash_max_inline_entries_ < 0) {
+    hash_max_inline_entries_ = 0;
+  }
+  GetConfInt("hash-max-inline-value", &hash_max_inline_value_);
+  if (hash_max_inline_value_ <= 0) {
+    hash_max_inline_value_ = 64;
+  }
+
+  GetConfInt("set-max-inline-entries", &set_max_inline_entries_);
+  if (set_max_inline_entries_ < 0) {
+    set_max_inline_entries_ = 0;
+  }
+  GetConfInt("set-max-inline-value", &set_max_inline_value_);
+  if (set_max_inline_value_ <= 0) {
+    set_max_inline_value_ = 64;
+  }
+
+  GetConfInt("scan-worker-num", &scan_worker_num_);
+  if (scan_worker_num_ <= 0) {
+    scan_worker_num_ = 1;
+  }
+
+  std::string kc;
+  GetConfStr("key-counters", &kc);
+  key_counters_ = kc == "yes";
+
+  std::string sm;
+  GetConfStr("strings-merge", &sm);
+  strings_merge_ = sm == "yes";
+
+  GetConfInt("bitmap-chunk-size", &bitmap_chunk_size_);
+  if (bitmap_chunk_size_ < 0) {
+    bitmap_chunk_size_ = 0;
+  }
+
+  GetConfInt("expiry-reap-rate", &expiry_reap_rate_);
+  if (expiry_reap_rate_ < 0) {
+    expiry_reap_rate_ = 0;
+  }
+
+  GetConfInt("lazyfree-range-threshold", &lazyfree_range_threshold_);
+  if (lazyfree_range_threshold_ < 0) {
+    lazyfree_range_threshold_ = 0;
+  }
+
+  GetConfInt("open-worker-num", &open_worker_num_);
+  if (open_worker_num_ < 0) {
+    open_worker_num_ = 0;
+  }
+
+  std::string lo;
+  GetConfStr("lazy-open", &lo);
+  lazy_open_ = lo == "yes";
+
+  GetConfInt64Human("sst-delete-rate-bytes", &sst_delete_rate_bytes_);
+  if (sst_delete_rate_bytes_ < 0) {
+    sst_delete_rate_bytes_ = 0;
+  }
+
   std::string epif;
   GetConfStr("enable-partitioned-index-filters", &epif);
   enable_partitioned_index_filters_ = epif == "yes";
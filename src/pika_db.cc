@@ -102,7 +102,7 @@ std::shared_ptr<pstd::lock::LockMgr> DB::LockMgr() { return lock_mgr_; }
 std::shared_ptr<PikaCache> DB::cache() const { return cache_; }
 std::shared_ptr<storage::Storage> DB::storage() const { return storage_; }
 
-void DB::KeyScan() {
+void DB::KeyScan(bool verify) {
   std::lock_guard ml(key_scan_protector_);
   if (key_scan_info_.key_scaning_) {
     return;
@@ -112,6 +112,7 @@ void DB::KeyScan() {
                                  // has not been scheduled for exec
   auto bg_task_arg = new BgTaskArg();
   bg_task_arg->db = shared_from_this();
+  bg_task_arg->verify = verify;
   g_pika_server->KeyScanTaskSchedule(&DoKeyScan, reinterpret_cast<void*>(bg_task_arg));
 }
 
@@ -120,13 +121,13 @@ bool DB::IsKeyScaning() {
   return key_scan_info_.key_scaning_;
 }
 
-void DB::RunKeyScan() {
+void DB::RunKeyScan(bool verify) {
   Status s;
   std::vector<storage::KeyInfo> new_key_infos;
 
   InitKeyScan();
   std::shared_lock l(dbs_rw_);
-  s = GetKeyNum(&new_key_infos);
+  s = GetKeyNum(&new_key_infos, verify);
   key_scan_info_.duration = static_cast<int32_t>(time(nullptr) - key_scan_info_.start_time);
 
   std::lock_guard lm(key_scan_protector_);
@@ -136,7 +137,7 @@ void DB::RunKeyScan() {
   key_scan_info_.key_scaning_ = false;
 }
 
-Status DB::GetKeyNum(std::vector<storage::KeyInfo>* key_info) {
+Status DB::GetKeyNum(std::vector<storage::KeyInfo>* key_info, bool verify) {
   std::lock_guard l(key_info_protector_);
   if (key_scan_info_.key_scaning_) {
     *key_info = key_scan_info_.key_infos;
@@ -146,7 +147,7 @@ Status DB::GetKeyNum(std::vector<storage::KeyInfo>* key_info) {
   key_scan_info_.key_scaning_ = true;
   key_scan_info_.duration = -2;  // duration -2 mean the task in waiting status,
                                  // has not been scheduled for exec
-  rocksdb::Status s = storage_->GetKeyNum(key_info);
+  rocksdb::Status s = storage_->GetKeyNum(key_info, verify);
   key_scan_info_.key_scaning_ = false;
   if (!s.ok()) {
     return Status::Corruption(s.ToString());
@@ -201,9 +202,51 @@ void DB::LongestNotCompactionSstCompact(const storage::DataType& type) {
   storage_->LongestNotCompactionSstCompact(type);
 }
 
+void DB::Rebalance(int64_t max_slots) {
+  bool expected = false;
+  if (!rebalancing_.compare_exchange_strong(expected, true)) {
+    return;
+  }
+  auto bg_task_arg = new BgTaskArg();
+  bg_task_arg->db = shared_from_this();
+  bg_task_arg->max_slots = max_slots;
+  g_pika_server->KeyScanTaskSchedule(&DoRebalance, reinterpret_cast<void*>(bg_task_arg));
+}
+
+bool DB::IsRebalancing() { return rebalancing_.load(); }
+
+void DB::RunRebalance(int64_t max_slots) {
+  std::shared_ptr<storage::Storage> storage;
+  {
+    std::shared_lock l(dbs_rw_);
+    storage = storage_;
+  }
+  // the commands hold dbs_rw_ shared while they run, so the slots switch
+  // instance between two commands
+  int64_t moved = 0;
+  rocksdb::Status s = storage->RebalanceSlots(
+      max_slots,
+      [this](const std::function<rocksdb::Status()>& switch_slots) {
+        std::lock_guard l(dbs_rw_);
+        return switch_slots();
+      },
+      &moved);
+  if (s.ok()) {
+    LOG(INFO) << db_name_ << " rebalance moved " << moved << " slots";
+  } else {
+    LOG(WARNING) << db_name_ << " rebalance failed after moving " << moved << " slots: " << s.ToString();
+  }
+  rebalancing_ = false;
+}
+
+void DB::DoRebalance(void* arg) {
+  std::unique_ptr<BgTaskArg> bg_task_arg(static_cast<BgTaskArg*>(arg));
+  bg_task_arg->db->RunRebalance(bg_task_arg->max_slots);
+}
+
 void DB::DoKeyScan(void* arg) {
   std::unique_ptr <BgTaskArg> bg_task_arg(static_cast<BgTaskArg*>(arg));
-  bg_task_arg->db->RunKeyScan();
+  bg_task_arg->db->RunKeyScan(bg_task_arg->verify);
 }
 
 void DB::InitKeyScan() {
@@ -232,31 +275,14 @@ bool DB::FlushDBWithoutLock() {
     return false;
   }
 
-  LOG(INFO) << db_name_ << " Delete old db...";
-  storage_.reset();
-
-  std::string dbpath = db_path_;
-  if (dbpath[dbpath.length() - 1] == '/') {
-    dbpath.erase(dbpath.length() - 1);
-  }
-  std::string delete_suffix("_deleting_");
-  delete_suffix.append(std::to_string(NowMicros()));
-  delete_suffix.append("/");
-  dbpath.append(delete_suffix);
-  auto rename_success = pstd::RenameFile(db_path_, dbpath);
-  storage_ = std::make_shared<storage::Storage>(g_pika_conf->db_instance_num(),
-      g_pika_conf->default_slot_num(), g_pika_conf->classic_mode());
-  rocksdb::Status s = storage_->Open(g_pika_server->storage_options(), db_path_);
-  assert(storage_);
-  assert(s.ok());
-  if (rename_success == -1) {
-    //the storage_->Open actually opened old RocksDB instance, so flushdb failed
-    LOG(WARNING)  << db_name_ << " FlushDB failed due to rename old db_path_ failed";
+  // the instances stay open, the files of the old keys are deleted at the
+  // rate of sst-delete-rate-bytes
+  rocksdb::Status s = storage_->FlushDB();
+  if (!s.ok()) {
+    LOG(WARNING) << db_name_ << " FlushDB failed, " << s.ToString();
     return false;
   }
-  LOG(INFO) << db_name_ << " Open new db success";
-
-  g_pika_server->PurgeDir(dbpath);
+  LOG(INFO) << db_name_ << " FlushDB success";
   return true;
 }
 
@@ -349,7 +375,13 @@ bool DB::InitBgsaveEnv() {
 // Prepare bgsave env, need bgsave_protector protect
 bool DB::InitBgsaveEngine() {
   bgsave_engine_.reset();
-  rocksdb::Status s = storage::BackupEngine::Open(storage().get(), bgsave_engine_, g_pika_conf->db_instance_num());
+  // the dumps share one sst store per db, outside the dated dirs dump-expire deletes
+  std::string sst_store_dir;
+  if (g_pika_conf->dump_incremental()) {
+    sst_store_dir = g_pika_conf->bgsave_path() + "sst_store/" + bgsave_sub_path_;
+  }
+  rocksdb::Status s = storage::BackupEngine::Open(storage().get(), bgsave_engine_, g_pika_conf->db_instance_num(),
+                                                  sst_store_dir);
   if (!s.ok()) {
     LOG(WARNING) << db_name_ << " open backup engine failed " << s.ToString();
     return false;
@@ -393,6 +393,17 @@ bool PikaServer::IsCompacting() {
   return false;
 }
 
+uint64_t PikaServer::LazyfreePendingRanges() {
+  uint64_t pending = 0;
+  std::shared_lock db_rwl(dbs_rw_);
+  for (const auto& db_item : dbs_) {
+    db_item.second->DBLockShared();
+    pending += db_item.second->storage()->GetPendingReclaimRanges();
+    db_item.second->DBUnlockShared();
+  }
+  return pending;
+}
+
 bool PikaServer::IsDBExist(const std::string& db_name) { return static_cast<bool>(GetDB(db_name)); }
 
 bool PikaServer::IsDBBinlogIoError(const std::string& db_name) {
@@ -422,6 +433,9 @@ Status PikaServer::DoSameThingSpecificDB(const std::set<std::string>& dbs, const
       case TaskType::kStartKeyScan:
         db_item.second->KeyScan();
         break;
+      case TaskType::kStartKeyScanVerify:
+        db_item.second->KeyScan(true);
+        break;
       case TaskType::kStopKeyScan:
         db_item.second->StopKeyScan();
         break;
@@ -1474,6 +1488,24 @@ void PikaServer::InitStorageOptions() {
   storage_options_.table_options.cache_index_and_filter_blocks = g_pika_conf->cache_index_and_filter_blocks();
   storage_options_.block_cache_size = g_pika_conf->block_cache();
   storage_options_.share_block_cache = g_pika_conf->share_block_cache();
+  storage_options_.data_format =
+      g_pika_conf->data_format() == "v2" ? storage::kDataFormatV2 : storage::kDataFormatV1;
+  storage_options_.meta_version_cache_capacity = g_pika_conf->meta_version_cache_capacity();
+  storage_options_.zset_rank_index_threshold = g_pika_conf->zset_rank_index_threshold();
+  storage_options_.list_chunk_size = g_pika_conf->list_chunk_size();
+  storage_options_.hash_max_inline_entries = g_pika_conf->hash_max_inline_entries();
+  storage_options_.hash_max_inline_value = g_pika_conf->hash_max_inline_value();
+  storage_options_.set_max_inline_entries = g_pika_conf->set_max_inline_entries();
+  storage_options_.set_max_inline_value = g_pika_conf->set_max_inline_value();
+  storage_options_.scan_worker_num = g_pika_conf->scan_worker_num();
+  storage_options_.key_counters = g_pika_conf->key_counters();
+  storage_options_.strings_merge = g_pika_conf->strings_merge();
+  storage_options_.bitmap_chunk_size = g_pika_conf->bitmap_chunk_size();
+  storage_options_.expiry_reap_rate = g_pika_conf->expiry_reap_rate();
+  storage_options_.lazyfree_range_threshold = g_pika_conf->lazyfree_range_threshold();
+  storage_options_.open_worker_num = g_pika_conf->open_worker_num();
+  storage_options_.lazy_open = g_pika_conf->lazy_open();
+  storage_options_.sst_delete_rate_bytes = g_pika_conf->sst_delete_rate_bytes();
 
   storage_options_.table_options.pin_l0_filter_and_index_blocks_in_cache =
       g_pika_conf->pin_l0_filter_and_index_blocks_in_cache();
@@ -1503,6 +1535,7 @@ void PikaServer::InitStorageOptions() {
   storage_options_.compact_param_.force_compact_file_age_seconds_ = g_pika_conf->force_compact_file_age_seconds();
   storage_options_.compact_param_.force_compact_min_delete_ratio_ = g_pika_conf->force_compact_min_delete_ratio();
   storage_options_.compact_param_.compact_every_num_of_files_ = g_pika_conf->compact_every_num_of_files();
+  storage_options_.compact_param_.ttl_compact_horizon_seconds_ = g_pika_conf->ttl_compact_horizon_seconds();
 
   // rocksdb blob
   if (g_pika_conf->enable_blob_files()) {
@@ -835,20 +835,18 @@ void ZUnionstoreCmd::DoBinlog() {
   PikaCmdArgsType initial_args;
   initial_args.emplace_back("zadd");
   initial_args.emplace_back(dest_key_);
-  auto first_pair = value_to_dest_.begin();
   char buf[32];
-  int64_t d_len = pstd::d2string(buf, sizeof(buf), first_pair->second);
+  int64_t d_len = pstd::d2string(buf, sizeof(buf), value_to_dest_[0].score);
   initial_args.emplace_back(buf);
-  initial_args.emplace_back(first_pair->first);
-  value_to_dest_.erase(value_to_dest_.begin());
+  initial_args.emplace_back(value_to_dest_[0].member);
   zadd_cmd_->Initial(initial_args, db_name_);
   zadd_cmd_->SetConn(GetConn());
   zadd_cmd_->SetResp(resp_.lock());
 
   auto& zadd_argv = zadd_cmd_->argv();
-  size_t data_size = d_len + zadd_argv[3].size();
+  size_t data_size = d_len + value_to_dest_[0].member.size();
   constexpr size_t kDataSize = 131072; //128KB
-  for (const auto& it : value_to_dest_) {
+  for (size_t i = 1; i < value_to_dest_.size(); i++) {
     if (data_size >= kDataSize) {
       // If the binlog has reached the size of 128KB. (131,072 bytes = 128KB)
       zadd_cmd_->DoBinlog();
@@ -857,10 +855,10 @@ void ZUnionstoreCmd::DoBinlog() {
       zadd_argv.emplace_back(dest_key_);
       data_size = 0;
     }
-    d_len = pstd::d2string(buf, sizeof(buf), it.second);
+    d_len = pstd::d2string(buf, sizeof(buf), value_to_dest_[i].score);
     zadd_argv.emplace_back(buf);
-    zadd_argv.emplace_back(it.first);
-    data_size += (d_len + it.first.size());
+    zadd_argv.emplace_back(value_to_dest_[i].member);
+    data_size += (value_to_dest_[i].member.size() + d_len);
   }
   zadd_cmd_->DoBinlog();
 }
@@ -0,0 +1,151 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/bitmap_kernels.h"
+#include "storage/storage.h"
+
+using namespace storage;
+using namespace std::chrono;
+
+// every size is run until this many bytes went through the kernel
+const uint64_t BYTES_PER_SIZE = 1ULL << 30;
+
+// The byte at a time loops the kernels replaced
+static int64_t TableBitCount(const unsigned char* value, int64_t bytes) {
+  static unsigned char bitsinbyte[256];
+  static bool init = false;
+  if (!init) {
+    for (int idx = 0; idx < 256; ++idx) {
+      bitsinbyte[idx] = static_cast<unsigned char>(__builtin_popcount(idx));
+    }
+    init = true;
+  }
+  int64_t bit_num = 0;
+  for (int64_t i = 0; i < bytes; i++) {
+    bit_num += bitsinbyte[value[i]];
+  }
+  return bit_num;
+}
+
+static int64_t WordBitPos(const unsigned char* s, uint64_t bytes, int bit) {
+  uint64_t word = 0;
+  uint64_t skip_val = bit == 0 ? std::numeric_limits<uint64_t>::max() : 0;
+  auto l = reinterpret_cast<const uint64_t*>(s);
+  int64_t pos = 0;
+  while (bytes >= sizeof(*l)) {
+    if (*l != skip_val) {
+      break;
+    }
+    l++;
+    bytes = bytes - sizeof(*l);
+    pos += static_cast<int64_t>(8 * sizeof(*l));
+  }
+  auto c = reinterpret_cast<const unsigned char*>(l);
+  for (size_t j = 0; j < sizeof(*l); j++) {
+    word = word << 8;
+    if (bytes != 0U) {
+      word = word | *c;
+      c++;
+      bytes--;
+    }
+  }
+  if (bit == 1 && word == 0) {
+    return -1;
+  }
+  uint64_t mask = ~(std::numeric_limits<uint64_t>::max() >> 1);
+  while (mask != 0U) {
+    if (static_cast<int>((word & mask) != 0) == bit) {
+      return pos;
+    }
+    pos++;
+    mask = mask >> 1;
+  }
+  return pos;
+}
+
+static void ByteBitOp(BitOpType op, unsigned char* dest, const unsigned char* src, uint64_t bytes) {
+  for (uint64_t j = 0; j < bytes; j++) {
+    switch (op) {
+      case kBitOpAnd:
+        dest[j] = dest[j] & src[j];
+        break;
+      case kBitOpOr:
+        dest[j] = dest[j] | src[j];
+        break;
+      case kBitOpXor:
+        dest[j] = dest[j] ^ src[j];
+        break;
+      case kBitOpNot:
+        dest[j] = ~dest[j];
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+// GB/s of fn over a buffer of size bytes
+template <typename Fn>
+static double Throughput(uint64_t size, Fn fn) {
+  uint64_t rounds = std::max<uint64_t>(BYTES_PER_SIZE / size, 1);
+  auto start = steady_clock::now();
+  for (uint64_t round = 0; round < rounds; ++round) {
+    fn();
+  }
+  auto cost = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+  return static_cast<double>(rounds * size) / static_cast<double>(std::max<int64_t>(cost, 1));
+}
+
+static void Report(const std::string& name, uint64_t size, double before, double after) {
+  std::cout << name << ", size " << size << ", loop: " << before << " GB/s, kernel: " << after
+            << " GB/s, speedup: " << after / before << std::endl;
+}
+
+// BITCOUNT, BITPOS for the last bit and BITOP AND over random buffers of
+// 1KB up to 512MB, or up to the MB given as the first argument
+int main(int argc, char** argv) {
+  uint64_t max_size = 512ULL << 20;
+  if (argc > 1) {
+    max_size = std::strtoull(argv[1], nullptr, 10) << 20;
+  }
+  std::cout << "kernels: " << BitmapKernelsName() << std::endl;
+
+  std::mt19937_64 gen(1024);
+  volatile int64_t sink = 0;
+  for (uint64_t size : {1ULL << 10, 64ULL << 10, 1ULL << 20, 16ULL << 20, 128ULL << 20, 512ULL << 20}) {
+    if (size > max_size) {
+      break;
+    }
+    std::vector<unsigned char> src(size);
+    std::vector<unsigned char> dest(size);
+    for (auto& byte : src) {
+      byte = static_cast<unsigned char>(gen());
+    }
+    std::vector<unsigned char> zeros(size, 0);
+    zeros[size - 1] = 1;
+
+    double before = Throughput(size, [&] { sink = sink + TableBitCount(src.data(), static_cast<int64_t>(size)); });
+    double after = Throughput(size, [&] { sink = sink + PopcountBytes(src.data(), size); });
+    Report("BitCount", size, before, after);
+
+    before = Throughput(size, [&] { sink = sink + WordBitPos(zeros.data(), size, 1); });
+    after = Throughput(size, [&] { sink = sink + static_cast<int64_t>(SkipBytes(zeros.data(), size, 0)); });
+    Report("BitPos", size, before, after);
+
+    before = Throughput(size, [&] { ByteBitOp(kBitOpAnd, dest.data(), src.data(), size); });
+    after = Throughput(size, [&] { BitOpBytes(kBitOpAnd, dest.data(), src.data(), size); });
+    Report("BitOp", size, before, after);
+  }
+  return 0;
+}
@@ -0,0 +1,86 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <sys/stat.h>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+
+using namespace storage;
+
+const int KEY_NUM = 10000;
+const int ELEMENT_NUM = 100;
+const int ELEMENT_LENGTH = 20;
+
+// fixed length field/member, so both formats store the same user bytes
+static std::string BenchElement(int idx) {
+  std::string element = "element_" + std::to_string(idx);
+  element.resize(ELEMENT_LENGTH, 'e');
+  return element;
+}
+
+static std::string BenchKey(int idx) { return "format_bench_key_" + std::to_string(idx); }
+
+// Write KEY_NUM collections of ELEMENT_NUM elements in the given format and
+// report the on-disk bytes per element after a full compaction
+void BenchFormat(const std::string& name, DataFormat format,
+                 const std::function<void(Storage*, const std::string&)>& write_key) {
+  std::string path = "./db/format_bench_" + name + "_v" + std::to_string(static_cast<int>(format));
+  pstd::DeleteDirIfExist(path);
+  mkdir(path.c_str(), 0755);
+
+  StorageOptions storage_options;
+  storage_options.options.create_if_missing = true;
+  // measure the encoding itself rather than how well it compresses
+  storage_options.options.compression = rocksdb::kNoCompression;
+  storage_options.data_format = format;
+  auto db = std::make_unique<Storage>();
+  Status s = db->Open(storage_options, path);
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  for (int idx = 0; idx < KEY_NUM; ++idx) {
+    write_key(db.get(), BenchKey(idx));
+  }
+  db->Compact(DataType::kAll, true);
+
+  uint64_t sst_size = 0;
+  db->GetUsage("rocksdb.total-sst-files-size", &sst_size);
+  uint64_t elements = static_cast<uint64_t>(KEY_NUM) * ELEMENT_NUM;
+  std::cout << name << " v" << static_cast<int>(format) << ", elements " << elements << ", sst size " << sst_size
+            << " bytes, " << static_cast<double>(sst_size) / elements << " bytes per element" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  mkdir("./db", 0755);
+
+  std::vector<FieldValue> fvs;
+  std::vector<std::string> members;
+  std::vector<ScoreMember> score_members;
+  for (int idx = 0; idx < ELEMENT_NUM; ++idx) {
+    fvs.push_back({BenchElement(idx), std::string(ELEMENT_LENGTH, 'v')});
+    members.push_back(BenchElement(idx));
+    score_members.push_back({static_cast<double>(idx), BenchElement(idx)});
+  }
+
+  for (DataFormat format : {kDataFormatV1, kDataFormatV2}) {
+    BenchFormat("hash", format, [&](Storage* db, const std::string& key) { db->HMSet(key, fvs); });
+    BenchFormat("set", format, [&](Storage* db, const std::string& key) {
+      int32_t ret = 0;
+      db->SAdd(key, members, &ret);
+    });
+    BenchFormat("zset", format, [&](Storage* db, const std::string& key) {
+      int32_t ret = 0;
+      db->ZAdd(key, score_members, &ret);
+    });
+  }
+  return 0;
+}
@@ -0,0 +1,106 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+
+using namespace storage;
+using namespace std::chrono;
+
+const int KEY_NUM = 1000000;
+const int VALUE_LENGTH = 64;
+const int ROUNDS = 2000;
+
+static std::string BenchKey(int idx) { return "mget_bench_key_" + std::to_string(idx); }
+
+static void Report(const std::string& name, size_t batch, std::vector<int64_t>* costs) {
+  std::sort(costs->begin(), costs->end());
+  int64_t p50 = (*costs)[costs->size() * 50 / 100];
+  int64_t p99 = (*costs)[costs->size() * 99 / 100];
+  std::cout << name << " batch " << batch << ", rounds " << costs->size() << ", p50: " << p50 << "us, p99: " << p99
+            << "us" << std::endl;
+}
+
+// Compare the per instance MultiGet path of MGet/MGetWithTTL/Exists against
+// issuing one Get per key, for 10/100/1000 keys batch
+void BenchMGet(storage::Storage* db) {
+  printf("====== MGet ======\n");
+  std::mt19937 gen(1024);
+  std::uniform_int_distribution<int> dist(0, KEY_NUM - 1);
+
+  for (size_t batch : {10, 100, 1000}) {
+    std::vector<int64_t> get_costs;
+    std::vector<int64_t> mget_costs;
+    std::vector<int64_t> mget_ttl_costs;
+    std::vector<int64_t> exists_costs;
+    for (int round = 0; round < ROUNDS; ++round) {
+      std::vector<std::string> keys;
+      for (size_t idx = 0; idx < batch; ++idx) {
+        keys.push_back(BenchKey(dist(gen)));
+      }
+
+      auto start = steady_clock::now();
+      std::string value;
+      for (const auto& key : keys) {
+        db->Get(key, &value);
+      }
+      get_costs.push_back(duration_cast<microseconds>(steady_clock::now() - start).count());
+
+      std::vector<ValueStatus> vss;
+      start = steady_clock::now();
+      db->MGet(keys, &vss);
+      mget_costs.push_back(duration_cast<microseconds>(steady_clock::now() - start).count());
+
+      start = steady_clock::now();
+      db->MGetWithTTL(keys, &vss);
+      mget_ttl_costs.push_back(duration_cast<microseconds>(steady_clock::now() - start).count());
+
+      start = steady_clock::now();
+      db->Exists(keys);
+      exists_costs.push_back(duration_cast<microseconds>(steady_clock::now() - start).count());
+    }
+    Report("Get loop", batch, &get_costs);
+    Report("MGet", batch, &mget_costs);
+    Report("MGetWithTTL", batch, &mget_ttl_costs);
+    Report("Exists", batch, &exists_costs);
+  }
+}
+
+int main(int argc, char** argv) {
+  std::string path = "./db/mget_bench";
+  pstd::DeleteDirIfExist(path);
+  mkdir("./db", 0755);
+  mkdir(path.c_str(), 0755);
+
+  StorageOptions storage_options;
+  storage_options.options.create_if_missing = true;
+  storage::Storage db;
+  storage::Status s = db.Open(storage_options, path);
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return -1;
+  }
+
+  const std::string value(VALUE_LENGTH, 'v');
+  std::vector<KeyValue> kvs;
+  for (int idx = 0; idx < KEY_NUM; ++idx) {
+    kvs.push_back({BenchKey(idx), value});
+    if (kvs.size() == 1000) {
+      db.MSet(kvs);
+      kvs.clear();
+    }
+  }
+  db.Compact(DataType::kAll, true);
+
+  BenchMGet(&db);
+  return 0;
+}
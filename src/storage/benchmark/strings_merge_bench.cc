@@ -0,0 +1,106 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+
+using namespace storage;
+using namespace std::chrono;
+
+const int COUNTER_NUM = 100;
+const int APPEND_KEY_NUM = 100;
+const int APPEND_LENGTH = 64;
+const int OPS = 200000;
+
+static void Report(const std::string& name, std::vector<int64_t>* costs) {
+  std::sort(costs->begin(), costs->end());
+  int64_t total = 0;
+  for (auto cost : *costs) {
+    total += cost;
+  }
+  int64_t p50 = (*costs)[costs->size() * 50 / 100];
+  int64_t p99 = (*costs)[costs->size() * 99 / 100];
+  std::cout << name << ", ops " << costs->size() << ", qps: " << costs->size() * 1000000 / std::max<int64_t>(total, 1)
+            << ", p50: " << p50 << "us, p99: " << p99 << "us" << std::endl;
+}
+
+// Incrby on a few hot counters, Append to strings that keep growing, and
+// the Get of the folded values afterwards
+void BenchStringsMerge(bool strings_merge) {
+  printf("====== strings-merge %s ======\n", strings_merge ? "yes" : "no");
+  std::string path = strings_merge ? "./db/strings_merge_bench_yes" : "./db/strings_merge_bench_no";
+  pstd::DeleteDirIfExist(path);
+  mkdir(path.c_str(), 0755);
+
+  StorageOptions storage_options;
+  storage_options.options.create_if_missing = true;
+  storage_options.strings_merge = strings_merge;
+  storage::Storage db;
+  storage::Status s = db.Open(storage_options, path);
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+  for (int idx = 0; idx < COUNTER_NUM; ++idx) {
+    db.Set("counter_" + std::to_string(idx), "0");
+  }
+  for (int idx = 0; idx < APPEND_KEY_NUM; ++idx) {
+    db.Set("append_" + std::to_string(idx), "");
+  }
+
+  std::mt19937 gen(1024);
+  std::uniform_int_distribution<int> counter_dist(0, COUNTER_NUM - 1);
+  std::uniform_int_distribution<int> append_dist(0, APPEND_KEY_NUM - 1);
+  const std::string append_value(APPEND_LENGTH, 'v');
+
+  std::vector<int64_t> incrby_costs;
+  int64_t ret = 0;
+  int64_t etime = 0;
+  for (int op = 0; op < OPS; ++op) {
+    std::string key = "counter_" + std::to_string(counter_dist(gen));
+    auto start = steady_clock::now();
+    db.Incrby(key, 1, &ret, &etime);
+    incrby_costs.push_back(duration_cast<microseconds>(steady_clock::now() - start).count());
+  }
+  Report("Incrby", &incrby_costs);
+
+  std::vector<int64_t> append_costs;
+  int32_t len = 0;
+  std::string new_value;
+  for (int op = 0; op < OPS; ++op) {
+    std::string key = "append_" + std::to_string(append_dist(gen));
+    auto start = steady_clock::now();
+    db.Append(key, append_value, &len, &etime, new_value);
+    append_costs.push_back(duration_cast<microseconds>(steady_clock::now() - start).count());
+  }
+  Report("Append", &append_costs);
+
+  std::vector<int64_t> get_costs;
+  std::string value;
+  for (int idx = 0; idx < APPEND_KEY_NUM; ++idx) {
+    auto start = steady_clock::now();
+    db.Get("append_" + std::to_string(idx), &value);
+    get_costs.push_back(duration_cast<microseconds>(steady_clock::now() - start).count());
+  }
+  Report("Get after append", &get_costs);
+
+  uint64_t memtable_bytes = 0;
+  db.GetUsage(PROPERTY_TYPE_ROCKSDB_CUR_SIZE_ALL_MEM_TABLES, &memtable_bytes);
+  std::cout << "memtable bytes: " << memtable_bytes << std::endl;
+}
+
+int main(int argc, char** argv) {
+  mkdir("./db", 0755);
+  BenchStringsMerge(false);
+  BenchStringsMerge(true);
+  return 0;
+}
@@ -0,0 +1,86 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <sys/stat.h>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+
+using namespace storage;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+const int MEMBER_NUM = 1000000;
+const int BATCH_NUM = 1000;
+const int LOOP_NUM = 100;
+
+static std::string BenchMember(int idx) { return "member_" + std::to_string(idx); }
+
+static void Measure(const std::string& name, const std::function<void()>& op) {
+  auto start = steady_clock::now();
+  for (int loop = 0; loop < LOOP_NUM; ++loop) {
+    op();
+  }
+  auto cost = duration_cast<microseconds>(steady_clock::now() - start).count();
+  std::cout << "  " << name << ": " << static_cast<double>(cost) / LOOP_NUM << " us per call" << std::endl;
+}
+
+// Fill one zset with MEMBER_NUM members and time the rank based commands
+// deep into it, with and without the rank index
+void BenchRank(int32_t threshold) {
+  std::string path = "./db/zset_rank_bench_" + std::to_string(threshold);
+  pstd::DeleteDirIfExist(path);
+  mkdir(path.c_str(), 0755);
+
+  StorageOptions storage_options;
+  storage_options.options.create_if_missing = true;
+  storage_options.zset_rank_index_threshold = threshold;
+  auto db = std::make_unique<Storage>();
+  Status s = db->Open(storage_options, path);
+  if (!s.ok()) {
+    printf("Open db failed, error: %s\n", s.ToString().c_str());
+    return;
+  }
+
+  int32_t ret = 0;
+  std::vector<ScoreMember> score_members;
+  auto start = steady_clock::now();
+  for (int idx = 0; idx < MEMBER_NUM; ++idx) {
+    score_members.push_back({static_cast<double>(idx), BenchMember(idx)});
+    if (score_members.size() == BATCH_NUM) {
+      db->ZAdd("zset_rank_bench_key", score_members, &ret);
+      score_members.clear();
+    }
+  }
+  auto cost = duration_cast<microseconds>(steady_clock::now() - start).count();
+  std::cout << "threshold " << threshold << ", zadd " << MEMBER_NUM << " members: " << cost / 1000 << " ms"
+            << std::endl;
+
+  std::vector<ScoreMember> range;
+  Measure("zrange 900000 900010", [&]() {
+    range.clear();
+    db->ZRange("zset_rank_bench_key", 900000, 900010, &range);
+  });
+  Measure("zrevrange 900000 900010", [&]() {
+    range.clear();
+    db->ZRevrange("zset_rank_bench_key", 900000, 900010, &range);
+  });
+  int32_t rank = 0;
+  Measure("zrank", [&]() { db->ZRank("zset_rank_bench_key", BenchMember(900000), &rank); });
+  Measure("zrevrank", [&]() { db->ZRevrank("zset_rank_bench_key", BenchMember(100000), &rank); });
+}
+
+int main(int argc, char** argv) {
+  mkdir("./db", 0755);
+  BenchRank(0);
+  BenchRank(1024);
+  return 0;
+}
@@ -6,6 +6,8 @@
 #ifndef SRC_BACKUPABLE_H_
 #define SRC_BACKUPABLE_H_
 
+#include <atomic>
+#include <tuple>
 #include <utility>
 
 #include "rocksdb/db.h"
@@ -18,6 +20,9 @@ namespace storage {
 
 inline const std::string DEFAULT_BK_PATH = "dump";  // Default backup root dir
 inline const std::string DEFAULT_RS_PATH = "db";    // Default restore root dir
+// Written next to each instance dir of an incremental backup, one line
+// "file_name store_name size" per sst file of the instance
+inline const std::string kBackupManifestSuffix = ".manifest";
 
 // Arguments which will used by BackupSave Thread
 // p_engine for BackupEngine handler
@@ -40,10 +45,25 @@ struct BackupContent {
   uint64_t sequence_number = 0;
 };
 
+/*
+ * With an sst store dir the backups are incremental: every sst file is put
+ * once into the store, named by the identity of its db, its file number and
+ * its size, which name its content as sst files never change. A backup links
+ * its sst files from the store, so it only costs the files that are new
+ * since the last one, and records them in its manifests. Store files no
+ * backup links any more are deleted after each backup. The store should be
+ * on the file system of the backups, and of the db to not copy at all.
+ */
 class BackupEngine {
  public:
   ~BackupEngine();
-  static Status Open(Storage* db, std::shared_ptr<BackupEngine>& backup_engine_ret, int inst_count);
+  static Status Open(Storage* db, std::shared_ptr<BackupEngine>& backup_engine_ret, int inst_count,
+                     const std::string& sst_store_dir = "");
+
+  // Restores the instances of the backup into db_path, one thread each. The
+  // instance dirs must not exist yet, sst files are linked when possible and
+  // checked against the manifests of an incremental backup
+  static Status Restore(const std::string& backup_dir, const std::string& db_path, int inst_count);
 
   Status SetBackupContent();
 
@@ -59,9 +79,19 @@ class BackupEngine {
   std::map<int, std::unique_ptr<rocksdb::DBCheckpoint>> engines_;
   std::map<int, BackupContent> backup_content_;
   std::map<int, pthread_t> backup_pthread_ts_;
+  std::map<int, rocksdb::DB*> dbs_;
+  std::string sst_store_dir_;
+  // cleared once a backup had to copy a store file instead of linking it,
+  // the link counts then no longer tell which store files are in use
+  std::atomic<bool> store_linked_{true};
 
   Status NewCheckpoint(rocksdb::DB* rocksdb_db, int index);
-  std::string GetSaveDirByIndex(const std::string& _dir, int index) const {
+  Status CreateIncrementalBackup(const std::string& dir, int index);
+  // puts the sst files of the instance into the store, returns them as
+  // (file name, store name, size)
+  Status AddToStore(int index, std::vector<std::tuple<std::string, std::string, uint64_t>>* sst_files);
+  Status PurgeStore();
+  static std::string GetSaveDirByIndex(const std::string& _dir, int index) {
     std::string backup_dir = _dir.empty() ? DEFAULT_BK_PATH : _dir;
     return backup_dir + ((backup_dir.back() != '/') ? "/" : "") + std::to_string(index);
   }
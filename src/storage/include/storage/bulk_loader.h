@@ -0,0 +1,98 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_BULK_LOADER_H_
+#define SRC_BULK_LOADER_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "rocksdb/db.h"
+
+#include "storage.h"
+
+namespace storage {
+
+struct BulkLoadOptions {
+  // where the sorted runs and the merged files are written, on the file
+  // system of the db so that the ingestion moves the files instead of
+  // copying them. Removed by Finish
+  std::string work_dir;
+  // bytes of entries held in memory before they are sorted and written out
+  // as runs
+  size_t buffer_bytes = 256 << 20;
+  // bytes of the files the runs of one cf are merged into
+  uint64_t target_file_size = 256 << 20;
+  // threads writing the runs and merging them
+  int32_t worker_num = 4;
+};
+
+/*
+ * Loads whole keys into a storage without going through its write path.
+ * Each key is encoded as its write to a new key would encode it, meta value,
+ * member keys, type index and expiry index entries, and routed to the cf of
+ * its instance. The entries are sorted in memory, written to sst files as
+ * runs, and Finish merges the runs of each cf into files that do not
+ * overlap and ingests the files of each instance in one go.
+ *
+ * Nothing is visible before Finish, and an error before the ingestion
+ * leaves the storage as it was. The storage must not be written meanwhile,
+ * a loaded key replaces the key of the same name. A key can be added once
+ * per load, a second one fails Finish. Lists are loaded one element per
+ * key and zsets without a rank index, the key counters are reconciled at
+ * their next read.
+ */
+class BulkLoader {
+ public:
+  ~BulkLoader();
+  static Status Open(Storage* db, const BulkLoadOptions& options, std::unique_ptr<BulkLoader>& loader_ret);
+
+  // ttl_millsec > 0 gives the key an etime. Collections without members
+  // are skipped
+  Status Set(const Slice& key, const Slice& value, int64_t ttl_millsec = 0);
+  Status HMSet(const Slice& key, const std::vector<FieldValue>& fvs, int64_t ttl_millsec = 0);
+  Status SAdd(const Slice& key, const std::vector<std::string>& members, int64_t ttl_millsec = 0);
+  Status RPush(const Slice& key, const std::vector<std::string>& values, int64_t ttl_millsec = 0);
+  Status ZAdd(const Slice& key, const std::vector<ScoreMember>& score_members, int64_t ttl_millsec = 0);
+
+  Status Finish();
+
+  uint64_t Keys() const { return keys_; }
+  // entries of every cf added so far
+  uint64_t Entries() const { return entries_; }
+
+ private:
+  struct CFBuffer;
+  struct Instance;
+
+  BulkLoader(Storage* db, const BulkLoadOptions& options);
+
+  Instance* GetInstance(const Slice& key);
+  // puts the meta value with its index entries
+  void AddMeta(Instance* inst, const Slice& key, const Slice& meta_value);
+  void Add(Instance* inst, ColumnFamilyIndex cf, const Slice& key, const Slice& value);
+  Status MaybeSpill();
+  Status Spill();
+  Status SpillBuffer(Instance* inst, ColumnFamilyIndex cf, CFBuffer* buffer);
+  Status MergeRuns(Instance* inst, ColumnFamilyIndex cf, std::vector<std::string>* files);
+  std::string RunPath(int index, ColumnFamilyIndex cf, const std::string& name) const;
+  // runs the jobs on up to worker_num threads, the first error is returned
+  Status RunWorkers(const std::vector<std::function<Status()>>& jobs);
+
+  Storage* db_ = nullptr;
+  BulkLoadOptions options_;
+  std::map<int, std::unique_ptr<Instance>> insts_;
+  size_t buffered_bytes_ = 0;
+  uint64_t keys_ = 0;
+  uint64_t entries_ = 0;
+  bool finished_ = false;
+};
+
+}  //  namespace storage
+#endif  //  SRC_BULK_LOADER_H_
@@ -7,21 +7,43 @@
 #define __SLOT_INDEXER_H__
 
 #include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace storage {
-// Manage slots to rocksdb indexes
-// TODO(wangshaoyi): temporarily mock return
+/*
+ * Maps every slot to the rocksdb instance holding its keys. The table starts
+ * as slot % inst_num, where the keys went before it existed, and changes as
+ * slots migrate between instances. Every change bumps the epoch; the table
+ * is stored in every instance, instance 0 first, and the one of instance 0
+ * is taken at open, see Storage::MigrateSlots. Encoded as:
+ * | epoch | slot num | instance of slot 0 | ... | instance of slot n - 1 |
+ * |  8B   |    4B    |         4B         |     |          4B            |
+ */
 class SlotIndexer {
 public:
   SlotIndexer() = delete;
-  SlotIndexer(uint32_t inst_num) : inst_num_(inst_num) {}
+  SlotIndexer(uint32_t slot_num, uint32_t inst_num);
   ~SlotIndexer() {}
-  uint32_t GetInstanceID(uint32_t slot_id) {return slot_id % inst_num_; }
-  void ReshardSlots(const std::vector<uint32_t>& slots) {}
+
+  // readers run concurrently with SetInstanceID, which only the migration
+  // of the slot calls
+  uint32_t GetInstanceID(uint32_t slot_id) const { return table_[slot_id].load(std::memory_order_acquire); }
+  void SetInstanceID(uint32_t slot_id, uint32_t inst_id);
+  uint32_t SlotNum() const { return slot_num_; }
+  uint64_t Epoch() const { return epoch_.load(std::memory_order_acquire); }
+  std::vector<uint32_t> GetSlots(uint32_t inst_id) const;
+
+  std::string Encode() const;
+  // false when value is not a table of SlotNum() slots
+  bool Decode(const std::string& value);
 
 private:
-  uint32_t inst_num_ = 3;
+  uint32_t slot_num_ = 1024;
+  std::atomic<uint64_t> epoch_{0};
+  std::unique_ptr<std::atomic<uint32_t>[]> table_;
 };
 } // namespace storage end
 
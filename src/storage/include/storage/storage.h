@@ -7,10 +7,14 @@
 #define INCLUDE_STORAGE_STORAGE_H_
 
 #include <unistd.h>
+#include <condition_variable>
+#include <functional>
 #include <list>
 #include <map>
+#include <mutex>
 #include <queue>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -53,6 +57,8 @@ using Status = rocksdb::Status;
 using Slice = rocksdb::Slice;
 
 class Redis;
+class MemberCursor;
+struct ZSetsMergeInput;
 enum class OptionType;
 
 struct StreamAddTrimArgs;
@@ -74,6 +80,58 @@ struct StorageOptions {
   bool enable_db_statistics = false;
   size_t small_compaction_threshold = 5000;
   size_t small_compaction_duration_threshold = 10000;
+  // format of the hash/set/zset member keys and data values for newly created
+  // instances, an instance that already holds such data keeps its own format
+  DataFormat data_format = kDataFormatV1;
+  // entries of the per instance cache of meta versions shared by the data cf
+  // compaction filters, 0 disables it
+  size_t meta_version_cache_capacity = 100000;
+  // zsets with at least this many members get a rank index so that rank
+  // based commands skip whole blocks of members, 0 disables building new ones
+  int32_t zset_rank_index_threshold = 0;
+  // lists created from now on pack up to this many elements into one data
+  // key, 0 keeps one data key per element. Existing lists keep their encoding
+  int32_t list_chunk_size = 0;
+  // hashes of at most this many fields, none of them or their values longer
+  // than hash_max_inline_value, keep their fields in the meta value so that
+  // reading them takes one Get. 0 creates no new inline hashes
+  int32_t hash_max_inline_entries = 0;
+  int32_t hash_max_inline_value = 64;
+  // the same for the members of sets. Zsets keep one data key per member
+  int32_t set_max_inline_entries = 0;
+  int32_t set_max_inline_value = 64;
+  // instances walked at the same time by KEYS, pattern deletes and key
+  // counting, 1 walks them one after another
+  int32_t scan_worker_num = 1;
+  // keep per type key counters at write time, GetKeyNum reads them instead
+  // of walking the keys unless asked to verify
+  bool key_counters = false;
+  // incrby, incrbyfloat, append and setrange of an existing string write
+  // a merge operand of the change instead of the whole new value
+  bool strings_merge = false;
+  // bitmaps SETBIT grows past this many bytes are split into chunks of it,
+  // so that the bit commands touch the chunks they need only, 0 keeps
+  // every bitmap a plain string
+  int32_t bitmap_chunk_size = 0;
+  // keys put with a ttl get an entry in an expiry index and the background
+  // thread deletes up to this many due entries per second, so expired keys
+  // go away without being read or compacted. 0 disables both
+  int32_t expiry_reap_rate = 0;
+  // hashes, sets and zsets of at least this many members deleted by DEL or
+  // UNLINK get the data keys of their old version range deleted, and that
+  // range compacted, by the background thread. 0 leaves every old version
+  // to the compaction filters
+  int32_t lazyfree_range_threshold = 0;
+  // instances Open opens at the same time, 0 opens all of them at once
+  int32_t open_worker_num = 0;
+  // Open returns as soon as the slot table is loaded from instance 0 and
+  // the other instances go on opening in the background; a command waits
+  // for the instances of its keys only
+  bool lazy_open = false;
+  // bytes per second the sst files dropped by FlushDB and by compactions are
+  // deleted at, through an sst file manager shared by the instances. 0
+  // deletes them at once
+  int64_t sst_delete_rate_bytes = 0;
   struct CompactParam {
     // for LongestNotCompactionSstCompact function
     int compact_every_num_of_files_;
@@ -81,6 +139,9 @@ struct StorageOptions {
     int force_compact_min_delete_ratio_;
     int dont_compact_sst_created_in_seconds_;
     int best_delete_min_ratio_;
+    // entries expiring within this many seconds of an sst file being written
+    // are recorded in its properties, and count as deleted once all expired
+    int ttl_compact_horizon_seconds_ = 3600;
   };
   CompactParam compact_param_;
   Status ResetOptions(const OptionType& option_type, const std::unordered_map<std::string, std::string>& options_map);
@@ -149,6 +210,14 @@ struct ScoreMember {
   bool operator==(const ScoreMember& sm) const { return (sm.score == score && sm.member == member); }
 };
 
+// A slot moving from the src instance to the dst instance
+struct SlotMove {
+  uint32_t slot = 0;
+  uint32_t src = 0;
+  uint32_t dst = 0;
+  bool operator==(const SlotMove& move) const { return slot == move.slot && src == move.src && dst == move.dst; }
+};
+
 enum BeforeOrAfter { Before, After };
 
 enum class OptionType {
@@ -167,6 +236,8 @@ enum Operation {
   kCleanAll,
   kCompactRange,
   kCompactOldestOrBestDeleteRatioSst,
+  // argv is the key and the version of a deleted collection
+  kReclaimRange,
 };
 
 struct BGTask {
@@ -185,7 +256,10 @@ class Storage {
   Storage(int db_instance_num, int slot_num, bool is_classic_mode);
   ~Storage();
 
+  // Opens the instances, open_worker_num of them at a time. With lazy_open
+  // it returns once instance 0 and the slot table are loaded
   Status Open(const StorageOptions& storage_options, const std::string& db_path);
+  bool IsInstanceOpened(size_t inst_id);
 
   Status LoadCursorStartKey(const DataType& dtype, int64_t cursor, char* type, std::string* start_key);
 
@@ -277,7 +351,7 @@ class Storage {
   // Count the number of set bits (population counting) in a string.
   // return the number of bits set to 1
   // note: if need to specified offset, set have_range to true
-  Status BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int32_t* ret, bool have_range);
+  Status BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int64_t* ret, bool have_range);
 
   // Perform a bitwise operation between multiple keys
   // and store the result in the destination key
@@ -888,7 +962,7 @@ class Storage {
   //
   // If destination already exists, it is overwritten.
   Status ZUnionstore(const Slice& destination, const std::vector<std::string>& keys, const std::vector<double>& weights,
-                     AGGREGATE agg, std::map<std::string, double>& value_to_dest, int32_t* ret);
+                     AGGREGATE agg, std::vector<ScoreMember>& value_to_dest, int32_t* ret);
 
   // Computes the intersection of numkeys sorted sets given by the specified
   // keys, and stores the result in destination. It is mandatory to provide the
@@ -1090,6 +1164,22 @@ class Storage {
   Status DoCompactRange(const DataType& type, const std::string& start, const std::string& end);
   Status DoCompactSpecificKey(const DataType& type, const std::string& key);
 
+  /**
+   * FlushDB deletes every key of every instance in place, without closing
+   * them. The slot table and the index markers are kept, the files the
+   * deletion leaves are compacted away by the background thread. Commands
+   * must be held off by the caller.
+   * @return Status
+  */
+  Status FlushDB();
+
+  // Walks up to max_entries due expiry index entries, starting from the
+  // instance after the one the last call started from, and deletes the keys
+  // that have expired. Run by the background thread every
+  // kExpiryReapIntervalMs with expiry_reap_rate on
+  static constexpr int64_t kExpiryReapIntervalMs = 100;
+  Status ReapExpiredKeys(int64_t max_entries, int64_t* reaped);
+
   /**
    * LongestNotCompactionSstCompact will execute the compact command for any cf in the given type
    * @param type. data type like `kStrings`
@@ -1098,19 +1188,63 @@ class Storage {
   */
   Status LongestNotCompactionSstCompact(const DataType &type, bool sync = false);
 
+  /**
+   * ConvertDataFormat rewrites the hash/set/zset member keys and data values of
+   * every instance into target_format, it must run offline without writes.
+   * An interrupted conversion resumes when it is run again, or when the
+   * instance is opened next.
+   * @param converted. number of member keys rewritten
+   * @return Status
+  */
+  Status ConvertDataFormat(DataFormat target_format, uint64_t* converted);
+
+  // Runs fn with no command in flight, callers serving commands while slots
+  // migrate pass one that holds them off
+  using SlotBarrier = std::function<Status(const std::function<Status()>&)>;
+
+  /**
+   * MigrateSlots moves slots to the dst_inst instance while they keep being
+   * served from the one they are in. The keys of the slots are copied from a
+   * snapshot, then the keys written since are copied again until few are
+   * left. barrier runs the last copy and the switch of the slot table, the
+   * keys are deleted from the old instance afterwards. Slots already in
+   * dst_inst are skipped.
+   * @return Status
+  */
+  Status MigrateSlots(const std::vector<uint32_t>& slots, uint32_t dst_inst, const SlotBarrier& barrier = nullptr);
+
+  /**
+   * PlanSlotRebalance picks up to max_slots slots to move so the instances
+   * carry about the same load. The load of an instance is its share of the
+   * live data size plus its share of the bytes written since the last plan,
+   * spread evenly over its slots; slots go from the instance of most load to
+   * the one of least while that narrows the gap between the two.
+   * @return Status
+  */
+  Status PlanSlotRebalance(int64_t max_slots, std::vector<SlotMove>* moves);
+  // Plans the moves and migrates them, moved is the number of slots moved
+  Status RebalanceSlots(int64_t max_slots, const SlotBarrier& barrier, int64_t* moved);
+  uint32_t GetSlotInstance(uint32_t slot_id) const { return slot_indexer_->GetInstanceID(slot_id); }
+
   Status SetMaxCacheStatisticKeys(uint32_t max_cache_statistic_keys);
   Status SetSmallCompactionThreshold(uint32_t small_compaction_threshold);
   Status SetSmallCompactionDurationThreshold(uint32_t small_compaction_duration_threshold);
 
   std::string GetCurrentTaskType();
+  // kReclaimRange tasks queued or running
+  uint64_t GetPendingReclaimRanges() const { return pending_reclaim_ranges_; }
   Status GetUsage(const std::string& property, uint64_t* result);
   Status GetUsage(const std::string& property, std::map<int, uint64_t>* type_result);
   uint64_t GetProperty(const std::string& property);
 
-  Status GetKeyNum(std::vector<KeyInfo>* key_infos);
+  // With key counters, verify walks the keys and corrects the counters
+  Status GetKeyNum(std::vector<KeyInfo>* key_infos, bool verify = false);
   Status StopScanKeyNum();
 
   rocksdb::DB* GetDBByIndex(int index);
+  // The format the instance writes member data in, an instance holding data
+  // keeps its own format whatever StorageOptions::data_format says
+  DataFormat GetDataFormat(int index);
 
   Status SetOptions(const OptionType& option_type, const std::string& db_type,
                     const std::unordered_map<std::string, std::string>& options);
@@ -1124,6 +1258,8 @@ class Storage {
   const StorageOptions& GetStorageOptions();
   // get hash cf handle in insts_[idx]
   std::vector<rocksdb::ColumnFamilyHandle*> GetHashCFHandles(const int idx);
+  // get list cf handle in insts_[idx]
+  std::vector<rocksdb::ColumnFamilyHandle*> GetListCFHandles(const int idx);
   // get DefaultWriteOptions in insts_[idx]
   rocksdb::WriteOptions GetDefaultWriteOptions(const int idx) const;
 
@@ -1131,6 +1267,15 @@ class Storage {
   std::vector<std::unique_ptr<Redis>> insts_;
   std::unique_ptr<SlotIndexer> slot_indexer_;
   std::atomic<bool> is_opened_ = {false};
+  // the instances done opening, see Open. A caller of an instance not done
+  // waits on open_cv_ until it is
+  std::mutex open_mutex_;
+  std::condition_variable open_cv_;
+  std::vector<bool> inst_opened_;
+  bool slot_table_loaded_ = false;
+  Status slot_table_status_;
+  std::atomic<bool> all_opened_ = {false};
+  std::thread open_thread_;
   int db_instance_num_ = 3;
   int slot_num_ = 1024;
   bool is_classic_mode_ = true;
@@ -1146,10 +1291,46 @@ class Storage {
 
   std::atomic<int> current_task_type_ = {kNone};
   std::atomic<bool> bg_tasks_should_exit_ = {false};
+  // the thread starts before Open sets the options
+  std::atomic<int32_t> expiry_reap_rate_ = {0};
+  std::atomic<size_t> reap_cursor_ = {0};
+  std::atomic<uint64_t> pending_reclaim_ranges_ = {0};
+
+  // one slot migration or rebalance plan at a time
+  std::mutex slot_migration_mutex_;
+  // bytes written by every instance as of the last rebalance plan
+  std::vector<uint64_t> rebalance_written_bytes_;
+  // Opens instance inst_id and brings it in line with the slot table,
+  // which the open of instance 0 loads
+  Status OpenInstance(size_t inst_id, const std::string& db_path);
+  // Runs OpenInstance on every instance, open_worker_num at a time
+  Status OpenInstances(const std::string& db_path);
+  // Takes the slot table of instance 0, which has the newest one
+  Status LoadSlotTable();
+  // Stores the slot table in instance inst_id if it has another one, and
+  // deletes the keys migrations left in it of slots it does not own
+  Status SettleInstanceSlots(size_t inst_id);
+  void WaitInstanceOpened(size_t inst_id);
+  void WaitInstancesOpened();
+  Status MigrateInstanceSlots(const std::vector<uint32_t>& slots, uint32_t src_inst, uint32_t dst_inst,
+                              const SlotBarrier& barrier);
 
   // For scan keys in data base
   std::atomic<bool> scan_keynum_exit_ = {false};
   Status MGetWithTTL(const Slice& key, std::string* value, int64_t* ttl_millsec);
+  // The cursors of the sets of keys in order, each on the instance of its
+  // key, nullptr for the missing or empty ones
+  Status NewSetsMemberCursors(const std::vector<std::string>& keys,
+                              std::vector<std::unique_ptr<MemberCursor>>* cursors);
+  // The zset merge inputs of keys in order, each on the instance of its key,
+  // without cursor for the missing or empty ones
+  Status NewZSetsMergeInputs(const std::vector<std::string>& keys, const std::vector<double>& weights,
+                             std::vector<ZSetsMergeInput>* inputs);
+  // Bucket the positions of keys by the index of the instance that owns them
+  void GroupKeysByInstance(const std::vector<std::string>& keys, std::vector<std::vector<size_t>>* key_indexes);
+  void GroupKeyValuesByInstance(const std::vector<KeyValue>& kvs, std::vector<std::vector<KeyValue>>* inst_kvs);
+  // Runs fn on the index of every instance, scan_worker_num of them at a time
+  Status ForEachInstance(const std::function<Status(size_t)>& fn);
 };
 
 }  //  namespace storage
@@ -32,6 +32,22 @@ const int kListValueIndexLength = 16;
 const int kTypeLength = 1;
 const int kTimestampLength = 8;
 
+/*
+ * On-disk format of hash/set/zset member keys and their data values.
+ * kDataFormatV1 pads every key with reserve1(8B) + reserve2(16B) and every
+ * value with reserve(16B) + ctime(8B).
+ * kDataFormatV2 drops the padding, the key starts with a 1B format tag in
+ * place of reserve1 and the value ends with the same 1B tag, so both keys
+ * and values are self-describing and can be parsed without knowing the
+ * format of the instance they come from.
+ */
+enum DataFormat : uint8_t {
+  kDataFormatV1 = 1,
+  kDataFormatV2 = 2,
+};
+const char kDataFormatV2Tag = static_cast<char>(kDataFormatV2);
+const int kDataFormatTagLength = 1;
+
 /*
  * kMetaCF is used to store the metadata of all types of
  * data and all information of type string
@@ -44,6 +60,11 @@ enum ColumnFamilyIndex {
   kZsetsDataCF = 4,
   kZsetsScoreCF = 5,
   kStreamsDataCF = 6,
+  kZsetsRankCF = 7,
+  kTypeIndexCF = 8,
+  kKeyStatsCF = 9,
+  kBitmapsDataCF = 10,
+  kExpiryIndexCF = 11,
 };
 
 const static char kNeedTransformCharacter = '\u0000';
@@ -76,8 +97,11 @@ inline char* EncodeUserKey(const Slice& user_key, char* dst_ptr, size_t nzero) {
       pos = i + 1;
     }
   }
+  // older versions did not advance past this tail, so the delimiter overwrote it.
+  // keys they wrote with bytes after the last \u0000 must be reloaded after upgrade.
   if (pos != user_key.size()) {
     memcpy(dst_ptr, user_data + pos, user_key.size() - pos);
+    dst_ptr += user_key.size() - pos;
   }
 
   memcpy(dst_ptr, kEncodedKeyDelim, 2);
@@ -131,5 +155,14 @@ inline const char* SeekUserkeyDelim(const char* ptr, int length) {
     return ptr;
 }
 
+// v1 data keys start with a zero reserve1, v2 data keys with kDataFormatV2Tag
+inline bool IsDataFormatV2Key(const Slice& key) {
+  return !key.empty() && key.data()[0] == kDataFormatV2Tag;
+}
+
+inline size_t DataKeyPrefixLength(const Slice& key) {
+  return IsDataFormatV2Key(key) ? kDataFormatTagLength : kPrefixReserveLength;
+}
+
 } // end namespace storage
 #endif
@@ -4,13 +4,125 @@
 //  of patent rights can be found in the PATENTS file in the same directory.
 //
 #include <dirent.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 
+#include <glog/logging.h>
+
+#include "file/file_util.h"
+#include "pstd/include/env.h"
+
 #include "storage/backupable.h"
 #include "storage/storage.h"
 
 namespace storage {
 
+namespace {
+
+bool IsTableFile(const std::string& fname) {
+  return fname.size() > 4 && fname.compare(fname.size() - 4, 4, ".sst") == 0;
+}
+
+// hard links src to dst, copies it where links are not supported
+Status LinkOrCopyFile(const std::string& src, const std::string& dst, uint64_t size, bool* linked) {
+  rocksdb::Env* env = rocksdb::Env::Default();
+  Status s = env->LinkFile(src, dst);
+  *linked = s.ok();
+  if (s.IsNotSupported()) {
+    s = rocksdb::CopyFile(rocksdb::FileSystem::Default().get(), src, dst, size, false, nullptr,
+                          rocksdb::Temperature::kUnknown);
+  }
+  return s;
+}
+
+Status ReadBackupManifest(const std::string& path, std::unordered_map<std::string, uint64_t>* sst_sizes) {
+  std::ifstream in(path);
+  if (!in.is_open()) {
+    return Status::NotFound("backup manifest " + path);
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string fname;
+    std::string store_name;
+    uint64_t size = 0;
+    if (!(fields >> fname >> store_name >> size)) {
+      return Status::Corruption("bad line in backup manifest " + path + ": " + line);
+    }
+    (*sst_sizes)[fname] = size;
+  }
+  return Status::OK();
+}
+
+Status RestoreInstance(const std::string& src_dir, const std::string& manifest_path, const std::string& dst_dir) {
+  rocksdb::Env* env = rocksdb::Env::Default();
+  if (env->FileExists(dst_dir).ok()) {
+    return Status::InvalidArgument("restore dir exists: " + dst_dir);
+  }
+  // a full backup has no manifest, its files are taken as they are
+  std::unordered_map<std::string, uint64_t> sst_sizes;
+  bool incremental = env->FileExists(manifest_path).ok();
+  Status s;
+  if (incremental) {
+    s = ReadBackupManifest(manifest_path, &sst_sizes);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  std::vector<std::string> children;
+  s = env->GetChildren(src_dir, &children);
+  if (!s.ok()) {
+    return s;
+  }
+  std::string tmp_dir = dst_dir + ".tmp";
+  pstd::DeleteDirIfExist(tmp_dir);
+  s = env->CreateDir(tmp_dir);
+  size_t restored_ssts = 0;
+  for (size_t idx = 0; s.ok() && idx < children.size(); ++idx) {
+    const std::string& fname = children[idx];
+    if (fname == "." || fname == "..") {
+      continue;
+    }
+    std::string src = src_dir + "/" + fname;
+    uint64_t size = 0;
+    s = env->GetFileSize(src, &size);
+    if (!s.ok()) {
+      break;
+    }
+    bool linked = false;
+    if (IsTableFile(fname)) {
+      if (incremental) {
+        auto iter = sst_sizes.find(fname);
+        if (iter == sst_sizes.end() || iter->second != size) {
+          s = Status::Corruption("sst file does not match the backup manifest: " + src);
+          break;
+        }
+        restored_ssts++;
+      }
+      s = LinkOrCopyFile(src, tmp_dir + "/" + fname, size, &linked);
+    } else {
+      s = rocksdb::CopyFile(rocksdb::FileSystem::Default().get(), src, tmp_dir + "/" + fname, 0, false, nullptr,
+                            rocksdb::Temperature::kUnknown);
+    }
+  }
+  if (s.ok() && restored_ssts != sst_sizes.size()) {
+    s = Status::Corruption("sst files missing from backup " + src_dir);
+  }
+  if (s.ok()) {
+    s = env->RenameFile(tmp_dir, dst_dir);
+  }
+  if (!s.ok()) {
+    pstd::DeleteDirIfExist(tmp_dir);
+  }
+  return s;
+}
+
+}  // namespace
+
 BackupEngine::~BackupEngine() {
   // Wait all children threads
   StopBackup();
@@ -27,12 +139,20 @@ Status BackupEngine::NewCheckpoint(rocksdb::DB* rocksdb_db, int index) {
   return s;
 }
 
-Status BackupEngine::Open(storage::Storage* storage, std::shared_ptr<BackupEngine>& backup_engine_ret, int inst_count) {
+Status BackupEngine::Open(storage::Storage* storage, std::shared_ptr<BackupEngine>& backup_engine_ret, int inst_count,
+                          const std::string& sst_store_dir) {
   // BackupEngine() is private, can't use make_shared
   backup_engine_ret = std::shared_ptr<BackupEngine>(new BackupEngine());
   if (!backup_engine_ret) {
     return Status::Corruption("New BackupEngine failed!");
   }
+  if (!sst_store_dir.empty()) {
+    if (pstd::CreatePath(sst_store_dir) != 0) {
+      backup_engine_ret = nullptr;
+      return Status::IOError("create sst store dir failed: " + sst_store_dir);
+    }
+    backup_engine_ret->sst_store_dir_ = sst_store_dir;
+  }
 
   // Create BackupEngine for each rocksdb instance
   rocksdb::Status s;
@@ -44,6 +164,7 @@ Status BackupEngine::Open(storage::Storage* storage, std::shared_ptr<BackupEngin
 
     if (s.ok()) {
       s = backup_engine_ret->NewCheckpoint(rocksdb_db, index);
+      backup_engine_ret->dbs_[index] = rocksdb_db;
     }
 
     if (!s.ok()) {
@@ -74,6 +195,9 @@ Status BackupEngine::CreateNewBackupSpecify(const std::string& backup_dir, int i
   auto it_content = backup_content_.find(index);
   std::string dir = GetSaveDirByIndex(backup_dir, index);
   delete_dir(dir.c_str());
+  if (!sst_store_dir_.empty()) {
+    return CreateIncrementalBackup(dir, index);
+  }
 
   if (it_content != backup_content_.end() && it_engine != engines_.end()) {
     Status s = it_engine->second->CreateCheckpointWithFiles(
@@ -90,6 +214,151 @@ Status BackupEngine::CreateNewBackupSpecify(const std::string& backup_dir, int i
   return Status::OK();
 }
 
+Status BackupEngine::AddToStore(int index, std::vector<std::tuple<std::string, std::string, uint64_t>>* sst_files) {
+  rocksdb::DB* db = dbs_[index];
+  rocksdb::Env* env = db->GetEnv();
+  std::string identity;
+  Status s = db->GetDbIdentity(identity);
+  if (!s.ok()) {
+    return s;
+  }
+  for (const auto& live_file : backup_content_[index].live_files) {
+    if (!IsTableFile(live_file)) {
+      continue;
+    }
+    // live files start with "/"
+    std::string fname = live_file.substr(1);
+    std::string src = db->GetName() + live_file;
+    uint64_t size = 0;
+    s = env->GetFileSize(src, &size);
+    if (!s.ok()) {
+      return s;
+    }
+    std::string store_name = identity + "_" + fname.substr(0, fname.size() - 4) + "_" + std::to_string(size) + ".sst";
+    std::string store_path = sst_store_dir_ + "/" + store_name;
+    sst_files->emplace_back(fname, store_name, size);
+    uint64_t store_size = 0;
+    if (env->GetFileSize(store_path, &store_size).ok() && store_size == size) {
+      continue;
+    }
+    // a copy goes through a tmp file, so the store never holds part of one
+    std::string tmp_path = store_path + ".tmp";
+    env->DeleteFile(tmp_path);
+    bool linked = false;
+    s = LinkOrCopyFile(src, tmp_path, size, &linked);
+    if (s.ok()) {
+      s = env->RenameFile(tmp_path, store_path);
+    }
+    if (!s.ok()) {
+      env->DeleteFile(tmp_path);
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status BackupEngine::CreateIncrementalBackup(const std::string& dir, int index) {
+  auto it_engine = engines_.find(index);
+  auto it_content = backup_content_.find(index);
+  if (it_content == backup_content_.end() || it_engine == engines_.end()) {
+    return Status::Corruption("Invalid db index");
+  }
+  // the file deletions SetBackupContent disabled are enabled again by the
+  // checkpoint, the sst files have to be in the store by then
+  std::vector<std::tuple<std::string, std::string, uint64_t>> sst_files;
+  Status s = AddToStore(index, &sst_files);
+  if (!s.ok()) {
+    dbs_[index]->EnableFileDeletions(false);
+    return s;
+  }
+  std::vector<std::string> other_files;
+  for (const auto& live_file : it_content->second.live_files) {
+    if (!IsTableFile(live_file)) {
+      other_files.push_back(live_file);
+    }
+  }
+  s = it_engine->second->CreateCheckpointWithFiles(dir, other_files, it_content->second.live_wal_files,
+                                                   it_content->second.manifest_file_size,
+                                                   it_content->second.sequence_number);
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::string manifest;
+  for (const auto& [fname, store_name, size] : sst_files) {
+    bool linked = false;
+    s = LinkOrCopyFile(sst_store_dir_ + "/" + store_name, dir + "/" + fname, size, &linked);
+    if (!s.ok()) {
+      break;
+    }
+    if (!linked) {
+      store_linked_ = false;
+    }
+    manifest.append(fname + " " + store_name + " " + std::to_string(size) + "\n");
+  }
+  if (s.ok()) {
+    std::string manifest_path = dir + kBackupManifestSuffix;
+    s = rocksdb::WriteStringToFile(rocksdb::Env::Default(), manifest, manifest_path + ".tmp", true);
+    if (s.ok()) {
+      s = rocksdb::Env::Default()->RenameFile(manifest_path + ".tmp", manifest_path);
+    }
+  }
+  if (!s.ok()) {
+    delete_dir(dir.c_str());
+    return s;
+  }
+  LOG(INFO) << "incremental backup of instance " << index << " links " << sst_files.size() << " sst files";
+  return Status::OK();
+}
+
+Status BackupEngine::PurgeStore() {
+  if (!store_linked_) {
+    LOG(WARNING) << "sst store " << sst_store_dir_ << " is copied from, not purged";
+    return Status::OK();
+  }
+  std::vector<std::string> children;
+  if (pstd::GetChildren(sst_store_dir_, children) != 0) {
+    return Status::IOError("list sst store failed: " + sst_store_dir_);
+  }
+  // a store file with no other link is in no backup, nor in the db
+  uint64_t purged = 0;
+  for (const auto& child : children) {
+    std::string path = sst_store_dir_ + "/" + child;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink <= 1) {
+      pstd::DeleteFile(path);
+      purged++;
+    }
+  }
+  LOG(INFO) << "purged " << purged << " files from sst store " << sst_store_dir_;
+  return Status::OK();
+}
+
+Status BackupEngine::Restore(const std::string& backup_dir, const std::string& db_path, int inst_count) {
+  if (pstd::CreatePath(db_path) != 0) {
+    return Status::IOError("create restore dir failed: " + db_path);
+  }
+  std::vector<Status> statuses(inst_count);
+  std::vector<std::thread> workers;
+  workers.reserve(inst_count);
+  for (int index = 0; index < inst_count; ++index) {
+    workers.emplace_back([&, index]() {
+      std::string src_dir = GetSaveDirByIndex(backup_dir, index);
+      statuses[index] =
+          RestoreInstance(src_dir, src_dir + kBackupManifestSuffix, GetSaveDirByIndex(db_path, index));
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  for (const auto& s : statuses) {
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
 void* ThreadFuncSaveSpecify(void* arg) {
   auto arg_ptr = static_cast<BackupSaveArgs*>(arg);
   auto p = static_cast<BackupEngine*>(arg_ptr->p_engine);
@@ -137,6 +406,9 @@ Status BackupEngine::CreateNewBackup(const std::string& dir) {
     StopBackup();
   }
   s = WaitBackupPthread();
+  if (s.ok() && !sst_store_dir_.empty()) {
+    s = PurgeStore();
+  }
 
   return s;
 }
@@ -14,14 +14,18 @@ namespace storage {
 using Slice = rocksdb::Slice;
 /*
 * used for Hash/Set/Zset's member data key. format:
+* kDataFormatV1:
 * | reserve1 | key | version | data | reserve2 |
 * |    8B    |     |    8B   |      |   16B    |
+* kDataFormatV2:
+* |  tag  | key | version | data |
+* |  1B   |     |    8B   |      |
 */
 class BaseDataKey {
  public:
   BaseDataKey(const Slice& key,
-             uint64_t version, const Slice& data)
-      : key_(key), version_(version), data_(data) {}
+             uint64_t version, const Slice& data, DataFormat format = kDataFormatV1)
+      : key_(key), version_(version), data_(data), format_(format) {}
 
   ~BaseDataKey() {
     if (start_ != space_) {
@@ -30,7 +34,7 @@ class BaseDataKey {
   }
 
   Slice EncodeSeekKey() {
-    size_t meta_size = sizeof(reserve1_) + sizeof(version_);
+    size_t meta_size = PrefixLength() + sizeof(version_);
     size_t usize = key_.size() + data_.size() + kEncodedKeyDelimSize;
     size_t nzero = std::count(key_.data(), key_.data() + key_.size(), kNeedTransformCharacter);
     usize += nzero;
@@ -48,9 +52,8 @@ class BaseDataKey {
     }
 
     start_ = dst;
-    // reserve1: 8 byte
-    memcpy(dst, reserve1_, sizeof(reserve1_));
-    dst += sizeof(reserve1_);
+    // reserve1: 8 byte, or the format tag: 1 byte
+    dst = EncodePrefix(dst);
     // key
     dst = EncodeUserKey(key_, dst, nzero);
     // version 8 byte
@@ -63,7 +66,7 @@ class BaseDataKey {
   }
 
   Slice Encode() {
-    size_t meta_size = sizeof(reserve1_) + sizeof(version_) + sizeof(reserve2_);
+    size_t meta_size = PrefixLength() + sizeof(version_) + SuffixLength();
     size_t usize = key_.size() + data_.size() + kEncodedKeyDelimSize;
     size_t nzero = std::count(key_.data(), key_.data() + key_.size(), kNeedTransformCharacter);
     usize += nzero;
@@ -81,9 +84,8 @@ class BaseDataKey {
     }
 
     start_ = dst;
-    // reserve1: 8 byte
-    memcpy(dst, reserve1_, sizeof(reserve1_));
-    dst += sizeof(reserve1_);
+    // reserve1: 8 byte, or the format tag: 1 byte
+    dst = EncodePrefix(dst);
     // key
     dst = EncodeUserKey(key_, dst, nzero);
     // version 8 byte
@@ -93,12 +95,25 @@ class BaseDataKey {
     memcpy(dst, data_.data(), data_.size());
     dst += data_.size();
     // TODO(wangshaoyi): too much for reserve
-    // reserve2: 16 byte
-    memcpy(dst, reserve2_, sizeof(reserve2_));
+    // reserve2: 16 byte, kDataFormatV2 has no reserve2
+    memcpy(dst, reserve2_, SuffixLength());
     return Slice(start_, needed);
   }
 
  private:
+  size_t PrefixLength() const { return format_ == kDataFormatV2 ? kDataFormatTagLength : sizeof(reserve1_); }
+
+  size_t SuffixLength() const { return format_ == kDataFormatV2 ? 0 : sizeof(reserve2_); }
+
+  char* EncodePrefix(char* dst) const {
+    if (format_ == kDataFormatV2) {
+      *dst = kDataFormatV2Tag;
+    } else {
+      memcpy(dst, reserve1_, sizeof(reserve1_));
+    }
+    return dst + PrefixLength();
+  }
+
   char* start_ = nullptr;
   char space_[200];
   char reserve1_[8] = {0};
@@ -106,6 +121,7 @@ class BaseDataKey {
   uint64_t version_ = uint64_t(-1);
   Slice data_;
   char reserve2_[16] = {0};
+  DataFormat format_ = kDataFormatV1;
 };
 
 class ParsedBaseDataKey {
@@ -124,10 +140,15 @@ class ParsedBaseDataKey {
 
   void decode(const char* ptr, const char* end_ptr) {
     const char* start = ptr;
-    // skip head reserve1_
-    ptr += sizeof(reserve1_);
-    // skip tail reserve2_
-    end_ptr -= kSuffixReserveLength;
+    if (IsDataFormatV2Key(Slice(ptr, std::distance(ptr, end_ptr)))) {
+      // skip head format tag, kDataFormatV2 has no reserve2_
+      ptr += kDataFormatTagLength;
+    } else {
+      // skip head reserve1_
+      ptr += sizeof(reserve1_);
+      // skip tail reserve2_
+      end_ptr -= kSuffixReserveLength;
+    }
     // user key
     ptr = DecodeUserKey(ptr, std::distance(ptr, end_ptr), &key_str_);
 
@@ -19,19 +19,33 @@
 namespace storage {
 /*
 * hash/set/zset/list data value format
+* kDataFormatV1:
 * | value | reserve | ctime |
 * |       |   16B   |   8B  |
+* kDataFormatV2:
+* | value | tag |
+* |       |  1B |
+* the last byte of a v1 value is the high byte of ctime, which is either
+* 0 or has the top bit set, so it never equals kDataFormatV2Tag
 */
 class BaseDataValue : public InternalValue {
 public:
  /*
   * The header of the Value field is initially initialized to knulltype
   */
-  explicit BaseDataValue(const rocksdb::Slice& user_value) : InternalValue(DataType::kNones, user_value) {}
+  explicit BaseDataValue(const rocksdb::Slice& user_value, DataFormat format = kDataFormatV1)
+      : InternalValue(DataType::kNones, user_value), format_(format) {}
   virtual ~BaseDataValue() {}
 
   virtual rocksdb::Slice Encode() {
     size_t usize = user_value_.size();
+    if (format_ == kDataFormatV2) {
+      size_t needed = usize + kDataFormatTagLength;
+      char* dst = ReAllocIfNeeded(needed);
+      memcpy(dst, user_value_.data(), usize);
+      dst[usize] = kDataFormatV2Tag;
+      return rocksdb::Slice(dst, needed);
+    }
     size_t needed = usize + kSuffixReserveLength + kTimestampLength;
     char* dst = ReAllocIfNeeded(needed);
     char* start_pos = dst;
@@ -48,6 +62,7 @@ public:
 
 private:
   const size_t kDefaultValueSuffixLength = kSuffixReserveLength + kTimestampLength;
+  DataFormat format_ = kDataFormatV1;
 };
 
 class ParsedBaseDataValue : public ParsedInternalValue {
@@ -56,12 +71,7 @@ public:
   // the implement of user interfaces and may need to modify the
   // original value suffix, so the value_ must point to the string
   explicit ParsedBaseDataValue(std::string* value) : ParsedInternalValue(value) {
-    if (value_->size() >= kBaseDataValueSuffixLength) {
-      user_value_ = rocksdb::Slice(value_->data(), value_->size() - kBaseDataValueSuffixLength);
-      memcpy(reserve_, value_->data() + user_value_.size(), kSuffixReserveLength);
-      uint64_t ctime = DecodeFixed64(value_->data() + user_value_.size() + kSuffixReserveLength);
-      ctime_ = (ctime & ~(1ULL << 63));
-    }
+    DecodeSuffix(value_->data(), value_->size());
   }
 
   // Use this constructor in rocksdb::CompactionFilter::Filter(),
@@ -69,12 +79,7 @@ public:
   // the rocksdb::Slice, so don't need to modify the original value, value_ can be
   // set to nullptr
   explicit ParsedBaseDataValue(const rocksdb::Slice& value) : ParsedInternalValue(value)  {
-    if (value.size() >= kBaseDataValueSuffixLength) {
-      user_value_ = rocksdb::Slice(value.data(), value.size() - kBaseDataValueSuffixLength);
-      memcpy(reserve_, value.data() + user_value_.size(), kSuffixReserveLength);
-      uint64_t ctime = DecodeFixed64(value.data() + user_value_.size() + kSuffixReserveLength);
-      ctime_ = (ctime & ~(1ULL << 63));
-    }
+    DecodeSuffix(value.data(), value.size());
   }
 
   virtual ~ParsedBaseDataValue() = default;
@@ -82,7 +87,7 @@ public:
   void SetEtimeToValue() override {}
 
   void SetCtimeToValue() override {
-    if (value_) {
+    if (value_ && format_ == kDataFormatV1) {
       char* dst = const_cast<char*>(value_->data()) + value_->size() - kTimestampLength;
       uint64_t ctime = ctime_ > 0 ? (ctime_ | (1ULL << 63)) : 0;
       EncodeFixed64(dst, ctime);
@@ -90,7 +95,7 @@ public:
   }
 
   void SetReserveToValue() {
-    if (value_) {
+    if (value_ && format_ == kDataFormatV1) {
       char* dst = const_cast<char*>(value_->data()) + value_->size() - kBaseDataValueSuffixLength;
       memcpy(dst, reserve_, kSuffixReserveLength);
     }
@@ -98,17 +103,34 @@ public:
 
   virtual void StripSuffix() override {
     if (value_) {
-      value_->erase(value_->size() - kBaseDataValueSuffixLength, kBaseDataValueSuffixLength);
+      value_->erase(value_->size() - suffix_length_, suffix_length_);
     }
   }
 
   static size_t GetkBaseDataValueSuffixLength() { return kBaseDataValueSuffixLength; }
 
+  DataFormat Format() { return format_; }
+
 protected:
   virtual void SetVersionToValue() override {};
 
 private:
+  void DecodeSuffix(const char* ptr, size_t size) {
+    if (size > 0 && ptr[size - 1] == kDataFormatV2Tag) {
+      format_ = kDataFormatV2;
+      suffix_length_ = kDataFormatTagLength;
+      user_value_ = rocksdb::Slice(ptr, size - kDataFormatTagLength);
+    } else if (size >= kBaseDataValueSuffixLength) {
+      user_value_ = rocksdb::Slice(ptr, size - kBaseDataValueSuffixLength);
+      memcpy(reserve_, ptr + user_value_.size(), kSuffixReserveLength);
+      uint64_t ctime = DecodeFixed64(ptr + user_value_.size() + kSuffixReserveLength);
+      ctime_ = (ctime & ~(1ULL << 63));
+    }
+  }
+
   static const size_t kBaseDataValueSuffixLength = kSuffixReserveLength + kTimestampLength;
+  DataFormat format_ = kDataFormatV1;
+  size_t suffix_length_ = kBaseDataValueSuffixLength;
 };
 
 }  //  namespace storage
@@ -20,12 +20,13 @@
 #include "src/strings_value_format.h"
 #include "src/zsets_data_key_format.h"
 #include "src/debug.h"
+#include "src/meta_version_cache.h"
 
 namespace storage {
 
 class BaseMetaFilter : public rocksdb::CompactionFilter {
  public:
-  BaseMetaFilter() = default;
+  explicit BaseMetaFilter(MetaVersionCache* meta_version_cache = nullptr) : meta_version_cache_(meta_version_cache) {}
   bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value,
               bool* value_changed) const override {
     auto cur_time = pstd::NowMillis();
@@ -70,6 +71,7 @@ class BaseMetaFilter : public rocksdb::CompactionFilter {
       }
       if (parsed_lists_meta_value.Count() == 0 && parsed_lists_meta_value.Version() < cur_time) {
         DEBUG("Drop[Empty & version < cur_time]");
+        AddDroppedVersion(parsed_key.Key(), parsed_lists_meta_value.Version());
         return true;
       }
       DEBUG("Reserve");
@@ -87,6 +89,7 @@ class BaseMetaFilter : public rocksdb::CompactionFilter {
       }
       if (parsed_base_meta_value.Count() == 0 && parsed_base_meta_value.Version() < cur_time) {
         DEBUG("Drop[Empty & version < cur_time]");
+        AddDroppedVersion(parsed_key.Key(), parsed_base_meta_value.Version());
         return true;
       }
       DEBUG("Reserve");
@@ -95,24 +98,45 @@ class BaseMetaFilter : public rocksdb::CompactionFilter {
   }
 
   const char* Name() const override { return "BaseMetaFilter"; }
+
+ private:
+  /*
+   * An empty collection only gets members again under a bigger version, so
+   * its data keys up to this version can be dropped without reading the meta.
+   * Stale metas are not recorded: the meta seen here may be shadowed by a
+   * newer one outside of this compaction, e.g. PERSIST keeps the version.
+   */
+  void AddDroppedVersion(const Slice& key, uint64_t version) const {
+    if (meta_version_cache_ != nullptr) {
+      meta_version_cache_->AddDroppedVersion(key, version);
+    }
+  }
+
+  MetaVersionCache* meta_version_cache_ = nullptr;
 };
 
 class BaseMetaFilterFactory : public rocksdb::CompactionFilterFactory {
  public:
-  BaseMetaFilterFactory() = default;
+  explicit BaseMetaFilterFactory(MetaVersionCache* meta_version_cache = nullptr)
+      : meta_version_cache_(meta_version_cache) {}
   std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
       const rocksdb::CompactionFilter::Context& context) override {
-    return std::unique_ptr<rocksdb::CompactionFilter>(new BaseMetaFilter());
+    return std::unique_ptr<rocksdb::CompactionFilter>(new BaseMetaFilter(meta_version_cache_));
   }
   const char* Name() const override { return "BaseMetaFilterFactory"; }
+
+ private:
+  MetaVersionCache* meta_version_cache_ = nullptr;
 };
 
 class BaseDataFilter : public rocksdb::CompactionFilter {
  public:
-  BaseDataFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr, enum DataType type)
+  BaseDataFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr, enum DataType type,
+                 MetaVersionCache* meta_version_cache = nullptr)
       : db_(db),
         cf_handles_ptr_(cf_handles_ptr),
-        type_(type)
+        type_(type),
+        meta_version_cache_(meta_version_cache)
         {}
 
   bool Filter(int level, const Slice& key, const rocksdb::Slice& value, std::string* new_value,
@@ -126,22 +150,48 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
     TRACE("[DataFilter], key: %s, data = %s, version = %llu", parsed_base_data_key.Key().ToString().c_str(),
           parsed_base_data_key.Data().ToString().c_str(), parsed_base_data_key.Version());
 
-    const char* ptr = key.data();
-    int key_size = key.size();
-    ptr = SeekUserkeyDelim(ptr + kPrefixReserveLength, key_size - kPrefixReserveLength);
-    std::string meta_key_enc(key.data(), std::distance(key.data(), ptr));
+    // meta keys always use the v1 layout, rebuild it from the data key prefix
+    size_t prefix_length = DataKeyPrefixLength(key);
+    const char* key_start = key.data() + prefix_length;
+    int key_size = key.size() - prefix_length;
+    const char* ptr = SeekUserkeyDelim(key_start, key_size);
+    std::string meta_key_enc(kPrefixReserveLength, kNeedTransformCharacter);
+    meta_key_enc.append(key_start, std::distance(key_start, ptr));
     meta_key_enc.append(kSuffixReserveLength, kNeedTransformCharacter);
 
     if (meta_key_enc != cur_key_) {
+      cur_key_ = meta_key_enc;
+      cur_meta_loaded_ = false;
+      cur_cache_found_ = meta_version_cache_ != nullptr &&
+                         meta_version_cache_->Lookup(parsed_base_data_key.Key(), &cur_cache_entry_);
+    }
+
+    if (cur_cache_found_) {
+      auto decision = MetaVersionCache::Decide(cur_cache_entry_, parsed_base_data_key.Version(), pstd::NowMillis());
+      if (decision != MetaVersionCache::kMiss) {
+        meta_version_cache_->RecordHit();
+        if (decision == MetaVersionCache::kDrop) {
+          TRACE("Drop[cached dropped version]");
+          return true;
+        }
+        TRACE("Reserve[cached meta version]");
+        return false;
+      }
+    }
+
+    if (!cur_meta_loaded_) {
       cur_meta_etime_ = 0;
       cur_meta_version_ = 0;
       meta_not_found_ = true;
-      cur_key_ = meta_key_enc;
       std::string meta_value;
       // destroyed when close the database, Reserve Current key value
       if (cf_handles_ptr_->empty()) {
         return false;
       }
+      cur_meta_loaded_ = true;
+      if (meta_version_cache_ != nullptr) {
+        meta_version_cache_->RecordMiss();
+      }
       Status s = db_->Get(default_read_options_, (*cf_handles_ptr_)[0], cur_key_, &meta_value);
       if (s.ok()) {
         /*
@@ -162,6 +212,9 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
           meta_not_found_ = false;
           cur_meta_version_ = parsed_base_meta_value.Version();
           cur_meta_etime_ = parsed_base_meta_value.Etime();
+          if (meta_version_cache_ != nullptr) {
+            meta_version_cache_->UpdateMeta(parsed_base_data_key.Key(), cur_meta_version_, cur_meta_etime_);
+          }
         } else {
           return true;
         }
@@ -221,16 +274,21 @@ class BaseDataFilter : public rocksdb::CompactionFilter {
   mutable bool meta_not_found_ = false;
   mutable uint64_t cur_meta_version_ = 0;
   mutable uint64_t cur_meta_etime_ = 0;
+  mutable bool cur_meta_loaded_ = false;
+  mutable bool cur_cache_found_ = false;
+  mutable MetaVersionEntry cur_cache_entry_;
   enum DataType type_ = DataType::kNones;
+  MetaVersionCache* meta_version_cache_ = nullptr;
 };
 
 class BaseDataFilterFactory : public rocksdb::CompactionFilterFactory {
  public:
-  BaseDataFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr, enum DataType type)
-      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr), type_(type) {}
+  BaseDataFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr, enum DataType type,
+                        MetaVersionCache* meta_version_cache = nullptr)
+      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr), type_(type), meta_version_cache_(meta_version_cache) {}
   std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
       const rocksdb::CompactionFilter::Context& context) override {
-    return std::make_unique<BaseDataFilter>(BaseDataFilter(*db_ptr_, cf_handles_ptr_, type_));
+    return std::make_unique<BaseDataFilter>(BaseDataFilter(*db_ptr_, cf_handles_ptr_, type_, meta_version_cache_));
   }
   const char* Name() const override { return "BaseDataFilterFactory"; }
 
@@ -238,6 +296,7 @@ class BaseDataFilterFactory : public rocksdb::CompactionFilterFactory {
   rocksdb::DB** db_ptr_ = nullptr;
   std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
   enum DataType type_ = DataType::kNones;
+  MetaVersionCache* meta_version_cache_ = nullptr;
 };
 
 using HashesMetaFilter = BaseMetaFilter;
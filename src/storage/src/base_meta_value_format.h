@@ -17,7 +17,15 @@ namespace storage {
 /*
 *| type | value |  version | reserve | cdate | timestamp |
 *|  1B  |       |    8B   |   16B    |   8B  |     8B    |
+*  The first bit in reserve field marks a zset whose current version has a
+*  rank index in the zset rank cf, see zsets_rank_index.h
+*  The second bit marks a hash or set whose fields or members follow the
+*  count in the value instead of living in the data cf, see
+*  hashes_inline_format.h and sets_inline_format.h
 */
+constexpr uint8_t zsets_rank_index_reserve_flag = 0x80;
+constexpr uint8_t inline_reserve_flag = 0x40;
+
 // TODO(wangshaoyi): reformat encode, AppendTimestampAndVersion
 class BaseMetaValue : public InternalValue {
  public:
@@ -157,9 +165,56 @@ class ParsedBaseMetaValue : public ParsedInternalValue {
     this->SetCount(0);
     this->SetEtime(0);
     this->SetCtime(0);
+    // the rank index and inline fields belong to the old version
+    this->SetRankIndexed(false);
+    this->SetInline(false);
+    this->SetInlinePayload(Slice());
     return this->UpdateVersion();
   }
 
+  bool IsRankIndexed() { return (reserve_[0] & zsets_rank_index_reserve_flag) != 0; }
+
+  void SetRankIndexed(bool indexed) {
+    if (indexed) {
+      reserve_[0] |= zsets_rank_index_reserve_flag;
+    } else {
+      reserve_[0] &= ~zsets_rank_index_reserve_flag;
+    }
+    if (value_) {
+      char* dst = const_cast<char*>(value_->data()) + value_->size() - kBaseMetaValueSuffixLength + kVersionLength;
+      dst[0] = reserve_[0];
+    }
+  }
+
+  bool IsInline() { return (reserve_[0] & inline_reserve_flag) != 0; }
+
+  void SetInline(bool is_inline) {
+    if (is_inline) {
+      reserve_[0] |= inline_reserve_flag;
+    } else {
+      reserve_[0] &= ~inline_reserve_flag;
+    }
+    if (value_) {
+      char* dst = const_cast<char*>(value_->data()) + value_->size() - kBaseMetaValueSuffixLength + kVersionLength;
+      dst[0] = reserve_[0];
+    }
+  }
+
+  // the user value after the count
+  Slice InlinePayload() {
+    return user_value_.size() > sizeof(int32_t)
+               ? Slice(user_value_.data() + sizeof(int32_t), user_value_.size() - sizeof(int32_t))
+               : Slice();
+  }
+
+  void SetInlinePayload(const Slice& payload) {
+    if (value_ && value_->size() >= kTypeLength + sizeof(int32_t) + kBaseMetaValueSuffixLength) {
+      size_t offset = kTypeLength + sizeof(int32_t);
+      value_->replace(offset, value_->size() - kBaseMetaValueSuffixLength - offset, payload.data(), payload.size());
+      user_value_ = Slice(value_->data() + kTypeLength, sizeof(int32_t) + payload.size());
+    }
+  }
+
   bool IsValid() override {
     return !IsStale() && Count() != 0;
   }
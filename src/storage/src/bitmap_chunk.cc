@@ -0,0 +1,268 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/bitmap_chunk.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "pstd/include/env.h"
+#include "src/base_data_key_format.h"
+#include "src/base_data_value_format.h"
+#include "src/coding.h"
+
+namespace storage {
+
+namespace {
+
+constexpr size_t kBitmapChunkMetaLength = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+constexpr size_t kChunkIndexLength = sizeof(uint64_t);
+
+std::string EncodeChunkIndex(uint64_t chunk_index) {
+  std::string buf(kChunkIndexLength, '\0');
+  for (size_t idx = 0; idx < kChunkIndexLength; ++idx) {
+    buf[kChunkIndexLength - 1 - idx] = static_cast<char>(chunk_index & 0xff);
+    chunk_index >>= 8;
+  }
+  return buf;
+}
+
+uint64_t DecodeChunkIndex(const char* ptr) {
+  uint64_t chunk_index = 0;
+  for (size_t idx = 0; idx < kChunkIndexLength; ++idx) {
+    chunk_index = (chunk_index << 8) | static_cast<uint8_t>(ptr[idx]);
+  }
+  return chunk_index;
+}
+
+bool AllZero(const Slice& bytes) {
+  return std::all_of(bytes.data(), bytes.data() + bytes.size(), [](char byte) { return byte == 0; });
+}
+
+}  // namespace
+
+bool BitmapChunkMeta::Decode(const Slice& user_value) {
+  if (user_value.size() != kBitmapChunkMetaLength) {
+    return false;
+  }
+  length = DecodeFixed64(user_value.data());
+  version = DecodeFixed64(user_value.data() + sizeof(uint64_t));
+  chunk_size = DecodeFixed32(user_value.data() + 2 * sizeof(uint64_t));
+  return chunk_size > 0;
+}
+
+std::string BitmapChunkMeta::Encode() const {
+  std::string user_value(kBitmapChunkMetaLength, '\0');
+  EncodeFixed64(user_value.data(), length);
+  EncodeFixed64(user_value.data() + sizeof(uint64_t), version);
+  EncodeFixed32(user_value.data() + 2 * sizeof(uint64_t), chunk_size);
+  return user_value;
+}
+
+ChunkedBitmap::ChunkedBitmap(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle, const Slice& key,
+                             const BitmapChunkMeta& meta)
+    : db_(db), handle_(handle), key_(key.ToString()), meta_(meta) {}
+
+ChunkedBitmap::ChunkedBitmap(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle, const Slice& key,
+                             uint32_t chunk_size)
+    : db_(db), handle_(handle), key_(key.ToString()), fresh_(true) {
+  meta_.version = NewVersion();
+  meta_.chunk_size = chunk_size;
+}
+
+Status ChunkedBitmap::GetBit(const rocksdb::ReadOptions& read_options, uint64_t offset, int32_t* ret) {
+  *ret = 0;
+  uint64_t byte = offset >> 3;
+  if (byte >= meta_.length) {
+    return Status::OK();
+  }
+  std::string bytes;
+  Status s = ReadChunk(read_options, byte / meta_.chunk_size, &bytes);
+  if (!s.ok()) {
+    return s;
+  }
+  uint64_t pos = byte % meta_.chunk_size;
+  if (pos < bytes.size()) {
+    size_t bit = 7 - (offset & 0x7);
+    *ret = (static_cast<uint8_t>(bytes[pos]) >> bit) & 0x1;
+  }
+  return Status::OK();
+}
+
+Status ChunkedBitmap::ForEachChunk(const rocksdb::ReadOptions& read_options, uint64_t first, uint64_t last,
+                                   const std::function<bool(uint64_t chunk_index, const Slice& bytes)>& visitor) {
+  if (first > last) {
+    return Status::OK();
+  }
+  uint64_t first_index = first / meta_.chunk_size;
+  uint64_t last_index = last / meta_.chunk_size;
+  if (fresh_ || first_index == last_index) {
+    std::string bytes;
+    for (uint64_t chunk_index = first_index; chunk_index <= last_index; ++chunk_index) {
+      Status s = ReadChunk(read_options, chunk_index, &bytes);
+      if (!s.ok()) {
+        return s;
+      }
+      if (!visitor(chunk_index, bytes)) {
+        break;
+      }
+    }
+    return Status::OK();
+  }
+
+  std::string first_key = ChunkKey(first_index);
+  std::string upper_key = ChunkKey(last_index + 1);
+  // | reserve1 | key | version |, shared by every chunk key of the bitmap
+  size_t prefix_length = first_key.size() - kChunkIndexLength - kSuffixReserveLength;
+  Slice prefix(first_key.data(), prefix_length);
+  Slice upper_bound(upper_key);
+  rocksdb::ReadOptions iter_options(read_options);
+  iter_options.iterate_upper_bound = &upper_bound;
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(iter_options, handle_));
+  iter->Seek(first_key);
+  for (uint64_t chunk_index = first_index; chunk_index <= last_index; ++chunk_index) {
+    bool go_on = true;
+    if (iter->Valid() && iter->key().size() == first_key.size() && iter->key().starts_with(prefix) &&
+        DecodeChunkIndex(iter->key().data() + prefix_length) == chunk_index) {
+      ParsedBaseDataValue parsed_value(iter->value());
+      go_on = visitor(chunk_index, parsed_value.UserValue());
+      iter->Next();
+    } else {
+      go_on = visitor(chunk_index, Slice());
+    }
+    if (!go_on) {
+      break;
+    }
+  }
+  return iter->status();
+}
+
+Status ChunkedBitmap::ReadRange(const rocksdb::ReadOptions& read_options, uint64_t first, uint64_t count,
+                                std::string* bytes) {
+  bytes->clear();
+  if (first >= meta_.length || count == 0) {
+    return Status::OK();
+  }
+  count = std::min(count, meta_.length - first);
+  bytes->assign(count, '\0');
+  uint64_t chunk_size = meta_.chunk_size;
+  return ForEachChunk(read_options, first, first + count - 1, [&](uint64_t chunk_index, const Slice& chunk) {
+    uint64_t chunk_start = chunk_index * chunk_size;
+    uint64_t from = std::max(first, chunk_start);
+    uint64_t to = std::min(first + count, chunk_start + chunk.size());
+    if (from < to) {
+      memcpy(bytes->data() + (from - first), chunk.data() + (from - chunk_start), to - from);
+    }
+    return true;
+  });
+}
+
+Status ChunkedBitmap::ReadAll(const rocksdb::ReadOptions& read_options, std::string* bytes) {
+  return ReadRange(read_options, 0, meta_.length, bytes);
+}
+
+void ChunkedBitmap::Assign(const Slice& bytes, rocksdb::WriteBatch* batch) {
+  assigned_ = bytes;
+  meta_.length = bytes.size();
+  for (uint64_t start = 0; start < bytes.size(); start += meta_.chunk_size) {
+    WriteChunk(start / meta_.chunk_size,
+               Slice(bytes.data() + start, std::min<uint64_t>(meta_.chunk_size, bytes.size() - start)), batch);
+  }
+}
+
+Status ChunkedBitmap::SetBit(const rocksdb::ReadOptions& read_options, uint64_t offset, int32_t on, int32_t* ret,
+                             rocksdb::WriteBatch* batch) {
+  uint64_t byte = offset >> 3;
+  size_t bit = 7 - (offset & 0x7);
+  uint64_t chunk_index = byte / meta_.chunk_size;
+  uint64_t pos = byte % meta_.chunk_size;
+  std::string bytes;
+  Status s = ReadChunk(read_options, chunk_index, &bytes);
+  if (!s.ok()) {
+    return s;
+  }
+  *ret = pos < bytes.size() ? (static_cast<uint8_t>(bytes[pos]) >> bit) & 0x1 : 0;
+  if (*ret == on) {
+    return Status::OK();
+  }
+  if (pos >= bytes.size()) {
+    bytes.resize(pos + 1, '\0');
+  }
+  if (on != 0) {
+    bytes[pos] = static_cast<char>(bytes[pos] | (1 << bit));
+  } else {
+    bytes[pos] = static_cast<char>(bytes[pos] & ~(1 << bit));
+  }
+  WriteChunk(chunk_index, bytes, batch);
+  meta_.length = std::max(meta_.length, byte + 1);
+  return Status::OK();
+}
+
+void ChunkedBitmap::WriteChunk(uint64_t chunk_index, const Slice& bytes, rocksdb::WriteBatch* batch) {
+  if (AllZero(bytes)) {
+    if (!fresh_) {
+      batch->Delete(handle_, ChunkKey(chunk_index));
+    }
+    return;
+  }
+  BaseDataValue chunk_value(bytes);
+  batch->Put(handle_, ChunkKey(chunk_index), chunk_value.Encode());
+}
+
+std::string ChunkedBitmap::ChunkKey(uint64_t chunk_index) {
+  std::string encoded_index = EncodeChunkIndex(chunk_index);
+  BaseDataKey chunk_key(key_, meta_.version, encoded_index);
+  return chunk_key.Encode().ToString();
+}
+
+Status ChunkedBitmap::ReadChunk(const rocksdb::ReadOptions& read_options, uint64_t chunk_index, std::string* bytes) {
+  bytes->clear();
+  if (fresh_) {
+    uint64_t start = chunk_index * meta_.chunk_size;
+    if (start < assigned_.size()) {
+      bytes->assign(assigned_.data() + start, std::min<uint64_t>(meta_.chunk_size, assigned_.size() - start));
+    }
+    return Status::OK();
+  }
+  Status s = db_->Get(read_options, handle_, ChunkKey(chunk_index), bytes);
+  if (s.IsNotFound()) {
+    bytes->clear();
+    return Status::OK();
+  } else if (!s.ok()) {
+    return s;
+  }
+  ParsedBaseDataValue parsed_value(bytes);
+  parsed_value.StripSuffix();
+  return Status::OK();
+}
+
+Status BitmapReader::Read(const rocksdb::ReadOptions& read_options, uint64_t first, uint64_t count,
+                          std::string* bytes) {
+  if (bitmap_ != nullptr) {
+    return bitmap_->ReadRange(read_options, first, count, bytes);
+  }
+  bytes->clear();
+  if (first < value_.size()) {
+    bytes->assign(value_, first, count);
+  }
+  return Status::OK();
+}
+
+// Versions only grow within the process and start from the clock, like the
+// versions of the collections, so a new bitmap never meets the chunks of an
+// earlier one under the same key that the compaction has not dropped yet
+uint64_t ChunkedBitmap::NewVersion() {
+  static std::atomic<uint64_t> last_version{0};
+  auto now = static_cast<uint64_t>(pstd::NowMicros());
+  uint64_t last = last_version.load();
+  uint64_t version = 0;
+  do {
+    version = std::max(now, last + 1);
+  } while (!last_version.compare_exchange_weak(last, version));
+  return version;
+}
+
+}  //  namespace storage
@@ -0,0 +1,105 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_BITMAP_CHUNK_H_
+#define SRC_BITMAP_CHUNK_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "rocksdb/db.h"
+#include "rocksdb/status.h"
+#include "rocksdb/write_batch.h"
+
+#include "storage/storage.h"
+
+namespace storage {
+
+/*
+ * The user value of a strings value marked by bitmap_chunked_reserve_flag:
+ * | length | version | chunk size |
+ * |   8B   |    8B   |     4B     |
+ * length is the byte length of the bitmap, version tells its chunks from the
+ * ones of an earlier bitmap under the same key
+ */
+struct BitmapChunkMeta {
+  uint64_t length = 0;
+  uint64_t version = 0;
+  uint32_t chunk_size = 0;
+
+  bool Decode(const Slice& user_value);
+  std::string Encode() const;
+};
+
+/*
+ * A bitmap split into chunks of chunk size bytes, stored in the bitmap data
+ * cf under | reserve1 | key | version | chunk index | reserve2 |, the chunk
+ * index in big endian so that the chunks of a bitmap sort by index. A chunk
+ * may be shorter than the chunk size and missing chunks are not stored, the
+ * bytes they leave out up to length are zero.
+ *
+ * The meta is kept in memory, the caller puts it back into the same batch
+ * as the chunks when Meta().length changed.
+ */
+class ChunkedBitmap {
+ public:
+  // an existing bitmap
+  ChunkedBitmap(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle, const Slice& key, const BitmapChunkMeta& meta);
+  // a new empty bitmap, under a version no earlier bitmap of the key had
+  ChunkedBitmap(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle, const Slice& key, uint32_t chunk_size);
+
+  const BitmapChunkMeta& Meta() const { return meta_; }
+
+  // Readers, byte offsets past length read as zero
+  Status GetBit(const rocksdb::ReadOptions& read_options, uint64_t offset, int32_t* ret);
+  // Calls visitor with every chunk overlapping the bytes [first, last] in
+  // index order, missing ones with an empty slice, until it returns false
+  Status ForEachChunk(const rocksdb::ReadOptions& read_options, uint64_t first, uint64_t last,
+                      const std::function<bool(uint64_t chunk_index, const Slice& bytes)>& visitor);
+  // count bytes from first, zero filled, cut at length
+  Status ReadRange(const rocksdb::ReadOptions& read_options, uint64_t first, uint64_t count, std::string* bytes);
+  Status ReadAll(const rocksdb::ReadOptions& read_options, std::string* bytes);
+
+  // Writers, called under the record lock of the key
+  // Only on a new bitmap: bytes become its content, they must outlive it
+  void Assign(const Slice& bytes, rocksdb::WriteBatch* batch);
+  Status SetBit(const rocksdb::ReadOptions& read_options, uint64_t offset, int32_t on, int32_t* ret,
+                rocksdb::WriteBatch* batch);
+  // put the chunk at chunk_index, an all zero one is dropped instead
+  void WriteChunk(uint64_t chunk_index, const Slice& bytes, rocksdb::WriteBatch* batch);
+
+ private:
+  std::string ChunkKey(uint64_t chunk_index);
+  Status ReadChunk(const rocksdb::ReadOptions& read_options, uint64_t chunk_index, std::string* bytes);
+  static uint64_t NewVersion();
+
+  rocksdb::DB* db_ = nullptr;
+  rocksdb::ColumnFamilyHandle* handle_ = nullptr;
+  std::string key_;
+  BitmapChunkMeta meta_;
+  // a new bitmap has no stored chunks yet, they are read from assigned_
+  bool fresh_ = false;
+  Slice assigned_;
+};
+
+// A BITOP source, the value of a plain string or a chunked bitmap
+class BitmapReader {
+ public:
+  BitmapReader() = default;
+  explicit BitmapReader(std::string value) : value_(std::move(value)) {}
+  explicit BitmapReader(std::unique_ptr<ChunkedBitmap> bitmap) : bitmap_(std::move(bitmap)) {}
+
+  uint64_t Length() const { return bitmap_ != nullptr ? bitmap_->Meta().length : value_.size(); }
+  // count bytes from first, cut at Length()
+  Status Read(const rocksdb::ReadOptions& read_options, uint64_t first, uint64_t count, std::string* bytes);
+
+ private:
+  std::string value_;
+  std::unique_ptr<ChunkedBitmap> bitmap_;
+};
+
+}  //  namespace storage
+#endif  //  SRC_BITMAP_CHUNK_H_
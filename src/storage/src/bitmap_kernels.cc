@@ -0,0 +1,237 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/bitmap_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define STORAGE_BITMAP_KERNELS_X86 1
+#endif
+
+namespace storage {
+
+namespace {
+
+// The word at a time loops, inlined into every kernel so that the target of
+// the caller decides how __builtin_popcountll is compiled
+inline __attribute__((always_inline)) int64_t PopcountWords(const unsigned char* data, uint64_t bytes) {
+  int64_t count = 0;
+  uint64_t idx = 0;
+  uint64_t word = 0;
+  for (; bytes - idx >= sizeof(word); idx += sizeof(word)) {
+    memcpy(&word, data + idx, sizeof(word));
+    count += __builtin_popcountll(word);
+  }
+  for (; idx < bytes; ++idx) {
+    count += __builtin_popcount(data[idx]);
+  }
+  return count;
+}
+
+inline __attribute__((always_inline)) uint64_t SkipWords(const unsigned char* data, uint64_t bytes,
+                                                         unsigned char skip) {
+  uint64_t pattern = 0x0101010101010101ULL * skip;
+  uint64_t idx = 0;
+  uint64_t word = 0;
+  for (; bytes - idx >= sizeof(word); idx += sizeof(word)) {
+    memcpy(&word, data + idx, sizeof(word));
+    if (word != pattern) {
+      break;
+    }
+  }
+  while (idx < bytes && data[idx] == skip) {
+    ++idx;
+  }
+  return idx;
+}
+
+inline __attribute__((always_inline)) uint64_t BitOpWord(BitOpType op, uint64_t dest, uint64_t src) {
+  switch (op) {
+    case kBitOpAnd:
+      return dest & src;
+    case kBitOpOr:
+      return dest | src;
+    case kBitOpXor:
+      return dest ^ src;
+    case kBitOpNot:
+      return ~dest;
+    default:
+      return dest;
+  }
+}
+
+inline __attribute__((always_inline)) void BitOpWords(BitOpType op, unsigned char* dest, const unsigned char* src,
+                                                      uint64_t bytes) {
+  uint64_t idx = 0;
+  uint64_t dest_word = 0;
+  uint64_t src_word = 0;
+  for (; bytes - idx >= sizeof(dest_word); idx += sizeof(dest_word)) {
+    memcpy(&dest_word, dest + idx, sizeof(dest_word));
+    if (op != kBitOpNot) {
+      memcpy(&src_word, src + idx, sizeof(src_word));
+    }
+    dest_word = BitOpWord(op, dest_word, src_word);
+    memcpy(dest + idx, &dest_word, sizeof(dest_word));
+  }
+  for (; idx < bytes; ++idx) {
+    dest[idx] = static_cast<unsigned char>(BitOpWord(op, dest[idx], op != kBitOpNot ? src[idx] : 0));
+  }
+}
+
+inline __attribute__((always_inline)) void MaxLoop(unsigned char* dest, const unsigned char* src, uint64_t bytes) {
+  for (uint64_t idx = 0; idx < bytes; ++idx) {
+    dest[idx] = std::max(dest[idx], src[idx]);
+  }
+}
+
+int64_t PopcountScalar(const unsigned char* data, uint64_t bytes) { return PopcountWords(data, bytes); }
+
+uint64_t SkipScalar(const unsigned char* data, uint64_t bytes, unsigned char skip) {
+  return SkipWords(data, bytes, skip);
+}
+
+void BitOpScalar(BitOpType op, unsigned char* dest, const unsigned char* src, uint64_t bytes) {
+  BitOpWords(op, dest, src, bytes);
+}
+
+void MaxScalar(unsigned char* dest, const unsigned char* src, uint64_t bytes) { MaxLoop(dest, src, bytes); }
+
+#ifdef STORAGE_BITMAP_KERNELS_X86
+
+__attribute__((target("popcnt"))) int64_t PopcountPopcnt(const unsigned char* data, uint64_t bytes) {
+  return PopcountWords(data, bytes);
+}
+
+// Nibble lookup with a byte shuffle, the byte counters are summed into the
+// 64 bit lanes before 31 rounds of at most 8 could overflow them
+__attribute__((target("avx2,popcnt"))) int64_t PopcountAvx2(const unsigned char* data, uint64_t bytes) {
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1,
+                                          2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i total = _mm256_setzero_si256();
+  uint64_t idx = 0;
+  while (bytes - idx >= sizeof(__m256i)) {
+    __m256i acc = _mm256_setzero_si256();
+    for (int round = 0; round < 31 && bytes - idx >= sizeof(__m256i); ++round, idx += sizeof(__m256i)) {
+      __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + idx));
+      __m256i low = _mm256_and_si256(value, low_mask);
+      __m256i high = _mm256_and_si256(_mm256_srli_epi16(value, 4), low_mask);
+      acc = _mm256_add_epi8(acc, _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high)));
+    }
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(acc, zero));
+  }
+  int64_t count = _mm256_extract_epi64(total, 0) + _mm256_extract_epi64(total, 1) + _mm256_extract_epi64(total, 2) +
+                  _mm256_extract_epi64(total, 3);
+  return count + PopcountWords(data + idx, bytes - idx);
+}
+
+__attribute__((target("avx2"))) uint64_t SkipAvx2(const unsigned char* data, uint64_t bytes, unsigned char skip) {
+  const __m256i pattern = _mm256_set1_epi8(static_cast<char>(skip));
+  uint64_t idx = 0;
+  for (; bytes - idx >= sizeof(__m256i); idx += sizeof(__m256i)) {
+    __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + idx));
+    auto equal = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(value, pattern)));
+    if (equal != 0xffffffffU) {
+      return idx + __builtin_ctz(~equal);
+    }
+  }
+  return idx + SkipWords(data + idx, bytes - idx, skip);
+}
+
+__attribute__((target("avx2"))) void BitOpAvx2(BitOpType op, unsigned char* dest, const unsigned char* src,
+                                               uint64_t bytes) {
+  const __m256i ones = _mm256_set1_epi8(-1);
+  uint64_t idx = 0;
+  for (; bytes - idx >= sizeof(__m256i); idx += sizeof(__m256i)) {
+    auto dest_ptr = reinterpret_cast<__m256i*>(dest + idx);
+    __m256i value = _mm256_loadu_si256(dest_ptr);
+    if (op == kBitOpNot) {
+      value = _mm256_xor_si256(value, ones);
+    } else {
+      __m256i src_value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + idx));
+      switch (op) {
+        case kBitOpAnd:
+          value = _mm256_and_si256(value, src_value);
+          break;
+        case kBitOpOr:
+          value = _mm256_or_si256(value, src_value);
+          break;
+        case kBitOpXor:
+          value = _mm256_xor_si256(value, src_value);
+          break;
+        default:
+          break;
+      }
+    }
+    _mm256_storeu_si256(dest_ptr, value);
+  }
+  BitOpWords(op, dest + idx, src != nullptr ? src + idx : nullptr, bytes - idx);
+}
+
+__attribute__((target("avx2"))) void MaxAvx2(unsigned char* dest, const unsigned char* src, uint64_t bytes) {
+  uint64_t idx = 0;
+  for (; bytes - idx >= sizeof(__m256i); idx += sizeof(__m256i)) {
+    auto dest_ptr = reinterpret_cast<__m256i*>(dest + idx);
+    __m256i src_value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + idx));
+    _mm256_storeu_si256(dest_ptr, _mm256_max_epu8(_mm256_loadu_si256(dest_ptr), src_value));
+  }
+  MaxLoop(dest + idx, src + idx, bytes - idx);
+}
+
+#endif  // STORAGE_BITMAP_KERNELS_X86
+
+struct BitmapKernels {
+  const char* name = "scalar";
+  int64_t (*popcount)(const unsigned char*, uint64_t) = PopcountScalar;
+  uint64_t (*skip)(const unsigned char*, uint64_t, unsigned char) = SkipScalar;
+  void (*bitop)(BitOpType, unsigned char*, const unsigned char*, uint64_t) = BitOpScalar;
+  void (*max)(unsigned char*, const unsigned char*, uint64_t) = MaxScalar;
+};
+
+BitmapKernels PickBitmapKernels() {
+  BitmapKernels kernels;
+#ifdef STORAGE_BITMAP_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("popcnt")) {
+    kernels.name = "popcnt";
+    kernels.popcount = PopcountPopcnt;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+    kernels.name = "avx2";
+    kernels.popcount = PopcountAvx2;
+    kernels.skip = SkipAvx2;
+    kernels.bitop = BitOpAvx2;
+    kernels.max = MaxAvx2;
+  }
+#endif
+  return kernels;
+}
+
+const BitmapKernels& Kernels() {
+  static const BitmapKernels kernels = PickBitmapKernels();
+  return kernels;
+}
+
+}  // namespace
+
+int64_t PopcountBytes(const unsigned char* data, uint64_t bytes) { return Kernels().popcount(data, bytes); }
+
+uint64_t SkipBytes(const unsigned char* data, uint64_t bytes, unsigned char skip) {
+  return Kernels().skip(data, bytes, skip);
+}
+
+void BitOpBytes(BitOpType op, unsigned char* dest, const unsigned char* src, uint64_t bytes) {
+  Kernels().bitop(op, dest, src, bytes);
+}
+
+void MaxBytes(unsigned char* dest, const unsigned char* src, uint64_t bytes) { Kernels().max(dest, src, bytes); }
+
+const char* BitmapKernelsName() { return Kernels().name; }
+
+}  //  namespace storage
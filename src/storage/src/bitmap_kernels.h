@@ -0,0 +1,34 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_BITMAP_KERNELS_H_
+#define SRC_BITMAP_KERNELS_H_
+
+#include <cstdint>
+
+#include "storage/storage.h"
+
+namespace storage {
+
+/*
+ * The loops of BITCOUNT, BITPOS, BITOP and PFMERGE over a byte buffer. On
+ * x86_64 the AVX2 or POPCNT version is picked once by the cpu the process
+ * runs on, the scalar one works a word at a time everywhere else.
+ */
+
+// the number of set bits in data[0, bytes)
+int64_t PopcountBytes(const unsigned char* data, uint64_t bytes);
+// the number of leading bytes of data[0, bytes) equal to skip
+uint64_t SkipBytes(const unsigned char* data, uint64_t bytes, unsigned char skip);
+// dest[i] = dest[i] op src[i] for i in [0, bytes), kBitOpNot ignores src
+void BitOpBytes(BitOpType op, unsigned char* dest, const unsigned char* src, uint64_t bytes);
+// dest[i] = max(dest[i], src[i]) for i in [0, bytes), the merge of hll registers
+void MaxBytes(unsigned char* dest, const unsigned char* src, uint64_t bytes);
+
+// avx2, popcnt or scalar, the kernels in use
+const char* BitmapKernelsName();
+
+}  //  namespace storage
+#endif  //  SRC_BITMAP_KERNELS_H_
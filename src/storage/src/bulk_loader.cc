@@ -0,0 +1,502 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "storage/bulk_loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <queue>
+#include <thread>
+#include <unordered_set>
+
+#include <glog/logging.h>
+
+#include "rocksdb/sst_file_reader.h"
+#include "rocksdb/sst_file_writer.h"
+
+#include "pstd/include/env.h"
+#include "src/base_data_key_format.h"
+#include "src/base_data_value_format.h"
+#include "src/base_key_format.h"
+#include "src/base_meta_value_format.h"
+#include "src/coding.h"
+#include "src/expiry_index.h"
+#include "src/lists_data_key_format.h"
+#include "src/lists_meta_value_format.h"
+#include "src/redis.h"
+#include "src/strings_value_format.h"
+#include "src/type_index.h"
+#include "src/zsets_data_key_format.h"
+
+namespace storage {
+
+namespace {
+
+constexpr int kBulkCFNum = kExpiryIndexCF + 1;
+// vector and string headers of one buffered entry
+constexpr size_t kEntryOverhead = 64;
+// runs open at once when merging, more are merged a group at a time first
+constexpr size_t kMaxMergeWidth = 64;
+
+Status DuplicateKeyError(const Slice& meta_key) {
+  ParsedBaseMetaKey parsed_meta_key(meta_key);
+  return Status::InvalidArgument("key added twice to the bulk load: " + parsed_meta_key.Key().ToString());
+}
+
+// Merges the sorted files into files of at most about target_file_size. On
+// equal keys the entry of the later file is kept, in the meta cf they fail
+Status MergeFiles(const rocksdb::Options& options, ColumnFamilyIndex cf, const std::vector<std::string>& inputs,
+                  uint64_t target_file_size, const std::function<std::string()>& next_path,
+                  std::vector<std::string>* outputs) {
+  const rocksdb::Comparator* cmp = options.comparator;
+  struct MergeSource {
+    std::unique_ptr<rocksdb::SstFileReader> reader;
+    std::unique_ptr<rocksdb::Iterator> iter;
+  };
+  std::vector<MergeSource> sources(inputs.size());
+  rocksdb::ReadOptions read_options;
+  read_options.fill_cache = false;
+  for (size_t idx = 0; idx < inputs.size(); ++idx) {
+    sources[idx].reader = std::make_unique<rocksdb::SstFileReader>(options);
+    Status s = sources[idx].reader->Open(inputs[idx]);
+    if (!s.ok()) {
+      return s;
+    }
+    sources[idx].iter.reset(sources[idx].reader->NewIterator(read_options));
+    sources[idx].iter->SeekToFirst();
+  }
+  // a pops after b, the later source goes first on equal keys
+  auto after = [&](size_t a, size_t b) {
+    int result = cmp->Compare(sources[a].iter->key(), sources[b].iter->key());
+    return result != 0 ? result > 0 : a < b;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heap(after);
+  for (size_t idx = 0; idx < sources.size(); ++idx) {
+    if (sources[idx].iter->Valid()) {
+      heap.push(idx);
+    } else if (!sources[idx].iter->status().ok()) {
+      return sources[idx].iter->status();
+    }
+  }
+
+  std::unique_ptr<rocksdb::SstFileWriter> writer;
+  std::string last_key;
+  bool has_last_key = false;
+  Status s;
+  while (!heap.empty()) {
+    size_t idx = heap.top();
+    heap.pop();
+    rocksdb::Iterator* iter = sources[idx].iter.get();
+    if (has_last_key && cmp->Compare(iter->key(), last_key) == 0) {
+      if (cf == kMetaCF) {
+        return DuplicateKeyError(iter->key());
+      }
+    } else {
+      if (writer == nullptr) {
+        writer = std::make_unique<rocksdb::SstFileWriter>(rocksdb::EnvOptions(), options);
+        outputs->push_back(next_path());
+        s = writer->Open(outputs->back());
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      s = writer->Put(iter->key(), iter->value());
+      if (!s.ok()) {
+        return s;
+      }
+      last_key.assign(iter->key().data(), iter->key().size());
+      has_last_key = true;
+      if (writer->FileSize() >= target_file_size) {
+        s = writer->Finish();
+        if (!s.ok()) {
+          return s;
+        }
+        writer.reset();
+      }
+    }
+    iter->Next();
+    if (iter->Valid()) {
+      heap.push(idx);
+    } else if (!iter->status().ok()) {
+      return iter->status();
+    }
+  }
+  if (writer != nullptr) {
+    s = writer->Finish();
+  }
+  return s;
+}
+
+}  // namespace
+
+struct BulkLoader::CFBuffer {
+  std::vector<std::pair<std::string, std::string>> entries;
+  // sorted runs written so far, in the order they were written
+  std::vector<std::string> runs;
+  uint64_t next_file = 0;
+};
+
+struct BulkLoader::Instance {
+  Redis* redis = nullptr;
+  int index = 0;
+  DataFormat format = kDataFormatV1;
+  bool expiry_indexed = false;
+  std::vector<rocksdb::Options> options;
+  std::vector<CFBuffer> buffers;
+};
+
+BulkLoader::BulkLoader(Storage* db, const BulkLoadOptions& options) : db_(db), options_(options) {}
+
+BulkLoader::~BulkLoader() {
+  if (!finished_) {
+    pstd::DeleteDirIfExist(options_.work_dir);
+  }
+}
+
+Status BulkLoader::Open(Storage* db, const BulkLoadOptions& options, std::unique_ptr<BulkLoader>& loader_ret) {
+  if (options.work_dir.empty() || options.worker_num <= 0 || options.buffer_bytes == 0) {
+    return Status::InvalidArgument("bulk load needs a work dir, workers and a buffer");
+  }
+  pstd::DeleteDirIfExist(options.work_dir);
+  if (pstd::CreatePath(options.work_dir) != 0) {
+    return Status::IOError("create bulk load work dir failed: " + options.work_dir);
+  }
+  // BulkLoader() is private, can't use make_unique
+  loader_ret = std::unique_ptr<BulkLoader>(new BulkLoader(db, options));
+  return Status::OK();
+}
+
+BulkLoader::Instance* BulkLoader::GetInstance(const Slice& key) {
+  Redis* redis = db_->GetDBInstance(key).get();
+  auto iter = insts_.find(redis->GetIndex());
+  if (iter != insts_.end()) {
+    return iter->second.get();
+  }
+  auto inst = std::make_unique<Instance>();
+  inst->redis = redis;
+  inst->index = redis->GetIndex();
+  inst->format = redis->GetDataFormat();
+  inst->expiry_indexed = redis->IsExpiryIndexed();
+  inst->buffers.resize(kBulkCFNum);
+  for (int cf = 0; cf < kBulkCFNum; ++cf) {
+    inst->options.push_back(redis->GetCFOptions(static_cast<ColumnFamilyIndex>(cf)));
+  }
+  pstd::CreatePath(options_.work_dir + "/" + std::to_string(inst->index));
+  return insts_.emplace(inst->index, std::move(inst)).first->second.get();
+}
+
+void BulkLoader::Add(Instance* inst, ColumnFamilyIndex cf, const Slice& key, const Slice& value) {
+  inst->buffers[cf].entries.emplace_back(key.ToString(), value.ToString());
+  buffered_bytes_ += key.size() + value.size() + kEntryOverhead;
+  entries_++;
+}
+
+void BulkLoader::AddMeta(Instance* inst, const Slice& key, const Slice& meta_value) {
+  Add(inst, kMetaCF, key, meta_value);
+  auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
+  if (IsTypeIndexed(type)) {
+    Add(inst, kTypeIndexCF, EncodeTypeIndexKey(DataTypeToTag(type), key), Slice());
+  }
+  if (inst->expiry_indexed) {
+    uint64_t etime = MetaValueEtime(meta_value);
+    if (etime != 0) {
+      Add(inst, kExpiryIndexCF, EncodeExpiryIndexKey(etime, key), Slice());
+    }
+  }
+}
+
+Status BulkLoader::Set(const Slice& key, const Slice& value, int64_t ttl_millsec) {
+  Instance* inst = GetInstance(key);
+  StringsValue strings_value(value);
+  if (ttl_millsec > 0) {
+    strings_value.SetRelativeTimeInMillsec(ttl_millsec);
+  }
+  BaseKey base_key(key);
+  AddMeta(inst, base_key.Encode(), strings_value.Encode());
+  keys_++;
+  return MaybeSpill();
+}
+
+Status BulkLoader::HMSet(const Slice& key, const std::vector<FieldValue>& fvs, int64_t ttl_millsec) {
+  // the last value of a field wins, as in HMSET
+  std::unordered_set<std::string> fields;
+  std::vector<const FieldValue*> filtered_fvs;
+  for (auto iter = fvs.rbegin(); iter != fvs.rend(); ++iter) {
+    if (fields.insert(iter->field).second) {
+      filtered_fvs.push_back(&*iter);
+    }
+  }
+  if (filtered_fvs.empty()) {
+    return Status::OK();
+  }
+  Instance* inst = GetInstance(key);
+  char meta_value_buf[4] = {0};
+  EncodeFixed32(meta_value_buf, filtered_fvs.size());
+  HashesMetaValue hashes_meta_value(DataType::kHashes, Slice(meta_value_buf, 4));
+  uint64_t version = hashes_meta_value.UpdateVersion();
+  if (ttl_millsec > 0) {
+    hashes_meta_value.SetRelativeTimeInMillsec(ttl_millsec);
+  }
+  BaseMetaKey base_meta_key(key);
+  AddMeta(inst, base_meta_key.Encode(), hashes_meta_value.Encode());
+  for (const auto* fv : filtered_fvs) {
+    HashesDataKey hashes_data_key(key, version, fv->field, inst->format);
+    BaseDataValue inter_value(fv->value, inst->format);
+    Add(inst, kHashesDataCF, hashes_data_key.Encode(), inter_value.Encode());
+  }
+  keys_++;
+  return MaybeSpill();
+}
+
+Status BulkLoader::SAdd(const Slice& key, const std::vector<std::string>& members, int64_t ttl_millsec) {
+  std::unordered_set<std::string> unique(members.begin(), members.end());
+  if (unique.empty()) {
+    return Status::OK();
+  }
+  Instance* inst = GetInstance(key);
+  char str[4];
+  EncodeFixed32(str, unique.size());
+  SetsMetaValue sets_meta_value(DataType::kSets, Slice(str, 4));
+  uint64_t version = sets_meta_value.UpdateVersion();
+  if (ttl_millsec > 0) {
+    sets_meta_value.SetRelativeTimeInMillsec(ttl_millsec);
+  }
+  BaseMetaKey base_meta_key(key);
+  AddMeta(inst, base_meta_key.Encode(), sets_meta_value.Encode());
+  for (const auto& member : unique) {
+    SetsMemberKey sets_member_key(key, version, member, inst->format);
+    BaseDataValue i_val(Slice{}, inst->format);
+    Add(inst, kSetsDataCF, sets_member_key.Encode(), i_val.Encode());
+  }
+  keys_++;
+  return MaybeSpill();
+}
+
+Status BulkLoader::RPush(const Slice& key, const std::vector<std::string>& values, int64_t ttl_millsec) {
+  if (values.empty()) {
+    return Status::OK();
+  }
+  Instance* inst = GetInstance(key);
+  char str[8];
+  EncodeFixed64(str, values.size());
+  ListsMetaValue lists_meta_value(Slice(str, sizeof(uint64_t)));
+  uint64_t version = lists_meta_value.UpdateVersion();
+  for (const auto& value : values) {
+    uint64_t index = lists_meta_value.RightIndex();
+    lists_meta_value.ModifyRightIndex(1);
+    ListsDataKey lists_data_key(key, version, index);
+    BaseDataValue i_val(value);
+    Add(inst, kListsDataCF, lists_data_key.Encode(), i_val.Encode());
+  }
+  if (ttl_millsec > 0) {
+    lists_meta_value.SetRelativeTimeInMillsec(ttl_millsec);
+  }
+  BaseMetaKey base_meta_key(key);
+  AddMeta(inst, base_meta_key.Encode(), lists_meta_value.Encode());
+  keys_++;
+  return MaybeSpill();
+}
+
+Status BulkLoader::ZAdd(const Slice& key, const std::vector<ScoreMember>& score_members, int64_t ttl_millsec) {
+  // the first score of a member wins, as in ZADD
+  std::unordered_set<std::string> unique;
+  std::vector<const ScoreMember*> filtered_score_members;
+  for (const auto& sm : score_members) {
+    if (unique.insert(sm.member).second) {
+      filtered_score_members.push_back(&sm);
+    }
+  }
+  if (filtered_score_members.empty()) {
+    return Status::OK();
+  }
+  Instance* inst = GetInstance(key);
+  char buf[4];
+  EncodeFixed32(buf, filtered_score_members.size());
+  ZSetsMetaValue zsets_meta_value(DataType::kZSets, Slice(buf, 4));
+  uint64_t version = zsets_meta_value.UpdateVersion();
+  if (ttl_millsec > 0) {
+    zsets_meta_value.SetRelativeTimeInMillsec(ttl_millsec);
+  }
+  BaseMetaKey base_meta_key(key);
+  AddMeta(inst, base_meta_key.Encode(), zsets_meta_value.Encode());
+  char score_buf[8];
+  for (const auto* sm : filtered_score_members) {
+    ZSetsMemberKey zsets_member_key(key, version, sm->member, inst->format);
+    const void* ptr_score = reinterpret_cast<const void*>(&sm->score);
+    EncodeFixed64(score_buf, *reinterpret_cast<const uint64_t*>(ptr_score));
+    BaseDataValue zsets_member_i_val(Slice(score_buf, sizeof(uint64_t)), inst->format);
+    Add(inst, kZsetsDataCF, zsets_member_key.Encode(), zsets_member_i_val.Encode());
+
+    ZSetsScoreKey zsets_score_key(key, version, sm->score, sm->member);
+    BaseDataValue zsets_score_i_val(Slice{}, inst->format);
+    Add(inst, kZsetsScoreCF, zsets_score_key.Encode(), zsets_score_i_val.Encode());
+  }
+  keys_++;
+  return MaybeSpill();
+}
+
+Status BulkLoader::MaybeSpill() {
+  if (buffered_bytes_ < options_.buffer_bytes) {
+    return Status::OK();
+  }
+  return Spill();
+}
+
+Status BulkLoader::Spill() {
+  std::vector<std::function<Status()>> jobs;
+  for (auto& [index, inst] : insts_) {
+    for (int cf = 0; cf < kBulkCFNum; ++cf) {
+      CFBuffer* buffer = &inst->buffers[cf];
+      if (buffer->entries.empty()) {
+        continue;
+      }
+      jobs.emplace_back([this, inst = inst.get(), cf, buffer]() {
+        return SpillBuffer(inst, static_cast<ColumnFamilyIndex>(cf), buffer);
+      });
+    }
+  }
+  buffered_bytes_ = 0;
+  return RunWorkers(jobs);
+}
+
+std::string BulkLoader::RunPath(int index, ColumnFamilyIndex cf, const std::string& name) const {
+  return options_.work_dir + "/" + std::to_string(index) + "/" + std::to_string(cf) + "_" + name + ".sst";
+}
+
+// Sorts the buffer by the comparator of the cf and writes it out as a run
+Status BulkLoader::SpillBuffer(Instance* inst, ColumnFamilyIndex cf, CFBuffer* buffer) {
+  const rocksdb::Options& options = inst->options[cf];
+  const rocksdb::Comparator* cmp = options.comparator;
+  auto& entries = buffer->entries;
+  std::stable_sort(entries.begin(), entries.end(),
+                   [cmp](const auto& a, const auto& b) { return cmp->Compare(a.first, b.first) < 0; });
+
+  rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), options);
+  std::string path = RunPath(inst->index, cf, std::to_string(buffer->next_file++));
+  Status s = writer.Open(path);
+  if (!s.ok()) {
+    return s;
+  }
+  for (size_t idx = 0; idx < entries.size(); ++idx) {
+    // the later of equal keys is kept
+    if (idx + 1 < entries.size() && cmp->Compare(entries[idx].first, entries[idx + 1].first) == 0) {
+      if (cf == kMetaCF) {
+        return DuplicateKeyError(entries[idx].first);
+      }
+      continue;
+    }
+    s = writer.Put(entries[idx].first, entries[idx].second);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  s = writer.Finish();
+  if (!s.ok()) {
+    return s;
+  }
+  buffer->runs.push_back(std::move(path));
+  std::vector<std::pair<std::string, std::string>>().swap(entries);
+  return Status::OK();
+}
+
+Status BulkLoader::MergeRuns(Instance* inst, ColumnFamilyIndex cf, std::vector<std::string>* files) {
+  CFBuffer* buffer = &inst->buffers[cf];
+  auto next_path = [this, inst, cf, buffer]() {
+    return RunPath(inst->index, cf, std::to_string(buffer->next_file++));
+  };
+  std::vector<std::string> runs = buffer->runs;
+  while (runs.size() > kMaxMergeWidth) {
+    std::vector<std::string> merged;
+    for (size_t first = 0; first < runs.size(); first += kMaxMergeWidth) {
+      std::vector<std::string> group(runs.begin() + first,
+                                     runs.begin() + std::min(first + kMaxMergeWidth, runs.size()));
+      if (group.size() == 1) {
+        merged.push_back(group.front());
+        continue;
+      }
+      Status s = MergeFiles(inst->options[cf], cf, group, std::numeric_limits<uint64_t>::max(), next_path, &merged);
+      if (!s.ok()) {
+        return s;
+      }
+      for (const auto& run : group) {
+        pstd::DeleteFile(run);
+      }
+    }
+    runs.swap(merged);
+  }
+  if (runs.size() == 1) {
+    files->push_back(runs.front());
+    return Status::OK();
+  }
+  return MergeFiles(inst->options[cf], cf, runs, options_.target_file_size, next_path, files);
+}
+
+Status BulkLoader::RunWorkers(const std::vector<std::function<Status()>>& jobs) {
+  std::vector<Status> statuses(jobs.size());
+  std::atomic<size_t> next_idx(0);
+  size_t worker_num = std::min(static_cast<size_t>(options_.worker_num), jobs.size());
+  std::vector<std::thread> workers;
+  workers.reserve(worker_num);
+  for (size_t worker = 0; worker < worker_num; ++worker) {
+    workers.emplace_back([&]() {
+      for (size_t idx = next_idx++; idx < jobs.size(); idx = next_idx++) {
+        statuses[idx] = jobs[idx]();
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  for (const auto& s : statuses) {
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status BulkLoader::Finish() {
+  if (finished_) {
+    return Status::InvalidArgument("bulk load already finished");
+  }
+  Status s = Spill();
+  std::map<int, std::vector<std::pair<ColumnFamilyIndex, std::vector<std::string>>>> inst_files;
+  if (s.ok()) {
+    std::vector<std::function<Status()>> jobs;
+    for (auto& [index, inst] : insts_) {
+      auto& cf_files = inst_files[index];
+      for (int cf = 0; cf < kBulkCFNum; ++cf) {
+        if (!inst->buffers[cf].runs.empty()) {
+          cf_files.emplace_back(static_cast<ColumnFamilyIndex>(cf), std::vector<std::string>());
+        }
+      }
+      for (auto& [cf, files] : cf_files) {
+        jobs.emplace_back([this, inst = inst.get(), cf = cf, files = &files]() { return MergeRuns(inst, cf, files); });
+      }
+    }
+    s = RunWorkers(jobs);
+  }
+  if (!s.ok()) {
+    LOG(ERROR) << "bulk load failed before the ingestion, " << s.ToString();
+    return s;
+  }
+
+  finished_ = true;
+  for (const auto& [index, cf_files] : inst_files) {
+    s = insts_[index]->redis->IngestBulkFiles(cf_files);
+    if (!s.ok()) {
+      LOG(ERROR) << "bulk load of instance " << index << " failed, " << s.ToString();
+      break;
+    }
+  }
+  pstd::DeleteDirIfExist(options_.work_dir);
+  if (s.ok()) {
+    LOG(INFO) << "bulk loaded " << keys_ << " keys, " << entries_ << " entries";
+  }
+  return s;
+}
+
+}  //  namespace storage
@@ -0,0 +1,55 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_CUSTOM_SLICE_TRANSFORM_H_
+#define SRC_CUSTOM_SLICE_TRANSFORM_H_
+
+#include "rocksdb/slice_transform.h"
+
+#include "storage/storage_define.h"
+
+namespace storage {
+/*
+ * Extract the prefix shared by all data keys of one collection, used for
+ * hash/set/zset member keys and zset score keys:
+ * | reserve1 | key | version | ... |
+ * |    8B    |     |    8B   |     |
+ * kDataFormatV2 member keys carry a 1B format tag in place of reserve1.
+ * The encoded user key ends with the "\0\0" delimiter, so the prefix is
+ * self-delimited and two different user keys never share a prefix.
+ */
+class DataKeyPrefixTransformImpl : public rocksdb::SliceTransform {
+ public:
+  DataKeyPrefixTransformImpl() = default;
+
+  const char* Name() const override { return "pika.DataKeyPrefixTransform"; }
+
+  rocksdb::Slice Transform(const rocksdb::Slice& key) const override {
+    assert(InDomain(key));
+    return rocksdb::Slice(key.data(), PrefixLength(key));
+  }
+
+  bool InDomain(const rocksdb::Slice& key) const override { return PrefixLength(key) != 0; }
+
+ private:
+  // return 0 if the key is too short to hold reserve1 + encoded key + version
+  static size_t PrefixLength(const rocksdb::Slice& key) {
+    size_t reserve_length = DataKeyPrefixLength(key);
+    if (key.size() < reserve_length + kEncodedKeyDelimSize + kVersionLength) {
+      return 0;
+    }
+    const char* ptr = key.data() + reserve_length;
+    int length = static_cast<int>(key.size() - reserve_length);
+    const char* delim_end = SeekUserkeyDelim(ptr, length);
+    if (delim_end == ptr) {
+      return 0;
+    }
+    size_t prefix_length = std::distance(key.data(), delim_end) + kVersionLength;
+    return prefix_length <= key.size() ? prefix_length : 0;
+  }
+};
+
+}  //  namespace storage
+#endif  //  SRC_CUSTOM_SLICE_TRANSFORM_H_
@@ -0,0 +1,86 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/expiry_index.h"
+
+#include "src/base_meta_value_format.h"
+#include "src/debug.h"
+#include "src/lists_meta_value_format.h"
+#include "src/strings_value_format.h"
+
+namespace storage {
+
+uint64_t MetaValueEtime(const rocksdb::Slice& meta_value) {
+  if (meta_value.empty()) {
+    return 0;
+  }
+  switch (static_cast<DataType>(static_cast<uint8_t>(meta_value[0]))) {
+    case DataType::kStrings:
+      return ParsedStringsValue(meta_value).Etime();
+    case DataType::kHashes:
+    case DataType::kSets:
+    case DataType::kZSets:
+      return ParsedBaseMetaValue(meta_value).Etime();
+    case DataType::kLists:
+      return ParsedListsMetaValue(meta_value).Etime();
+    default:
+      // streams do not expire
+      return 0;
+  }
+}
+
+bool MetaValueExpired(const rocksdb::Slice& meta_value, uint64_t now) {
+  if (meta_value.empty()) {
+    return false;
+  }
+  switch (static_cast<DataType>(static_cast<uint8_t>(meta_value[0]))) {
+    case DataType::kStrings: {
+      ParsedStringsValue parsed_strings_value(meta_value);
+      return parsed_strings_value.Etime() != 0 && parsed_strings_value.Etime() < now;
+    }
+    case DataType::kHashes:
+    case DataType::kSets:
+    case DataType::kZSets: {
+      ParsedBaseMetaValue parsed_base_meta_value(meta_value);
+      return parsed_base_meta_value.Etime() != 0 && parsed_base_meta_value.Etime() < now &&
+             parsed_base_meta_value.Version() < now;
+    }
+    case DataType::kLists: {
+      ParsedListsMetaValue parsed_lists_meta_value(meta_value);
+      return parsed_lists_meta_value.Etime() != 0 && parsed_lists_meta_value.Etime() < now &&
+             parsed_lists_meta_value.Version() < now;
+    }
+    default:
+      return false;
+  }
+}
+
+bool ExpiryIndexFilter::Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value,
+                               std::string* new_value, bool* value_changed) const {
+  UNUSED(level);
+  UNUSED(value);
+  UNUSED(new_value);
+  UNUSED(value_changed);
+  // destroyed when close the database, or the build marker
+  if (db_ == nullptr || cf_handles_ptr_->empty() || key.size() <= kExpiryIndexBucketLength) {
+    return false;
+  }
+  std::string meta_value;
+  rocksdb::Slice meta_key(key.data() + kExpiryIndexBucketLength, key.size() - kExpiryIndexBucketLength);
+  rocksdb::Status s = db_->Get(default_read_options_, (*cf_handles_ptr_)[kMetaCF], meta_key, &meta_value);
+  if (s.IsNotFound()) {
+    TRACE("Drop[Meta key not exist]");
+    return true;
+  }
+  if (!s.ok()) {
+    TRACE("Reserve[Get meta_key faild]");
+    return false;
+  }
+  // persisted, or expired again since the entry was written
+  uint64_t etime = MetaValueEtime(meta_value);
+  return etime == 0 || ExpiryIndexBucket(etime) != DecodeExpiryIndexBucket(key);
+}
+
+}  //  namespace storage
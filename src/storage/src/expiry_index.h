@@ -0,0 +1,102 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_EXPIRY_INDEX_H_
+#define SRC_EXPIRY_INDEX_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rocksdb/compaction_filter.h"
+#include "rocksdb/db.h"
+
+#include "storage/storage_define.h"
+
+namespace storage {
+
+/*
+ * The expiry index cf holds one key per meta value put with an etime, in
+ * the order the keys expire:
+ * | bucket | meta key |
+ * |   8B   |          |
+ * bucket is the etime in seconds, big endian so that the buckets sort by
+ * time. The value is empty. An entry is written with every meta put that
+ * has an etime and never updated, so a key expired again, persisted or
+ * deleted leaves its old entry behind. The reaper checks each due entry
+ * against the meta cf before deleting the key, and the compaction filter
+ * drops the entries whose meta key is gone or expires in another bucket.
+ */
+constexpr size_t kExpiryIndexBucketLength = sizeof(uint64_t);
+constexpr uint64_t kExpiryIndexBucketMillis = 1000;
+
+inline uint64_t ExpiryIndexBucket(uint64_t etime) { return etime / kExpiryIndexBucketMillis; }
+
+inline std::string EncodeExpiryIndexBucket(uint64_t bucket) {
+  std::string index_key(kExpiryIndexBucketLength, '\0');
+  for (size_t idx = 0; idx < kExpiryIndexBucketLength; ++idx) {
+    index_key[idx] = static_cast<char>(bucket >> (8 * (kExpiryIndexBucketLength - 1 - idx)));
+  }
+  return index_key;
+}
+
+inline uint64_t DecodeExpiryIndexBucket(const rocksdb::Slice& index_key) {
+  uint64_t bucket = 0;
+  for (size_t idx = 0; idx < kExpiryIndexBucketLength; ++idx) {
+    bucket = (bucket << 8) | static_cast<uint8_t>(index_key[idx]);
+  }
+  return bucket;
+}
+
+inline std::string EncodeExpiryIndexKey(uint64_t etime, const rocksdb::Slice& meta_key) {
+  std::string index_key = EncodeExpiryIndexBucket(ExpiryIndexBucket(etime));
+  index_key.append(meta_key.data(), meta_key.size());
+  return index_key;
+}
+
+// Written once the index covers every meta key with an etime. Shorter than
+// a bucket and sorts after every bucket of this era, so the reaper never
+// reaches it
+constexpr const char* kExpiryIndexBuiltKey = "#built";
+
+// The etime of a meta value of any type, 0 when it does not expire
+uint64_t MetaValueEtime(const rocksdb::Slice& meta_value);
+
+// Whether the meta compaction filter would drop the meta value at now
+bool MetaValueExpired(const rocksdb::Slice& meta_value, uint64_t now);
+
+class ExpiryIndexFilter : public rocksdb::CompactionFilter {
+ public:
+  ExpiryIndexFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr)
+      : db_(db), cf_handles_ptr_(cf_handles_ptr) {}
+
+  bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value,
+              bool* value_changed) const override;
+
+  const char* Name() const override { return "ExpiryIndexFilter"; }
+
+ private:
+  rocksdb::DB* db_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+  rocksdb::ReadOptions default_read_options_;
+};
+
+class ExpiryIndexFilterFactory : public rocksdb::CompactionFilterFactory {
+ public:
+  ExpiryIndexFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr)
+      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr) {}
+  std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+      const rocksdb::CompactionFilter::Context& context) override {
+    return std::make_unique<ExpiryIndexFilter>(*db_ptr_, cf_handles_ptr_);
+  }
+  const char* Name() const override { return "ExpiryIndexFilterFactory"; }
+
+ private:
+  rocksdb::DB** db_ptr_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+};
+
+}  //  namespace storage
+#endif  //  SRC_EXPIRY_INDEX_H_
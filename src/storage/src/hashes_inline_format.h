@@ -0,0 +1,125 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_HASHES_INLINE_FORMAT_H_
+#define SRC_HASHES_INLINE_FORMAT_H_
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "rocksdb/slice.h"
+
+#include "src/coding.h"
+#include "storage/storage.h"
+
+namespace storage {
+
+/*
+ * Fields of a small hash kept inline in its meta value, after the count,
+ * sorted by field like the data keys they stand for:
+ * | field len | field | value len | value | ...
+ * |     4B    |       |     4B    |       |
+ */
+class HashesInlineFields {
+ public:
+  HashesInlineFields() = default;
+
+  bool Decode(const Slice& payload) {
+    fvs_.clear();
+    const char* ptr = payload.data();
+    const char* end_ptr = payload.data() + payload.size();
+    while (ptr != end_ptr) {
+      FieldValue fv;
+      if (!DecodeString(&ptr, end_ptr, &fv.field) || !DecodeString(&ptr, end_ptr, &fv.value)) {
+        return false;
+      }
+      fvs_.push_back(std::move(fv));
+    }
+    return true;
+  }
+
+  std::string Encode() const {
+    std::string payload;
+    for (const auto& fv : fvs_) {
+      EncodeString(fv.field, &payload);
+      EncodeString(fv.value, &payload);
+    }
+    return payload;
+  }
+
+  // whether the fields may stay inline, at most max_entries of them and
+  // no field or value longer than max_value
+  bool Fits(int32_t max_entries, int32_t max_value) const {
+    if (fvs_.size() > static_cast<size_t>(std::max(max_entries, 0))) {
+      return false;
+    }
+    return std::all_of(fvs_.begin(), fvs_.end(), [max_value](const FieldValue& fv) {
+      return fv.field.size() <= static_cast<size_t>(max_value) && fv.value.size() <= static_cast<size_t>(max_value);
+    });
+  }
+
+  size_t Count() const { return fvs_.size(); }
+  const std::vector<FieldValue>& FieldValues() const { return fvs_; }
+
+  // the first field not less than field
+  std::vector<FieldValue>::const_iterator LowerBound(const Slice& field) const {
+    return std::lower_bound(fvs_.begin(), fvs_.end(), field,
+                            [](const FieldValue& fv, const Slice& target) { return Slice(fv.field).compare(target) < 0; });
+  }
+
+  const std::string* Find(const Slice& field) const {
+    auto iter = LowerBound(field);
+    return iter != fvs_.end() && Slice(iter->field) == field ? &iter->value : nullptr;
+  }
+
+  // returns whether field is new
+  bool Set(const Slice& field, const Slice& value) {
+    auto iter = fvs_.begin() + (LowerBound(field) - fvs_.cbegin());
+    if (iter != fvs_.end() && Slice(iter->field) == field) {
+      iter->value.assign(value.data(), value.size());
+      return false;
+    }
+    fvs_.insert(iter, FieldValue(field.ToString(), value.ToString()));
+    return true;
+  }
+
+  // returns whether field was there
+  bool Erase(const Slice& field) {
+    auto iter = LowerBound(field);
+    if (iter == fvs_.end() || Slice(iter->field) != field) {
+      return false;
+    }
+    fvs_.erase(iter);
+    return true;
+  }
+
+ private:
+  static void EncodeString(const std::string& str, std::string* dst) {
+    char buf[sizeof(uint32_t)];
+    EncodeFixed32(buf, static_cast<uint32_t>(str.size()));
+    dst->append(buf, sizeof(buf));
+    dst->append(str);
+  }
+
+  static bool DecodeString(const char** ptr, const char* end_ptr, std::string* str) {
+    if (end_ptr - *ptr < static_cast<ptrdiff_t>(sizeof(uint32_t))) {
+      return false;
+    }
+    uint32_t len = DecodeFixed32(*ptr);
+    *ptr += sizeof(uint32_t);
+    if (end_ptr - *ptr < static_cast<ptrdiff_t>(len)) {
+      return false;
+    }
+    str->assign(*ptr, len);
+    *ptr += len;
+    return true;
+  }
+
+  std::vector<FieldValue> fvs_;
+};
+
+}  //  namespace storage
+#endif  //  SRC_HASHES_INLINE_FORMAT_H_
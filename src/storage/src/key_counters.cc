@@ -0,0 +1,145 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/key_counters.h"
+
+#include <memory>
+
+#include "src/base_meta_value_format.h"
+#include "src/coding.h"
+#include "src/debug.h"
+#include "src/lists_meta_value_format.h"
+#include "src/pika_stream_meta_value.h"
+#include "src/strings_value_format.h"
+
+namespace storage {
+
+void AccumulateKeyCounters(const rocksdb::Slice& meta_value, int64_t sign, KeyCountersMap* counters) {
+  if (meta_value.empty()) {
+    return;
+  }
+  auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
+  bool empty = false;
+  uint64_t etime = 0;
+  switch (type) {
+    case DataType::kStrings: {
+      ParsedStringsValue parsed_strings_value(meta_value);
+      etime = parsed_strings_value.Etime();
+      break;
+    }
+    case DataType::kHashes:
+    case DataType::kSets:
+    case DataType::kZSets: {
+      ParsedBaseMetaValue parsed_base_meta_value(meta_value);
+      empty = parsed_base_meta_value.Count() == 0;
+      etime = parsed_base_meta_value.Etime();
+      break;
+    }
+    case DataType::kLists: {
+      ParsedListsMetaValue parsed_lists_meta_value(meta_value);
+      empty = parsed_lists_meta_value.Count() == 0;
+      etime = parsed_lists_meta_value.Etime();
+      break;
+    }
+    case DataType::kStreams: {
+      if (meta_value.size() != kDefaultStreamValueLength) {
+        return;
+      }
+      ParsedStreamMetaValue parsed_stream_meta_value(meta_value);
+      empty = parsed_stream_meta_value.length() == 0;
+      break;
+    }
+    default:
+      return;
+  }
+
+  KeyCounters& type_counters = (*counters)[DataTypeToTag(type)];
+  type_counters.total += sign;
+  if (empty) {
+    type_counters.empty += sign;
+  } else if (etime != 0) {
+    type_counters.expires += sign;
+    type_counters.etime_sum += sign * static_cast<int64_t>(etime / 1000);
+  }
+}
+
+rocksdb::Status ReadKeyCounters(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* stats_handle,
+                                const rocksdb::ReadOptions& options, KeyCountersMap* counters) {
+  counters->clear();
+  std::unique_ptr<rocksdb::Iterator> iter(db->NewIterator(options, stats_handle));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    rocksdb::Slice key = iter->key();
+    if (key.size() != 2 || iter->value().size() != sizeof(uint64_t)) {
+      continue;
+    }
+    auto counter = static_cast<int64_t>(DecodeFixed64(iter->value().data()));
+    KeyCounters& type_counters = (*counters)[key[0]];
+    switch (key[1]) {
+      case kKeyCounterTotal:
+        type_counters.total = counter;
+        break;
+      case kKeyCounterEmpty:
+        type_counters.empty = counter;
+        break;
+      case kKeyCounterExpires:
+        type_counters.expires = counter;
+        break;
+      case kKeyCounterEtimeSum:
+        type_counters.etime_sum = counter;
+        break;
+      default:
+        break;
+    }
+  }
+  return iter->status();
+}
+
+rocksdb::Status MergeKeyCounters(rocksdb::WriteBatch* batch, rocksdb::ColumnFamilyHandle* stats_handle,
+                                 const KeyCountersMap& deltas) {
+  char buf[sizeof(uint64_t)];
+  auto merge = [&](char tag, KeyCounter counter, int64_t delta) {
+    if (delta == 0) {
+      return rocksdb::Status::OK();
+    }
+    EncodeFixed64(buf, static_cast<uint64_t>(delta));
+    return batch->Merge(stats_handle, EncodeKeyCounterKey(tag, counter), rocksdb::Slice(buf, sizeof(buf)));
+  };
+  for (const auto& [tag, delta] : deltas) {
+    rocksdb::Status s = merge(tag, kKeyCounterTotal, delta.total);
+    if (s.ok()) {
+      s = merge(tag, kKeyCounterEmpty, delta.empty);
+    }
+    if (s.ok()) {
+      s = merge(tag, kKeyCounterExpires, delta.expires);
+    }
+    if (s.ok()) {
+      s = merge(tag, kKeyCounterEtimeSum, delta.etime_sum);
+    }
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return rocksdb::Status::OK();
+}
+
+bool KeyStatsMergeOperator::Merge(const rocksdb::Slice& key, const rocksdb::Slice* existing_value,
+                                  const rocksdb::Slice& value, std::string* new_value, rocksdb::Logger* logger) const {
+  UNUSED(key);
+  UNUSED(logger);
+  // negative deltas wrap around, the sum reads back as a signed integer
+  uint64_t sum = 0;
+  if (existing_value != nullptr && existing_value->size() == sizeof(uint64_t)) {
+    sum = DecodeFixed64(existing_value->data());
+  }
+  if (value.size() == sizeof(uint64_t)) {
+    sum += DecodeFixed64(value.data());
+  }
+  char buf[sizeof(uint64_t)];
+  EncodeFixed64(buf, sum);
+  new_value->assign(buf, sizeof(buf));
+  return true;
+}
+
+}  //  namespace storage
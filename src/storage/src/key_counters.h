@@ -0,0 +1,77 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_KEY_COUNTERS_H_
+#define SRC_KEY_COUNTERS_H_
+
+#include <map>
+#include <string>
+
+#include "rocksdb/db.h"
+#include "rocksdb/merge_operator.h"
+#include "rocksdb/write_batch.h"
+
+#include "src/base_value_format.h"
+#include "storage/storage_define.h"
+
+namespace storage {
+
+/*
+ * The key stats cf holds four counters per type, kept at write time from the
+ * meta values put and deleted in each write:
+ * | type tag | counter |
+ * |    1B    |   1B    |
+ * The value is a fixed64 two's complement integer summed by
+ * KeyStatsMergeOperator. A meta value is counted by its content only, so a
+ * key whose etime has passed is still counted as expiring until it is
+ * rewritten, or until the compaction drops it and the next reconcile takes it
+ * out.
+ */
+enum KeyCounter : char {
+  kKeyCounterTotal = 't',    // meta values of the type
+  kKeyCounterEmpty = 'e',    // of which hold no member, seen as invalid keys
+  kKeyCounterExpires = 'x',  // of which have members and an etime
+  kKeyCounterEtimeSum = 's'  // sum of those etimes, in seconds so it does not overflow
+};
+
+struct KeyCounters {
+  int64_t total = 0;
+  int64_t empty = 0;
+  int64_t expires = 0;
+  int64_t etime_sum = 0;
+
+  bool Zero() const { return total == 0 && empty == 0 && expires == 0 && etime_sum == 0; }
+};
+
+// Counters by type tag
+using KeyCountersMap = std::map<char, KeyCounters>;
+
+inline std::string EncodeKeyCounterKey(char tag, KeyCounter counter) { return {tag, static_cast<char>(counter)}; }
+
+// Written once the counters match the meta cf, sorts before every tag
+constexpr const char* kKeyCountersReconciledKey = "#reconciled";
+
+// Adds (sign 1) or takes out (sign -1) the counters of one meta value
+void AccumulateKeyCounters(const rocksdb::Slice& meta_value, int64_t sign, KeyCountersMap* counters);
+
+// Counters of every type as stored, see kKeyCountersReconciledKey for
+// whether they can be trusted
+rocksdb::Status ReadKeyCounters(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* stats_handle,
+                                const rocksdb::ReadOptions& options, KeyCountersMap* counters);
+
+// Merges the non zero deltas into batch
+rocksdb::Status MergeKeyCounters(rocksdb::WriteBatch* batch, rocksdb::ColumnFamilyHandle* stats_handle,
+                                 const KeyCountersMap& deltas);
+
+class KeyStatsMergeOperator : public rocksdb::AssociativeMergeOperator {
+ public:
+  bool Merge(const rocksdb::Slice& key, const rocksdb::Slice* existing_value, const rocksdb::Slice& value,
+             std::string* new_value, rocksdb::Logger* logger) const override;
+
+  const char* Name() const override { return "KeyStatsMergeOperator"; }
+};
+
+}  //  namespace storage
+#endif  //  SRC_KEY_COUNTERS_H_
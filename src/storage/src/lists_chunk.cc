@@ -0,0 +1,498 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/lists_chunk.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "src/base_data_value_format.h"
+#include "src/coding.h"
+#include "src/lists_data_key_format.h"
+
+namespace storage {
+
+bool ListsChunk::Decode(const Slice& payload) {
+  elements_.clear();
+  bytes_ = 0;
+  if (payload.size() < sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t count = DecodeFixed32(payload.data());
+  const char* ptr = payload.data() + sizeof(uint32_t);
+  const char* end_ptr = payload.data() + payload.size();
+  for (uint32_t idx = 0; idx < count; ++idx) {
+    if (end_ptr - ptr < static_cast<ptrdiff_t>(sizeof(uint32_t))) {
+      return false;
+    }
+    uint32_t len = DecodeFixed32(ptr);
+    ptr += sizeof(uint32_t);
+    if (end_ptr - ptr < static_cast<ptrdiff_t>(len)) {
+      return false;
+    }
+    elements_.emplace_back(ptr, len);
+    bytes_ += len;
+    ptr += len;
+  }
+  return ptr == end_ptr;
+}
+
+std::string ListsChunk::Encode() const {
+  std::string payload;
+  payload.reserve(sizeof(uint32_t) * (elements_.size() + 1) + bytes_);
+  char buf[sizeof(uint32_t)];
+  EncodeFixed32(buf, static_cast<uint32_t>(elements_.size()));
+  payload.append(buf, sizeof(buf));
+  for (const auto& element : elements_) {
+    EncodeFixed32(buf, static_cast<uint32_t>(element.size()));
+    payload.append(buf, sizeof(buf));
+    payload.append(element);
+  }
+  return payload;
+}
+
+uint32_t ListsChunk::DecodeCount(const Slice& payload) {
+  return payload.size() < sizeof(uint32_t) ? 0 : DecodeFixed32(payload.data());
+}
+
+void ListsChunk::Set(size_t pos, const Slice& element) {
+  bytes_ = bytes_ - elements_[pos].size() + element.size();
+  elements_[pos].assign(element.data(), element.size());
+}
+
+void ListsChunk::Insert(size_t pos, const Slice& element) {
+  elements_.insert(elements_.begin() + static_cast<ptrdiff_t>(pos), element.ToString());
+  bytes_ += element.size();
+}
+
+void ListsChunk::Erase(size_t pos) {
+  bytes_ -= elements_[pos].size();
+  elements_.erase(elements_.begin() + static_cast<ptrdiff_t>(pos));
+}
+
+std::string ListsChunk::PopFront() {
+  std::string element = std::move(elements_.front());
+  elements_.pop_front();
+  bytes_ -= element.size();
+  return element;
+}
+
+std::string ListsChunk::PopBack() {
+  std::string element = std::move(elements_.back());
+  elements_.pop_back();
+  bytes_ -= element.size();
+  return element;
+}
+
+void ListsChunk::Trim(size_t first, size_t last) {
+  elements_.erase(elements_.begin() + static_cast<ptrdiff_t>(last) + 1, elements_.end());
+  elements_.erase(elements_.begin(), elements_.begin() + static_cast<ptrdiff_t>(first));
+  bytes_ = 0;
+  for (const auto& element : elements_) {
+    bytes_ += element.size();
+  }
+}
+
+void ListsChunk::SplitAt(size_t pos, ListsChunk* tail) {
+  while (elements_.size() > pos) {
+    tail->PushFront(PopBack());
+  }
+}
+
+ChunkedList::ChunkedList(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle, const Slice& key,
+                         ParsedListsMetaValue* meta_value, int32_t chunk_size)
+    : db_(db),
+      handle_(handle),
+      key_(key.ToString()),
+      meta_value_(meta_value),
+      version_(meta_value->Version()),
+      chunk_size_(chunk_size > 0 ? chunk_size : kListChunkDefaultSize) {
+  ListsDataKey lists_data_key(key_, version_, 0);
+  Slice encoded = lists_data_key.Encode();
+  prefix_.assign(encoded.data(), encoded.size() - sizeof(uint64_t) - kSuffixReserveLength);
+}
+
+Status ChunkedList::Push(const std::vector<std::string>& values, bool left, rocksdb::WriteBatch* batch) {
+  std::unique_ptr<rocksdb::Iterator> iter(NewChunkIterator(rocksdb::ReadOptions()));
+  ListsChunk chunk;
+  uint64_t chunk_id = 0;
+  bool loaded = false;
+  if (meta_value_->Count() > 0) {
+    SeekToEnd(iter.get(), left);
+    if (ChunkOf(iter.get(), &chunk_id)) {
+      Status s = DecodeChunk(iter.get(), &chunk);
+      if (!s.ok()) {
+        return s;
+      }
+      loaded = true;
+    } else if (!iter->status().ok()) {
+      return iter->status();
+    }
+  }
+  for (const auto& value : values) {
+    if (!loaded || !chunk.HasRoom(value.size(), chunk_size_)) {
+      if (loaded) {
+        PutChunk(chunk_id, chunk, batch);
+      }
+      chunk = ListsChunk();
+      chunk_id = NewChunkId(left);
+      loaded = true;
+    }
+    if (left) {
+      chunk.PushFront(value);
+    } else {
+      chunk.PushBack(value);
+    }
+    meta_value_->ModifyCount(1);
+  }
+  if (loaded) {
+    PutChunk(chunk_id, chunk, batch);
+  }
+  return Status::OK();
+}
+
+Status ChunkedList::Pop(uint64_t count, bool left, std::vector<std::string>* elements, rocksdb::WriteBatch* batch) {
+  std::unique_ptr<rocksdb::Iterator> iter(NewChunkIterator(rocksdb::ReadOptions()));
+  uint64_t chunk_id = 0;
+  uint64_t popped = 0;
+  for (SeekToEnd(iter.get(), left); popped < count && ChunkOf(iter.get(), &chunk_id);
+       left ? iter->Next() : iter->Prev()) {
+    ListsChunk chunk;
+    Status s = DecodeChunk(iter.get(), &chunk);
+    if (!s.ok()) {
+      return s;
+    }
+    for (; !chunk.Empty() && popped < count; ++popped) {
+      elements->push_back(left ? chunk.PopFront() : chunk.PopBack());
+      meta_value_->ModifyCount(-1);
+    }
+    PutChunk(chunk_id, chunk, batch);
+  }
+  return iter->status();
+}
+
+Status ChunkedList::Set(uint64_t pos, const Slice& value, rocksdb::WriteBatch* batch) {
+  std::unique_ptr<rocksdb::Iterator> iter(NewChunkIterator(rocksdb::ReadOptions()));
+  uint64_t chunk_id = 0;
+  uint64_t first_pos = 0;
+  Status s = Locate(iter.get(), pos, &chunk_id, &first_pos);
+  if (!s.ok()) {
+    return s;
+  }
+  ListsChunk chunk;
+  s = DecodeChunk(iter.get(), &chunk);
+  if (!s.ok()) {
+    return s;
+  }
+  chunk.Set(pos - first_pos, value);
+  PutChunk(chunk_id, chunk, batch);
+  return Status::OK();
+}
+
+Status ChunkedList::Trim(uint64_t first, uint64_t last, rocksdb::WriteBatch* batch) {
+  std::unique_ptr<rocksdb::Iterator> iter(NewChunkIterator(rocksdb::ReadOptions()));
+  uint64_t chunk_id = 0;
+  uint64_t chunk_first = 0;
+  for (SeekToEnd(iter.get(), true); ChunkOf(iter.get(), &chunk_id); iter->Next()) {
+    ParsedBaseDataValue parsed_value(iter->value());
+    uint64_t count = ListsChunk::DecodeCount(parsed_value.UserValue());
+    uint64_t chunk_last = chunk_first + count - 1;
+    if (count == 0 || chunk_last < first || chunk_first > last) {
+      batch->Delete(handle_, iter->key());
+    } else if (chunk_first < first || chunk_last > last) {
+      ListsChunk chunk;
+      Status s = DecodeChunk(iter.get(), &chunk);
+      if (!s.ok()) {
+        return s;
+      }
+      chunk.Trim(std::max(first, chunk_first) - chunk_first, std::min(last, chunk_last) - chunk_first);
+      PutChunk(chunk_id, chunk, batch);
+    }
+    chunk_first += count;
+  }
+  meta_value_->SetCount(last - first + 1);
+  return iter->status();
+}
+
+Status ChunkedList::Insert(const BeforeOrAfter& before_or_after, const Slice& pivot, const Slice& value,
+                           rocksdb::WriteBatch* batch) {
+  std::unique_ptr<rocksdb::Iterator> iter(NewChunkIterator(rocksdb::ReadOptions()));
+  uint64_t chunk_id = 0;
+  for (SeekToEnd(iter.get(), true); ChunkOf(iter.get(), &chunk_id); iter->Next()) {
+    ListsChunk chunk;
+    Status s = DecodeChunk(iter.get(), &chunk);
+    if (!s.ok()) {
+      return s;
+    }
+    for (size_t idx = 0; idx < chunk.Count(); ++idx) {
+      if (pivot.compare(chunk.At(idx)) != 0) {
+        continue;
+      }
+      chunk.Insert(before_or_after == Before ? idx : idx + 1, value);
+      meta_value_->ModifyCount(1);
+      if (chunk.Oversized(chunk_size_)) {
+        uint64_t split_id = 0;
+        iter->Next();
+        s = SplitChunkId(iter.get(), chunk_id, &split_id, batch);
+        if (!s.ok()) {
+          return s;
+        }
+        ListsChunk tail;
+        chunk.SplitAt(chunk.Count() / 2, &tail);
+        PutChunk(split_id, tail, batch);
+      }
+      PutChunk(chunk_id, chunk, batch);
+      return Status::OK();
+    }
+  }
+  return iter->status().ok() ? Status::NotFound() : iter->status();
+}
+
+Status ChunkedList::Rem(int64_t count, const Slice& value, uint64_t* removed, rocksdb::WriteBatch* batch) {
+  *removed = 0;
+  bool left = count >= 0;
+  uint64_t rest = count < 0 ? -count : count;
+  std::unique_ptr<rocksdb::Iterator> iter(NewChunkIterator(rocksdb::ReadOptions()));
+  uint64_t chunk_id = 0;
+  for (SeekToEnd(iter.get(), left); (count == 0 || rest != 0) && ChunkOf(iter.get(), &chunk_id);
+       left ? iter->Next() : iter->Prev()) {
+    ListsChunk chunk;
+    Status s = DecodeChunk(iter.get(), &chunk);
+    if (!s.ok()) {
+      return s;
+    }
+    size_t origin_count = chunk.Count();
+    if (left) {
+      for (size_t idx = 0; idx < chunk.Count() && (count == 0 || rest != 0);) {
+        if (value.compare(chunk.At(idx)) == 0) {
+          chunk.Erase(idx);
+          if (count != 0) {
+            rest--;
+          }
+        } else {
+          ++idx;
+        }
+      }
+    } else {
+      for (size_t idx = chunk.Count(); idx > 0 && rest != 0; --idx) {
+        if (value.compare(chunk.At(idx - 1)) == 0) {
+          chunk.Erase(idx - 1);
+          rest--;
+        }
+      }
+    }
+    if (chunk.Count() != origin_count) {
+      *removed += origin_count - chunk.Count();
+      PutChunk(chunk_id, chunk, batch);
+    }
+  }
+  meta_value_->ModifyCount(-*removed);
+  return iter->status();
+}
+
+Status ChunkedList::Rotate(std::string* element, rocksdb::WriteBatch* batch) {
+  std::unique_ptr<rocksdb::Iterator> iter(NewChunkIterator(rocksdb::ReadOptions()));
+  uint64_t tail_id = 0;
+  uint64_t head_id = 0;
+  ListsChunk tail;
+  SeekToEnd(iter.get(), false);
+  if (!ChunkOf(iter.get(), &tail_id)) {
+    return iter->status().ok() ? Status::Corruption("list chunks out of sync with meta") : iter->status();
+  }
+  Status s = DecodeChunk(iter.get(), &tail);
+  if (!s.ok()) {
+    return s;
+  }
+  *element = tail.PopBack();
+
+  SeekToEnd(iter.get(), true);
+  if (!ChunkOf(iter.get(), &head_id)) {
+    return iter->status().ok() ? Status::Corruption("list chunks out of sync with meta") : iter->status();
+  }
+  if (head_id == tail_id) {
+    tail.PushFront(*element);
+    PutChunk(tail_id, tail, batch);
+    return Status::OK();
+  }
+  PutChunk(tail_id, tail, batch);
+  ListsChunk head;
+  s = DecodeChunk(iter.get(), &head);
+  if (!s.ok()) {
+    return s;
+  }
+  if (!head.HasRoom(element->size(), chunk_size_)) {
+    head = ListsChunk();
+    head_id = NewChunkId(true);
+  }
+  head.PushFront(*element);
+  PutChunk(head_id, head, batch);
+  return Status::OK();
+}
+
+Status ChunkedList::Index(const rocksdb::ReadOptions& read_options, uint64_t pos, std::string* element) {
+  std::unique_ptr<rocksdb::Iterator> iter(NewChunkIterator(read_options));
+  uint64_t chunk_id = 0;
+  uint64_t first_pos = 0;
+  Status s = Locate(iter.get(), pos, &chunk_id, &first_pos);
+  if (!s.ok()) {
+    return s;
+  }
+  ListsChunk chunk;
+  s = DecodeChunk(iter.get(), &chunk);
+  if (!s.ok()) {
+    return s;
+  }
+  *element = chunk.At(pos - first_pos);
+  return Status::OK();
+}
+
+Status ChunkedList::Range(const rocksdb::ReadOptions& read_options, uint64_t first, uint64_t last,
+                          std::vector<std::string>* elements) {
+  std::unique_ptr<rocksdb::Iterator> iter(NewChunkIterator(read_options));
+  uint64_t chunk_id = 0;
+  uint64_t chunk_first = 0;
+  Status s = Locate(iter.get(), first, &chunk_id, &chunk_first);
+  if (!s.ok()) {
+    return s;
+  }
+  for (uint64_t pos = first; pos <= last && ChunkOf(iter.get(), &chunk_id); iter->Next()) {
+    ListsChunk chunk;
+    s = DecodeChunk(iter.get(), &chunk);
+    if (!s.ok()) {
+      return s;
+    }
+    for (size_t idx = pos - chunk_first; idx < chunk.Count() && pos <= last; ++idx, ++pos) {
+      elements->push_back(chunk.At(idx));
+    }
+    chunk_first += chunk.Count();
+  }
+  return iter->status();
+}
+
+rocksdb::Iterator* ChunkedList::NewChunkIterator(const rocksdb::ReadOptions& read_options) {
+  return db_->NewIterator(read_options, handle_);
+}
+
+std::string ChunkedList::ChunkKey(uint64_t chunk_id) {
+  ListsDataKey lists_data_key(key_, version_, chunk_id);
+  return lists_data_key.Encode().ToString();
+}
+
+bool ChunkedList::ChunkOf(rocksdb::Iterator* iter, uint64_t* chunk_id) {
+  if (!iter->Valid()) {
+    return false;
+  }
+  Slice key = iter->key();
+  if (key.size() != prefix_.size() + sizeof(uint64_t) + kSuffixReserveLength || !key.starts_with(prefix_)) {
+    return false;
+  }
+  *chunk_id = DecodeFixed64(key.data() + prefix_.size());
+  return *chunk_id > meta_value_->LeftIndex() && *chunk_id < meta_value_->RightIndex();
+}
+
+void ChunkedList::SeekToEnd(rocksdb::Iterator* iter, bool left) {
+  if (left) {
+    iter->Seek(ChunkKey(meta_value_->LeftIndex() + 1));
+  } else {
+    iter->SeekForPrev(ChunkKey(meta_value_->RightIndex() - 1));
+  }
+}
+
+Status ChunkedList::Locate(rocksdb::Iterator* iter, uint64_t pos, uint64_t* chunk_id, uint64_t* first_pos) {
+  uint64_t count = meta_value_->Count();
+  if (pos >= count) {
+    return Status::NotFound();
+  }
+  bool left = pos < count - pos;
+  uint64_t passed = 0;
+  for (SeekToEnd(iter, left); ChunkOf(iter, chunk_id); left ? iter->Next() : iter->Prev()) {
+    ParsedBaseDataValue parsed_value(iter->value());
+    uint64_t chunk_count = ListsChunk::DecodeCount(parsed_value.UserValue());
+    if (left && pos < passed + chunk_count) {
+      *first_pos = passed;
+      return Status::OK();
+    }
+    if (!left && count - 1 - pos < passed + chunk_count) {
+      *first_pos = count - passed - chunk_count;
+      return Status::OK();
+    }
+    passed += chunk_count;
+  }
+  return iter->status().ok() ? Status::Corruption("list chunks out of sync with meta") : iter->status();
+}
+
+Status ChunkedList::DecodeChunk(rocksdb::Iterator* iter, ListsChunk* chunk) {
+  ParsedBaseDataValue parsed_value(iter->value());
+  if (!chunk->Decode(parsed_value.UserValue())) {
+    return Status::Corruption("bad list chunk");
+  }
+  return Status::OK();
+}
+
+// keep kListChunkIdGap free on both sides of every chunk
+uint64_t ChunkedList::NewChunkId(bool left) {
+  uint64_t chunk_id = 0;
+  if (left) {
+    chunk_id = meta_value_->LeftIndex() - kListChunkIdGap + 1;
+    meta_value_->ModifyLeftIndex(kListChunkIdGap);
+  } else {
+    chunk_id = meta_value_->RightIndex();
+    meta_value_->ModifyRightIndex(kListChunkIdGap);
+  }
+  return chunk_id;
+}
+
+Status ChunkedList::SplitChunkId(rocksdb::Iterator* iter, uint64_t chunk_id, uint64_t* split_id,
+                                 rocksdb::WriteBatch* batch) {
+  // the chunks to move, by their old id
+  std::vector<std::pair<uint64_t, std::string>> moved;
+  uint64_t next_id = 0;
+  uint64_t spacing = 0;
+  while (true) {
+    bool at_end = !ChunkOf(iter, &next_id);
+    if (at_end) {
+      if (!iter->status().ok()) {
+        return iter->status();
+      }
+      next_id = meta_value_->RightIndex();
+    }
+    // the split chunk and the moved ones go in between, evenly spread
+    spacing = (next_id - chunk_id) / (moved.size() + 2);
+    if (moved.empty() ? spacing >= 1 : spacing >= kListChunkMinIdSpacing) {
+      break;
+    }
+    if (at_end) {
+      // the ids past the right end are free
+      uint64_t right_index = chunk_id + (moved.size() + 2) * kListChunkIdGap;
+      meta_value_->ModifyRightIndex(right_index - next_id);
+      spacing = kListChunkIdGap;
+      break;
+    }
+    moved.emplace_back(next_id, iter->value().ToString());
+    iter->Next();
+  }
+  // a new id may be the old one of a later chunk, so every delete goes first
+  for (const auto& [old_id, value] : moved) {
+    batch->Delete(handle_, ChunkKey(old_id));
+  }
+  for (size_t idx = 0; idx < moved.size(); ++idx) {
+    batch->Put(handle_, ChunkKey(chunk_id + (idx + 2) * spacing), moved[idx].second);
+  }
+  *split_id = chunk_id + spacing;
+  return Status::OK();
+}
+
+void ChunkedList::PutChunk(uint64_t chunk_id, const ListsChunk& chunk, rocksdb::WriteBatch* batch) {
+  if (chunk.Empty()) {
+    batch->Delete(handle_, ChunkKey(chunk_id));
+    return;
+  }
+  std::string payload = chunk.Encode();
+  BaseDataValue chunk_value(payload);
+  batch->Put(handle_, ChunkKey(chunk_id), chunk_value.Encode());
+}
+
+}  //  namespace storage
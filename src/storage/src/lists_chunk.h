@@ -0,0 +1,140 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_LISTS_CHUNK_H_
+#define SRC_LISTS_CHUNK_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "rocksdb/db.h"
+#include "rocksdb/status.h"
+#include "rocksdb/write_batch.h"
+
+#include "src/lists_meta_value_format.h"
+#include "storage/storage.h"
+
+namespace storage {
+
+// new chunks take ids this far apart, so a chunk grown by LINSERT can be
+// split in place
+const uint64_t kListChunkIdGap = 1ULL << 16;
+// chunks given new ids to make room for a split are spread at least this far
+// apart, or kListChunkIdGap apart once they reach the right end
+const uint64_t kListChunkMinIdSpacing = kListChunkIdGap >> 6;
+// chunk size used when list-chunk-size is off but the list is chunked already
+const int32_t kListChunkDefaultSize = 128;
+// a chunk only takes more elements while it stays below this size, a larger
+// element gets a chunk of its own
+const size_t kListChunkMaxBytes = 8192;
+
+/*
+ * Elements of one chunk, the user value of a chunk data key:
+ * | count | len | element | len | element | ...
+ * |   4B  |  4B |         |  4B |         |
+ */
+class ListsChunk {
+ public:
+  ListsChunk() = default;
+
+  bool Decode(const Slice& payload);
+  std::string Encode() const;
+  // the count of an encoded chunk, without decoding its elements
+  static uint32_t DecodeCount(const Slice& payload);
+
+  size_t Count() const { return elements_.size(); }
+  bool Empty() const { return elements_.empty(); }
+  // whether one more element fits, an empty chunk takes any element
+  bool HasRoom(size_t element_size, int32_t chunk_size) const {
+    return elements_.empty() ||
+           (elements_.size() < static_cast<size_t>(chunk_size) && bytes_ + element_size <= kListChunkMaxBytes);
+  }
+  bool Oversized(int32_t chunk_size) const {
+    return elements_.size() > 1 && (elements_.size() > static_cast<size_t>(chunk_size) || bytes_ > kListChunkMaxBytes);
+  }
+
+  const std::string& At(size_t pos) const { return elements_[pos]; }
+  void Set(size_t pos, const Slice& element);
+  void Insert(size_t pos, const Slice& element);
+  void Erase(size_t pos);
+  void PushFront(const Slice& element) { Insert(0, element); }
+  void PushBack(const Slice& element) { Insert(elements_.size(), element); }
+  std::string PopFront();
+  std::string PopBack();
+  // keep [first, last] only
+  void Trim(size_t first, size_t last);
+  // move the elements from pos on into tail
+  void SplitAt(size_t pos, ListsChunk* tail);
+
+ private:
+  std::deque<std::string> elements_;
+  size_t bytes_ = 0;
+};
+
+/*
+ * A list packed into chunks of up to chunk_size elements, stored in the list
+ * data cf under | key | version | chunk id |. Chunk ids grow outwards from
+ * the middle like the element indexes of a plain list, LeftIndex and
+ * RightIndex of the meta value are the next free id at either end. Every
+ * operation updates the meta value it was given, the caller puts it into
+ * the same batch as the chunks.
+ *
+ * Push, pop and the end-relative reads touch the chunks they need only,
+ * reads by position sum the chunk counts from the nearer end, so they cost
+ * O(#chunks) keys instead of O(#elements). Insert, Rem and Set rewrite the
+ * chunks they change only.
+ */
+class ChunkedList {
+ public:
+  ChunkedList(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle, const Slice& key,
+              ParsedListsMetaValue* meta_value, int32_t chunk_size);
+
+  // Writers, called under the record lock of the key
+  Status Push(const std::vector<std::string>& values, bool left, rocksdb::WriteBatch* batch);
+  Status Pop(uint64_t count, bool left, std::vector<std::string>* elements, rocksdb::WriteBatch* batch);
+  Status Set(uint64_t pos, const Slice& value, rocksdb::WriteBatch* batch);
+  // keep the elements at [first, last], both within the list
+  Status Trim(uint64_t first, uint64_t last, rocksdb::WriteBatch* batch);
+  Status Insert(const BeforeOrAfter& before_or_after, const Slice& pivot, const Slice& value,
+                rocksdb::WriteBatch* batch);
+  Status Rem(int64_t count, const Slice& value, uint64_t* removed, rocksdb::WriteBatch* batch);
+  // move the last element to the head, for RPOPLPUSH on one key
+  Status Rotate(std::string* element, rocksdb::WriteBatch* batch);
+
+  // Readers, positions count from the left end starting at 0
+  Status Index(const rocksdb::ReadOptions& read_options, uint64_t pos, std::string* element);
+  Status Range(const rocksdb::ReadOptions& read_options, uint64_t first, uint64_t last,
+               std::vector<std::string>* elements);
+
+ private:
+  rocksdb::Iterator* NewChunkIterator(const rocksdb::ReadOptions& read_options);
+  std::string ChunkKey(uint64_t chunk_id);
+  // whether iter is at a chunk of this list, and its id
+  bool ChunkOf(rocksdb::Iterator* iter, uint64_t* chunk_id);
+  void SeekToEnd(rocksdb::Iterator* iter, bool left);
+  // position iter at the chunk holding pos, walking from the nearer end
+  Status Locate(rocksdb::Iterator* iter, uint64_t pos, uint64_t* chunk_id, uint64_t* first_pos);
+  Status DecodeChunk(rocksdb::Iterator* iter, ListsChunk* chunk);
+  void PutChunk(uint64_t chunk_id, const ListsChunk& chunk, rocksdb::WriteBatch* batch);
+  // take the next free chunk id at either end
+  uint64_t NewChunkId(bool left);
+  // an id for a chunk split off chunk_id, iter at the chunk after it. Once
+  // the ids in between are used up, the chunks from iter on move to new ids
+  // up to the first gap wide enough for them, or past the right end
+  Status SplitChunkId(rocksdb::Iterator* iter, uint64_t chunk_id, uint64_t* split_id, rocksdb::WriteBatch* batch);
+
+  rocksdb::DB* db_ = nullptr;
+  rocksdb::ColumnFamilyHandle* handle_ = nullptr;
+  std::string key_;
+  ParsedListsMetaValue* meta_value_ = nullptr;
+  uint64_t version_ = 0;
+  int32_t chunk_size_ = kListChunkDefaultSize;
+  // | reserve1 | key | version |, shared by every chunk key of the list
+  std::string prefix_;
+};
+
+}  //  namespace storage
+#endif  //  SRC_LISTS_CHUNK_H_
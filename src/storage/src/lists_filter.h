@@ -15,6 +15,7 @@
 #include "src/debug.h"
 #include "src/lists_data_key_format.h"
 #include "src/lists_meta_value_format.h"
+#include "src/meta_version_cache.h"
 #include "src/base_value_format.h"
 
 namespace storage {
@@ -26,10 +27,12 @@ namespace storage {
 
 class ListsDataFilter : public rocksdb::CompactionFilter {
  public:
-  ListsDataFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr, enum DataType type)
+  ListsDataFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr, enum DataType type,
+                  MetaVersionCache* meta_version_cache = nullptr)
       : db_(db),
         cf_handles_ptr_(cf_handles_ptr),
-        type_(type)
+        type_(type),
+        meta_version_cache_(meta_version_cache)
         {}
 
   bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value,
@@ -51,6 +54,25 @@ class ListsDataFilter : public rocksdb::CompactionFilter {
 
     if (meta_key_enc != cur_key_) {
       cur_key_ = meta_key_enc;
+      cur_meta_loaded_ = false;
+      cur_cache_found_ = meta_version_cache_ != nullptr &&
+                         meta_version_cache_->Lookup(parsed_lists_data_key.key(), &cur_cache_entry_);
+    }
+
+    if (cur_cache_found_) {
+      auto decision = MetaVersionCache::Decide(cur_cache_entry_, parsed_lists_data_key.Version(), pstd::NowMillis());
+      if (decision != MetaVersionCache::kMiss) {
+        meta_version_cache_->RecordHit();
+        if (decision == MetaVersionCache::kDrop) {
+          TRACE("Drop[cached dropped version]");
+          return true;
+        }
+        TRACE("Reserve[cached meta version]");
+        return false;
+      }
+    }
+
+    if (!cur_meta_loaded_) {
       cur_meta_etime_ = 0;
       cur_meta_version_ = 0;
       meta_not_found_ = true;
@@ -59,6 +81,10 @@ class ListsDataFilter : public rocksdb::CompactionFilter {
       if (cf_handles_ptr_->empty()) {
         return false;
       }
+      cur_meta_loaded_ = true;
+      if (meta_version_cache_ != nullptr) {
+        meta_version_cache_->RecordMiss();
+      }
       rocksdb::Status s = db_->Get(default_read_options_, (*cf_handles_ptr_)[0], cur_key_, &meta_value);
       if (s.ok()) {
         /*
@@ -74,6 +100,9 @@ class ListsDataFilter : public rocksdb::CompactionFilter {
         meta_not_found_ = false;
         cur_meta_version_ = parsed_lists_meta_value.Version();
         cur_meta_etime_ = parsed_lists_meta_value.Etime();
+        if (meta_version_cache_ != nullptr) {
+          meta_version_cache_->UpdateMeta(parsed_lists_data_key.key(), cur_meta_version_, cur_meta_etime_);
+        }
       } else if (s.IsNotFound()) {
         meta_not_found_ = true;
       } else {
@@ -129,17 +158,22 @@ class ListsDataFilter : public rocksdb::CompactionFilter {
   mutable bool meta_not_found_ = false;
   mutable uint64_t cur_meta_version_ = 0;
   mutable uint64_t cur_meta_etime_ = 0;
+  mutable bool cur_meta_loaded_ = false;
+  mutable bool cur_cache_found_ = false;
+  mutable MetaVersionEntry cur_cache_entry_;
   enum DataType type_ = DataType::kNones;
+  MetaVersionCache* meta_version_cache_ = nullptr;
 };
 
 class ListsDataFilterFactory : public rocksdb::CompactionFilterFactory {
  public:
-  ListsDataFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr, enum DataType type)
-      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr), type_(type) {}
+  ListsDataFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr, enum DataType type,
+                         MetaVersionCache* meta_version_cache = nullptr)
+      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr), type_(type), meta_version_cache_(meta_version_cache) {}
 
   std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
       const rocksdb::CompactionFilter::Context& context) override {
-    return std::unique_ptr<rocksdb::CompactionFilter>(new ListsDataFilter(*db_ptr_, cf_handles_ptr_, type_));
+    return std::unique_ptr<rocksdb::CompactionFilter>(new ListsDataFilter(*db_ptr_, cf_handles_ptr_, type_, meta_version_cache_));
   }
   const char* Name() const override { return "ListsDataFilterFactory"; }
 
@@ -147,6 +181,7 @@ class ListsDataFilterFactory : public rocksdb::CompactionFilterFactory {
   rocksdb::DB** db_ptr_ = nullptr;
   std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
   enum DataType type_ = DataType::kNones;
+  MetaVersionCache* meta_version_cache_ = nullptr;
 };
 
 }  //  namespace storage
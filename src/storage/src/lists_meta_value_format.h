@@ -19,7 +19,12 @@ const uint64_t InitalRightIndex = 9223372036854775808U;
 /*
 *| type | list_size | version | left index | right index | reserve |  cdate | timestamp |
 *|  1B  |     8B    |    8B   |     8B     |      8B     |   16B   |    8B  |     8B    |
+*  The first bit in reserve field marks a list whose current version packs its
+*  elements into chunks, left index and right index then bound the chunk ids
+*  instead of the element indexes, see lists_chunk.h
 */
+constexpr uint8_t lists_chunked_reserve_flag = 0x80;
+
 class ListsMetaValue : public InternalValue {
  public:
   explicit ListsMetaValue(const rocksdb::Slice& user_value)
@@ -72,6 +77,14 @@ class ListsMetaValue : public InternalValue {
 
   void ModifyRightIndex(uint64_t index) { right_index_ += index; }
 
+  void SetChunked(bool chunked) {
+    if (chunked) {
+      reserve_[0] |= lists_chunked_reserve_flag;
+    } else {
+      reserve_[0] &= ~lists_chunked_reserve_flag;
+    }
+  }
+
  private:
   uint64_t left_index_ = 0;
   uint64_t right_index_ = 0;
@@ -199,9 +212,25 @@ class ParsedListsMetaValue : public ParsedInternalValue {
     this->set_right_index(InitalRightIndex);
     this->SetEtime(0);
     this->SetCtime(0);
+    this->SetChunked(false);
     return this->UpdateVersion();
   }
 
+  bool IsChunked() { return (reserve_[0] & lists_chunked_reserve_flag) != 0; }
+
+  void SetChunked(bool chunked) {
+    if (chunked) {
+      reserve_[0] |= lists_chunked_reserve_flag;
+    } else {
+      reserve_[0] &= ~lists_chunked_reserve_flag;
+    }
+    if (value_) {
+      char* dst = const_cast<char*>(value_->data()) + value_->size() - kListsMetaValueSuffixLength + kVersionLength +
+                  2 * kListValueIndexLength;
+      dst[0] = reserve_[0];
+    }
+  }
+
   bool IsValid() override {
     return !IsStale() && Count() != 0;
   }
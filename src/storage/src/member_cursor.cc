@@ -0,0 +1,314 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/member_cursor.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "src/base_data_key_format.h"
+#include "src/coding.h"
+
+namespace storage {
+
+// Members a cursor steps over with Next before a seek pays off, the sets of
+// an intersection often share runs of members
+static const int kSeekForwardSteps = 8;
+
+MemberCursor::MemberCursor(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle,
+                           const rocksdb::ReadOptions& read_options, const Slice& key, uint64_t version, int32_t count,
+                           DataFormat format)
+    : key_(key.ToString()), version_(version), count_(count), format_(format) {
+  BaseDataKey member_key(key_, version_, Slice(), format_);
+  prefix_ = member_key.EncodeSeekKey().ToString();
+  suffix_length_ = format_ == kDataFormatV2 ? 0 : kSuffixReserveLength;
+  rocksdb::ReadOptions options = read_options;
+  options.prefix_same_as_start = true;
+  iter_.reset(db->NewIterator(options, handle));
+  iter_->Seek(prefix_);
+  Settle();
+}
+
+MemberCursor::MemberCursor(std::vector<std::string> members)
+    : count_(static_cast<int32_t>(members.size())), members_(std::move(members)) {
+  Settle();
+}
+
+void MemberCursor::Next() {
+  if (iter_ == nullptr) {
+    pos_++;
+  } else {
+    iter_->Next();
+  }
+  Settle();
+}
+
+void MemberCursor::SeekForward(const Slice& target) {
+  if (iter_ == nullptr) {
+    if (valid_ && member_.compare(target) < 0) {
+      pos_ = std::lower_bound(members_.begin() + static_cast<ptrdiff_t>(pos_), members_.end(), target,
+                              [](const std::string& member, const Slice& seek) {
+                                return Slice(member).compare(seek) < 0;
+                              }) -
+             members_.begin();
+      Settle();
+    }
+    return;
+  }
+  for (int step = 0; valid_ && member_.compare(target) < 0; ++step) {
+    if (step == kSeekForwardSteps) {
+      BaseDataKey member_key(key_, version_, target, format_);
+      iter_->Seek(member_key.EncodeSeekKey());
+      Settle();
+      // the zero v1 reserve2 of a member prefixing target followed by zeros
+      // sorts after the seek key
+      while (valid_ && member_.compare(target) < 0) {
+        Next();
+      }
+      return;
+    }
+    Next();
+  }
+}
+
+void MemberCursor::Settle() {
+  if (iter_ == nullptr) {
+    valid_ = pos_ < members_.size();
+    if (valid_) {
+      member_ = members_[pos_];
+    }
+    return;
+  }
+  valid_ = iter_->Valid() && iter_->key().starts_with(prefix_) &&
+           iter_->key().size() >= prefix_.size() + suffix_length_;
+  if (valid_) {
+    Slice key = iter_->key();
+    member_ = Slice(key.data() + prefix_.size(), key.size() - prefix_.size() - suffix_length_);
+  }
+}
+
+rocksdb::Status SetsInter(MemberCursors* cursors, const SetsMemberSink& sink) {
+  if (cursors->empty()) {
+    return rocksdb::Status::OK();
+  }
+  std::stable_sort(cursors->begin(), cursors->end(),
+                   [](const auto& lhs, const auto& rhs) { return lhs->Count() < rhs->Count(); });
+  auto& lead = cursors->front();
+  while (lead->Valid()) {
+    Slice candidate = lead->member();
+    bool matched = true;
+    for (size_t idx = 1; idx < cursors->size(); ++idx) {
+      auto& cursor = (*cursors)[idx];
+      cursor->SeekForward(candidate);
+      if (!cursor->Valid()) {
+        // no member past this one is in every set
+        return cursor->status();
+      }
+      if (cursor->member() != candidate) {
+        lead->SeekForward(cursor->member());
+        matched = false;
+        break;
+      }
+    }
+    if (matched) {
+      rocksdb::Status s = sink(candidate);
+      if (!s.ok()) {
+        return s;
+      }
+      lead->Next();
+    }
+  }
+  return lead->status();
+}
+
+rocksdb::Status SetsUnion(MemberCursors* cursors, const SetsMemberSink& sink) {
+  // a min heap of the cursors by their current member
+  auto greater = [cursors](size_t lhs, size_t rhs) {
+    return (*cursors)[lhs]->member().compare((*cursors)[rhs]->member()) > 0;
+  };
+  std::vector<size_t> heap;
+  for (size_t idx = 0; idx < cursors->size(); ++idx) {
+    if ((*cursors)[idx]->Valid()) {
+      heap.push_back(idx);
+    } else if (!(*cursors)[idx]->status().ok()) {
+      return (*cursors)[idx]->status();
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), greater);
+
+  std::string last_member;
+  bool emitted = false;
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), greater);
+    auto& cursor = (*cursors)[heap.back()];
+    if (!emitted || cursor->member() != last_member) {
+      rocksdb::Status s = sink(cursor->member());
+      if (!s.ok()) {
+        return s;
+      }
+      last_member.assign(cursor->member().data(), cursor->member().size());
+      emitted = true;
+    }
+    cursor->Next();
+    if (cursor->Valid()) {
+      std::push_heap(heap.begin(), heap.end(), greater);
+    } else if (cursor->status().ok()) {
+      heap.pop_back();
+    } else {
+      return cursor->status();
+    }
+  }
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status SetsDiff(MemberCursors* cursors, const SetsMemberSink& sink) {
+  if (cursors->empty()) {
+    return rocksdb::Status::OK();
+  }
+  auto& first = cursors->front();
+  for (; first->Valid(); first->Next()) {
+    Slice member = first->member();
+    bool found = false;
+    for (size_t idx = 1; idx < cursors->size() && !found; ++idx) {
+      auto& cursor = (*cursors)[idx];
+      cursor->SeekForward(member);
+      if (cursor->Valid()) {
+        found = cursor->member() == member;
+      } else if (!cursor->status().ok()) {
+        return cursor->status();
+      }
+    }
+    if (!found) {
+      rocksdb::Status s = sink(member);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+  return first->status();
+}
+
+double ZSetsMergeInput::Score() const {
+  if (is_set) {
+    return weight;
+  }
+  uint64_t bits = DecodeFixed64(cursor->value().data());
+  const void* ptr_score = reinterpret_cast<const void*>(&bits);
+  return weight * *reinterpret_cast<const double*>(ptr_score);
+}
+
+static double Aggregate(AGGREGATE agg, double score, double other) {
+  switch (agg) {
+    case SUM:
+      return score + other;
+    case MIN:
+      return std::min(score, other);
+    case MAX:
+      return std::max(score, other);
+  }
+  return score;
+}
+
+rocksdb::Status ZSetsUnion(ZSetsMergeInputs* inputs, AGGREGATE agg, const ZSetsMemberSink& sink) {
+  // a min heap of the inputs by their current member
+  auto greater = [inputs](size_t lhs, size_t rhs) {
+    return (*inputs)[lhs].cursor->member().compare((*inputs)[rhs].cursor->member()) > 0;
+  };
+  std::vector<size_t> heap;
+  for (size_t idx = 0; idx < inputs->size(); ++idx) {
+    const auto& cursor = (*inputs)[idx].cursor;
+    if (cursor == nullptr) {
+      continue;
+    }
+    if (cursor->Valid()) {
+      heap.push_back(idx);
+    } else if (!cursor->status().ok()) {
+      return cursor->status();
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), greater);
+
+  std::vector<size_t> holders;
+  while (!heap.empty()) {
+    // every input holding the least member, none of them moves before the
+    // member is taken
+    do {
+      std::pop_heap(heap.begin(), heap.end(), greater);
+      holders.push_back(heap.back());
+      heap.pop_back();
+    } while (!heap.empty() &&
+             (*inputs)[heap.front()].cursor->member() == (*inputs)[holders.front()].cursor->member());
+    std::sort(holders.begin(), holders.end());
+    double score = (*inputs)[holders.front()].Score();
+    for (size_t idx = 1; idx < holders.size(); ++idx) {
+      score = Aggregate(agg, score, (*inputs)[holders[idx]].Score());
+    }
+    rocksdb::Status s = sink((*inputs)[holders.front()].cursor->member(), (score == -0.0) ? 0 : score);
+    if (!s.ok()) {
+      return s;
+    }
+    for (const auto idx : holders) {
+      auto& cursor = (*inputs)[idx].cursor;
+      cursor->Next();
+      if (cursor->Valid()) {
+        heap.push_back(idx);
+        std::push_heap(heap.begin(), heap.end(), greater);
+      } else if (!cursor->status().ok()) {
+        return cursor->status();
+      }
+    }
+    holders.clear();
+  }
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status ZSetsInter(ZSetsMergeInputs* inputs, AGGREGATE agg, const ZSetsMemberSink& sink) {
+  if (inputs->empty()) {
+    return rocksdb::Status::OK();
+  }
+  // the inputs keep their order for the aggregation, the leapfrog goes over
+  // them from the smallest on
+  std::vector<size_t> order;
+  for (size_t idx = 0; idx < inputs->size(); ++idx) {
+    if ((*inputs)[idx].cursor == nullptr) {
+      return rocksdb::Status::OK();
+    }
+    order.push_back(idx);
+  }
+  std::stable_sort(order.begin(), order.end(), [inputs](size_t lhs, size_t rhs) {
+    return (*inputs)[lhs].cursor->Count() < (*inputs)[rhs].cursor->Count();
+  });
+  auto& lead = (*inputs)[order.front()].cursor;
+  while (lead->Valid()) {
+    Slice candidate = lead->member();
+    bool matched = true;
+    for (size_t pos = 1; pos < order.size(); ++pos) {
+      auto& cursor = (*inputs)[order[pos]].cursor;
+      cursor->SeekForward(candidate);
+      if (!cursor->Valid()) {
+        return cursor->status();
+      }
+      if (cursor->member() != candidate) {
+        lead->SeekForward(cursor->member());
+        matched = false;
+        break;
+      }
+    }
+    if (matched) {
+      double score = inputs->front().Score();
+      for (size_t idx = 1; idx < inputs->size(); ++idx) {
+        score = Aggregate(agg, score, (*inputs)[idx].Score());
+      }
+      rocksdb::Status s = sink(candidate, score);
+      if (!s.ok()) {
+        return s;
+      }
+      lead->Next();
+    }
+  }
+  return lead->status();
+}
+
+}  //  namespace storage
@@ -0,0 +1,100 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_MEMBER_CURSOR_H_
+#define SRC_MEMBER_CURSOR_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rocksdb/db.h"
+
+#include "storage/storage.h"
+#include "storage/storage_define.h"
+
+namespace storage {
+
+/*
+ * Walks the members of one version of a set, or of a zset in its member
+ * cf, in order. The member keys of a version share everything before the
+ * member and the v1 reserve2 after it is all zeros, so they sort as their
+ * members do, and the cursors of several keys merge by comparing members
+ * instead of looking every member of one key up in the others. The members
+ * of an inline set are walked in memory the same way.
+ */
+class MemberCursor {
+ public:
+  MemberCursor(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle, const rocksdb::ReadOptions& read_options,
+               const Slice& key, uint64_t version, int32_t count, DataFormat format);
+  // the sorted members of an inline set
+  explicit MemberCursor(std::vector<std::string> members);
+
+  bool Valid() const { return valid_; }
+  // member and value point into the current entry, valid until the cursor
+  // moves
+  Slice member() const { return member_; }
+  Slice value() const { return iter_ != nullptr ? iter_->value() : Slice(); }
+  // the member count of the meta value
+  int32_t Count() const { return count_; }
+  void Next();
+  // Moves to the first member not less than target, never backwards
+  void SeekForward(const Slice& target);
+  rocksdb::Status status() const { return iter_ != nullptr ? iter_->status() : rocksdb::Status::OK(); }
+
+ private:
+  void Settle();
+
+  std::string key_;
+  uint64_t version_ = 0;
+  int32_t count_ = 0;
+  DataFormat format_ = kDataFormatV1;
+  std::string prefix_;
+  size_t suffix_length_ = 0;
+  std::unique_ptr<rocksdb::Iterator> iter_;
+  // the members walked instead of iter_ for an inline set
+  std::vector<std::string> members_;
+  size_t pos_ = 0;
+  bool valid_ = false;
+  Slice member_;
+};
+
+using MemberCursors = std::vector<std::unique_ptr<MemberCursor>>;
+// Takes the members of a result one by one in order, an error stops the walk
+using SetsMemberSink = std::function<rocksdb::Status(const Slice& member)>;
+
+// The members in every set, the cursors leapfrog from the smallest set on
+// and stop as soon as one set runs out
+rocksdb::Status SetsInter(MemberCursors* cursors, const SetsMemberSink& sink);
+// The members in any set once, a k-way merge of the cursors
+rocksdb::Status SetsUnion(MemberCursors* cursors, const SetsMemberSink& sink);
+// The members of the first set in none of the others
+rocksdb::Status SetsDiff(MemberCursors* cursors, const SetsMemberSink& sink);
+
+// An input of a zset union or intersection, the members of a set score 1
+struct ZSetsMergeInput {
+  std::unique_ptr<MemberCursor> cursor;
+  double weight = 1;
+  bool is_set = false;
+
+  // the weighted score of the current member
+  double Score() const;
+};
+
+using ZSetsMergeInputs = std::vector<ZSetsMergeInput>;
+// Takes the members of a result one by one in member order with their
+// aggregated scores, an error stops the walk
+using ZSetsMemberSink = std::function<rocksdb::Status(const Slice& member, double score)>;
+
+// The members in any input, their scores aggregated in input order. Inputs
+// without a cursor are skipped
+rocksdb::Status ZSetsUnion(ZSetsMergeInputs* inputs, AGGREGATE agg, const ZSetsMemberSink& sink);
+// The members in every input, the cursors leapfrog as in SetsInter. An
+// input without a cursor makes the result empty
+rocksdb::Status ZSetsInter(ZSetsMergeInputs* inputs, AGGREGATE agg, const ZSetsMemberSink& sink);
+
+}  //  namespace storage
+#endif  //  SRC_MEMBER_CURSOR_H_
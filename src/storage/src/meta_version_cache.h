@@ -0,0 +1,161 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_META_VERSION_CACHE_H_
+#define SRC_META_VERSION_CACHE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "rocksdb/slice.h"
+
+#include "pstd/include/env.h"
+#include "pstd/include/pstd_mutex.h"
+
+namespace storage {
+
+/*
+ * What the data cf compaction filters learned about one user key from the
+ * meta cf. Only facts that no later write can turn into a wrong drop:
+ * dropped_version: every data key with version <= dropped_version is stale.
+ *   A collection that is deleted or expired only comes back with a bigger
+ *   version, so a stale version never becomes live again.
+ * version/etime: the meta seen at update_time. It is only used to keep data,
+ *   and only for a short while, so a later EXPIRE or PERSIST is at worst
+ *   picked up by the next compaction. version == 0 means nothing to keep on.
+ */
+struct MetaVersionEntry {
+  uint64_t dropped_version = 0;
+  uint64_t version = 0;
+  uint64_t etime = 0;
+  uint64_t update_time = 0;
+};
+
+class MetaVersionCache {
+ public:
+  enum Decision { kMiss, kKeep, kDrop };
+
+  // keep decisions made from an entry older than this go back to the meta cf
+  static const uint64_t kKeepValidMillis = 60 * 1000;
+
+  explicit MetaVersionCache(size_t capacity) : shard_capacity_(std::max<size_t>(capacity / kShardNum, 1)) {}
+
+  static Decision Decide(const MetaVersionEntry& entry, uint64_t data_version, uint64_t now) {
+    if (data_version <= entry.dropped_version) {
+      return kDrop;
+    }
+    if (entry.version != 0 && entry.update_time + kKeepValidMillis > now && (entry.etime == 0 || entry.etime > now)) {
+      return kKeep;
+    }
+    return kMiss;
+  }
+
+  bool Lookup(const rocksdb::Slice& key, MetaVersionEntry* entry) {
+    Shard& shard = GetShard(key);
+    std::lock_guard l(shard.mutex);
+    auto iter = shard.table.find(key.ToString());
+    if (iter == shard.table.end()) {
+      return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+    *entry = iter->second->second;
+    return true;
+  }
+
+  // Called by the data filters with the meta they just read
+  void UpdateMeta(const rocksdb::Slice& key, uint64_t version, uint64_t etime) {
+    uint64_t now = pstd::NowMillis();
+    bool expired = etime != 0 && etime < now;
+    uint64_t dropped_version = expired ? version : (version > 0 ? version - 1 : 0);
+    Update(key, dropped_version, [&](MetaVersionEntry* entry) {
+      if (version > entry->dropped_version) {
+        entry->version = version;
+        entry->etime = etime;
+        entry->update_time = now;
+      }
+    });
+  }
+
+  // Called by the meta filter when it drops a meta, and by DEL once the
+  // new meta version is written
+  void AddDroppedVersion(const rocksdb::Slice& key, uint64_t version) {
+    Update(key, version, [](MetaVersionEntry* entry) {});
+  }
+
+  void Clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard l(shard.mutex);
+      shard.lru.clear();
+      shard.table.clear();
+    }
+  }
+
+  void RecordHit() { hits_.fetch_add(1, std::memory_order_relaxed); }
+  void RecordMiss() { misses_.fetch_add(1, std::memory_order_relaxed); }
+  uint64_t Hits() const { return hits_.load(std::memory_order_relaxed); }
+  uint64_t Misses() const { return misses_.load(std::memory_order_relaxed); }
+
+  size_t Size() {
+    size_t size = 0;
+    for (auto& shard : shards_) {
+      std::lock_guard l(shard.mutex);
+      size += shard.table.size();
+    }
+    return size;
+  }
+
+ private:
+  static const size_t kShardNum = 16;
+  using LRUList = std::list<std::pair<std::string, MetaVersionEntry>>;
+  struct Shard {
+    pstd::Mutex mutex;
+    LRUList lru;
+    std::unordered_map<std::string, LRUList::iterator> table;
+  };
+
+  Shard& GetShard(const rocksdb::Slice& key) {
+    return shards_[std::hash<std::string_view>()(std::string_view(key.data(), key.size())) % kShardNum];
+  }
+
+  // raise dropped_version, drop the keep info it covers, then apply update_fn
+  template <typename UpdateFn>
+  void Update(const rocksdb::Slice& key, uint64_t dropped_version, UpdateFn&& update_fn) {
+    Shard& shard = GetShard(key);
+    std::lock_guard l(shard.mutex);
+    std::string key_str = key.ToString();
+    auto iter = shard.table.find(key_str);
+    if (iter == shard.table.end()) {
+      shard.lru.emplace_front(key_str, MetaVersionEntry());
+      shard.table[key_str] = shard.lru.begin();
+      if (shard.table.size() > shard_capacity_) {
+        shard.table.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+      }
+    } else {
+      shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+    }
+    MetaVersionEntry* entry = &shard.lru.front().second;
+    entry->dropped_version = std::max(entry->dropped_version, dropped_version);
+    if (entry->version <= entry->dropped_version) {
+      entry->version = 0;
+    }
+    update_fn(entry);
+  }
+
+  const size_t shard_capacity_;
+  Shard shards_[kShardNum];
+  std::atomic<uint64_t> hits_ = 0;
+  std::atomic<uint64_t> misses_ = 0;
+};
+
+}  //  namespace storage
+#endif  //  SRC_META_VERSION_CACHE_H_
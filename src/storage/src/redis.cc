@@ -3,19 +3,33 @@
 //  LICENSE file in the root directory of this source tree. An additional grant
 //  of patent rights can be found in the PATENTS file in the same directory.
 
+#include <algorithm>
+#include <limits>
 #include <sstream>
 
 #include "rocksdb/env.h"
 
 #include "src/redis.h"
+#include "src/base_data_key_format.h"
+#include "src/base_data_value_format.h"
+#include "src/base_key_format.h"
+#include "src/custom_slice_transform.h"
+#include "src/lists_data_key_format.h"
 #include "src/lists_filter.h"
+#include "src/strings_filter.h"
 #include "src/base_filter.h"
+#include "src/zsets_data_key_format.h"
 #include "src/zsets_filter.h"
+#include "src/type_index.h"
+#include "src/ttl_properties.h"
+#include "src/scope_record_lock.h"
+#include "src/scope_snapshot.h"
 #include "pstd/include/pstd_defer.h"
 
 namespace storage {
 
 constexpr const char* ErrTypeMessage = "WRONGTYPE";
+constexpr double kMemtablePrefixBloomSizeRatio = 0.1;
 
 const rocksdb::Comparator* ListsDataKeyComparator() {
   static ListsDataKeyComparatorImpl ldkc;
@@ -27,6 +41,12 @@ rocksdb::Comparator* ZSetsScoreKeyComparator() {
   return &zsets_score_key_compare;
 }
 
+std::shared_ptr<const rocksdb::SliceTransform> DataKeyPrefixTransform() {
+  static std::shared_ptr<const rocksdb::SliceTransform> data_key_prefix_transform =
+      std::make_shared<DataKeyPrefixTransformImpl>();
+  return data_key_prefix_transform;
+}
+
 Redis::Redis(Storage* const s, int32_t index)
     : storage_(s), index_(index),
       lock_mgr_(std::make_shared<LockMgr>(1000, 0, std::make_shared<MutexFactoryImpl>())),
@@ -59,11 +79,30 @@ Redis::~Redis() {
 }
 
 Status Redis::Open(const StorageOptions& storage_options, const std::string& db_path) {
+  uint64_t open_start_us = pstd::NowMicros();
   statistics_store_->SetCapacity(storage_options.statistics_max_size);
   small_compaction_threshold_ = storage_options.small_compaction_threshold;
+  zset_rank_index_threshold_ = storage_options.zset_rank_index_threshold;
+  list_chunk_size_ = storage_options.list_chunk_size;
+  hash_max_inline_entries_ = storage_options.hash_max_inline_entries;
+  hash_max_inline_value_ = storage_options.hash_max_inline_value;
+  set_max_inline_entries_ = storage_options.set_max_inline_entries;
+  set_max_inline_value_ = storage_options.set_max_inline_value;
+  key_counters_ = storage_options.key_counters;
+  expiry_index_ = storage_options.expiry_reap_rate > 0;
+  lazyfree_range_threshold_ = storage_options.lazyfree_range_threshold;
+  strings_merge_ = storage_options.strings_merge;
+  bitmap_chunk_size_ = storage_options.bitmap_chunk_size;
+  if (storage_options.meta_version_cache_capacity > 0) {
+    meta_version_cache_ = std::make_unique<MetaVersionCache>(storage_options.meta_version_cache_capacity);
+  }
 
   rocksdb::BlockBasedTableOptions table_ops(storage_options.table_options);
   table_ops.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10, true));
+  // hash, set and zset data cf also build prefix blooms on
+  // | reserve1 | key | version |, so seeking a missing or small
+  // collection can skip the sst files that don't hold its prefix
+  table_ops.whole_key_filtering = true;
 
   rocksdb::Options ops(storage_options.options);
   ops.create_missing_column_families = true;
@@ -80,7 +119,9 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
    */
   // meta & string column-family options
   rocksdb::ColumnFamilyOptions meta_cf_ops(storage_options.options);
-  meta_cf_ops.compaction_filter_factory = std::make_shared<MetaFilterFactory>();
+  meta_cf_ops.compaction_filter_factory = std::make_shared<MetaFilterFactory>(meta_version_cache_.get());
+  // set even with strings_merge off, operands written before must still fold
+  meta_cf_ops.merge_operator = std::make_shared<StringsMergeOperator>();
   rocksdb::BlockBasedTableOptions meta_table_ops(table_ops);
 
   rocksdb::BlockBasedTableOptions string_table_ops(table_ops);
@@ -88,10 +129,16 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
     meta_table_ops.block_cache = rocksdb::NewLRUCache(storage_options.block_cache_size);
   }
   meta_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(meta_table_ops));
+  const int ttl_horizon = storage_options.compact_param_.ttl_compact_horizon_seconds_;
+  meta_cf_ops.table_properties_collector_factories.push_back(
+      std::make_shared<TTLPropertiesCollectorFactory>(TTLKeyLayout::kMeta, nullptr, ttl_horizon));
 
   // hash column-family options
   rocksdb::ColumnFamilyOptions hash_data_cf_ops(storage_options.options);
-  hash_data_cf_ops.compaction_filter_factory = std::make_shared<HashesDataFilterFactory>(&db_, &handles_, DataType::kHashes);
+  hash_data_cf_ops.compaction_filter_factory = std::make_shared<HashesDataFilterFactory>(&db_, &handles_, DataType::kHashes,
+                                                                                meta_version_cache_.get());
+  hash_data_cf_ops.prefix_extractor = DataKeyPrefixTransform();
+  hash_data_cf_ops.memtable_prefix_bloom_size_ratio = kMemtablePrefixBloomSizeRatio;
   rocksdb::BlockBasedTableOptions hash_data_cf_table_ops(table_ops);
   if (!storage_options.share_block_cache && storage_options.block_cache_size > 0) {
     hash_data_cf_table_ops.block_cache = rocksdb::NewLRUCache(storage_options.block_cache_size);
@@ -100,7 +147,8 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
 
   // list column-family options
   rocksdb::ColumnFamilyOptions list_data_cf_ops(storage_options.options);
-  list_data_cf_ops.compaction_filter_factory = std::make_shared<ListsDataFilterFactory>(&db_, &handles_, DataType::kLists);
+  list_data_cf_ops.compaction_filter_factory = std::make_shared<ListsDataFilterFactory>(&db_, &handles_, DataType::kLists,
+                                                                               meta_version_cache_.get());
   list_data_cf_ops.comparator = ListsDataKeyComparator();
 
   rocksdb::BlockBasedTableOptions list_data_cf_table_ops(table_ops);
@@ -111,7 +159,10 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
 
   // set column-family options
   rocksdb::ColumnFamilyOptions set_data_cf_ops(storage_options.options);
-  set_data_cf_ops.compaction_filter_factory = std::make_shared<SetsMemberFilterFactory>(&db_, &handles_, DataType::kSets);
+  set_data_cf_ops.compaction_filter_factory = std::make_shared<SetsMemberFilterFactory>(&db_, &handles_, DataType::kSets,
+                                                                               meta_version_cache_.get());
+  set_data_cf_ops.prefix_extractor = DataKeyPrefixTransform();
+  set_data_cf_ops.memtable_prefix_bloom_size_ratio = kMemtablePrefixBloomSizeRatio;
   rocksdb::BlockBasedTableOptions set_data_cf_table_ops(table_ops);
   if (!storage_options.share_block_cache && storage_options.block_cache_size > 0) {
     set_data_cf_table_ops.block_cache = rocksdb::NewLRUCache(storage_options.block_cache_size);
@@ -121,9 +172,15 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   // zset column-family options
   rocksdb::ColumnFamilyOptions zset_data_cf_ops(storage_options.options);
   rocksdb::ColumnFamilyOptions zset_score_cf_ops(storage_options.options);
-  zset_data_cf_ops.compaction_filter_factory = std::make_shared<ZSetsDataFilterFactory>(&db_, &handles_, DataType::kZSets);
-  zset_score_cf_ops.compaction_filter_factory = std::make_shared<ZSetsScoreFilterFactory>(&db_, &handles_, DataType::kZSets);
+  zset_data_cf_ops.compaction_filter_factory = std::make_shared<ZSetsDataFilterFactory>(&db_, &handles_, DataType::kZSets,
+                                                                               meta_version_cache_.get());
+  zset_score_cf_ops.compaction_filter_factory = std::make_shared<ZSetsScoreFilterFactory>(&db_, &handles_, DataType::kZSets,
+                                                                                 meta_version_cache_.get());
   zset_score_cf_ops.comparator = ZSetsScoreKeyComparator();
+  zset_data_cf_ops.prefix_extractor = DataKeyPrefixTransform();
+  zset_data_cf_ops.memtable_prefix_bloom_size_ratio = kMemtablePrefixBloomSizeRatio;
+  zset_score_cf_ops.prefix_extractor = DataKeyPrefixTransform();
+  zset_score_cf_ops.memtable_prefix_bloom_size_ratio = kMemtablePrefixBloomSizeRatio;
 
   rocksdb::BlockBasedTableOptions zset_meta_cf_table_ops(table_ops);
   rocksdb::BlockBasedTableOptions zset_data_cf_table_ops(table_ops);
@@ -134,6 +191,17 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   zset_data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(zset_data_cf_table_ops));
   zset_score_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(zset_score_cf_table_ops));
 
+  // zset rank index keys have the score key layout, so they share its
+  // comparator, prefix and compaction filter
+  rocksdb::ColumnFamilyOptions zset_rank_cf_ops(storage_options.options);
+  zset_rank_cf_ops.compaction_filter_factory = std::make_shared<ZSetsScoreFilterFactory>(&db_, &handles_, DataType::kZSets,
+                                                                                meta_version_cache_.get());
+  zset_rank_cf_ops.comparator = ZSetsScoreKeyComparator();
+  zset_rank_cf_ops.prefix_extractor = DataKeyPrefixTransform();
+  zset_rank_cf_ops.memtable_prefix_bloom_size_ratio = kMemtablePrefixBloomSizeRatio;
+  rocksdb::BlockBasedTableOptions zset_rank_cf_table_ops(table_ops);
+  zset_rank_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(zset_rank_cf_table_ops));
+
   // stream column-family options
   rocksdb::ColumnFamilyOptions stream_data_cf_ops(storage_options.options);
   stream_data_cf_ops.compaction_filter_factory = std::make_shared<BaseDataFilterFactory>(&db_, &handles_, DataType::kStreams);
@@ -143,6 +211,44 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   }
   stream_data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(stream_data_cf_table_ops));
 
+  // type index column-family options, its keys are short and only scanned
+  rocksdb::ColumnFamilyOptions type_index_cf_ops(storage_options.options);
+  type_index_cf_ops.compaction_filter_factory = std::make_shared<TypeIndexFilterFactory>(&db_, &handles_);
+  rocksdb::BlockBasedTableOptions type_index_cf_table_ops(table_ops);
+  type_index_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(type_index_cf_table_ops));
+
+  // key stats column-family options, a few counters summed by merge
+  rocksdb::ColumnFamilyOptions key_stats_cf_ops(storage_options.options);
+  key_stats_cf_ops.merge_operator = std::make_shared<KeyStatsMergeOperator>();
+
+  // bitmap column-family options
+  rocksdb::ColumnFamilyOptions bitmap_data_cf_ops(storage_options.options);
+  bitmap_data_cf_ops.compaction_filter_factory = std::make_shared<BitmapsDataFilterFactory>(&db_, &handles_);
+  rocksdb::BlockBasedTableOptions bitmap_data_cf_table_ops(table_ops);
+  if (!storage_options.share_block_cache && storage_options.block_cache_size > 0) {
+    bitmap_data_cf_table_ops.block_cache = rocksdb::NewLRUCache(storage_options.block_cache_size);
+  }
+  bitmap_data_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(bitmap_data_cf_table_ops));
+
+  // expiry index column-family options, its keys are short and only scanned
+  rocksdb::ColumnFamilyOptions expiry_index_cf_ops(storage_options.options);
+  expiry_index_cf_ops.compaction_filter_factory = std::make_shared<ExpiryIndexFilterFactory>(&db_, &handles_);
+  rocksdb::BlockBasedTableOptions expiry_index_cf_table_ops(table_ops);
+  expiry_index_cf_ops.table_factory.reset(rocksdb::NewBlockBasedTableFactory(expiry_index_cf_table_ops));
+
+  // member data cfs judge their entries by the meta version cache, without
+  // it only the meta cf records its dead entries
+  if (meta_version_cache_ != nullptr) {
+    for (auto [cf_ops, layout] : {std::make_pair(&hash_data_cf_ops, TTLKeyLayout::kBaseData),
+                                  std::make_pair(&set_data_cf_ops, TTLKeyLayout::kBaseData),
+                                  std::make_pair(&list_data_cf_ops, TTLKeyLayout::kListsData),
+                                  std::make_pair(&zset_data_cf_ops, TTLKeyLayout::kBaseData),
+                                  std::make_pair(&zset_score_cf_ops, TTLKeyLayout::kZSetsScore)}) {
+      cf_ops->table_properties_collector_factories.push_back(
+          std::make_shared<TTLPropertiesCollectorFactory>(layout, meta_version_cache_.get(), ttl_horizon));
+    }
+  }
+
   std::vector<rocksdb::ColumnFamilyDescriptor> column_families;
   // meta & string cf
   column_families.emplace_back(rocksdb::kDefaultColumnFamilyName, meta_cf_ops);
@@ -157,9 +263,168 @@ Status Redis::Open(const StorageOptions& storage_options, const std::string& db_
   column_families.emplace_back("zset_score_cf", zset_score_cf_ops);
   // stream CF
   column_families.emplace_back("stream_data_cf", stream_data_cf_ops);
+  // zset rank index CF
+  column_families.emplace_back("zset_rank_cf", zset_rank_cf_ops);
+  // type index CF
+  column_families.emplace_back("type_index_cf", type_index_cf_ops);
+  // key stats CF
+  column_families.emplace_back("key_stats_cf", key_stats_cf_ops);
+  // bitmap CF
+  column_families.emplace_back("bitmap_data_cf", bitmap_data_cf_ops);
+  // expiry index CF
+  column_families.emplace_back("expiry_index_cf", expiry_index_cf_ops);
   ops.listeners.emplace_back(std::make_shared<OBDSstListener>());
 
-  return rocksdb::DB::Open(ops, db_path, column_families, &handles_, &db_);
+  rocksdb::DB* db = nullptr;
+  uint64_t db_open_start_us = pstd::NowMicros();
+  Status s = rocksdb::DB::Open(ops, db_path, column_families, &handles_, &db);
+  wal_replay_micros_ = pstd::NowMicros() - db_open_start_us;
+  if (!s.ok()) {
+    return s;
+  }
+  // every write of a collection meta goes through TypeIndexedDB, which
+  // keeps the type index, and the key counters and expiry index if enabled,
+  // in the same batch
+  auto type_indexed_db = new TypeIndexedDB(db, handles_[kMetaCF], handles_[kTypeIndexCF],
+                                           key_counters_ ? handles_[kKeyStatsCF] : nullptr,
+                                           expiry_index_ ? handles_[kExpiryIndexCF] : nullptr);
+  db_ = type_indexed_db;
+  s = type_indexed_db->BuildTypeIndex();
+  if (!s.ok()) {
+    return s;
+  }
+  if (!key_counters_) {
+    // the counters go stale from here, they are reconciled again once enabled
+    s = db_->Delete(default_write_options_, handles_[kKeyStatsCF], kKeyCountersReconciledKey);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (expiry_index_) {
+    s = type_indexed_db->BuildExpiryIndex();
+  } else {
+    // keys get an etime without an entry from here, the index is built again
+    // once enabled
+    s = db_->Delete(default_write_options_, handles_[kExpiryIndexCF], kExpiryIndexBuiltKey);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  bool unfinished_conversion = false;
+  data_format_ = DetectDataFormat(storage_options.data_format, &unfinished_conversion);
+  if (unfinished_conversion) {
+    // the converted keys are only visible as v2, finish before serving
+    uint64_t converted = 0;
+    LOG(WARNING) << "instance " << index_ << " has an unfinished data format conversion, resuming it";
+    s = ConvertDataFormat(kDataFormatV2, &converted);
+    if (!s.ok()) {
+      return s;
+    }
+    LOG(INFO) << "instance " << index_ << " converted " << converted << " member keys to data format v2";
+  }
+  open_micros_ = pstd::NowMicros() - open_start_us;
+  return s;
+}
+
+// The data format is recorded by the member keys themselves, v2 keys start
+// with kDataFormatV2Tag and sort after every v1 key, so the first and last
+// keys of the member data cfs tell which format this instance was created
+// with. An instance without any member data yet takes the configured format.
+// v1 and v2 keys side by side are left by an interrupted conversion.
+DataFormat Redis::DetectDataFormat(DataFormat default_format, bool* unfinished) {
+  *unfinished = false;
+  rocksdb::ReadOptions read_options;
+  read_options.total_order_seek = true;
+  bool has_v1_data = false;
+  bool has_v2_data = false;
+  for (const auto cf : {kHashesDataCF, kSetsDataCF, kZsetsDataCF}) {
+    std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[cf]));
+    iter->SeekToFirst();
+    if (!iter->Valid()) {
+      continue;
+    }
+    if (IsDataFormatV2Key(iter->key())) {
+      has_v2_data = true;
+      continue;
+    }
+    has_v1_data = true;
+    iter->SeekToLast();
+    if (iter->Valid() && IsDataFormatV2Key(iter->key())) {
+      has_v2_data = true;
+    }
+  }
+  if (has_v1_data) {
+    *unfinished = has_v2_data;
+    return kDataFormatV1;
+  }
+  return has_v2_data ? kDataFormatV2 : default_format;
+}
+
+Status Redis::ConvertDataFormat(DataFormat target_format, uint64_t* converted) {
+  *converted = 0;
+  if (target_format != kDataFormatV2) {
+    return Status::NotSupported("only conversion to data format v2 is supported");
+  }
+
+  const int32_t kConvertBatchCount = 1000;
+  rocksdb::WriteBatch batch;
+  auto commit_batch = [&]() {
+    Status s = db_->Write(default_write_options_, &batch);
+    batch.Clear();
+    return s;
+  };
+
+  rocksdb::ReadOptions read_options;
+  read_options.total_order_seek = true;
+  for (const auto cf : {kHashesDataCF, kSetsDataCF, kZsetsDataCF}) {
+    std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[cf]));
+    // converted keys sort after all the v1 keys, a rerun resumes from the
+    // first v1 key left and stops at the first v2 key
+    for (iter->SeekToFirst(); iter->Valid() && !IsDataFormatV2Key(iter->key()); iter->Next()) {
+      ParsedBaseDataKey parsed_data_key(iter->key());
+      ParsedBaseDataValue parsed_value(iter->value());
+      BaseDataKey data_key(parsed_data_key.Key(), parsed_data_key.Version(), parsed_data_key.Data(), target_format);
+      BaseDataValue internal_value(parsed_value.UserValue(), target_format);
+      batch.Delete(handles_[cf], iter->key());
+      batch.Put(handles_[cf], data_key.Encode(), internal_value.Encode());
+      (*converted)++;
+      if (batch.Count() >= kConvertBatchCount) {
+        Status s = commit_batch();
+        if (!s.ok()) {
+          return s;
+        }
+      }
+    }
+    if (!iter->status().ok()) {
+      return iter->status();
+    }
+  }
+
+  // zset score keys keep the v1 layout, only their values are rewritten
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[kZsetsScoreCF]));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedBaseDataValue parsed_value(iter->value());
+    if (parsed_value.Format() == target_format) {
+      continue;
+    }
+    BaseDataValue internal_value(parsed_value.UserValue(), target_format);
+    batch.Put(handles_[kZsetsScoreCF], iter->key(), internal_value.Encode());
+    if (batch.Count() >= kConvertBatchCount) {
+      Status s = commit_batch();
+      if (!s.ok()) {
+        return s;
+      }
+    }
+  }
+  if (!iter->status().ok()) {
+    return iter->status();
+  }
+
+  Status s = commit_batch();
+  if (s.ok()) {
+    data_format_ = target_format;
+  }
+  return s;
 }
 
 Status Redis::GetScanStartPoint(const DataType& type, const Slice& key, const Slice& pattern, int64_t cursor, std::string* start_point) {
@@ -203,14 +468,525 @@ Status Redis::CompactRange(const rocksdb::Slice* begin, const rocksdb::Slice* en
   db_->CompactRange(default_compact_range_options_, handles_[kZsetsDataCF], begin, end);
   db_->CompactRange(default_compact_range_options_, handles_[kZsetsScoreCF], begin, end);
   db_->CompactRange(default_compact_range_options_, handles_[kStreamsDataCF], begin, end);
+  db_->CompactRange(default_compact_range_options_, handles_[kZsetsRankCF], begin, end);
+  db_->CompactRange(default_compact_range_options_, handles_[kBitmapsDataCF], begin, end);
+  if (begin == nullptr && end == nullptr) {
+    db_->CompactRange(default_compact_range_options_, handles_[kTypeIndexCF], nullptr, nullptr);
+    db_->CompactRange(default_compact_range_options_, handles_[kKeyStatsCF], nullptr, nullptr);
+    db_->CompactRange(default_compact_range_options_, handles_[kExpiryIndexCF], nullptr, nullptr);
+  } else {
+    // type index keys are the meta key behind the type tag, compact the
+    // range under each tag. the counters and the expiry index are not keyed
+    // by the user key, they wait for a full compaction
+    for (const auto type : {DataType::kHashes, DataType::kSets, DataType::kLists, DataType::kZSets,
+                            DataType::kStreams}) {
+      char tag = DataTypeTag[static_cast<int>(type)];
+      std::string index_begin = begin != nullptr ? EncodeTypeIndexKey(tag, *begin) : std::string(1, tag);
+      std::string index_end = end != nullptr ? EncodeTypeIndexKey(tag, *end) : std::string(1, static_cast<char>(tag + 1));
+      rocksdb::Slice index_begin_slice(index_begin);
+      rocksdb::Slice index_end_slice(index_end);
+      db_->CompactRange(default_compact_range_options_, handles_[kTypeIndexCF], &index_begin_slice, &index_end_slice);
+    }
+  }
+  // the compaction drops expired keys without a write, the counters catch up
+  // after a full one
+  if (key_counters_ && begin == nullptr && end == nullptr) {
+    Status s = static_cast<TypeIndexedDB*>(db_)->ReconcileKeyCounters();
+    if (!s.ok()) {
+      LOG(WARNING) << "reconcile key counters failed: " << s.ToString();
+    }
+  }
+  return Status::OK();
+}
+
+Status Redis::ReapExpiredKeys(int64_t max_entries, int64_t* entries, int64_t* reaped) {
+  *entries = 0;
+  *reaped = 0;
+  if (!expiry_index_) {
+    return Status::OK();
+  }
+  // entries of the current bucket may not be due yet, they wait for the next
+  // second rather than each being checked again
+  uint64_t now = pstd::NowMillis();
+  std::string upper_bound = EncodeExpiryIndexBucket(ExpiryIndexBucket(now));
+  rocksdb::Slice upper_bound_slice(upper_bound);
+  rocksdb::ReadOptions read_options;
+  read_options.fill_cache = false;
+  read_options.iterate_upper_bound = &upper_bound_slice;
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[kExpiryIndexCF]));
+
+  const int64_t kReapBatchCount = 128;
+  std::vector<std::string> index_keys;
+  std::vector<std::string> user_keys;
+  iter->SeekToFirst();
+  while (*entries < max_entries && iter->Valid()) {
+    index_keys.clear();
+    user_keys.clear();
+    for (; iter->Valid() && *entries < max_entries && static_cast<int64_t>(index_keys.size()) < kReapBatchCount;
+         iter->Next()) {
+      rocksdb::Slice index_key = iter->key();
+      index_keys.push_back(index_key.ToString());
+      if (index_key.size() > kExpiryIndexBucketLength) {
+        ParsedBaseMetaKey parsed_meta_key(
+            Slice(index_key.data() + kExpiryIndexBucketLength, index_key.size() - kExpiryIndexBucketLength));
+        user_keys.push_back(parsed_meta_key.Key().ToString());
+      }
+      (*entries)++;
+    }
+
+    // the meta is read again under the locks, a key written since the entry
+    // was made only loses the entry
+    MultiScopeRecordLock ml(lock_mgr_, user_keys);
+    rocksdb::WriteBatch batch;
+    std::unordered_set<std::string> deleted_meta_keys;
+    std::string meta_value;
+    for (const auto& index_key : index_keys) {
+      if (index_key.size() > kExpiryIndexBucketLength) {
+        std::string meta_key = index_key.substr(kExpiryIndexBucketLength);
+        Status s = db_->Get(default_read_options_, handles_[kMetaCF], meta_key, &meta_value);
+        if (!s.ok() && !s.IsNotFound()) {
+          return s;
+        }
+        if (s.ok() && MetaValueExpired(meta_value, now) && deleted_meta_keys.insert(meta_key).second) {
+          batch.Delete(handles_[kMetaCF], meta_key);
+          (*reaped)++;
+        }
+      }
+      batch.Delete(handles_[kExpiryIndexCF], index_key);
+    }
+    Status s = db_->Write(default_write_options_, &batch);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return iter->status();
+}
+
+Status Redis::ReclaimRange(const DataType& type, const Slice& key, uint64_t version) {
+  struct Range {
+    rocksdb::ColumnFamilyHandle* handle;
+    std::string begin;
+    std::string end;
+  };
+  std::vector<Range> ranges;
+  // member keys sort bytewise, the ones of a version share the prefix
+  // | reserve1 | key | version |
+  auto add_prefix_range = [&](ColumnFamilyIndex cf) {
+    BaseDataKey data_key(key, version, Slice(), data_format_);
+    std::string begin = data_key.EncodeSeekKey().ToString();
+    std::string end = begin;
+    while (!end.empty() && static_cast<uint8_t>(end.back()) == 0xff) {
+      end.pop_back();
+    }
+    if (end.empty()) {
+      return;
+    }
+    end.back() = static_cast<char>(static_cast<uint8_t>(end.back()) + 1);
+    ranges.push_back({handles_[cf], std::move(begin), std::move(end)});
+  };
+  switch (type) {
+    case DataType::kHashes:
+      add_prefix_range(kHashesDataCF);
+      break;
+    case DataType::kSets:
+      add_prefix_range(kSetsDataCF);
+      break;
+    case DataType::kZSets: {
+      add_prefix_range(kZsetsDataCF);
+      // score and rank keys compare their version and score as numbers, the
+      // version ends before the lowest key of the next one
+      if (version == std::numeric_limits<uint64_t>::max()) {
+        break;
+      }
+      double lowest = -std::numeric_limits<double>::infinity();
+      ZSetsScoreKey begin_key(key, version, lowest, Slice());
+      ZSetsScoreKey end_key(key, version + 1, lowest, Slice());
+      std::string begin = begin_key.Encode().ToString();
+      std::string end = end_key.Encode().ToString();
+      ranges.push_back({handles_[kZsetsScoreCF], begin, end});
+      ranges.push_back({handles_[kZsetsRankCF], std::move(begin), std::move(end)});
+      break;
+    }
+    default:
+      return Status::InvalidArgument("no member data cf to reclaim for " + std::string(DataTypeToString(type)));
+  }
+
+  rocksdb::WriteBatch batch;
+  for (const auto& range : ranges) {
+    batch.DeleteRange(range.handle, range.begin, range.end);
+  }
+  Status s = db_->Write(default_write_options_, &batch);
+  if (!s.ok()) {
+    return s;
+  }
+  for (const auto& range : ranges) {
+    Slice begin(range.begin);
+    Slice end(range.end);
+    s = db_->CompactRange(default_compact_range_options_, range.handle, &begin, &end);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+// The cfs are emptied rather than dropped and created again: the meta cf is
+// the default cf, which cannot be dropped, and the handles are read by the
+// compaction filters and the background thread without a lock. The write
+// goes to the base db, TypeIndexedDB would count the meta deletes again
+// against the key counters the same batch deletes
+Status Redis::FlushDB() {
+  rocksdb::DB* base_db = db_->GetBaseDB();
+  struct KeptRecord {
+    ColumnFamilyIndex cf;
+    std::string key;
+    std::string value;
+  };
+  std::vector<KeptRecord> kept = {{kTypeIndexCF, kTypeIndexBuiltKey, ""},
+                                  {kExpiryIndexCF, kExpiryIndexBuiltKey, ""},
+                                  {kKeyStatsCF, kKeyCountersReconciledKey, ""},
+                                  {kKeyStatsCF, kSlotTableKey, ""}};
+  auto put_kept = [&](rocksdb::WriteBatch* batch) {
+    for (const auto& record : kept) {
+      batch->Put(handles_[record.cf], record.key, record.value);
+    }
+  };
+  for (auto iter = kept.begin(); iter != kept.end();) {
+    Status s = base_db->Get(default_read_options_, handles_[iter->cf], iter->key, &iter->value);
+    if (s.IsNotFound()) {
+      iter = kept.erase(iter);
+      continue;
+    }
+    if (!s.ok()) {
+      return s;
+    }
+    ++iter;
+  }
+
+  rocksdb::ReadOptions read_options;
+  read_options.total_order_seek = true;
+  read_options.fill_cache = false;
+  rocksdb::WriteBatch batch;
+  for (auto handle : handles_) {
+    std::unique_ptr<rocksdb::Iterator> iter(base_db->NewIterator(read_options, handle));
+    iter->SeekToLast();
+    if (!iter->Valid()) {
+      if (!iter->status().ok()) {
+        return iter->status();
+      }
+      continue;
+    }
+    std::string last = iter->key().ToString();
+    iter->SeekToFirst();
+    if (!iter->Valid()) {
+      return iter->status().ok() ? Status::Corruption("flushdb: cf lost its first key") : iter->status();
+    }
+    batch.DeleteRange(handle, iter->key(), last);
+    batch.Delete(handle, last);
+  }
+  // put after the range deletes, so the later sequence wins
+  put_kept(&batch);
+  Status s = base_db->Write(default_write_options_, &batch);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // files wholly in the deleted range go without being read, the deletion
+  // itself is paced by the sst file manager if one is set
+  for (auto handle : handles_) {
+    s = rocksdb::DeleteFilesInRange(base_db, handle, nullptr, nullptr);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  // a flush and compaction since the write may have put the kept records
+  // into a file just deleted
+  rocksdb::WriteBatch kept_batch;
+  put_kept(&kept_batch);
+  s = base_db->Write(default_write_options_, &kept_batch);
+  if (!s.ok()) {
+    return s;
+  }
+  statistics_store_->Clear();
+  scan_cursors_store_->Clear();
+  if (meta_version_cache_ != nullptr) {
+    meta_version_cache_->Clear();
+  }
   return Status::OK();
 }
 
+rocksdb::Options Redis::GetCFOptions(ColumnFamilyIndex cf) { return db_->GetOptions(handles_[cf]); }
+
+Status Redis::IngestBulkFiles(const std::vector<std::pair<ColumnFamilyIndex, std::vector<std::string>>>& cf_files) {
+  std::vector<rocksdb::IngestExternalFileArg> args;
+  for (const auto& [cf, files] : cf_files) {
+    rocksdb::IngestExternalFileArg arg;
+    arg.column_family = handles_[cf];
+    arg.external_files = files;
+    arg.options.move_files = true;
+    args.push_back(std::move(arg));
+  }
+  if (args.empty()) {
+    return Status::OK();
+  }
+  Status s = db_->IngestExternalFiles(args);
+  if (!s.ok()) {
+    return s;
+  }
+  if (key_counters_) {
+    s = db_->Delete(default_write_options_, handles_[kKeyStatsCF], kKeyCountersReconciledKey);
+  }
+  return s;
+}
+
+Status Redis::GetSlotTable(std::string* value) {
+  return db_->Get(default_read_options_, handles_[kKeyStatsCF], kSlotTableKey, value);
+}
+
+Status Redis::PutSlotTable(const std::string& value) {
+  return db_->Put(default_write_options_, handles_[kKeyStatsCF], kSlotTableKey, value);
+}
+
+Status Redis::GetMigratingSlots(std::vector<uint32_t>* slots) {
+  std::string value;
+  Status s = db_->Get(default_read_options_, handles_[kKeyStatsCF], kMigratingSlotsKey, &value);
+  if (!s.ok()) {
+    return s;
+  }
+  slots->clear();
+  for (size_t offset = 0; offset + sizeof(uint32_t) <= value.size(); offset += sizeof(uint32_t)) {
+    slots->push_back(DecodeFixed32(value.data() + offset));
+  }
+  return s;
+}
+
+Status Redis::PutMigratingSlots(const std::vector<uint32_t>& slots) {
+  if (slots.empty()) {
+    return db_->Delete(default_write_options_, handles_[kKeyStatsCF], kMigratingSlotsKey);
+  }
+  std::string value(sizeof(uint32_t) * slots.size(), '\0');
+  for (size_t idx = 0; idx < slots.size(); ++idx) {
+    EncodeFixed32(value.data() + sizeof(uint32_t) * idx, slots[idx]);
+  }
+  return db_->Put(default_write_options_, handles_[kKeyStatsCF], kMigratingSlotsKey, value);
+}
+
+void Redis::SetSlotWriteLog(const std::shared_ptr<SlotWriteLog>& log) {
+  static_cast<TypeIndexedDB*>(db_)->SetSlotWriteLog(log);
+}
+
+uint64_t Redis::GetWrittenBytes() const { return static_cast<TypeIndexedDB*>(db_)->WrittenBytes(); }
+
+// Keys of a slot are spread over the whole key space, so every slot data cf
+// is walked once for all the slots migrating together
+Status Redis::CopySlots(Redis* dst, const SlotSet& slots) {
+  const rocksdb::Snapshot* snapshot = nullptr;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  read_options.fill_cache = false;
+  read_options.total_order_seek = true;
+
+  const int32_t kCopyBatchCount = 1000;
+  uint64_t copied = 0;
+  std::string user_key;
+  rocksdb::WriteBatch batch;
+  for (const auto cf : kSlotDataCFs) {
+    std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[cf]));
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      if (!slots.CoversKey(iter->key(), &user_key)) {
+        continue;
+      }
+      PutSlotData(dst, cf, iter->key(), iter->value(), &batch);
+      copied++;
+      if (batch.Count() >= kCopyBatchCount) {
+        Status s = dst->db_->Write(dst->default_write_options_, &batch);
+        if (!s.ok()) {
+          return s;
+        }
+        batch.Clear();
+      }
+    }
+    if (!iter->status().ok()) {
+      return iter->status();
+    }
+  }
+  Status s = dst->db_->Write(dst->default_write_options_, &batch);
+  if (s.ok()) {
+    LOG(INFO) << "instance " << index_ << " copied " << copied << " keys of " << slots.Slots().size()
+              << " slots to instance " << dst->index_;
+  }
+  return s;
+}
+
+// Instances pick their data format on their own, so the member keys and
+// values moved between a v1 and a v2 instance are rewritten like
+// ConvertDataFormat does. The other keys are the same in both formats
+void Redis::PutSlotData(Redis* dst, ColumnFamilyIndex cf, const Slice& key, const Slice& value,
+                        rocksdb::WriteBatch* batch) {
+  DataFormat format = dst->data_format_;
+  if (cf == kHashesDataCF || cf == kSetsDataCF || cf == kZsetsDataCF) {
+    DataFormat key_format = IsDataFormatV2Key(key) ? kDataFormatV2 : kDataFormatV1;
+    if (key_format != format) {
+      ParsedBaseDataKey parsed_data_key(key);
+      ParsedBaseDataValue parsed_value(value);
+      BaseDataKey data_key(parsed_data_key.Key(), parsed_data_key.Version(), parsed_data_key.Data(), format);
+      BaseDataValue internal_value(parsed_value.UserValue(), format);
+      batch->Put(dst->handles_[cf], data_key.Encode(), internal_value.Encode());
+      return;
+    }
+  } else if (cf == kZsetsScoreCF) {
+    // zset score keys keep the v1 layout, only their values differ
+    ParsedBaseDataValue parsed_value(value);
+    if (parsed_value.Format() != format) {
+      BaseDataValue internal_value(parsed_value.UserValue(), format);
+      batch->Put(dst->handles_[cf], key, internal_value.Encode());
+      return;
+    }
+  }
+  batch->Put(dst->handles_[cf], key, value);
+}
+
+// Seek targets of the keys of user_key in a slot data cf other than the meta
+// cf, one for v1 and one for v2 keys in the bytewise cfs
+static std::vector<std::string> UserKeySeekTargets(ColumnFamilyIndex cf, const Slice& user_key) {
+  if (cf == kZsetsScoreCF || cf == kZsetsRankCF) {
+    // the comparator reads the version and score of both keys
+    ZSetsScoreKey lowest(user_key, 0, -std::numeric_limits<double>::infinity(), Slice());
+    return {lowest.Encode().ToString()};
+  }
+  if (cf == kListsDataCF) {
+    ListsDataKey lowest(user_key, 0, 0);
+    return {lowest.Encode().ToString()};
+  }
+  std::vector<std::string> targets;
+  for (const auto format : {kDataFormatV1, kDataFormatV2}) {
+    BaseDataKey lowest(user_key, 0, Slice(), format);
+    targets.push_back(lowest.EncodeSeekKey().ToString());
+  }
+  return targets;
+}
+
+Status Redis::CopyKeys(Redis* dst, const std::vector<std::string>& user_keys) {
+  const rocksdb::Snapshot* snapshot = nullptr;
+  ScopeSnapshot ss(db_, &snapshot);
+  rocksdb::ReadOptions read_options;
+  read_options.snapshot = snapshot;
+  read_options.total_order_seek = true;
+  rocksdb::ReadOptions dst_read_options;
+  dst_read_options.total_order_seek = true;
+
+  const int32_t kCopyBatchCount = 1000;
+  Status s;
+  rocksdb::WriteBatch batch;
+  auto flush = [&](int32_t batch_count) {
+    if (batch.Count() < batch_count) {
+      return Status::OK();
+    }
+    Status write_status = dst->db_->Write(dst->default_write_options_, &batch);
+    batch.Clear();
+    return write_status;
+  };
+  std::string meta_value;
+  std::string key_user_key;
+  for (const auto& user_key : user_keys) {
+    // the meta goes first, see kSlotDataCFs
+    BaseMetaKey base_meta_key(user_key);
+    s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
+    if (s.ok()) {
+      batch.Put(dst->handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+    } else if (s.IsNotFound()) {
+      batch.Delete(dst->handles_[kMetaCF], base_meta_key.Encode());
+    } else {
+      return s;
+    }
+    // the keys dst holds are deleted before the ones held here are put, dst
+    // does not serve the slot yet so the steps in between are never seen
+    for (const auto cf : kSlotDataCFs) {
+      if (cf == kMetaCF) {
+        continue;
+      }
+      for (const auto& target : UserKeySeekTargets(cf, user_key)) {
+        std::unique_ptr<rocksdb::Iterator> dst_iter(dst->db_->NewIterator(dst_read_options, dst->handles_[cf]));
+        for (dst_iter->Seek(target); dst_iter->Valid(); dst_iter->Next()) {
+          DecodeSlotDataUserKey(dst_iter->key(), &key_user_key);
+          if (key_user_key != user_key) {
+            break;
+          }
+          batch.Delete(dst->handles_[cf], dst_iter->key());
+          s = flush(kCopyBatchCount);
+          if (!s.ok()) {
+            return s;
+          }
+        }
+        if (!dst_iter->status().ok()) {
+          return dst_iter->status();
+        }
+        std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[cf]));
+        for (iter->Seek(target); iter->Valid(); iter->Next()) {
+          DecodeSlotDataUserKey(iter->key(), &key_user_key);
+          if (key_user_key != user_key) {
+            break;
+          }
+          PutSlotData(dst, cf, iter->key(), iter->value(), &batch);
+          s = flush(kCopyBatchCount);
+          if (!s.ok()) {
+            return s;
+          }
+        }
+        if (!iter->status().ok()) {
+          return iter->status();
+        }
+      }
+    }
+  }
+  return flush(1);
+}
+
+Status Redis::DeleteSlots(const SlotSet& slots) {
+  rocksdb::ReadOptions read_options;
+  read_options.fill_cache = false;
+  read_options.total_order_seek = true;
+
+  const int32_t kDeleteBatchCount = 1000;
+  uint64_t deleted = 0;
+  std::string user_key;
+  rocksdb::WriteBatch batch;
+  for (const auto cf : kSlotDataCFs) {
+    std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, handles_[cf]));
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      if (!slots.CoversKey(iter->key(), &user_key)) {
+        continue;
+      }
+      batch.Delete(handles_[cf], iter->key());
+      deleted++;
+      if (batch.Count() >= kDeleteBatchCount) {
+        Status s = db_->Write(default_write_options_, &batch);
+        if (!s.ok()) {
+          return s;
+        }
+        batch.Clear();
+      }
+    }
+    if (!iter->status().ok()) {
+      return iter->status();
+    }
+  }
+  Status s = db_->Write(default_write_options_, &batch);
+  if (s.ok()) {
+    LOG(INFO) << "instance " << index_ << " deleted " << deleted << " keys of " << slots.Slots().size() << " slots";
+  }
+  return s;
+}
+
 void SelectColumnFamilyHandles(const DataType& option_type, const ColumnFamilyType& type,
                                std::vector<int>& handleIdxVec) {
   switch (option_type) {
     case DataType::kStrings:
       handleIdxVec.push_back(kMetaCF);
+      if (type == kData || type == kMetaAndData) {
+        handleIdxVec.push_back(kBitmapsDataCF);
+      }
       break;
     case DataType::kHashes:
       if (type == kMeta || type == kMetaAndData) {
@@ -243,6 +1019,7 @@ void SelectColumnFamilyHandles(const DataType& option_type, const ColumnFamilyTy
       if (type == kData || type == kMetaAndData) {
         handleIdxVec.push_back(kZsetsDataCF);
         handleIdxVec.push_back(kZsetsScoreCF);
+        handleIdxVec.push_back(kZsetsRankCF);
       }
       break;
     case DataType::kStreams:
@@ -254,7 +1031,7 @@ void SelectColumnFamilyHandles(const DataType& option_type, const ColumnFamilyTy
       }
       break;
     case DataType::kAll:
-      for (auto s = kMetaCF; s <= kStreamsDataCF; s = static_cast<ColumnFamilyIndex>(s + 1)) {
+      for (auto s = kMetaCF; s <= kExpiryIndexCF; s = static_cast<ColumnFamilyIndex>(s + 1)) {
         handleIdxVec.push_back(s);
       }
       break;
@@ -381,6 +1158,10 @@ Status Redis::LongestNotCompactionSstCompact(const DataType& option_type, std::v
       total_keys = metadata_iter->num_entries;
       deleted_keys = metadata_iter->num_deletions;
       ++metadata_iter;
+      // expired puts and members of stale versions are dropped like deletions
+      uint64_t dead_keys = 0, dead_bytes = 0;
+      GetTTLDeadEntries(*iter.second, static_cast<uint64_t>(now), &dead_keys, &dead_bytes);
+      deleted_keys = std::min(deleted_keys + dead_keys, total_keys);
 
       double delete_ratio = static_cast<double>(deleted_keys) / static_cast<double>(total_keys);
 
@@ -388,7 +1169,7 @@ Status Redis::LongestNotCompactionSstCompact(const DataType& option_type, std::v
       if (file_creation_time <
               static_cast<uint64_t>(now / 1000 - storageOptions.compact_param_.force_compact_file_age_seconds_) &&
           delete_ratio >= force_compact_min_ratio) {
-        compact_result = db_->CompactRange(default_compact_range_options_, &start_key, &stop_key);
+        compact_result = db_->CompactRange(default_compact_range_options_, handles_[idx], &start_key, &stop_key);
         if (--max_files_to_compact == 0) {
           break;
         }
@@ -486,6 +1267,13 @@ Status Redis::AddCompactKeyTaskIfNeeded(const DataType& dtype, const std::string
   return Status::OK();
 }
 
+void Redis::AddReclaimRangeTaskIfNeeded(const DataType& dtype, const Slice& key, uint64_t version, uint64_t count) {
+  if (lazyfree_range_threshold_ <= 0 || count < static_cast<uint64_t>(lazyfree_range_threshold_)) {
+    return;
+  }
+  storage_->AddBGTask({dtype, kReclaimRange, {key.ToString(), std::to_string(version)}});
+}
+
 Status Redis::SetOptions(const OptionType& option_type, const std::unordered_map<std::string, std::string>& options) {
   if (option_type == OptionType::kDB) {
     return db_->SetDBOptions(options);
@@ -696,6 +1484,15 @@ void Redis::GetRocksDBInfo(std::string& info, const char* prefix) {
       write_ticker_count(rocksdb::Tickers::BLOB_DB_CACHE_BYTES_READ, "blob_db_cache_bytes_read");
       write_ticker_count(rocksdb::Tickers::BLOB_DB_CACHE_BYTES_WRITE, "blob_db_cache_bytes_write");
     }
+    // open
+    string_stream << prefix << "open_micros:" << open_micros_ << "\r\n";
+    string_stream << prefix << "wal_replay_micros:" << wal_replay_micros_ << "\r\n";
+    // meta version cache shared by the data cf compaction filters
+    if (meta_version_cache_ != nullptr) {
+      string_stream << prefix << "meta_version_cache_size:" << meta_version_cache_->Size() << "\r\n";
+      string_stream << prefix << "meta_version_cache_hits:" << meta_version_cache_->Hits() << "\r\n";
+      string_stream << prefix << "meta_version_cache_misses:" << meta_version_cache_->Misses() << "\r\n";
+    }
     // column family stats
     std::map<std::string, std::string> mapvalues;
     db_->rocksdb::DB::GetMapProperty(rocksdb::DB::Properties::kCFStats,&mapvalues);
@@ -724,7 +1521,10 @@ Status Redis::GetProperty(const std::string& property, uint64_t* out) {
   return Status::OK();
 }
 
-Status Redis::ScanKeyNum(std::vector<KeyInfo>* key_infos) {
+Status Redis::ScanKeyNum(std::vector<KeyInfo>* key_infos, bool verify) {
+  if (key_counters_ && !verify) {
+    return CountersKeyNum(key_infos);
+  }
   key_infos->resize(DataTypeNum);
   rocksdb::Status s;
   s = ScanStringsKeyNum(&((*key_infos)[0]));
@@ -752,6 +1552,54 @@ Status Redis::ScanKeyNum(std::vector<KeyInfo>* key_infos) {
     return s;
   }
 
+  if (key_counters_) {
+    std::vector<KeyInfo> counted_key_infos;
+    s = CountersKeyNum(&counted_key_infos);
+    for (size_t idx = 0; s.ok() && idx < key_infos->size(); ++idx) {
+      if (counted_key_infos[idx].keys != (*key_infos)[idx].keys) {
+        LOG(INFO) << "db " << index_ << " type " << idx << " key counters counted " << counted_key_infos[idx].keys
+                  << " keys, " << (*key_infos)[idx].keys << " found";
+      }
+    }
+    s = static_cast<TypeIndexedDB*>(db_)->ReconcileKeyCounters();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+// KeyInfo of every type from the key counters, reconciled first if they are
+// not yet. Keys whose etime has passed are counted until the next reconcile
+Status Redis::CountersKeyNum(std::vector<KeyInfo>* key_infos) {
+  std::string unused;
+  Status s = db_->Get(default_read_options_, handles_[kKeyStatsCF], kKeyCountersReconciledKey, &unused);
+  if (s.IsNotFound()) {
+    s = static_cast<TypeIndexedDB*>(db_)->ReconcileKeyCounters();
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  KeyCountersMap counters;
+  s = ReadKeyCounters(db_, handles_[kKeyStatsCF], default_read_options_, &counters);
+  if (!s.ok()) {
+    return s;
+  }
+
+  auto positive = [](int64_t counter) { return counter > 0 ? static_cast<uint64_t>(counter) : 0; };
+  uint64_t cursec = pstd::NowMillis() / 1000;
+  key_infos->resize(DataTypeNum);
+  // in the order of ScanKeyNum
+  const char tags[] = {'k', 'h', 'l', 'z', 's', 'x'};
+  for (size_t idx = 0; idx < sizeof(tags); ++idx) {
+    const KeyCounters& type_counters = counters[tags[idx]];
+    KeyInfo& key_info = (*key_infos)[idx];
+    key_info.keys = positive(type_counters.total - type_counters.empty);
+    key_info.expires = positive(type_counters.expires);
+    key_info.invaild_keys = positive(type_counters.empty);
+    uint64_t avg_etime = key_info.expires != 0 ? positive(type_counters.etime_sum) / key_info.expires : 0;
+    key_info.avg_ttl = avg_etime > cursec ? (avg_etime - cursec) * 1000 : 0;
+  }
   return Status::OK();
 }
 
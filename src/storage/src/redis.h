@@ -6,9 +6,12 @@
 #ifndef SRC_REDIS_H_
 #define SRC_REDIS_H_
 
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "rocksdb/db.h"
@@ -16,10 +19,20 @@
 #include "rocksdb/status.h"
 
 #include "src/debug.h"
+#include "src/hashes_inline_format.h"
 #include "src/lock_mgr.h"
 #include "src/lru_cache.h"
+#include "src/meta_version_cache.h"
+#include "src/sets_inline_format.h"
+#include "src/zsets_rank_index.h"
 #include "src/mutex_impl.h"
 #include "src/type_iterator.h"
+#include "src/type_index.h"
+#include "src/expiry_index.h"
+#include "src/member_cursor.h"
+#include "src/slot_migration.h"
+#include "src/strings_merge.h"
+#include "src/bitmap_chunk.h"
 #include "src/custom_comparator.h"
 #include "storage/storage.h"
 #include "storage/storage_define.h"
@@ -105,14 +118,66 @@ class Redis {
   // Common Commands
   Status Open(const StorageOptions& storage_options, const std::string& db_path);
 
+  DataFormat GetDataFormat() const { return data_format_; }
+  // Time the last Open took, and the part of it in the rocksdb open, which
+  // is mostly the replay of the WAL
+  uint64_t GetOpenMicros() const { return open_micros_; }
+  uint64_t GetWalReplayMicros() const { return wal_replay_micros_; }
+  // Offline rewrite of the hash/set/zset member keys and data values into
+  // target_format, must not run concurrently with writes
+  Status ConvertDataFormat(DataFormat target_format, uint64_t* converted);
+
   virtual Status CompactRange(const rocksdb::Slice* begin, const rocksdb::Slice* end);
 
+  // Walks the expiry index entries due before the current second, up to
+  // max_entries of them, deleting the keys that have expired and the entries.
+  // reaped is the number of keys deleted
+  Status ReapExpiredKeys(int64_t max_entries, int64_t* entries, int64_t* reaped);
+
+  // Range deletes the data keys of version of the hash, set or zset key in
+  // every data cf of its type and compacts those ranges
+  Status ReclaimRange(const DataType& type, const Slice& key, uint64_t version);
+
+  // Range deletes every key of every cf but the index markers and the slot
+  // table, then drops the sst files the deletion covers. The files left are
+  // reclaimed by the compaction Storage::FlushDB queues
+  Status FlushDB();
+
+  // Bulk load, see BulkLoader. The options the sst files of cf are written
+  // with, so they carry the comparator, filters and prefix blooms of the cf
+  rocksdb::Options GetCFOptions(ColumnFamilyIndex cf);
+  bool IsExpiryIndexed() const { return expiry_index_; }
+  // Ingests the files of every cf in one go, the files of a cf must not
+  // overlap. The key counters are reconciled at their next read
+  Status IngestBulkFiles(const std::vector<std::pair<ColumnFamilyIndex, std::vector<std::string>>>& cf_files);
+
+  // Slot migration, see Storage::MigrateSlots. The slot table and the
+  // migrating slots live in the key stats cf, see slot_migration.h
+  Status GetSlotTable(std::string* value);
+  Status PutSlotTable(const std::string& value);
+  Status GetMigratingSlots(std::vector<uint32_t>* slots);
+  // no slots deletes the record
+  Status PutMigratingSlots(const std::vector<uint32_t>& slots);
+  // Records the user keys of slots written from here on, nullptr stops it
+  void SetSlotWriteLog(const std::shared_ptr<SlotWriteLog>& log);
+  // Copies the keys of slots into dst from a snapshot
+  Status CopySlots(Redis* dst, const SlotSet& slots);
+  // Makes every key of user_keys in dst what it is here, deleted if it is gone
+  Status CopyKeys(Redis* dst, const std::vector<std::string>& user_keys);
+  // Puts a key of the slot data cf cf into batch for dst, in the data format of dst
+  void PutSlotData(Redis* dst, ColumnFamilyIndex cf, const Slice& key, const Slice& value, rocksdb::WriteBatch* batch);
+  Status DeleteSlots(const SlotSet& slots);
+  // Bytes written since open, the write rate of the slot rebalance
+  uint64_t GetWrittenBytes() const;
+
   virtual Status LongestNotCompactionSstCompact(const DataType& option_type, std::vector<Status>* compact_result_vec,
                                                 const ColumnFamilyType& type = kMetaAndData);
 
   virtual Status GetProperty(const std::string& property, uint64_t* out);
 
-  Status ScanKeyNum(std::vector<KeyInfo>* key_info);
+  // With key counters the full scan runs only to verify and correct them
+  Status ScanKeyNum(std::vector<KeyInfo>* key_info, bool verify = false);
+  Status CountersKeyNum(std::vector<KeyInfo>* key_info);
   Status ScanStringsKeyNum(KeyInfo* key_info);
   Status ScanHashesKeyNum(KeyInfo* key_info);
   Status ScanListsKeyNum(KeyInfo* key_info);
@@ -154,14 +219,21 @@ class Redis {
 
   // Strings Commands
   Status Append(const Slice& key, const Slice& value, int32_t* ret, int64_t* expired_timestamp_millsec, std::string& out_new_value);
-  Status BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int32_t* ret, bool have_range);
+  Status BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int64_t* ret, bool have_range);
   Status BitOp(BitOpType op, const std::string& dest_key, const std::vector<std::string>& src_keys, std::string &value_to_dest, int64_t* ret);
+  // BITOP in two steps, sources from any instance and dest_key in this one
+  Status GetBitmapReader(const Slice& key, BitmapReader* reader);
+  Status BitOpStore(BitOpType op, const std::string& dest_key, std::vector<BitmapReader>* sources,
+                    std::string& value_to_dest, int64_t* ret);
   Status Decrby(const Slice& key, int64_t value, int64_t* ret);
   Status Get(const Slice& key, std::string* value);
   Status HyperloglogGet(const Slice& key, std::string* value);
   Status MGet(const Slice& key, std::string* value);
   Status GetWithTTL(const Slice& key, std::string* value, int64_t* ttl_millsec);
   Status MGetWithTTL(const Slice& key, std::string* value, int64_t* ttl_millsec);
+  // Batched variants, all keys must belong to this instance
+  Status MGet(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss);
+  Status MGetWithTTL(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss);
   Status GetBit(const Slice& key, int64_t offset, int32_t* ret);
   Status Getrange(const Slice& key, int64_t start_offset, int64_t end_offset, std::string* ret);
   Status GetrangeWithValue(const Slice& key, int64_t start_offset, int64_t end_offset,
@@ -188,12 +260,17 @@ class Redis {
   Status PKSetexAt(const Slice& key, const Slice& value, int64_t time_stamp_millsec_);
 
   Status Exists(const Slice& key);
+  Status Exists(const std::vector<std::string>& keys, int64_t* count);
   Status Del(const Slice& key);
+  // Delete all keys with a single WriteBatch, count is the number of keys deleted
+  Status Del(const std::vector<std::string>& keys, int64_t* count);
   Status Expire(const Slice& key, int64_t ttl_millsec);
   Status Expireat(const Slice& key, int64_t timestamp_millsec);
   Status Persist(const Slice& key);
   Status TTL(const Slice& key, int64_t* ttl_millsec);
-  Status PKPatternMatchDelWithRemoveKeys(const std::string& pattern, int64_t* ret, std::vector<std::string>* remove_keys, const int64_t& max_count);
+  // remaining is shared with the other instances, each key deleted takes one
+  Status PKPatternMatchDelWithRemoveKeys(const std::string& pattern, int64_t* ret, std::vector<std::string>* remove_keys,
+                                         std::atomic<int64_t>* remaining);
 
   Status GetType(const Slice& key, enum DataType& type);
   Status IsExist(const Slice& key);
@@ -227,7 +304,7 @@ class Redis {
   Status SetSmallCompactionDurationThreshold(uint64_t small_compaction_duration_threshold);
 
 
-  std::vector<rocksdb::ColumnFamilyHandle*> GetStringCFHandles() { return {handles_[kMetaCF]}; }
+  std::vector<rocksdb::ColumnFamilyHandle*> GetStringCFHandles() { return {handles_[kMetaCF], handles_[kBitmapsDataCF]}; }
 
   std::vector<rocksdb::ColumnFamilyHandle*> GetHashCFHandles() {
     return {handles_.begin() + kMetaCF, handles_.begin() + kHashesDataCF + 1};
@@ -242,7 +319,9 @@ class Redis {
   }
 
   std::vector<rocksdb::ColumnFamilyHandle*> GetZsetCFHandles() {
-    return {handles_.begin() + kMetaCF, handles_.begin() + kZsetsScoreCF + 1};
+    std::vector<rocksdb::ColumnFamilyHandle*> cfhds(handles_.begin() + kMetaCF, handles_.begin() + kZsetsScoreCF + 1);
+    cfhds.push_back(handles_[kZsetsRankCF]);
+    return cfhds;
   }
 
   std::vector<rocksdb::ColumnFamilyHandle*> GetStreamCFHandles() {
@@ -270,6 +349,14 @@ class Redis {
                std::vector<std::string>* members, int64_t* next_cursor);
   Status AddAndGetSpopCount(const std::string& key, uint64_t* count);
   Status ResetSpopCount(const std::string& key);
+  // Opens a cursor on the members of the set key, NotFound when it is empty
+  Status NewSetsMemberCursor(const Slice& key, const rocksdb::ReadOptions& read_options,
+                             std::unique_ptr<MemberCursor>* cursor);
+  // Replaces destination, of any type, by the set of the members producer
+  // feeds its sink. They are written in batches under a new version, which
+  // the meta value switches to in the last one
+  Status SetsStore(const Slice& destination, const std::function<Status(const SetsMemberSink&)>& producer,
+                   std::vector<std::string>* value_to_dest, int32_t* ret);
 
   // Lists commands
   Status LIndex(const Slice& key, int64_t index, std::string* element);
@@ -307,9 +394,8 @@ class Redis {
                           int64_t offset, std::vector<ScoreMember>* score_members);
   Status ZRevrank(const Slice& key, const Slice& member, int32_t* rank);
   Status ZScore(const Slice& key, const Slice& member, double* score);
-  Status ZGetAll(const Slice& key, double weight, std::map<std::string, double>* value_to_dest);
   Status ZUnionstore(const Slice& destination, const std::vector<std::string>& keys, const std::vector<double>& weights,
-                     AGGREGATE agg, std::map<std::string, double>& value_to_dest, int32_t* ret);
+                     AGGREGATE agg, std::vector<ScoreMember>& value_to_dest, int32_t* ret);
   Status ZInterstore(const Slice& destination, const std::vector<std::string>& keys, const std::vector<double>& weights,
                      AGGREGATE agg, std::vector<ScoreMember>& value_to_dest, int32_t* ret);
   Status ZRangebylex(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
@@ -322,6 +408,13 @@ class Redis {
                std::vector<ScoreMember>* score_members, int64_t* next_cursor);
   Status ZPopMax(const Slice& key, int64_t count, std::vector<ScoreMember>* score_members);
   Status ZPopMin(const Slice& key, int64_t count, std::vector<ScoreMember>* score_members);
+  // Opens a cursor on the members of the zset or set key, a set counting as
+  // a zset of score 1 members; NotFound when it is empty
+  Status NewZSetsMergeInput(const Slice& key, const rocksdb::ReadOptions& read_options, ZSetsMergeInput* input);
+  // Replaces destination, of any type, by the zset of the members producer
+  // feeds its sink, written like in SetsStore
+  Status ZSetsStore(const Slice& destination, const std::function<Status(const ZSetsMemberSink&)>& producer,
+                    std::vector<ScoreMember>* value_to_dest, int32_t* ret);
 
   //===--------------------------------------------------------------------===//
   // Commands
@@ -370,22 +463,22 @@ class Redis {
     options.iterate_upper_bound = upper_bound;
     switch (type) {
       case 'k':
-        return new StringsIterator(options, db_, handles_[kMetaCF], pattern);
+        return new StringsIterator(options, db_, handles_[kMetaCF], handles_[kBitmapsDataCF], pattern);
         break;
       case 'h':
-        return new HashesIterator(options, db_, handles_[kMetaCF], pattern);
+        return new HashesIterator(NewTypeIndexIterator(options, DataType::kHashes), pattern);
         break;
       case 's':
-        return new SetsIterator(options, db_, handles_[kMetaCF], pattern);
+        return new SetsIterator(NewTypeIndexIterator(options, DataType::kSets), pattern);
         break;
       case 'l':
-        return new ListsIterator(options, db_, handles_[kMetaCF], pattern);
+        return new ListsIterator(NewTypeIndexIterator(options, DataType::kLists), pattern);
         break;
       case 'z':
-        return new ZsetsIterator(options, db_, handles_[kMetaCF], pattern);
+        return new ZsetsIterator(NewTypeIndexIterator(options, DataType::kZSets), pattern);
         break;
       case 'x':
-        return new StreamsIterator(options, db_, handles_[kMetaCF], pattern);
+        return new StreamsIterator(NewTypeIndexIterator(options, DataType::kStreams), pattern);
         break;
       case 'a':
         return new AllIterator(options, db_, handles_[kMetaCF], pattern);
@@ -396,6 +489,11 @@ class Redis {
     return nullptr;
   }
 
+  // Meta keys and values of one of the collection types, in the meta cf order
+  rocksdb::Iterator* NewTypeIndexIterator(const rocksdb::ReadOptions& options, const DataType& type) {
+    return new TypeIndexIterator(options, db_, handles_[kMetaCF], handles_[kTypeIndexCF], type);
+  }
+
   enum DataType GetMetaValueType(const std::string &meta_value) {
     DataType meta_type = static_cast<enum DataType>(static_cast<uint8_t>(meta_value[0]));
     return meta_type;
@@ -437,6 +535,19 @@ class Redis {
   }
 
 private:
+  // Batched lookup of the meta cf, values[i] is only valid when statuses[i].ok()
+  void MultiGetMeta(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                    std::vector<Status>* statuses);
+  Status ExistsWithMetaValue(const Slice& key, std::string&& meta_value);
+  // The cursors of the sets of keys in order, nullptr for the missing or
+  // empty ones
+  Status NewSetsMemberCursors(const std::vector<std::string>& keys, const rocksdb::ReadOptions& read_options,
+                              MemberCursors* cursors);
+  // The inputs of keys in order with their weights, without cursor for the
+  // missing or empty ones
+  Status NewZSetsMergeInputs(const std::vector<std::string>& keys, const std::vector<double>& weights,
+                             const rocksdb::ReadOptions& read_options, ZSetsMergeInputs* inputs);
+
   Status GenerateStreamID(const StreamMetaValue& stream_meta, StreamAddTrimArgs& args);
 
   Status StreamScanRange(const Slice& key, const uint64_t version, const Slice& id_start, const std::string& id_end,
@@ -521,6 +632,60 @@ private:
   rocksdb::ReadOptions default_read_options_;
   rocksdb::CompactRangeOptions default_compact_range_options_;
   std::atomic<bool> in_compact_flag_;
+  // Format of the hash/set/zset member keys and data values written by this instance
+  DataFormat data_format_ = kDataFormatV1;
+  uint64_t open_micros_ = 0;
+  uint64_t wal_replay_micros_ = 0;
+  DataFormat DetectDataFormat(DataFormat default_format, bool* unfinished);
+  // Shared by the compaction filters, saves their meta cf lookups
+  std::unique_ptr<MetaVersionCache> meta_version_cache_;
+  void AddDroppedVersion(const Slice& key, uint64_t version) {
+    if (meta_version_cache_ != nullptr) {
+      meta_version_cache_->AddDroppedVersion(key, version);
+    }
+  }
+  // Hashes of at most this many fields, no field or value longer than
+  // hash_max_inline_value_, keep their fields in the meta value. 0 stops
+  // creating new ones and spills existing ones on their next write
+  int32_t hash_max_inline_entries_ = 0;
+  int32_t hash_max_inline_value_ = 64;
+  // the same for sets, see sets_inline_format.h
+  int32_t set_max_inline_entries_ = 0;
+  int32_t set_max_inline_value_ = 64;
+  // key counters kept in kKeyStatsCF by TypeIndexedDB
+  bool key_counters_ = false;
+  // expiry index kept in kExpiryIndexCF by TypeIndexedDB, see expiry_index.h
+  bool expiry_index_ = false;
+  // Collections deleted with at least this many members have their old
+  // version range deleted in the background, 0 disables it
+  int32_t lazyfree_range_threshold_ = 0;
+  // Incrby, Incrbyfloat, Append and Setrange of a live string write a
+  // StringsMergeOperator operand instead of the whole value
+  bool strings_merge_ = false;
+  // Bitmaps SETBIT grows past this many bytes are chunked, see bitmap_chunk.h,
+  // 0 keeps them plain strings
+  int32_t bitmap_chunk_size_ = 0;
+  // value holds the user value of a chunked bitmap, it gets the bitmap bytes
+  Status ExpandChunkedBitmap(const Slice& key, std::string* value);
+  Status ChunkedBitPos(const Slice& key, const BitmapChunkMeta& bitmap_meta, int32_t bit, int64_t start_offset,
+                       int64_t end_offset, int64_t* ret);
+  bool HashesUpdateInline(const Slice& key, bool meta_found, std::string* meta_value,
+                          const std::function<Status(HashesInlineFields*)>& update, Status* s);
+  Status HashesFoldInline(const rocksdb::ReadOptions& read_options, const Slice& key,
+                          const std::unordered_set<std::string>& deleted_fields,
+                          ParsedHashesMetaValue* parsed_hashes_meta_value, rocksdb::WriteBatch* batch);
+  bool SetsUpdateInline(const Slice& key, bool meta_found, std::string* meta_value,
+                        const std::function<Status(SetsInlineMembers*)>& update, rocksdb::WriteBatch* batch,
+                        Status* s);
+  Status SetsFoldInline(const Slice& key, const std::unordered_set<std::string>& deleted_members,
+                        ParsedSetsMetaValue* parsed_sets_meta_value, rocksdb::WriteBatch* batch);
+  // Lists created with a positive chunk size are chunked, see lists_chunk.h
+  int32_t list_chunk_size_ = 0;
+  // Zsets reaching this size get a rank index, 0 disables building new ones
+  int32_t zset_rank_index_threshold_ = 0;
+  void MaintainZsetsRankIndex(const Slice& key, int32_t count, ZSetsRankIndex* rank_index);
+  Status ZRankByIndex(const rocksdb::ReadOptions& read_options, const Slice& key, uint64_t version,
+                      const Slice& member, int32_t* rank);
   OBDSstListener listener_; // listening created sst file while compacting in OBD-compact
 
   // For Scan
@@ -538,6 +703,9 @@ private:
   Status UpdateSpecificKeyStatistics(const DataType& dtype, const std::string& key, uint64_t count);
   Status UpdateSpecificKeyDuration(const DataType& dtype, const std::string& key, uint64_t duration);
   Status AddCompactKeyTaskIfNeeded(const DataType& dtype, const std::string& key, uint64_t count, uint64_t duration);
+  // Queues a kReclaimRange task for a deleted collection of count members
+  // when it reaches lazyfree_range_threshold_
+  void AddReclaimRangeTaskIfNeeded(const DataType& dtype, const Slice& key, uint64_t version, uint64_t count);
 };
 
 }  //  namespace storage
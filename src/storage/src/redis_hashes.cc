@@ -5,6 +5,7 @@
 
 #include "src/redis.h"
 
+#include <iterator>
 #include <memory>
 
 #include <fmt/core.h>
@@ -33,7 +34,7 @@ Status Redis::ScanHashesKeyNum(KeyInfo* key_info) {
 
   pstd::TimeType curtime = pstd::NowMillis();
 
-  rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[kMetaCF]);
+  rocksdb::Iterator* iter = NewTypeIndexIterator(iterator_options, DataType::kHashes);
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
     if (!ExpectedMetaValue(DataType::kHashes, iter->value().ToString())) {
       continue;
@@ -58,6 +59,117 @@ Status Redis::ScanHashesKeyNum(KeyInfo* key_info) {
   return Status::OK();
 }
 
+static Status DecodeInlineFields(ParsedHashesMetaValue* parsed_hashes_meta_value, HashesInlineFields* fields) {
+  if (!fields->Decode(parsed_hashes_meta_value->InlinePayload())) {
+    return Status::Corruption("bad inline hash");
+  }
+  return Status::OK();
+}
+
+// Runs update on the fields of an inline hash, or of a hash that does not
+// exist yet while inline hashes are enabled, and writes the result inline
+// if it fits, as data keys otherwise. Returns false for a hash with data
+// keys, which is left to the caller
+bool Redis::HashesUpdateInline(const Slice& key, bool meta_found, std::string* meta_value,
+                               const std::function<Status(HashesInlineFields*)>& update, Status* s) {
+  HashesInlineFields fields;
+  std::string origin_payload;
+  bool fresh = !meta_found;
+  if (meta_found) {
+    ParsedHashesMetaValue parsed_hashes_meta_value(meta_value);
+    if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
+      // the callers reuse a stale meta value, drop its fields first
+      parsed_hashes_meta_value.SetInline(false);
+      parsed_hashes_meta_value.SetInlinePayload(Slice());
+      fresh = true;
+    } else if (!parsed_hashes_meta_value.IsInline()) {
+      return false;
+    } else {
+      *s = DecodeInlineFields(&parsed_hashes_meta_value, &fields);
+      if (!s->ok()) {
+        return true;
+      }
+      origin_payload = parsed_hashes_meta_value.InlinePayload().ToString();
+    }
+  }
+  if (fresh && hash_max_inline_entries_ <= 0) {
+    return false;
+  }
+  *s = update(&fields);
+  if (!s->ok() || (fresh ? fields.Count() == 0 : fields.Encode() == origin_payload)) {
+    return true;
+  }
+
+  if (!meta_found) {
+    char meta_value_buf[4] = {0};
+    HashesMetaValue hashes_meta_value(DataType::kHashes, Slice(meta_value_buf, 4));
+    hashes_meta_value.UpdateVersion();
+    *meta_value = hashes_meta_value.Encode().ToString();
+  }
+  ParsedHashesMetaValue parsed_hashes_meta_value(meta_value);
+  uint64_t version = fresh && meta_found ? parsed_hashes_meta_value.InitialMetaValue()
+                                         : parsed_hashes_meta_value.Version();
+  rocksdb::WriteBatch batch;
+  parsed_hashes_meta_value.SetCount(static_cast<int32_t>(fields.Count()));
+  if (fields.Count() != 0 && fields.Fits(hash_max_inline_entries_, hash_max_inline_value_)) {
+    parsed_hashes_meta_value.SetInline(true);
+    parsed_hashes_meta_value.SetInlinePayload(fields.Encode());
+  } else {
+    // no data key carries this version yet, the fields can spill under it
+    parsed_hashes_meta_value.SetInline(false);
+    parsed_hashes_meta_value.SetInlinePayload(Slice());
+    for (const auto& fv : fields.FieldValues()) {
+      HashesDataKey hashes_data_key(key, version, fv.field, data_format_);
+      BaseDataValue internal_value(fv.value, data_format_);
+      batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
+    }
+  }
+  BaseMetaKey base_meta_key(key);
+  batch.Put(handles_[kMetaCF], base_meta_key.Encode(), *meta_value);
+  *s = db_->Write(default_write_options_, &batch);
+  return true;
+}
+
+// Moves the fields left after HDel into the meta value and deletes their
+// data keys in the same batch. Only done at half the inline limit so that a
+// hash hovering around it does not convert back and forth on every write
+Status Redis::HashesFoldInline(const rocksdb::ReadOptions& read_options, const Slice& key,
+                               const std::unordered_set<std::string>& deleted_fields,
+                               ParsedHashesMetaValue* parsed_hashes_meta_value, rocksdb::WriteBatch* batch) {
+  int32_t count = parsed_hashes_meta_value->Count();
+  if (count == 0 || count > std::max(hash_max_inline_entries_ / 2, 1) || hash_max_inline_entries_ <= 0) {
+    return Status::OK();
+  }
+  HashesInlineFields fields;
+  std::vector<std::string> data_keys;
+  HashesDataKey hashes_data_key(key, parsed_hashes_meta_value->Version(), "", data_format_);
+  Slice prefix = hashes_data_key.EncodeSeekKey();
+  rocksdb::ReadOptions fold_read_options(read_options);
+  fold_read_options.prefix_same_as_start = true;
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(fold_read_options, handles_[kHashesDataCF]));
+  for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
+    ParsedHashesDataKey parsed_hashes_data_key(iter->key());
+    if (deleted_fields.find(parsed_hashes_data_key.field().ToString()) != deleted_fields.end()) {
+      continue;
+    }
+    ParsedBaseDataValue parsed_internal_value(iter->value());
+    fields.Set(parsed_hashes_data_key.field(), parsed_internal_value.UserValue());
+    data_keys.push_back(iter->key().ToString());
+    if (!fields.Fits(hash_max_inline_entries_, hash_max_inline_value_)) {
+      return Status::OK();
+    }
+  }
+  if (!iter->status().ok() || fields.Count() != static_cast<size_t>(count)) {
+    return iter->status();
+  }
+  for (const auto& data_key : data_keys) {
+    batch->Delete(handles_[kHashesDataCF], data_key);
+  }
+  parsed_hashes_meta_value->SetInline(true);
+  parsed_hashes_meta_value->SetInlinePayload(fields.Encode());
+  return Status::OK();
+}
+
 Status Redis::HDel(const Slice& key, const std::vector<std::string>& fields, int32_t* ret) {
   uint32_t statistic = 0;
   std::vector<std::string> filtered_fields;
@@ -93,6 +205,20 @@ Status Redis::HDel(const Slice& key, const std::vector<std::string>& fields, int
         DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     }
   }
+  if (s.ok() || s.IsNotFound()) {
+    auto erase_fields = [&](HashesInlineFields* inline_fields) {
+      for (const auto& field : filtered_fields) {
+        if (inline_fields->Erase(field)) {
+          del_cnt++;
+        }
+      }
+      *ret = del_cnt;
+      return Status::OK();
+    };
+    if (HashesUpdateInline(key, s.ok(), &meta_value, erase_fields, &s)) {
+      return s;
+    }
+  }
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
@@ -102,7 +228,7 @@ Status Redis::HDel(const Slice& key, const std::vector<std::string>& fields, int
       std::string data_value;
       version = parsed_hashes_meta_value.Version();
       for (const auto& field : filtered_fields) {
-        HashesDataKey hashes_data_key(key, version, field);
+        HashesDataKey hashes_data_key(key, version, field, data_format_);
         s = db_->Get(read_options, handles_[kHashesDataCF], hashes_data_key.Encode(), &data_value);
         if (s.ok()) {
           del_cnt++;
@@ -119,6 +245,10 @@ Status Redis::HDel(const Slice& key, const std::vector<std::string>& fields, int
         return Status::InvalidArgument("hash size overflow");
       }
       parsed_hashes_meta_value.ModifyCount(-del_cnt);
+      s = HashesFoldInline(read_options, key, field_set, &parsed_hashes_meta_value, &batch);
+      if (!s.ok()) {
+        return s;
+      }
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
     }
   } else if (s.IsNotFound()) {
@@ -163,9 +293,17 @@ Status Redis::HGet(const Slice& key, const Slice& field, std::string* value) {
       return Status::NotFound("Stale");
     } else if (parsed_hashes_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_hashes_meta_value.IsInline()) {
+      HashesInlineFields inline_fields;
+      s = DecodeInlineFields(&parsed_hashes_meta_value, &inline_fields);
+      const std::string* inline_value = s.ok() ? inline_fields.Find(field) : nullptr;
+      if (inline_value == nullptr) {
+        return s.ok() ? Status::NotFound() : s;
+      }
+      *value = *inline_value;
     } else {
       version = parsed_hashes_meta_value.Version();
-      HashesDataKey data_key(key, version, field);
+      HashesDataKey data_key(key, version, field, data_format_);
       s = db_->Get(read_options, handles_[kHashesDataCF], data_key.Encode(), value);
       if (s.ok()) {
         ParsedBaseDataValue parsed_internal_value(value);
@@ -203,11 +341,18 @@ Status Redis::HGetall(const Slice& key, std::vector<FieldValue>* fvs) {
       return Status::NotFound("Stale");
     } else if (parsed_hashes_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_hashes_meta_value.IsInline()) {
+      HashesInlineFields inline_fields;
+      s = DecodeInlineFields(&parsed_hashes_meta_value, &inline_fields);
+      if (s.ok()) {
+        fvs->insert(fvs->end(), inline_fields.FieldValues().begin(), inline_fields.FieldValues().end());
+      }
     } else {
       version = parsed_hashes_meta_value.Version();
-      HashesDataKey hashes_data_key(key, version, "");
+      HashesDataKey hashes_data_key(key, version, "", data_format_);
       Slice prefix = hashes_data_key.EncodeSeekKey();
       KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      read_options.prefix_same_as_start = true;
       auto iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedHashesDataKey parsed_hashes_data_key(iter->key());
@@ -256,10 +401,20 @@ Status Redis::HGetallWithTTL(const Slice& key, std::vector<FieldValue>* fvs, int
         *ttl_millsec = *ttl_millsec - curtime >= 0 ? *ttl_millsec - curtime : -2;
       }
 
+      if (parsed_hashes_meta_value.IsInline()) {
+        HashesInlineFields inline_fields;
+        s = DecodeInlineFields(&parsed_hashes_meta_value, &inline_fields);
+        if (s.ok()) {
+          fvs->insert(fvs->end(), inline_fields.FieldValues().begin(), inline_fields.FieldValues().end());
+        }
+        return s;
+      }
+
       version = parsed_hashes_meta_value.Version();
-      HashesDataKey hashes_data_key(key, version, "");
+      HashesDataKey hashes_data_key(key, version, "", data_format_);
       Slice prefix = hashes_data_key.EncodeSeekKey();
       KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      read_options.prefix_same_as_start = true;
       auto iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedHashesDataKey parsed_hashes_data_key(iter->key());
@@ -297,6 +452,27 @@ Status Redis::HIncrby(const Slice& key, const Slice& field, int64_t value, int64
         DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     }
   }
+  if (s.ok() || s.IsNotFound()) {
+    auto incr_field = [&](HashesInlineFields* inline_fields) {
+      const std::string* old_value = inline_fields->Find(field);
+      int64_t ival = 0;
+      if (old_value != nullptr) {
+        if (StrToInt64(old_value->data(), old_value->size(), &ival) == 0) {
+          return Status::Corruption("hash value is not an integer");
+        }
+        if ((value >= 0 && LLONG_MAX - value < ival) || (value < 0 && LLONG_MIN - value > ival)) {
+          return Status::InvalidArgument("Overflow");
+        }
+      }
+      *ret = ival + value;
+      Int64ToStr(value_buf, 32, *ret);
+      inline_fields->Set(field, value_buf);
+      return Status::OK();
+    };
+    if (HashesUpdateInline(key, s.ok(), &meta_value, incr_field, &s)) {
+      return s;
+    }
+  }
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
@@ -304,14 +480,14 @@ Status Redis::HIncrby(const Slice& key, const Slice& field, int64_t value, int64
       parsed_hashes_meta_value.SetCount(1);
       parsed_hashes_meta_value.SetEtime(0);
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
-      HashesDataKey hashes_data_key(key, version, field);
+      HashesDataKey hashes_data_key(key, version, field, data_format_);
       Int64ToStr(value_buf, 32, value);
-      BaseDataValue internal_value(value_buf);
+      BaseDataValue internal_value(value_buf, data_format_);
       batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
       *ret = value;
     } else {
       version = parsed_hashes_meta_value.Version();
-      HashesDataKey hashes_data_key(key, version, field);
+      HashesDataKey hashes_data_key(key, version, field, data_format_);
       s = db_->Get(default_read_options_, handles_[kHashesDataCF], hashes_data_key.Encode(), &old_value);
       if (s.ok()) {
         ParsedBaseDataValue parsed_internal_value(&old_value);
@@ -325,7 +501,7 @@ Status Redis::HIncrby(const Slice& key, const Slice& field, int64_t value, int64
         }
         *ret = ival + value;
         Int64ToStr(value_buf, 32, *ret);
-        BaseDataValue internal_value(value_buf);
+        BaseDataValue internal_value(value_buf, data_format_);
         batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
         statistic++;
       } else if (s.IsNotFound()) {
@@ -333,7 +509,7 @@ Status Redis::HIncrby(const Slice& key, const Slice& field, int64_t value, int64
         if (!parsed_hashes_meta_value.CheckModifyCount(1)) {
           return Status::InvalidArgument("hash size overflow");
         }
-        BaseDataValue internal_value(value_buf);
+        BaseDataValue internal_value(value_buf, data_format_);
         parsed_hashes_meta_value.ModifyCount(1);
         batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
         batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
@@ -347,10 +523,10 @@ Status Redis::HIncrby(const Slice& key, const Slice& field, int64_t value, int64
     HashesMetaValue hashes_meta_value(DataType::kHashes, Slice(meta_value_buf, 4));
     version = hashes_meta_value.UpdateVersion();
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), hashes_meta_value.Encode());
-    HashesDataKey hashes_data_key(key, version, field);
+    HashesDataKey hashes_data_key(key, version, field, data_format_);
 
     Int64ToStr(value_buf, 32, value);
-    BaseDataValue internal_value(value_buf);
+    BaseDataValue internal_value(value_buf, data_format_);
     batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
     *ret = value;
   } else {
@@ -390,6 +566,27 @@ Status Redis::HIncrbyfloat(const Slice& key, const Slice& field, const Slice& by
         DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     }
   }
+  if (s.ok() || s.IsNotFound()) {
+    auto incr_field = [&](HashesInlineFields* inline_fields) {
+      const std::string* old_value_ptr = inline_fields->Find(field);
+      long double total = long_double_by;
+      if (old_value_ptr != nullptr) {
+        long double old_value;
+        if (StrToLongDouble(old_value_ptr->data(), old_value_ptr->size(), &old_value) == -1) {
+          return Status::Corruption("value is not a vaild float");
+        }
+        total = old_value + long_double_by;
+      }
+      if (LongDoubleToStr(total, new_value) == -1) {
+        return Status::InvalidArgument("Overflow");
+      }
+      inline_fields->Set(field, *new_value);
+      return Status::OK();
+    };
+    if (HashesUpdateInline(key, s.ok(), &meta_value, incr_field, &s)) {
+      return s;
+    }
+  }
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
@@ -397,14 +594,14 @@ Status Redis::HIncrbyfloat(const Slice& key, const Slice& field, const Slice& by
       parsed_hashes_meta_value.SetCount(1);
       parsed_hashes_meta_value.SetEtime(0);
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
-      HashesDataKey hashes_data_key(key, version, field);
+      HashesDataKey hashes_data_key(key, version, field, data_format_);
 
       LongDoubleToStr(long_double_by, new_value);
-      BaseDataValue inter_value(*new_value);
+      BaseDataValue inter_value(*new_value, data_format_);
       batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), inter_value.Encode());
     } else {
       version = parsed_hashes_meta_value.Version();
-      HashesDataKey hashes_data_key(key, version, field);
+      HashesDataKey hashes_data_key(key, version, field, data_format_);
       s = db_->Get(default_read_options_, handles_[kHashesDataCF], hashes_data_key.Encode(), &old_value_str);
       if (s.ok()) {
         long double total;
@@ -419,7 +616,7 @@ Status Redis::HIncrbyfloat(const Slice& key, const Slice& field, const Slice& by
         if (LongDoubleToStr(total, new_value) == -1) {
           return Status::InvalidArgument("Overflow");
         }
-        BaseDataValue internal_value(*new_value);
+        BaseDataValue internal_value(*new_value, data_format_);
         batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
         statistic++;
       } else if (s.IsNotFound()) {
@@ -428,7 +625,7 @@ Status Redis::HIncrbyfloat(const Slice& key, const Slice& field, const Slice& by
           return Status::InvalidArgument("hash size overflow");
         }
         parsed_hashes_meta_value.ModifyCount(1);
-        BaseDataValue internal_value(*new_value);
+        BaseDataValue internal_value(*new_value, data_format_);
         batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
         batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
       } else {
@@ -441,9 +638,9 @@ Status Redis::HIncrbyfloat(const Slice& key, const Slice& field, const Slice& by
     version = hashes_meta_value.UpdateVersion();
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), hashes_meta_value.Encode());
 
-    HashesDataKey hashes_data_key(key, version, field);
+    HashesDataKey hashes_data_key(key, version, field, data_format_);
     LongDoubleToStr(long_double_by, new_value);
-    BaseDataValue internal_value(*new_value);
+    BaseDataValue internal_value(*new_value, data_format_);
     batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
   } else {
     return s;
@@ -480,11 +677,18 @@ Status Redis::HKeys(const Slice& key, std::vector<std::string>* fields) {
       return Status::NotFound("Stale");
     } else if (parsed_hashes_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_hashes_meta_value.IsInline()) {
+      HashesInlineFields inline_fields;
+      s = DecodeInlineFields(&parsed_hashes_meta_value, &inline_fields);
+      for (const auto& fv : inline_fields.FieldValues()) {
+        fields->push_back(fv.field);
+      }
     } else {
       version = parsed_hashes_meta_value.Version();
-      HashesDataKey hashes_data_key(key, version, "");
+      HashesDataKey hashes_data_key(key, version, "", data_format_);
       Slice prefix = hashes_data_key.EncodeSeekKey();
       KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      read_options.prefix_same_as_start = true;
       auto iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedHashesDataKey parsed_hashes_data_key(iter->key());
@@ -563,10 +767,24 @@ Status Redis::HMGet(const Slice& key, const std::vector<std::string>& fields, st
         vss->push_back({std::string(), Status::NotFound()});
       }
       return Status::NotFound(is_stale ? "Stale" : "");
+    } else if (parsed_hashes_meta_value.IsInline()) {
+      HashesInlineFields inline_fields;
+      s = DecodeInlineFields(&parsed_hashes_meta_value, &inline_fields);
+      if (!s.ok()) {
+        return s;
+      }
+      for (const auto& field : fields) {
+        const std::string* inline_value = inline_fields.Find(field);
+        if (inline_value != nullptr) {
+          vss->push_back({*inline_value, Status::OK()});
+        } else {
+          vss->push_back({std::string(), Status::NotFound()});
+        }
+      }
     } else {
       version = parsed_hashes_meta_value.Version();
       for (const auto& field : fields) {
-        HashesDataKey hashes_data_key(key, version, field);
+        HashesDataKey hashes_data_key(key, version, field, data_format_);
         s = db_->Get(read_options, handles_[kHashesDataCF], hashes_data_key.Encode(), &value);
         if (s.ok()) {
           ParsedBaseDataValue parsed_internal_value(&value);
@@ -620,6 +838,17 @@ Status Redis::HMSet(const Slice& key, const std::vector<FieldValue>& fvs) {
         DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     }
   }
+  if (s.ok() || s.IsNotFound()) {
+    auto set_fields = [&](HashesInlineFields* inline_fields) {
+      for (const auto& fv : filtered_fvs) {
+        inline_fields->Set(fv.field, fv.value);
+      }
+      return Status::OK();
+    };
+    if (HashesUpdateInline(key, s.ok(), &meta_value, set_fields, &s)) {
+      return s;
+    }
+  }
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
@@ -630,8 +859,8 @@ Status Redis::HMSet(const Slice& key, const std::vector<FieldValue>& fvs) {
       parsed_hashes_meta_value.SetCount(static_cast<int32_t>(filtered_fvs.size()));
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
       for (const auto& fv : filtered_fvs) {
-        HashesDataKey hashes_data_key(key, version, fv.field);
-        BaseDataValue inter_value(fv.value);
+        HashesDataKey hashes_data_key(key, version, fv.field, data_format_);
+        BaseDataValue inter_value(fv.value, data_format_);
         batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), inter_value.Encode());
       }
     } else {
@@ -639,8 +868,8 @@ Status Redis::HMSet(const Slice& key, const std::vector<FieldValue>& fvs) {
       std::string data_value;
       version = parsed_hashes_meta_value.Version();
       for (const auto& fv : filtered_fvs) {
-        HashesDataKey hashes_data_key(key, version, fv.field);
-        BaseDataValue inter_value(fv.value);
+        HashesDataKey hashes_data_key(key, version, fv.field, data_format_);
+        BaseDataValue inter_value(fv.value, data_format_);
         s = db_->Get(default_read_options_, handles_[kHashesDataCF], hashes_data_key.Encode(), &data_value);
         if (s.ok()) {
           statistic++;
@@ -664,8 +893,8 @@ Status Redis::HMSet(const Slice& key, const std::vector<FieldValue>& fvs) {
     version = hashes_meta_value.UpdateVersion();
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), hashes_meta_value.Encode());
     for (const auto& fv : filtered_fvs) {
-      HashesDataKey hashes_data_key(key, version, fv.field);
-      BaseDataValue inter_value(fv.value);
+      HashesDataKey hashes_data_key(key, version, fv.field, data_format_);
+      BaseDataValue inter_value(fv.value, data_format_);
       batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), inter_value.Encode());
     }
   }
@@ -695,27 +924,36 @@ Status Redis::HSet(const Slice& key, const Slice& field, const Slice& value, int
         DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     }
   }
+  if (s.ok() || s.IsNotFound()) {
+    auto set_field = [&](HashesInlineFields* inline_fields) {
+      *res = inline_fields->Set(field, value) ? 1 : 0;
+      return Status::OK();
+    };
+    if (HashesUpdateInline(key, s.ok(), &meta_value, set_field, &s)) {
+      return s;
+    }
+  }
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
       version = parsed_hashes_meta_value.InitialMetaValue();
       parsed_hashes_meta_value.SetCount(1);
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
-      HashesDataKey data_key(key, version, field);
-      BaseDataValue internal_value(value);
+      HashesDataKey data_key(key, version, field, data_format_);
+      BaseDataValue internal_value(value, data_format_);
       batch.Put(handles_[kHashesDataCF], data_key.Encode(), internal_value.Encode());
       *res = 1;
     } else {
       version = parsed_hashes_meta_value.Version();
       std::string data_value;
-      HashesDataKey hashes_data_key(key, version, field);
+      HashesDataKey hashes_data_key(key, version, field, data_format_);
       s = db_->Get(default_read_options_, handles_[kHashesDataCF], hashes_data_key.Encode(), &data_value);
       if (s.ok()) {
         *res = 0;
         if (data_value == value.ToString()) {
           return Status::OK();
         } else {
-          BaseDataValue internal_value(value);
+          BaseDataValue internal_value(value, data_format_);
           batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
           statistic++;
         }
@@ -724,7 +962,7 @@ Status Redis::HSet(const Slice& key, const Slice& field, const Slice& value, int
           return Status::InvalidArgument("hash size overflow");
         }
         parsed_hashes_meta_value.ModifyCount(1);
-        BaseDataValue internal_value(value);
+        BaseDataValue internal_value(value, data_format_);
         batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
         batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
         *res = 1;
@@ -737,8 +975,8 @@ Status Redis::HSet(const Slice& key, const Slice& field, const Slice& value, int
     HashesMetaValue hashes_meta_value(DataType::kHashes, Slice(meta_value_buf, 4));
     version = hashes_meta_value.UpdateVersion();
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), hashes_meta_value.Encode());
-    HashesDataKey data_key(key, version, field);
-    BaseDataValue internal_value(value);
+    HashesDataKey data_key(key, version, field, data_format_);
+    BaseDataValue internal_value(value, data_format_);
     batch.Put(handles_[kHashesDataCF], data_key.Encode(), internal_value.Encode());
     *res = 1;
   } else {
@@ -757,7 +995,7 @@ Status Redis::HSetnx(const Slice& key, const Slice& field, const Slice& value, i
   std::string meta_value;
 
   BaseMetaKey base_meta_key(key);
-  BaseDataValue internal_value(value);
+  BaseDataValue internal_value(value, data_format_);
   Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   char meta_value_buf[4] = {0};
   if (s.ok() && !ExpectedMetaValue(DataType::kHashes, meta_value)) {
@@ -770,18 +1008,30 @@ Status Redis::HSetnx(const Slice& key, const Slice& field, const Slice& value, i
         DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     }
   }
+  if (s.ok() || s.IsNotFound()) {
+    auto set_field = [&](HashesInlineFields* inline_fields) {
+      *ret = inline_fields->Find(field) == nullptr ? 1 : 0;
+      if (*ret == 1) {
+        inline_fields->Set(field, value);
+      }
+      return Status::OK();
+    };
+    if (HashesUpdateInline(key, s.ok(), &meta_value, set_field, &s)) {
+      return s;
+    }
+  }
   if (s.ok()) {
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
       version = parsed_hashes_meta_value.InitialMetaValue();
       parsed_hashes_meta_value.SetCount(1);
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
-      HashesDataKey hashes_data_key(key, version, field);
+      HashesDataKey hashes_data_key(key, version, field, data_format_);
       batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
       *ret = 1;
     } else {
       version = parsed_hashes_meta_value.Version();
-      HashesDataKey hashes_data_key(key, version, field);
+      HashesDataKey hashes_data_key(key, version, field, data_format_);
       std::string data_value;
       s = db_->Get(default_read_options_, handles_[kHashesDataCF], hashes_data_key.Encode(), &data_value);
       if (s.ok()) {
@@ -803,7 +1053,7 @@ Status Redis::HSetnx(const Slice& key, const Slice& field, const Slice& value, i
     HashesMetaValue hashes_meta_value(DataType::kHashes, Slice(meta_value_buf, 4));
     version = hashes_meta_value.UpdateVersion();
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), hashes_meta_value.Encode());
-    HashesDataKey hashes_data_key(key, version, field);
+    HashesDataKey hashes_data_key(key, version, field, data_format_);
     batch.Put(handles_[kHashesDataCF], hashes_data_key.Encode(), internal_value.Encode());
     *ret = 1;
   } else {
@@ -839,11 +1089,18 @@ Status Redis::HVals(const Slice& key, std::vector<std::string>* values) {
       return Status::NotFound("Stale");
     } else if (parsed_hashes_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_hashes_meta_value.IsInline()) {
+      HashesInlineFields inline_fields;
+      s = DecodeInlineFields(&parsed_hashes_meta_value, &inline_fields);
+      for (const auto& fv : inline_fields.FieldValues()) {
+        values->push_back(fv.value);
+      }
     } else {
       version = parsed_hashes_meta_value.Version();
-      HashesDataKey hashes_data_key(key, version, "");
+      HashesDataKey hashes_data_key(key, version, "", data_format_);
       Slice prefix = hashes_data_key.EncodeSeekKey();
       KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      read_options.prefix_same_as_start = true;
       auto iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedBaseDataValue parsed_internal_value(iter->value());
@@ -901,6 +1158,18 @@ Status Redis::HScan(const Slice& key, int64_t cursor, const std::string& pattern
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
       *next_cursor = 0;
       return Status::NotFound();
+    } else if (parsed_hashes_meta_value.IsInline()) {
+      // like a listpack hash in redis, one call returns every field
+      HashesInlineFields inline_fields;
+      s = DecodeInlineFields(&parsed_hashes_meta_value, &inline_fields);
+      if (!s.ok()) {
+        return s;
+      }
+      for (const auto& fv : inline_fields.FieldValues()) {
+        if (StringMatch(pattern.data(), pattern.size(), fv.field.data(), fv.field.size(), 0) != 0) {
+          field_values->push_back(fv);
+        }
+      }
     } else {
       std::string sub_field;
       std::string start_point;
@@ -916,10 +1185,11 @@ Status Redis::HScan(const Slice& key, int64_t cursor, const std::string& pattern
         sub_field = pattern.substr(0, pattern.size() - 1);
       }
 
-      HashesDataKey hashes_data_prefix(key, version, sub_field);
-      HashesDataKey hashes_start_data_key(key, version, start_point);
+      HashesDataKey hashes_data_prefix(key, version, sub_field, data_format_);
+      HashesDataKey hashes_start_data_key(key, version, start_point, data_format_);
       std::string prefix = hashes_data_prefix.EncodeSeekKey().ToString();
       KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(hashes_start_data_key.Encode()); iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -978,12 +1248,28 @@ Status Redis::HScanx(const Slice& key, const std::string& start_field, const std
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
       *next_field = "";
       return Status::NotFound();
+    } else if (parsed_hashes_meta_value.IsInline()) {
+      HashesInlineFields inline_fields;
+      s = DecodeInlineFields(&parsed_hashes_meta_value, &inline_fields);
+      if (!s.ok()) {
+        return s;
+      }
+      auto iter = inline_fields.LowerBound(start_field);
+      for (; iter != inline_fields.FieldValues().end() && rest > 0; ++iter, --rest) {
+        if (StringMatch(pattern.data(), pattern.size(), iter->field.data(), iter->field.size(), 0) != 0) {
+          field_values->push_back(*iter);
+        }
+      }
+      if (iter != inline_fields.FieldValues().end()) {
+        *next_field = iter->field;
+      }
     } else {
       uint64_t version = parsed_hashes_meta_value.Version();
-      HashesDataKey hashes_data_prefix(key, version, Slice());
-      HashesDataKey hashes_start_data_key(key, version, start_field);
+      HashesDataKey hashes_data_prefix(key, version, Slice(), data_format_);
+      HashesDataKey hashes_start_data_key(key, version, start_field, data_format_);
       std::string prefix = hashes_data_prefix.EncodeSeekKey().ToString();
       KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(hashes_start_data_key.Encode()); iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -1047,12 +1333,33 @@ Status Redis::PKHScanRange(const Slice& key, const Slice& field_start, const std
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_hashes_meta_value.IsInline()) {
+      HashesInlineFields inline_fields;
+      s = DecodeInlineFields(&parsed_hashes_meta_value, &inline_fields);
+      if (!s.ok()) {
+        return s;
+      }
+      const auto& fvs = inline_fields.FieldValues();
+      auto iter = start_no_limit ? fvs.begin() : inline_fields.LowerBound(field_start);
+      for (; iter != fvs.end() && remain > 0; ++iter) {
+        if (!end_no_limit && iter->field.compare(field_end) > 0) {
+          break;
+        }
+        if (StringMatch(pattern.data(), pattern.size(), iter->field.data(), iter->field.size(), 0) != 0) {
+          field_values->push_back(*iter);
+        }
+        remain--;
+      }
+      if (iter != fvs.end() && (end_no_limit || iter->field.compare(field_end) <= 0)) {
+        *next_field = iter->field;
+      }
     } else {
       uint64_t version = parsed_hashes_meta_value.Version();
-      HashesDataKey hashes_data_prefix(key, version, Slice());
-      HashesDataKey hashes_start_data_key(key, version, field_start);
+      HashesDataKey hashes_data_prefix(key, version, Slice(), data_format_);
+      HashesDataKey hashes_start_data_key(key, version, field_start, data_format_);
       std::string prefix = hashes_data_prefix.EncodeSeekKey().ToString();
       KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->Seek(start_no_limit ? prefix : hashes_start_data_key.Encode());
            iter->Valid() && remain > 0 && iter->key().starts_with(prefix); iter->Next()) {
@@ -1118,14 +1425,45 @@ Status Redis::PKHRScanRange(const Slice& key, const Slice& field_start, const st
     ParsedHashesMetaValue parsed_hashes_meta_value(&meta_value);
     if (parsed_hashes_meta_value.IsStale() || parsed_hashes_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_hashes_meta_value.IsInline()) {
+      HashesInlineFields inline_fields;
+      s = DecodeInlineFields(&parsed_hashes_meta_value, &inline_fields);
+      if (!s.ok()) {
+        return s;
+      }
+      // walk back from the last field not greater than field_start
+      const auto& fvs = inline_fields.FieldValues();
+      auto riter = std::make_reverse_iterator(fvs.end());
+      if (!start_no_limit) {
+        auto upper = inline_fields.LowerBound(field_start);
+        if (upper != fvs.end() && Slice(upper->field) == field_start) {
+          ++upper;
+        }
+        riter = std::make_reverse_iterator(upper);
+      }
+      for (; riter != fvs.rend() && remain > 0; ++riter) {
+        if (!end_no_limit && riter->field.compare(field_end) < 0) {
+          break;
+        }
+        if (StringMatch(pattern.data(), pattern.size(), riter->field.data(), riter->field.size(), 0) != 0) {
+          field_values->push_back(*riter);
+        }
+        remain--;
+      }
+      if (riter != fvs.rend() && (end_no_limit || riter->field.compare(field_end) >= 0)) {
+        *next_field = riter->field;
+      }
     } else {
       uint64_t version = parsed_hashes_meta_value.Version();
       uint64_t start_key_version = start_no_limit ? version + 1 : version;
       std::string start_key_field = start_no_limit ? "" : field_start.ToString();
-      HashesDataKey hashes_data_prefix(key, version, Slice());
-      HashesDataKey hashes_start_data_key(key, start_key_version, start_key_field);
+      HashesDataKey hashes_data_prefix(key, version, Slice(), data_format_);
+      HashesDataKey hashes_start_data_key(key, start_key_version, start_key_field, data_format_);
       std::string prefix = hashes_data_prefix.EncodeSeekKey().ToString();
       KeyStatisticsDurationGuard guard(this, DataType::kHashes, key.ToString());
+      // the seek target may carry version + 1, which lies outside the prefix
+      // of this hash, so prefix bloom must not be used for this iterator
+      read_options.total_order_seek = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kHashesDataCF]);
       for (iter->SeekForPrev(hashes_start_data_key.Encode().ToString());
            iter->Valid() && remain > 0 && iter->key().starts_with(prefix); iter->Prev()) {
@@ -1224,8 +1562,13 @@ Status Redis::HashesDel(const Slice& key, std::string&& prefetch_meta) {
       return Status::NotFound();
     } else {
       uint32_t statistic = parsed_hashes_meta_value.Count();
+      uint64_t dropped_version = parsed_hashes_meta_value.Version();
       parsed_hashes_meta_value.InitialMetaValue();
       s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      if (s.ok()) {
+        AddDroppedVersion(key, dropped_version);
+        AddReclaimRangeTaskIfNeeded(DataType::kHashes, key, dropped_version, statistic);
+      }
       UpdateSpecificKeyStatistics(DataType::kHashes, key.ToString(), statistic);
     }
   }
@@ -1360,6 +1703,7 @@ void Redis::ScanHashes() {
   ScopeSnapshot ss(db_, &snapshot);
   iterator_options.snapshot = snapshot;
   iterator_options.fill_cache = false;
+  iterator_options.total_order_seek = true;
   auto current_time = static_cast<int32_t>(time(nullptr));
 
   LOG(INFO) << "***************" << "rocksdb instance: " << index_ << " Hashes Meta Data***************";
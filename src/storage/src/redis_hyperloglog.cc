@@ -11,6 +11,8 @@
 
 #include "src/storage_murmur3.h"
 #include "storage/storage_define.h"
+#include "src/bitmap_kernels.h"
+#include "src/coding.h"
 #include "src/redis.h"
 #include "src/mutex.h"
 #include "src/redis_hyperloglog.h"
@@ -20,41 +22,222 @@ namespace storage {
 
 const int32_t HLL_HASH_SEED = 313;
 
-HyperLogLog::HyperLogLog(uint8_t precision, std::string origin_register) {
+namespace {
+
+const char kHllMagic[] = "HYLL";
+constexpr char kHllDense = 0;
+constexpr char kHllSparse = 1;
+constexpr size_t kHllCardOffset = 8;
+constexpr uint8_t kHllCardStale = 0x80;
+
+// The sparse opcodes of redis
+// ZERO:  00xxxxxx, xxxxxx + 1 empty registers, up to 64
+// XZERO: 01xxxxxx yyyyyyyy, xxxxxxyyyyyyyy + 1 empty registers, up to 16384
+// VAL:   1vvvvvxx, xx + 1 registers of value vvvvv + 1, up to 4 of up to 32
+constexpr uint32_t kHllZeroMaxLen = 64;
+constexpr uint32_t kHllXZeroMaxLen = 16384;
+constexpr uint32_t kHllValMaxLen = 4;
+constexpr uint8_t kHllValMaxValue = 32;
+
+}  // namespace
+
+HyperLogLog::HyperLogLog(uint8_t precision) {
   b_ = precision;
   m_ = 1 << precision;
   alpha_ = Alpha();
-  register_ = std::make_unique<char[]>(m_);
-  for (uint32_t i = 0; i < m_; ++i) {
-    register_[i] = 0;
+}
+
+HyperLogLog::~HyperLogLog() = default;
+
+bool HyperLogLog::Decode(const rocksdb::Slice& value) {
+  sparse_ = true;
+  entries_.clear();
+  registers_.clear();
+  card_valid_ = false;
+  if (value.empty()) {
+    return true;
   }
-  if (!origin_register.empty()) {
-    for (uint32_t i = 0; i < m_; ++i) {
-      register_[i] = origin_register[i];
+  if (value.size() == m_ && !value.starts_with(rocksdb::Slice(kHllMagic, 4))) {
+    // a value written before the header, sparse again while it is small
+    for (uint32_t idx = 0; idx < m_; ++idx) {
+      if (value[idx] != 0) {
+        entries_.emplace_back(idx, static_cast<uint8_t>(value[idx]));
+      }
+      if (entries_.size() > kHllSparseMaxBytes) {
+        entries_.clear();
+        registers_.assign(value.data(), value.size());
+        sparse_ = false;
+        break;
+      }
     }
+    return true;
+  }
+  if (value.size() < kHllHeaderLength || !value.starts_with(rocksdb::Slice(kHllMagic, 4))) {
+    return false;
+  }
+  const char* card = value.data() + kHllCardOffset;
+  if ((static_cast<uint8_t>(card[7]) & kHllCardStale) == 0) {
+    card_valid_ = true;
+    card_ = static_cast<int64_t>(DecodeFixed64(card));
+  }
+  rocksdb::Slice body(value.data() + kHllHeaderLength, value.size() - kHllHeaderLength);
+  if (value[4] == kHllSparse) {
+    return DecodeSparse(body);
   }
+  if (value[4] != kHllDense || body.size() != m_) {
+    return false;
+  }
+  registers_.assign(body.data(), body.size());
+  sparse_ = false;
+  return true;
 }
 
-HyperLogLog::~HyperLogLog() = default;
+bool HyperLogLog::DecodeSparse(const rocksdb::Slice& opcodes) {
+  uint32_t index = 0;
+  size_t pos = 0;
+  while (pos < opcodes.size()) {
+    auto opcode = static_cast<uint8_t>(opcodes[pos++]);
+    uint32_t len = 0;
+    if ((opcode & 0x80) != 0) {
+      auto value = static_cast<uint8_t>(((opcode >> 2) & 0x1f) + 1);
+      len = (opcode & 0x3) + 1;
+      if (index + len > m_) {
+        return false;
+      }
+      for (uint32_t idx = 0; idx < len; ++idx) {
+        entries_.emplace_back(index + idx, value);
+      }
+    } else if ((opcode & 0x40) != 0) {
+      if (pos == opcodes.size()) {
+        return false;
+      }
+      len = (((opcode & 0x3f) << 8) | static_cast<uint8_t>(opcodes[pos++])) + 1;
+    } else {
+      len = (opcode & 0x3f) + 1;
+    }
+    index += len;
+  }
+  return index == m_;
+}
+
+std::string HyperLogLog::Encode() {
+  std::string value(kHllHeaderLength, '\0');
+  memcpy(value.data(), kHllMagic, 4);
+  if (card_valid_) {
+    EncodeFixed64(value.data() + kHllCardOffset, static_cast<uint64_t>(card_));
+  } else {
+    value[kHllCardOffset + 7] = static_cast<char>(kHllCardStale);
+  }
+  if (sparse_) {
+    value[4] = kHllSparse;
+    if (EncodeSparse(&value) && value.size() <= kHllHeaderLength + kHllSparseMaxBytes) {
+      return value;
+    }
+    // it stays dense from now on
+    ToDense();
+    value.resize(kHllHeaderLength);
+  }
+  value[4] = kHllDense;
+  value.append(registers_);
+  return value;
+}
+
+bool HyperLogLog::EncodeSparse(std::string* value) const {
+  uint32_t index = 0;
+  size_t entry = 0;
+  while (index < m_) {
+    if (entry < entries_.size() && entries_[entry].first == index) {
+      uint8_t register_value = entries_[entry].second;
+      if (register_value > kHllValMaxValue) {
+        return false;
+      }
+      uint32_t len = 1;
+      while (len < kHllValMaxLen && entry + len < entries_.size() && entries_[entry + len].first == index + len &&
+             entries_[entry + len].second == register_value) {
+        ++len;
+      }
+      value->push_back(static_cast<char>(0x80 | ((register_value - 1) << 2) | (len - 1)));
+      index += len;
+      entry += len;
+      continue;
+    }
+    uint32_t zeros = (entry < entries_.size() ? entries_[entry].first : m_) - index;
+    while (zeros > 0) {
+      uint32_t len = std::min(zeros, kHllXZeroMaxLen);
+      if (len > kHllZeroMaxLen) {
+        value->push_back(static_cast<char>(0x40 | ((len - 1) >> 8)));
+        value->push_back(static_cast<char>((len - 1) & 0xff));
+      } else {
+        value->push_back(static_cast<char>(len - 1));
+      }
+      zeros -= len;
+      index += len;
+    }
+  }
+  return true;
+}
+
+void HyperLogLog::ToDense() {
+  if (!sparse_) {
+    return;
+  }
+  registers_.assign(m_, '\0');
+  for (const auto& entry : entries_) {
+    registers_[entry.first] = static_cast<char>(entry.second);
+  }
+  entries_.clear();
+  entries_.shrink_to_fit();
+  sparse_ = false;
+}
 
-std::string HyperLogLog::Add(const char* value, uint32_t len) {
+bool HyperLogLog::Add(const char* value, uint32_t len) {
   uint32_t hash_value;
   MurmurHash3_x86_32(value, static_cast<int32_t>(len), HLL_HASH_SEED, static_cast<void*>(&hash_value));
   uint32_t index = hash_value & ((1 << b_) - 1);
   uint8_t rank = Nctz((hash_value >> b_), static_cast<int32_t>(32 - b_));
-  if (rank > register_[index]) { register_[index] = static_cast<char>(rank);
-}
-  std::string result(m_, 0);
-  for (uint32_t i = 0; i < m_; ++i) {
-    result[i] = register_[i];
+  if (!sparse_) {
+    if (rank <= static_cast<uint8_t>(registers_[index])) {
+      return false;
+    }
+    registers_[index] = static_cast<char>(rank);
+  } else {
+    auto iter = std::lower_bound(entries_.begin(), entries_.end(), std::make_pair(index, static_cast<uint8_t>(0)));
+    if (iter != entries_.end() && iter->first == index) {
+      if (rank <= iter->second) {
+        return false;
+      }
+      iter->second = rank;
+    } else {
+      entries_.emplace(iter, index, rank);
+    }
   }
-  return result;
+  card_valid_ = false;
+  return true;
 }
 
+// Sums 2^-register by register value, the same sum as over the registers
+// but with one power per value instead of one per register
 double HyperLogLog::Estimate() const {
-  double estimate = FirstEstimate();
+  uint32_t histogram[64] = {0};
+  if (sparse_) {
+    histogram[0] = m_ - static_cast<uint32_t>(entries_.size());
+    for (const auto& entry : entries_) {
+      histogram[entry.second & 0x3f]++;
+    }
+  } else {
+    for (char value : registers_) {
+      histogram[static_cast<uint8_t>(value) & 0x3f]++;
+    }
+  }
+  double sum = 0.0;
+  for (int value = 0; value < 64; ++value) {
+    if (histogram[value] != 0) {
+      sum += histogram[value] * ldexp(1.0, -value);
+    }
+  }
+  double estimate = alpha_ * m_ * m_ / sum;
   if (estimate <= 2.5 * m_) {
-    uint32_t zeros = CountZero();
+    uint32_t zeros = histogram[0];
     if (zeros != 0) {
       estimate = m_ * log(static_cast<double>(m_) / zeros);
     }
@@ -64,17 +247,6 @@ double HyperLogLog::Estimate() const {
   return estimate;
 }
 
-double HyperLogLog::FirstEstimate() const {
-  double estimate;
-  double sum = 0.0;
-  for (uint32_t i = 0; i < m_; i++) {
-    sum += 1.0 / (1 << register_[i]);
-  }
-
-  estimate = alpha_ * m_ * m_ / sum;
-  return estimate;
-}
-
 double HyperLogLog::Alpha() const {
   switch (m_) {
     case 16:
@@ -88,31 +260,53 @@ double HyperLogLog::Alpha() const {
   }
 }
 
-uint32_t HyperLogLog::CountZero() const {
-  uint32_t count = 0;
-  for (uint32_t i = 0; i < m_; i++) {
-    if (register_[i] == 0) {
-      count++;
-    }
-  }
-  return count;
-}
-
-std::string HyperLogLog::Merge(const HyperLogLog& hll) {
+void HyperLogLog::Merge(const HyperLogLog& hll) {
   if (m_ != hll.m_) {
     // TODO(shq) the number of registers doesn't match
+    return;
+  }
+  card_valid_ = false;
+  if (sparse_ && hll.sparse_) {
+    std::vector<std::pair<uint32_t, uint8_t>> merged;
+    merged.reserve(entries_.size() + hll.entries_.size());
+    auto left = entries_.begin();
+    auto right = hll.entries_.begin();
+    while (left != entries_.end() || right != hll.entries_.end()) {
+      if (right == hll.entries_.end() || (left != entries_.end() && left->first < right->first)) {
+        merged.push_back(*left++);
+      } else if (left == entries_.end() || right->first < left->first) {
+        merged.push_back(*right++);
+      } else {
+        merged.emplace_back(left->first, std::max(left->second, right->second));
+        ++left;
+        ++right;
+      }
+    }
+    entries_ = std::move(merged);
+    return;
   }
-  for (uint32_t r = 0; r < m_; r++) {
-    if (register_[r] < hll.register_[r]) {
-      register_[r] = static_cast<char>(register_[r] | hll.register_[r]);
+  ToDense();
+  if (hll.sparse_) {
+    for (const auto& entry : hll.entries_) {
+      auto& value = registers_[entry.first];
+      value = static_cast<char>(std::max(static_cast<uint8_t>(value), entry.second));
     }
+  } else {
+    MaxBytes(reinterpret_cast<unsigned char*>(registers_.data()),
+             reinterpret_cast<const unsigned char*>(hll.registers_.data()), m_);
   }
+}
 
-  std::string result(m_, 0);
-  for (uint32_t i = 0; i < m_; ++i) {
-    result[i] = register_[i];
+bool HyperLogLog::CachedCardinality(int64_t* card) const {
+  if (card_valid_) {
+    *card = card_;
   }
-  return result;
+  return card_valid_;
+}
+
+void HyperLogLog::SetCachedCardinality(int64_t card) {
+  card_ = card;
+  card_valid_ = true;
 }
 
 // ::__builtin_ctz(x): return the first number of '0' after the first '1' from the right
@@ -170,4 +364,4 @@ Status Redis::HyperloglogSet(const Slice &key, const Slice &value) {
     return db_->Put(default_write_options_, base_key.Encode(), hyperloglog_value.Encode());
 }
 
-}  // namespace storage
\ No newline at end of file
+}  // namespace storage
@@ -10,28 +10,65 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include "rocksdb/slice.h"
 
 namespace storage {
 
+/*
+ * The value of a hyperloglog, laid out like the one of redis:
+ * | magic "HYLL" | encoding | unused | cardinality | registers |
+ * |      4B      |    1B    |   3B   |     8B      |           |
+ * The dense encoding keeps one byte per register. The sparse one keeps
+ * the ZERO, XZERO and VAL opcodes of redis, runs of empty registers and of
+ * registers of the same value, until it would outgrow kHllSparseMaxBytes.
+ * cardinality is counted by the PFADD or PFMERGE that wrote the value, the
+ * msb of its last byte set means the value carries no count.
+ *
+ * A value of exactly one byte per register without the header is the
+ * dense value written before the header existed.
+ */
+constexpr size_t kHllHeaderLength = 16;
+constexpr size_t kHllSparseMaxBytes = 3000;
+
 class HyperLogLog {
  public:
-  HyperLogLog(uint8_t precision, std::string origin_register);
+  explicit HyperLogLog(uint8_t precision);
   ~HyperLogLog();
 
+  // an empty value is an empty hyperloglog
+  bool Decode(const rocksdb::Slice& value);
+  std::string Encode();
+
   double Estimate() const;
-  double FirstEstimate() const;
-  uint32_t CountZero() const;
   double Alpha() const;
   uint8_t Nctz(uint32_t x, int b);
 
-  std::string Add(const char* value, uint32_t len);
-  std::string Merge(const HyperLogLog& hll);
+  // true when a register changed
+  bool Add(const char* value, uint32_t len);
+  void Merge(const HyperLogLog& hll);
+
+  bool CachedCardinality(int64_t* card) const;
+  void SetCachedCardinality(int64_t card);
+  bool IsSparse() const { return sparse_; }
 
  protected:
-  uint32_t m_ = 0;  // register bit width
-  uint32_t b_ = 0;  // regieter size
+  bool DecodeSparse(const rocksdb::Slice& opcodes);
+  // false when a register does not fit a VAL opcode
+  bool EncodeSparse(std::string* value) const;
+  void ToDense();
+
+  uint32_t m_ = 0;  // register size
+  uint32_t b_ = 0;  // register bit width
   double alpha_ = 0;
-  std::unique_ptr<char[]> register_;
+  bool sparse_ = true;
+  // the non empty registers by index while sparse
+  std::vector<std::pair<uint32_t, uint8_t>> entries_;
+  std::string registers_;
+  bool card_valid_ = false;
+  int64_t card_ = 0;
 };
 
 }  // namespace storage
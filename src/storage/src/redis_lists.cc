@@ -10,6 +10,7 @@
 
 #include "pstd/include/pika_codis_slot.h"
 #include "src/base_data_value_format.h"
+#include "src/lists_chunk.h"
 #include "src/lists_filter.h"
 #include "src/redis.h"
 #include "src/scope_record_lock.h"
@@ -18,6 +19,38 @@
 #include "src/debug.h"
 
 namespace storage {
+// Position of index in a list of count elements
+static bool ListPosition(int64_t index, uint64_t count, uint64_t* pos) {
+  if (index >= 0 ? static_cast<uint64_t>(index) >= count : static_cast<uint64_t>(-index) > count) {
+    return false;
+  }
+  *pos = index >= 0 ? index : count + index;
+  return true;
+}
+
+// Positions of [start, stop] in a list of count elements, false if empty
+static bool ListRange(int64_t start, int64_t stop, uint64_t count, uint64_t* first, uint64_t* last) {
+  auto size = static_cast<int64_t>(count);
+  int64_t first_pos = start >= 0 ? start : size + start;
+  int64_t last_pos = stop >= 0 ? stop : size + stop;
+  if (first_pos > last_pos || first_pos >= size || last_pos < 0) {
+    return false;
+  }
+  *first = first_pos < 0 ? 0 : first_pos;
+  *last = last_pos >= size ? size - 1 : last_pos;
+  return true;
+}
+
+// Meta value of a new, empty chunked list
+static std::string NewChunkedListsMetaValue() {
+  char str[8];
+  EncodeFixed64(str, 0);
+  ListsMetaValue lists_meta_value(Slice(str, sizeof(uint64_t)));
+  lists_meta_value.SetChunked(true);
+  lists_meta_value.UpdateVersion();
+  return lists_meta_value.Encode().ToString();
+}
+
 Status Redis::ScanListsKeyNum(KeyInfo* key_info) {
   uint64_t keys = 0;
   uint64_t expires = 0;
@@ -32,7 +65,7 @@ Status Redis::ScanListsKeyNum(KeyInfo* key_info) {
 
   pstd::TimeType curtime = pstd::NowMillis();
 
-  rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[kMetaCF]);
+  rocksdb::Iterator* iter = NewTypeIndexIterator(iterator_options, DataType::kLists);
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
     if (!ExpectedMetaValue(DataType::kLists, iter->value().ToString())) {
       continue;
@@ -84,6 +117,13 @@ Status Redis::LIndex(const Slice& key, int64_t index, std::string* element) {
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      uint64_t pos = 0;
+      if (!ListPosition(index, parsed_lists_meta_value.Count(), &pos)) {
+        return Status::NotFound();
+      }
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      return chunked_list.Index(read_options, pos, element);
     } else {
       uint64_t target_index =
           index >= 0 ? parsed_lists_meta_value.LeftIndex() + index + 1 : parsed_lists_meta_value.RightIndex() + index;
@@ -127,6 +167,18 @@ Status Redis::LInsert(const Slice& key, const BeforeOrAfter& before_or_after, co
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Insert(before_or_after, pivot, value, &batch);
+      if (s.IsNotFound()) {
+        *ret = -1;
+        return s;
+      } else if (!s.ok()) {
+        return s;
+      }
+      batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      *ret = static_cast<int32_t>(parsed_lists_meta_value.Count());
+      return db_->Write(default_write_options_, &batch);
     } else {
       bool find_pivot = false;
       uint64_t pivot_index = 0;
@@ -278,6 +330,14 @@ Status Redis::LPop(const Slice& key, int64_t count, std::vector<std::string>* el
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Pop(count, true, elements, &batch);
+      if (!s.ok()) {
+        return s;
+      }
+      statistic += elements->size();
+      batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
     } else {
       auto size = static_cast<int64_t>(parsed_lists_meta_value.Count());
       uint64_t version = parsed_lists_meta_value.Version();
@@ -334,16 +394,35 @@ Status Redis::LPush(const Slice& key, const std::vector<std::string>& values, ui
     ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
     if (parsed_lists_meta_value.IsStale() || parsed_lists_meta_value.Count() == 0) {
       version = parsed_lists_meta_value.InitialMetaValue();
+      parsed_lists_meta_value.SetChunked(list_chunk_size_ > 0);
     } else {
       version = parsed_lists_meta_value.Version();
     }
-    for (const auto& value : values) {
-      index = parsed_lists_meta_value.LeftIndex();
-      parsed_lists_meta_value.ModifyLeftIndex(1);
-      parsed_lists_meta_value.ModifyCount(1);
-      ListsDataKey lists_data_key(key, version, index);
-      BaseDataValue i_val(value);
-      batch.Put(handles_[kListsDataCF], lists_data_key.Encode(), i_val.Encode());
+    if (parsed_lists_meta_value.IsChunked()) {
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Push(values, true, &batch);
+      if (!s.ok()) {
+        return s;
+      }
+    } else {
+      for (const auto& value : values) {
+        index = parsed_lists_meta_value.LeftIndex();
+        parsed_lists_meta_value.ModifyLeftIndex(1);
+        parsed_lists_meta_value.ModifyCount(1);
+        ListsDataKey lists_data_key(key, version, index);
+        BaseDataValue i_val(value);
+        batch.Put(handles_[kListsDataCF], lists_data_key.Encode(), i_val.Encode());
+      }
+    }
+    batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+    *ret = parsed_lists_meta_value.Count();
+  } else if (s.IsNotFound() && list_chunk_size_ > 0) {
+    meta_value = NewChunkedListsMetaValue();
+    ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+    ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+    s = chunked_list.Push(values, true, &batch);
+    if (!s.ok()) {
+      return s;
     }
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
     *ret = parsed_lists_meta_value.Count();
@@ -392,6 +471,15 @@ Status Redis::LPushx(const Slice& key, const std::vector<std::string>& values, u
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Push(values, true, &batch);
+      if (!s.ok()) {
+        return s;
+      }
+      batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      *len = parsed_lists_meta_value.Count();
+      return db_->Write(default_write_options_, &batch);
     } else {
       uint64_t version = parsed_lists_meta_value.Version();
       for (const auto& value : values) {
@@ -436,6 +524,14 @@ Status Redis::LRange(const Slice& key, int64_t start, int64_t stop, std::vector<
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      uint64_t first = 0;
+      uint64_t last = 0;
+      if (!ListRange(start, stop, parsed_lists_meta_value.Count(), &first, &last)) {
+        return Status::OK();
+      }
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      return chunked_list.Range(read_options, first, last, ret);
     } else {
       uint64_t version = parsed_lists_meta_value.Version();
       uint64_t origin_left_index = parsed_lists_meta_value.LeftIndex() + 1;
@@ -506,6 +602,16 @@ Status Redis::LRangeWithTTL(const Slice& key, int64_t start, int64_t stop, std::
         *ttl_millsec = *ttl_millsec - curtime >= 0 ? *ttl_millsec - curtime : -2;
       }
 
+      if (parsed_lists_meta_value.IsChunked()) {
+        uint64_t first = 0;
+        uint64_t last = 0;
+        if (!ListRange(start, stop, parsed_lists_meta_value.Count(), &first, &last)) {
+          return Status::OK();
+        }
+        ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+        return chunked_list.Range(read_options, first, last, ret);
+      }
+
       uint64_t version = parsed_lists_meta_value.Version();
       uint64_t origin_left_index = parsed_lists_meta_value.LeftIndex() + 1;
       uint64_t origin_right_index = parsed_lists_meta_value.RightIndex() - 1;
@@ -565,6 +671,20 @@ Status Redis::LRem(const Slice& key, int64_t count, const Slice& value, uint64_t
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      uint64_t removed = 0;
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Rem(count, value, &removed, &batch);
+      if (!s.ok()) {
+        return s;
+      }
+      if (removed == 0) {
+        *ret = 0;
+        return Status::NotFound();
+      }
+      batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      *ret = removed;
+      return db_->Write(default_write_options_, &batch);
     } else {
       uint64_t current_index;
       std::vector<uint64_t> target_index;
@@ -697,6 +817,21 @@ Status Redis::LSet(const Slice& key, int64_t index, const Slice& value) {
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      uint64_t pos = 0;
+      if (!ListPosition(index, parsed_lists_meta_value.Count(), &pos)) {
+        return Status::Corruption("index out of range");
+      }
+      rocksdb::WriteBatch batch;
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Set(pos, value, &batch);
+      if (!s.ok()) {
+        return s;
+      }
+      s = db_->Write(default_write_options_, &batch);
+      statistic++;
+      UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
+      return s;
     } else {
       uint64_t version = parsed_lists_meta_value.Version();
       uint64_t target_index =
@@ -742,6 +877,20 @@ Status Redis::LTrim(const Slice& key, int64_t start, int64_t stop) {
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      uint64_t first = 0;
+      uint64_t last = 0;
+      if (!ListRange(start, stop, parsed_lists_meta_value.Count(), &first, &last)) {
+        parsed_lists_meta_value.InitialMetaValue();
+      } else {
+        statistic += parsed_lists_meta_value.Count() - (last - first + 1);
+        ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+        s = chunked_list.Trim(first, last, &batch);
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
     } else {
       uint64_t origin_left_index = parsed_lists_meta_value.LeftIndex() + 1;
       uint64_t origin_right_index = parsed_lists_meta_value.RightIndex() - 1;
@@ -814,6 +963,14 @@ Status Redis::RPop(const Slice& key, int64_t count, std::vector<std::string>* el
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Pop(count, false, elements, &batch);
+      if (!s.ok()) {
+        return s;
+      }
+      statistic += elements->size();
+      batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
     } else {
       auto size = static_cast<int64_t>(parsed_lists_meta_value.Count());
       uint64_t version = parsed_lists_meta_value.Version();
@@ -871,6 +1028,17 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
         return Status::NotFound("Stale");
       } else if (parsed_lists_meta_value.Count() == 0) {
         return Status::NotFound();
+      } else if (parsed_lists_meta_value.IsChunked()) {
+        ChunkedList chunked_list(db_, handles_[kListsDataCF], source, &parsed_lists_meta_value, list_chunk_size_);
+        s = chunked_list.Rotate(element, &batch);
+        if (!s.ok() || parsed_lists_meta_value.Count() == 1) {
+          return s;
+        }
+        statistic++;
+        batch.Put(handles_[kMetaCF], base_source.Encode(), meta_value);
+        s = db_->Write(default_write_options_, &batch);
+        UpdateSpecificKeyStatistics(DataType::kLists, source.ToString(), statistic);
+        return s;
       } else {
         std::string target;
         uint64_t version = parsed_lists_meta_value.Version();
@@ -926,12 +1094,26 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      std::vector<std::string> elements;
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], source, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Pop(1, false, &elements, &batch);
+      if (!s.ok()) {
+        return s;
+      } else if (elements.empty()) {
+        return Status::Corruption("list chunks out of sync with meta");
+      }
+      target = elements[0];
+      statistic++;
+      batch.Put(handles_[kMetaCF], base_source.Encode(), source_meta_value);
     } else {
       version = parsed_lists_meta_value.Version();
       uint64_t last_node_index = parsed_lists_meta_value.RightIndex() - 1;
       ListsDataKey lists_data_key(source, version, last_node_index);
       s = db_->Get(default_read_options_, handles_[kListsDataCF], lists_data_key.Encode(), &target);
       if (s.ok()) {
+        ParsedBaseDataValue parsed_value(&target);
+        parsed_value.StripSuffix();
         batch.Delete(handles_[kListsDataCF], lists_data_key.Encode());
         statistic++;
         parsed_lists_meta_value.ModifyCount(-1);
@@ -962,14 +1144,33 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
     ParsedListsMetaValue parsed_lists_meta_value(&destination_meta_value);
     if (parsed_lists_meta_value.IsStale() || parsed_lists_meta_value.Count() == 0) {
       version = parsed_lists_meta_value.InitialMetaValue();
+      parsed_lists_meta_value.SetChunked(list_chunk_size_ > 0);
     } else {
       version = parsed_lists_meta_value.Version();
     }
-    uint64_t target_index = parsed_lists_meta_value.LeftIndex();
-    ListsDataKey lists_data_key(destination, version, target_index);
-    batch.Put(handles_[kListsDataCF], lists_data_key.Encode(), target);
-    parsed_lists_meta_value.ModifyCount(1);
-    parsed_lists_meta_value.ModifyLeftIndex(1);
+    if (parsed_lists_meta_value.IsChunked()) {
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], destination, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Push({target}, true, &batch);
+      if (!s.ok()) {
+        return s;
+      }
+    } else {
+      uint64_t target_index = parsed_lists_meta_value.LeftIndex();
+      ListsDataKey lists_data_key(destination, version, target_index);
+      BaseDataValue i_val(target);
+      batch.Put(handles_[kListsDataCF], lists_data_key.Encode(), i_val.Encode());
+      parsed_lists_meta_value.ModifyCount(1);
+      parsed_lists_meta_value.ModifyLeftIndex(1);
+    }
+    batch.Put(handles_[kMetaCF], base_destination.Encode(), destination_meta_value);
+  } else if (s.IsNotFound() && list_chunk_size_ > 0) {
+    destination_meta_value = NewChunkedListsMetaValue();
+    ParsedListsMetaValue parsed_lists_meta_value(&destination_meta_value);
+    ChunkedList chunked_list(db_, handles_[kListsDataCF], destination, &parsed_lists_meta_value, list_chunk_size_);
+    s = chunked_list.Push({target}, true, &batch);
+    if (!s.ok()) {
+      return s;
+    }
     batch.Put(handles_[kMetaCF], base_destination.Encode(), destination_meta_value);
   } else if (s.IsNotFound()) {
     char str[8];
@@ -978,7 +1179,8 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
     version = lists_meta_value.UpdateVersion();
     uint64_t target_index = lists_meta_value.LeftIndex();
     ListsDataKey lists_data_key(destination, version, target_index);
-    batch.Put(handles_[kListsDataCF], lists_data_key.Encode(), target);
+    BaseDataValue i_val(target);
+    batch.Put(handles_[kListsDataCF], lists_data_key.Encode(), i_val.Encode());
     lists_meta_value.ModifyLeftIndex(1);
     batch.Put(handles_[kMetaCF], base_destination.Encode(), lists_meta_value.Encode());
   } else {
@@ -988,8 +1190,6 @@ Status Redis::RPoplpush(const Slice& source, const Slice& destination, std::stri
   s = db_->Write(default_write_options_, &batch);
   UpdateSpecificKeyStatistics(DataType::kLists, source.ToString(), statistic);
   if (s.ok()) {
-    ParsedBaseDataValue parsed_value(&target);
-    parsed_value.StripSuffix();
     *element = target;
   }
   return s;
@@ -1019,16 +1219,35 @@ Status Redis::RPush(const Slice& key, const std::vector<std::string>& values, ui
     ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
     if (parsed_lists_meta_value.IsStale() || parsed_lists_meta_value.Count() == 0) {
       version = parsed_lists_meta_value.InitialMetaValue();
+      parsed_lists_meta_value.SetChunked(list_chunk_size_ > 0);
     } else {
       version = parsed_lists_meta_value.Version();
     }
-    for (const auto& value : values) {
-      index = parsed_lists_meta_value.RightIndex();
-      parsed_lists_meta_value.ModifyRightIndex(1);
-      parsed_lists_meta_value.ModifyCount(1);
-      ListsDataKey lists_data_key(key, version, index);
-      BaseDataValue i_val(value);
-      batch.Put(handles_[kListsDataCF], lists_data_key.Encode(), i_val.Encode());
+    if (parsed_lists_meta_value.IsChunked()) {
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Push(values, false, &batch);
+      if (!s.ok()) {
+        return s;
+      }
+    } else {
+      for (const auto& value : values) {
+        index = parsed_lists_meta_value.RightIndex();
+        parsed_lists_meta_value.ModifyRightIndex(1);
+        parsed_lists_meta_value.ModifyCount(1);
+        ListsDataKey lists_data_key(key, version, index);
+        BaseDataValue i_val(value);
+        batch.Put(handles_[kListsDataCF], lists_data_key.Encode(), i_val.Encode());
+      }
+    }
+    batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+    *ret = parsed_lists_meta_value.Count();
+  } else if (s.IsNotFound() && list_chunk_size_ > 0) {
+    meta_value = NewChunkedListsMetaValue();
+    ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+    ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+    s = chunked_list.Push(values, false, &batch);
+    if (!s.ok()) {
+      return s;
     }
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
     *ret = parsed_lists_meta_value.Count();
@@ -1077,6 +1296,15 @@ Status Redis::RPushx(const Slice& key, const std::vector<std::string>& values, u
       return Status::NotFound("Stale");
     } else if (parsed_lists_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_lists_meta_value.IsChunked()) {
+      ChunkedList chunked_list(db_, handles_[kListsDataCF], key, &parsed_lists_meta_value, list_chunk_size_);
+      s = chunked_list.Push(values, false, &batch);
+      if (!s.ok()) {
+        return s;
+      }
+      batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      *len = parsed_lists_meta_value.Count();
+      return db_->Write(default_write_options_, &batch);
     } else {
       uint64_t version = parsed_lists_meta_value.Version();
       for (const auto& value : values) {
@@ -1164,8 +1392,12 @@ Status Redis::ListsDel(const Slice& key, std::string&& prefetch_meta) {
       return Status::NotFound();
     } else {
       uint64_t statistic = parsed_lists_meta_value.Count();
+      uint64_t dropped_version = parsed_lists_meta_value.Version();
       parsed_lists_meta_value.InitialMetaValue();
       s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      if (s.ok()) {
+        AddDroppedVersion(key, dropped_version);
+      }
       UpdateSpecificKeyStatistics(DataType::kLists, key.ToString(), statistic);
     }
   }
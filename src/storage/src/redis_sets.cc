@@ -36,7 +36,7 @@ rocksdb::Status Redis::ScanSetsKeyNum(KeyInfo* key_info) {
 
   pstd::TimeType curtime = pstd::NowMillis();
 
-  rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[kMetaCF]);
+  rocksdb::Iterator* iter = NewTypeIndexIterator(iterator_options, DataType::kSets);
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
     if (!ExpectedMetaValue(DataType::kSets, iter->value().ToString())) {
       continue;
@@ -61,6 +61,110 @@ rocksdb::Status Redis::ScanSetsKeyNum(KeyInfo* key_info) {
   return rocksdb::Status::OK();
 }
 
+static Status DecodeInlineMembers(ParsedSetsMetaValue* parsed_sets_meta_value, SetsInlineMembers* members) {
+  if (!members->Decode(parsed_sets_meta_value->InlinePayload())) {
+    return Status::Corruption("bad inline set");
+  }
+  return Status::OK();
+}
+
+// Runs update on the members of an inline set, or of a set that does not
+// exist yet while inline sets are enabled, and puts the result into batch,
+// inline if it fits, as member keys otherwise. Returns false for a set with
+// member keys, which is left to the caller
+bool Redis::SetsUpdateInline(const Slice& key, bool meta_found, std::string* meta_value,
+                             const std::function<Status(SetsInlineMembers*)>& update, rocksdb::WriteBatch* batch,
+                             Status* s) {
+  SetsInlineMembers members;
+  std::string origin_payload;
+  bool fresh = !meta_found;
+  if (meta_found) {
+    ParsedSetsMetaValue parsed_sets_meta_value(meta_value);
+    if (parsed_sets_meta_value.IsStale() || parsed_sets_meta_value.Count() == 0) {
+      fresh = true;
+    } else if (!parsed_sets_meta_value.IsInline()) {
+      return false;
+    } else {
+      *s = DecodeInlineMembers(&parsed_sets_meta_value, &members);
+      if (!s->ok()) {
+        return true;
+      }
+      origin_payload = parsed_sets_meta_value.InlinePayload().ToString();
+    }
+  }
+  if (fresh && set_max_inline_entries_ <= 0) {
+    return false;
+  }
+  *s = update(&members);
+  if (!s->ok() || (fresh ? members.Count() == 0 : members.Encode() == origin_payload)) {
+    return true;
+  }
+
+  if (!meta_found) {
+    char meta_value_buf[4] = {0};
+    SetsMetaValue sets_meta_value(DataType::kSets, Slice(meta_value_buf, 4));
+    sets_meta_value.UpdateVersion();
+    *meta_value = sets_meta_value.Encode().ToString();
+  }
+  ParsedSetsMetaValue parsed_sets_meta_value(meta_value);
+  uint64_t version = fresh && meta_found ? parsed_sets_meta_value.InitialMetaValue()
+                                         : parsed_sets_meta_value.Version();
+  parsed_sets_meta_value.SetCount(static_cast<int32_t>(members.Count()));
+  if (members.Count() != 0 && members.Fits(set_max_inline_entries_, set_max_inline_value_)) {
+    parsed_sets_meta_value.SetInline(true);
+    parsed_sets_meta_value.SetInlinePayload(members.Encode());
+  } else {
+    // no member key carries this version yet, the members can spill under it
+    parsed_sets_meta_value.SetInline(false);
+    parsed_sets_meta_value.SetInlinePayload(Slice());
+    for (const auto& member : members.Members()) {
+      SetsMemberKey sets_member_key(key, version, member, data_format_);
+      BaseDataValue iter_value(Slice{}, data_format_);
+      batch->Put(handles_[kSetsDataCF], sets_member_key.Encode(), iter_value.Encode());
+    }
+  }
+  BaseMetaKey base_meta_key(key);
+  batch->Put(handles_[kMetaCF], base_meta_key.Encode(), *meta_value);
+  return true;
+}
+
+// Moves the members left after SRem into the meta value and deletes their
+// member keys in the same batch, at half the inline limit as for hashes
+Status Redis::SetsFoldInline(const Slice& key, const std::unordered_set<std::string>& deleted_members,
+                             ParsedSetsMetaValue* parsed_sets_meta_value, rocksdb::WriteBatch* batch) {
+  int32_t count = parsed_sets_meta_value->Count();
+  if (count == 0 || count > std::max(set_max_inline_entries_ / 2, 1) || set_max_inline_entries_ <= 0) {
+    return Status::OK();
+  }
+  SetsInlineMembers members;
+  std::vector<std::string> member_keys;
+  SetsMemberKey sets_member_key(key, parsed_sets_meta_value->Version(), Slice(), data_format_);
+  Slice prefix = sets_member_key.EncodeSeekKey();
+  rocksdb::ReadOptions fold_read_options(default_read_options_);
+  fold_read_options.prefix_same_as_start = true;
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(fold_read_options, handles_[kSetsDataCF]));
+  for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
+    ParsedSetsMemberKey parsed_sets_member_key(iter->key());
+    if (deleted_members.find(parsed_sets_member_key.member().ToString()) != deleted_members.end()) {
+      continue;
+    }
+    members.Insert(parsed_sets_member_key.member());
+    member_keys.push_back(iter->key().ToString());
+    if (!members.Fits(set_max_inline_entries_, set_max_inline_value_)) {
+      return Status::OK();
+    }
+  }
+  if (!iter->status().ok() || members.Count() != static_cast<size_t>(count)) {
+    return iter->status();
+  }
+  for (const auto& member_key : member_keys) {
+    batch->Delete(handles_[kSetsDataCF], member_key);
+  }
+  parsed_sets_meta_value->SetInline(true);
+  parsed_sets_meta_value->SetInlinePayload(members.Encode());
+  return Status::OK();
+}
+
 rocksdb::Status Redis::SAdd(const Slice& key, const std::vector<std::string>& members, int32_t* ret) {
   std::unordered_set<std::string> unique;
   std::vector<std::string> filtered_members;
@@ -88,6 +192,21 @@ rocksdb::Status Redis::SAdd(const Slice& key, const std::vector<std::string>& me
           DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     }
   }
+  if (s.ok() || s.IsNotFound()) {
+    auto add_members = [&](SetsInlineMembers* inline_members) {
+      int32_t cnt = 0;
+      for (const auto& member : filtered_members) {
+        if (inline_members->Insert(member)) {
+          cnt++;
+        }
+      }
+      *ret = cnt;
+      return Status::OK();
+    };
+    if (SetsUpdateInline(key, s.ok(), &meta_value, add_members, &batch, &s)) {
+      return s.ok() ? db_->Write(default_write_options_, &batch) : s;
+    }
+  }
   if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
     if (parsed_sets_meta_value.IsStale() || parsed_sets_meta_value.Count() == 0) {
@@ -98,8 +217,8 @@ rocksdb::Status Redis::SAdd(const Slice& key, const std::vector<std::string>& me
       parsed_sets_meta_value.SetCount(static_cast<int32_t>(filtered_members.size()));
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
       for (const auto& member : filtered_members) {
-        SetsMemberKey sets_member_key(key, version, member);
-        BaseDataValue iter_value(Slice{});
+        SetsMemberKey sets_member_key(key, version, member, data_format_);
+        BaseDataValue iter_value(Slice{}, data_format_);
         batch.Put(handles_[kSetsDataCF], sets_member_key.Encode(), iter_value.Encode());
       }
       *ret = static_cast<int32_t>(filtered_members.size());
@@ -108,12 +227,12 @@ rocksdb::Status Redis::SAdd(const Slice& key, const std::vector<std::string>& me
       std::string member_value;
       version = parsed_sets_meta_value.Version();
       for (const auto& member : filtered_members) {
-        SetsMemberKey sets_member_key(key, version, member);
+        SetsMemberKey sets_member_key(key, version, member, data_format_);
         s = db_->Get(default_read_options_, handles_[kSetsDataCF], sets_member_key.Encode(), &member_value);
         if (s.ok()) {
         } else if (s.IsNotFound()) {
           cnt++;
-          BaseDataValue iter_value(Slice{});
+          BaseDataValue iter_value(Slice{}, data_format_);
           batch.Put(handles_[kSetsDataCF], sets_member_key.Encode(), iter_value.Encode());
         } else {
           return s;
@@ -137,8 +256,8 @@ rocksdb::Status Redis::SAdd(const Slice& key, const std::vector<std::string>& me
     version = sets_meta_value.UpdateVersion();
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), sets_meta_value.Encode());
     for (const auto& member : filtered_members) {
-      SetsMemberKey sets_member_key(key, version, member);
-      BaseDataValue i_val(Slice{});
+      SetsMemberKey sets_member_key(key, version, member, data_format_);
+      BaseDataValue i_val(Slice{}, data_format_);
       batch.Put(handles_[kSetsDataCF], sets_member_key.Encode(), i_val.Encode());
     }
     *ret = static_cast<int32_t>(filtered_members.size());
@@ -181,469 +300,218 @@ rocksdb::Status Redis::SCard(const Slice& key, int32_t* ret, std::string&& meta)
   return s;
 }
 
-rocksdb::Status Redis::SDiff(const std::vector<std::string>& keys, std::vector<std::string>* members) {
-  if (keys.empty()) {
-    return rocksdb::Status::Corruption("SDiff invalid parameter, no keys");
-  }
-
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-
+rocksdb::Status Redis::NewSetsMemberCursor(const Slice& key, const rocksdb::ReadOptions& read_options,
+                                           std::unique_ptr<MemberCursor>* cursor) {
   std::string meta_value;
-  uint64_t version = 0;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  std::vector<KeyVersion> vaild_sets;
-  rocksdb::Status s;
-
-  for (uint32_t idx = 1; idx < keys.size(); ++idx) {
-    BaseMetaKey base_meta_key(keys[idx]);
-    s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
-    if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-      if (ExpectedStale(meta_value)) {
-        s = Status::NotFound();
-      } else {
-       return Status::InvalidArgument(
-          "WRONGTYPE, key: " + keys[idx] + ", expect type: " +
-          DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-          DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-      }
-    }
-    if (s.ok()) {
-      ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-      if (!parsed_sets_meta_value.IsStale() && parsed_sets_meta_value.Count() != 0) {
-        vaild_sets.push_back({keys[idx], parsed_sets_meta_value.Version()});
-      }
-    } else if (!s.IsNotFound()) {
-      return s;
-    }
-  }
-
-  BaseMetaKey base_meta_key0(keys[0]);
-  s = db_->Get(read_options, handles_[kMetaCF], base_meta_key0.Encode(), &meta_value);
+  BaseMetaKey base_meta_key(key);
+  rocksdb::Status s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
     if (ExpectedStale(meta_value)) {
       s = Status::NotFound();
     } else {
       return Status::InvalidArgument(
-        "WRONGTYPE, key: " + keys[0] + ", expect type: " +
+        "WRONGTYPE, key: " + key.ToString() + ", expect type: " +
         DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
         DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     }
   }
-  if (s.ok()) {
-    ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-    if (!parsed_sets_meta_value.IsStale() && parsed_sets_meta_value.Count() != 0) {
-      bool found;
-      Slice prefix;
-      std::string member_value;
-      version = parsed_sets_meta_value.Version();
-      SetsMemberKey sets_member_key(keys[0], version, Slice());
-      prefix = sets_member_key.EncodeSeekKey();
-      KeyStatisticsDurationGuard guard(this, DataType::kSets, keys[0]);
-      auto iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
-      for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
-        ParsedSetsMemberKey parsed_sets_member_key(iter->key());
-        Slice member = parsed_sets_member_key.member();
-
-        found = false;
-        for (const auto& key_version : vaild_sets) {
-          SetsMemberKey sets_member_key(key_version.key, key_version.version, member);
-          s = db_->Get(read_options, handles_[kSetsDataCF], sets_member_key.Encode(), &member_value);
-          if (s.ok()) {
-            found = true;
-            break;
-          } else if (!s.IsNotFound()) {
-            delete iter;
-            return s;
-          }
-        }
-        if (!found) {
-          members->push_back(member.ToString());
-        }
-      }
-      delete iter;
-    }
-  } else if (!s.IsNotFound()) {
+  if (!s.ok()) {
     return s;
   }
-  return rocksdb::Status::OK();
-}
-
-rocksdb::Status Redis::SDiffstore(const Slice& destination, const std::vector<std::string>& keys, std::vector<std::string>& value_to_dest, int32_t* ret) {
-  if (keys.empty()) {
-    return rocksdb::Status::Corruption("SDiffsotre invalid parameter, no keys");
+  ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
+  if (parsed_sets_meta_value.IsStale() || parsed_sets_meta_value.Count() == 0) {
+    return rocksdb::Status::NotFound();
   }
-
-  rocksdb::WriteBatch batch;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-
-  std::string meta_value;
-  uint64_t version = 0;
-  ScopeRecordLock l(lock_mgr_, destination);
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  std::vector<KeyVersion> vaild_sets;
-  rocksdb::Status s;
-
-  for (uint32_t idx = 1; idx < keys.size(); ++idx) {
-    BaseMetaKey base_meta_key(keys[idx]);
-    s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
-    if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-      if (ExpectedStale(meta_value)) {
-        s = Status::NotFound();
-      } else {
-        return Status::InvalidArgument(
-          "WRONGTYPE, key: " + keys[idx] + ", expect type: " +
-          DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-          DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-      }
-    }
+  if (parsed_sets_meta_value.IsInline()) {
+    SetsInlineMembers inline_members;
+    s = DecodeInlineMembers(&parsed_sets_meta_value, &inline_members);
     if (s.ok()) {
-      ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-      if (!parsed_sets_meta_value.IsStale() && parsed_sets_meta_value.Count() != 0) {
-        vaild_sets.push_back({keys[idx], parsed_sets_meta_value.Version()});
-      }
-    } else if (!s.IsNotFound()) {
-      return s;
+      *cursor = std::make_unique<MemberCursor>(inline_members.Members());
     }
+    return s;
   }
+  *cursor = std::make_unique<MemberCursor>(db_, handles_[kSetsDataCF], read_options, key,
+                                               parsed_sets_meta_value.Version(), parsed_sets_meta_value.Count(),
+                                               data_format_);
+  return rocksdb::Status::OK();
+}
 
-  std::vector<std::string> members;
-  BaseMetaKey base_meta_key0(keys[0]);
-  s = db_->Get(read_options, handles_[kMetaCF], base_meta_key0.Encode(), &meta_value);
-  if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-    if (ExpectedStale(meta_value)) {
-      s = Status::NotFound();
-    } else {
-      return Status::InvalidArgument(
-        "WRONGTYPE, key: " + keys[0] + ", expect type: " +
-        DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-        DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-    }
-  }
-  if (s.ok()) {
-    ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-    if (!parsed_sets_meta_value.IsStale() && parsed_sets_meta_value.Count() != 0) {
-      bool found;
-      std::string member_value;
-      version = parsed_sets_meta_value.Version();
-      SetsMemberKey sets_member_key(keys[0], version, Slice());
-      Slice prefix = sets_member_key.EncodeSeekKey();
-      KeyStatisticsDurationGuard guard(this, DataType::kSets, keys[0]);
-      auto iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
-      for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
-        ParsedSetsMemberKey parsed_sets_member_key(iter->key());
-        Slice member = parsed_sets_member_key.member();
-
-        found = false;
-        for (const auto& key_version : vaild_sets) {
-          SetsMemberKey sets_member_key(key_version.key, key_version.version, member);
-          s = db_->Get(read_options, handles_[kSetsDataCF], sets_member_key.Encode(), &member_value);
-          if (s.ok()) {
-            found = true;
-            break;
-          } else if (!s.IsNotFound()) {
-            delete iter;
-            return s;
-          }
-        }
-        if (!found) {
-          members.push_back(member.ToString());
-        }
-      }
-      delete iter;
+rocksdb::Status Redis::NewSetsMemberCursors(const std::vector<std::string>& keys,
+                                            const rocksdb::ReadOptions& read_options, MemberCursors* cursors) {
+  for (const auto& key : keys) {
+    std::unique_ptr<MemberCursor> cursor;
+    rocksdb::Status s = NewSetsMemberCursor(key, read_options, &cursor);
+    if (!s.ok() && !s.IsNotFound()) {
+      return s;
     }
-  } else if (!s.IsNotFound()) {
-    return s;
+    cursors->push_back(std::move(cursor));
   }
+  return rocksdb::Status::OK();
+}
 
+rocksdb::Status Redis::SetsStore(const Slice& destination,
+                                 const std::function<Status(const SetsMemberSink&)>& producer,
+                                 std::vector<std::string>* value_to_dest, int32_t* ret) {
+  ScopeRecordLock l(lock_mgr_, destination);
   uint32_t statistic = 0;
+  uint64_t version = 0;
+  std::string meta_value;
   BaseMetaKey base_destination(destination);
-  s = db_->Get(read_options, handles_[kMetaCF], base_destination.Encode(), &meta_value);
-  if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-    if (ExpectedStale(meta_value)) {
-      s = Status::NotFound();
-    } else {
-     return Status::InvalidArgument(
-        "WRONGTYPE, key: " + destination.ToString() + ", expect type: " +
-        DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-        DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-    }
-  }
-  if (s.ok()) {
+  rocksdb::Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_destination.Encode(), &meta_value);
+  if (s.ok() && ExpectedMetaValue(DataType::kSets, meta_value)) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
     statistic = parsed_sets_meta_value.Count();
     version = parsed_sets_meta_value.InitialMetaValue();
-    if (!parsed_sets_meta_value.check_set_count(static_cast<int32_t>(members.size()))) {
-      return Status::InvalidArgument("set size overflow");
-    }
-    parsed_sets_meta_value.SetCount(static_cast<int32_t>(members.size()));
-    batch.Put(handles_[kMetaCF], base_destination.Encode(), meta_value);
-  } else if (s.IsNotFound()) {
+  } else if (s.ok() || s.IsNotFound()) {
+    // a value of another type is overwritten, its members go with the
+    // compactions as the meta value no longer matches them
     char str[4];
-    EncodeFixed32(str, members.size());
+    EncodeFixed32(str, 0);
     SetsMetaValue sets_meta_value(DataType::kSets, Slice(str, 4));
     version = sets_meta_value.UpdateVersion();
-    batch.Put(handles_[kMetaCF], base_destination.Encode(), sets_meta_value.Encode());
+    meta_value = sets_meta_value.Encode().ToString();
   } else {
     return s;
   }
-  for (const auto& member : members) {
-    SetsMemberKey sets_member_key(destination, version, member);
-    BaseDataValue iter_value(Slice{});
+
+  // nothing reads the members of the new version before its meta value is
+  // written, so the batches in between need not go at once
+  const int32_t kStoreBatchCount = 1000;
+  std::vector<std::string> members;
+  rocksdb::WriteBatch batch;
+  auto put_member = [&](const Slice& member) {
+    SetsMemberKey sets_member_key(destination, version, member, data_format_);
+    BaseDataValue iter_value(Slice{}, data_format_);
     batch.Put(handles_[kSetsDataCF], sets_member_key.Encode(), iter_value.Encode());
+  };
+  // the members stay inline until they outgrow the limits, then all spill
+  bool keep_inline = set_max_inline_entries_ > 0;
+  s = producer([&](const Slice& member) {
+    if (members.size() >= INT32_MAX) {
+      return Status::InvalidArgument("set size overflow");
+    }
+    members.push_back(member.ToString());
+    if (keep_inline && members.size() <= static_cast<size_t>(set_max_inline_entries_) &&
+        member.size() <= static_cast<size_t>(set_max_inline_value_)) {
+      return Status::OK();
+    } else if (keep_inline) {
+      keep_inline = false;
+      for (const auto& kept_member : members) {
+        put_member(kept_member);
+      }
+    } else {
+      put_member(member);
+    }
+    if (batch.Count() < kStoreBatchCount) {
+      return Status::OK();
+    }
+    Status write_status = db_->Write(default_write_options_, &batch);
+    batch.Clear();
+    return write_status;
+  });
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
+  parsed_sets_meta_value.SetCount(static_cast<int32_t>(members.size()));
+  if (keep_inline && !members.empty()) {
+    SetsInlineMembers inline_members;
+    for (const auto& member : members) {
+      inline_members.Insert(member);
+    }
+    parsed_sets_meta_value.SetInline(true);
+    parsed_sets_meta_value.SetInlinePayload(inline_members.Encode());
   }
+  batch.Put(handles_[kMetaCF], base_destination.Encode(), meta_value);
   *ret = static_cast<int32_t>(members.size());
   s = db_->Write(default_write_options_, &batch);
   UpdateSpecificKeyStatistics(DataType::kSets, destination.ToString(), statistic);
-  value_to_dest = std::move(members);
+  *value_to_dest = std::move(members);
   return s;
 }
 
-rocksdb::Status Redis::SInter(const std::vector<std::string>& keys, std::vector<std::string>* members) {
+rocksdb::Status Redis::SDiff(const std::vector<std::string>& keys, std::vector<std::string>* members) {
   if (keys.empty()) {
-    return rocksdb::Status::Corruption("SInter invalid parameter, no keys");
+    return rocksdb::Status::Corruption("SDiff invalid parameter, no keys");
   }
 
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
-
-  std::string meta_value;
-  uint64_t version = 0;
   ScopeSnapshot ss(db_, &snapshot);
   read_options.snapshot = snapshot;
-  std::vector<KeyVersion> vaild_sets;
-  rocksdb::Status s;
-
-  for (uint32_t idx = 1; idx < keys.size(); ++idx) {
-    BaseMetaKey base_meta_key(keys[idx]);
-    s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
-    if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-      if (ExpectedStale(meta_value)) {
-        s = Status::NotFound();
-      } else {
-       return Status::InvalidArgument(
-          "WRONGTYPE, key: " + keys[idx] + ", expect type: " +
-          DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-          DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-      }
-    }
-    if (s.ok()) {
-      ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-      if (parsed_sets_meta_value.IsStale() || parsed_sets_meta_value.Count() == 0) {
-        return rocksdb::Status::OK();
-      } else {
-        vaild_sets.push_back({keys[idx], parsed_sets_meta_value.Version()});
-      }
-    } else if (s.IsNotFound()) {
-      return rocksdb::Status::OK();
-    } else {
-      return s;
-    }
+  MemberCursors cursors;
+  rocksdb::Status s = NewSetsMemberCursors(keys, read_options, &cursors);
+  if (!s.ok() || cursors[0] == nullptr) {
+    return s;
   }
+  cursors.erase(std::remove(cursors.begin(), cursors.end(), nullptr), cursors.end());
+  KeyStatisticsDurationGuard guard(this, DataType::kSets, keys[0]);
+  return SetsDiff(&cursors, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return rocksdb::Status::OK();
+  });
+}
 
-  BaseMetaKey base_meta_key0(keys[0]);
-  s = db_->Get(read_options, handles_[kMetaCF], base_meta_key0.Encode(), &meta_value);
-  if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-    if (ExpectedStale(meta_value)) {
-      s = Status::NotFound();
-    } else {
-      return Status::InvalidArgument(
-        "WRONGTYPE, key: " + keys[0] + ", expect type: " +
-        DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-        DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-    }
+rocksdb::Status Redis::SDiffstore(const Slice& destination, const std::vector<std::string>& keys, std::vector<std::string>& value_to_dest, int32_t* ret) {
+  if (keys.empty()) {
+    return rocksdb::Status::Corruption("SDiffsotre invalid parameter, no keys");
   }
-  if (s.ok()) {
-    ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-    if (parsed_sets_meta_value.IsStale() || parsed_sets_meta_value.Count() == 0) {
-      return rocksdb::Status::OK();
-    } else {
-      bool reliable;
-      std::string member_value;
-      version = parsed_sets_meta_value.Version();
-      SetsMemberKey sets_member_key(keys[0], version, Slice());
-      KeyStatisticsDurationGuard guard(this, DataType::kSets, keys[0]);
-      Slice prefix = sets_member_key.EncodeSeekKey();
-      auto iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
-      for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
-        ParsedSetsMemberKey parsed_sets_member_key(iter->key());
-        Slice member = parsed_sets_member_key.member();
-
-        reliable = true;
-        for (const auto& key_version : vaild_sets) {
-          SetsMemberKey sets_member_key(key_version.key, key_version.version, member);
-          s = db_->Get(read_options, handles_[kSetsDataCF], sets_member_key.Encode(), &member_value);
-          if (s.ok()) {
-            continue;
-          } else if (s.IsNotFound()) {
-            reliable = false;
-            break;
-          } else {
-            delete iter;
-            return s;
-          }
-        }
-        if (reliable) {
-          members->push_back(member.ToString());
-        }
-      }
-      delete iter;
+
+  return SetsStore(destination, [&](const SetsMemberSink& sink) {
+    rocksdb::ReadOptions read_options;
+    const rocksdb::Snapshot* snapshot;
+    ScopeSnapshot ss(db_, &snapshot);
+    read_options.snapshot = snapshot;
+    MemberCursors cursors;
+    rocksdb::Status s = NewSetsMemberCursors(keys, read_options, &cursors);
+    if (!s.ok() || cursors[0] == nullptr) {
+      return s;
     }
-  } else if (s.IsNotFound()) {
-    return rocksdb::Status::OK();
-  } else {
-    return s;
-  }
-  return rocksdb::Status::OK();
+    cursors.erase(std::remove(cursors.begin(), cursors.end(), nullptr), cursors.end());
+    KeyStatisticsDurationGuard guard(this, DataType::kSets, keys[0]);
+    return SetsDiff(&cursors, sink);
+  }, &value_to_dest, ret);
 }
 
-rocksdb::Status Redis::SInterstore(const Slice& destination, const std::vector<std::string>& keys, std::vector<std::string>& value_to_dest, int32_t* ret) {
+rocksdb::Status Redis::SInter(const std::vector<std::string>& keys, std::vector<std::string>* members) {
   if (keys.empty()) {
-    return rocksdb::Status::Corruption("SInterstore invalid parameter, no keys");
+    return rocksdb::Status::Corruption("SInter invalid parameter, no keys");
   }
 
-  rocksdb::WriteBatch batch;
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
-
-  std::string meta_value;
-  uint64_t version = 0;
-  bool have_invalid_sets = false;
-  ScopeRecordLock l(lock_mgr_, destination);
   ScopeSnapshot ss(db_, &snapshot);
   read_options.snapshot = snapshot;
-  std::vector<KeyVersion> vaild_sets;
-  rocksdb::Status s;
-
-  for (uint32_t idx = 1; idx < keys.size(); ++idx) {
-    BaseMetaKey base_meta_key(keys[idx]);
-    s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
-    if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-      if (ExpectedStale(meta_value)) {
-        s = Status::NotFound();
-      } else {
-       return Status::InvalidArgument(
-          "WRONGTYPE, key: " + keys[idx] + ", expect type: " +
-          DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-          DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-      }
-    }
-    if (s.ok()) {
-      ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-      if (parsed_sets_meta_value.IsStale() || parsed_sets_meta_value.Count() == 0) {
-        have_invalid_sets = true;
-        break;
-      } else {
-        vaild_sets.push_back({keys[idx], parsed_sets_meta_value.Version()});
-      }
-    } else if (s.IsNotFound()) {
-      have_invalid_sets = true;
-      break;
-    } else {
-      return s;
-    }
+  MemberCursors cursors;
+  rocksdb::Status s = NewSetsMemberCursors(keys, read_options, &cursors);
+  if (!s.ok() || std::find(cursors.begin(), cursors.end(), nullptr) != cursors.end()) {
+    return s;
   }
+  KeyStatisticsDurationGuard guard(this, DataType::kSets, keys[0]);
+  return SetsInter(&cursors, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return rocksdb::Status::OK();
+  });
+}
 
-  std::vector<std::string> members;
-  if (!have_invalid_sets) {
-    BaseMetaKey base_meta_key0(keys[0]);
-    s = db_->Get(read_options, handles_[kMetaCF], base_meta_key0.Encode(), &meta_value);
-    if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-      if (ExpectedStale(meta_value)) {
-        s = Status::NotFound();
-      } else {
-        return Status::InvalidArgument(
-        "WRONGTYPE, key: " + keys[0] + ", expect type: " +
-        DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-        DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-      }
-    }
-    if (s.ok()) {
-      ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-      if (parsed_sets_meta_value.IsStale() || parsed_sets_meta_value.Count() == 0) {
-        have_invalid_sets = true;
-      } else {
-        bool reliable;
-        std::string member_value;
-        version = parsed_sets_meta_value.Version();
-        SetsMemberKey sets_member_key(keys[0], version, Slice());
-        Slice prefix = sets_member_key.EncodeSeekKey();
-        KeyStatisticsDurationGuard guard(this, DataType::kSets, keys[0]);
-        auto iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
-        for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
-          ParsedSetsMemberKey parsed_sets_member_key(iter->key());
-          Slice member = parsed_sets_member_key.member();
-
-          reliable = true;
-          for (const auto& key_version : vaild_sets) {
-            SetsMemberKey sets_member_key(key_version.key, key_version.version, member);
-            s = db_->Get(read_options, handles_[kSetsDataCF], sets_member_key.Encode(), &member_value);
-            if (s.ok()) {
-              continue;
-            } else if (s.IsNotFound()) {
-              reliable = false;
-              break;
-            } else {
-              delete iter;
-              return s;
-            }
-          }
-          if (reliable) {
-            members.push_back(member.ToString());
-          }
-        }
-        delete iter;
-      }
-    } else if (s.IsNotFound()) {
-    } else {
-      return s;
-    }
+rocksdb::Status Redis::SInterstore(const Slice& destination, const std::vector<std::string>& keys, std::vector<std::string>& value_to_dest, int32_t* ret) {
+  if (keys.empty()) {
+    return rocksdb::Status::Corruption("SInterstore invalid parameter, no keys");
   }
 
-  uint32_t statistic = 0;
-  BaseMetaKey base_destination(destination);
-  s = db_->Get(read_options, handles_[kMetaCF], base_destination.Encode(), &meta_value);
-  if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-    if (ExpectedStale(meta_value)) {
-      s = Status::NotFound();
-    } else {
-      return Status::InvalidArgument(
-        "WRONGTYPE, key: " + destination.ToString() + ", expect type: " +
-        DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-        DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-    }
-  }
-  if (s.ok()) {
-    ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-    statistic = parsed_sets_meta_value.Count();
-    version = parsed_sets_meta_value.InitialMetaValue();
-    if (!parsed_sets_meta_value.check_set_count(static_cast<int32_t>(members.size()))) {
-      return Status::InvalidArgument("set size overflow");
+  return SetsStore(destination, [&](const SetsMemberSink& sink) {
+    rocksdb::ReadOptions read_options;
+    const rocksdb::Snapshot* snapshot;
+    ScopeSnapshot ss(db_, &snapshot);
+    read_options.snapshot = snapshot;
+    MemberCursors cursors;
+    rocksdb::Status s = NewSetsMemberCursors(keys, read_options, &cursors);
+    if (!s.ok() || std::find(cursors.begin(), cursors.end(), nullptr) != cursors.end()) {
+      return s;
     }
-    parsed_sets_meta_value.SetCount(static_cast<int32_t>(members.size()));
-    batch.Put(handles_[kMetaCF], base_destination.Encode(), meta_value);
-  } else if (s.IsNotFound()) {
-    char str[4];
-    EncodeFixed32(str, members.size());
-    SetsMetaValue sets_meta_value(DataType::kSets, Slice(str, 4));
-    version = sets_meta_value.UpdateVersion();
-    batch.Put(handles_[kMetaCF], base_destination.Encode(), sets_meta_value.Encode());
-  } else {
-    return s;
-  }
-  for (const auto& member : members) {
-    SetsMemberKey sets_member_key(destination, version, member);
-    BaseDataValue iter_value(Slice{});
-    batch.Put(handles_[kSetsDataCF], sets_member_key.Encode(), iter_value.Encode());
-  }
-  *ret = static_cast<int32_t>(members.size());
-  s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kSets, destination.ToString(), statistic);
-  value_to_dest = std::move(members);
-  return s;
+    KeyStatisticsDurationGuard guard(this, DataType::kSets, keys[0]);
+    return SetsInter(&cursors, sink);
+  }, &value_to_dest, ret);
 }
 
 rocksdb::Status Redis::SIsmember(const Slice& key, const Slice& member, int32_t* ret) {
@@ -674,10 +542,17 @@ rocksdb::Status Redis::SIsmember(const Slice& key, const Slice& member, int32_t*
       return rocksdb::Status::NotFound("Stale");
     } else if (parsed_sets_meta_value.Count() == 0) {
       return rocksdb::Status::NotFound();
+    } else if (parsed_sets_meta_value.IsInline()) {
+      SetsInlineMembers inline_members;
+      s = DecodeInlineMembers(&parsed_sets_meta_value, &inline_members);
+      if (s.ok() && !inline_members.Contains(member)) {
+        s = rocksdb::Status::NotFound();
+      }
+      *ret = s.ok() ? 1 : 0;
     } else {
       std::string member_value;
       version = parsed_sets_meta_value.Version();
-      SetsMemberKey sets_member_key(key, version, member);
+      SetsMemberKey sets_member_key(key, version, member, data_format_);
       s = db_->Get(read_options, handles_[kSetsDataCF], sets_member_key.Encode(), &member_value);
       *ret = s.ok() ? 1 : 0;
     }
@@ -724,11 +599,16 @@ rocksdb::Status Redis::SMembers(const Slice& key, std::vector<std::string>* memb
       return rocksdb::Status::NotFound("Stale");
     } else if (parsed_sets_meta_value.Count() == 0) {
       return rocksdb::Status::NotFound();
+    } else if (parsed_sets_meta_value.IsInline()) {
+      SetsInlineMembers inline_members;
+      s = DecodeInlineMembers(&parsed_sets_meta_value, &inline_members);
+      members->insert(members->end(), inline_members.Members().begin(), inline_members.Members().end());
     } else {
       version = parsed_sets_meta_value.Version();
-      SetsMemberKey sets_member_key(key, version, Slice());
+      SetsMemberKey sets_member_key(key, version, Slice(), data_format_);
       Slice prefix = sets_member_key.EncodeSeekKey();
       KeyStatisticsDurationGuard guard(this, DataType::kSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       auto iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
       for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
         ParsedSetsMemberKey parsed_sets_member_key(iter->key());
@@ -778,10 +658,18 @@ Status Redis::SMembersWithTTL(const Slice& key,
         *ttl_millsec = *ttl_millsec - curtime >= 0 ? *ttl_millsec - curtime : -2;
       }
 
+      if (parsed_sets_meta_value.IsInline()) {
+        SetsInlineMembers inline_members;
+        s = DecodeInlineMembers(&parsed_sets_meta_value, &inline_members);
+        members->insert(members->end(), inline_members.Members().begin(), inline_members.Members().end());
+        return s;
+      }
+
       version = parsed_sets_meta_value.Version();
-      SetsMemberKey sets_member_key(key, version, Slice());
+      SetsMemberKey sets_member_key(key, version, Slice(), data_format_);
       Slice prefix = sets_member_key.EncodeSeekKey();
       KeyStatisticsDurationGuard guard(this, DataType::kSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       auto iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
       for (iter->Seek(prefix);
            iter->Valid() && iter->key().starts_with(prefix);
@@ -829,10 +717,23 @@ rocksdb::Status Redis::SMove(const Slice& source, const Slice& destination, cons
       return rocksdb::Status::NotFound("Stale");
     } else if (parsed_sets_meta_value.Count() == 0) {
       return rocksdb::Status::NotFound();
+    } else if (parsed_sets_meta_value.IsInline()) {
+      auto erase_member = [&](SetsInlineMembers* inline_members) {
+        *ret = inline_members->Erase(member) ? 1 : 0;
+        return Status::OK();
+      };
+      SetsUpdateInline(source, true, &meta_value, erase_member, &batch, &s);
+      if (!s.ok()) {
+        return s;
+      }
+      if (*ret == 0) {
+        return rocksdb::Status::NotFound();
+      }
+      statistic++;
     } else {
       std::string member_value;
       version = parsed_sets_meta_value.Version();
-      SetsMemberKey sets_member_key(source, version, member);
+      SetsMemberKey sets_member_key(source, version, member, data_format_);
       s = db_->Get(default_read_options_, handles_[kSetsDataCF], sets_member_key.Encode(), &member_value);
       if (s.ok()) {
         *ret = 1;
@@ -869,26 +770,34 @@ rocksdb::Status Redis::SMove(const Slice& source, const Slice& destination, cons
         DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     }
   }
-  if (s.ok()) {
+  auto add_member = [&](SetsInlineMembers* inline_members) {
+    inline_members->Insert(member);
+    return Status::OK();
+  };
+  if ((s.ok() || s.IsNotFound()) && SetsUpdateInline(destination, s.ok(), &meta_value, add_member, &batch, &s)) {
+    if (!s.ok()) {
+      return s;
+    }
+  } else if (s.ok()) {
     ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
     if (parsed_sets_meta_value.IsStale() || parsed_sets_meta_value.Count() == 0) {
       version = parsed_sets_meta_value.InitialMetaValue();
       parsed_sets_meta_value.SetCount(1);
       batch.Put(handles_[kMetaCF], base_destination.Encode(), meta_value);
-      SetsMemberKey sets_member_key(destination, version, member);
-      BaseDataValue i_val(Slice{});
+      SetsMemberKey sets_member_key(destination, version, member, data_format_);
+      BaseDataValue i_val(Slice{}, data_format_);
       batch.Put(handles_[kSetsDataCF], sets_member_key.Encode(), i_val.Encode());
     } else {
       std::string member_value;
       version = parsed_sets_meta_value.Version();
-      SetsMemberKey sets_member_key(destination, version, member);
+      SetsMemberKey sets_member_key(destination, version, member, data_format_);
       s = db_->Get(default_read_options_, handles_[kSetsDataCF], sets_member_key.Encode(), &member_value);
       if (s.IsNotFound()) {
         if (!parsed_sets_meta_value.CheckModifyCount(1)) {
           return Status::InvalidArgument("set size overflow");
         }
         parsed_sets_meta_value.ModifyCount(1);
-        BaseDataValue iter_value(Slice{});
+        BaseDataValue iter_value(Slice{}, data_format_);
         batch.Put(handles_[kMetaCF], base_destination.Encode(), meta_value);
         batch.Put(handles_[kSetsDataCF], sets_member_key.Encode(), iter_value.Encode());
       } else if (!s.ok()) {
@@ -901,8 +810,8 @@ rocksdb::Status Redis::SMove(const Slice& source, const Slice& destination, cons
     SetsMetaValue sets_meta_value(DataType::kSets, Slice(str, 4));
     version = sets_meta_value.UpdateVersion();
     batch.Put(handles_[kMetaCF], base_destination.Encode(), sets_meta_value.Encode());
-    SetsMemberKey sets_member_key(destination, version, member);
-    BaseDataValue iter_value(Slice{});
+    SetsMemberKey sets_member_key(destination, version, member, data_format_);
+    BaseDataValue iter_value(Slice{}, data_format_);
     batch.Put(handles_[kSetsDataCF], sets_member_key.Encode(), iter_value.Encode());
   } else {
     return s;
@@ -937,14 +846,30 @@ rocksdb::Status Redis::SPop(const Slice& key, std::vector<std::string>* members,
       return Status::NotFound("Stale");
     } else if (parsed_sets_meta_value.Count() == 0) {
       return Status::NotFound();
+    } else if (parsed_sets_meta_value.IsInline()) {
+      engine.seed(time(nullptr));
+      auto pop_members = [&](SetsInlineMembers* inline_members) {
+        for (int64_t cur_round = 0; cur_round < cnt && inline_members->Count() != 0; cur_round++) {
+          size_t pos = engine() % inline_members->Count();
+          members->push_back(inline_members->Members()[pos]);
+          inline_members->EraseAt(pos);
+        }
+        return Status::OK();
+      };
+      SetsUpdateInline(key, true, &meta_value, pop_members, &batch, &s);
+      if (!s.ok()) {
+        return s;
+      }
     } else {
       int32_t length = parsed_sets_meta_value.Count();
       if (length < cnt) {
         int32_t size = parsed_sets_meta_value.Count();
         int32_t cur_index = 0;
         uint64_t version = parsed_sets_meta_value.Version();
-        SetsMemberKey sets_member_key(key, version, Slice());
-        auto iter = db_->NewIterator(default_read_options_, handles_[kSetsDataCF]);
+        SetsMemberKey sets_member_key(key, version, Slice(), data_format_);
+        rocksdb::ReadOptions iter_options(default_read_options_);
+        iter_options.prefix_same_as_start = true;
+        auto iter = db_->NewIterator(iter_options, handles_[kSetsDataCF]);
         for (iter->Seek(sets_member_key.EncodeSeekKey());
             iter->Valid() && cur_index < size;
             iter->Next(), cur_index++) {
@@ -978,10 +903,12 @@ rocksdb::Status Redis::SPop(const Slice& key, std::vector<std::string>* members,
           sets_index.insert(target_index);
         }
 
-        SetsMemberKey sets_member_key(key, version, Slice());
+        SetsMemberKey sets_member_key(key, version, Slice(), data_format_);
         int64_t del_count = 0;
         KeyStatisticsDurationGuard guard(this, DataType::kSets, key.ToString());
-        auto iter = db_->NewIterator(default_read_options_, handles_[kSetsDataCF]);
+        rocksdb::ReadOptions iter_options(default_read_options_);
+        iter_options.prefix_same_as_start = true;
+        auto iter = db_->NewIterator(iter_options, handles_[kSetsDataCF]);
         for (iter->Seek(sets_member_key.EncodeSeekKey());
             iter->Valid() && cur_index < size;
             iter->Next(), cur_index++) {
@@ -1078,11 +1005,25 @@ rocksdb::Status Redis::SRandmember(const Slice& key, int32_t count, std::vector<
       }
       std::sort(targets.begin(), targets.end());
 
+      if (parsed_sets_meta_value.IsInline()) {
+        SetsInlineMembers inline_members;
+        s = DecodeInlineMembers(&parsed_sets_meta_value, &inline_members);
+        for (const auto target : targets) {
+          if (static_cast<size_t>(target) < inline_members.Count()) {
+            members->push_back(inline_members.Members()[target]);
+          }
+        }
+        std::shuffle(members->begin(), members->end(), engine);
+        return s;
+      }
+
       int32_t cur_index = 0;
       int32_t idx = 0;
-      SetsMemberKey sets_member_key(key, version, Slice());
+      SetsMemberKey sets_member_key(key, version, Slice(), data_format_);
       KeyStatisticsDurationGuard guard(this, DataType::kSets, key.ToString());
-      auto iter = db_->NewIterator(default_read_options_, handles_[kSetsDataCF]);
+      rocksdb::ReadOptions iter_options(default_read_options_);
+      iter_options.prefix_same_as_start = true;
+      auto iter = db_->NewIterator(iter_options, handles_[kSetsDataCF]);
       for (iter->Seek(sets_member_key.EncodeSeekKey()); iter->Valid() && cur_index < size; iter->Next(), cur_index++) {
         if (static_cast<size_t>(idx) >= targets.size()) {
           break;
@@ -1128,12 +1069,25 @@ rocksdb::Status Redis::SRem(const Slice& key, const std::vector<std::string>& me
       return rocksdb::Status::NotFound("stale");
     } else if (parsed_sets_meta_value.Count() == 0) {
       return rocksdb::Status::NotFound();
+    } else if (parsed_sets_meta_value.IsInline()) {
+      auto erase_members = [&](SetsInlineMembers* inline_members) {
+        for (const auto& member : members) {
+          if (inline_members->Erase(member)) {
+            (*ret)++;
+          }
+        }
+        return Status::OK();
+      };
+      SetsUpdateInline(key, true, &meta_value, erase_members, &batch, &s);
+      if (!s.ok()) {
+        return s;
+      }
     } else {
       int32_t cnt = 0;
       std::string member_value;
       version = parsed_sets_meta_value.Version();
       for (const auto& member : members) {
-        SetsMemberKey sets_member_key(key, version, member);
+        SetsMemberKey sets_member_key(key, version, member, data_format_);
         s = db_->Get(default_read_options_, handles_[kSetsDataCF], sets_member_key.Encode(), &member_value);
         if (s.ok()) {
           cnt++;
@@ -1149,6 +1103,11 @@ rocksdb::Status Redis::SRem(const Slice& key, const std::vector<std::string>& me
         return Status::InvalidArgument("set size overflow");
       }
       parsed_sets_meta_value.ModifyCount(-cnt);
+      std::unordered_set<std::string> deleted_members(members.begin(), members.end());
+      s = SetsFoldInline(key, deleted_members, &parsed_sets_meta_value, &batch);
+      if (!s.ok()) {
+        return s;
+      }
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
     }
   } else if (s.IsNotFound()) {
@@ -1169,54 +1128,18 @@ rocksdb::Status Redis::SUnion(const std::vector<std::string>& keys, std::vector<
 
   rocksdb::ReadOptions read_options;
   const rocksdb::Snapshot* snapshot;
-
-  std::string meta_value;
   ScopeSnapshot ss(db_, &snapshot);
   read_options.snapshot = snapshot;
-  std::vector<KeyVersion> vaild_sets;
-  rocksdb::Status s;
-
-  for (const auto & key : keys) {
-    BaseMetaKey base_meta_key(key);
-    s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
-    if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-      if (ExpectedStale(meta_value)) {
-        s = Status::NotFound();
-      } else {
-        return Status::InvalidArgument(
-          "WRONGTYPE, key: " + key + ", expect type: " +
-          DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-          DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-      }
-    }
-    if (s.ok()) {
-      ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-      if (!parsed_sets_meta_value.IsStale() && parsed_sets_meta_value.Count() != 0) {
-        vaild_sets.push_back({key, parsed_sets_meta_value.Version()});
-      }
-    } else if (!s.IsNotFound()) {
-      return s;
-    }
-  }
-
-  Slice prefix;
-  std::map<std::string, bool> result_flag;
-  for (const auto& key_version : vaild_sets) {
-    SetsMemberKey sets_member_key(key_version.key, key_version.version, Slice());
-    prefix = sets_member_key.EncodeSeekKey();
-    KeyStatisticsDurationGuard guard(this, DataType::kSets, key_version.key);
-    auto iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
-    for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
-      ParsedSetsMemberKey parsed_sets_member_key(iter->key());
-      std::string member = parsed_sets_member_key.member().ToString();
-      if (result_flag.find(member) == result_flag.end()) {
-        members->push_back(member);
-        result_flag[member] = true;
-      }
-    }
-    delete iter;
+  MemberCursors cursors;
+  rocksdb::Status s = NewSetsMemberCursors(keys, read_options, &cursors);
+  if (!s.ok()) {
+    return s;
   }
-  return rocksdb::Status::OK();
+  cursors.erase(std::remove(cursors.begin(), cursors.end(), nullptr), cursors.end());
+  return SetsUnion(&cursors, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return rocksdb::Status::OK();
+  });
 }
 
 rocksdb::Status Redis::SUnionstore(const Slice& destination, const std::vector<std::string>& keys, std::vector<std::string>& value_to_dest, int32_t* ret) {
@@ -1224,101 +1147,19 @@ rocksdb::Status Redis::SUnionstore(const Slice& destination, const std::vector<s
     return rocksdb::Status::Corruption("SUnionstore invalid parameter, no keys");
   }
 
-  rocksdb::WriteBatch batch;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot;
-
-  std::string meta_value;
-  uint64_t version = 0;
-  ScopeRecordLock l(lock_mgr_, destination);
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  std::vector<KeyVersion> vaild_sets;
-  rocksdb::Status s;
-
-  for (const auto & key : keys) {
-    BaseMetaKey base_meta_key(key);
-    s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
-    if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-      if (ExpectedStale(meta_value)) {
-        s = Status::NotFound();
-      } else {
-        return Status::InvalidArgument(
-          "WRONGTYPE, key: " + key + ", expect type: " +
-          DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-          DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-      }
-    }
-    if (s.ok()) {
-      ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-      if (!parsed_sets_meta_value.IsStale() && parsed_sets_meta_value.Count() != 0) {
-        vaild_sets.push_back({key, parsed_sets_meta_value.Version()});
-      }
-    } else if (!s.IsNotFound()) {
+  return SetsStore(destination, [&](const SetsMemberSink& sink) {
+    rocksdb::ReadOptions read_options;
+    const rocksdb::Snapshot* snapshot;
+    ScopeSnapshot ss(db_, &snapshot);
+    read_options.snapshot = snapshot;
+    MemberCursors cursors;
+    rocksdb::Status s = NewSetsMemberCursors(keys, read_options, &cursors);
+    if (!s.ok()) {
       return s;
     }
-  }
-
-  Slice prefix;
-  std::vector<std::string> members;
-  std::map<std::string, bool> result_flag;
-  for (const auto& key_version : vaild_sets) {
-    SetsMemberKey sets_member_key(key_version.key, key_version.version, Slice());
-    prefix = sets_member_key.EncodeSeekKey();
-    KeyStatisticsDurationGuard guard(this, DataType::kSets, key_version.key);
-    auto iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
-    for (iter->Seek(prefix); iter->Valid() && iter->key().starts_with(prefix); iter->Next()) {
-      ParsedSetsMemberKey parsed_sets_member_key(iter->key());
-      std::string member = parsed_sets_member_key.member().ToString();
-      if (result_flag.find(member) == result_flag.end()) {
-        members.push_back(member);
-        result_flag[member] = true;
-      }
-    }
-    delete iter;
-  }
-
-  uint32_t statistic = 0;
-  BaseMetaKey base_destination(destination);
-  s = db_->Get(read_options, handles_[kMetaCF], base_destination.Encode(), &meta_value);
-  if (s.ok() && !ExpectedMetaValue(DataType::kSets, meta_value)) {
-    if (ExpectedStale(meta_value)) {
-      s = Status::NotFound();
-    } else {
-     return Status::InvalidArgument(
-        "WRONGTYPE, key: " + destination.ToString() + ", expect type: " +
-        DataTypeStrings[static_cast<int>(DataType::kSets)] + ", get type: " +
-        DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-    }
-  }
-  if (s.ok()) {
-    ParsedSetsMetaValue parsed_sets_meta_value(&meta_value);
-    statistic = parsed_sets_meta_value.Count();
-    version = parsed_sets_meta_value.InitialMetaValue();
-    if (!parsed_sets_meta_value.check_set_count(static_cast<int32_t>(members.size()))) {
-      return Status::InvalidArgument("set size overflow");
-    }
-    parsed_sets_meta_value.SetCount(static_cast<int32_t>(members.size()));
-    batch.Put(handles_[kMetaCF], destination, meta_value);
-  } else if (s.IsNotFound()) {
-    char str[4];
-    EncodeFixed32(str, members.size());
-    SetsMetaValue sets_meta_value(DataType::kSets, Slice(str, 4));
-    version = sets_meta_value.UpdateVersion();
-    batch.Put(handles_[kMetaCF], base_destination.Encode(), sets_meta_value.Encode());
-  } else {
-    return s;
-  }
-  for (const auto& member : members) {
-    SetsMemberKey sets_member_key(destination, version, member);
-    BaseDataValue i_val(Slice{});
-    batch.Put(handles_[kSetsDataCF], sets_member_key.Encode(), i_val.Encode());
-  }
-  *ret = static_cast<int32_t>(members.size());
-  s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kSets, destination.ToString(), statistic);
-  value_to_dest = std::move(members);
-  return s;
+    cursors.erase(std::remove(cursors.begin(), cursors.end(), nullptr), cursors.end());
+    return SetsUnion(&cursors, sink);
+  }, &value_to_dest, ret);
 }
 
 rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
@@ -1356,6 +1197,18 @@ rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string
     if (parsed_sets_meta_value.IsStale() || parsed_sets_meta_value.Count() == 0) {
       *next_cursor = 0;
       return rocksdb::Status::NotFound();
+    } else if (parsed_sets_meta_value.IsInline()) {
+      // like a listpack set in redis, one call returns every member
+      SetsInlineMembers inline_members;
+      s = DecodeInlineMembers(&parsed_sets_meta_value, &inline_members);
+      if (!s.ok()) {
+        return s;
+      }
+      for (const auto& member : inline_members.Members()) {
+        if (StringMatch(pattern.data(), pattern.size(), member.data(), member.size(), 0) != 0) {
+          members->push_back(member);
+        }
+      }
     } else {
       std::string sub_member;
       std::string start_point;
@@ -1371,10 +1224,11 @@ rocksdb::Status Redis::SScan(const Slice& key, int64_t cursor, const std::string
         sub_member = pattern.substr(0, pattern.size() - 1);
       }
 
-      SetsMemberKey sets_member_prefix(key, version, sub_member);
-      SetsMemberKey sets_member_key(key, version, start_point);
+      SetsMemberKey sets_member_prefix(key, version, sub_member, data_format_);
+      SetsMemberKey sets_member_key(key, version, start_point, data_format_);
       std::string prefix = sets_member_prefix.EncodeSeekKey().ToString();
       KeyStatisticsDurationGuard guard(this, DataType::kSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kSetsDataCF]);
       for (iter->Seek(sets_member_key.EncodeSeekKey()); iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -1472,8 +1326,13 @@ rocksdb::Status Redis::SetsDel(const Slice& key, std::string&& prefetch_meta) {
       return rocksdb::Status::NotFound();
     } else {
       uint32_t statistic = parsed_sets_meta_value.Count();
+      uint64_t dropped_version = parsed_sets_meta_value.Version();
       parsed_sets_meta_value.InitialMetaValue();
       s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      if (s.ok()) {
+        AddDroppedVersion(key, dropped_version);
+        AddReclaimRangeTaskIfNeeded(DataType::kSets, key, dropped_version, statistic);
+      }
       UpdateSpecificKeyStatistics(DataType::kSets, key.ToString(), statistic);
     }
   }
@@ -1608,6 +1467,7 @@ void Redis::ScanSets() {
   ScopeSnapshot ss(db_, &snapshot);
   iterator_options.snapshot = snapshot;
   iterator_options.fill_cache = false;
+  iterator_options.total_order_seek = true;
   auto current_time = static_cast<int32_t>(time(nullptr));
 
   LOG(INFO) << "***************Sets Meta Data***************";
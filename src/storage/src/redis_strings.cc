@@ -6,14 +6,18 @@
 #include <iostream>
 #include <algorithm>
 #include <climits>
+#include <cstring>
 #include <limits>
 #include <memory>
+#include <tuple>
+#include <unordered_set>
 
 #include <fmt/core.h>
 #include <glog/logging.h>
 
 #include "pstd/include/pika_codis_slot.h"
 #include "src/base_key_format.h"
+#include "src/bitmap_kernels.h"
 #include "src/scope_record_lock.h"
 #include "src/scope_snapshot.h"
 #include "src/strings_filter.h"
@@ -89,12 +93,22 @@ Status Redis::Append(const Slice& key, const Slice& value, int32_t* ret, int64_t
     } else {
       uint64_t timestamp = parsed_strings_value.Etime();
       std::string old_user_value = parsed_strings_value.UserValue().ToString();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, &old_user_value);
+        if (!s.ok()) {
+          return s;
+        }
+      }
       std::string new_value = old_user_value + value.ToString();
       out_new_value = new_value;
-      StringsValue strings_value(new_value);
-      strings_value.SetEtime(timestamp);
       *ret = static_cast<int32_t>(new_value.size());
       *expired_timestamp_millsec = timestamp;
+      if (strings_merge_ && !parsed_strings_value.IsBitmapChunked()) {
+        return db_->Merge(default_write_options_, base_key.Encode(),
+                          EncodeStringsMergeOperand(kStringsMergeAppend, timestamp, value));
+      }
+      StringsValue strings_value(new_value);
+      strings_value.SetEtime(timestamp);
       return db_->Put(default_write_options_, base_key.Encode(), strings_value.Encode());
     }
   } else if (s.IsNotFound()) {
@@ -106,23 +120,11 @@ Status Redis::Append(const Slice& key, const Slice& value, int32_t* ret, int64_t
   return s;
 }
 
-int GetBitCount(const unsigned char* value, int64_t bytes) {
-  int bit_num = 0;
-  static const unsigned char bitsinbyte[256] = {
-      0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2,
-      3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3,
-      3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5,
-      6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4,
-      3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4,
-      5, 5, 6, 5, 6, 6, 7, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6,
-      6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};
-  for (int i = 0; i < bytes; i++) {
-    bit_num += bitsinbyte[static_cast<unsigned int>(value[i])];
-  }
-  return bit_num;
+int64_t GetBitCount(const unsigned char* value, int64_t bytes) {
+  return PopcountBytes(value, static_cast<uint64_t>(bytes));
 }
 
-Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int32_t* ret,
+Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int64_t* ret,
                           bool have_range) {
   *ret = 0;
   std::string value;
@@ -145,8 +147,13 @@ Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offse
       return Status::NotFound("Stale");
     } else {
       parsed_strings_value.StripSuffix();
+      BitmapChunkMeta bitmap_meta;
+      bool chunked = parsed_strings_value.IsBitmapChunked();
+      if (chunked && !bitmap_meta.Decode(value)) {
+        return Status::Corruption("bad chunked bitmap value");
+      }
       const auto bit_value = reinterpret_cast<const unsigned char*>(value.data());
-      auto value_length = static_cast<int64_t>(value.length());
+      auto value_length = static_cast<int64_t>(chunked ? bitmap_meta.length : value.length());
       if (have_range) {
         if (start_offset < 0) {
           start_offset = start_offset + value_length;
@@ -171,6 +178,23 @@ Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offse
         start_offset = 0;
         end_offset = std::max(value_length - 1, static_cast<int64_t>(0));
       }
+      if (chunked) {
+        // count the chunks of the range only
+        ChunkedBitmap bitmap(db_, handles_[kBitmapsDataCF], key, bitmap_meta);
+        uint64_t chunk_size = bitmap_meta.chunk_size;
+        return bitmap.ForEachChunk(default_read_options_, start_offset, end_offset,
+                                   [&](uint64_t chunk_index, const Slice& bytes) {
+                                     uint64_t chunk_start = chunk_index * chunk_size;
+                                     uint64_t from = std::max<uint64_t>(start_offset, chunk_start);
+                                     uint64_t to = std::min<uint64_t>(end_offset + 1, chunk_start + bytes.size());
+                                     if (from < to) {
+                                       *ret += GetBitCount(
+                                           reinterpret_cast<const unsigned char*>(bytes.data()) + (from - chunk_start),
+                                           static_cast<int64_t>(to - from));
+                                     }
+                                     return true;
+                                   });
+      }
       *ret = GetBitCount(bit_value + start_offset, end_offset - start_offset + 1);
     }
   } else {
@@ -180,98 +204,112 @@ Status Redis::BitCount(const Slice& key, int64_t start_offset, int64_t end_offse
 }
 
 std::string BitOpOperate(BitOpType op, const std::vector<std::string>& src_values, int64_t max_len) {
-  char byte;
-  char output;
-  auto dest_value = std::make_unique<char[]>(max_len);
-  for (int64_t j = 0; j < max_len; j++) {
-    if (j < static_cast<int64_t>(src_values[0].size())) {
-      output = src_values[0][j];
+  std::string dest_value(max_len, '\0');
+  auto dest = reinterpret_cast<unsigned char*>(dest_value.data());
+  memcpy(dest, src_values[0].data(), std::min<int64_t>(max_len, static_cast<int64_t>(src_values[0].size())));
+  if (op == kBitOpNot) {
+    BitOpBytes(op, dest, nullptr, max_len);
+    return dest_value;
+  }
+  for (size_t i = 1; i < src_values.size(); i++) {
+    auto src_len = std::min<int64_t>(max_len, static_cast<int64_t>(src_values[i].size()));
+    BitOpBytes(op, dest, reinterpret_cast<const unsigned char*>(src_values[i].data()), src_len);
+    // a shorter source is zero filled, only an and changes the bytes past it
+    if (op == kBitOpAnd && src_len < max_len) {
+      memset(dest + src_len, 0, max_len - src_len);
+    }
+  }
+  return dest_value;
+}
+
+Status Redis::GetBitmapReader(const Slice& key, BitmapReader* reader) {
+  std::string value;
+  BaseKey base_key(key);
+  Status s = db_->Get(default_read_options_, base_key.Encode(), &value);
+  if (s.ok() && !ExpectedMetaValue(DataType::kStrings, value)) {
+    if (ExpectedStale(value)) {
+      s = Status::NotFound();
     } else {
-      output = 0;
+      return Status::InvalidArgument(
+          "WRONGTYPE, key: " + key.ToString() + ", expect type: " +
+          DataTypeStrings[static_cast<int>(DataType::kStrings)] + ", get type: " +
+          DataTypeStrings[static_cast<int>(GetMetaValueType(value))]);
     }
-    if (op == kBitOpNot) {
-      output = static_cast<char>(~output);
+  }
+  if (s.ok()) {
+    ParsedStringsValue parsed_strings_value(&value);
+    if (parsed_strings_value.IsStale()) {
+      return Status::NotFound("Stale");
     }
-    for (size_t i = 1; i < src_values.size(); i++) {
-      if (static_cast<int64_t>(src_values[i].size()) - 1 >= j) {
-        byte = src_values[i][j];
-      } else {
-        byte = 0;
-      }
-      switch (op) {
-        case kBitOpNot:
-          break;
-        case kBitOpAnd:
-          output = static_cast<char>(output & byte);
-          break;
-        case kBitOpOr:
-          output = static_cast<char>(output | byte);
-          break;
-        case kBitOpXor:
-          output = static_cast<char>(output ^ byte);
-          break;
-        case kBitOpDefault:
-          break;
-      }
-    }
-    dest_value[j] = output;
-  }
-  std::string dest_str(dest_value.get(), max_len);
-  return dest_str;
+    parsed_strings_value.StripSuffix();
+    if (parsed_strings_value.IsBitmapChunked()) {
+      BitmapChunkMeta bitmap_meta;
+      if (!bitmap_meta.Decode(value)) {
+        return Status::Corruption("bad chunked bitmap value");
+      }
+      *reader = BitmapReader(std::make_unique<ChunkedBitmap>(db_, handles_[kBitmapsDataCF], key, bitmap_meta));
+    } else {
+      *reader = BitmapReader(std::move(value));
+    }
+  }
+  return s;
+}
+
+Status Redis::BitOpStore(BitOpType op, const std::string& dest_key, std::vector<BitmapReader>* sources,
+                         std::string& value_to_dest, int64_t* ret) {
+  uint64_t max_len = 0;
+  for (const auto& source : *sources) {
+    max_len = std::max(max_len, source.Length());
+  }
+
+  // the sources are read a chunk at a time, a chunked one is never read whole
+  uint64_t step = bitmap_chunk_size_ > 0 ? bitmap_chunk_size_ : std::max<uint64_t>(max_len, 1);
+  value_to_dest.clear();
+  value_to_dest.reserve(max_len);
+  std::vector<std::string> src_chunks(sources->size());
+  for (uint64_t first = 0; first < max_len; first += step) {
+    uint64_t count = std::min(step, max_len - first);
+    for (size_t idx = 0; idx < sources->size(); ++idx) {
+      Status s = (*sources)[idx].Read(default_read_options_, first, count, &src_chunks[idx]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    value_to_dest.append(BitOpOperate(op, src_chunks, static_cast<int64_t>(count)));
+  }
+  *ret = static_cast<int64_t>(max_len);
+
+  ScopeRecordLock l(lock_mgr_, dest_key);
+  BaseKey base_dest_key(dest_key);
+  if (bitmap_chunk_size_ == 0 || max_len <= static_cast<uint64_t>(bitmap_chunk_size_)) {
+    StringsValue strings_value(value_to_dest);
+    return db_->Put(default_write_options_, base_dest_key.Encode(), strings_value.Encode());
+  }
+  rocksdb::WriteBatch batch;
+  ChunkedBitmap bitmap(db_, handles_[kBitmapsDataCF], dest_key, bitmap_chunk_size_);
+  bitmap.Assign(value_to_dest, &batch);
+  std::string bitmap_meta = bitmap.Meta().Encode();
+  StringsValue strings_value(bitmap_meta);
+  strings_value.SetBitmapChunked();
+  batch.Put(base_dest_key.Encode(), strings_value.Encode());
+  return db_->Write(default_write_options_, &batch);
 }
 
 Status Redis::BitOp(BitOpType op, const std::string& dest_key, const std::vector<std::string>& src_keys, std::string& value_to_dest, int64_t* ret) {
-  Status s;
   if (op == kBitOpNot && src_keys.size() != 1) {
     return Status::InvalidArgument("the number of source keys is not right");
   } else if (src_keys.empty()) {
     return Status::InvalidArgument("the number of source keys is not right");
   }
 
-  int64_t max_len = 0;
-  int64_t value_len = 0;
-  std::vector<std::string> src_values;
-  for (const auto & src_key : src_keys) {
-    std::string value;
-    BaseKey base_key(src_key);
-    s = db_->Get(default_read_options_, base_key.Encode(), &value);
-    if (s.ok() && !ExpectedMetaValue(DataType::kStrings, value)) {
-      if (ExpectedStale(value)) {
-        s = Status::NotFound();
-      } else {
-        return Status::InvalidArgument(
-          "WRONGTYPE, key: " + dest_key + ", expect type: " +
-          DataTypeStrings[static_cast<int>(DataType::kStrings)] + ", get type: " +
-          DataTypeStrings[static_cast<int>(GetMetaValueType(value))]);
-      }
-    }
-    if (s.ok()) {
-      ParsedStringsValue parsed_strings_value(&value);
-      if (parsed_strings_value.IsStale()) {
-        src_values.emplace_back("");
-        value_len = 0;
-      } else {
-        parsed_strings_value.StripSuffix();
-        src_values.push_back(value);
-        value_len = static_cast<int64_t>(value.size());
-      }
-    } else if (s.IsNotFound()) {
-      src_values.emplace_back("");
-      value_len = 0;
-    } else {
+  std::vector<BitmapReader> sources(src_keys.size());
+  for (size_t idx = 0; idx < src_keys.size(); ++idx) {
+    Status s = GetBitmapReader(src_keys[idx], &sources[idx]);
+    if (!s.ok() && !s.IsNotFound()) {
       return s;
     }
-    max_len = std::max(max_len, value_len);
   }
-
-  std::string dest_value = BitOpOperate(op, src_values, max_len);
-  value_to_dest = dest_value;
-  *ret = static_cast<int64_t>(dest_value.size());
-
-  StringsValue strings_value(Slice(dest_value.c_str(), max_len));
-  ScopeRecordLock l(lock_mgr_, dest_key);
-  BaseKey base_dest_key(dest_key);
-  return db_->Put(default_write_options_, base_dest_key.Encode(), strings_value.Encode());
+  return BitOpStore(op, dest_key, &sources, value_to_dest, ret);
 }
 
 Status Redis::Decrby(const Slice& key, int64_t value, int64_t* ret) {
@@ -301,6 +339,12 @@ Status Redis::Decrby(const Slice& key, int64_t value, int64_t* ret) {
     } else {
       uint64_t timestamp = parsed_strings_value.Etime();
       std::string old_user_value = parsed_strings_value.UserValue().ToString();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, &old_user_value);
+        if (!s.ok()) {
+          return s;
+        }
+      }
       char* end = nullptr;
       errno = 0;
       int64_t ival = strtoll(old_user_value.c_str(), &end, 10);
@@ -349,6 +393,9 @@ Status Redis::Get(const Slice& key, std::string* value) {
       return Status::NotFound("Stale");
     } else {
       parsed_strings_value.StripSuffix();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, value);
+      }
     }
   }
   return s;
@@ -370,6 +417,9 @@ Status Redis::MGet(const Slice& key, std::string* value) {
       return Status::NotFound("Stale");
     } else {
       parsed_strings_value.StripSuffix();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, value);
+      }
     }
   }
   return s;
@@ -416,7 +466,11 @@ Status Redis::GetWithTTL(const Slice& key, std::string* value, int64_t* ttl_mill
 
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(value);
-    return HandleParsedStringsValue(parsed_strings_value, value, ttl_millsec);
+    s = HandleParsedStringsValue(parsed_strings_value, value, ttl_millsec);
+    if (s.ok() && parsed_strings_value.IsBitmapChunked()) {
+      s = ExpandChunkedBitmap(key, value);
+    }
+    return s;
   } else if (s.IsNotFound()) {
     ClearValueAndSetTTL(value, ttl_millsec, -2);
   }
@@ -436,7 +490,11 @@ Status Redis::MGetWithTTL(const Slice& key, std::string* value, int64_t* ttl_mil
 
   if (s.ok()) {
     ParsedStringsValue parsed_strings_value(value);
-    return HandleParsedStringsValue(parsed_strings_value, value, ttl_millsec);
+    s = HandleParsedStringsValue(parsed_strings_value, value, ttl_millsec);
+    if (s.ok() && parsed_strings_value.IsBitmapChunked()) {
+      s = ExpandChunkedBitmap(key, value);
+    }
+    return s;
   } else if (s.IsNotFound()) {
     ClearValueAndSetTTL(value, ttl_millsec, -2);
   }
@@ -444,6 +502,109 @@ Status Redis::MGetWithTTL(const Slice& key, std::string* value, int64_t* ttl_mil
   return s;
 }
 
+void Redis::MultiGetMeta(const std::vector<std::string>& keys, std::vector<std::string>* values,
+                         std::vector<Status>* statuses) {
+  size_t num_keys = keys.size();
+  std::vector<std::string> encoded_keys;
+  std::vector<Slice> key_slices;
+  encoded_keys.reserve(num_keys);
+  key_slices.reserve(num_keys);
+  for (const auto& key : keys) {
+    BaseMetaKey base_meta_key(key);
+    encoded_keys.emplace_back(base_meta_key.Encode().ToString());
+  }
+  for (const auto& encoded_key : encoded_keys) {
+    key_slices.emplace_back(encoded_key);
+  }
+
+  // Batched MultiGet lets rocksdb sort the keys, coalesce the block cache
+  // lookups and issue the sst reads together instead of one Get per key
+  std::vector<rocksdb::PinnableSlice> pinnable_values(num_keys);
+  statuses->assign(num_keys, Status::OK());
+  db_->MultiGet(default_read_options_, handles_[kMetaCF], num_keys, key_slices.data(), pinnable_values.data(),
+                statuses->data());
+
+  values->clear();
+  values->resize(num_keys);
+  for (size_t idx = 0; idx < num_keys; ++idx) {
+    if ((*statuses)[idx].ok()) {
+      (*values)[idx].assign(pinnable_values[idx].data(), pinnable_values[idx].size());
+    }
+    pinnable_values[idx].Reset();
+  }
+}
+
+Status Redis::MGet(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss) {
+  vss->clear();
+  vss->reserve(keys.size());
+
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  MultiGetMeta(keys, &values, &statuses);
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    Status& s = statuses[idx];
+    std::string& value = values[idx];
+    if (s.ok() && !ExpectedMetaValue(DataType::kStrings, value)) {
+      s = Status::NotFound();
+    }
+    if (s.ok()) {
+      ParsedStringsValue parsed_strings_value(&value);
+      if (parsed_strings_value.IsStale()) {
+        vss->push_back({std::string(), Status::NotFound()});
+      } else {
+        parsed_strings_value.StripSuffix();
+        if (parsed_strings_value.IsBitmapChunked()) {
+          s = ExpandChunkedBitmap(keys[idx], &value);
+          if (!s.ok()) {
+            vss->clear();
+            return s;
+          }
+        }
+        vss->push_back({std::move(value), Status::OK()});
+      }
+    } else if (s.IsNotFound()) {
+      vss->push_back({std::string(), Status::NotFound()});
+    } else {
+      vss->clear();
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status Redis::MGetWithTTL(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss) {
+  vss->clear();
+  vss->reserve(keys.size());
+
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  MultiGetMeta(keys, &values, &statuses);
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    Status& s = statuses[idx];
+    std::string& value = values[idx];
+    int64_t ttl_millsec = -2;
+    if (s.ok() && !ExpectedMetaValue(DataType::kStrings, value)) {
+      s = Status::NotFound();
+    }
+    if (s.ok()) {
+      ParsedStringsValue parsed_strings_value(&value);
+      s = HandleParsedStringsValue(parsed_strings_value, &value, &ttl_millsec);
+      if (s.ok() && parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(keys[idx], &value);
+      }
+    }
+    if (s.ok()) {
+      vss->push_back({std::move(value), Status::OK(), ttl_millsec});
+    } else if (s.IsNotFound()) {
+      vss->push_back({std::string(), Status::NotFound(), -2});
+    } else {
+      vss->clear();
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
 Status Redis::GetBit(const Slice& key, int64_t offset, int32_t* ret) {
   std::string meta_value;
 
@@ -466,6 +627,13 @@ Status Redis::GetBit(const Slice& key, int64_t offset, int32_t* ret) {
       if (parsed_strings_value.IsStale()) {
         *ret = 0;
         return Status::OK();
+      } else if (parsed_strings_value.IsBitmapChunked()) {
+        BitmapChunkMeta bitmap_meta;
+        if (!bitmap_meta.Decode(parsed_strings_value.UserValue())) {
+          return Status::Corruption("bad chunked bitmap value");
+        }
+        ChunkedBitmap bitmap(db_, handles_[kBitmapsDataCF], key, bitmap_meta);
+        return bitmap.GetBit(default_read_options_, offset, ret);
       } else {
         data_value = parsed_strings_value.UserValue().ToString();
       }
@@ -505,7 +673,12 @@ Status Redis::Getrange(const Slice& key, int64_t start_offset, int64_t end_offse
       return Status::NotFound("Stale");
     } else {
       parsed_strings_value.StripSuffix();
-      auto size = static_cast<int64_t>(value.size());
+      BitmapChunkMeta bitmap_meta;
+      bool chunked = parsed_strings_value.IsBitmapChunked();
+      if (chunked && !bitmap_meta.Decode(value)) {
+        return Status::Corruption("bad chunked bitmap value");
+      }
+      auto size = static_cast<int64_t>(chunked ? bitmap_meta.length : value.size());
       int64_t start_t = start_offset >= 0 ? start_offset : size + start_offset;
       int64_t end_t = end_offset >= 0 ? end_offset : size + end_offset;
       if (start_t > size - 1 || (start_t != 0 && start_t > end_t) || (start_t != 0 && end_t < 0)) {
@@ -520,6 +693,11 @@ Status Redis::Getrange(const Slice& key, int64_t start_offset, int64_t end_offse
       if (start_t == 0 && end_t < 0) {
         end_t = 0;
       }
+      if (chunked) {
+        // read the chunks of the range only
+        ChunkedBitmap bitmap(db_, handles_[kBitmapsDataCF], key, bitmap_meta);
+        return bitmap.ReadRange(default_read_options_, start_t, end_t - start_t + 1, ret);
+      }
       *ret = value.substr(start_t, end_t - start_t + 1);
       return Status::OK();
     }
@@ -552,6 +730,12 @@ Status Redis::GetrangeWithValue(const Slice& key, int64_t start_offset, int64_t
       return Status::NotFound("Stale");
     } else {
       parsed_strings_value.StripSuffix();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, value);
+        if (!s.ok()) {
+          return s;
+        }
+      }
       // get ttl
       *ttl_millsec = parsed_strings_value.Etime();
       if (*ttl_millsec == 0) {
@@ -611,6 +795,12 @@ Status Redis::GetSet(const Slice& key, const Slice& value, std::string* old_valu
       *old_value = "";
     } else {
       parsed_strings_value.StripSuffix();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, old_value);
+        if (!s.ok()) {
+          return s;
+        }
+      }
     }
   } else if (!s.IsNotFound()) {
     return s;
@@ -645,6 +835,12 @@ Status Redis::Incrby(const Slice& key, int64_t value, int64_t* ret, int64_t* exp
     } else {
       uint64_t timestamp = parsed_strings_value.Etime();
       std::string old_user_value = parsed_strings_value.UserValue().ToString();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, &old_user_value);
+        if (!s.ok()) {
+          return s;
+        }
+      }
       char* end = nullptr;
       int64_t ival = strtoll(old_user_value.c_str(), &end, 10);
       if (*end != 0) {
@@ -654,10 +850,14 @@ Status Redis::Incrby(const Slice& key, int64_t value, int64_t* ret, int64_t* exp
         return Status::InvalidArgument("Overflow");
       }
       *ret = ival + value;
+      *expired_timestamp_millsec = timestamp;
+      if (strings_merge_ && !parsed_strings_value.IsBitmapChunked()) {
+        return db_->Merge(default_write_options_, base_key.Encode(),
+                          EncodeStringsMergeOperand(kStringsMergeIncrby, timestamp, EncodeIncrbyPayload(value)));
+      }
       new_value = std::to_string(*ret);
       StringsValue strings_value(new_value);
       strings_value.SetEtime(timestamp);
-      *expired_timestamp_millsec = timestamp;
       return db_->Put(default_write_options_, base_key.Encode(), strings_value.Encode());
     }
   } else if (s.IsNotFound()) {
@@ -702,6 +902,12 @@ Status Redis::Incrbyfloat(const Slice& key, const Slice& value, std::string* ret
     } else {
       uint64_t timestamp = parsed_strings_value.Etime();
       std::string old_user_value = parsed_strings_value.UserValue().ToString();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, &old_user_value);
+        if (!s.ok()) {
+          return s;
+        }
+      }
       long double total;
       long double old_number;
       if (StrToLongDouble(old_user_value.data(), old_user_value.size(), &old_number) == -1) {
@@ -712,9 +918,13 @@ Status Redis::Incrbyfloat(const Slice& key, const Slice& value, std::string* ret
         return Status::InvalidArgument("Overflow");
       }
       *ret = new_value;
+      *expired_timestamp_sec = timestamp;
+      if (strings_merge_ && !parsed_strings_value.IsBitmapChunked()) {
+        return db_->Merge(default_write_options_, base_key.Encode(),
+                          EncodeStringsMergeOperand(kStringsMergeIncrbyfloat, timestamp, value));
+      }
       StringsValue strings_value(new_value);
       strings_value.SetEtime(timestamp);
-      *expired_timestamp_sec = timestamp;
       return db_->Put(default_write_options_, base_key.Encode(), strings_value.Encode());
     }
   } else if (s.IsNotFound()) {
@@ -839,14 +1049,47 @@ Status Redis::SetBit(const Slice& key, int64_t offset, int32_t on, int32_t* ret)
   if (s.ok() || s.IsNotFound()) {
     std::string data_value;
     uint64_t timestamp = 0;
+    std::unique_ptr<ChunkedBitmap> bitmap;
     if (s.ok()) {
       ParsedStringsValue parsed_strings_value(&meta_value);
       if (!parsed_strings_value.IsStale()) {
-        data_value = parsed_strings_value.UserValue().ToString();
         timestamp = parsed_strings_value.Etime();
+        if (parsed_strings_value.IsBitmapChunked()) {
+          BitmapChunkMeta bitmap_meta;
+          if (!bitmap_meta.Decode(parsed_strings_value.UserValue())) {
+            return Status::Corruption("bad chunked bitmap value");
+          }
+          bitmap = std::make_unique<ChunkedBitmap>(db_, handles_[kBitmapsDataCF], key, bitmap_meta);
+        } else {
+          data_value = parsed_strings_value.UserValue().ToString();
+        }
       }
     }
     size_t byte = offset >> 3;
+    rocksdb::WriteBatch batch;
+    bool split = false;
+    if (bitmap == nullptr && bitmap_chunk_size_ > 0 &&
+        std::max(data_value.length(), byte + 1) > static_cast<size_t>(bitmap_chunk_size_)) {
+      // the bitmap outgrows a chunk, it moves into chunks before the bit is set
+      bitmap = std::make_unique<ChunkedBitmap>(db_, handles_[kBitmapsDataCF], key, bitmap_chunk_size_);
+      bitmap->Assign(data_value, &batch);
+      split = true;
+    }
+    if (bitmap != nullptr) {
+      uint64_t length = bitmap->Meta().length;
+      s = bitmap->SetBit(default_read_options_, offset, on, ret, &batch);
+      if (!s.ok() || *ret == on) {
+        return s;
+      }
+      if (split || bitmap->Meta().length != length) {
+        std::string bitmap_meta = bitmap->Meta().Encode();
+        StringsValue strings_value(bitmap_meta);
+        strings_value.SetBitmapChunked();
+        strings_value.SetEtime(timestamp);
+        batch.Put(base_key.Encode(), strings_value.Encode());
+      }
+      return db_->Write(default_write_options_, &batch);
+    }
     size_t bit = 7 - (offset & 0x7);
     char byte_val;
     size_t value_lenth = data_value.length();
@@ -941,7 +1184,14 @@ Status Redis::Setvx(const Slice& key, const Slice& value, const Slice& new_value
     if (parsed_strings_value.IsStale()) {
       *ret = 0;
     } else {
-      if (value.compare(parsed_strings_value.UserValue()) == 0) {
+      std::string old_user_value = parsed_strings_value.UserValue().ToString();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, &old_user_value);
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      if (value.compare(old_user_value) == 0) {
         StringsValue strings_value(new_value);
         if (ttl_millsec > 0) {
           strings_value.SetRelativeTimeInMillsec(ttl_millsec);
@@ -986,7 +1236,14 @@ Status Redis::Delvx(const Slice& key, const Slice& value, int32_t* ret) {
       *ret = 0;
       return Status::NotFound("Stale");
     } else {
-      if (value.compare(parsed_strings_value.UserValue()) == 0) {
+      std::string old_user_value = parsed_strings_value.UserValue().ToString();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, &old_user_value);
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      if (value.compare(old_user_value) == 0) {
         *ret = 1;
         return db_->Delete(default_write_options_, base_key.Encode());
       } else {
@@ -1027,8 +1284,20 @@ Status Redis::Setrange(const Slice& key, int64_t start_offset, const Slice& valu
       std::string tmp(start_offset, '\0');
       new_value = tmp.append(value.data());
       *ret = static_cast<int32_t>(new_value.length());
+    } else if (strings_merge_ && !parsed_strings_value.IsBitmapChunked()) {
+      timestamp = parsed_strings_value.Etime();
+      *ret = static_cast<int32_t>(std::max(old_value.length(), static_cast<size_t>(start_offset) + value.size()));
+      return db_->Merge(default_write_options_, base_key.Encode(),
+                        EncodeStringsMergeOperand(kStringsMergeSetrange, timestamp,
+                                                  EncodeSetrangePayload(start_offset, value)));
     } else {
       timestamp = parsed_strings_value.Etime();
+      if (parsed_strings_value.IsBitmapChunked()) {
+        s = ExpandChunkedBitmap(key, &old_value);
+        if (!s.ok()) {
+          return s;
+        }
+      }
       if (static_cast<size_t>(start_offset) > old_value.length()) {
         old_value.resize(start_offset);
         new_value = old_value.append(value.data());
@@ -1056,60 +1325,49 @@ Status Redis::Setrange(const Slice& key, int64_t start_offset, const Slice& valu
 }
 
 Status Redis::Strlen(const Slice& key, int32_t* len) {
+  *len = 0;
   std::string value;
-  Status s = Get(key, &value);
+  BaseKey base_key(key);
+  Status s = db_->Get(default_read_options_, base_key.Encode(), &value);
+  if (s.ok() && !ExpectedMetaValue(DataType::kStrings, value)) {
+    if (ExpectedStale(value)) {
+      s = Status::NotFound();
+    } else {
+      return Status::InvalidArgument(
+          "WRONGTYPE, key: " + key.ToString() + ", expect type: " +
+          DataTypeStrings[static_cast<int>(DataType::kStrings)] + ", get type: " +
+          DataTypeStrings[static_cast<int>(GetMetaValueType(value))]);
+    }
+  }
   if (s.ok()) {
-    *len = static_cast<int32_t>(value.size());
-  } else {
-    *len = 0;
+    ParsedStringsValue parsed_strings_value(&value);
+    if (parsed_strings_value.IsStale()) {
+      return Status::NotFound("Stale");
+    }
+    parsed_strings_value.StripSuffix();
+    // the length of a chunked bitmap is in its meta, its chunks are not read
+    if (parsed_strings_value.IsBitmapChunked()) {
+      BitmapChunkMeta bitmap_meta;
+      if (!bitmap_meta.Decode(value)) {
+        return Status::Corruption("bad chunked bitmap value");
+      }
+      *len = static_cast<int32_t>(bitmap_meta.length);
+    } else {
+      *len = static_cast<int32_t>(value.size());
+    }
   }
   return s;
 }
 
-int32_t GetBitPos(const unsigned char* s, unsigned int bytes, int bit) {
-  uint64_t word = 0;
-  uint64_t skip_val = 0;
-  auto value = const_cast<unsigned char*>(s);
-  auto l = reinterpret_cast<uint64_t*>(value);
-  int pos = 0;
-  if (bit == 0) {
-    skip_val = std::numeric_limits<uint64_t>::max();
-  } else {
-    skip_val = 0;
+// the position of the first bit in s[0, bytes) equal to bit, -1 when there
+// is no 1 and 8 * bytes when there is no 0
+int64_t GetBitPos(const unsigned char* s, uint64_t bytes, int bit) {
+  uint64_t byte = SkipBytes(s, bytes, bit == 0 ? 0xff : 0x00);
+  if (byte == bytes) {
+    return bit == 1 ? -1 : static_cast<int64_t>(8 * bytes);
   }
-  // skip 8 bytes at one time, find the first int64 that should not be skipped
-  while (bytes >= sizeof(*l)) {
-    if (*l != skip_val) {
-      break;
-    }
-    l++;
-    bytes = bytes - sizeof(*l);
-    pos += static_cast<int32_t>(8 * sizeof(*l));
-  }
-  auto c = reinterpret_cast<unsigned char*>(l);
-  for (size_t j = 0; j < sizeof(*l); j++) {
-    word = word << 8;
-    if (bytes != 0U) {
-      word = word | *c;
-      c++;
-      bytes--;
-    }
-  }
-  if (bit == 1 && word == 0) {
-    return -1;
-  }
-  // set each bit of mask to 0 except msb
-  uint64_t mask = std::numeric_limits<uint64_t>::max();
-  mask = mask >> 1;
-  mask = ~(mask);
-  while (mask != 0U) {
-    if (static_cast<int>((word & mask) != 0) == bit) {
-      return pos;
-    }
-    pos++;
-    mask = mask >> 1;
-  }
-  return pos;
+  unsigned int value = bit == 0 ? static_cast<unsigned char>(~s[byte]) : s[byte];
+  return static_cast<int64_t>(8 * byte) + __builtin_clz(value) - 24;
 }
 
 Status Redis::BitPos(const Slice& key, int32_t bit, int64_t* ret) {
@@ -1139,10 +1397,18 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t* ret) {
       return Status::NotFound("Stale");
     } else {
       parsed_strings_value.StripSuffix();
+      BitmapChunkMeta bitmap_meta;
+      bool chunked = parsed_strings_value.IsBitmapChunked();
+      if (chunked && !bitmap_meta.Decode(value)) {
+        return Status::Corruption("bad chunked bitmap value");
+      }
       const auto bit_value = reinterpret_cast<const unsigned char*>(value.data());
-      auto value_length = static_cast<int64_t>(value.length());
+      auto value_length = static_cast<int64_t>(chunked ? bitmap_meta.length : value.length());
       int64_t start_offset = 0;
       int64_t end_offset = std::max(value_length - 1, static_cast<int64_t>(0));
+      if (chunked) {
+        return ChunkedBitPos(key, bitmap_meta, bit, start_offset, end_offset, ret);
+      }
       int64_t bytes = end_offset - start_offset + 1;
       int64_t pos = GetBitPos(bit_value + start_offset, bytes, bit);
       if (pos == (8 * bytes) && bit == 0) {
@@ -1186,8 +1452,13 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
       return Status::NotFound("Stale");
     } else {
       parsed_strings_value.StripSuffix();
+      BitmapChunkMeta bitmap_meta;
+      bool chunked = parsed_strings_value.IsBitmapChunked();
+      if (chunked && !bitmap_meta.Decode(value)) {
+        return Status::Corruption("bad chunked bitmap value");
+      }
       const auto bit_value = reinterpret_cast<const unsigned char*>(value.data());
-      auto value_length = static_cast<int64_t>(value.length());
+      auto value_length = static_cast<int64_t>(chunked ? bitmap_meta.length : value.length());
       int64_t end_offset = std::max(value_length - 1, static_cast<int64_t>(0));
       if (start_offset < 0) {
         start_offset = start_offset + value_length;
@@ -1203,6 +1474,9 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
         *ret = -1;
         return Status::OK();
       }
+      if (chunked) {
+        return ChunkedBitPos(key, bitmap_meta, bit, start_offset, end_offset, ret);
+      }
       int64_t bytes = end_offset - start_offset + 1;
       int64_t pos = GetBitPos(bit_value + start_offset, bytes, bit);
       if (pos == (8 * bytes) && bit == 0) {
@@ -1246,8 +1520,13 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
       return Status::NotFound("Stale");
     } else {
       parsed_strings_value.StripSuffix();
+      BitmapChunkMeta bitmap_meta;
+      bool chunked = parsed_strings_value.IsBitmapChunked();
+      if (chunked && !bitmap_meta.Decode(value)) {
+        return Status::Corruption("bad chunked bitmap value");
+      }
       const auto bit_value = reinterpret_cast<const unsigned char*>(value.data());
-      auto value_length = static_cast<int64_t>(value.length());
+      auto value_length = static_cast<int64_t>(chunked ? bitmap_meta.length : value.length());
       if (start_offset < 0) {
         start_offset = start_offset + value_length;
       }
@@ -1258,7 +1537,7 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
         end_offset = end_offset + value_length;
       }
       // converting to int64_t just avoid warning
-      if (end_offset > static_cast<int64_t>(value.length()) - 1) {
+      if (end_offset > value_length - 1) {
         end_offset = value_length - 1;
       }
       if (end_offset < 0) {
@@ -1272,6 +1551,9 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
         *ret = -1;
         return Status::OK();
       }
+      if (chunked) {
+        return ChunkedBitPos(key, bitmap_meta, bit, start_offset, end_offset, ret);
+      }
       int64_t bytes = end_offset - start_offset + 1;
       int64_t pos = GetBitPos(bit_value + start_offset, bytes, bit);
       if (pos == (8 * bytes) && bit == 0) {
@@ -1288,6 +1570,44 @@ Status Redis::BitPos(const Slice& key, int32_t bit, int64_t start_offset, int64_
   return Status::OK();
 }
 
+Status Redis::ChunkedBitPos(const Slice& key, const BitmapChunkMeta& bitmap_meta, int32_t bit, int64_t start_offset,
+                            int64_t end_offset, int64_t* ret) {
+  *ret = -1;
+  ChunkedBitmap bitmap(db_, handles_[kBitmapsDataCF], key, bitmap_meta);
+  uint64_t chunk_size = bitmap_meta.chunk_size;
+  return bitmap.ForEachChunk(
+      default_read_options_, start_offset, end_offset, [&](uint64_t chunk_index, const Slice& bytes) {
+        uint64_t chunk_start = chunk_index * chunk_size;
+        uint64_t from = std::max<uint64_t>(start_offset, chunk_start);
+        uint64_t to = std::min<uint64_t>(end_offset + 1, chunk_start + chunk_size);
+        uint64_t present_to = std::min<uint64_t>(to, chunk_start + bytes.size());
+        if (from < present_to) {
+          int64_t pos = GetBitPos(reinterpret_cast<const unsigned char*>(bytes.data()) + (from - chunk_start),
+                                  present_to - from, bit);
+          if (pos != -1 && pos < static_cast<int64_t>(8 * (present_to - from))) {
+            *ret = static_cast<int64_t>(8 * from) + pos;
+            return false;
+          }
+        }
+        // the bytes a chunk leaves out are zero
+        uint64_t zero_from = std::max(from, present_to);
+        if (bit == 0 && zero_from < to) {
+          *ret = static_cast<int64_t>(8 * zero_from);
+          return false;
+        }
+        return true;
+      });
+}
+
+Status Redis::ExpandChunkedBitmap(const Slice& key, std::string* value) {
+  BitmapChunkMeta bitmap_meta;
+  if (!bitmap_meta.Decode(*value)) {
+    return Status::Corruption("bad chunked bitmap value");
+  }
+  ChunkedBitmap bitmap(db_, handles_[kBitmapsDataCF], key, bitmap_meta);
+  return bitmap.ReadAll(default_read_options_, value);
+}
+
 //TODO(wangshaoyi): timestamp uint64_t
 Status Redis::PKSetexAt(const Slice& key, const Slice& value, int64_t time_stamp_millsec_) {
   StringsValue strings_value(value);
@@ -1514,36 +1834,63 @@ void Redis::ScanStrings() {
 
 rocksdb::Status Redis::Exists(const Slice& key) {
   std::string meta_value;
-  uint64_t llen = 0;
-  int32_t ret = 0;
   BaseMetaKey base_meta_key(key);
-  std::vector<storage::IdMessage> id_messages;
-  storage::StreamScanArgs arg;
-  storage::StreamUtils::StreamParseIntervalId("-", arg.start_sid, &arg.start_ex, 0);
-  storage::StreamUtils::StreamParseIntervalId("+", arg.end_sid, &arg.end_ex, UINT64_MAX);
   rocksdb::Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (s.ok()) {
-    auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
-    switch (type) {
-      case DataType::kSets:
-        return SCard(key, &ret, std::move(meta_value));
-      case DataType::kZSets:
-        return ZCard(key, &ret, std::move(meta_value));
-      case DataType::kHashes:
-        return HLen(key, &ret, std::move(meta_value));
-      case DataType::kLists:
-        return LLen(key, &llen, std::move(meta_value));
-      case DataType::kStreams:
-        return XRange(key, arg, id_messages, std::move(meta_value));
-      case DataType::kStrings:
-        return ExpectedStale(meta_value) ? rocksdb::Status::NotFound() : rocksdb::Status::OK();
-      default:
-        return rocksdb::Status::NotFound();
-    }
+    return ExistsWithMetaValue(key, std::move(meta_value));
   }
   return rocksdb::Status::NotFound();
 }
 
+rocksdb::Status Redis::Exists(const std::vector<std::string>& keys, int64_t* count) {
+  *count = 0;
+  std::vector<std::string> meta_values;
+  std::vector<Status> statuses;
+  MultiGetMeta(keys, &meta_values, &statuses);
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    if (!statuses[idx].ok()) {
+      if (!statuses[idx].IsNotFound()) {
+        return statuses[idx];
+      }
+      continue;
+    }
+    rocksdb::Status s = ExistsWithMetaValue(keys[idx], std::move(meta_values[idx]));
+    if (s.ok()) {
+      (*count)++;
+    } else if (!s.IsNotFound()) {
+      return s;
+    }
+  }
+  return rocksdb::Status::OK();
+}
+
+rocksdb::Status Redis::ExistsWithMetaValue(const Slice& key, std::string&& meta_value) {
+  uint64_t llen = 0;
+  int32_t ret = 0;
+  auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
+  switch (type) {
+    case DataType::kSets:
+      return SCard(key, &ret, std::move(meta_value));
+    case DataType::kZSets:
+      return ZCard(key, &ret, std::move(meta_value));
+    case DataType::kHashes:
+      return HLen(key, &ret, std::move(meta_value));
+    case DataType::kLists:
+      return LLen(key, &llen, std::move(meta_value));
+    case DataType::kStreams: {
+      std::vector<storage::IdMessage> id_messages;
+      storage::StreamScanArgs arg;
+      storage::StreamUtils::StreamParseIntervalId("-", arg.start_sid, &arg.start_ex, 0);
+      storage::StreamUtils::StreamParseIntervalId("+", arg.end_sid, &arg.end_ex, UINT64_MAX);
+      return XRange(key, arg, id_messages, std::move(meta_value));
+    }
+    case DataType::kStrings:
+      return ExpectedStale(meta_value) ? rocksdb::Status::NotFound() : rocksdb::Status::OK();
+    default:
+      return rocksdb::Status::NotFound();
+  }
+}
+
 rocksdb::Status Redis::Del(const Slice& key) {
   std::string meta_value;
   BaseMetaKey base_meta_key(key);
@@ -1570,6 +1917,105 @@ rocksdb::Status Redis::Del(const Slice& key) {
   return rocksdb::Status::NotFound();
 }
 
+rocksdb::Status Redis::Del(const std::vector<std::string>& keys, int64_t* count) {
+  *count = 0;
+  MultiScopeRecordLock ml(lock_mgr_, keys);
+
+  std::vector<std::string> meta_values;
+  std::vector<Status> statuses;
+  MultiGetMeta(keys, &meta_values, &statuses);
+
+  rocksdb::WriteBatch batch;
+  std::unordered_set<std::string> deleted_keys;
+  std::vector<std::tuple<DataType, std::string, uint64_t>> statistics;
+  std::vector<std::pair<std::string, uint64_t>> dropped_versions;
+  std::vector<std::tuple<DataType, std::string, uint64_t, uint64_t>> reclaim_ranges;
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    if (!statuses[idx].ok()) {
+      if (statuses[idx].IsNotFound()) {
+        continue;
+      }
+      return statuses[idx];
+    }
+    const std::string& key = keys[idx];
+    if (deleted_keys.find(key) != deleted_keys.end()) {
+      continue;
+    }
+
+    std::string& meta_value = meta_values[idx];
+    BaseMetaKey base_meta_key(key);
+    auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
+    switch (type) {
+      case DataType::kStrings: {
+        ParsedStringsValue parsed_strings_value(&meta_value);
+        if (parsed_strings_value.IsStale()) {
+          continue;
+        }
+        batch.Delete(handles_[kMetaCF], base_meta_key.Encode());
+        break;
+      }
+      case DataType::kSets:
+      case DataType::kZSets:
+      case DataType::kHashes: {
+        ParsedBaseMetaValue parsed_base_meta_value(&meta_value);
+        if (parsed_base_meta_value.IsStale() || parsed_base_meta_value.Count() == 0) {
+          continue;
+        }
+        statistics.emplace_back(type, key, parsed_base_meta_value.Count());
+        dropped_versions.emplace_back(key, parsed_base_meta_value.Version());
+        reclaim_ranges.emplace_back(type, key, parsed_base_meta_value.Version(), parsed_base_meta_value.Count());
+        parsed_base_meta_value.InitialMetaValue();
+        batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+        break;
+      }
+      case DataType::kLists: {
+        ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
+        if (parsed_lists_meta_value.IsStale() || parsed_lists_meta_value.Count() == 0) {
+          continue;
+        }
+        statistics.emplace_back(type, key, parsed_lists_meta_value.Count());
+        dropped_versions.emplace_back(key, parsed_lists_meta_value.Version());
+        parsed_lists_meta_value.InitialMetaValue();
+        batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+        break;
+      }
+      case DataType::kStreams: {
+        StreamMetaValue stream_meta_value;
+        stream_meta_value.ParseFrom(meta_value);
+        if (stream_meta_value.length() == 0) {
+          continue;
+        }
+        statistics.emplace_back(type, key, stream_meta_value.length());
+        stream_meta_value.InitMetaValue();
+        batch.Put(handles_[kMetaCF], base_meta_key.Encode(), stream_meta_value.value());
+        break;
+      }
+      default:
+        continue;
+    }
+    deleted_keys.insert(key);
+  }
+
+  if (deleted_keys.empty()) {
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status s = db_->Write(default_write_options_, &batch);
+  if (!s.ok()) {
+    return s;
+  }
+  *count = static_cast<int64_t>(deleted_keys.size());
+  for (const auto& [type, key, statistic] : statistics) {
+    UpdateSpecificKeyStatistics(type, key, statistic);
+  }
+  for (const auto& [key, version] : dropped_versions) {
+    AddDroppedVersion(key, version);
+  }
+  for (const auto& [type, key, version, statistic] : reclaim_ranges) {
+    AddReclaimRangeTaskIfNeeded(type, key, version, statistic);
+  }
+  return s;
+}
+
 rocksdb::Status Redis::Expire(const Slice& key, int64_t ttl_millsec) {
   std::string meta_value;
   BaseMetaKey base_meta_key(key);
@@ -1692,7 +2138,9 @@ rocksdb::Status Redis::IsExist(const storage::Slice& key) {
 /*
  * Example Delete the specified prefix key
  */
-rocksdb::Status Redis::PKPatternMatchDelWithRemoveKeys(const std::string& pattern, int64_t* ret, std::vector<std::string>* remove_keys, const int64_t& max_count) {
+rocksdb::Status Redis::PKPatternMatchDelWithRemoveKeys(const std::string& pattern, int64_t* ret,
+                                                       std::vector<std::string>* remove_keys,
+                                                       std::atomic<int64_t>* remaining) {
   rocksdb::ReadOptions iterator_options;
   const rocksdb::Snapshot* snapshot;
   ScopeSnapshot ss(db_, &snapshot);
@@ -1704,9 +2152,16 @@ rocksdb::Status Redis::PKPatternMatchDelWithRemoveKeys(const std::string& patter
   int64_t total_delete = 0;
   rocksdb::Status s;
   rocksdb::WriteBatch batch;
+  // takes one key from the budget shared by all instances
+  auto take_one = [remaining]() {
+    int64_t left = remaining->load();
+    while (left > 0 && !remaining->compare_exchange_weak(left, left - 1)) {
+    }
+    return left > 0;
+  };
   rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[kMetaCF]);
   iter->SeekToFirst();
-  while (iter->Valid() && static_cast<int64_t>(batch.Count()) < max_count) {
+  while (iter->Valid() && remaining->load() > 0) {
     auto meta_type = static_cast<enum DataType>(static_cast<uint8_t>(iter->value()[0]));
     ParsedBaseMetaKey parsed_meta_key(iter->key().ToString());
     key = iter->key().ToString();
@@ -1715,7 +2170,8 @@ rocksdb::Status Redis::PKPatternMatchDelWithRemoveKeys(const std::string& patter
     if (meta_type == DataType::kStrings) {
       ParsedStringsValue parsed_strings_value(&meta_value);
       if (!parsed_strings_value.IsStale() &&
-          (StringMatch(pattern.data(), pattern.size(), parsed_meta_key.Key().data(), parsed_meta_key.Key().size(), 0) != 0)) {
+          (StringMatch(pattern.data(), pattern.size(), parsed_meta_key.Key().data(), parsed_meta_key.Key().size(), 0) != 0) &&
+          take_one()) {
         batch.Delete(key);
         remove_keys->push_back(parsed_meta_key.Key().data());
       }
@@ -1723,7 +2179,7 @@ rocksdb::Status Redis::PKPatternMatchDelWithRemoveKeys(const std::string& patter
       ParsedListsMetaValue parsed_lists_meta_value(&meta_value);
       if (!parsed_lists_meta_value.IsStale() && (parsed_lists_meta_value.Count() != 0U) &&
           (StringMatch(pattern.data(), pattern.size(), parsed_meta_key.Key().data(), parsed_meta_key.Key().size(), 0) !=
-           0)) {
+           0) && take_one()) {
         parsed_lists_meta_value.InitialMetaValue();
         batch.Put(handles_[kMetaCF], iter->key(), meta_value);
         remove_keys->push_back(parsed_meta_key.Key().data());
@@ -1732,7 +2188,8 @@ rocksdb::Status Redis::PKPatternMatchDelWithRemoveKeys(const std::string& patter
       StreamMetaValue stream_meta_value;
       stream_meta_value.ParseFrom(meta_value);
       if ((stream_meta_value.length() != 0) &&
-          (StringMatch(pattern.data(), pattern.size(), parsed_meta_key.Key().data(), parsed_meta_key.Key().size(), 0) != 0)) {
+          (StringMatch(pattern.data(), pattern.size(), parsed_meta_key.Key().data(), parsed_meta_key.Key().size(), 0) != 0) &&
+          take_one()) {
         stream_meta_value.InitMetaValue();
         batch.Put(handles_[kMetaCF], key, stream_meta_value.value());
         remove_keys->push_back(parsed_meta_key.Key().data());
@@ -1741,7 +2198,7 @@ rocksdb::Status Redis::PKPatternMatchDelWithRemoveKeys(const std::string& patter
       ParsedBaseMetaValue parsed_meta_value(&meta_value);
       if (!parsed_meta_value.IsStale() && (parsed_meta_value.Count() != 0) &&
           (StringMatch(pattern.data(), pattern.size(), parsed_meta_key.Key().data(), parsed_meta_key.Key().size(), 0) !=
-           0)) {
+           0) && take_one()) {
         parsed_meta_value.InitialMetaValue();
         batch.Put(handles_[kMetaCF], iter->key(), meta_value);
         remove_keys->push_back(parsed_meta_key.Key().data());
@@ -1756,6 +2213,7 @@ rocksdb::Status Redis::PKPatternMatchDelWithRemoveKeys(const std::string& patter
       batch.Clear();
     } else {
       remove_keys->erase(remove_keys->end() - batch.Count(), remove_keys->end());
+      remaining->fetch_add(static_cast<int64_t>(batch.Count()));
     }
   }
 
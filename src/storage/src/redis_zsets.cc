@@ -38,7 +38,7 @@ Status Redis::ScanZsetsKeyNum(KeyInfo* key_info) {
 
   pstd::TimeType curtime = pstd::NowMillis();
 
-  rocksdb::Iterator* iter = db_->NewIterator(iterator_options, handles_[kMetaCF]);
+  rocksdb::Iterator* iter = NewTypeIndexIterator(iterator_options, DataType::kZSets);
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
     if (!ExpectedMetaValue(DataType::kZSets, iter->value().ToString())) {
       continue;
@@ -94,17 +94,21 @@ Status Redis::ZPopMax(const Slice& key, const int64_t count, std::vector<ScoreMe
       uint64_t version = parsed_zsets_meta_value.Version();
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::max(), Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
-      rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kZsetsScoreCF]);
+      rocksdb::ReadOptions iter_options(default_read_options_);
+      iter_options.prefix_same_as_start = true;
+      rocksdb::Iterator* iter = db_->NewIterator(iter_options, handles_[kZsetsScoreCF]);
+      ZSetsRankIndex rank_index(db_, handles_, key, version, parsed_zsets_meta_value.IsRankIndexed());
       int32_t del_cnt = 0;
       for (iter->SeekForPrev(zsets_score_key.Encode()); iter->Valid() && del_cnt < num; iter->Prev()) {
         ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
         score_members->emplace_back(
             ScoreMember{parsed_zsets_score_key.score(), parsed_zsets_score_key.member().ToString()});
-        ZSetsMemberKey zsets_member_key(key, version, parsed_zsets_score_key.member());
+        ZSetsMemberKey zsets_member_key(key, version, parsed_zsets_score_key.member(), data_format_);
         ++statistic;
         ++del_cnt;
         batch.Delete(handles_[kZsetsDataCF], zsets_member_key.Encode());
         batch.Delete(handles_[kZsetsScoreCF], iter->key());
+        rank_index.Remove(parsed_zsets_score_key.score(), parsed_zsets_score_key.member());
       }
       delete iter;
       if (!parsed_zsets_meta_value.CheckModifyCount(-del_cnt)) {
@@ -112,7 +116,14 @@ Status Redis::ZPopMax(const Slice& key, const int64_t count, std::vector<ScoreMe
       }
       parsed_zsets_meta_value.ModifyCount(-del_cnt);
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      s = rank_index.Flush(&batch);
+      if (!s.ok()) {
+        return s;
+      }
       s = db_->Write(default_write_options_, &batch);
+      if (s.ok()) {
+        MaintainZsetsRankIndex(key, parsed_zsets_meta_value.Count(), &rank_index);
+      }
       UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
       return s;
     }
@@ -152,17 +163,21 @@ Status Redis::ZPopMin(const Slice& key, const int64_t count, std::vector<ScoreMe
       uint64_t version = parsed_zsets_meta_value.Version();
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
-      rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kZsetsScoreCF]);
+      rocksdb::ReadOptions iter_options(default_read_options_);
+      iter_options.prefix_same_as_start = true;
+      rocksdb::Iterator* iter = db_->NewIterator(iter_options, handles_[kZsetsScoreCF]);
+      ZSetsRankIndex rank_index(db_, handles_, key, version, parsed_zsets_meta_value.IsRankIndexed());
       int32_t del_cnt = 0;
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && del_cnt < num; iter->Next()) {
         ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
         score_members->emplace_back(
             ScoreMember{parsed_zsets_score_key.score(), parsed_zsets_score_key.member().ToString()});
-        ZSetsMemberKey zsets_member_key(key, version, parsed_zsets_score_key.member());
+        ZSetsMemberKey zsets_member_key(key, version, parsed_zsets_score_key.member(), data_format_);
         ++statistic;
         ++del_cnt;
         batch.Delete(handles_[kZsetsDataCF], zsets_member_key.Encode());
         batch.Delete(handles_[kZsetsScoreCF], iter->key());
+        rank_index.Remove(parsed_zsets_score_key.score(), parsed_zsets_score_key.member());
       }
       delete iter;
       if (!parsed_zsets_meta_value.CheckModifyCount(-del_cnt)) {
@@ -170,7 +185,14 @@ Status Redis::ZPopMin(const Slice& key, const int64_t count, std::vector<ScoreMe
       }
       parsed_zsets_meta_value.ModifyCount(-del_cnt);
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      s = rank_index.Flush(&batch);
+      if (!s.ok()) {
+        return s;
+      }
       s = db_->Write(default_write_options_, &batch);
+      if (s.ok()) {
+        MaintainZsetsRankIndex(key, parsed_zsets_meta_value.Count(), &rank_index);
+      }
       UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
       return s;
     }
@@ -193,6 +215,8 @@ Status Redis::ZAdd(const Slice& key, const std::vector<ScoreMember>& score_membe
 
   char score_buf[8];
   uint64_t version = 0;
+  int32_t zset_count = 0;
+  std::unique_ptr<ZSetsRankIndex> rank_index;
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
@@ -219,12 +243,13 @@ Status Redis::ZAdd(const Slice& key, const std::vector<ScoreMember>& score_membe
       vaild = true;
       version = parsed_zsets_meta_value.Version();
     }
+    rank_index = std::make_unique<ZSetsRankIndex>(db_, handles_, key, version, parsed_zsets_meta_value.IsRankIndexed());
 
     int32_t cnt = 0;
     std::string data_value;
     for (const auto& sm : filtered_score_members) {
       bool not_found = true;
-      ZSetsMemberKey zsets_member_key(key, version, sm.member);
+      ZSetsMemberKey zsets_member_key(key, version, sm.member, data_format_);
       if (vaild) {
         s = db_->Get(default_read_options_, handles_[kZsetsDataCF], zsets_member_key.Encode(), &data_value);
         if (s.ok()) {
@@ -239,6 +264,7 @@ Status Redis::ZAdd(const Slice& key, const std::vector<ScoreMember>& score_membe
           } else {
             ZSetsScoreKey zsets_score_key(key, version, old_score, sm.member);
             batch.Delete(handles_[kZsetsScoreCF], zsets_score_key.Encode());
+            rank_index->Remove(old_score, sm.member);
             // delete old zsets_score_key and overwirte zsets_member_key
             // but in different column_families so we accumulative 1
             statistic++;
@@ -250,12 +276,13 @@ Status Redis::ZAdd(const Slice& key, const std::vector<ScoreMember>& score_membe
 
       const void* ptr_score = reinterpret_cast<const void*>(&sm.score);
       EncodeFixed64(score_buf, *reinterpret_cast<const uint64_t*>(ptr_score));
-      BaseDataValue zsets_member_i_val(Slice(score_buf, sizeof(uint64_t)));
+      BaseDataValue zsets_member_i_val(Slice(score_buf, sizeof(uint64_t)), data_format_);
       batch.Put(handles_[kZsetsDataCF], zsets_member_key.Encode(), zsets_member_i_val.Encode());
 
       ZSetsScoreKey zsets_score_key(key, version, sm.score, sm.member);
-      BaseDataValue zsets_score_i_val(Slice{});
+      BaseDataValue zsets_score_i_val(Slice{}, data_format_);
       batch.Put(handles_[kZsetsScoreCF], zsets_score_key.Encode(), zsets_score_i_val.Encode());
+      rank_index->Add(sm.score, sm.member);
       if (not_found) {
         cnt++;
       }
@@ -265,22 +292,29 @@ Status Redis::ZAdd(const Slice& key, const std::vector<ScoreMember>& score_membe
     }
     parsed_zsets_meta_value.ModifyCount(cnt);
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+    s = rank_index->Flush(&batch);
+    if (!s.ok()) {
+      return s;
+    }
+    zset_count = parsed_zsets_meta_value.Count();
     *ret = cnt;
   } else if (s.IsNotFound()) {
     char buf[4];
     EncodeFixed32(buf, filtered_score_members.size());
     ZSetsMetaValue zsets_meta_value(DataType::kZSets, Slice(buf, 4));
     version = zsets_meta_value.UpdateVersion();
+    rank_index = std::make_unique<ZSetsRankIndex>(db_, handles_, key, version, false);
+    zset_count = static_cast<int32_t>(filtered_score_members.size());
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), zsets_meta_value.Encode());
     for (const auto& sm : filtered_score_members) {
-      ZSetsMemberKey zsets_member_key(key, version, sm.member);
+      ZSetsMemberKey zsets_member_key(key, version, sm.member, data_format_);
       const void* ptr_score = reinterpret_cast<const void*>(&sm.score);
       EncodeFixed64(score_buf, *reinterpret_cast<const uint64_t*>(ptr_score));
-      BaseDataValue zsets_member_i_val(Slice(score_buf, sizeof(uint64_t)));
+      BaseDataValue zsets_member_i_val(Slice(score_buf, sizeof(uint64_t)), data_format_);
       batch.Put(handles_[kZsetsDataCF], zsets_member_key.Encode(), zsets_member_i_val.Encode());
 
       ZSetsScoreKey zsets_score_key(key, version, sm.score, sm.member);
-      BaseDataValue zsets_score_i_val(Slice{});
+      BaseDataValue zsets_score_i_val(Slice{}, data_format_);
       batch.Put(handles_[kZsetsScoreCF], zsets_score_key.Encode(), zsets_score_i_val.Encode());
     }
     *ret = static_cast<int32_t>(filtered_score_members.size());
@@ -288,6 +322,9 @@ Status Redis::ZAdd(const Slice& key, const std::vector<ScoreMember>& score_membe
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
+  if (s.ok()) {
+    MaintainZsetsRankIndex(key, zset_count, rank_index.get());
+  }
   UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
   return s;
 }
@@ -365,6 +402,7 @@ Status Redis::ZCount(const Slice& key, double min, double max, bool left_close,
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, min, Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         bool left_pass = false;
@@ -403,6 +441,8 @@ Status Redis::ZIncrby(const Slice& key, const Slice& member, double increment, d
   double score = 0;
   char score_buf[8];
   uint64_t version = 0;
+  int32_t zset_count = 0;
+  std::unique_ptr<ZSetsRankIndex> rank_index;
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
@@ -426,8 +466,9 @@ Status Redis::ZIncrby(const Slice& key, const Slice& member, double increment, d
     } else {
       version = parsed_zsets_meta_value.Version();
     }
+    rank_index = std::make_unique<ZSetsRankIndex>(db_, handles_, key, version, parsed_zsets_meta_value.IsRankIndexed());
     std::string data_value;
-    ZSetsMemberKey zsets_member_key(key, version, member);
+    ZSetsMemberKey zsets_member_key(key, version, member, data_format_);
     s = db_->Get(default_read_options_, handles_[kZsetsDataCF], zsets_member_key.Encode(), &data_value);
     if (s.ok()) {
       ParsedBaseDataValue parsed_value(&data_value);
@@ -438,6 +479,7 @@ Status Redis::ZIncrby(const Slice& key, const Slice& member, double increment, d
       score = old_score + increment;
       ZSetsScoreKey zsets_score_key(key, version, old_score, member);
       batch.Delete(handles_[kZsetsScoreCF], zsets_score_key.Encode());
+      rank_index->Remove(old_score, member);
       // delete old zsets_score_key and overwirte zsets_member_key
       // but in different column_families so we accumulative 1
       statistic++;
@@ -451,27 +493,38 @@ Status Redis::ZIncrby(const Slice& key, const Slice& member, double increment, d
     } else {
       return s;
     }
+    zset_count = parsed_zsets_meta_value.Count();
   } else if (s.IsNotFound()) {
     char buf[4];
     EncodeFixed32(buf, 1);
     ZSetsMetaValue zsets_meta_value(DataType::kZSets, Slice(buf, 4));
     version = zsets_meta_value.UpdateVersion();
+    rank_index = std::make_unique<ZSetsRankIndex>(db_, handles_, key, version, false);
+    zset_count = 1;
     batch.Put(handles_[kMetaCF], base_meta_key.Encode(), zsets_meta_value.Encode());
     score = increment;
   } else {
     return s;
   }
-  ZSetsMemberKey zsets_member_key(key, version, member);
+  ZSetsMemberKey zsets_member_key(key, version, member, data_format_);
   const void* ptr_score = reinterpret_cast<const void*>(&score);
   EncodeFixed64(score_buf, *reinterpret_cast<const uint64_t*>(ptr_score));
-  BaseDataValue zsets_member_i_val(Slice(score_buf, sizeof(uint64_t)));
+  BaseDataValue zsets_member_i_val(Slice(score_buf, sizeof(uint64_t)), data_format_);
   batch.Put(handles_[kZsetsDataCF], zsets_member_key.Encode(), zsets_member_i_val.Encode());
 
   ZSetsScoreKey zsets_score_key(key, version, score, member);
-  BaseDataValue zsets_score_i_val(Slice{});
+  BaseDataValue zsets_score_i_val(Slice{}, data_format_);
   batch.Put(handles_[kZsetsScoreCF], zsets_score_key.Encode(), zsets_score_i_val.Encode());
+  rank_index->Add(score, member);
+  s = rank_index->Flush(&batch);
+  if (!s.ok()) {
+    return s;
+  }
   *ret = score;
   s = db_->Write(default_write_options_, &batch);
+  if (s.ok()) {
+    MaintainZsetsRankIndex(key, zset_count, rank_index.get());
+  }
   UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
   return s;
 }
@@ -518,8 +571,15 @@ Status Redis::ZRange(const Slice& key, int32_t start, int32_t stop, std::vector<
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
-      for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
+      ZSetsRankIndex rank_index(db_, handles_, key, version, parsed_zsets_meta_value.IsRankIndexed());
+      if (rank_index.Indexed() && rank_index.Seek(read_options, start_index, iter).ok()) {
+        cur_index = start_index;
+      } else {
+        iter->Seek(zsets_score_key.Encode());
+      }
+      for (; iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         if (cur_index >= start_index) {
           ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
           score_member.score = parsed_zsets_score_key.score();
@@ -587,10 +647,15 @@ Status Redis::ZRangeWithTTL(const Slice& key, int32_t start, int32_t stop, std::
       ZSetsScoreKey zsets_score_key(key, version,
                                     std::numeric_limits<double>::lowest(), Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
-      for (iter->Seek(zsets_score_key.Encode());
-           iter->Valid() && cur_index <= stop_index;
-           iter->Next(), ++cur_index) {
+      ZSetsRankIndex rank_index(db_, handles_, key, version, parsed_zsets_meta_value.IsRankIndexed());
+      if (rank_index.Indexed() && rank_index.Seek(read_options, start_index, iter).ok()) {
+        cur_index = start_index;
+      } else {
+        iter->Seek(zsets_score_key.Encode());
+      }
+      for (; iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         if (cur_index >= start_index) {
           ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
           score_member.score = parsed_zsets_score_key.score();
@@ -640,6 +705,7 @@ Status Redis::ZRangebyscore(const Slice& key, double min, double max, bool left_
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, min, Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && index <= stop_index; iter->Next(), ++index) {
         bool left_pass = false;
@@ -712,11 +778,18 @@ Status Redis::ZRank(const Slice& key, const Slice& member, int32_t* rank) {
     } else {
       bool found = false;
       uint64_t version = parsed_zsets_meta_value.Version();
+      if (parsed_zsets_meta_value.IsRankIndexed()) {
+        s = ZRankByIndex(read_options, key, version, member, rank);
+        if (!s.IsCorruption()) {
+          return s;
+        }
+      }
       int32_t index = 0;
       int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && index <= stop_index; iter->Next(), ++index) {
         ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
@@ -737,6 +810,57 @@ Status Redis::ZRank(const Slice& key, const Slice& member, int32_t* rank) {
   return s;
 }
 
+Status Redis::ZRankByIndex(const rocksdb::ReadOptions& read_options, const Slice& key, uint64_t version,
+                           const Slice& member, int32_t* rank) {
+  std::string data_value;
+  ZSetsMemberKey zsets_member_key(key, version, member, data_format_);
+  Status s = db_->Get(read_options, handles_[kZsetsDataCF], zsets_member_key.Encode(), &data_value);
+  if (!s.ok()) {
+    return s;
+  }
+  ParsedBaseDataValue parsed_value(&data_value);
+  parsed_value.StripSuffix();
+  uint64_t tmp = DecodeFixed64(data_value.data());
+  const void* ptr_tmp = reinterpret_cast<const void*>(&tmp);
+  double score = *reinterpret_cast<const double*>(ptr_tmp);
+
+  KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+  ZSetsRankIndex rank_index(db_, handles_, key, version, true);
+  return rank_index.Rank(read_options, score, member, rank);
+}
+
+// Called with the record lock of key held, after the write that changed the
+// zset went through. A failure leaves the index usable, so it is only logged.
+void Redis::MaintainZsetsRankIndex(const Slice& key, int32_t count, ZSetsRankIndex* rank_index) {
+  if (rank_index == nullptr) {
+    return;
+  }
+  Status s;
+  if (rank_index->Indexed()) {
+    s = rank_index->Rebalance();
+  } else if (zset_rank_index_threshold_ > 0 && count >= zset_rank_index_threshold_) {
+    std::string meta_value;
+    BaseMetaKey base_meta_key(key);
+    s = db_->Get(default_read_options_, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
+    if (s.ok()) {
+      ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
+      if (parsed_zsets_meta_value.Version() != rank_index->Version()) {
+        return;
+      }
+      rocksdb::WriteBatch batch;
+      s = rank_index->Build(&batch);
+      if (s.ok()) {
+        parsed_zsets_meta_value.SetRankIndexed(true);
+        batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+        s = db_->Write(default_write_options_, &batch);
+      }
+    }
+  }
+  if (!s.ok()) {
+    LOG(WARNING) << "maintain rank index of zset " << key.ToString() << " failed, " << s.ToString();
+  }
+}
+
 Status Redis::ZRem(const Slice& key, const std::vector<std::string>& members, int32_t* ret) {
   *ret = 0;
   uint32_t statistic = 0;
@@ -749,6 +873,8 @@ Status Redis::ZRem(const Slice& key, const std::vector<std::string>& members, in
     }
   }
 
+  int32_t zset_count = 0;
+  std::unique_ptr<ZSetsRankIndex> rank_index;
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
@@ -775,8 +901,10 @@ Status Redis::ZRem(const Slice& key, const std::vector<std::string>& members, in
       int32_t del_cnt = 0;
       std::string data_value;
       uint64_t version = parsed_zsets_meta_value.Version();
+      rank_index = std::make_unique<ZSetsRankIndex>(db_, handles_, key, version,
+                                                    parsed_zsets_meta_value.IsRankIndexed());
       for (const auto& member : filtered_members) {
-        ZSetsMemberKey zsets_member_key(key, version, member);
+        ZSetsMemberKey zsets_member_key(key, version, member, data_format_);
         s = db_->Get(default_read_options_, handles_[kZsetsDataCF], zsets_member_key.Encode(), &data_value);
         if (s.ok()) {
           del_cnt++;
@@ -790,6 +918,7 @@ Status Redis::ZRem(const Slice& key, const std::vector<std::string>& members, in
 
           ZSetsScoreKey zsets_score_key(key, version, score, member);
           batch.Delete(handles_[kZsetsScoreCF], zsets_score_key.Encode());
+          rank_index->Remove(score, member);
         } else if (!s.IsNotFound()) {
           return s;
         }
@@ -800,11 +929,19 @@ Status Redis::ZRem(const Slice& key, const std::vector<std::string>& members, in
       }
       parsed_zsets_meta_value.ModifyCount(-del_cnt);
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      s = rank_index->Flush(&batch);
+      if (!s.ok()) {
+        return s;
+      }
+      zset_count = parsed_zsets_meta_value.Count();
     }
   } else {
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
+  if (s.ok()) {
+    MaintainZsetsRankIndex(key, zset_count, rank_index.get());
+  }
   UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
   return s;
 }
@@ -812,6 +949,8 @@ Status Redis::ZRem(const Slice& key, const std::vector<std::string>& members, in
 Status Redis::ZRemrangebyrank(const Slice& key, int32_t start, int32_t stop, int32_t* ret) {
   *ret = 0;
   uint32_t statistic = 0;
+  int32_t zset_count = 0;
+  std::unique_ptr<ZSetsRankIndex> rank_index;
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
@@ -847,15 +986,25 @@ Status Redis::ZRemrangebyrank(const Slice& key, int32_t start, int32_t stop, int
       if (start_index > stop_index || start_index >= count) {
         return s;
       }
+      rank_index = std::make_unique<ZSetsRankIndex>(db_, handles_, key, version,
+                                                    parsed_zsets_meta_value.IsRankIndexed());
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::lowest(), Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
-      rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kZsetsScoreCF]);
-      for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
+      rocksdb::ReadOptions iter_options(default_read_options_);
+      iter_options.prefix_same_as_start = true;
+      rocksdb::Iterator* iter = db_->NewIterator(iter_options, handles_[kZsetsScoreCF]);
+      if (rank_index->Indexed() && rank_index->Seek(iter_options, start_index, iter).ok()) {
+        cur_index = start_index;
+      } else {
+        iter->Seek(zsets_score_key.Encode());
+      }
+      for (; iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         if (cur_index >= start_index) {
           ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
-          ZSetsMemberKey zsets_member_key(key, version, parsed_zsets_score_key.member());
+          ZSetsMemberKey zsets_member_key(key, version, parsed_zsets_score_key.member(), data_format_);
           batch.Delete(handles_[kZsetsDataCF], zsets_member_key.Encode());
           batch.Delete(handles_[kZsetsScoreCF], iter->key());
+          rank_index->Remove(parsed_zsets_score_key.score(), parsed_zsets_score_key.member());
           del_cnt++;
           statistic++;
         }
@@ -867,11 +1016,19 @@ Status Redis::ZRemrangebyrank(const Slice& key, int32_t start, int32_t stop, int
       }
       parsed_zsets_meta_value.ModifyCount(-del_cnt);
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      s = rank_index->Flush(&batch);
+      if (!s.ok()) {
+        return s;
+      }
+      zset_count = parsed_zsets_meta_value.Count();
     }
   } else {
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
+  if (s.ok()) {
+    MaintainZsetsRankIndex(key, zset_count, rank_index.get());
+  }
   UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
   return s;
 }
@@ -880,6 +1037,8 @@ Status Redis::ZRemrangebyscore(const Slice& key, double min, double max, bool le
                                     int32_t* ret) {
   *ret = 0;
   uint32_t statistic = 0;
+  int32_t zset_count = 0;
+  std::unique_ptr<ZSetsRankIndex> rank_index;
   std::string meta_value;
   rocksdb::WriteBatch batch;
   ScopeRecordLock l(lock_mgr_, key);
@@ -908,9 +1067,13 @@ Status Redis::ZRemrangebyscore(const Slice& key, double min, double max, bool le
       int32_t cur_index = 0;
       int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
       uint64_t version = parsed_zsets_meta_value.Version();
+      rank_index = std::make_unique<ZSetsRankIndex>(db_, handles_, key, version,
+                                                    parsed_zsets_meta_value.IsRankIndexed());
       ZSetsScoreKey zsets_score_key(key, version, min, Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
-      rocksdb::Iterator* iter = db_->NewIterator(default_read_options_, handles_[kZsetsScoreCF]);
+      rocksdb::ReadOptions iter_options(default_read_options_);
+      iter_options.prefix_same_as_start = true;
+      rocksdb::Iterator* iter = db_->NewIterator(iter_options, handles_[kZsetsScoreCF]);
       for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         bool left_pass = false;
         bool right_pass = false;
@@ -930,9 +1093,10 @@ Status Redis::ZRemrangebyscore(const Slice& key, double min, double max, bool le
           right_pass = true;
         }
         if (left_pass && right_pass) {
-          ZSetsMemberKey zsets_member_key(key, version, parsed_zsets_score_key.member());
+          ZSetsMemberKey zsets_member_key(key, version, parsed_zsets_score_key.member(), data_format_);
           batch.Delete(handles_[kZsetsDataCF], zsets_member_key.Encode());
           batch.Delete(handles_[kZsetsScoreCF], iter->key());
+          rank_index->Remove(parsed_zsets_score_key.score(), parsed_zsets_score_key.member());
           del_cnt++;
           statistic++;
         }
@@ -947,11 +1111,19 @@ Status Redis::ZRemrangebyscore(const Slice& key, double min, double max, bool le
       }
       parsed_zsets_meta_value.ModifyCount(-del_cnt);
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      s = rank_index->Flush(&batch);
+      if (!s.ok()) {
+        return s;
+      }
+      zset_count = parsed_zsets_meta_value.Count();
     }
   } else {
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
+  if (s.ok()) {
+    MaintainZsetsRankIndex(key, zset_count, rank_index.get());
+  }
   UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
   return s;
 }
@@ -998,9 +1170,15 @@ Status Redis::ZRevrange(const Slice& key, int32_t start, int32_t stop, std::vect
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::max(), Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
-      for (iter->SeekForPrev(zsets_score_key.Encode()); iter->Valid() && cur_index >= start_index;
-           iter->Prev(), --cur_index) {
+      ZSetsRankIndex rank_index(db_, handles_, key, version, parsed_zsets_meta_value.IsRankIndexed());
+      if (rank_index.Indexed() && rank_index.Seek(read_options, stop_index, iter).ok()) {
+        cur_index = stop_index;
+      } else {
+        iter->SeekForPrev(zsets_score_key.Encode());
+      }
+      for (; iter->Valid() && cur_index >= start_index; iter->Prev(), --cur_index) {
         if (cur_index <= stop_index) {
           ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
           score_member.score = parsed_zsets_score_key.score();
@@ -1049,6 +1227,7 @@ Status Redis::ZRevrangebyscore(const Slice& key, double min, double max, bool le
       ScoreMember score_member;
       ZSetsScoreKey zsets_score_key(key, version, std::nextafter(max, std::numeric_limits<double>::max()), Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->SeekForPrev(zsets_score_key.Encode()); iter->Valid() && left > 0; iter->Prev(), --left) {
         bool left_pass = false;
@@ -1124,8 +1303,18 @@ Status Redis::ZRevrank(const Slice& key, const Slice& member, int32_t* rank) {
       int32_t rev_index = 0;
       int32_t left = parsed_zsets_meta_value.Count();
       uint64_t version = parsed_zsets_meta_value.Version();
+      if (parsed_zsets_meta_value.IsRankIndexed()) {
+        s = ZRankByIndex(read_options, key, version, member, rank);
+        if (s.ok()) {
+          *rank = left - 1 - *rank;
+        }
+        if (!s.IsCorruption()) {
+          return s;
+        }
+      }
       ZSetsScoreKey zsets_score_key(key, version, std::numeric_limits<double>::max(), Slice());
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
       for (iter->SeekForPrev(zsets_score_key.Encode()); iter->Valid() && left > 0; iter->Prev(), --left, ++rev_index) {
         ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
@@ -1176,7 +1365,7 @@ Status Redis::ZScore(const Slice& key, const Slice& member, double* score) {
       return Status::NotFound();
     } else {
       std::string data_value;
-      ZSetsMemberKey zsets_member_key(key, version, member);
+      ZSetsMemberKey zsets_member_key(key, version, member, data_format_);
       s = db_->Get(read_options, handles_[kZsetsDataCF], zsets_member_key.Encode(), &data_value);
       if (s.ok()) {
         ParsedBaseDataValue parsed_value(&data_value);
@@ -1196,16 +1385,10 @@ Status Redis::ZScore(const Slice& key, const Slice& member, double* score) {
   return s;
 }
 
-Status Redis::ZGetAll(const Slice& key, double weight, std::map<std::string, double>* value_to_dest) {
-  Status s;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
+Status Redis::NewZSetsMergeInput(const Slice& key, const rocksdb::ReadOptions& read_options, ZSetsMergeInput* input) {
   std::string meta_value;
-
   BaseMetaKey base_meta_key(key);
-  s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
+  Status s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
   if (s.ok() && !ExpectedMetaValue(DataType::kZSets, meta_value) && !ExpectedMetaValue(DataType::kSets, meta_value)) {
     if (ExpectedStale(meta_value)) {
       s = Status::NotFound();
@@ -1216,302 +1399,154 @@ Status Redis::ZGetAll(const Slice& key, double weight, std::map<std::string, dou
         DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
     }
   }
-  if (s.ok()) {
-    ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
-    if (!parsed_zsets_meta_value.IsStale() && parsed_zsets_meta_value.Count() != 0) {
-      int32_t cur_index = 0;
-      int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
-      double score = 0.0;
-      uint64_t version = parsed_zsets_meta_value.Version();
-      ZSetsScoreKey zsets_score_key(key.ToString(), version, std::numeric_limits<double>::lowest(), Slice());
-      Slice seek_key = zsets_score_key.Encode();
-      rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
-      for (iter->Seek(seek_key); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
-        ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
-        double score = parsed_zsets_score_key.score() * weight;
-        score = (score == -0.0) ? 0 : score;
-        value_to_dest->insert(std::make_pair(parsed_zsets_score_key.member().ToString(), score));
-      }
-      delete iter;
+  if (!s.ok()) {
+    return s;
+  }
+  // the meta values of sets and zsets share their layout
+  bool is_set = ExpectedMetaValue(DataType::kSets, meta_value);
+  ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
+  if (parsed_zsets_meta_value.IsStale() || parsed_zsets_meta_value.Count() == 0) {
+    return Status::NotFound();
+  }
+  input->is_set = is_set;
+  if (is_set && parsed_zsets_meta_value.IsInline()) {
+    SetsInlineMembers inline_members;
+    if (!inline_members.Decode(parsed_zsets_meta_value.InlinePayload())) {
+      return Status::Corruption("bad inline set");
     }
+    input->cursor = std::make_unique<MemberCursor>(inline_members.Members());
+    return Status::OK();
   }
-  return s;
+  input->cursor = std::make_unique<MemberCursor>(db_, handles_[is_set ? kSetsDataCF : kZsetsDataCF], read_options, key,
+                                                 parsed_zsets_meta_value.Version(), parsed_zsets_meta_value.Count(),
+                                                 data_format_);
+  return Status::OK();
 }
 
-Status Redis::ZUnionstore(const Slice& destination, const std::vector<std::string>& keys,
-                               const std::vector<double>& weights, const AGGREGATE agg, std::map<std::string, double>& value_to_dest, int32_t* ret) {
-  *ret = 0;
-  uint32_t statistic = 0;
-  rocksdb::WriteBatch batch;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
-
-  uint64_t version;
-  std::string meta_value;
-  ScoreMember sm;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  ScopeRecordLock l(lock_mgr_, destination);
-  std::map<std::string, double> member_score_map;
-
-  Status s;
+Status Redis::NewZSetsMergeInputs(const std::vector<std::string>& keys, const std::vector<double>& weights,
+                                  const rocksdb::ReadOptions& read_options, ZSetsMergeInputs* inputs) {
   for (size_t idx = 0; idx < keys.size(); ++idx) {
-    BaseMetaKey base_meta_key(keys[idx]);
-    s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
-    if (s.ok() && !ExpectedMetaValue(DataType::kZSets, meta_value)) {
-      if (ExpectedStale(meta_value)) {
-        s = Status::NotFound();
-      } else {
-        return Status::InvalidArgument(
-          "WRONGTYPE, key: " + keys[idx] + ", expected type: " +
-          DataTypeStrings[static_cast<int>(DataType::kZSets)] + ", got type: " +
-          DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-      }
-    }
-    if (s.ok()) {
-      ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
-      if (!parsed_zsets_meta_value.IsStale() && parsed_zsets_meta_value.Count() != 0) {
-        int32_t cur_index = 0;
-        int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
-        double score = 0;
-        double weight = idx < weights.size() ? weights[idx] : 1;
-        version = parsed_zsets_meta_value.Version();
-        ZSetsScoreKey zsets_score_key(keys[idx], version, std::numeric_limits<double>::lowest(), Slice());
-        KeyStatisticsDurationGuard guard(this, DataType::kZSets, keys[idx]);
-        rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
-        for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index;
-             iter->Next(), ++cur_index) {
-          ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
-          sm.score = parsed_zsets_score_key.score();
-          sm.member = parsed_zsets_score_key.member().ToString();
-          if (member_score_map.find(sm.member) == member_score_map.end()) {
-            score = weight * sm.score;
-            member_score_map[sm.member] = (score == -0.0) ? 0 : score;
-          } else {
-            score = member_score_map[sm.member];
-            switch (agg) {
-              case SUM:
-                score += weight * sm.score;
-                break;
-              case MIN:
-                score = std::min(score, weight * sm.score);
-                break;
-              case MAX:
-                score = std::max(score, weight * sm.score);
-                break;
-            }
-            member_score_map[sm.member] = (score == -0.0) ? 0 : score;
-          }
-        }
-        delete iter;
-      }
-    } else if (!s.IsNotFound()) {
+    ZSetsMergeInput input;
+    Status s = NewZSetsMergeInput(keys[idx], read_options, &input);
+    if (!s.ok() && !s.IsNotFound()) {
       return s;
     }
+    input.weight = idx < weights.size() ? weights[idx] : 1;
+    inputs->push_back(std::move(input));
   }
+  return Status::OK();
+}
 
+Status Redis::ZSetsStore(const Slice& destination, const std::function<Status(const ZSetsMemberSink&)>& producer,
+                         std::vector<ScoreMember>* value_to_dest, int32_t* ret) {
+  ScopeRecordLock l(lock_mgr_, destination);
+  uint32_t statistic = 0;
+  uint64_t version = 0;
+  std::string meta_value;
   BaseMetaKey base_destination(destination);
-  s = db_->Get(read_options, handles_[kMetaCF], base_destination.Encode(), &meta_value);
-  if (s.ok() && !ExpectedMetaValue(DataType::kZSets, meta_value)) {
-    if (ExpectedStale(meta_value)) {
-      s = Status::NotFound();
-    } else {
-      return Status::InvalidArgument(
-        "WRONGTYPE, key: " + destination.ToString() + ", expected type: " +
-        DataTypeStrings[static_cast<int>(DataType::kZSets)] + ", got type: " +
-        DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-    }
-  }
-  if (s.ok()) {
+  Status s = db_->Get(default_read_options_, handles_[kMetaCF], base_destination.Encode(), &meta_value);
+  if (s.ok() && ExpectedMetaValue(DataType::kZSets, meta_value)) {
     ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
     statistic = parsed_zsets_meta_value.Count();
     version = parsed_zsets_meta_value.InitialMetaValue();
-    if (!parsed_zsets_meta_value.check_set_count(static_cast<int32_t>(member_score_map.size()))) {
-      return Status::InvalidArgument("zset size overflow");
-    }
-    parsed_zsets_meta_value.SetCount(static_cast<int32_t>(member_score_map.size()));
-    batch.Put(handles_[kMetaCF], base_destination.Encode(), meta_value);
-  } else {
+  } else if (s.ok() || s.IsNotFound()) {
+    // a value of another type is overwritten, like in SetsStore
     char buf[4];
-    EncodeFixed32(buf, member_score_map.size());
+    EncodeFixed32(buf, 0);
     ZSetsMetaValue zsets_meta_value(DataType::kZSets, Slice(buf, 4));
     version = zsets_meta_value.UpdateVersion();
-    batch.Put(handles_[kMetaCF], base_destination.Encode(), zsets_meta_value.Encode());
+    meta_value = zsets_meta_value.Encode().ToString();
+  } else {
+    return s;
   }
 
+  const int32_t kStoreBatchCount = 1000;
+  std::vector<ScoreMember> score_members;
+  rocksdb::WriteBatch batch;
   char score_buf[8];
-  for (const auto& sm : member_score_map) {
-    ZSetsMemberKey zsets_member_key(destination, version, sm.first);
-
-    const void* ptr_score = reinterpret_cast<const void*>(&sm.second);
+  s = producer([&](const Slice& member, double score) {
+    if (score_members.size() >= INT32_MAX) {
+      return Status::InvalidArgument("zset size overflow");
+    }
+    ZSetsMemberKey zsets_member_key(destination, version, member, data_format_);
+    const void* ptr_score = reinterpret_cast<const void*>(&score);
     EncodeFixed64(score_buf, *reinterpret_cast<const uint64_t*>(ptr_score));
-    BaseDataValue member_i_val(Slice(score_buf, sizeof(uint64_t)));
+    BaseDataValue member_i_val(Slice(score_buf, sizeof(uint64_t)), data_format_);
     batch.Put(handles_[kZsetsDataCF], zsets_member_key.Encode(), member_i_val.Encode());
 
-    ZSetsScoreKey zsets_score_key(destination, version, sm.second, sm.first);
-    BaseDataValue score_i_val(Slice{});
+    ZSetsScoreKey zsets_score_key(destination, version, score, member);
+    BaseDataValue score_i_val(Slice{}, data_format_);
     batch.Put(handles_[kZsetsScoreCF], zsets_score_key.Encode(), score_i_val.Encode());
+    score_members.push_back({score, member.ToString()});
+    if (batch.Count() < kStoreBatchCount) {
+      return Status::OK();
+    }
+    Status write_status = db_->Write(default_write_options_, &batch);
+    batch.Clear();
+    return write_status;
+  });
+  if (!s.ok()) {
+    return s;
   }
-  *ret = static_cast<int32_t>(member_score_map.size());
+  ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
+  parsed_zsets_meta_value.SetCount(static_cast<int32_t>(score_members.size()));
+  batch.Put(handles_[kMetaCF], base_destination.Encode(), meta_value);
+  *ret = static_cast<int32_t>(score_members.size());
   s = db_->Write(default_write_options_, &batch);
+  if (s.ok()) {
+    // the destination is rewritten under a new version, without index
+    ZSetsRankIndex rank_index(db_, handles_, destination, version, false);
+    MaintainZsetsRankIndex(destination, *ret, &rank_index);
+  }
   UpdateSpecificKeyStatistics(DataType::kZSets, destination.ToString(), statistic);
-  value_to_dest = std::move(member_score_map);
+  *value_to_dest = std::move(score_members);
   return s;
 }
 
-Status Redis::ZInterstore(const Slice& destination, const std::vector<std::string>& keys,
-                               const std::vector<double>& weights, const AGGREGATE agg, std::vector<ScoreMember>& value_to_dest, int32_t* ret) {
+Status Redis::ZUnionstore(const Slice& destination, const std::vector<std::string>& keys,
+                          const std::vector<double>& weights, const AGGREGATE agg,
+                          std::vector<ScoreMember>& value_to_dest, int32_t* ret) {
   if (keys.empty()) {
-    return Status::Corruption("ZInterstore invalid parameter, no keys");
+    return Status::Corruption("ZUnionstore invalid parameter, no keys");
   }
 
   *ret = 0;
-  uint32_t statistic = 0;
-  rocksdb::WriteBatch batch;
-  rocksdb::ReadOptions read_options;
-  const rocksdb::Snapshot* snapshot = nullptr;
-  ScopeSnapshot ss(db_, &snapshot);
-  read_options.snapshot = snapshot;
-  ScopeRecordLock l(lock_mgr_, destination);
-
-  std::string meta_value;
-  uint64_t version = 0;
-  bool have_invalid_zsets = false;
-  ScoreMember item;
-  std::vector<KeyVersion> valid_zsets;
-  std::vector<ScoreMember> score_members;
-  std::vector<ScoreMember> final_score_members;
-  Status s;
-
-  int32_t cur_index = 0;
-  int32_t stop_index = 0;
-  for (size_t idx = 0; idx < keys.size(); ++idx) {
-    BaseMetaKey base_meta_key(keys[idx]);
-    s = db_->Get(read_options, handles_[kMetaCF], base_meta_key.Encode(), &meta_value);
-    if (s.ok() && !ExpectedMetaValue(DataType::kZSets, meta_value)) {
-      if (ExpectedStale(meta_value)) {
-        s = Status::NotFound();
-      } else {
-        return Status::InvalidArgument(
-          "WRONGTYPE, key: " + keys[idx] + ", expected type: " +
-          DataTypeStrings[static_cast<int>(DataType::kZSets)] + ", got type: " +
-          DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-      }
-    }
-    if (s.ok()) {
-      ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
-      if (parsed_zsets_meta_value.IsStale() || parsed_zsets_meta_value.Count() == 0) {
-        have_invalid_zsets = true;
-      } else {
-        valid_zsets.push_back({keys[idx], parsed_zsets_meta_value.Version()});
-        if (idx == 0) {
-          stop_index = parsed_zsets_meta_value.Count() - 1;
-        }
-      }
-    } else if (s.IsNotFound()) {
-      have_invalid_zsets = true;
-    } else {
+  return ZSetsStore(destination, [&](const ZSetsMemberSink& sink) {
+    rocksdb::ReadOptions read_options;
+    const rocksdb::Snapshot* snapshot = nullptr;
+    ScopeSnapshot ss(db_, &snapshot);
+    read_options.snapshot = snapshot;
+    ZSetsMergeInputs inputs;
+    Status s = NewZSetsMergeInputs(keys, weights, read_options, &inputs);
+    if (!s.ok()) {
       return s;
     }
-  }
-
-  if (!have_invalid_zsets) {
-    ZSetsScoreKey zsets_score_key(valid_zsets[0].key, valid_zsets[0].version, std::numeric_limits<double>::lowest(), Slice());
-    KeyStatisticsDurationGuard guard(this, DataType::kZSets, valid_zsets[0].key);
-    rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsScoreCF]);
-    for (iter->Seek(zsets_score_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
-      ParsedZSetsScoreKey parsed_zsets_score_key(iter->key());
-      double score = parsed_zsets_score_key.score();
-      std::string member = parsed_zsets_score_key.member().ToString();
-      score_members.push_back({score, member});
-    }
-    delete iter;
+    KeyStatisticsDurationGuard guard(this, DataType::kZSets, keys[0]);
+    return ZSetsUnion(&inputs, agg, sink);
+  }, &value_to_dest, ret);
+}
 
-    std::string data_value;
-    for (const auto& sm : score_members) {
-      bool reliable = true;
-      item.member = sm.member;
-      item.score = sm.score * (!weights.empty() ? weights[0] : 1);
-      for (size_t idx = 1; idx < valid_zsets.size(); ++idx) {
-        double weight = idx < weights.size() ? weights[idx] : 1;
-        ZSetsMemberKey zsets_member_key(valid_zsets[idx].key, valid_zsets[idx].version, item.member);
-        s = db_->Get(read_options, handles_[kZsetsDataCF], zsets_member_key.Encode(), &data_value);
-        if (s.ok()) {
-          ParsedBaseDataValue parsed_value(&data_value);
-          parsed_value.StripSuffix();
-          uint64_t tmp = DecodeFixed64(data_value.data());
-          const void* ptr_tmp = reinterpret_cast<const void*>(&tmp);
-          double score = *reinterpret_cast<const double*>(ptr_tmp);
-          switch (agg) {
-            case SUM:
-              item.score += weight * score;
-              break;
-            case MIN:
-              item.score = std::min(item.score, weight * score);
-              break;
-            case MAX:
-              item.score = std::max(item.score, weight * score);
-              break;
-          }
-        } else if (s.IsNotFound()) {
-          reliable = false;
-          break;
-        } else {
-          return s;
-        }
-      }
-      if (reliable) {
-        final_score_members.push_back(item);
-      }
-    }
+Status Redis::ZInterstore(const Slice& destination, const std::vector<std::string>& keys,
+                          const std::vector<double>& weights, const AGGREGATE agg,
+                          std::vector<ScoreMember>& value_to_dest, int32_t* ret) {
+  if (keys.empty()) {
+    return Status::Corruption("ZInterstore invalid parameter, no keys");
   }
 
-  BaseMetaKey base_destination(destination);
-  s = db_->Get(read_options, handles_[kMetaCF], base_destination.Encode(), &meta_value);
-  if (s.ok() && !ExpectedMetaValue(DataType::kZSets, meta_value)) {
-    if (ExpectedStale(meta_value)) {
-      s = Status::NotFound();
-    } else {
-      return Status::InvalidArgument(
-        "WRONGTYPE, key: " + destination.ToString() + ", expected type: " +
-        DataTypeStrings[static_cast<int>(DataType::kZSets)] + ", got type: " +
-        DataTypeStrings[static_cast<int>(GetMetaValueType(meta_value))]);
-    }
-  }
-  if (s.ok()) {
-    ParsedZSetsMetaValue parsed_zsets_meta_value(&meta_value);
-    statistic = parsed_zsets_meta_value.Count();
-    version = parsed_zsets_meta_value.InitialMetaValue();
-    if (!parsed_zsets_meta_value.check_set_count(static_cast<int32_t>(final_score_members.size()))) {
-      return Status::InvalidArgument("zset size overflow");
+  *ret = 0;
+  return ZSetsStore(destination, [&](const ZSetsMemberSink& sink) {
+    rocksdb::ReadOptions read_options;
+    const rocksdb::Snapshot* snapshot = nullptr;
+    ScopeSnapshot ss(db_, &snapshot);
+    read_options.snapshot = snapshot;
+    ZSetsMergeInputs inputs;
+    Status s = NewZSetsMergeInputs(keys, weights, read_options, &inputs);
+    if (!s.ok()) {
+      return s;
     }
-    parsed_zsets_meta_value.SetCount(static_cast<int32_t>(final_score_members.size()));
-    batch.Put(handles_[kMetaCF], base_destination.Encode(), meta_value);
-  } else {
-    char buf[4];
-    EncodeFixed32(buf, final_score_members.size());
-    ZSetsMetaValue zsets_meta_value(DataType::kZSets, Slice(buf, 4));
-    version = zsets_meta_value.UpdateVersion();
-    batch.Put(handles_[kMetaCF], base_destination.Encode(), zsets_meta_value.Encode());
-  }
-  char score_buf[8];
-  for (const auto& sm : final_score_members) {
-    ZSetsMemberKey zsets_member_key(destination, version, sm.member);
-
-    const void* ptr_score = reinterpret_cast<const void*>(&sm.score);
-    EncodeFixed64(score_buf, *reinterpret_cast<const uint64_t*>(ptr_score));
-    BaseDataValue member_i_val(Slice(score_buf, sizeof(uint64_t)));
-    batch.Put(handles_[kZsetsDataCF], zsets_member_key.Encode(), member_i_val.Encode());
-
-    ZSetsScoreKey zsets_score_key(destination, version, sm.score, sm.member);
-    BaseDataValue zsets_score_i_val(Slice{});
-    batch.Put(handles_[kZsetsScoreCF], zsets_score_key.Encode(), zsets_score_i_val.Encode());
-  }
-  *ret = static_cast<int32_t>(final_score_members.size());
-  s = db_->Write(default_write_options_, &batch);
-  UpdateSpecificKeyStatistics(DataType::kZSets, destination.ToString(), statistic);
-  value_to_dest = std::move(final_score_members);
-  return s;
+    KeyStatisticsDurationGuard guard(this, DataType::kZSets, keys[0]);
+    return ZSetsInter(&inputs, agg, sink);
+  }, &value_to_dest, ret);
 }
 
 Status Redis::ZRangebylex(const Slice& key, const Slice& min, const Slice& max, bool left_close, bool right_close,
@@ -1548,8 +1583,9 @@ Status Redis::ZRangebylex(const Slice& key, const Slice& min, const Slice& max,
       uint64_t version = parsed_zsets_meta_value.Version();
       int32_t cur_index = 0;
       int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
-      ZSetsMemberKey zsets_member_key(key, version, Slice());
+      ZSetsMemberKey zsets_member_key(key, version, Slice(), data_format_);
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsDataCF]);
       for (iter->Seek(zsets_member_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         bool left_pass = false;
@@ -1599,6 +1635,8 @@ Status Redis::ZRemrangebylex(const Slice& key, const Slice& min, const Slice& ma
   bool right_not_limit = max.compare("+") == 0;
 
   int32_t del_cnt = 0;
+  int32_t zset_count = 0;
+  std::unique_ptr<ZSetsRankIndex> rank_index;
   std::string meta_value;
 
   BaseMetaKey base_meta_key(key);
@@ -1621,8 +1659,11 @@ Status Redis::ZRemrangebylex(const Slice& key, const Slice& min, const Slice& ma
       uint64_t version = parsed_zsets_meta_value.Version();
       int32_t cur_index = 0;
       int32_t stop_index = parsed_zsets_meta_value.Count() - 1;
-      ZSetsMemberKey zsets_member_key(key, version, Slice());
+      rank_index = std::make_unique<ZSetsRankIndex>(db_, handles_, key, version,
+                                                    parsed_zsets_meta_value.IsRankIndexed());
+      ZSetsMemberKey zsets_member_key(key, version, Slice(), data_format_);
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsDataCF]);
       for (iter->Seek(zsets_member_key.Encode()); iter->Valid() && cur_index <= stop_index; iter->Next(), ++cur_index) {
         bool left_pass = false;
@@ -1644,6 +1685,7 @@ Status Redis::ZRemrangebylex(const Slice& key, const Slice& min, const Slice& ma
           double score = *reinterpret_cast<const double*>(ptr_tmp);
           ZSetsScoreKey zsets_score_key(key, version, score, member);
           batch.Delete(handles_[kZsetsScoreCF], zsets_score_key.Encode());
+          rank_index->Remove(score, member);
           del_cnt++;
           statistic++;
         }
@@ -1659,12 +1701,20 @@ Status Redis::ZRemrangebylex(const Slice& key, const Slice& min, const Slice& ma
       }
       parsed_zsets_meta_value.ModifyCount(-del_cnt);
       batch.Put(handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      s = rank_index->Flush(&batch);
+      if (!s.ok()) {
+        return s;
+      }
+      zset_count = parsed_zsets_meta_value.Count();
       *ret = del_cnt;
     }
   } else {
     return s;
   }
   s = db_->Write(default_write_options_, &batch);
+  if (s.ok()) {
+    MaintainZsetsRankIndex(key, zset_count, rank_index.get());
+  }
   UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
   return s;
 }
@@ -1737,8 +1787,13 @@ Status Redis::ZsetsDel(const Slice& key, std::string&& prefetch_meta) {
       return Status::NotFound();
     } else {
       uint32_t statistic = parsed_zsets_meta_value.Count();
+      uint64_t dropped_version = parsed_zsets_meta_value.Version();
       parsed_zsets_meta_value.InitialMetaValue();
       s = db_->Put(default_write_options_, handles_[kMetaCF], base_meta_key.Encode(), meta_value);
+      if (s.ok()) {
+        AddDroppedVersion(key, dropped_version);
+        AddReclaimRangeTaskIfNeeded(DataType::kZSets, key, dropped_version, statistic);
+      }
       UpdateSpecificKeyStatistics(DataType::kZSets, key.ToString(), statistic);
     }
   }
@@ -1834,10 +1889,11 @@ Status Redis::ZScan(const Slice& key, int64_t cursor, const std::string& pattern
         sub_member = pattern.substr(0, pattern.size() - 1);
       }
 
-      ZSetsMemberKey zsets_member_prefix(key, version, sub_member);
-      ZSetsMemberKey zsets_member_key(key, version, start_point);
+      ZSetsMemberKey zsets_member_prefix(key, version, sub_member, data_format_);
+      ZSetsMemberKey zsets_member_key(key, version, start_point, data_format_);
       std::string prefix = zsets_member_prefix.EncodeSeekKey().ToString();
       KeyStatisticsDurationGuard guard(this, DataType::kZSets, key.ToString());
+      read_options.prefix_same_as_start = true;
       rocksdb::Iterator* iter = db_->NewIterator(read_options, handles_[kZsetsDataCF]);
       for (iter->Seek(zsets_member_key.Encode()); iter->Valid() && rest > 0 && iter->key().starts_with(prefix);
            iter->Next()) {
@@ -1959,6 +2015,7 @@ void Redis::ScanZsets() {
   ScopeSnapshot ss(db_, &snapshot);
   iterator_options.snapshot = snapshot;
   iterator_options.fill_cache = false;
+  iterator_options.total_order_seek = true;
   auto current_time = static_cast<int32_t>(time(nullptr));
 
   LOG(INFO) << "***************" << "rocksdb instance: " << index_ << " ZSets Meta Data***************";
@@ -0,0 +1,112 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_SETS_INLINE_FORMAT_H_
+#define SRC_SETS_INLINE_FORMAT_H_
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "rocksdb/slice.h"
+
+#include "src/coding.h"
+#include "storage/storage.h"
+
+namespace storage {
+
+/*
+ * Members of a small set kept inline in its meta value, after the count,
+ * sorted like the member keys they stand for:
+ * | member len | member | ...
+ * |     4B     |        |
+ */
+class SetsInlineMembers {
+ public:
+  SetsInlineMembers() = default;
+
+  bool Decode(const Slice& payload) {
+    members_.clear();
+    const char* ptr = payload.data();
+    const char* end_ptr = payload.data() + payload.size();
+    while (ptr != end_ptr) {
+      if (end_ptr - ptr < static_cast<ptrdiff_t>(sizeof(uint32_t))) {
+        return false;
+      }
+      uint32_t len = DecodeFixed32(ptr);
+      ptr += sizeof(uint32_t);
+      if (end_ptr - ptr < static_cast<ptrdiff_t>(len)) {
+        return false;
+      }
+      members_.emplace_back(ptr, len);
+      ptr += len;
+    }
+    return true;
+  }
+
+  std::string Encode() const {
+    std::string payload;
+    char buf[sizeof(uint32_t)];
+    for (const auto& member : members_) {
+      EncodeFixed32(buf, static_cast<uint32_t>(member.size()));
+      payload.append(buf, sizeof(buf));
+      payload.append(member);
+    }
+    return payload;
+  }
+
+  // whether the members may stay inline, at most max_entries of them and
+  // none longer than max_value
+  bool Fits(int32_t max_entries, int32_t max_value) const {
+    if (members_.size() > static_cast<size_t>(std::max(max_entries, 0))) {
+      return false;
+    }
+    return std::all_of(members_.begin(), members_.end(), [max_value](const std::string& member) {
+      return member.size() <= static_cast<size_t>(max_value);
+    });
+  }
+
+  size_t Count() const { return members_.size(); }
+  const std::vector<std::string>& Members() const { return members_; }
+
+  // the first member not less than member
+  std::vector<std::string>::const_iterator LowerBound(const Slice& member) const {
+    return std::lower_bound(members_.begin(), members_.end(), member,
+                            [](const std::string& lhs, const Slice& target) { return Slice(lhs).compare(target) < 0; });
+  }
+
+  bool Contains(const Slice& member) const {
+    auto iter = LowerBound(member);
+    return iter != members_.end() && Slice(*iter) == member;
+  }
+
+  // returns whether member is new
+  bool Insert(const Slice& member) {
+    auto iter = members_.begin() + (LowerBound(member) - members_.cbegin());
+    if (iter != members_.end() && Slice(*iter) == member) {
+      return false;
+    }
+    members_.insert(iter, member.ToString());
+    return true;
+  }
+
+  // returns whether member was there
+  bool Erase(const Slice& member) {
+    auto iter = LowerBound(member);
+    if (iter == members_.end() || Slice(*iter) != member) {
+      return false;
+    }
+    members_.erase(iter);
+    return true;
+  }
+
+  void EraseAt(size_t pos) { members_.erase(members_.begin() + static_cast<ptrdiff_t>(pos)); }
+
+ private:
+  std::vector<std::string> members_;
+};
+
+}  //  namespace storage
+#endif  //  SRC_SETS_INLINE_FORMAT_H_
@@ -0,0 +1,62 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "storage/slot_indexer.h"
+
+#include "src/coding.h"
+
+namespace storage {
+
+SlotIndexer::SlotIndexer(uint32_t slot_num, uint32_t inst_num)
+    : slot_num_(slot_num), table_(new std::atomic<uint32_t>[slot_num]) {
+  for (uint32_t slot_id = 0; slot_id < slot_num_; ++slot_id) {
+    table_[slot_id].store(slot_id % inst_num, std::memory_order_relaxed);
+  }
+}
+
+void SlotIndexer::SetInstanceID(uint32_t slot_id, uint32_t inst_id) {
+  table_[slot_id].store(inst_id, std::memory_order_release);
+  epoch_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+std::vector<uint32_t> SlotIndexer::GetSlots(uint32_t inst_id) const {
+  std::vector<uint32_t> slots;
+  for (uint32_t slot_id = 0; slot_id < slot_num_; ++slot_id) {
+    if (GetInstanceID(slot_id) == inst_id) {
+      slots.push_back(slot_id);
+    }
+  }
+  return slots;
+}
+
+std::string SlotIndexer::Encode() const {
+  std::string value(sizeof(uint64_t) + sizeof(uint32_t) * (1 + slot_num_), '\0');
+  char* dst = value.data();
+  EncodeFixed64(dst, Epoch());
+  dst += sizeof(uint64_t);
+  EncodeFixed32(dst, slot_num_);
+  dst += sizeof(uint32_t);
+  for (uint32_t slot_id = 0; slot_id < slot_num_; ++slot_id) {
+    EncodeFixed32(dst, GetInstanceID(slot_id));
+    dst += sizeof(uint32_t);
+  }
+  return value;
+}
+
+bool SlotIndexer::Decode(const std::string& value) {
+  if (value.size() != sizeof(uint64_t) + sizeof(uint32_t) * (1 + slot_num_) ||
+      DecodeFixed32(value.data() + sizeof(uint64_t)) != slot_num_) {
+    return false;
+  }
+  const char* ptr = value.data() + sizeof(uint64_t) + sizeof(uint32_t);
+  for (uint32_t slot_id = 0; slot_id < slot_num_; ++slot_id) {
+    table_[slot_id].store(DecodeFixed32(ptr), std::memory_order_release);
+    ptr += sizeof(uint32_t);
+  }
+  epoch_.store(DecodeFixed64(value.data()), std::memory_order_release);
+  return true;
+}
+
+}  // namespace storage
@@ -0,0 +1,88 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/slot_migration.h"
+
+#include "pstd/include/pika_codis_slot.h"
+
+namespace storage {
+
+namespace {
+
+class SlotWriteCollector : public rocksdb::WriteBatch::Handler {
+ public:
+  explicit SlotWriteCollector(SlotWriteLog* log) : log_(log) {}
+
+  rocksdb::Status PutCF(uint32_t column_family_id, const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+    log_->Record(column_family_id, key);
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status DeleteCF(uint32_t column_family_id, const rocksdb::Slice& key) override {
+    log_->Record(column_family_id, key);
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status SingleDeleteCF(uint32_t column_family_id, const rocksdb::Slice& key) override {
+    return DeleteCF(column_family_id, key);
+  }
+  // only the member keys of dead versions are range deleted, the copy in
+  // the target instance goes with its own compactions
+  rocksdb::Status DeleteRangeCF(uint32_t column_family_id, const rocksdb::Slice& begin_key,
+                                const rocksdb::Slice& end_key) override {
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status MergeCF(uint32_t column_family_id, const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+    log_->Record(column_family_id, key);
+    return rocksdb::Status::OK();
+  }
+
+ private:
+  SlotWriteLog* log_ = nullptr;
+};
+
+}  // namespace
+
+SlotSet::SlotSet(int slot_num, const std::vector<uint32_t>& slots)
+    : slot_num_(slot_num), slots_(slots), covered_(slot_num, false) {
+  for (const auto slot_id : slots_) {
+    if (slot_id < covered_.size()) {
+      covered_[slot_id] = true;
+    }
+  }
+}
+
+bool SlotSet::Covers(const std::string& user_key) const { return covered_[GetSlotID(slot_num_, user_key)]; }
+
+bool SlotSet::CoversKey(const Slice& key, std::string* user_key) const {
+  DecodeSlotDataUserKey(key, user_key);
+  return Covers(*user_key);
+}
+
+void SlotWriteLog::Record(uint32_t cf_id, const Slice& key) {
+  if (!IsSlotDataCF(cf_id)) {
+    return;
+  }
+  std::string user_key;
+  if (!slots_.CoversKey(key, &user_key)) {
+    return;
+  }
+  std::lock_guard l(mutex_);
+  keys_.insert(std::move(user_key));
+}
+
+void SlotWriteLog::Record(rocksdb::WriteBatch* batch) {
+  SlotWriteCollector collector(this);
+  batch->Iterate(&collector);
+}
+
+std::vector<std::string> SlotWriteLog::Take() {
+  std::unordered_set<std::string> keys;
+  {
+    std::lock_guard l(mutex_);
+    keys.swap(keys_);
+  }
+  return {keys.begin(), keys.end()};
+}
+
+}  //  namespace storage
@@ -0,0 +1,85 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_SLOT_MIGRATION_H_
+#define SRC_SLOT_MIGRATION_H_
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "rocksdb/write_batch.h"
+
+#include "storage/storage_define.h"
+
+namespace storage {
+
+/*
+ * The cfs holding user data, whose keys all start with the encoded user key
+ * after the 8B reserve1, or the 1B format tag of v2 member keys. The type
+ * index, key stats and expiry index cfs follow the meta cf, a slot migration
+ * writes the meta keys through the TypeIndexedDB of the target instance to
+ * get them rather than copying them. The meta cf goes first, so a data key
+ * copied after its meta is never seen by a compaction filter without it.
+ */
+constexpr ColumnFamilyIndex kSlotDataCFs[] = {kMetaCF,       kHashesDataCF,  kSetsDataCF,  kListsDataCF,  kZsetsDataCF,
+                                              kZsetsScoreCF, kStreamsDataCF, kZsetsRankCF, kBitmapsDataCF};
+
+inline bool IsSlotDataCF(uint32_t cf_id) { return cf_id <= kZsetsRankCF || cf_id == kBitmapsDataCF; }
+
+// The user key of a key of a slot data cf
+inline void DecodeSlotDataUserKey(const Slice& key, std::string* user_key) {
+  size_t prefix_length = DataKeyPrefixLength(key);
+  if (key.size() < prefix_length + kEncodedKeyDelimSize) {
+    user_key->clear();
+    return;
+  }
+  DecodeUserKey(key.data() + prefix_length, static_cast<int>(key.size() - prefix_length), user_key);
+}
+
+// Records kept in the key stats cf of every instance: the slot table, see
+// SlotIndexer, and the slots the instance may hold keys of without owning
+// them while they migrate, so that an open after a crash deletes those keys
+constexpr const char* kSlotTableKey = "#slot_table";
+constexpr const char* kMigratingSlotsKey = "#migrating_slots";
+
+class SlotSet {
+ public:
+  SlotSet(int slot_num, const std::vector<uint32_t>& slots);
+
+  bool Covers(const std::string& user_key) const;
+  // user_key is the decoded user key of key
+  bool CoversKey(const Slice& key, std::string* user_key) const;
+  const std::vector<uint32_t>& Slots() const { return slots_; }
+
+ private:
+  int slot_num_ = 0;
+  std::vector<uint32_t> slots_;
+  std::vector<bool> covered_;
+};
+
+/*
+ * The user keys of a SlotSet written in one instance while its slots migrate
+ * out of it. TypeIndexedDB records the keys of every write once the write is
+ * done, so copying a key after taking it out of the log sees the write, and
+ * a later write puts the key back in.
+ */
+class SlotWriteLog {
+ public:
+  explicit SlotWriteLog(const SlotSet& slots) : slots_(slots) {}
+
+  void Record(uint32_t cf_id, const Slice& key);
+  void Record(rocksdb::WriteBatch* batch);
+  std::vector<std::string> Take();
+
+ private:
+  const SlotSet slots_;
+  std::mutex mutex_;
+  std::unordered_set<std::string> keys_;
+};
+
+}  //  namespace storage
+#endif  //  SRC_SLOT_MIGRATION_H_
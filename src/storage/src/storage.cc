@@ -3,11 +3,17 @@
 //  LICENSE file in the root directory of this source tree. An additional grant
 //  of patent rights can be found in the PATENTS file in the same directory.
 
-#include <utility>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <utility>
 
 #include <glog/logging.h>
 
+#include "rocksdb/sst_file_manager.h"
+
 #include "storage/util.h"
 #include "storage/storage.h"
 #include "scope_snapshot.h"
@@ -15,13 +21,13 @@
 #include "src/mutex_impl.h"
 #include "src/options_helper.h"
 #include "src/redis_hyperloglog.h"
+#include "src/slot_migration.h"
 #include "src/type_iterator.h"
 #include "src/redis.h"
 #include "include/pika_conf.h"
 #include "pstd/include/pika_codis_slot.h"
 
 namespace storage {
-extern std::string BitOpOperate(BitOpType op, const std::vector<std::string>& src_values, int64_t max_len);
 class Redis;
 Status StorageOptions::ResetOptions(const OptionType& option_type,
                                     const std::unordered_map<std::string, std::string>& options_map) {
@@ -55,7 +61,7 @@ Storage::Storage() : Storage(3, 1024, true) {}
 Storage::Storage(int db_instance_num, int slot_num, bool is_classic_mode) {
   cursors_store_ = std::make_unique<LRUCache<std::string, std::string>>();
   cursors_store_->SetCapacity(5000);
-  slot_indexer_ = std::make_unique<SlotIndexer>(db_instance_num);
+  slot_indexer_ = std::make_unique<SlotIndexer>(slot_num, db_instance_num);
   is_classic_mode_ = is_classic_mode;
   db_instance_num_ = db_instance_num;
   slot_num_ = slot_num;
@@ -67,6 +73,9 @@ Storage::Storage(int db_instance_num, int slot_num, bool is_classic_mode) {
 }
 
 Storage::~Storage() {
+  if (open_thread_.joinable()) {
+    open_thread_.join();
+  }
   bg_tasks_should_exit_ = true;
   bg_tasks_cond_var_.notify_one();
 
@@ -90,9 +99,15 @@ static std::string AppendSubDirectory(const std::string& db_path, int index) {
 }
 
 std::vector<rocksdb::ColumnFamilyHandle*> Storage::GetHashCFHandles(const int idx) {
+  WaitInstancesOpened();
   return insts_[idx]->GetHashCFHandles();
 }
 
+std::vector<rocksdb::ColumnFamilyHandle*> Storage::GetListCFHandles(const int idx) {
+  WaitInstancesOpened();
+  return insts_[idx]->GetListCFHandles();
+}
+
 rocksdb::WriteOptions Storage::GetDefaultWriteOptions(const int idx) const {
   return insts_[idx]->GetDefaultWriteOptions();
 }
@@ -102,18 +117,135 @@ Status Storage::Open(const StorageOptions& storage_options, const std::string& d
 
   int inst_count = db_instance_num_;
   storage_options_ = storage_options;
+  if (storage_options.sst_delete_rate_bytes > 0 && storage_options.options.sst_file_manager == nullptr) {
+    storage_options_.options.sst_file_manager.reset(rocksdb::NewSstFileManager(
+        rocksdb::Env::Default(), nullptr, "", storage_options.sst_delete_rate_bytes));
+  }
   for (int index = 0; index < inst_count; index++) {
     insts_.emplace_back(std::make_unique<Redis>(this, index));
-    Status s = insts_.back()->Open(storage_options, AppendSubDirectory(db_path, index));
+  }
+  inst_opened_.assign(inst_count, false);
+  rebalance_written_bytes_.assign(inst_count, 0);
+  is_opened_.store(true);
+
+  auto start_reaping = [this, storage_options]() {
+    // wakes the background thread up to start reaping
+    bg_tasks_mutex_.lock();
+    expiry_reap_rate_ = storage_options.expiry_reap_rate;
+    bg_tasks_cond_var_.notify_one();
+    bg_tasks_mutex_.unlock();
+  };
+  if (!storage_options.lazy_open) {
+    Status s = OpenInstances(db_path);
     if (!s.ok()) {
-      LOG(FATAL) << "open db failed" << s.ToString();
+      LOG(ERROR) << "open db failed, " << s.ToString();
+      return s;
     }
+    start_reaping();
+    return Status::OK();
   }
 
-  is_opened_.store(true);
+  open_thread_ = std::thread([this, db_path, start_reaping]() {
+    Status s = OpenInstances(db_path);
+    if (!s.ok()) {
+      // Open has returned the errors of the slot table, any other one
+      // leaves instances the commands would wait for for good
+      LOG_IF(FATAL, slot_table_status_.ok()) << "open db failed, " << s.ToString();
+      return;
+    }
+    start_reaping();
+  });
+  std::unique_lock l(open_mutex_);
+  open_cv_.wait(l, [this]() { return slot_table_loaded_; });
+  if (!slot_table_status_.ok()) {
+    LOG(ERROR) << "load slot table failed, " << slot_table_status_.ToString();
+  }
+  return slot_table_status_;
+}
+
+Status Storage::OpenInstances(const std::string& db_path) {
+  size_t worker_num = storage_options_.open_worker_num > 0 ? storage_options_.open_worker_num : insts_.size();
+  worker_num = std::min(worker_num, insts_.size());
+  std::vector<Status> statuses(insts_.size());
+  // instance 0 goes first, the others wait for the slot table it loads
+  std::atomic<size_t> next_idx(0);
+  std::vector<std::thread> workers;
+  workers.reserve(worker_num);
+  for (size_t worker = 0; worker < worker_num; ++worker) {
+    workers.emplace_back([&]() {
+      for (size_t idx = next_idx++; idx < insts_.size(); idx = next_idx++) {
+        statuses[idx] = OpenInstance(idx, db_path);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  for (const auto& s : statuses) {
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  std::lock_guard l(open_mutex_);
+  all_opened_.store(true, std::memory_order_release);
+  open_cv_.notify_all();
   return Status::OK();
 }
 
+Status Storage::OpenInstance(size_t inst_id, const std::string& db_path) {
+  Status s = insts_[inst_id]->Open(storage_options_, AppendSubDirectory(db_path, static_cast<int>(inst_id)));
+  if (!s.ok()) {
+    LOG(FATAL) << "open db failed" << s.ToString();
+  }
+  if (inst_id == 0) {
+    s = LoadSlotTable();
+    std::lock_guard l(open_mutex_);
+    slot_table_loaded_ = true;
+    slot_table_status_ = s;
+    open_cv_.notify_all();
+  } else {
+    std::unique_lock l(open_mutex_);
+    open_cv_.wait(l, [this]() { return slot_table_loaded_; });
+    s = slot_table_status_;
+  }
+  if (s.ok()) {
+    s = SettleInstanceSlots(inst_id);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  LOG(INFO) << "instance " << inst_id << " opened in " << insts_[inst_id]->GetOpenMicros() << "us, "
+            << insts_[inst_id]->GetWalReplayMicros() << "us of them in the rocksdb open";
+  std::lock_guard l(open_mutex_);
+  inst_opened_[inst_id] = true;
+  open_cv_.notify_all();
+  return s;
+}
+
+bool Storage::IsInstanceOpened(size_t inst_id) {
+  if (all_opened_.load(std::memory_order_acquire)) {
+    return true;
+  }
+  std::lock_guard l(open_mutex_);
+  return inst_id < inst_opened_.size() && inst_opened_[inst_id];
+}
+
+void Storage::WaitInstanceOpened(size_t inst_id) {
+  if (all_opened_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::unique_lock l(open_mutex_);
+  open_cv_.wait(l, [this, inst_id]() { return inst_opened_[inst_id]; });
+}
+
+void Storage::WaitInstancesOpened() {
+  if (all_opened_.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::unique_lock l(open_mutex_);
+  open_cv_.wait(l, [this]() { return all_opened_.load(std::memory_order_acquire); });
+}
+
 Status Storage::LoadCursorStartKey(const DataType& dtype, int64_t cursor, char* type, std::string* start_key) {
   std::string index_key = DataTypeTag[static_cast<int>(dtype)] + std::to_string(cursor);
   std::string index_value;
@@ -138,6 +270,7 @@ std::unique_ptr<Redis>& Storage::GetDBInstance(const Slice& key) { return GetDBI
 
 std::unique_ptr<Redis>& Storage::GetDBInstance(const std::string& key) {
   auto inst_index = slot_indexer_->GetInstanceID(GetSlotID(slot_num_, key));
+  WaitInstanceOpened(inst_index);
   return insts_[inst_index];
 }
 
@@ -183,53 +316,144 @@ Status Storage::GetBit(const Slice& key, int64_t offset, int32_t* ret) {
 }
 
 Status Storage::MSet(const std::vector<KeyValue>& kvs) {
-  Status s;
+  std::vector<std::vector<KeyValue>> inst_kvs;
+  GroupKeyValuesByInstance(kvs, &inst_kvs);
+  for (size_t inst_index = 0; inst_index < inst_kvs.size(); ++inst_index) {
+    if (inst_kvs[inst_index].empty()) {
+      continue;
+    }
+    Status s = insts_[inst_index]->MSet(inst_kvs[inst_index]);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+void Storage::GroupKeyValuesByInstance(const std::vector<KeyValue>& kvs,
+                                       std::vector<std::vector<KeyValue>>* inst_kvs) {
+  WaitInstancesOpened();
+  inst_kvs->clear();
+  inst_kvs->resize(insts_.size());
   for (const auto& kv : kvs) {
-    auto& inst = GetDBInstance(kv.key);
-    s = inst->Set(Slice(kv.key), Slice(kv.value));
+    auto inst_index = slot_indexer_->GetInstanceID(GetSlotID(slot_num_, kv.key));
+    (*inst_kvs)[inst_index].push_back(kv);
+  }
+}
+
+// Runs fn on up to scan_worker_num threads, each taking the next instance
+// not taken yet. Returns the first failure in instance order
+Status Storage::ForEachInstance(const std::function<Status(size_t)>& fn) {
+  WaitInstancesOpened();
+  size_t worker_num = std::min(static_cast<size_t>(std::max(storage_options_.scan_worker_num, 1)), insts_.size());
+  if (worker_num <= 1) {
+    for (size_t idx = 0; idx < insts_.size(); ++idx) {
+      Status s = fn(idx);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+
+  std::vector<Status> statuses(insts_.size());
+  std::atomic<size_t> next_idx(0);
+  std::vector<std::thread> workers;
+  workers.reserve(worker_num);
+  for (size_t worker = 0; worker < worker_num; ++worker) {
+    workers.emplace_back([&]() {
+      for (size_t idx = next_idx++; idx < insts_.size(); idx = next_idx++) {
+        statuses[idx] = fn(idx);
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  for (const auto& s : statuses) {
     if (!s.ok()) {
       return s;
     }
   }
-  return s;
+  return Status::OK();
+}
+
+void Storage::GroupKeysByInstance(const std::vector<std::string>& keys,
+                                  std::vector<std::vector<size_t>>* key_indexes) {
+  WaitInstancesOpened();
+  key_indexes->clear();
+  key_indexes->resize(insts_.size());
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    auto inst_index = slot_indexer_->GetInstanceID(GetSlotID(slot_num_, keys[idx]));
+    (*key_indexes)[inst_index].push_back(idx);
+  }
 }
 
 Status Storage::MGet(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss) {
   vss->clear();
-  Status s;
-  for(const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
-    std::string value;
-    s = inst->MGet(key, &value);
-    if (s.ok()) {
-      vss->push_back({value, Status::OK()});
-    } else if (s.IsNotFound()) {
-      vss->push_back({std::string(), Status::NotFound()});
+  std::vector<std::vector<size_t>> key_indexes;
+  GroupKeysByInstance(keys, &key_indexes);
+
+  std::vector<ValueStatus> results(keys.size());
+  for (size_t inst_index = 0; inst_index < key_indexes.size(); ++inst_index) {
+    const auto& indexes = key_indexes[inst_index];
+    if (indexes.empty()) {
+      continue;
+    }
+    std::vector<ValueStatus> inst_vss;
+    Status s;
+    if (indexes.size() == keys.size()) {
+      s = insts_[inst_index]->MGet(keys, &inst_vss);
     } else {
-      vss->clear();
+      std::vector<std::string> inst_keys;
+      inst_keys.reserve(indexes.size());
+      for (const auto idx : indexes) {
+        inst_keys.push_back(keys[idx]);
+      }
+      s = insts_[inst_index]->MGet(inst_keys, &inst_vss);
+    }
+    if (!s.ok()) {
       return s;
     }
+    for (size_t pos = 0; pos < indexes.size(); ++pos) {
+      results[indexes[pos]] = std::move(inst_vss[pos]);
+    }
   }
+  *vss = std::move(results);
   return Status::OK();
 }
 
 Status Storage::MGetWithTTL(const std::vector<std::string>& keys, std::vector<ValueStatus>* vss) {
   vss->clear();
-  Status s;
-  for(const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
-    std::string value;
-    int64_t ttl_millsec;
-    s = inst->MGetWithTTL(key, &value, &ttl_millsec);
-    if (s.ok()) {
-      vss->push_back({value, Status::OK(), ttl_millsec});
-    } else if (s.IsNotFound()) {
-      vss->push_back({std::string(), Status::NotFound(), ttl_millsec});
+  std::vector<std::vector<size_t>> key_indexes;
+  GroupKeysByInstance(keys, &key_indexes);
+
+  std::vector<ValueStatus> results(keys.size());
+  for (size_t inst_index = 0; inst_index < key_indexes.size(); ++inst_index) {
+    const auto& indexes = key_indexes[inst_index];
+    if (indexes.empty()) {
+      continue;
+    }
+    std::vector<ValueStatus> inst_vss;
+    Status s;
+    if (indexes.size() == keys.size()) {
+      s = insts_[inst_index]->MGetWithTTL(keys, &inst_vss);
     } else {
-      vss->clear();
+      std::vector<std::string> inst_keys;
+      inst_keys.reserve(indexes.size());
+      for (const auto idx : indexes) {
+        inst_keys.push_back(keys[idx]);
+      }
+      s = insts_[inst_index]->MGetWithTTL(inst_keys, &inst_vss);
+    }
+    if (!s.ok()) {
       return s;
     }
+    for (size_t pos = 0; pos < indexes.size(); ++pos) {
+      results[indexes[pos]] = std::move(inst_vss[pos]);
+    }
   }
+  *vss = std::move(results);
   return Status::OK();
 }
 
@@ -242,26 +466,39 @@ Status Storage::Setnx(const Slice& key, const Slice& value, int32_t* ret, int64_
 // TODO: Not concurrent safe now, merge wuxianrong's bugfix after floyd's PR review finishes.
 Status Storage::MSetnx(const std::vector<KeyValue>& kvs, int32_t* ret) {
   assert(is_classic_mode_);
-  Status s;
-  for (const auto& kv : kvs) {
-    auto& inst = GetDBInstance(kv.key);
-    s = inst->IsExist(Slice(kv.key));
-    if (!s.IsNotFound()) {
+  *ret = 0;
+  std::vector<std::vector<KeyValue>> inst_kvs;
+  GroupKeyValuesByInstance(kvs, &inst_kvs);
+  for (size_t inst_index = 0; inst_index < inst_kvs.size(); ++inst_index) {
+    if (inst_kvs[inst_index].empty()) {
+      continue;
+    }
+    std::vector<std::string> inst_keys;
+    inst_keys.reserve(inst_kvs[inst_index].size());
+    for (const auto& kv : inst_kvs[inst_index]) {
+      inst_keys.push_back(kv.key);
+    }
+    int64_t exist_count = 0;
+    Status s = insts_[inst_index]->Exists(inst_keys, &exist_count);
+    if (!s.ok()) {
       return s;
     }
+    if (exist_count > 0) {
+      return Status::OK();
+    }
   }
 
-  for (const auto& kv : kvs) {
-    auto& inst = GetDBInstance(kv.key);
-    s = inst->Set(Slice(kv.key), Slice(kv.value));
+  for (size_t inst_index = 0; inst_index < inst_kvs.size(); ++inst_index) {
+    if (inst_kvs[inst_index].empty()) {
+      continue;
+    }
+    Status s = insts_[inst_index]->MSet(inst_kvs[inst_index]);
     if (!s.ok()) {
       return s;
     }
   }
-  if (s.ok()) {
-    *ret = 1;
-  }
-  return s;
+  *ret = 1;
+  return Status::OK();
 }
 
 Status Storage::Setvx(const Slice& key, const Slice& value, const Slice& new_value, int32_t* ret, int64_t ttl_millsec) {
@@ -295,7 +532,7 @@ Status Storage::Append(const Slice& key, const Slice& value, int32_t* ret, int64
   return inst->Append(key, value, ret, expired_timestamp_millsec, out_new_value);
 }
 
-Status Storage::BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int32_t* ret, bool have_range) {
+Status Storage::BitCount(const Slice& key, int64_t start_offset, int64_t end_offset, int64_t* ret, bool have_range) {
   auto& inst = GetDBInstance(key);
   return inst->BitCount(key, start_offset, end_offset, ret, have_range);
 }
@@ -305,33 +542,17 @@ Status Storage::BitOp(BitOpType op, const std::string& dest_key, const std::vect
                       std::string &value_to_dest, int64_t* ret) {
   assert(is_classic_mode_);
   if (op == storage::BitOpType::kBitOpNot && src_keys.size() >= 2) { return Status::InvalidArgument(); }
-  Status s;
-  int64_t max_len = 0;
-  int64_t value_len = 0;
-  std::vector<std::string> src_values;
-  for (const auto& src_key : src_keys) {
-    auto& inst = GetDBInstance(src_key);
-    std::string value;
-    s = inst->Get(Slice(src_key), &value);
-    if (s.ok()) {
-      src_values.push_back(value);
-      value_len = value.size();
-    } else {
-      if (!s.IsNotFound()) {
-        return s;
-      }
-      src_values.push_back("");
-      value_len = 0;
+  std::vector<BitmapReader> sources(src_keys.size());
+  for (size_t idx = 0; idx < src_keys.size(); ++idx) {
+    auto& inst = GetDBInstance(src_keys[idx]);
+    Status s = inst->GetBitmapReader(src_keys[idx], &sources[idx]);
+    if (!s.ok() && !s.IsNotFound()) {
+      return s;
     }
-    max_len = std::max(max_len, value_len);
   }
 
-  std::string dest_value = BitOpOperate(op, src_values, max_len);
-  value_to_dest = dest_value;
-  *ret = dest_value.size();
-
   auto& dest_inst = GetDBInstance(dest_key);
-  return dest_inst->Set(Slice(dest_key), Slice(dest_value));
+  return dest_inst->BitOpStore(op, dest_key, &sources, value_to_dest, ret);
 }
 
 Status Storage::BitPos(const Slice& key, int32_t bit, int64_t* ret) {
@@ -495,6 +716,19 @@ Status Storage::SCard(const Slice& key, int32_t* ret) {
   return inst->SCard(key, ret);
 }
 
+Status Storage::NewSetsMemberCursors(const std::vector<std::string>& keys, MemberCursors* cursors) {
+  for (const auto& key : keys) {
+    std::unique_ptr<MemberCursor> cursor;
+    auto& inst = GetDBInstance(key);
+    Status s = inst->NewSetsMemberCursor(key, rocksdb::ReadOptions(), &cursor);
+    if (!s.ok() && !s.IsNotFound()) {
+      return s;
+    }
+    cursors->push_back(std::move(cursor));
+  }
+  return Status::OK();
+}
+
 Status Storage::SDiff(const std::vector<std::string>& keys, std::vector<std::string>* members) {
   if (keys.empty()) {
     return rocksdb::Status::Corruption("SDiff invalid parameter, no keys");
@@ -509,29 +743,16 @@ Status Storage::SDiff(const std::vector<std::string>& keys, std::vector<std::str
     return s;
   }
 
-  auto& inst = GetDBInstance(keys[0]);
-  std::vector<std::string> keys0_members;
-  s = inst->SMembers(Slice(keys[0]), &keys0_members);
-  if (!s.ok() && !s.IsNotFound()) {
+  MemberCursors cursors;
+  s = NewSetsMemberCursors(keys, &cursors);
+  if (!s.ok() || cursors[0] == nullptr) {
     return s;
   }
-
-  for (const auto& member : keys0_members) {
-    int32_t exist = 0;
-    for (int idx = 1; idx < keys.size(); idx++) {
-      Slice pkey = Slice(keys[idx]);
-      auto& inst = GetDBInstance(pkey);
-      s = inst->SIsmember(pkey, Slice(member), &exist);
-      if (!s.ok() && !s.IsNotFound()) {
-        return s;
-      }
-      if (exist) break;
-    }
-    if (!exist) {
-      members->push_back(member);
-    }
-  }
-  return Status::OK();
+  cursors.erase(std::remove(cursors.begin(), cursors.end(), nullptr), cursors.end());
+  return SetsDiff(&cursors, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return Status::OK();
+  });
 }
 
 Status Storage::SDiffstore(const Slice& destination, const std::vector<std::string>& keys, std::vector<std::string>& value_to_dest, int32_t* ret) {
@@ -544,19 +765,19 @@ Status Storage::SDiffstore(const Slice& destination, const std::vector<std::stri
     return s;
   }
 
-  s = SDiff(keys, &value_to_dest);
-  if (!s.ok()) {
-    return s;
+  if (keys.empty()) {
+    return rocksdb::Status::Corruption("SDiffstore invalid parameter, no keys");
   }
-
   auto& inst = GetDBInstance(destination);
-  s = inst->SetsDel(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-
-  s = inst->SAdd(destination, value_to_dest, ret);
-  return s;
+  return inst->SetsStore(destination, [&](const SetsMemberSink& sink) {
+    MemberCursors cursors;
+    Status s = NewSetsMemberCursors(keys, &cursors);
+    if (!s.ok() || cursors[0] == nullptr) {
+      return s;
+    }
+    cursors.erase(std::remove(cursors.begin(), cursors.end(), nullptr), cursors.end());
+    return SetsDiff(&cursors, sink);
+  }, &value_to_dest, ret);
 }
 
 Status Storage::SInter(const std::vector<std::string>& keys, std::vector<std::string>* members) {
@@ -570,35 +791,15 @@ Status Storage::SInter(const std::vector<std::string>& keys, std::vector<std::st
     return s;
   }
 
-  std::vector<std::string> key0_members;
-  auto& inst = GetDBInstance(keys[0]);
-  s = inst->SMembers(keys[0], &key0_members);
-  if (s.IsNotFound()) {
-    return Status::OK();
-  }
-  if (!s.ok()) {
+  MemberCursors cursors;
+  s = NewSetsMemberCursors(keys, &cursors);
+  if (!s.ok() || std::find(cursors.begin(), cursors.end(), nullptr) != cursors.end()) {
     return s;
   }
-
-  for (const auto member : key0_members) {
-    int32_t exist = 1;
-    for (int idx = 1; idx < keys.size(); idx++) {
-      Slice pkey(keys[idx]);
-      auto& inst = GetDBInstance(keys[idx]);
-      s = inst->SIsmember(keys[idx], member, &exist);
-      if (s.ok() && exist > 0) {
-        continue;
-      } else if (!s.IsNotFound()) {
-        return s;
-      } else {
-        break;
-      }
-    }
-    if (exist > 0) {
-      members->push_back(member);
-    }
-  }
-  return Status::OK();
+  return SetsInter(&cursors, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return Status::OK();
+  });
 }
 
 Status Storage::SInterstore(const Slice& destination, const std::vector<std::string>& keys, std::vector<std::string>& value_to_dest, int32_t* ret) {
@@ -611,19 +812,15 @@ Status Storage::SInterstore(const Slice& destination, const std::vector<std::str
     return s;
   }
 
-  s = SInter(keys, &value_to_dest);
-  if (!s.ok()) {
-    return s;
-  }
-
   auto& dest_inst = GetDBInstance(destination);
-  s = dest_inst->Del(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-
-  s = dest_inst->SAdd(destination, value_to_dest, ret);
-  return s;
+  return dest_inst->SetsStore(destination, [&](const SetsMemberSink& sink) {
+    MemberCursors cursors;
+    Status s = NewSetsMemberCursors(keys, &cursors);
+    if (!s.ok() || std::find(cursors.begin(), cursors.end(), nullptr) != cursors.end()) {
+      return s;
+    }
+    return SetsInter(&cursors, sink);
+  }, &value_to_dest, ret);
 }
 
 Status Storage::SIsmember(const Slice& key, const Slice& member, int32_t* ret) {
@@ -694,26 +891,16 @@ Status Storage::SUnion(const std::vector<std::string>& keys, std::vector<std::st
     return inst->SUnion(keys, members);
   }
 
-  using Iter = std::vector<std::string>::iterator;
-  using Uset = std::unordered_set<std::string>;
-  Uset member_set;
-  for (const auto& key : keys) {
-    std::vector<std::string> vec;
-    auto& inst = GetDBInstance(key);
-    s = inst->SMembers(key, &vec);
-    if (s.IsNotFound()) {
-      continue;
-    }
-    if (!s.ok()) {
-      return s;
-    }
-    std::copy(std::move_iterator<Iter>(vec.begin()),
-              std::move_iterator<Iter>(vec.end()),
-              std::insert_iterator<Uset>(member_set, member_set.begin()));
+  MemberCursors cursors;
+  s = NewSetsMemberCursors(keys, &cursors);
+  if (!s.ok()) {
+    return s;
   }
-
-  std::copy(member_set.begin(), member_set.end(), std::back_inserter(*members));
-  return Status::OK();
+  cursors.erase(std::remove(cursors.begin(), cursors.end(), nullptr), cursors.end());
+  return SetsUnion(&cursors, [members](const Slice& member) {
+    members->push_back(member.ToString());
+    return Status::OK();
+  });
 }
 
 Status Storage::SUnionstore(const Slice& destination, const std::vector<std::string>& keys, std::vector<std::string>& value_to_dest, int32_t* ret) {
@@ -727,18 +914,16 @@ Status Storage::SUnionstore(const Slice& destination, const std::vector<std::str
     return s;
   }
 
-  s = SUnion(keys, &value_to_dest);
-  if (!s.ok()) {
-    return s;
-  }
-  *ret = value_to_dest.size();
   auto& dest_inst = GetDBInstance(destination);
-  s = dest_inst->Del(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-  int unused_ret;
-  return dest_inst->SAdd(destination, value_to_dest, &unused_ret);
+  return dest_inst->SetsStore(destination, [&](const SetsMemberSink& sink) {
+    MemberCursors cursors;
+    Status s = NewSetsMemberCursors(keys, &cursors);
+    if (!s.ok()) {
+      return s;
+    }
+    cursors.erase(std::remove(cursors.begin(), cursors.end(), nullptr), cursors.end());
+    return SetsUnion(&cursors, sink);
+  }, &value_to_dest, ret);
 }
 
 Status Storage::SScan(const Slice& key, int64_t cursor, const std::string& pattern, int64_t count,
@@ -970,9 +1155,24 @@ Status Storage::ZScore(const Slice& key, const Slice& member, double* ret) {
   return inst->ZScore(key, member, ret);
 }
 
+Status Storage::NewZSetsMergeInputs(const std::vector<std::string>& keys, const std::vector<double>& weights,
+                                    ZSetsMergeInputs* inputs) {
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    ZSetsMergeInput input;
+    auto& inst = GetDBInstance(keys[idx]);
+    Status s = inst->NewZSetsMergeInput(keys[idx], rocksdb::ReadOptions(), &input);
+    if (!s.ok() && !s.IsNotFound()) {
+      return s;
+    }
+    input.weight = idx < weights.size() ? weights[idx] : 1;
+    inputs->push_back(std::move(input));
+  }
+  return Status::OK();
+}
+
 Status Storage::ZUnionstore(const Slice& destination, const std::vector<std::string>& keys,
                             const std::vector<double>& weights, const AGGREGATE agg,
-                            std::map<std::string, double>& value_to_dest, int32_t* ret) {
+                            std::vector<ScoreMember>& value_to_dest, int32_t* ret) {
   value_to_dest.clear();
   Status s;
 
@@ -983,50 +1183,15 @@ Status Storage::ZUnionstore(const Slice& destination, const std::vector<std::str
     return s;
   }
 
-  for (int idx = 0; idx < keys.size(); idx++) {
-    Slice key = Slice(keys[idx]);
-    auto& inst = GetDBInstance(key);
-    std::map<std::string, double> member_to_score;
-    double weight = idx >= weights.size() ? 1 : weights[idx];
-    s = inst->ZGetAll(key, weight, &member_to_score);
-    if (!s.ok() && !s.IsNotFound()) {
+  auto& dest_inst = GetDBInstance(destination);
+  return dest_inst->ZSetsStore(destination, [&](const ZSetsMemberSink& sink) {
+    ZSetsMergeInputs inputs;
+    Status s = NewZSetsMergeInputs(keys, weights, &inputs);
+    if (!s.ok()) {
       return s;
     }
-    for (const auto& key_score : member_to_score) {
-      const std::string& member = key_score.first;
-      double score = key_score.second;
-      if (value_to_dest.find(member) == value_to_dest.end()) {
-        value_to_dest[member] = score;
-        continue;
-      }
-      switch (agg) {
-        case SUM:
-          score += value_to_dest[member];
-          break;
-        case MIN:
-          score = std::min(value_to_dest[member], score);
-          break;
-        case MAX:
-          score = std::max(value_to_dest[member], score);
-          break;
-      }
-      value_to_dest[member] = (score == -0.0) ? 0 : score;
-    }
-  }
-
-  BaseMetaKey base_destination(destination);
-  auto& inst = GetDBInstance(destination);
-  s = inst->ZsetsDel(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-  std::vector<ScoreMember> score_members;
-  std::for_each(value_to_dest.begin(), value_to_dest.end(), [&score_members](auto kv) {
-      score_members.emplace_back(kv.second, kv.first);
-      });
-  *ret = score_members.size();
-  int unused_ret;
-  return inst->ZAdd(destination, score_members, &unused_ret);
+    return ZSetsUnion(&inputs, agg, sink);
+  }, &value_to_dest, ret);
 }
 
 Status Storage::ZInterstore(const Slice& destination, const std::vector<std::string>& keys,
@@ -1042,59 +1207,15 @@ Status Storage::ZInterstore(const Slice& destination, const std::vector<std::str
     return s;
   }
 
-  Slice key = Slice(keys[0]);
-  auto& inst = GetDBInstance(key);
-  std::map<std::string, double> member_to_score;
-  double weight = weights.empty() ? 1 : weights[0];
-  s = inst->ZGetAll(key, weight, &member_to_score);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-
-  for (const auto member_score : member_to_score) {
-    std::string member = member_score.first;
-    double score = member_score.second;
-    bool reliable = true;
-
-    for (int idx = 1; idx < keys.size(); idx++) {
-      double weight = idx >= weights.size() ? 1 : weights[idx];
-      auto& inst = GetDBInstance(keys[idx]);
-      double ret_score;
-      s = inst->ZScore(keys[idx], member, &ret_score);
-      if (!s.ok() && !s.IsNotFound()) {
-        return s;
-      }
-      if (s.IsNotFound()) {
-        reliable = false;
-        break;
-      }
-      switch (agg) {
-        case SUM:
-          score += ret_score * weight;
-          break;
-        case MIN:
-          score = std::min(score, ret_score * weight);
-          break;
-        case MAX:
-          score = std::max(score, ret_score * weight);
-          break;
-      }
-    }
-    if (reliable) {
-      value_to_dest.emplace_back(score, member);
+  auto& dest_inst = GetDBInstance(destination);
+  return dest_inst->ZSetsStore(destination, [&](const ZSetsMemberSink& sink) {
+    ZSetsMergeInputs inputs;
+    Status s = NewZSetsMergeInputs(keys, weights, &inputs);
+    if (!s.ok()) {
+      return s;
     }
-  }
-
-  BaseMetaKey base_destination(destination);
-  auto& ninst = GetDBInstance(destination);
-
-  s = ninst->ZsetsDel(destination);
-  if (!s.ok() && !s.IsNotFound()) {
-    return s;
-  }
-  *ret = value_to_dest.size();
-  int unused_ret;
-  return ninst->ZAdd(destination, value_to_dest, &unused_ret);
+    return ZSetsInter(&inputs, agg, sink);
+  }, &value_to_dest, ret);
 }
 
 Status Storage::ZRangebylex(const Slice& key, const Slice& min, const Slice& max, bool left_close,
@@ -1194,13 +1315,25 @@ int32_t Storage::Expire(const Slice& key, int64_t ttl_millsec) {
 
 
 int64_t Storage::Del(const std::vector<std::string>& keys) {
-  Status s;
   int64_t count = 0;
-  for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
-    s = inst->Del(key);
+  std::vector<std::vector<size_t>> key_indexes;
+  GroupKeysByInstance(keys, &key_indexes);
+  for (size_t inst_index = 0; inst_index < key_indexes.size(); ++inst_index) {
+    const auto& indexes = key_indexes[inst_index];
+    if (indexes.empty()) {
+      continue;
+    }
+    std::vector<std::string> inst_keys;
+    inst_keys.reserve(indexes.size());
+    for (const auto idx : indexes) {
+      inst_keys.push_back(keys[idx]);
+    }
+    int64_t inst_count = 0;
+    Status s = insts_[inst_index]->Del(inst_keys, &inst_count);
     if (s.ok()) {
-      count++;
+      count += inst_count;
+    } else {
+      LOG(WARNING) << "instance " << inst_index << " delete keys failed, error: " << s.ToString();
     }
   }
   return count;
@@ -1208,21 +1341,31 @@ int64_t Storage::Del(const std::vector<std::string>& keys) {
 
 int64_t Storage::Exists(const std::vector<std::string>& keys) {
   int64_t count = 0;
-  Status s;
-  for (const auto& key : keys) {
-    auto& inst = GetDBInstance(key);
-    s = inst->Exists(key);
-    if (s.ok()) {
-      count++;
-    } else if (!s.IsNotFound()) {
+  std::vector<std::vector<size_t>> key_indexes;
+  GroupKeysByInstance(keys, &key_indexes);
+  for (size_t inst_index = 0; inst_index < key_indexes.size(); ++inst_index) {
+    const auto& indexes = key_indexes[inst_index];
+    if (indexes.empty()) {
+      continue;
+    }
+    std::vector<std::string> inst_keys;
+    inst_keys.reserve(indexes.size());
+    for (const auto idx : indexes) {
+      inst_keys.push_back(keys[idx]);
+    }
+    int64_t inst_count = 0;
+    Status s = insts_[inst_index]->Exists(inst_keys, &inst_count);
+    if (!s.ok()) {
       return -1;
     }
+    count += inst_count;
   }
   return count;
 }
 
 int64_t Storage::Scan(const DataType& dtype, int64_t cursor, const std::string& pattern, int64_t count,
                       std::vector<std::string>* keys) {
+  WaitInstancesOpened();
   assert(is_classic_mode_);
   keys->clear();
   bool is_finish;
@@ -1315,6 +1458,7 @@ int64_t Storage::Scan(const DataType& dtype, int64_t cursor, const std::string&
 Status Storage::PKScanRange(const DataType& data_type, const Slice& key_start, const Slice& key_end,
                             const Slice& pattern, int32_t limit, std::vector<std::string>* keys,
                             std::vector<KeyValue>* kvs, std::string* next_key) {
+  WaitInstancesOpened();
   next_key->clear();
   std::string key;
   std::string value;
@@ -1356,6 +1500,13 @@ Status Storage::PKScanRange(const DataType& data_type, const Slice& key_start, c
     miter.Next();
   }
 
+  // a value that could not be read fails the scan
+  for (const auto& iter : inst_iters) {
+    Status s = iter->status();
+    if (!s.ok()) {
+      return s;
+    }
+  }
   if (miter.Valid() && (end_no_limit || miter.Key().compare(key_end.ToString()) <= 0)) {
     *next_key = miter.Key();
   }
@@ -1365,6 +1516,7 @@ Status Storage::PKScanRange(const DataType& data_type, const Slice& key_start, c
 Status Storage::PKRScanRange(const DataType& data_type, const Slice& key_start, const Slice& key_end,
                              const Slice& pattern, int32_t limit, std::vector<std::string>* keys,
                              std::vector<KeyValue>* kvs, std::string* next_key) {
+  WaitInstancesOpened();
   next_key->clear();
   std::string key, value;
   BaseMetaKey base_key_start(key_start);
@@ -1403,6 +1555,13 @@ Status Storage::PKRScanRange(const DataType& data_type, const Slice& key_start,
     miter.Prev();
   }
 
+  // a value that could not be read fails the scan
+  for (const auto& iter : inst_iters) {
+    Status s = iter->status();
+    if (!s.ok()) {
+      return s;
+    }
+  }
   if (miter.Valid() && (end_no_limit || miter.Key().compare(key_end.ToString()) >= 0)) {
     *next_key = miter.Key();
   }
@@ -1411,24 +1570,25 @@ Status Storage::PKRScanRange(const DataType& data_type, const Slice& key_start,
 
 Status Storage::PKPatternMatchDelWithRemoveKeys(const std::string& pattern, int64_t* ret, 
                                                 std::vector<std::string>* remove_keys, const int64_t& max_count) {
-  Status s;
   *ret = 0;
-  for (const auto& inst : insts_) {
-    int64_t tmp_ret = 0;
-    s = inst->PKPatternMatchDelWithRemoveKeys(pattern, &tmp_ret, remove_keys, max_count - *ret);
-    if (!s.ok()) {
-      return s;
-    } 
-    *ret += tmp_ret;
-    if (*ret == max_count) {
-      return s;
-    }
+  // the instances share max_count, each key they delete takes one from it
+  std::atomic<int64_t> remaining(max_count);
+  std::vector<int64_t> inst_rets(insts_.size(), 0);
+  std::vector<std::vector<std::string>> inst_remove_keys(insts_.size());
+  Status s = ForEachInstance([&](size_t idx) {
+    return insts_[idx]->PKPatternMatchDelWithRemoveKeys(pattern, &inst_rets[idx], &inst_remove_keys[idx], &remaining);
+  });
+  for (size_t idx = 0; idx < insts_.size(); ++idx) {
+    *ret += inst_rets[idx];
+    remove_keys->insert(remove_keys->end(), std::make_move_iterator(inst_remove_keys[idx].begin()),
+                        std::make_move_iterator(inst_remove_keys[idx].end()));
   }
   return s;
 }
 
 Status Storage::Scanx(const DataType& data_type, const std::string& start_key, const std::string& pattern,
                       int64_t count, std::vector<std::string>* keys, std::string* next_key) {
+  WaitInstancesOpened();
   Status s;
   keys->clear();
   next_key->clear();
@@ -1516,30 +1676,35 @@ Status Storage::GetType(const std::string& key, enum DataType& type) {
 
 Status Storage::Keys(const DataType& data_type, const std::string& pattern, std::vector<std::string>* keys) {
   keys->clear();
-  std::vector<DataType> types;
-  types.push_back(data_type);
-
-  for (const auto& type : types) {
-    std::vector<IterSptr> inst_iters;
-    for (const auto& inst : insts_) {
-      IterSptr inst_iter;
-      inst_iter.reset(inst->CreateIterator(type, pattern, nullptr /*lower_bound*/, nullptr /*upper_bound*/));
-      inst_iters.push_back(inst_iter);
+  std::vector<std::vector<std::string>> inst_keys(insts_.size());
+  Status s = ForEachInstance([&](size_t idx) {
+    std::unique_ptr<TypeIterator> inst_iter(
+        insts_[idx]->CreateIterator(data_type, pattern, nullptr /*lower_bound*/, nullptr /*upper_bound*/));
+    if (inst_iter == nullptr) {
+      return Status::OK();
     }
-
-    MergingIterator miter(inst_iters);
-    miter.SeekToFirst();
-    while (miter.Valid()) {
-      keys->push_back(miter.Key());
-      miter.Next();
+    for (inst_iter->SeekToFirst(); inst_iter->Valid(); inst_iter->Next()) {
+      inst_keys[idx].push_back(inst_iter->Key());
     }
+    return inst_iter->status();
+  });
+  if (!s.ok()) {
+    return s;
   }
 
+  // the keys of every instance come out sorted, merge them in order as the
+  // merging iterator would
+  for (auto& ikeys : inst_keys) {
+    auto middle = static_cast<std::ptrdiff_t>(keys->size());
+    keys->insert(keys->end(), std::make_move_iterator(ikeys.begin()), std::make_move_iterator(ikeys.end()));
+    std::inplace_merge(keys->begin(), keys->begin() + middle, keys->end());
+  }
   return Status::OK();
 }
 
 void Storage::ScanDatabase(const DataType& type) {
-  for (const auto& inst : insts_) {
+  ForEachInstance([&](size_t idx) {
+    const auto& inst = insts_[idx];
     switch (type) {
       case DataType::kStrings:
         inst->ScanStrings();
@@ -1567,7 +1732,8 @@ void Storage::ScanDatabase(const DataType& type) {
         inst->ScanLists();
         break;
     }
-  }
+    return Status::OK();
+  });
 }
 
 // HyperLogLog
@@ -1578,29 +1744,27 @@ Status Storage::PfAdd(const Slice& key, const std::vector<std::string>& values,
   }
 
   std::string value;
-  std::string registers;
-  std::string result;
   auto& inst = GetDBInstance(key);
   Status s = inst->HyperloglogGet(key, &value);
-  if (s.ok()) {
-    registers = value;
-  } else if (s.IsNotFound()) {
-    registers = "";
-  } else {
+  if (!s.ok() && !s.IsNotFound()) {
     return s;
   }
-  HyperLogLog log(kPrecision, registers);
-  auto previous = static_cast<int32_t>(log.Estimate());
+  HyperLogLog log(kPrecision);
+  if (s.ok() && !log.Decode(value)) {
+    return Status::Corruption("bad hyperloglog value");
+  }
+  bool changed = false;
   for (const auto& value : values) {
-    result = log.Add(value.data(), value.size());
+    changed = log.Add(value.data(), value.size()) || changed;
   }
-  HyperLogLog update_log(kPrecision, result);
-  auto now = static_cast<int32_t>(update_log.Estimate());
-  if (previous != now || (s.IsNotFound() && values.empty())) {
-    *update = true;
+  // like redis, true when a register changed
+  if (!changed && s.ok()) {
+    return Status::OK();
   }
-  s = inst->HyperloglogSet(key, result);
-  return s;
+  *update = true;
+  // the count is cached by the writes, PFCOUNT only reads it
+  log.SetCachedCardinality(static_cast<int32_t>(log.Estimate()));
+  return inst->HyperloglogSet(key, log.Encode());
 }
 
 Status Storage::PfCount(const std::vector<std::string>& keys, int64_t* result) {
@@ -1608,31 +1772,33 @@ Status Storage::PfCount(const std::vector<std::string>& keys, int64_t* result) {
     return Status::InvalidArgument("Invalid the number of key");
   }
 
-  std::string value;
-  std::string first_registers;
+  std::string first_value;
   auto& inst = GetDBInstance(keys[0]);
-  Status s = inst->HyperloglogGet(keys[0], &value);
-  if (s.ok()) {
-    first_registers = std::string(value.data(), value.size());
-  } else if (s.IsNotFound()) {
-    first_registers = "";
-  } else {
+  Status s = inst->HyperloglogGet(keys[0], &first_value);
+  if (!s.ok() && !s.IsNotFound()) {
     return s;
   }
-  HyperLogLog first_log(kPrecision, first_registers);
+  bool first_found = s.ok();
+  HyperLogLog first_log(kPrecision);
+  if (first_found && !first_log.Decode(first_value)) {
+    return Status::Corruption("bad hyperloglog value");
+  }
+  if (keys.size() == 1 && first_log.CachedCardinality(result)) {
+    return Status::OK();
+  }
   for (size_t i = 1; i < keys.size(); ++i) {
     std::string value;
-    std::string registers;
     auto& inst = GetDBInstance(keys[i]);
     s = inst->HyperloglogGet(keys[i], &value);
-    if (s.ok()) {
-      registers = value;
-    } else if (s.IsNotFound()) {
+    if (s.IsNotFound()) {
       continue;
-    } else {
+    } else if (!s.ok()) {
       return s;
     }
-    HyperLogLog log(kPrecision, registers);
+    HyperLogLog log(kPrecision);
+    if (!log.Decode(value)) {
+      return Status::Corruption("bad hyperloglog value");
+    }
     first_log.Merge(log);
   }
   *result = static_cast<int32_t>(first_log.Estimate());
@@ -1646,35 +1812,30 @@ Status Storage::PfMerge(const std::vector<std::string>& keys, std::string& value
 
   Status s;
   std::string value;
-  std::string first_registers;
-  std::string result;
   auto& inst = GetDBInstance(keys[0]);
   s = inst->HyperloglogGet(keys[0], &value);
-  if (s.ok()) {
-    first_registers = std::string(value.data(), value.size());
-  } else if (s.IsNotFound()) {
-    first_registers = "";
+  HyperLogLog first_log(kPrecision);
+  if (s.ok() && !first_log.Decode(value)) {
+    return Status::Corruption("bad hyperloglog value");
   }
-
-  result = first_registers;
-  HyperLogLog first_log(kPrecision, first_registers);
   for (size_t i = 1; i < keys.size(); ++i) {
     std::string value;
-    std::string registers;
     auto& tmp_inst = GetDBInstance(keys[i]);
     s = tmp_inst->HyperloglogGet(keys[i], &value);
-    if (s.ok()) {
-      registers = std::string(value.data(), value.size());
-    } else if (s.IsNotFound()) {
+    if (s.IsNotFound()) {
       continue;
-    } else {
+    } else if (!s.ok()) {
       return s;
     }
-    HyperLogLog log(kPrecision, registers);
-    result = first_log.Merge(log);
+    HyperLogLog log(kPrecision);
+    if (!log.Decode(value)) {
+      return Status::Corruption("bad hyperloglog value");
+    }
+    first_log.Merge(log);
   }
-  auto& ninst = GetDBInstance(keys[0]);
-  s = ninst->HyperloglogSet(keys[0], result);
+  first_log.SetCachedCardinality(static_cast<int32_t>(first_log.Estimate()));
+  std::string result = first_log.Encode();
+  s = inst->HyperloglogSet(keys[0], result);
   value_to_dest = std::move(result);
   return s;
 }
@@ -1699,9 +1860,19 @@ Status Storage::AddBGTask(const BGTask& bg_task) {
   bg_tasks_mutex_.lock();
   if (bg_task.type == DataType::kAll) {
     // if current task it is global compact,
-    // clear the bg_tasks_queue_;
-    std::queue<BGTask> empty_queue;
-    bg_tasks_queue_.swap(empty_queue);
+    // clear the bg_tasks_queue_, but for the ranges to reclaim, which the
+    // compaction filters would only get to one key at a time
+    std::queue<BGTask> reclaim_queue;
+    while (!bg_tasks_queue_.empty()) {
+      if (bg_tasks_queue_.front().operation == kReclaimRange) {
+        reclaim_queue.push(std::move(bg_tasks_queue_.front()));
+      }
+      bg_tasks_queue_.pop();
+    }
+    bg_tasks_queue_.swap(reclaim_queue);
+  }
+  if (bg_task.operation == kReclaimRange) {
+    pending_reclaim_ranges_++;
   }
   bg_tasks_queue_.push(bg_task);
   bg_tasks_cond_var_.notify_one();
@@ -1711,10 +1882,19 @@ Status Storage::AddBGTask(const BGTask& bg_task) {
 
 Status Storage::RunBGTask() {
   BGTask task;
+  auto next_reap = std::chrono::steady_clock::now();
   while (!bg_tasks_should_exit_) {
     std::unique_lock<std::mutex> lock(bg_tasks_mutex_);
-    bg_tasks_cond_var_.wait(lock, [this]() { return !bg_tasks_queue_.empty() || bg_tasks_should_exit_; });
+    auto has_task = [this]() { return !bg_tasks_queue_.empty() || bg_tasks_should_exit_; };
+    // with the reaper on the thread also wakes up when the next pass is due
+    int32_t reap_rate = expiry_reap_rate_;
+    if (reap_rate > 0) {
+      bg_tasks_cond_var_.wait_until(lock, next_reap, has_task);
+    } else {
+      bg_tasks_cond_var_.wait(lock, [this, &has_task]() { return has_task() || expiry_reap_rate_ > 0; });
+    }
 
+    task = BGTask();
     if (!bg_tasks_queue_.empty()) {
       task = bg_tasks_queue_.front();
       bg_tasks_queue_.pop();
@@ -1736,12 +1916,56 @@ Status Storage::RunBGTask() {
       if (task.argv.size() == 2) {
         DoCompactRange(task.type, task.argv.front(), task.argv.back());
       }
+    } else if (task.operation == kReclaimRange) {
+      if (task.argv.size() == 2) {
+        Status s = GetDBInstance(task.argv[0])
+                       ->ReclaimRange(task.type, task.argv[0], std::strtoull(task.argv[1].c_str(), nullptr, 10));
+        if (!s.ok()) {
+          LOG(WARNING) << "ReclaimRange error: " << s.ToString();
+        }
+      }
+      pending_reclaim_ranges_--;
+    }
+
+    // a rate under 1000 / kExpiryReapIntervalMs is met with passes of one
+    // entry further apart
+    if (reap_rate > 0 && std::chrono::steady_clock::now() >= next_reap) {
+      int64_t interval_ms = std::max<int64_t>(kExpiryReapIntervalMs, 1000 / reap_rate);
+      int64_t reaped = 0;
+      Status s = ReapExpiredKeys(std::max<int64_t>(reap_rate * interval_ms / 1000, 1), &reaped);
+      if (!s.ok()) {
+        LOG(WARNING) << "ReapExpiredKeys error: " << s.ToString();
+      }
+      next_reap = std::chrono::steady_clock::now() + std::chrono::milliseconds(interval_ms);
+    }
+  }
+  return Status::OK();
+}
+
+Status Storage::ReapExpiredKeys(int64_t max_entries, int64_t* reaped) {
+  *reaped = 0;
+  if (insts_.empty()) {
+    return Status::OK();
+  }
+  // every pass starts from the next instance, so a busy one does not take
+  // the whole rate
+  size_t first = reap_cursor_++ % insts_.size();
+  int64_t entries = 0;
+  for (size_t n = 0; n < insts_.size() && entries < max_entries; ++n) {
+    int64_t inst_entries = 0;
+    int64_t inst_reaped = 0;
+    Status s = insts_[(first + n) % insts_.size()]->ReapExpiredKeys(max_entries - entries, &inst_entries, &inst_reaped);
+    entries += inst_entries;
+    *reaped += inst_reaped;
+    if (!s.ok()) {
+      return s;
     }
   }
   return Status::OK();
 }
 
 Status Storage::LongestNotCompactionSstCompact(const DataType &type, bool sync) {
+  WaitInstancesOpened();
   if (sync) {
     Status s;
     for (const auto& inst : insts_) {
@@ -1760,6 +1984,283 @@ Status Storage::LongestNotCompactionSstCompact(const DataType &type, bool sync)
   return Status::OK();
 }
 
+Status Storage::ConvertDataFormat(DataFormat target_format, uint64_t* converted) {
+  WaitInstancesOpened();
+  *converted = 0;
+  for (const auto& inst : insts_) {
+    uint64_t inst_converted = 0;
+    Status s = inst->ConvertDataFormat(target_format, &inst_converted);
+    *converted += inst_converted;
+    if (!s.ok()) {
+      LOG(ERROR) << "ConvertDataFormat of instance " << inst->GetIndex() << " error: " << s.ToString();
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status Storage::LoadSlotTable() {
+  // a migration puts the table in the instances in order and has switched
+  // the slots once instance 0 has it, so instance 0 always has the newest
+  std::string value;
+  Status s = insts_[0]->GetSlotTable(&value);
+  if (s.ok()) {
+    if (!slot_indexer_->Decode(value)) {
+      return Status::Corruption("slot table of instance 0 does not have " + std::to_string(slot_num_) + " slots");
+    }
+  } else if (!s.IsNotFound()) {
+    return s;
+  }
+  // without a table the slots stay slot % db_instance_num as the keys were
+  // put, SettleInstanceSlots stores it so that a later change of
+  // db_instance_num keeps it
+  for (uint32_t slot_id = 0; slot_id < static_cast<uint32_t>(slot_num_); ++slot_id) {
+    uint32_t inst_id = slot_indexer_->GetInstanceID(slot_id);
+    if (inst_id >= insts_.size()) {
+      return Status::InvalidArgument("slot " + std::to_string(slot_id) + " lives in instance " +
+                                     std::to_string(inst_id) + ", more instances are needed to open it");
+    }
+  }
+  return Status::OK();
+}
+
+Status Storage::SettleInstanceSlots(size_t inst_id) {
+  auto& inst = insts_[inst_id];
+  std::string table = slot_indexer_->Encode();
+  std::string value;
+  Status s = inst->GetSlotTable(&value);
+  if (s.IsNotFound() || (s.ok() && value != table)) {
+    s = inst->PutSlotTable(table);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::vector<uint32_t> slots;
+  s = inst->GetMigratingSlots(&slots);
+  if (s.IsNotFound()) {
+    return Status::OK();
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<uint32_t> stray_slots;
+  for (const auto slot_id : slots) {
+    if (slot_id < static_cast<uint32_t>(slot_num_) && slot_indexer_->GetInstanceID(slot_id) != inst_id) {
+      stray_slots.push_back(slot_id);
+    }
+  }
+  if (!stray_slots.empty()) {
+    LOG(WARNING) << "instance " << inst_id << " holds keys of " << stray_slots.size()
+                 << " slots an interrupted migration left, deleting them";
+    s = inst->DeleteSlots(SlotSet(slot_num_, stray_slots));
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return inst->PutMigratingSlots({});
+}
+
+// A migration goes on copying the keys written during the last round until
+// they are this few, or for this many rounds, before it takes the barrier
+static const int kSlotMigrationRounds = 16;
+static const size_t kSlotMigrationBarrierKeys = 1000;
+
+Status Storage::MigrateSlots(const std::vector<uint32_t>& slots, uint32_t dst_inst, const SlotBarrier& barrier) {
+  WaitInstancesOpened();
+  if (dst_inst >= insts_.size()) {
+    return Status::InvalidArgument("no instance " + std::to_string(dst_inst));
+  }
+  std::lock_guard l(slot_migration_mutex_);
+  std::vector<std::vector<uint32_t>> src_slots(insts_.size());
+  for (const auto slot_id : slots) {
+    if (slot_id >= static_cast<uint32_t>(slot_num_)) {
+      return Status::InvalidArgument("no slot " + std::to_string(slot_id));
+    }
+    uint32_t src_inst = slot_indexer_->GetInstanceID(slot_id);
+    if (src_inst != dst_inst) {
+      src_slots[src_inst].push_back(slot_id);
+    }
+  }
+  for (uint32_t src_inst = 0; src_inst < src_slots.size(); ++src_inst) {
+    if (src_slots[src_inst].empty()) {
+      continue;
+    }
+    Status s = MigrateInstanceSlots(src_slots[src_inst], src_inst, dst_inst, barrier);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
+Status Storage::MigrateInstanceSlots(const std::vector<uint32_t>& slots, uint32_t src_inst, uint32_t dst_inst,
+                                     const SlotBarrier& barrier) {
+  auto& src = insts_[src_inst];
+  auto& dst = insts_[dst_inst];
+  SlotSet slot_set(slot_num_, slots);
+  // dst holds keys of slots it does not own from here, until they switch
+  Status s = dst->PutMigratingSlots(slots);
+  if (!s.ok()) {
+    return s;
+  }
+  // the log goes in before the snapshot of the copy, so every write the
+  // snapshot misses is in it
+  auto log = std::make_shared<SlotWriteLog>(slot_set);
+  src->SetSlotWriteLog(log);
+  s = src->CopySlots(dst.get(), slot_set);
+  std::vector<std::string> keys;
+  for (int round = 0; s.ok() && round < kSlotMigrationRounds; ++round) {
+    keys = log->Take();
+    if (keys.size() <= kSlotMigrationBarrierKeys) {
+      break;
+    }
+    s = src->CopyKeys(dst.get(), keys);
+    keys.clear();
+  }
+
+  bool switched = false;
+  auto switch_slots = [&]() {
+    std::vector<std::string> last_keys = log->Take();
+    keys.insert(keys.end(), last_keys.begin(), last_keys.end());
+    Status s = src->CopyKeys(dst.get(), keys);
+    if (!s.ok()) {
+      return s;
+    }
+    // and src holds them from the first table put on
+    s = src->PutMigratingSlots(slots);
+    if (!s.ok()) {
+      return s;
+    }
+    SlotIndexer table(slot_num_, db_instance_num_);
+    table.Decode(slot_indexer_->Encode());
+    for (const auto slot_id : slots) {
+      table.SetInstanceID(slot_id, dst_inst);
+    }
+    // every instance keeps the table and the next open takes the one of
+    // instance 0, which goes first, so the slots have switched once it has it
+    std::string value = table.Encode();
+    for (const auto& inst : insts_) {
+      s = inst->PutSlotTable(value);
+      if (!s.ok()) {
+        break;
+      }
+      switched = true;
+    }
+    if (switched) {
+      slot_indexer_->Decode(value);
+    }
+    return s;
+  };
+  if (s.ok()) {
+    s = barrier ? barrier(switch_slots) : switch_slots();
+  }
+  src->SetSlotWriteLog(nullptr);
+
+  // the keys left in the instance that does not own the slots go, an open
+  // after a failure here deletes them as well
+  Status cleanup = (switched ? src : dst)->DeleteSlots(slot_set);
+  if (cleanup.ok()) {
+    cleanup = src->PutMigratingSlots({});
+  }
+  if (cleanup.ok()) {
+    cleanup = dst->PutMigratingSlots({});
+  }
+  // the copy and the cleanup are no load for the next rebalance plan to see
+  rebalance_written_bytes_[src_inst] = src->GetWrittenBytes();
+  rebalance_written_bytes_[dst_inst] = dst->GetWrittenBytes();
+  if (!s.ok()) {
+    LOG(ERROR) << "migrate " << slots.size() << " slots from instance " << src_inst << " to instance " << dst_inst
+               << " failed, " << s.ToString();
+    return s;
+  }
+  LOG(INFO) << "migrated " << slots.size() << " slots from instance " << src_inst << " to instance " << dst_inst;
+  return cleanup;
+}
+
+Status Storage::PlanSlotRebalance(int64_t max_slots, std::vector<SlotMove>* moves) {
+  WaitInstancesOpened();
+  moves->clear();
+  std::lock_guard l(slot_migration_mutex_);
+  size_t inst_num = insts_.size();
+  std::vector<double> sizes(inst_num, 0);
+  std::vector<double> writes(inst_num, 0);
+  double total_size = 0;
+  double total_writes = 0;
+  for (size_t idx = 0; idx < inst_num; ++idx) {
+    uint64_t size = 0;
+    Status s = insts_[idx]->GetProperty("rocksdb.estimate-live-data-size", &size);
+    if (!s.ok()) {
+      return s;
+    }
+    uint64_t written_bytes = insts_[idx]->GetWrittenBytes();
+    sizes[idx] = static_cast<double>(size);
+    writes[idx] = static_cast<double>(written_bytes - rebalance_written_bytes_[idx]);
+    rebalance_written_bytes_[idx] = written_bytes;
+    total_size += sizes[idx];
+    total_writes += writes[idx];
+  }
+
+  std::vector<std::vector<uint32_t>> inst_slots(inst_num);
+  for (size_t idx = 0; idx < inst_num; ++idx) {
+    inst_slots[idx] = slot_indexer_->GetSlots(idx);
+  }
+  std::vector<double> loads(inst_num, 0);
+  // the load a slot takes along, the one of its instance before any move
+  std::vector<double> slot_loads(inst_num, 0);
+  for (size_t idx = 0; idx < inst_num; ++idx) {
+    loads[idx] = (total_size > 0 ? sizes[idx] / total_size : 0) + (total_writes > 0 ? writes[idx] / total_writes : 0);
+    if (!inst_slots[idx].empty()) {
+      slot_loads[idx] = loads[idx] / static_cast<double>(inst_slots[idx].size());
+    }
+  }
+
+  while (static_cast<int64_t>(moves->size()) < max_slots) {
+    size_t src = 0;
+    size_t dst = 0;
+    for (size_t idx = 1; idx < inst_num; ++idx) {
+      if (loads[idx] > loads[src]) {
+        src = idx;
+      }
+      if (loads[idx] < loads[dst]) {
+        dst = idx;
+      }
+    }
+    double slot_load = slot_loads[src];
+    // the gap narrows only while the slot weighs less than it
+    if (src == dst || inst_slots[src].empty() || slot_load <= 0 || loads[src] - loads[dst] <= slot_load) {
+      break;
+    }
+    moves->push_back({inst_slots[src].back(), static_cast<uint32_t>(src), static_cast<uint32_t>(dst)});
+    inst_slots[src].pop_back();
+    loads[src] -= slot_load;
+    loads[dst] += slot_load;
+  }
+  return Status::OK();
+}
+
+Status Storage::RebalanceSlots(int64_t max_slots, const SlotBarrier& barrier, int64_t* moved) {
+  *moved = 0;
+  std::vector<SlotMove> moves;
+  Status s = PlanSlotRebalance(max_slots, &moves);
+  if (!s.ok()) {
+    return s;
+  }
+  // one migration per target, it walks every source once for all its slots
+  std::map<uint32_t, std::vector<uint32_t>> dst_slots;
+  for (const auto& move : moves) {
+    dst_slots[move.dst].push_back(move.slot);
+  }
+  for (const auto& [dst_inst, slots] : dst_slots) {
+    s = MigrateSlots(slots, dst_inst, barrier);
+    if (!s.ok()) {
+      return s;
+    }
+    *moved += static_cast<int64_t>(slots.size());
+  }
+  return Status::OK();
+}
+
 Status Storage::Compact(const DataType& type, bool sync) {
   if (sync) {
     return DoCompactRange(type, "", "");
@@ -1771,6 +2272,7 @@ Status Storage::Compact(const DataType& type, bool sync) {
 
 // run compactrange for all rocksdb instance
 Status Storage::DoCompactRange(const DataType& type, const std::string& start, const std::string& end) {
+  WaitInstancesOpened();
   if (type != DataType::kAll) {
     return Status::InvalidArgument("");
   }
@@ -1817,7 +2319,24 @@ Status Storage::DoCompactSpecificKey(const DataType& type, const std::string& ke
   return s;
 }
 
+Status Storage::FlushDB() {
+  WaitInstancesOpened();
+  // a migration would copy keys back in behind the flush
+  std::lock_guard l(slot_migration_mutex_);
+  for (const auto& inst : insts_) {
+    Status s = inst->FlushDB();
+    if (!s.ok()) {
+      LOG(ERROR) << "FlushDB error: " << s.ToString();
+      return s;
+    }
+  }
+  cursors_store_->Clear();
+  AddBGTask({DataType::kAll, kCleanAll});
+  return Status::OK();
+}
+
 Status Storage::SetMaxCacheStatisticKeys(uint32_t max_cache_statistic_keys) {
+  WaitInstancesOpened();
   for (const auto& inst : insts_) {
     inst->SetMaxCacheStatisticKeys(max_cache_statistic_keys);
   }
@@ -1825,6 +2344,7 @@ Status Storage::SetMaxCacheStatisticKeys(uint32_t max_cache_statistic_keys) {
 }
 
 Status Storage::SetSmallCompactionThreshold(uint32_t small_compaction_threshold) {
+  WaitInstancesOpened();
   for (const auto& inst : insts_) {
     inst->SetSmallCompactionThreshold(small_compaction_threshold);
   }
@@ -1832,6 +2352,7 @@ Status Storage::SetSmallCompactionThreshold(uint32_t small_compaction_threshold)
 }
 
 Status Storage::SetSmallCompactionDurationThreshold(uint32_t small_compaction_duration_threshold) {
+  WaitInstancesOpened();
   for (const auto& inst : insts_) {
     inst->SetSmallCompactionDurationThreshold(small_compaction_duration_threshold);
   }
@@ -1861,6 +2382,9 @@ Status Storage::GetUsage(const std::string& property, uint64_t* const result) {
 Status Storage::GetUsage(const std::string& property, std::map<int, uint64_t>* const inst_result) {
   inst_result->clear();
   for (const auto& inst : insts_) {
+    if (!IsInstanceOpened(inst->GetIndex())) {
+      continue;
+    }
     uint64_t value = 0;
     inst->GetProperty(property, &value);
     (*inst_result)[inst->GetIndex()] = value;
@@ -1873,24 +2397,31 @@ uint64_t Storage::GetProperty(const std::string& property) {
   uint64_t result = 0;
   Status s;
   for (const auto& inst : insts_) {
+    if (!IsInstanceOpened(inst->GetIndex())) {
+      continue;
+    }
     s = inst->GetProperty(property, &out);
     result += out;
   }
   return result;
 }
 
-Status Storage::GetKeyNum(std::vector<KeyInfo>* key_infos) {
-  KeyInfo key_info;
+Status Storage::GetKeyNum(std::vector<KeyInfo>* key_infos, bool verify) {
   key_infos->resize(DataTypeNum);
-  for (const auto& db : insts_) {
-    std::vector<KeyInfo> db_key_infos;
+  std::vector<std::vector<KeyInfo>> inst_key_infos(insts_.size());
+  Status s = ForEachInstance([&](size_t idx) {
     // check the scanner was stopped or not, before scanning the next db
     if (scan_keynum_exit_) {
-      break;
+      return Status::OK();
     }
-    auto s = db->ScanKeyNum(&db_key_infos);
-    if (!s.ok()) {
-      return s;
+    return insts_[idx]->ScanKeyNum(&inst_key_infos[idx], verify);
+  });
+  if (!s.ok()) {
+    return s;
+  }
+  for (const auto& db_key_infos : inst_key_infos) {
+    if (db_key_infos.empty()) {
+      continue;
     }
     std::transform(db_key_infos.begin(), db_key_infos.end(),
         key_infos->begin(), key_infos->begin(), std::plus<>{});
@@ -1908,6 +2439,7 @@ Status Storage::StopScanKeyNum() {
 }
 
 rocksdb::DB* Storage::GetDBByIndex(int index) {
+  WaitInstancesOpened();
   if (index < 0 || index >= db_instance_num_) {
     LOG(WARNING) << "Invalid DB Index: " << index << "total: "
                  << db_instance_num_;
@@ -1916,8 +2448,19 @@ rocksdb::DB* Storage::GetDBByIndex(int index) {
   return insts_[index]->GetDB();
 }
 
+DataFormat Storage::GetDataFormat(int index) {
+  WaitInstancesOpened();
+  if (index < 0 || index >= db_instance_num_) {
+    LOG(WARNING) << "Invalid DB Index: " << index << "total: "
+                 << db_instance_num_;
+    return kDataFormatV1;
+  }
+  return insts_[index]->GetDataFormat();
+}
+
 Status Storage::SetOptions(const OptionType& option_type, const std::string& db_type,
     const std::unordered_map<std::string, std::string>& options) {
+  WaitInstancesOpened();
   Status s;
   for (const auto& inst : insts_) {
     s = inst->SetOptions(option_type, options);
@@ -1930,6 +2473,7 @@ Status Storage::SetOptions(const OptionType& option_type, const std::string& db_
 }
 
 void Storage::SetCompactRangeOptions(const bool is_canceled) {
+  WaitInstancesOpened();
   for (const auto& inst : insts_) {
     inst->SetCompactRangeOptions(is_canceled);
   }
@@ -1949,6 +2493,7 @@ Status Storage::EnableDymayticOptions(const OptionType& option_type,
 
 Status Storage::EnableAutoCompaction(const OptionType& option_type,
     const std::string& db_type, const std::unordered_map<std::string, std::string>& options) {
+  WaitInstancesOpened();
   Status s;
 
   for (const auto& inst : insts_) {
@@ -1975,6 +2520,11 @@ void Storage::GetRocksDBInfo(std::string& info) {
   char temp[12] = {0};
   for (const auto& inst : insts_) {
     snprintf(temp, sizeof(temp), "instance%d_", inst->GetIndex());
+    if (!IsInstanceOpened(inst->GetIndex())) {
+      // see Open, lazy_open
+      info.append("#").append(temp).append("RocksDB\r\n").append(temp).append("open_state:loading\r\n");
+      continue;
+    }
     inst->GetRocksDBInfo(info, temp);
   }
 }
@@ -1995,6 +2545,7 @@ int64_t Storage::IsExist(const Slice& key, std::map<DataType, Status>* type_stat
 
 
 void Storage::DisableWal(const bool is_wal_disable) {
+  WaitInstancesOpened();
   for (const auto& inst : insts_) {
     inst->SetWriteWalOptions(is_wal_disable);
   }
@@ -8,8 +8,13 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "rocksdb/compaction_filter.h"
+#include "rocksdb/db.h"
+#include "src/base_data_key_format.h"
+#include "src/base_key_format.h"
+#include "src/bitmap_chunk.h"
 #include "src/debug.h"
 #include "src/strings_value_format.h"
 
@@ -62,5 +67,97 @@ class StringsFilterFactory : public rocksdb::CompactionFilterFactory {
   const char* Name() const override { return "StringsFilterFactory"; }
 };
 
+/*
+ * Keeps the chunks of the bitmap the meta value of their key points to, and
+ * drops the ones left by an earlier bitmap, by a string that replaced it, or
+ * by an expired or deleted key
+ */
+class BitmapsDataFilter : public rocksdb::CompactionFilter {
+ public:
+  BitmapsDataFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr)
+      : db_(db), cf_handles_ptr_(cf_handles_ptr) {}
+
+  bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value,
+              bool* value_changed) const override {
+    UNUSED(level);
+    UNUSED(value);
+    UNUSED(new_value);
+    UNUSED(value_changed);
+    ParsedBaseDataKey parsed_chunk_key(key);
+    TRACE("==========================START==========================");
+    TRACE("[BitmapsDataFilter], key: %s, version = %llu", parsed_chunk_key.Key().ToString().c_str(),
+          parsed_chunk_key.Version());
+
+    BaseKey base_key(parsed_chunk_key.Key());
+    std::string meta_key = base_key.Encode().ToString();
+    if (meta_key != cur_key_) {
+      // destroyed when close the database, Reserve Current key value
+      if (cf_handles_ptr_->empty()) {
+        return false;
+      }
+      cur_key_ = meta_key;
+      cur_meta_chunked_ = false;
+      std::string meta_value;
+      rocksdb::Status s = db_->Get(default_read_options_, (*cf_handles_ptr_)[0], cur_key_, &meta_value);
+      if (s.ok()) {
+        if (static_cast<DataType>(static_cast<uint8_t>(meta_value[0])) == DataType::kStrings) {
+          ParsedStringsValue parsed_strings_value(Slice(meta_value.data(), meta_value.size()));
+          BitmapChunkMeta bitmap_meta;
+          if (parsed_strings_value.IsBitmapChunked() && bitmap_meta.Decode(parsed_strings_value.UserValue())) {
+            cur_meta_chunked_ = true;
+            cur_meta_version_ = bitmap_meta.version;
+            cur_meta_etime_ = parsed_strings_value.Etime();
+          }
+        }
+      } else if (!s.IsNotFound()) {
+        cur_key_ = "";
+        TRACE("Reserve[Get meta_key faild]");
+        return false;
+      }
+    }
+
+    if (!cur_meta_chunked_) {
+      TRACE("Drop[Meta key not exist or not a chunked bitmap]");
+      return true;
+    }
+    if (cur_meta_etime_ != 0 && cur_meta_etime_ < static_cast<uint64_t>(pstd::NowMillis())) {
+      TRACE("Drop[Timeout]");
+      return true;
+    }
+    if (cur_meta_version_ != parsed_chunk_key.Version()) {
+      TRACE("Drop[chunk version != bitmap version]");
+      return true;
+    }
+    TRACE("Reserve[chunk version == bitmap version]");
+    return false;
+  }
+
+  const char* Name() const override { return "BitmapsDataFilter"; }
+
+ private:
+  rocksdb::DB* db_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+  rocksdb::ReadOptions default_read_options_;
+  mutable std::string cur_key_;
+  mutable bool cur_meta_chunked_ = false;
+  mutable uint64_t cur_meta_version_ = 0;
+  mutable uint64_t cur_meta_etime_ = 0;
+};
+
+class BitmapsDataFilterFactory : public rocksdb::CompactionFilterFactory {
+ public:
+  BitmapsDataFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr)
+      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr) {}
+  std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+      const rocksdb::CompactionFilter::Context& context) override {
+    return std::unique_ptr<rocksdb::CompactionFilter>(new BitmapsDataFilter(*db_ptr_, cf_handles_ptr_));
+  }
+  const char* Name() const override { return "BitmapsDataFilterFactory"; }
+
+ private:
+  rocksdb::DB** db_ptr_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+};
+
 }  //  namespace storage
 #endif  // SRC_STRINGS_FILTER_H_
@@ -0,0 +1,174 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/strings_merge.h"
+
+#include <climits>
+#include <cstdlib>
+
+#include "src/coding.h"
+#include "src/debug.h"
+#include "src/strings_value_format.h"
+#include "storage/util.h"
+
+namespace storage {
+
+namespace {
+
+constexpr size_t kStringsMergeHeaderLength = 1 + sizeof(uint64_t);
+
+bool IncrbyUserValue(int64_t value, std::string* user_value) {
+  char* end = nullptr;
+  int64_t ival = strtoll(user_value->c_str(), &end, 10);
+  if (*end != 0) {
+    return false;
+  }
+  if ((value >= 0 && LLONG_MAX - value < ival) || (value < 0 && LLONG_MIN - value > ival)) {
+    return false;
+  }
+  *user_value = std::to_string(ival + value);
+  return true;
+}
+
+bool IncrbyfloatUserValue(const rocksdb::Slice& value, std::string* user_value) {
+  long double long_double_by;
+  long double old_number;
+  if (StrToLongDouble(value.data(), value.size(), &long_double_by) == -1 ||
+      StrToLongDouble(user_value->data(), user_value->size(), &old_number) == -1) {
+    return false;
+  }
+  std::string new_value;
+  if (LongDoubleToStr(old_number + long_double_by, &new_value) == -1) {
+    return false;
+  }
+  *user_value = std::move(new_value);
+  return true;
+}
+
+}  // namespace
+
+std::string EncodeStringsMergeOperand(StringsMergeOp op, uint64_t etime, const rocksdb::Slice& payload) {
+  std::string operand(kStringsMergeHeaderLength + payload.size(), '\0');
+  operand[0] = static_cast<char>(op);
+  EncodeFixed64(operand.data() + 1, etime);
+  memcpy(operand.data() + kStringsMergeHeaderLength, payload.data(), payload.size());
+  return operand;
+}
+
+std::string EncodeIncrbyPayload(int64_t value) {
+  std::string payload(sizeof(uint64_t), '\0');
+  EncodeFixed64(payload.data(), static_cast<uint64_t>(value));
+  return payload;
+}
+
+std::string EncodeSetrangePayload(int64_t offset, const rocksdb::Slice& value) {
+  std::string payload(sizeof(uint64_t), '\0');
+  EncodeFixed64(payload.data(), static_cast<uint64_t>(offset));
+  payload.append(value.data(), value.size());
+  return payload;
+}
+
+bool ApplyStringsMergeOperand(const rocksdb::Slice& operand, std::string* user_value) {
+  if (operand.size() < kStringsMergeHeaderLength) {
+    return false;
+  }
+  rocksdb::Slice payload(operand.data() + kStringsMergeHeaderLength, operand.size() - kStringsMergeHeaderLength);
+  switch (operand[0]) {
+    case kStringsMergeIncrby:
+      if (payload.size() != sizeof(uint64_t)) {
+        return false;
+      }
+      return IncrbyUserValue(static_cast<int64_t>(DecodeFixed64(payload.data())), user_value);
+    case kStringsMergeIncrbyfloat:
+      return IncrbyfloatUserValue(payload, user_value);
+    case kStringsMergeAppend:
+      user_value->append(payload.data(), payload.size());
+      return true;
+    case kStringsMergeSetrange: {
+      if (payload.size() < sizeof(uint64_t)) {
+        return false;
+      }
+      uint64_t offset = DecodeFixed64(payload.data());
+      rocksdb::Slice value(payload.data() + sizeof(uint64_t), payload.size() - sizeof(uint64_t));
+      if (user_value->size() < offset + value.size()) {
+        user_value->resize(offset + value.size());
+      }
+      user_value->replace(offset, value.size(), value.data(), value.size());
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+bool StringsMergeOperator::FullMergeV2(const MergeOperationInput& merge_in, MergeOperationOutput* merge_out) const {
+  const rocksdb::Slice* existing_value = merge_in.existing_value;
+  if (existing_value != nullptr && (existing_value->size() < kStringsValueMinLength ||
+                                    static_cast<DataType>(static_cast<uint8_t>((*existing_value)[0])) !=
+                                        DataType::kStrings)) {
+    // operands are only written on strings, keep whatever else is there
+    merge_out->new_value = existing_value->ToString();
+    return true;
+  }
+
+  std::string user_value;
+  uint64_t etime = 0;
+  if (existing_value != nullptr) {
+    ParsedStringsValue parsed_strings_value(*existing_value);
+    user_value = parsed_strings_value.UserValue().ToString();
+    etime = parsed_strings_value.Etime();
+  } else if (!merge_in.operand_list.empty() && merge_in.operand_list.front().size() >= kStringsMergeHeaderLength) {
+    etime = DecodeFixed64(merge_in.operand_list.front().data() + 1);
+  }
+  for (const auto& operand : merge_in.operand_list) {
+    if (!ApplyStringsMergeOperand(operand, &user_value)) {
+      TRACE("Skip[strings merge operand does not apply]");
+    }
+  }
+  StringsValue strings_value(user_value);
+  strings_value.SetEtime(etime);
+  merge_out->new_value = strings_value.Encode().ToString();
+  return true;
+}
+
+bool StringsMergeOperator::PartialMerge(const rocksdb::Slice& key, const rocksdb::Slice& left_operand,
+                                        const rocksdb::Slice& right_operand, std::string* new_value,
+                                        rocksdb::Logger* logger) const {
+  UNUSED(key);
+  UNUSED(logger);
+  if (left_operand.size() < kStringsMergeHeaderLength || right_operand.size() < kStringsMergeHeaderLength ||
+      left_operand[0] != right_operand[0] ||
+      DecodeFixed64(left_operand.data() + 1) != DecodeFixed64(right_operand.data() + 1)) {
+    return false;
+  }
+  uint64_t etime = DecodeFixed64(left_operand.data() + 1);
+  rocksdb::Slice left_payload(left_operand.data() + kStringsMergeHeaderLength,
+                              left_operand.size() - kStringsMergeHeaderLength);
+  rocksdb::Slice right_payload(right_operand.data() + kStringsMergeHeaderLength,
+                               right_operand.size() - kStringsMergeHeaderLength);
+  switch (left_operand[0]) {
+    case kStringsMergeIncrby: {
+      if (left_payload.size() != sizeof(uint64_t) || right_payload.size() != sizeof(uint64_t)) {
+        return false;
+      }
+      // each one applied on its own, the sum may not fit although both did
+      auto left = static_cast<int64_t>(DecodeFixed64(left_payload.data()));
+      auto right = static_cast<int64_t>(DecodeFixed64(right_payload.data()));
+      if ((right >= 0 && LLONG_MAX - right < left) || (right < 0 && LLONG_MIN - right > left)) {
+        return false;
+      }
+      *new_value = EncodeStringsMergeOperand(kStringsMergeIncrby, etime, EncodeIncrbyPayload(left + right));
+      return true;
+    }
+    case kStringsMergeAppend:
+      *new_value = left_operand.ToString();
+      new_value->append(right_payload.data(), right_payload.size());
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  //  namespace storage
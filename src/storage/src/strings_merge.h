@@ -0,0 +1,55 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_STRINGS_MERGE_H_
+#define SRC_STRINGS_MERGE_H_
+
+#include <string>
+
+#include "rocksdb/merge_operator.h"
+#include "rocksdb/slice.h"
+
+namespace storage {
+
+/*
+ * A strings merge operand changes the user value of a live string in place of
+ * a Put of the whole value:
+ * | op | etime | payload |
+ * | 1B |  8B   |         |
+ * etime is the one of the string the operand was written on, in ms, the
+ * folded value keeps it. It stands in for the string when the compaction
+ * dropped that one as stale before the fold, the result is then stale too.
+ */
+enum StringsMergeOp : char {
+  kStringsMergeIncrby = 'i',       // payload: fixed64 increment
+  kStringsMergeIncrbyfloat = 'f',  // payload: increment as text
+  kStringsMergeAppend = 'a',       // payload: bytes to append
+  kStringsMergeSetrange = 'r'      // payload: fixed64 offset, bytes to write there
+};
+
+std::string EncodeStringsMergeOperand(StringsMergeOp op, uint64_t etime, const rocksdb::Slice& payload);
+std::string EncodeIncrbyPayload(int64_t value);
+std::string EncodeSetrangePayload(int64_t offset, const rocksdb::Slice& value);
+
+/*
+ * Applies operand to user_value the way Incrby, Incrbyfloat, Append and
+ * Setrange do, false and user_value untouched if it does not apply, e.g. an
+ * increment of a value that is not a number
+ */
+bool ApplyStringsMergeOperand(const rocksdb::Slice& operand, std::string* user_value);
+
+class StringsMergeOperator : public rocksdb::MergeOperator {
+ public:
+  bool FullMergeV2(const MergeOperationInput& merge_in, MergeOperationOutput* merge_out) const override;
+  // Sums consecutive increments and joins consecutive appends
+  bool PartialMerge(const rocksdb::Slice& key, const rocksdb::Slice& left_operand,
+                    const rocksdb::Slice& right_operand, std::string* new_value,
+                    rocksdb::Logger* logger) const override;
+
+  const char* Name() const override { return "StringsMergeOperator"; }
+};
+
+}  //  namespace storage
+#endif  //  SRC_STRINGS_MERGE_H_
@@ -17,9 +17,12 @@ namespace storage {
 * | type | value | reserve | cdate | timestamp |
 * |  1B  |       |   16B   |   8B  |     8B    |
 *  The first bit in reservse field is used to isolate string and hyperloglog  
+*  The second bit marks a bitmap split into chunks, its value then holds the
+*  length, version and chunk size of the bitmap, see bitmap_chunk.h
 */
  // 80H = 1000000B
 constexpr uint8_t hyperloglog_reserve_flag = 0x80;
+constexpr uint8_t bitmap_chunked_reserve_flag = 0x40;
 class StringsValue : public InternalValue {
  public:
   explicit StringsValue(const rocksdb::Slice& user_value) : InternalValue(DataType::kStrings, user_value) {}
@@ -44,6 +47,8 @@ class StringsValue : public InternalValue {
     EncodeFixed64(dst, etime);
     return {start_, needed};
   }
+
+  void SetBitmapChunked() { reserve_[0] |= bitmap_chunked_reserve_flag; }
 };
 
 class HyperloglogValue : public InternalValue {
@@ -62,9 +67,12 @@ class HyperloglogValue : public InternalValue {
     reserve_[0] |= hyperloglog_reserve_flag;
     memcpy(dst, reserve_, kSuffixReserveLength);
     dst += kSuffixReserveLength;
-    EncodeFixed64(dst, ctime_);
+    // in milliseconds like StringsValue, so an etime kept from the old value reads back the same
+    uint64_t ctime = ctime_ > 0 ? (ctime_ | (1ULL << 63)) : 0;
+    EncodeFixed64(dst, ctime);
     dst += kTimestampLength;
-    EncodeFixed64(dst, etime_);
+    uint64_t etime = etime_ > 0 ? (etime_ | (1ULL << 63)) : 0;
+    EncodeFixed64(dst, etime);
     return {start_, needed};
   }
 };
@@ -133,6 +141,8 @@ class ParsedStringsValue : public ParsedInternalValue {
     }
   }
 
+  bool IsBitmapChunked() { return (reserve_[0] & bitmap_chunked_reserve_flag) != 0; }
+
   // Strings type do not have version field;
   void SetVersionToValue() override {}
 
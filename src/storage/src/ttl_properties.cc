@@ -0,0 +1,182 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/ttl_properties.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "src/base_data_key_format.h"
+#include "src/base_meta_value_format.h"
+#include "src/expiry_index.h"
+#include "src/lists_data_key_format.h"
+#include "src/lists_meta_value_format.h"
+#include "src/zsets_data_key_format.h"
+
+namespace storage {
+
+namespace {
+
+uint64_t GetUint64Property(const rocksdb::UserCollectedProperties& props, const char* name) {
+  auto iter = props.find(name);
+  return iter == props.end() ? 0 : std::strtoull(iter->second.c_str(), nullptr, 10);
+}
+
+// Whether the meta filter drops the meta value as an empty collection
+bool MetaValueEmpty(const rocksdb::Slice& meta_value, uint64_t now) {
+  switch (static_cast<DataType>(static_cast<uint8_t>(meta_value[0]))) {
+    case DataType::kHashes:
+    case DataType::kSets:
+    case DataType::kZSets: {
+      ParsedBaseMetaValue parsed_base_meta_value(meta_value);
+      return parsed_base_meta_value.Count() == 0 && parsed_base_meta_value.Version() < now;
+    }
+    case DataType::kLists: {
+      ParsedListsMetaValue parsed_lists_meta_value(meta_value);
+      return parsed_lists_meta_value.Count() == 0 && parsed_lists_meta_value.Version() < now;
+    }
+    default:
+      return false;
+  }
+}
+
+class TTLPropertiesCollector : public rocksdb::TablePropertiesCollector {
+ public:
+  TTLPropertiesCollector(TTLKeyLayout layout, MetaVersionCache* meta_version_cache, int64_t horizon_seconds)
+      : layout_(layout),
+        meta_version_cache_(meta_version_cache),
+        now_(pstd::NowMillis()),
+        horizon_(now_ + std::max<int64_t>(horizon_seconds, 0) * 1000) {}
+
+  rocksdb::Status AddUserKey(const rocksdb::Slice& key, const rocksdb::Slice& value, rocksdb::EntryType type,
+                             rocksdb::SequenceNumber seq, uint64_t file_size) override {
+    if (type != rocksdb::kEntryPut) {
+      return rocksdb::Status::OK();
+    }
+    uint64_t etime = 0;
+    bool dead = layout_ == TTLKeyLayout::kMeta ? MetaEntryEtime(key, value, &etime) : DataEntryEtime(key, &etime);
+    uint64_t bytes = key.size() + value.size();
+    if (dead) {
+      dead_entries_++;
+      dead_bytes_ += bytes;
+    } else if (etime != 0 && etime <= horizon_) {
+      expiring_entries_++;
+      expiring_bytes_ += bytes;
+      expiring_max_etime_ = std::max(expiring_max_etime_, etime);
+    }
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::Status Finish(rocksdb::UserCollectedProperties* properties) override {
+    *properties = GetReadableProperties();
+    return rocksdb::Status::OK();
+  }
+
+  rocksdb::UserCollectedProperties GetReadableProperties() const override {
+    return {{kTTLDeadEntriesProperty, std::to_string(dead_entries_)},
+            {kTTLDeadBytesProperty, std::to_string(dead_bytes_)},
+            {kTTLExpiringEntriesProperty, std::to_string(expiring_entries_)},
+            {kTTLExpiringBytesProperty, std::to_string(expiring_bytes_)},
+            {kTTLExpiringMaxEtimeProperty, std::to_string(expiring_max_etime_)}};
+  }
+
+  const char* Name() const override { return "TTLPropertiesCollector"; }
+
+ private:
+  // true if the meta filter drops it now, else its etime
+  bool MetaEntryEtime(const rocksdb::Slice& key, const rocksdb::Slice& value, uint64_t* etime) const {
+    // the kept records of the meta cf start with '#'
+    if (value.empty() || (!key.empty() && key[0] == '#')) {
+      return false;
+    }
+    if (MetaValueExpired(value, now_) || MetaValueEmpty(value, now_)) {
+      return true;
+    }
+    *etime = MetaValueEtime(value);
+    return false;
+  }
+
+  // true if the version of the data key is known to be dropped, else the
+  // etime of the live version it belongs to if known
+  bool DataEntryEtime(const rocksdb::Slice& key, uint64_t* etime) {
+    if (meta_version_cache_ == nullptr) {
+      return false;
+    }
+    std::string user_key;
+    uint64_t version = 0;
+    switch (layout_) {
+      case TTLKeyLayout::kListsData: {
+        ParsedListsDataKey parsed_key(key);
+        user_key = parsed_key.key().ToString();
+        version = parsed_key.Version();
+        break;
+      }
+      case TTLKeyLayout::kZSetsScore: {
+        ParsedZSetsScoreKey parsed_key(key);
+        user_key = parsed_key.key().ToString();
+        version = parsed_key.Version();
+        break;
+      }
+      default: {
+        ParsedBaseDataKey parsed_key(key);
+        user_key = parsed_key.Key().ToString();
+        version = parsed_key.Version();
+        break;
+      }
+    }
+    // the members of a key are next to each other, look it up once
+    if (user_key != cur_key_) {
+      cur_key_ = user_key;
+      cur_found_ = meta_version_cache_->Lookup(cur_key_, &cur_entry_);
+    }
+    if (!cur_found_) {
+      return false;
+    }
+    if (version <= cur_entry_.dropped_version) {
+      return true;
+    }
+    if (version == cur_entry_.version) {
+      if (cur_entry_.etime != 0 && cur_entry_.etime < now_) {
+        return true;
+      }
+      *etime = cur_entry_.etime;
+    }
+    return false;
+  }
+
+  TTLKeyLayout layout_;
+  MetaVersionCache* meta_version_cache_ = nullptr;
+  uint64_t now_ = 0;
+  uint64_t horizon_ = 0;
+  std::string cur_key_;
+  bool cur_found_ = false;
+  MetaVersionEntry cur_entry_;
+  uint64_t dead_entries_ = 0;
+  uint64_t dead_bytes_ = 0;
+  uint64_t expiring_entries_ = 0;
+  uint64_t expiring_bytes_ = 0;
+  uint64_t expiring_max_etime_ = 0;
+};
+
+}  // namespace
+
+rocksdb::TablePropertiesCollector* TTLPropertiesCollectorFactory::CreateTablePropertiesCollector(
+    rocksdb::TablePropertiesCollectorFactory::Context context) {
+  return new TTLPropertiesCollector(layout_, meta_version_cache_, horizon_seconds_);
+}
+
+void GetTTLDeadEntries(const rocksdb::TableProperties& props, uint64_t now, uint64_t* dead_entries,
+                       uint64_t* dead_bytes) {
+  const auto& user_props = props.user_collected_properties;
+  *dead_entries = GetUint64Property(user_props, kTTLDeadEntriesProperty);
+  *dead_bytes = GetUint64Property(user_props, kTTLDeadBytesProperty);
+  uint64_t expiring_max_etime = GetUint64Property(user_props, kTTLExpiringMaxEtimeProperty);
+  if (expiring_max_etime != 0 && expiring_max_etime < now) {
+    *dead_entries += GetUint64Property(user_props, kTTLExpiringEntriesProperty);
+    *dead_bytes += GetUint64Property(user_props, kTTLExpiringBytesProperty);
+  }
+}
+
+}  //  namespace storage
@@ -0,0 +1,58 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_TTL_PROPERTIES_H_
+#define SRC_TTL_PROPERTIES_H_
+
+#include <memory>
+#include <string>
+
+#include "rocksdb/table_properties.h"
+
+#include "src/meta_version_cache.h"
+
+namespace storage {
+
+/*
+ * Expired metas and the members of stale versions are plain puts, so the
+ * tombstone counts of an sst file don't show how much of it a compaction
+ * would drop. The collector counts, for each sst file written:
+ * dead: entries the compaction filters would already drop
+ * expiring: entries that expire within the horizon, with the latest etime
+ *   among them, past which they are all dead as well
+ * Meta cf entries are judged by their own value. Data cf entries only by
+ * what the meta version cache knows of their key, a miss counts as live.
+ */
+constexpr const char* kTTLDeadEntriesProperty = "pika.ttl.dead.entries";
+constexpr const char* kTTLDeadBytesProperty = "pika.ttl.dead.bytes";
+constexpr const char* kTTLExpiringEntriesProperty = "pika.ttl.expiring.entries";
+constexpr const char* kTTLExpiringBytesProperty = "pika.ttl.expiring.bytes";
+constexpr const char* kTTLExpiringMaxEtimeProperty = "pika.ttl.expiring.max_etime";
+
+// how the keys of the cf are laid out
+enum class TTLKeyLayout { kMeta, kBaseData, kListsData, kZSetsScore };
+
+class TTLPropertiesCollectorFactory : public rocksdb::TablePropertiesCollectorFactory {
+ public:
+  TTLPropertiesCollectorFactory(TTLKeyLayout layout, MetaVersionCache* meta_version_cache, int64_t horizon_seconds)
+      : layout_(layout), meta_version_cache_(meta_version_cache), horizon_seconds_(horizon_seconds) {}
+
+  rocksdb::TablePropertiesCollector* CreateTablePropertiesCollector(
+      rocksdb::TablePropertiesCollectorFactory::Context context) override;
+  const char* Name() const override { return "TTLPropertiesCollectorFactory"; }
+
+ private:
+  TTLKeyLayout layout_;
+  MetaVersionCache* meta_version_cache_ = nullptr;
+  int64_t horizon_seconds_ = 0;
+};
+
+// The entries and bytes of the sst file that are dead at now, 0 for a file
+// written without the collector
+void GetTTLDeadEntries(const rocksdb::TableProperties& props, uint64_t now, uint64_t* dead_entries,
+                       uint64_t* dead_bytes);
+
+}  //  namespace storage
+#endif  //  SRC_TTL_PROPERTIES_H_
@@ -0,0 +1,466 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/type_index.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "glog/logging.h"
+
+#include "src/debug.h"
+
+namespace storage {
+
+namespace {
+
+struct MetaWrite {
+  std::string key;
+  std::string value;
+  bool deleted = false;
+};
+
+// Collects the index keys of the collection meta values put in a batch, with
+// index_expiry the expiry index keys of the ones with an etime, and with
+// count_meta every meta put and delete in order
+class TypeIndexCollector : public rocksdb::WriteBatch::Handler {
+ public:
+  TypeIndexCollector(uint32_t meta_cf_id, bool count_meta, bool index_expiry)
+      : meta_cf_id_(meta_cf_id), count_meta_(count_meta), index_expiry_(index_expiry) {}
+
+  rocksdb::Status PutCF(uint32_t column_family_id, const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+    if (column_family_id != meta_cf_id_) {
+      return rocksdb::Status::OK();
+    }
+    if (!value.empty()) {
+      auto type = static_cast<DataType>(static_cast<uint8_t>(value[0]));
+      if (IsTypeIndexed(type)) {
+        index_keys_.push_back(EncodeTypeIndexKey(DataTypeToTag(type), key));
+      }
+    }
+    if (index_expiry_) {
+      uint64_t etime = MetaValueEtime(value);
+      if (etime != 0) {
+        expiry_keys_.push_back(EncodeExpiryIndexKey(etime, key));
+      }
+    }
+    if (count_meta_) {
+      meta_writes_.push_back({key.ToString(), value.ToString(), false});
+    }
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status DeleteCF(uint32_t column_family_id, const rocksdb::Slice& key) override {
+    if (column_family_id == meta_cf_id_ && count_meta_) {
+      meta_writes_.push_back({key.ToString(), "", true});
+    }
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status SingleDeleteCF(uint32_t column_family_id, const rocksdb::Slice& key) override {
+    return DeleteCF(column_family_id, key);
+  }
+  rocksdb::Status DeleteRangeCF(uint32_t column_family_id, const rocksdb::Slice& begin_key,
+                                const rocksdb::Slice& end_key) override {
+    return rocksdb::Status::OK();
+  }
+  rocksdb::Status MergeCF(uint32_t column_family_id, const rocksdb::Slice& key, const rocksdb::Slice& value) override {
+    return rocksdb::Status::OK();
+  }
+
+  const std::vector<std::string>& IndexKeys() const { return index_keys_; }
+  const std::vector<std::string>& ExpiryKeys() const { return expiry_keys_; }
+  const std::vector<MetaWrite>& MetaWrites() const { return meta_writes_; }
+
+ private:
+  uint32_t meta_cf_id_ = 0;
+  bool count_meta_ = false;
+  bool index_expiry_ = false;
+  std::vector<std::string> index_keys_;
+  std::vector<std::string> expiry_keys_;
+  std::vector<MetaWrite> meta_writes_;
+};
+
+// Counter deltas of the meta writes of one batch, a key written twice in the
+// batch is compared with its earlier write rather than with the db
+rocksdb::Status CollectKeyCounterDeltas(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* meta_handle,
+                                        const std::vector<MetaWrite>& meta_writes, KeyCountersMap* deltas) {
+  std::unordered_map<std::string, const MetaWrite*> latest_writes;
+  std::string old_value;
+  for (const auto& meta_write : meta_writes) {
+    auto iter = latest_writes.find(meta_write.key);
+    if (iter != latest_writes.end()) {
+      if (!iter->second->deleted) {
+        AccumulateKeyCounters(iter->second->value, -1, deltas);
+      }
+    } else {
+      rocksdb::Status s = db->Get(rocksdb::ReadOptions(), meta_handle, meta_write.key, &old_value);
+      if (s.ok()) {
+        AccumulateKeyCounters(old_value, -1, deltas);
+      } else if (!s.IsNotFound()) {
+        return s;
+      }
+    }
+    if (!meta_write.deleted) {
+      AccumulateKeyCounters(meta_write.value, 1, deltas);
+    }
+    latest_writes[meta_write.key] = &meta_write;
+  }
+  return rocksdb::Status::OK();
+}
+
+}  // namespace
+
+rocksdb::Status TypeIndexedDB::Put(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                                   const rocksdb::Slice& key, const rocksdb::Slice& value) {
+  // the plain Put of strings comes with the handle of DB::DefaultColumnFamily
+  if (column_family->GetID() != meta_handle_->GetID() ||
+      (stats_handle_ == nullptr &&
+       (value.empty() || !IsTypeIndexed(static_cast<DataType>(static_cast<uint8_t>(value[0])))) &&
+       (expiry_handle_ == nullptr || MetaValueEtime(value) == 0))) {
+    rocksdb::Status s = rocksdb::StackableDB::Put(options, column_family, key, value);
+    if (s.ok()) {
+      RecordWrite(column_family->GetID(), key, key.size() + value.size());
+    }
+    return s;
+  }
+  rocksdb::WriteBatch batch;
+  batch.Put(column_family, key, value);
+  return Write(options, &batch);
+}
+
+rocksdb::Status TypeIndexedDB::Delete(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                                      const rocksdb::Slice& key) {
+  if (column_family->GetID() != meta_handle_->GetID() || stats_handle_ == nullptr) {
+    rocksdb::Status s = rocksdb::StackableDB::Delete(options, column_family, key);
+    if (s.ok()) {
+      RecordWrite(column_family->GetID(), key, key.size());
+    }
+    return s;
+  }
+  rocksdb::WriteBatch batch;
+  batch.Delete(column_family, key);
+  return Write(options, &batch);
+}
+
+rocksdb::Status TypeIndexedDB::Merge(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                                     const rocksdb::Slice& key, const rocksdb::Slice& value) {
+  // merge operands of strings change neither the type nor the etime
+  rocksdb::Status s = rocksdb::StackableDB::Merge(options, column_family, key, value);
+  if (s.ok()) {
+    RecordWrite(column_family->GetID(), key, key.size() + value.size());
+  }
+  return s;
+}
+
+rocksdb::Status TypeIndexedDB::Write(const rocksdb::WriteOptions& options, rocksdb::WriteBatch* updates) {
+  TypeIndexCollector collector(meta_handle_->GetID(), stats_handle_ != nullptr, expiry_handle_ != nullptr);
+  rocksdb::Status s = updates->Iterate(&collector);
+  if (!s.ok()) {
+    return s;
+  }
+  KeyCountersMap deltas;
+  if (!collector.MetaWrites().empty()) {
+    s = CollectKeyCounterDeltas(this, meta_handle_, collector.MetaWrites(), &deltas);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  bool no_delta = std::all_of(deltas.begin(), deltas.end(), [](const auto& delta) { return delta.second.Zero(); });
+  if (collector.IndexKeys().empty() && collector.ExpiryKeys().empty() && no_delta) {
+    s = rocksdb::StackableDB::Write(options, updates);
+  } else {
+    // the caller still owns the batch and may look at its count, the index
+    // entries and counter deltas are taken out of it again after the write
+    updates->SetSavePoint();
+    for (const auto& index_key : collector.IndexKeys()) {
+      updates->Put(index_handle_, index_key, rocksdb::Slice());
+    }
+    for (const auto& expiry_key : collector.ExpiryKeys()) {
+      updates->Put(expiry_handle_, expiry_key, rocksdb::Slice());
+    }
+    s = MergeKeyCounters(updates, stats_handle_, deltas);
+    if (s.ok()) {
+      s = rocksdb::StackableDB::Write(options, updates);
+    }
+    updates->RollbackToSavePoint();
+  }
+  if (s.ok()) {
+    RecordWrite(updates);
+  }
+  return s;
+}
+
+void TypeIndexedDB::SetSlotWriteLog(const std::shared_ptr<SlotWriteLog>& log) {
+  std::atomic_store(&slot_write_log_, log);
+  slot_logging_.store(log != nullptr);
+}
+
+void TypeIndexedDB::RecordWrite(uint32_t cf_id, const rocksdb::Slice& key, size_t bytes) {
+  written_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  if (!slot_logging_.load()) {
+    return;
+  }
+  std::shared_ptr<SlotWriteLog> log = std::atomic_load(&slot_write_log_);
+  if (log != nullptr) {
+    log->Record(cf_id, key);
+  }
+}
+
+void TypeIndexedDB::RecordWrite(rocksdb::WriteBatch* updates) {
+  written_bytes_.fetch_add(updates->GetDataSize(), std::memory_order_relaxed);
+  if (!slot_logging_.load()) {
+    return;
+  }
+  std::shared_ptr<SlotWriteLog> log = std::atomic_load(&slot_write_log_);
+  if (log != nullptr) {
+    log->Record(updates);
+  }
+}
+
+rocksdb::Status TypeIndexedDB::BuildTypeIndex() {
+  std::string unused;
+  rocksdb::Status s = Get(rocksdb::ReadOptions(), index_handle_, kTypeIndexBuiltKey, &unused);
+  if (!s.IsNotFound()) {
+    return s;
+  }
+
+  const int32_t kBuildBatchCount = 1000;
+  uint64_t indexed = 0;
+  rocksdb::WriteBatch batch;
+  rocksdb::ReadOptions read_options;
+  read_options.fill_cache = false;
+  std::unique_ptr<rocksdb::Iterator> iter(NewIterator(read_options, meta_handle_));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    rocksdb::Slice value = iter->value();
+    if (value.empty()) {
+      continue;
+    }
+    auto type = static_cast<DataType>(static_cast<uint8_t>(value[0]));
+    if (!IsTypeIndexed(type)) {
+      continue;
+    }
+    batch.Put(index_handle_, EncodeTypeIndexKey(DataTypeToTag(type), iter->key()), rocksdb::Slice());
+    indexed++;
+    if (batch.Count() >= kBuildBatchCount) {
+      s = rocksdb::StackableDB::Write(rocksdb::WriteOptions(), &batch);
+      if (!s.ok()) {
+        return s;
+      }
+      batch.Clear();
+    }
+  }
+  if (!iter->status().ok()) {
+    return iter->status();
+  }
+  // the marker goes last, an interrupted build starts over at next open
+  batch.Put(index_handle_, kTypeIndexBuiltKey, rocksdb::Slice());
+  s = rocksdb::StackableDB::Write(rocksdb::WriteOptions(), &batch);
+  if (s.ok()) {
+    LOG(INFO) << "type index built, " << indexed << " keys indexed";
+  }
+  return s;
+}
+
+rocksdb::Status TypeIndexedDB::BuildExpiryIndex() {
+  if (expiry_handle_ == nullptr) {
+    return rocksdb::Status::NotSupported("expiry index disabled");
+  }
+  std::string unused;
+  rocksdb::Status s = Get(rocksdb::ReadOptions(), expiry_handle_, kExpiryIndexBuiltKey, &unused);
+  if (!s.IsNotFound()) {
+    return s;
+  }
+
+  const int32_t kBuildBatchCount = 1000;
+  uint64_t indexed = 0;
+  rocksdb::WriteBatch batch;
+  rocksdb::ReadOptions read_options;
+  read_options.fill_cache = false;
+  std::unique_ptr<rocksdb::Iterator> iter(NewIterator(read_options, meta_handle_));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    uint64_t etime = MetaValueEtime(iter->value());
+    if (etime == 0) {
+      continue;
+    }
+    batch.Put(expiry_handle_, EncodeExpiryIndexKey(etime, iter->key()), rocksdb::Slice());
+    indexed++;
+    if (batch.Count() >= kBuildBatchCount) {
+      s = rocksdb::StackableDB::Write(rocksdb::WriteOptions(), &batch);
+      if (!s.ok()) {
+        return s;
+      }
+      batch.Clear();
+    }
+  }
+  if (!iter->status().ok()) {
+    return iter->status();
+  }
+  // the marker goes last, an interrupted build starts over at next open
+  batch.Put(expiry_handle_, kExpiryIndexBuiltKey, rocksdb::Slice());
+  s = rocksdb::StackableDB::Write(rocksdb::WriteOptions(), &batch);
+  if (s.ok()) {
+    LOG(INFO) << "expiry index built, " << indexed << " keys indexed";
+  }
+  return s;
+}
+
+rocksdb::Status TypeIndexedDB::ReconcileKeyCounters() {
+  if (stats_handle_ == nullptr) {
+    return rocksdb::Status::NotSupported("key counters disabled");
+  }
+  rocksdb::ReadOptions read_options;
+  read_options.fill_cache = false;
+  read_options.snapshot = GetSnapshot();
+
+  KeyCountersMap stored;
+  KeyCountersMap actual;
+  rocksdb::Status s = ReadKeyCounters(this, stats_handle_, read_options, &stored);
+  if (s.ok()) {
+    std::unique_ptr<rocksdb::Iterator> iter(NewIterator(read_options, meta_handle_));
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      AccumulateKeyCounters(iter->value(), 1, &actual);
+    }
+    s = iter->status();
+  }
+  ReleaseSnapshot(read_options.snapshot);
+  if (!s.ok()) {
+    return s;
+  }
+
+  KeyCountersMap deltas(actual);
+  for (const auto& [tag, counters] : stored) {
+    KeyCounters& delta = deltas[tag];
+    delta.total -= counters.total;
+    delta.empty -= counters.empty;
+    delta.expires -= counters.expires;
+    delta.etime_sum -= counters.etime_sum;
+  }
+  rocksdb::WriteBatch batch;
+  s = MergeKeyCounters(&batch, stats_handle_, deltas);
+  if (!s.ok()) {
+    return s;
+  }
+  batch.Put(stats_handle_, kKeyCountersReconciledKey, rocksdb::Slice());
+  return rocksdb::StackableDB::Write(rocksdb::WriteOptions(), &batch);
+}
+
+TypeIndexIterator::TypeIndexIterator(const rocksdb::ReadOptions& options, rocksdb::DB* db,
+                                     rocksdb::ColumnFamilyHandle* meta_handle,
+                                     rocksdb::ColumnFamilyHandle* index_handle, DataType type)
+    : db_(db), meta_handle_(meta_handle), tag_(DataTypeToTag(type)), meta_options_(options) {
+  // index entries and meta values are read at the same point in time
+  if (meta_options_.snapshot == nullptr) {
+    own_snapshot_ = db_->GetSnapshot();
+    meta_options_.snapshot = own_snapshot_;
+  }
+  meta_options_.iterate_lower_bound = nullptr;
+  meta_options_.iterate_upper_bound = nullptr;
+
+  lower_bound_ = options.iterate_lower_bound != nullptr ? EncodeTypeIndexKey(tag_, *options.iterate_lower_bound)
+                                                        : std::string(1, tag_);
+  upper_bound_ = options.iterate_upper_bound != nullptr ? EncodeTypeIndexKey(tag_, *options.iterate_upper_bound)
+                                                        : std::string(1, static_cast<char>(tag_ + 1));
+  lower_bound_slice_ = lower_bound_;
+  upper_bound_slice_ = upper_bound_;
+  rocksdb::ReadOptions index_options(meta_options_);
+  index_options.iterate_lower_bound = &lower_bound_slice_;
+  index_options.iterate_upper_bound = &upper_bound_slice_;
+  index_iter_.reset(db_->NewIterator(index_options, index_handle));
+}
+
+TypeIndexIterator::~TypeIndexIterator() {
+  index_iter_.reset();
+  if (own_snapshot_ != nullptr) {
+    db_->ReleaseSnapshot(own_snapshot_);
+  }
+}
+
+void TypeIndexIterator::SeekToFirst() {
+  index_iter_->SeekToFirst();
+  SkipForward();
+}
+
+void TypeIndexIterator::SeekToLast() {
+  index_iter_->SeekToLast();
+  SkipBackward();
+}
+
+void TypeIndexIterator::Seek(const rocksdb::Slice& target) {
+  index_iter_->Seek(EncodeTypeIndexKey(tag_, target));
+  SkipForward();
+}
+
+void TypeIndexIterator::SeekForPrev(const rocksdb::Slice& target) {
+  index_iter_->SeekForPrev(EncodeTypeIndexKey(tag_, target));
+  SkipBackward();
+}
+
+void TypeIndexIterator::Next() {
+  index_iter_->Next();
+  SkipForward();
+}
+
+void TypeIndexIterator::Prev() {
+  index_iter_->Prev();
+  SkipBackward();
+}
+
+rocksdb::Slice TypeIndexIterator::key() const {
+  rocksdb::Slice index_key = index_iter_->key();
+  return {index_key.data() + 1, index_key.size() - 1};
+}
+
+// Whether the current entry still stands for a meta key of the type
+bool TypeIndexIterator::LoadMeta() {
+  rocksdb::Status s = db_->Get(meta_options_, meta_handle_, key(), &meta_value_);
+  if (s.IsNotFound()) {
+    return false;
+  }
+  if (!s.ok()) {
+    status_ = s;
+    return true;
+  }
+  return !meta_value_.empty() && DataTypeToTag(static_cast<DataType>(static_cast<uint8_t>(meta_value_[0]))) == tag_;
+}
+
+void TypeIndexIterator::SkipForward() {
+  while (index_iter_->Valid() && !LoadMeta()) {
+    index_iter_->Next();
+  }
+}
+
+void TypeIndexIterator::SkipBackward() {
+  while (index_iter_->Valid() && !LoadMeta()) {
+    index_iter_->Prev();
+  }
+}
+
+bool TypeIndexFilter::Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value,
+                             std::string* new_value, bool* value_changed) const {
+  UNUSED(level);
+  UNUSED(value);
+  UNUSED(new_value);
+  UNUSED(value_changed);
+  // destroyed when close the database, or the build marker
+  if (db_ == nullptr || cf_handles_ptr_->empty() || key.empty() || !IsTypeIndexedTag(key[0])) {
+    return false;
+  }
+  std::string meta_value;
+  rocksdb::Slice meta_key(key.data() + 1, key.size() - 1);
+  rocksdb::Status s = db_->Get(default_read_options_, (*cf_handles_ptr_)[kMetaCF], meta_key, &meta_value);
+  if (s.IsNotFound()) {
+    TRACE("Drop[Meta key not exist]");
+    return true;
+  }
+  if (!s.ok() || meta_value.empty()) {
+    TRACE("Reserve[Get meta_key faild]");
+    return false;
+  }
+  // a stale meta of the same type is left to the meta filter, the entry
+  // goes with it at a later compaction
+  auto type = static_cast<DataType>(static_cast<uint8_t>(meta_value[0]));
+  return DataTypeToTag(type) != key[0];
+}
+
+}  //  namespace storage
@@ -0,0 +1,194 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_TYPE_INDEX_H_
+#define SRC_TYPE_INDEX_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rocksdb/compaction_filter.h"
+#include "rocksdb/db.h"
+#include "rocksdb/utilities/stackable_db.h"
+#include "rocksdb/write_batch.h"
+
+#include "src/base_value_format.h"
+#include "src/expiry_index.h"
+#include "src/key_counters.h"
+#include "src/slot_migration.h"
+#include "storage/storage_define.h"
+
+namespace storage {
+
+/*
+ * The type index cf holds one key per hash, set, list, zset and stream meta
+ * key, so that a scan of one type does not walk the strings and the other
+ * types in the meta cf:
+ * | type tag | meta key |
+ * |    1B    |          |
+ * The value is empty. Entries are a superset of the live keys of the type,
+ * readers check each one against the meta cf and the compaction filter
+ * drops the ones whose meta key is gone or holds another type now.
+ * Strings are not indexed, a string scan walks the meta cf as before.
+ */
+inline bool IsTypeIndexed(DataType type) {
+  return type == DataType::kHashes || type == DataType::kSets || type == DataType::kLists ||
+         type == DataType::kZSets || type == DataType::kStreams;
+}
+
+inline bool IsTypeIndexedTag(char tag) {
+  return tag == 'h' || tag == 's' || tag == 'l' || tag == 'z' || tag == 'x';
+}
+
+inline std::string EncodeTypeIndexKey(char tag, const rocksdb::Slice& meta_key) {
+  std::string index_key;
+  index_key.reserve(1 + meta_key.size());
+  index_key.push_back(tag);
+  index_key.append(meta_key.data(), meta_key.size());
+  return index_key;
+}
+
+// Written once the index covers every meta key, sorts before every tag
+constexpr const char* kTypeIndexBuiltKey = "#built";
+
+/*
+ * Adds the type index entries of the collection meta values put in a write,
+ * in the same batch, so every write path of Redis keeps the index without
+ * knowing about it. With a stats handle the key counter deltas of the meta
+ * values put and deleted go in the same batch too, each costs a read of the
+ * old meta value, which the record lock of the caller keeps stable until the
+ * write is done. With an expiry handle the meta values put with an etime get
+ * their expiry index entry in the same batch as well. Every write done is
+ * counted in WrittenBytes and, while slots migrate out of the instance,
+ * recorded in their SlotWriteLog
+ */
+class TypeIndexedDB : public rocksdb::StackableDB {
+ public:
+  TypeIndexedDB(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* meta_handle, rocksdb::ColumnFamilyHandle* index_handle,
+                rocksdb::ColumnFamilyHandle* stats_handle = nullptr, rocksdb::ColumnFamilyHandle* expiry_handle = nullptr)
+      : rocksdb::StackableDB(db),
+        meta_handle_(meta_handle),
+        index_handle_(index_handle),
+        stats_handle_(stats_handle),
+        expiry_handle_(expiry_handle) {}
+
+  using rocksdb::StackableDB::Put;
+  rocksdb::Status Put(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                      const rocksdb::Slice& key, const rocksdb::Slice& value) override;
+  using rocksdb::StackableDB::Delete;
+  rocksdb::Status Delete(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                         const rocksdb::Slice& key) override;
+  using rocksdb::StackableDB::Merge;
+  rocksdb::Status Merge(const rocksdb::WriteOptions& options, rocksdb::ColumnFamilyHandle* column_family,
+                        const rocksdb::Slice& key, const rocksdb::Slice& value) override;
+  rocksdb::Status Write(const rocksdb::WriteOptions& options, rocksdb::WriteBatch* updates) override;
+
+  // nullptr stops the recording
+  void SetSlotWriteLog(const std::shared_ptr<SlotWriteLog>& log);
+  uint64_t WrittenBytes() const { return written_bytes_.load(std::memory_order_relaxed); }
+
+  // Indexes the meta keys written before the index existed, once
+  rocksdb::Status BuildTypeIndex();
+
+  // Adds the expiry index entries of the meta keys with an etime written
+  // while the index was off, once
+  rocksdb::Status BuildExpiryIndex();
+
+  // Brings the key counters to the meta cf as of a snapshot and marks them
+  // reconciled. The difference is merged rather than put, so the deltas of
+  // the writes after the snapshot are kept
+  rocksdb::Status ReconcileKeyCounters();
+
+ private:
+  void RecordWrite(uint32_t cf_id, const rocksdb::Slice& key, size_t bytes);
+  void RecordWrite(rocksdb::WriteBatch* updates);
+
+  rocksdb::ColumnFamilyHandle* meta_handle_ = nullptr;
+  rocksdb::ColumnFamilyHandle* index_handle_ = nullptr;
+  rocksdb::ColumnFamilyHandle* stats_handle_ = nullptr;
+  rocksdb::ColumnFamilyHandle* expiry_handle_ = nullptr;
+  std::atomic<uint64_t> written_bytes_{0};
+  // writers only load the log, with std::atomic_load, once the flag is set
+  std::atomic<bool> slot_logging_{false};
+  std::shared_ptr<SlotWriteLog> slot_write_log_;
+};
+
+/*
+ * Walks the meta keys of one indexed type through the type index. key() and
+ * value() are the meta key and meta value, in the meta cf order, entries
+ * whose meta is gone or holds another type are skipped. The bounds of
+ * options are meta keys too
+ */
+class TypeIndexIterator : public rocksdb::Iterator {
+ public:
+  TypeIndexIterator(const rocksdb::ReadOptions& options, rocksdb::DB* db, rocksdb::ColumnFamilyHandle* meta_handle,
+                    rocksdb::ColumnFamilyHandle* index_handle, DataType type);
+  ~TypeIndexIterator() override;
+
+  bool Valid() const override { return status_.ok() && index_iter_->Valid(); }
+  void SeekToFirst() override;
+  void SeekToLast() override;
+  void Seek(const rocksdb::Slice& target) override;
+  void SeekForPrev(const rocksdb::Slice& target) override;
+  void Next() override;
+  void Prev() override;
+  rocksdb::Slice key() const override;
+  rocksdb::Slice value() const override { return meta_value_; }
+  rocksdb::Status status() const override { return status_.ok() ? index_iter_->status() : status_; }
+
+ private:
+  bool LoadMeta();
+  void SkipForward();
+  void SkipBackward();
+
+  rocksdb::DB* db_ = nullptr;
+  rocksdb::ColumnFamilyHandle* meta_handle_ = nullptr;
+  char tag_ = 0;
+  const rocksdb::Snapshot* own_snapshot_ = nullptr;
+  rocksdb::ReadOptions meta_options_;
+  std::string lower_bound_;
+  std::string upper_bound_;
+  rocksdb::Slice lower_bound_slice_;
+  rocksdb::Slice upper_bound_slice_;
+  std::unique_ptr<rocksdb::Iterator> index_iter_;
+  std::string meta_value_;
+  rocksdb::Status status_;
+};
+
+class TypeIndexFilter : public rocksdb::CompactionFilter {
+ public:
+  TypeIndexFilter(rocksdb::DB* db, std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr)
+      : db_(db), cf_handles_ptr_(cf_handles_ptr) {}
+
+  bool Filter(int level, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value,
+              bool* value_changed) const override;
+
+  const char* Name() const override { return "TypeIndexFilter"; }
+
+ private:
+  rocksdb::DB* db_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+  rocksdb::ReadOptions default_read_options_;
+};
+
+class TypeIndexFilterFactory : public rocksdb::CompactionFilterFactory {
+ public:
+  TypeIndexFilterFactory(rocksdb::DB** db_ptr, std::vector<rocksdb::ColumnFamilyHandle*>* handles_ptr)
+      : db_ptr_(db_ptr), cf_handles_ptr_(handles_ptr) {}
+  std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+      const rocksdb::CompactionFilter::Context& context) override {
+    return std::make_unique<TypeIndexFilter>(*db_ptr_, cf_handles_ptr_);
+  }
+  const char* Name() const override { return "TypeIndexFilterFactory"; }
+
+ private:
+  rocksdb::DB** db_ptr_ = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*>* cf_handles_ptr_ = nullptr;
+};
+
+}  //  namespace storage
+#endif  //  SRC_TYPE_INDEX_H_
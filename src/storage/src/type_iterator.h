@@ -23,6 +23,7 @@
 #include "src/base_data_key_format.h"
 #include "src/base_key_format.h"
 #include "src/base_meta_value_format.h"
+#include "src/bitmap_chunk.h"
 #include "src/strings_value_format.h"
 #include "src/lists_meta_value_format.h"
 #include "src/pika_stream_meta_value.h"
@@ -41,6 +42,8 @@ public:
     raw_iter_.reset(db->NewIterator(options, handle));
   }
 
+  explicit TypeIterator(rocksdb::Iterator* raw_iter) { raw_iter_.reset(raw_iter); }
+
   virtual ~TypeIterator() {}
 
   virtual void Seek(const std::string& start_key) {
@@ -106,15 +109,21 @@ protected:
  * Since the meta of all data types is in a cf,
  * it is necessary to skip data that does not
  * belong to your type when iterating with an
- * iterator
+ * iterator. The collection types walk their
+ * TypeIndexIterator, which only visits the meta
+ * keys of the type, strings walk the meta cf
  */
 
 class StringsIterator : public TypeIterator {
 public:
   StringsIterator(const rocksdb::ReadOptions& options, rocksdb::DB* db,
-                  ColumnFamilyHandle* handle,
+                  ColumnFamilyHandle* handle, ColumnFamilyHandle* bitmap_handle,
                   const std::string& pattern)
-      : TypeIterator(options, db, handle), pattern_(pattern) {}
+      : TypeIterator(options, db, handle), db_(db), bitmap_handle_(bitmap_handle), pattern_(pattern) {
+    // the iterate bounds are meta keys, chunk reads go without them
+    chunk_read_options_.fill_cache = options.fill_cache;
+    chunk_read_options_.snapshot = options.snapshot;
+  }
   ~StringsIterator() {}
 
   bool ShouldSkip() override {
@@ -135,18 +144,47 @@ public:
 
     user_key_ = parsed_key.Key().ToString();
     user_value_ = parsed_value.UserValue().ToString();
+    chunked_ = parsed_value.IsBitmapChunked();
     return false;
   }
+
+  // a chunked bitmap keeps only its chunk meta in user_value_, the chunks are
+  // read here so that the scans that only want keys do not read them
+  std::string Value() const override {
+    if (!chunked_) {
+      return user_value_;
+    }
+    BitmapChunkMeta bitmap_meta;
+    if (!bitmap_meta.Decode(user_value_)) {
+      chunk_status_ = Status::Corruption("bad chunked bitmap value");
+      return std::string();
+    }
+    std::string value;
+    ChunkedBitmap bitmap(db_, bitmap_handle_, user_key_, bitmap_meta);
+    Status s = bitmap.ReadAll(chunk_read_options_, &value);
+    if (!s.ok()) {
+      chunk_status_ = s;
+      return std::string();
+    }
+    return value;
+  }
+
+  Status status() override { return chunk_status_.ok() ? raw_iter_->status() : chunk_status_; }
+
 private:
+  rocksdb::DB* db_ = nullptr;
+  ColumnFamilyHandle* bitmap_handle_ = nullptr;
+  rocksdb::ReadOptions chunk_read_options_;
+  bool chunked_ = false;
+  // the first chunk read error, it fails the scan reading the value
+  mutable Status chunk_status_;
   std::string pattern_;
 };
 
 class HashesIterator : public TypeIterator {
 public:
-  HashesIterator(const rocksdb::ReadOptions& options, rocksdb::DB* db,
-                 ColumnFamilyHandle* handle,
-                 const std::string& pattern)
-      : TypeIterator(options, db, handle), pattern_(pattern) {}
+  HashesIterator(rocksdb::Iterator* raw_iter, const std::string& pattern)
+      : TypeIterator(raw_iter), pattern_(pattern) {}
   ~HashesIterator() {}
 
   bool ShouldSkip() override {
@@ -174,10 +212,8 @@ private:
 
 class ListsIterator : public TypeIterator {
 public:
-  ListsIterator(const rocksdb::ReadOptions& options, rocksdb::DB* db,
-                ColumnFamilyHandle* handle,
-                const std::string& pattern)
-      : TypeIterator(options, db, handle), pattern_(pattern) {}
+  ListsIterator(rocksdb::Iterator* raw_iter, const std::string& pattern)
+      : TypeIterator(raw_iter), pattern_(pattern) {}
   ~ListsIterator() {}
 
   bool ShouldSkip() override {
@@ -205,10 +241,8 @@ private:
 
 class SetsIterator : public TypeIterator {
 public:
-  SetsIterator(const rocksdb::ReadOptions& options, rocksdb::DB* db,
-               ColumnFamilyHandle* handle,
-               const std::string& pattern)
-      : TypeIterator(options, db, handle), pattern_(pattern) {}
+  SetsIterator(rocksdb::Iterator* raw_iter, const std::string& pattern)
+      : TypeIterator(raw_iter), pattern_(pattern) {}
   ~SetsIterator() {}
 
   bool ShouldSkip() override {
@@ -236,10 +270,8 @@ private:
 
 class ZsetsIterator : public TypeIterator {
 public:
-  ZsetsIterator(const rocksdb::ReadOptions& options, rocksdb::DB* db,
-                ColumnFamilyHandle* handle,
-                const std::string& pattern)
-      : TypeIterator(options, db, handle), pattern_(pattern) {}
+  ZsetsIterator(rocksdb::Iterator* raw_iter, const std::string& pattern)
+      : TypeIterator(raw_iter), pattern_(pattern) {}
   ~ZsetsIterator() {}
 
   bool ShouldSkip() override {
@@ -267,10 +299,8 @@ private:
 
 class StreamsIterator : public TypeIterator {
 public:
-  StreamsIterator(const rocksdb::ReadOptions& options, rocksdb::DB* db,
-                  ColumnFamilyHandle* handle,
-                  const std::string& pattern)
-      : TypeIterator(options, db, handle), pattern_(pattern) {}
+  StreamsIterator(rocksdb::Iterator* raw_iter, const std::string& pattern)
+      : TypeIterator(raw_iter), pattern_(pattern) {}
   ~StreamsIterator() {}
 
   bool ShouldSkip() override {
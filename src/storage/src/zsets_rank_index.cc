@@ -0,0 +1,252 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include "src/zsets_rank_index.h"
+
+#include <limits>
+
+#include "src/coding.h"
+#include "src/zsets_data_key_format.h"
+
+namespace storage {
+
+ZSetsRankIndex::ZSetsRankIndex(rocksdb::DB* db, const std::vector<rocksdb::ColumnFamilyHandle*>& handles,
+                               const Slice& key, uint64_t version, bool indexed)
+    : db_(db),
+      score_cf_(handles[kZsetsScoreCF]),
+      rank_cf_(handles[kZsetsRankCF]),
+      key_(key.ToString()),
+      version_(version),
+      indexed_(indexed) {
+  ZSetsScoreKey first_block(key_, version_, -std::numeric_limits<double>::infinity(), Slice());
+  first_block_ = first_block.Encode().ToString();
+}
+
+void ZSetsRankIndex::Add(double score, const Slice& member) {
+  if (!indexed_) {
+    return;
+  }
+  ZSetsScoreKey zsets_score_key(key_, version_, score, member);
+  std::string block;
+  if (BlockOf(zsets_score_key.Encode(), &block).ok()) {
+    deltas_[block]++;
+  }
+}
+
+void ZSetsRankIndex::Remove(double score, const Slice& member) {
+  if (!indexed_) {
+    return;
+  }
+  ZSetsScoreKey zsets_score_key(key_, version_, score, member);
+  std::string block;
+  if (BlockOf(zsets_score_key.Encode(), &block).ok()) {
+    deltas_[block]--;
+  }
+}
+
+Status ZSetsRankIndex::Flush(rocksdb::WriteBatch* batch) {
+  for (const auto& [block, delta] : deltas_) {
+    if (delta == 0) {
+      continue;
+    }
+    int64_t count = 0;
+    Status s = GetBlockCount(block, &count);
+    if (!s.ok()) {
+      return s;
+    }
+    count += delta;
+    if (count <= 0 && block != first_block_) {
+      batch->Delete(rank_cf_, block);
+      continue;
+    }
+    count = count < 0 ? 0 : count;
+    batch->Put(rank_cf_, block, EncodeCount(count));
+    if (count > 2 * kBlockSize || (count < kBlockSize / 4 && block != first_block_)) {
+      unbalanced_.push_back(block);
+    }
+  }
+  deltas_.clear();
+  return Status::OK();
+}
+
+Status ZSetsRankIndex::Rebalance() {
+  Status s;
+  for (const auto& block : unbalanced_) {
+    // an earlier merge may have changed or removed the block
+    int64_t count = 0;
+    s = GetBlockCount(block, &count);
+    if (!s.ok()) {
+      break;
+    }
+    if (count > 2 * kBlockSize) {
+      s = SplitBlock(block, count);
+    } else if (count < kBlockSize / 4 && block != first_block_) {
+      s = MergeBlock(block, count);
+    }
+    if (!s.ok()) {
+      break;
+    }
+  }
+  unbalanced_.clear();
+  return s;
+}
+
+Status ZSetsRankIndex::Build(rocksdb::WriteBatch* batch) {
+  rocksdb::ReadOptions read_options;
+  read_options.prefix_same_as_start = true;
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, score_cf_));
+  std::string block = first_block_;
+  int64_t count = 0;
+  for (iter->Seek(first_block_); iter->Valid(); iter->Next()) {
+    if (count == kBlockSize) {
+      batch->Put(rank_cf_, block, EncodeCount(count));
+      block = iter->key().ToString();
+      count = 0;
+    }
+    count++;
+  }
+  if (!iter->status().ok()) {
+    return iter->status();
+  }
+  batch->Put(rank_cf_, block, EncodeCount(count));
+  indexed_ = true;
+  return Status::OK();
+}
+
+Status ZSetsRankIndex::Seek(const rocksdb::ReadOptions& read_options, int32_t rank, rocksdb::Iterator* score_iter) {
+  std::unique_ptr<rocksdb::Iterator> iter(NewRankIterator(read_options));
+  int64_t skipped = 0;
+  for (iter->Seek(first_block_); iter->Valid(); iter->Next()) {
+    int64_t count = DecodeCount(iter->value());
+    if (skipped + count > rank) {
+      score_iter->Seek(iter->key());
+      for (; skipped < rank && score_iter->Valid(); ++skipped) {
+        score_iter->Next();
+      }
+      return score_iter->Valid() ? Status::OK() : Status::Corruption("zset rank index out of sync");
+    }
+    skipped += count;
+  }
+  return Status::Corruption("zset rank index out of sync");
+}
+
+Status ZSetsRankIndex::Rank(const rocksdb::ReadOptions& read_options, double score, const Slice& member,
+                            int32_t* rank) {
+  ZSetsScoreKey zsets_score_key(key_, version_, score, member);
+  Slice target = zsets_score_key.Encode();
+  const rocksdb::Comparator* comparator = rank_cf_->GetComparator();
+
+  // sum the counts of the blocks before the one holding target
+  std::unique_ptr<rocksdb::Iterator> iter(NewRankIterator(read_options));
+  std::string block;
+  int64_t skipped = 0;
+  int64_t block_count = 0;
+  for (iter->Seek(first_block_); iter->Valid() && comparator->Compare(iter->key(), target) <= 0; iter->Next()) {
+    skipped += block_count;
+    block = iter->key().ToString();
+    block_count = DecodeCount(iter->value());
+  }
+  if (block.empty()) {
+    return Status::Corruption("zset rank index out of sync");
+  }
+
+  rocksdb::ReadOptions score_options(read_options);
+  score_options.prefix_same_as_start = true;
+  std::unique_ptr<rocksdb::Iterator> score_iter(db_->NewIterator(score_options, score_cf_));
+  for (score_iter->Seek(block); score_iter->Valid(); score_iter->Next(), ++skipped) {
+    if (score_iter->key() == target) {
+      *rank = static_cast<int32_t>(skipped);
+      return Status::OK();
+    }
+  }
+  return Status::NotFound();
+}
+
+Status ZSetsRankIndex::BlockOf(const Slice& score_key, std::string* block) {
+  if (!block_iter_) {
+    block_iter_.reset(NewRankIterator(rocksdb::ReadOptions()));
+  }
+  block_iter_->SeekForPrev(score_key);
+  if (!block_iter_->Valid()) {
+    return block_iter_->status().ok() ? Status::Corruption("zset rank index out of sync") : block_iter_->status();
+  }
+  *block = block_iter_->key().ToString();
+  return Status::OK();
+}
+
+Status ZSetsRankIndex::GetBlockCount(const std::string& block, int64_t* count) {
+  std::string value;
+  Status s = db_->Get(rocksdb::ReadOptions(), rank_cf_, block, &value);
+  if (s.ok()) {
+    *count = DecodeCount(value);
+  } else if (s.IsNotFound()) {
+    *count = 0;
+    s = Status::OK();
+  }
+  return s;
+}
+
+// Cut a block into blocks of kBlockSize, the last one keeps the rest
+Status ZSetsRankIndex::SplitBlock(const std::string& block, int64_t count) {
+  rocksdb::ReadOptions read_options;
+  read_options.prefix_same_as_start = true;
+  std::unique_ptr<rocksdb::Iterator> iter(db_->NewIterator(read_options, score_cf_));
+  rocksdb::WriteBatch batch;
+  std::string cur_block = block;
+  int64_t index = 0;
+  iter->Seek(block);
+  for (int64_t blocks = count / kBlockSize; blocks > 1; --blocks) {
+    for (int64_t step = 0; step < kBlockSize && iter->Valid(); ++step, ++index) {
+      iter->Next();
+    }
+    if (!iter->Valid()) {
+      return iter->status().ok() ? Status::Corruption("zset rank index out of sync") : iter->status();
+    }
+    batch.Put(rank_cf_, cur_block, EncodeCount(kBlockSize));
+    cur_block = iter->key().ToString();
+  }
+  batch.Put(rank_cf_, cur_block, EncodeCount(count - index));
+  return db_->Write(rocksdb::WriteOptions(), &batch);
+}
+
+// Fold a small block into the previous one if the result is not too large
+Status ZSetsRankIndex::MergeBlock(const std::string& block, int64_t count) {
+  std::unique_ptr<rocksdb::Iterator> iter(NewRankIterator(rocksdb::ReadOptions()));
+  iter->SeekForPrev(block);
+  if (!iter->Valid() || iter->key() != block) {
+    // merged or deleted already
+    return iter->status();
+  }
+  iter->Prev();
+  if (!iter->Valid()) {
+    return iter->status();
+  }
+  int64_t prev_count = DecodeCount(iter->value());
+  if (prev_count + count > 2 * kBlockSize) {
+    return Status::OK();
+  }
+  rocksdb::WriteBatch batch;
+  batch.Put(rank_cf_, iter->key(), EncodeCount(prev_count + count));
+  batch.Delete(rank_cf_, block);
+  return db_->Write(rocksdb::WriteOptions(), &batch);
+}
+
+rocksdb::Iterator* ZSetsRankIndex::NewRankIterator(const rocksdb::ReadOptions& read_options) {
+  rocksdb::ReadOptions iter_options(read_options);
+  iter_options.prefix_same_as_start = true;
+  return db_->NewIterator(iter_options, rank_cf_);
+}
+
+std::string ZSetsRankIndex::EncodeCount(int64_t count) {
+  char buf[sizeof(int64_t)];
+  EncodeFixed64(buf, static_cast<uint64_t>(count));
+  return {buf, sizeof(buf)};
+}
+
+int64_t ZSetsRankIndex::DecodeCount(const Slice& value) {
+  return value.size() < sizeof(int64_t) ? 0 : static_cast<int64_t>(DecodeFixed64(value.data()));
+}
+
+}  //  namespace storage
@@ -0,0 +1,98 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef SRC_ZSETS_RANK_INDEX_H_
+#define SRC_ZSETS_RANK_INDEX_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rocksdb/db.h"
+#include "rocksdb/status.h"
+#include "rocksdb/write_batch.h"
+
+#include "storage/storage_define.h"
+
+namespace storage {
+
+using Status = rocksdb::Status;
+
+/*
+ * Rank index of one zset version, stored in the zset rank cf.
+ * The members, in score cf order, are split into blocks and every block is
+ * stored as:
+ *   key:   | reserve1 | key | version | score | member | reserve2 |
+ *          |    8B    |     |    8B   |  8B   |        |    16B    |
+ *   value: | count |
+ *          |   8B  |
+ * The key has the zset score key layout and is the lower bound of the block,
+ * count is the number of score keys in [lower bound, next lower bound). The
+ * first block starts at -inf so every member belongs to exactly one block.
+ *
+ * Rank lookups sum the block counts and only step through the score keys of
+ * one block, O(count / kBlockSize + kBlockSize) instead of O(rank).
+ * Block counts change in the same WriteBatch as the score keys they count;
+ * splitting and merging blocks keeps the counts right at every step, so it
+ * is done in its own batch after the write.
+ *
+ * The index is optional, the zset meta value carries a flag telling whether
+ * the current version has one (see ParsedBaseMetaValue::IsRankIndexed).
+ */
+class ZSetsRankIndex {
+ public:
+  // blocks are split above 2 * kBlockSize score keys and merged into the
+  // previous block below kBlockSize / 4
+  static const int64_t kBlockSize = 1024;
+
+  ZSetsRankIndex(rocksdb::DB* db, const std::vector<rocksdb::ColumnFamilyHandle*>& handles, const Slice& key,
+                 uint64_t version, bool indexed);
+
+  bool Indexed() const { return indexed_; }
+  uint64_t Version() const { return version_; }
+
+  // Writers, called under the record lock of the key. Add and Remove track
+  // the score keys written to an indexed zset, Flush puts the block count
+  // changes into the batch that writes them, Rebalance splits and merges the
+  // blocks changed by that batch once it is written.
+  void Add(double score, const Slice& member);
+  void Remove(double score, const Slice& member);
+  Status Flush(rocksdb::WriteBatch* batch);
+  Status Rebalance();
+  // Put the blocks of a zset without index into batch
+  Status Build(rocksdb::WriteBatch* batch);
+
+  // Readers. Seek positions score_iter, an iterator over the score cf with
+  // prefix_same_as_start, at the member of the given rank. Rank returns the
+  // rank of the given score key.
+  Status Seek(const rocksdb::ReadOptions& read_options, int32_t rank, rocksdb::Iterator* score_iter);
+  Status Rank(const rocksdb::ReadOptions& read_options, double score, const Slice& member, int32_t* rank);
+
+ private:
+  Status BlockOf(const Slice& score_key, std::string* block);
+  Status GetBlockCount(const std::string& block, int64_t* count);
+  Status SplitBlock(const std::string& block, int64_t count);
+  Status MergeBlock(const std::string& block, int64_t count);
+  rocksdb::Iterator* NewRankIterator(const rocksdb::ReadOptions& read_options);
+  static std::string EncodeCount(int64_t count);
+  static int64_t DecodeCount(const Slice& value);
+
+  rocksdb::DB* db_ = nullptr;
+  rocksdb::ColumnFamilyHandle* score_cf_ = nullptr;
+  rocksdb::ColumnFamilyHandle* rank_cf_ = nullptr;
+  std::string key_;
+  uint64_t version_ = 0;
+  bool indexed_ = false;
+  // lower bound of the first block
+  std::string first_block_;
+  // pending count changes by block, and the blocks they left unbalanced
+  std::map<std::string, int64_t> deltas_;
+  std::vector<std::string> unbalanced_;
+  std::unique_ptr<rocksdb::Iterator> block_iter_;
+};
+
+}  //  namespace storage
+#endif  //  SRC_ZSETS_RANK_INDEX_H_
@@ -0,0 +1,289 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::Slice;
+using storage::Status;
+
+// bitmaps over 16 bytes are chunked
+static const int32_t kChunkSize = 16;
+
+class BitmapChunkTest : public ::testing::Test {
+ public:
+  BitmapChunkTest() = default;
+  ~BitmapChunkTest() override = default;
+
+  void SetUp() override {
+    path = "./db/bitmap_chunk";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.bitmap_chunk_size = kChunkSize;
+    db = std::make_unique<storage::Storage>();
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  std::string path;
+  storage::StorageOptions storage_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+// sets the bits of offsets in key and in a plain string mirroring it
+static void set_bits(storage::Storage* const db, const Slice& key, const std::vector<int64_t>& offsets,
+                     std::string* expect) {
+  int32_t ret = 0;
+  for (auto offset : offsets) {
+    Status s = db->SetBit(key, offset, 1, &ret);
+    ASSERT_TRUE(s.ok());
+    size_t byte = offset >> 3;
+    if (expect->size() <= byte) {
+      expect->resize(byte + 1, '\0');
+    }
+    (*expect)[byte] = static_cast<char>((*expect)[byte] | (1 << (7 - (offset & 0x7))));
+  }
+}
+
+static bool value_match(storage::Storage* const db, const Slice& key, const std::string& expect) {
+  std::string value;
+  Status s = db->Get(key, &value);
+  return s.ok() && value == expect;
+}
+
+// SetBit and GetBit across chunks, and a plain string that outgrows a chunk
+TEST_F(BitmapChunkTest, SetBitTest) {  // NOLINT
+  int32_t ret = 0;
+  std::string expect;
+  s = db->Set("SETBIT_KEY", "ab");
+  ASSERT_TRUE(s.ok());
+  expect = "ab";
+  set_bits(db.get(), "SETBIT_KEY", {7, 200, 201, 1000, 8 * kChunkSize * 3}, &expect);
+  ASSERT_TRUE(value_match(db.get(), "SETBIT_KEY", expect));
+
+  for (int64_t offset = 0; offset < static_cast<int64_t>(expect.size()) * 8 + 16; ++offset) {
+    s = db->GetBit("SETBIT_KEY", offset, &ret);
+    ASSERT_TRUE(s.ok());
+    int32_t bit = offset / 8 < static_cast<int64_t>(expect.size())
+                      ? (static_cast<uint8_t>(expect[offset / 8]) >> (7 - offset % 8)) & 0x1
+                      : 0;
+    ASSERT_EQ(ret, bit);
+  }
+
+  // clearing a bit gives the old one back
+  s = db->SetBit("SETBIT_KEY", 200, 0, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db->GetBit("SETBIT_KEY", 200, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+
+  int32_t len = 0;
+  s = db->Strlen("SETBIT_KEY", &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, static_cast<int32_t>(expect.size()));
+}
+
+// BitCount and BitPos over ranges that cross chunks and missing chunks
+TEST_F(BitmapChunkTest, BitCountBitPosTest) {  // NOLINT
+  std::string expect;
+  set_bits(db.get(), "COUNT_KEY", {3, 130, 131, 500, 900}, &expect);
+
+  int64_t count = 0;
+  s = db->BitCount("COUNT_KEY", 0, 0, &count, false);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 5);
+  s = db->BitCount("COUNT_KEY", 16, 63, &count, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 3);
+  s = db->BitCount("COUNT_KEY", -1, -1, &count, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 1);
+
+  int64_t pos = 0;
+  s = db->BitPos("COUNT_KEY", 1, &pos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pos, 3);
+  s = db->BitPos("COUNT_KEY", 1, 1, &pos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pos, 130);
+  s = db->BitPos("COUNT_KEY", 1, 17, 100, &pos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pos, 500);
+  s = db->BitPos("COUNT_KEY", 1, 63, 100, &pos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pos, 900);
+  s = db->BitPos("COUNT_KEY", 0, 40, 50, &pos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pos, 320);
+
+  // a run of ones over a whole chunk
+  std::vector<int64_t> ones;
+  for (int64_t offset = 0; offset < 8 * kChunkSize + 4; ++offset) {
+    ones.push_back(offset);
+  }
+  std::string ones_expect;
+  set_bits(db.get(), "ONES_KEY", ones, &ones_expect);
+  s = db->BitPos("ONES_KEY", 0, &pos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(pos, 8 * kChunkSize + 4);
+  s = db->BitCount("ONES_KEY", 0, 0, &count, false);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 8 * kChunkSize + 4);
+}
+
+// BitOp on chunked and plain sources, the dest is chunked when it is large
+TEST_F(BitmapChunkTest, BitOpTest) {  // NOLINT
+  std::string chunked;
+  set_bits(db.get(), "BITOP_CHUNKED", {1, 150, 400}, &chunked);
+  std::string plain = "\xff\x0f";
+  s = db->Set("BITOP_PLAIN", plain);
+  ASSERT_TRUE(s.ok());
+
+  std::string value_to_dest;
+  int64_t ret = 0;
+  s = db->BitOp(storage::kBitOpOr, "BITOP_DEST", {"BITOP_CHUNKED", "BITOP_PLAIN", "BITOP_MISSING"}, value_to_dest,
+                &ret);
+  ASSERT_TRUE(s.ok());
+  std::string expect = chunked;
+  expect[0] = static_cast<char>(expect[0] | plain[0]);
+  expect[1] = static_cast<char>(expect[1] | plain[1]);
+  ASSERT_EQ(ret, static_cast<int64_t>(expect.size()));
+  ASSERT_EQ(value_to_dest, expect);
+  ASSERT_TRUE(value_match(db.get(), "BITOP_DEST", expect));
+
+  int32_t bit = 0;
+  s = db->GetBit("BITOP_DEST", 400, &bit);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(bit, 1);
+
+  s = db->BitOp(storage::kBitOpAnd, "BITOP_DEST", {"BITOP_CHUNKED", "BITOP_PLAIN"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  expect = std::string(chunked.size(), '\0');
+  expect[0] = static_cast<char>(chunked[0] & plain[0]);
+  expect[1] = static_cast<char>(chunked[1] & plain[1]);
+  ASSERT_TRUE(value_match(db.get(), "BITOP_DEST", expect));
+  int64_t count = 0;
+  s = db->BitCount("BITOP_DEST", 0, 0, &count, false);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 1);
+}
+
+// The other string commands see the whole value, and writes store it plain
+TEST_F(BitmapChunkTest, StringsTest) {  // NOLINT
+  std::string expect;
+  set_bits(db.get(), "STRING_KEY", {10, 300}, &expect);
+
+  std::string range;
+  s = db->Getrange("STRING_KEY", 1, 20, &range);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(range, expect.substr(1, 20));
+
+  int32_t ret = 0;
+  int64_t etime = 0;
+  std::string new_value;
+  s = db->Append("STRING_KEY", "tail", &ret, &etime, new_value);
+  ASSERT_TRUE(s.ok());
+  expect += "tail";
+  ASSERT_EQ(ret, static_cast<int32_t>(expect.size()));
+  ASSERT_TRUE(value_match(db.get(), "STRING_KEY", expect));
+
+  // the ttl stays with the bitmap
+  ASSERT_EQ(db->Expire("STRING_KEY", 100 * 1000), 1);
+  set_bits(db.get(), "STRING_KEY", {700}, &expect);
+  ASSERT_GT(db->TTL("STRING_KEY"), 0);
+  ASSERT_TRUE(value_match(db.get(), "STRING_KEY", expect));
+
+  // a Set replaces the bitmap, its chunks go with the compaction
+  s = db->Set("STRING_KEY", "plain");
+  ASSERT_TRUE(s.ok());
+  s = db->Compact(storage::DataType::kAll, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(value_match(db.get(), "STRING_KEY", "plain"));
+  int32_t bit = 0;
+  s = db->GetBit("STRING_KEY", 300, &bit);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(bit, 0);
+}
+
+// PKScanRange and PKRScanRange return the whole value of a chunked bitmap
+TEST_F(BitmapChunkTest, ScanRangeTest) {  // NOLINT
+  std::string expect;
+  set_bits(db.get(), "SCAN_CHUNKED", {3, 250, 8 * kChunkSize * 2}, &expect);
+  s = db->Set("SCAN_PLAIN", "plain");
+  ASSERT_TRUE(s.ok());
+
+  std::vector<std::string> keys;
+  std::vector<storage::KeyValue> kvs;
+  std::string next_key;
+  s = db->PKScanRange(storage::DataType::kStrings, "", "", "SCAN_*", 10, &keys, &kvs, &next_key);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(kvs.size(), 2);
+  ASSERT_EQ(kvs[0].key, "SCAN_CHUNKED");
+  ASSERT_EQ(kvs[0].value, expect);
+  ASSERT_EQ(kvs[1].key, "SCAN_PLAIN");
+  ASSERT_EQ(kvs[1].value, "plain");
+
+  kvs.clear();
+  s = db->PKRScanRange(storage::DataType::kStrings, "", "", "SCAN_*", 10, &keys, &kvs, &next_key);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(kvs.size(), 2);
+  ASSERT_EQ(kvs[1].key, "SCAN_CHUNKED");
+  ASSERT_EQ(kvs[1].value, expect);
+}
+
+// Chunked bitmaps are read back with chunking off
+TEST_F(BitmapChunkTest, ReopenTest) {  // NOLINT
+  std::string expect;
+  set_bits(db.get(), "REOPEN_KEY", {5, 600}, &expect);
+
+  db.reset();
+  storage_options.bitmap_chunk_size = 0;
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(value_match(db.get(), "REOPEN_KEY", expect));
+  set_bits(db.get(), "REOPEN_KEY", {601}, &expect);
+  ASSERT_TRUE(value_match(db.get(), "REOPEN_KEY", expect));
+  int64_t count = 0;
+  s = db->BitCount("REOPEN_KEY", 0, 0, &count, false);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(count, 3);
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("bitmap_chunk_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,104 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "src/bitmap_kernels.h"
+
+using namespace storage;
+
+// lengths around the word and vector widths, and unaligned starts
+static const std::vector<uint64_t> kLengths = {0, 1, 7, 8, 9, 31, 32, 33, 63, 64, 65, 1000, 8191, 8192 + 37};
+
+static std::vector<unsigned char> random_bytes(std::mt19937* gen, uint64_t length) {
+  std::vector<unsigned char> bytes(length + 1);
+  for (auto& byte : bytes) {
+    byte = static_cast<unsigned char>((*gen)());
+  }
+  return bytes;
+}
+
+TEST(BitmapKernelsTest, PopcountTest) {  // NOLINT
+  std::mt19937 gen(1024);
+  for (auto length : kLengths) {
+    auto bytes = random_bytes(&gen, length);
+    int64_t expect = 0;
+    for (uint64_t idx = 1; idx <= length; ++idx) {
+      expect += __builtin_popcount(bytes[idx]);
+    }
+    ASSERT_EQ(PopcountBytes(bytes.data() + 1, length), expect) << BitmapKernelsName() << " " << length;
+  }
+  // a buffer long enough for the byte counters to be summed more than once
+  std::vector<unsigned char> ones(32 * 100, 0xff);
+  ASSERT_EQ(PopcountBytes(ones.data(), ones.size()), static_cast<int64_t>(8 * ones.size()));
+}
+
+TEST(BitmapKernelsTest, SkipTest) {  // NOLINT
+  for (auto length : kLengths) {
+    std::vector<unsigned char> zeros(length + 1, 0x00);
+    std::vector<unsigned char> ones(length + 1, 0xff);
+    ASSERT_EQ(SkipBytes(zeros.data() + 1, length, 0x00), length);
+    ASSERT_EQ(SkipBytes(ones.data() + 1, length, 0xff), length);
+    for (uint64_t at = 0; at < length; at += std::max<uint64_t>(length / 7, 1)) {
+      zeros[at + 1] = 0x10;
+      ones[at + 1] = 0xfe;
+      ASSERT_EQ(SkipBytes(zeros.data() + 1, length, 0x00), at);
+      ASSERT_EQ(SkipBytes(ones.data() + 1, length, 0xff), at);
+      zeros[at + 1] = 0x00;
+      ones[at + 1] = 0xff;
+    }
+  }
+}
+
+TEST(BitmapKernelsTest, BitOpTest) {  // NOLINT
+  std::mt19937 gen(1024);
+  for (auto length : kLengths) {
+    auto dest = random_bytes(&gen, length);
+    auto src = random_bytes(&gen, length);
+    for (auto op : {kBitOpAnd, kBitOpOr, kBitOpXor, kBitOpNot}) {
+      auto result = dest;
+      BitOpBytes(op, result.data() + 1, src.data() + 1, length);
+      ASSERT_EQ(result[0], dest[0]);
+      for (uint64_t idx = 1; idx <= length; ++idx) {
+        unsigned char expect = 0;
+        switch (op) {
+          case kBitOpAnd:
+            expect = dest[idx] & src[idx];
+            break;
+          case kBitOpOr:
+            expect = dest[idx] | src[idx];
+            break;
+          case kBitOpXor:
+            expect = dest[idx] ^ src[idx];
+            break;
+          default:
+            expect = static_cast<unsigned char>(~dest[idx]);
+            break;
+        }
+        ASSERT_EQ(result[idx], expect) << BitmapKernelsName() << " " << op << " " << length;
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("bitmap_kernels_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,194 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/bulk_loader.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::DataType;
+using storage::Slice;
+using storage::Status;
+
+class BulkLoaderTest : public ::testing::Test {
+ public:
+  BulkLoaderTest() = default;
+  ~BulkLoaderTest() override = default;
+
+  void SetUp() override {
+    path = "./db/bulk_loader";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.key_counters = true;
+    storage_options.expiry_reap_rate = 1000;
+    db = std::make_unique<storage::Storage>();
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+    // small buffers and files, so the runs are merged and split
+    load_options.work_dir = path + "_load";
+    load_options.buffer_bytes = 64 * 1024;
+    load_options.target_file_size = 32 * 1024;
+    load_options.worker_num = 2;
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+    pstd::DeleteDirIfExist(load_options.work_dir);
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  std::string path;
+  storage::StorageOptions storage_options;
+  storage::BulkLoadOptions load_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+static std::string LoadKey(const std::string& type, int idx) { return "LOAD_" + type + "_" + std::to_string(idx); }
+
+static void load_keys(storage::BulkLoader* loader, int num) {
+  for (int idx = 0; idx < num; ++idx) {
+    std::string value = std::to_string(idx);
+    Status s = loader->Set(LoadKey("STRING", idx), value);
+    ASSERT_TRUE(s.ok());
+    s = loader->HMSet(LoadKey("HASH", idx), {{"F1", value}, {"F2", "V2"}, {"F1", "V1"}});
+    ASSERT_TRUE(s.ok());
+    s = loader->SAdd(LoadKey("SET", idx), {"M1", "M2", value, "M1"});
+    ASSERT_TRUE(s.ok());
+    s = loader->RPush(LoadKey("LIST", idx), {"E1", "E2", value});
+    ASSERT_TRUE(s.ok());
+    s = loader->ZAdd(LoadKey("ZSET", idx), {{2, "M2"}, {1, "M1"}, {3, "M2"}});
+    ASSERT_TRUE(s.ok());
+  }
+}
+
+// Keys of every type read back as their writes would have left them
+TEST_F(BulkLoaderTest, LoadTest) {  // NOLINT
+  std::unique_ptr<storage::BulkLoader> loader;
+  s = storage::BulkLoader::Open(db.get(), load_options, loader);
+  ASSERT_TRUE(s.ok());
+  load_keys(loader.get(), 500);
+  s = loader->Set("LOAD_TTL", "V", 100 * 1000);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(loader->SAdd("LOAD_EMPTY", {}).ok());
+  ASSERT_EQ(loader->Keys(), 2501);
+  // nothing is visible before Finish
+  ASSERT_EQ(db->Exists({LoadKey("STRING", 0)}), 0);
+  s = loader->Finish();
+  ASSERT_TRUE(s.ok());
+  ASSERT_FALSE(pstd::FileExists(load_options.work_dir));
+
+  std::string value;
+  s = db->Get(LoadKey("STRING", 7), &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "7");
+  s = db->HGet(LoadKey("HASH", 7), "F1", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "V1");
+  int32_t len = 0;
+  s = db->HLen(LoadKey("HASH", 7), &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, 2);
+  int32_t card = 0;
+  s = db->SCard(LoadKey("SET", 7), &card);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(card, 3);
+  std::vector<std::string> elements;
+  s = db->LRange(LoadKey("LIST", 7), 0, -1, &elements);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(elements, std::vector<std::string>({"E1", "E2", "7"}));
+  std::vector<storage::ScoreMember> score_members;
+  s = db->ZRange(LoadKey("ZSET", 7), 0, -1, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(score_members.size(), 2);
+  ASSERT_EQ(score_members[0].member, "M1");
+  ASSERT_EQ(score_members[1].score, 2);
+  int64_t ttl = db->TTL("LOAD_TTL");
+  ASSERT_GT(ttl, 0);
+  ASSERT_EQ(db->Exists({"LOAD_EMPTY"}), 0);
+
+  // the type index covers the loaded keys, the counters count them
+  std::vector<std::string> keys;
+  s = db->Keys(DataType::kZSets, "LOAD_*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(keys.size(), 500);
+  std::vector<storage::KeyInfo> key_infos;
+  s = db->GetKeyNum(&key_infos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(key_infos[0].keys, 501);
+  ASSERT_EQ(key_infos[0].expires, 1);
+  for (size_t idx = 1; idx < 5; ++idx) {
+    ASSERT_EQ(key_infos[idx].keys, 500);
+  }
+
+  // loaded keys take writes like any other
+  int32_t ret = 0;
+  s = db->SAdd(LoadKey("SET", 7), {"M3"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  ASSERT_EQ(db->Del({LoadKey("HASH", 7)}), 1);
+}
+
+// A loaded key replaces the stored one, a key loaded twice fails the load
+TEST_F(BulkLoaderTest, ReplaceTest) {  // NOLINT
+  int32_t ret = 0;
+  s = db->SAdd("REPLACED", {"OLD1", "OLD2"}, &ret);
+  ASSERT_TRUE(s.ok());
+
+  std::unique_ptr<storage::BulkLoader> loader;
+  s = storage::BulkLoader::Open(db.get(), load_options, loader);
+  ASSERT_TRUE(s.ok());
+  s = loader->HMSet("REPLACED", {{"F", "V"}});
+  ASSERT_TRUE(s.ok());
+  s = loader->Finish();
+  ASSERT_TRUE(s.ok());
+  std::string value;
+  s = db->HGet("REPLACED", "F", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "V");
+  int32_t card = 0;
+  s = db->SCard("REPLACED", &card);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  // the duplicate sits in another run than the first one
+  s = storage::BulkLoader::Open(db.get(), load_options, loader);
+  ASSERT_TRUE(s.ok());
+  s = loader->Set("TWICE", "V1");
+  ASSERT_TRUE(s.ok());
+  load_keys(loader.get(), 200);
+  s = loader->Set("TWICE", "V2");
+  ASSERT_TRUE(s.ok());
+  s = loader->Finish();
+  ASSERT_TRUE(s.IsInvalidArgument());
+  ASSERT_EQ(db->Exists({"TWICE", LoadKey("STRING", 0)}), 0);
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("bulk_loader_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -7,7 +7,9 @@
 #include <iostream>
 #include <thread>
 
+#include "src/base_data_key_format.h"
 #include "src/custom_comparator.h"
+#include "src/custom_slice_transform.h"
 #include "src/redis.h"
 #include "src/zsets_data_key_format.h"
 #include "storage/storage.h"
@@ -152,6 +154,44 @@ TEST(ZSetScoreKeyComparator, FindShortestSeparatorTest) {
   ASSERT_TRUE(impl.Compare(start_10, limit_10) < 0);
 }
 
+// DataKeyPrefixTransform
+TEST(DataKeyPrefixTransform, TransformTest) {
+  DataKeyPrefixTransformImpl transform;
+
+  // member key and seek key of the same hash share one prefix
+  HashesDataKey data_key("Axlgrep", 1557212501, "field");
+  HashesDataKey seek_key("Axlgrep", 1557212501, Slice());
+  std::string data_key_str = data_key.Encode().ToString();
+  std::string seek_key_str = seek_key.EncodeSeekKey().ToString();
+  ASSERT_TRUE(transform.InDomain(data_key_str));
+  ASSERT_TRUE(transform.InDomain(seek_key_str));
+  ASSERT_EQ(transform.Transform(data_key_str), Slice(seek_key_str));
+
+  // zset score key carries the same prefix as the member key
+  ZSetsScoreKey score_key("Axlgrep", 1557212501, 3.1415, "abc");
+  std::string score_key_str = score_key.Encode().ToString();
+  ASSERT_EQ(transform.Transform(score_key_str), Slice(seek_key_str));
+
+  // user key with '\0' inside, and a key that is a prefix of another key
+  std::string zero_key("Axl\0grep", 8);
+  HashesDataKey zero_data_key(zero_key, 1557212501, "field");
+  HashesDataKey zero_seek_key(zero_key, 1557212501, Slice());
+  std::string zero_data_key_str = zero_data_key.Encode().ToString();
+  ASSERT_EQ(transform.Transform(zero_data_key_str), zero_seek_key.EncodeSeekKey());
+  HashesDataKey short_data_key("Axl", 1557212501, "field");
+  std::string short_data_key_str = short_data_key.Encode().ToString();
+  ASSERT_NE(transform.Transform(short_data_key_str), transform.Transform(data_key_str));
+
+  // different versions never share a prefix
+  HashesDataKey new_version_key("Axlgrep", 1557212502, "field");
+  std::string new_version_key_str = new_version_key.Encode().ToString();
+  ASSERT_NE(transform.Transform(new_version_key_str), transform.Transform(data_key_str));
+
+  // too short to hold reserve1 + key + version
+  ASSERT_FALSE(transform.InDomain(Slice("short")));
+  ASSERT_FALSE(transform.InDomain(Slice(data_key_str.data(), kPrefixReserveLength + 9)));
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
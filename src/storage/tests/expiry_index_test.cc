@@ -0,0 +1,211 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::Slice;
+using storage::Status;
+
+// keys with this ttl are due once the second after their etime has begun
+static const int64_t kShortTtl = 1000;
+
+class ExpiryIndexTest : public ::testing::Test {
+ public:
+  ExpiryIndexTest() = default;
+  ~ExpiryIndexTest() override = default;
+
+  void SetUp() override {
+    path = "./db/expiry_index";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    // the counters tell the keys deleted from the ones only expired, and the
+    // background reaper is slow enough for the tests to do the work
+    storage_options.key_counters = true;
+    storage_options.expiry_reap_rate = 1;
+    db = std::make_unique<storage::Storage>();
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  std::string path;
+  storage::StorageOptions storage_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+static void wait_due() { std::this_thread::sleep_for(std::chrono::milliseconds(2 * kShortTtl + 100)); }
+
+// Keys of strings, hashes, lists, zsets and sets still on disk
+static std::vector<uint64_t> stored_keys(storage::Storage* const db) {
+  std::vector<storage::KeyInfo> key_infos;
+  Status s = db->GetKeyNum(&key_infos);
+  EXPECT_TRUE(s.ok());
+  std::vector<uint64_t> keys;
+  for (size_t idx = 0; idx < 5; ++idx) {
+    keys.push_back(key_infos[idx].keys);
+  }
+  return keys;
+}
+
+// Setex, PKSetexAt and Expire of every type are reaped once due
+TEST_F(ExpiryIndexTest, ReapTest) {  // NOLINT
+  int32_t ret = 0;
+  uint64_t len = 0;
+  for (int idx = 0; idx < 10; ++idx) {
+    s = db->Setex("SETEX_KEY_" + std::to_string(idx), "v", kShortTtl);
+    ASSERT_TRUE(s.ok());
+  }
+  s = db->PKSetexAt("PKSETEXAT_KEY", "v", pstd::NowMillis() + kShortTtl);
+  ASSERT_TRUE(s.ok());
+  for (int idx = 0; idx < 3; ++idx) {
+    s = db->Setex("LONG_TTL_KEY_" + std::to_string(idx), "v", 100 * 1000);
+    ASSERT_TRUE(s.ok());
+  }
+  s = db->Set("NO_TTL_KEY", "v");
+  ASSERT_TRUE(s.ok());
+  s = db->HSet("HASH_KEY", "f", "v", &ret);
+  ASSERT_TRUE(s.ok());
+  s = db->RPush("LIST_KEY", {"e"}, &len);
+  ASSERT_TRUE(s.ok());
+  s = db->ZAdd("ZSET_KEY", {{1, "m"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db->SAdd("SET_KEY", {"m"}, &ret);
+  ASSERT_TRUE(s.ok());
+  for (const auto& key : {"HASH_KEY", "LIST_KEY", "ZSET_KEY", "SET_KEY"}) {
+    ASSERT_EQ(db->Expire(key, kShortTtl), 1);
+  }
+  ASSERT_EQ(stored_keys(db.get()), std::vector<uint64_t>({15, 1, 1, 1, 1}));
+
+  // nothing is due yet
+  int64_t reaped = 0;
+  s = db->ReapExpiredKeys(1000, &reaped);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(reaped, 0);
+
+  wait_due();
+  s = db->ReapExpiredKeys(1000, &reaped);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LE(reaped, 15);
+  ASSERT_EQ(stored_keys(db.get()), std::vector<uint64_t>({4, 0, 0, 0, 0}));
+  ASSERT_EQ(db->Exists({"SETEX_KEY_0", "PKSETEXAT_KEY", "HASH_KEY", "LIST_KEY"}), 0);
+  ASSERT_EQ(db->Exists({"LONG_TTL_KEY_0", "NO_TTL_KEY"}), 2);
+
+  // a key written again under the same name is a new key
+  s = db->HSet("HASH_KEY", "f2", "v", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  int32_t hlen = 0;
+  s = db->HLen("HASH_KEY", &hlen);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(hlen, 1);
+}
+
+// Keys persisted, expired later or written again keep living, their stale
+// entries only go away
+TEST_F(ExpiryIndexTest, StaleEntryTest) {  // NOLINT
+  s = db->Setex("PERSIST_KEY", "v", kShortTtl);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->Persist("PERSIST_KEY"), 1);
+  s = db->Setex("LATER_KEY", "v", kShortTtl);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->Expire("LATER_KEY", 100 * 1000), 1);
+  s = db->Setex("SET_AGAIN_KEY", "v", kShortTtl);
+  ASSERT_TRUE(s.ok());
+  s = db->Set("SET_AGAIN_KEY", "v2");
+  ASSERT_TRUE(s.ok());
+
+  wait_due();
+  int64_t reaped = 0;
+  s = db->ReapExpiredKeys(1000, &reaped);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(reaped, 0);
+  ASSERT_EQ(db->Exists({"PERSIST_KEY", "LATER_KEY", "SET_AGAIN_KEY"}), 3);
+  ASSERT_EQ(stored_keys(db.get()), std::vector<uint64_t>({3, 0, 0, 0, 0}));
+  ASSERT_GT(db->TTL("LATER_KEY"), 0);
+}
+
+// A pass stops after max_entries entries, the next one goes on
+TEST_F(ExpiryIndexTest, RateTest) {  // NOLINT
+  for (int idx = 0; idx < 100; ++idx) {
+    s = db->Setex("KEY_" + std::to_string(idx), "v", kShortTtl);
+    ASSERT_TRUE(s.ok());
+  }
+  wait_due();
+  int64_t reaped = 0;
+  s = db->ReapExpiredKeys(10, &reaped);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LE(reaped, 10);
+  ASSERT_GE(stored_keys(db.get())[0], 100 - 10 - 10);
+  s = db->ReapExpiredKeys(1000, &reaped);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(stored_keys(db.get())[0], 0);
+}
+
+// Keys given a ttl while the index was off are indexed once it is on
+TEST_F(ExpiryIndexTest, BuildTest) {  // NOLINT
+  db.reset();
+  storage_options.expiry_reap_rate = 0;
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  for (int idx = 0; idx < 5; ++idx) {
+    s = db->Setex("KEY_" + std::to_string(idx), "v", kShortTtl);
+    ASSERT_TRUE(s.ok());
+  }
+  s = db->Set("NO_TTL_KEY", "v");
+  ASSERT_TRUE(s.ok());
+  wait_due();
+  int64_t reaped = 0;
+  s = db->ReapExpiredKeys(1000, &reaped);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(reaped, 0);
+  ASSERT_EQ(stored_keys(db.get())[0], 6);
+
+  db.reset();
+  storage_options.expiry_reap_rate = 1;
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  s = db->ReapExpiredKeys(1000, &reaped);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(stored_keys(db.get())[0], 1);
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("expiry_index_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
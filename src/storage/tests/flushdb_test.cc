@@ -0,0 +1,166 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "pstd/include/pika_codis_slot.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::DataType;
+using storage::Slice;
+using storage::Status;
+
+static const int kSlotNum = 1024;
+
+class FlushDBTest : public ::testing::Test {
+ public:
+  FlushDBTest() = default;
+  ~FlushDBTest() override = default;
+
+  void SetUp() override {
+    path = "./db/flushdb";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.key_counters = true;
+    storage_options.expiry_reap_rate = 1000;
+    storage_options.sst_delete_rate_bytes = 1024 * 1024;
+    db = std::make_unique<storage::Storage>(3, kSlotNum, true);
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  std::string path;
+  storage::StorageOptions storage_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+static void write_keys(storage::Storage* const db, const std::string& prefix) {
+  int32_t ret = 0;
+  uint64_t len = 0;
+  Status s = db->Set(prefix + "STRING", "STRING_VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db->HMSet(prefix + "HASH", {{"F1", "V1"}, {"F2", "V2"}});
+  ASSERT_TRUE(s.ok());
+  s = db->RPush(prefix + "LIST", {"E1", "E2", "E3"}, &len);
+  ASSERT_TRUE(s.ok());
+  s = db->ZAdd(prefix + "ZSET", {{1, "M1"}, {2, "M2"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db->SAdd(prefix + "SET", {"M1", "M2"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->Expire(prefix + "HASH", 100 * 1000), 1);
+}
+
+static int64_t total_keys(storage::Storage* const db) {
+  std::vector<storage::KeyInfo> key_infos;
+  Status s = db->GetKeyNum(&key_infos);
+  EXPECT_TRUE(s.ok());
+  int64_t total = 0;
+  for (const auto& key_info : key_infos) {
+    total += key_info.keys;
+  }
+  return total;
+}
+
+// Keys of every type go, in every instance, files flushed to disk included
+TEST_F(FlushDBTest, FlushTest) {  // NOLINT
+  for (int idx = 0; idx < 20; ++idx) {
+    write_keys(db.get(), "KEY_" + std::to_string(idx) + "_");
+  }
+  s = db->CompactRange(DataType::kAll, "", "", true);
+  ASSERT_TRUE(s.ok());
+  write_keys(db.get(), "MEMTABLE_");
+  ASSERT_EQ(total_keys(db.get()), 105);
+
+  s = db->FlushDB();
+  ASSERT_TRUE(s.ok());
+  std::vector<std::string> keys;
+  s = db->Keys(DataType::kAll, "*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(keys.empty());
+  ASSERT_EQ(db->Exists({"KEY_0_STRING", "KEY_0_HASH", "KEY_0_LIST", "KEY_0_ZSET", "KEY_0_SET"}), 0);
+  // the counters are deleted with the keys and still trusted
+  ASSERT_EQ(total_keys(db.get()), 0);
+  std::vector<storage::KeyInfo> key_infos;
+  s = db->GetKeyNum(&key_infos, true);
+  ASSERT_TRUE(s.ok());
+  for (const auto& key_info : key_infos) {
+    ASSERT_EQ(key_info.keys, 0);
+  }
+
+  // a collection written again starts empty
+  int32_t ret = 0;
+  s = db->SAdd("KEY_0_SET", {"M3"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  int32_t card = 0;
+  s = db->SCard("KEY_0_SET", &card);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(card, 1);
+  write_keys(db.get(), "KEY_1_");
+  ASSERT_EQ(total_keys(db.get()), 6);
+}
+
+// The slot table outlives the flush and a reopen after it
+TEST_F(FlushDBTest, SlotTableTest) {  // NOLINT
+  write_keys(db.get(), "{KEY}_");
+  uint32_t slot_id = GetSlotID(kSlotNum, "{KEY}_STRING");
+  uint32_t dst_inst = (db->GetSlotInstance(slot_id) + 1) % 3;
+  s = db->MigrateSlots({slot_id}, dst_inst);
+  ASSERT_TRUE(s.ok());
+
+  s = db->FlushDB();
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->GetSlotInstance(slot_id), dst_inst);
+  db.reset();
+  db = std::make_unique<storage::Storage>(3, kSlotNum, true);
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->GetSlotInstance(slot_id), dst_inst);
+  ASSERT_EQ(db->Exists({"{KEY}_STRING"}), 0);
+
+  s = db->Set("{KEY}_STRING", "V");
+  ASSERT_TRUE(s.ok());
+  int64_t count = 0;
+  rocksdb::ReadOptions read_options;
+  std::unique_ptr<rocksdb::Iterator> iter(db->GetDBByIndex(static_cast<int>(dst_inst))->NewIterator(read_options));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(count, 1);
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("flushdb_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,272 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::FieldValue;
+using storage::Slice;
+using storage::Status;
+
+using HashModel = std::map<std::string, std::string>;
+
+class HashesInlineTest : public ::testing::Test {
+ public:
+  HashesInlineTest() = default;
+  ~HashesInlineTest() override = default;
+
+  void SetUp() override {
+    std::string path = "./db/hashes_inline";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.hash_max_inline_entries = 8;
+    storage_options.hash_max_inline_value = 16;
+    s = db.Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    std::string path = "./db/hashes_inline";
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  storage::StorageOptions storage_options;
+  storage::Storage db;
+  storage::Status s;
+};
+
+static std::string InlineField(int idx) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "f%03d", idx);
+  return buf;
+}
+
+// Compare HLen, HGetall, HKeys, HVals, HGet and HMGet of key with the model
+static bool hash_match(storage::Storage* const db, const Slice& key, const HashModel& model) {
+  int32_t len = 0;
+  Status s = db->HLen(key, &len);
+  if (model.empty()) {
+    return s.IsNotFound();
+  }
+  if (!s.ok() || len != static_cast<int32_t>(model.size())) {
+    return false;
+  }
+  std::vector<FieldValue> fvs;
+  std::vector<std::string> fields;
+  std::vector<std::string> values;
+  if (!db->HGetall(key, &fvs).ok() || !db->HKeys(key, &fields).ok() || !db->HVals(key, &values).ok() ||
+      fvs.size() != model.size() || fields.size() != model.size() || values.size() != model.size()) {
+    return false;
+  }
+  size_t idx = 0;
+  for (const auto& [field, value] : model) {
+    if (fvs[idx].field != field || fvs[idx].value != value || fields[idx] != field || values[idx] != value) {
+      return false;
+    }
+    std::string get_value;
+    if (!db->HGet(key, field, &get_value).ok() || get_value != value) {
+      return false;
+    }
+    ++idx;
+  }
+  std::vector<storage::ValueStatus> vss;
+  if (!db->HMGet(key, {model.begin()->first, "missing"}, &vss).ok() || vss.size() != 2 ||
+      vss[0].value != model.begin()->second || !vss[1].status.IsNotFound()) {
+    return false;
+  }
+  return db->HExists(key, "missing").IsNotFound();
+}
+
+// HSet, HSetnx, HMSet, HIncrby, HIncrbyfloat, HDel
+TEST_F(HashesInlineTest, WriteTest) {  // NOLINT
+  HashModel model;
+  int32_t ret = 0;
+  for (int idx = 0; idx < 6; ++idx) {
+    s = db.HSet("INLINE_KEY", InlineField(idx), "v" + std::to_string(idx), &ret);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(ret, 1);
+    model[InlineField(idx)] = "v" + std::to_string(idx);
+  }
+  s = db.HSet("INLINE_KEY", InlineField(0), "new", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  model[InlineField(0)] = "new";
+  s = db.HSetnx("INLINE_KEY", InlineField(1), "none", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+
+  int64_t ival = 0;
+  s = db.HIncrby("INLINE_KEY", "counter", 5, &ival);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ival, 5);
+  s = db.HIncrby("INLINE_KEY", "counter", -7, &ival);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ival, -2);
+  model["counter"] = "-2";
+  s = db.HIncrby("INLINE_KEY", InlineField(0), 1, &ival);
+  ASSERT_TRUE(s.IsCorruption());
+  std::string fval;
+  s = db.HIncrbyfloat("INLINE_KEY", "float", "1.5", &fval);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(fval, "1.5");
+  model["float"] = "1.5";
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+
+  // the ninth field moves the hash to data keys
+  s = db.HMSet("INLINE_KEY", {{InlineField(6), "v6"}, {InlineField(7), "v7"}});
+  ASSERT_TRUE(s.ok());
+  model[InlineField(6)] = "v6";
+  model[InlineField(7)] = "v7";
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+
+  // and back at half of the limit
+  std::vector<std::string> del_fields{InlineField(0), InlineField(1), InlineField(2), InlineField(3),
+                                      InlineField(4), "missing"};
+  s = db.HDel("INLINE_KEY", del_fields, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 5);
+  for (int idx = 0; idx < 5; ++idx) {
+    model.erase(InlineField(idx));
+  }
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+  s = db.HDel("INLINE_KEY", {"counter"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  model.erase("counter");
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+
+  // a long value moves it too
+  std::string long_value(32, 'x');
+  s = db.HSet("INLINE_KEY", "long", long_value, &ret);
+  ASSERT_TRUE(s.ok());
+  model["long"] = long_value;
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+
+  s = db.HDel("INLINE_KEY", {"long"}, &ret);
+  ASSERT_TRUE(s.ok());
+  model.erase("long");
+  std::vector<std::string> rest;
+  for (const auto& fv : model) {
+    rest.push_back(fv.first);
+  }
+  s = db.HDel("INLINE_KEY", rest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, static_cast<int32_t>(rest.size()));
+  model.clear();
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+
+  // created from scratch past the limit
+  std::vector<FieldValue> fvs;
+  for (int idx = 0; idx < 12; ++idx) {
+    fvs.push_back({InlineField(idx), "v"});
+    model[InlineField(idx)] = "v";
+  }
+  s = db.HMSet("INLINE_KEY", fvs);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+}
+
+// Expire, Del, recreate
+TEST_F(HashesInlineTest, LifecycleTest) {  // NOLINT
+  HashModel model;
+  int32_t ret = 0;
+  s = db.HMSet("INLINE_KEY", {{"a", "1"}, {"b", "2"}});
+  ASSERT_TRUE(s.ok());
+  model = {{"a", "1"}, {"b", "2"}};
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+
+  std::vector<FieldValue> fvs;
+  int64_t ttl = 0;
+  ASSERT_EQ(db.Expire("INLINE_KEY", 100 * 1000), 1);
+  s = db.HGetallWithTTL("INLINE_KEY", &fvs, &ttl);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(fvs.size(), 2);
+  ASSERT_GT(ttl, 0);
+
+  ASSERT_EQ(db.Del({"INLINE_KEY"}), 1);
+  model.clear();
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+
+  s = db.HSet("INLINE_KEY", "c", "3", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  model = {{"c", "3"}};
+  ASSERT_TRUE(hash_match(&db, "INLINE_KEY", model));
+}
+
+// HScan, HScanx, PKHScanRange, PKHRScanRange
+TEST_F(HashesInlineTest, ScanTest) {  // NOLINT
+  std::vector<FieldValue> fvs;
+  for (int idx = 0; idx < 8; ++idx) {
+    fvs.push_back({InlineField(idx), "v"});
+  }
+  s = db.HMSet("INLINE_KEY", fvs);
+  ASSERT_TRUE(s.ok());
+
+  std::vector<FieldValue> field_values;
+  int64_t next_cursor = 0;
+  s = db.HScan("INLINE_KEY", 0, "f00*", 2, &field_values, &next_cursor);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(field_values.size(), 8);
+  ASSERT_EQ(next_cursor, 0);
+
+  std::string next_field;
+  s = db.HScanx("INLINE_KEY", InlineField(2), "*", 3, &field_values, &next_field);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(field_values.size(), 3);
+  ASSERT_EQ(field_values[0].field, InlineField(2));
+  ASSERT_EQ(next_field, InlineField(5));
+
+  s = db.PKHScanRange("INLINE_KEY", InlineField(1), InlineField(6), "*", 3, &field_values, &next_field);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(field_values.size(), 3);
+  ASSERT_EQ(field_values[2].field, InlineField(3));
+  ASSERT_EQ(next_field, InlineField(4));
+  s = db.PKHScanRange("INLINE_KEY", InlineField(5), InlineField(6), "*", 10, &field_values, &next_field);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(field_values.size(), 2);
+  ASSERT_EQ(next_field, "");
+
+  s = db.PKHRScanRange("INLINE_KEY", InlineField(6), InlineField(1), "*", 3, &field_values, &next_field);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(field_values.size(), 3);
+  ASSERT_EQ(field_values[0].field, InlineField(6));
+  ASSERT_EQ(next_field, InlineField(3));
+  s = db.PKHRScanRange("INLINE_KEY", "", "", "*", 10, &field_values, &next_field);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(field_values.size(), 8);
+  ASSERT_EQ(field_values[0].field, InlineField(7));
+  ASSERT_EQ(next_field, "");
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("hashes_inline_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
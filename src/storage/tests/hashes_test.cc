@@ -2431,6 +2431,57 @@ TEST_F(HashesTest, PKHRScanRangeTest) {
   ASSERT_EQ(next_field, "i");
 }
 
+// Data format v2 and the offline v1 -> v2 conversion
+TEST(HashesDataFormatTest, ConvertTest) {
+  std::string path = "./db/hashes_data_format";
+  pstd::DeleteDirIfExist(path);
+  mkdir(path.c_str(), 0755);
+  StorageOptions storage_options;
+  storage_options.options.create_if_missing = true;
+  std::vector<FieldValue> fvs = {{"F1", "V1"}, {"F2", "V2"}, {std::string("F\0x", 3), std::string("V\0x", 3)}};
+
+  // ***************** Group 1 Test *****************
+  // write with v1, then convert to v2
+  auto db = std::make_unique<storage::Storage>();
+  storage::Status s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  s = db->HMSet("GP1_DATA_FORMAT_KEY", fvs);
+  ASSERT_TRUE(s.ok());
+  uint64_t converted = 0;
+  s = db->ConvertDataFormat(kDataFormatV2, &converted);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(converted, 3);
+  ASSERT_TRUE(field_value_match(db.get(), "GP1_DATA_FORMAT_KEY", fvs));
+
+  // converting again finds nothing left
+  s = db->ConvertDataFormat(kDataFormatV2, &converted);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(converted, 0);
+
+  // ***************** Group 2 Test *****************
+  // reopen with the default v1 option, the instance keeps writing v2
+  db.reset();
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(field_value_match(db.get(), "GP1_DATA_FORMAT_KEY", fvs));
+  int32_t ret = 0;
+  s = db->HSet("GP1_DATA_FORMAT_KEY", "F4", "V4", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db->HDel("GP1_DATA_FORMAT_KEY", {"F1"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  std::string value;
+  s = db->HGet("GP1_DATA_FORMAT_KEY", "F4", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "V4");
+  ASSERT_TRUE(size_match(db.get(), "GP1_DATA_FORMAT_KEY", 3));
+
+  db.reset();
+  DeleteFiles(path.c_str());
+}
+
 int main(int argc, char** argv) {
   if (!pstd::FileExists("./log")) {
     pstd::CreatePath("./log");
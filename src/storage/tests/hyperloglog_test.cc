@@ -182,6 +182,94 @@ TEST_F(HyperLogLogTest, MultipleKeysTest) {
   ASSERT_LT(ratio_nums, static_cast<double>(result / 100) * 5);
 }
 
+TEST_F(HyperLogLogTest, SparseTest) {
+  // a small HLL stays sparse, a large one turns dense, the count is the same
+  bool update;
+  std::vector<std::string> values;
+  for (int32_t i = 0; i < 100; i++) {
+    values.push_back("SPARSE" + std::to_string(i));
+  }
+  s = db.PfAdd("HLL_SPARSE", values, &update);
+  ASSERT_TRUE(s.ok());
+  std::vector<std::string> keys{"HLL_SPARSE"};
+  std::string merged;
+  s = db.PfMerge(keys, merged);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LT(merged.size(), 1024);
+  int64_t result;
+  s = db.PfCount(keys, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(result, 100);
+
+  for (int32_t i = 0; i < 20000; i++) {
+    std::vector<std::string> value{"DENSE" + std::to_string(i)};
+    s = db.PfAdd("HLL_SPARSE", value, &update);
+    ASSERT_TRUE(s.ok());
+  }
+  s = db.PfMerge(keys, merged);
+  ASSERT_TRUE(s.ok());
+  ASSERT_GT(merged.size(), 1 << Storage::kPrecision);
+  s = db.PfCount(keys, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_LT(abs(20100 - result), 20100 / 100 * 5);
+
+  // merging sparse into dense and dense into sparse
+  std::vector<std::string> small_values{"SPARSE1", "SMALL"};
+  s = db.PfAdd("HLL_SMALL", small_values, &update);
+  ASSERT_TRUE(s.ok());
+  int64_t union_result;
+  std::vector<std::string> union_keys{"HLL_SMALL", "HLL_SPARSE"};
+  s = db.PfCount(union_keys, &union_result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_GE(union_result, result);
+  s = db.PfMerge(union_keys, merged);
+  ASSERT_TRUE(s.ok());
+  std::vector<std::string> small_keys{"HLL_SMALL"};
+  s = db.PfCount(small_keys, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(result, union_result);
+}
+
+TEST_F(HyperLogLogTest, CachedCardinalityTest) {
+  // PFADD and PFMERGE cache the count in the value, PFCOUNT leaves it as is
+  bool update;
+  std::vector<std::string> values{"A", "B", "C"};
+  s = db.PfAdd("HLL_CACHED", values, &update);
+  ASSERT_TRUE(s.ok());
+  std::vector<std::string> keys{"HLL_CACHED"};
+  std::string stored;
+  s = db.Get("HLL_CACHED", &stored);
+  ASSERT_TRUE(s.ok());
+  int64_t result;
+  for (int32_t i = 0; i < 3; i++) {
+    s = db.PfCount(keys, &result);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(result, 3);
+  }
+  std::string counted;
+  s = db.Get("HLL_CACHED", &counted);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(counted, stored);
+
+  values = {"D"};
+  s = db.PfAdd("HLL_CACHED", values, &update);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(update);
+  s = db.PfCount(keys, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(result, 4);
+
+  values = {"E", "F"};
+  s = db.PfAdd("HLL_CACHED_OTHER", values, &update);
+  ASSERT_TRUE(s.ok());
+  std::string merged;
+  s = db.PfMerge({"HLL_CACHED", "HLL_CACHED_OTHER"}, merged);
+  ASSERT_TRUE(s.ok());
+  s = db.PfCount(keys, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(result, 6);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
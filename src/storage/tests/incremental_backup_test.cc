@@ -0,0 +1,185 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/backupable.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::Status;
+
+class IncrementalBackupTest : public ::testing::Test {
+ public:
+  IncrementalBackupTest() = default;
+  ~IncrementalBackupTest() override = default;
+
+  void SetUp() override {
+    path = "./db/incremental_backup";
+    dump_path = "./db/incremental_backup_dump";
+    pstd::DeleteDirIfExist(path);
+    pstd::DeleteDirIfExist(dump_path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    db = std::make_unique<storage::Storage>();
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+    pstd::DeleteDirIfExist(dump_path);
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  // writes the keys and flushes them into sst files
+  void WriteKeys(const std::string& prefix, int num) {
+    for (int idx = 0; idx < num; ++idx) {
+      ASSERT_TRUE(db->Set(prefix + std::to_string(idx), "VALUE").ok());
+    }
+    for (int index = 0; index < kInstNum; ++index) {
+      ASSERT_TRUE(db->GetDBByIndex(index)->Flush(rocksdb::FlushOptions()).ok());
+    }
+  }
+
+  Status Backup(const std::string& dir) {
+    std::shared_ptr<storage::BackupEngine> engine;
+    Status s = storage::BackupEngine::Open(db.get(), engine, kInstNum, store_dir());
+    if (s.ok()) {
+      s = engine->SetBackupContent();
+    }
+    if (s.ok()) {
+      s = engine->CreateNewBackup(dir);
+    }
+    return s;
+  }
+
+  std::string store_dir() const { return dump_path + "/sst_store"; }
+
+  static const int kInstNum = 3;
+  std::string path;
+  std::string dump_path;
+  storage::StorageOptions storage_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+static std::vector<std::string> SstFiles(const std::string& dir) {
+  std::vector<std::string> children;
+  std::vector<std::string> ssts;
+  pstd::GetChildren(dir, children);
+  for (const auto& child : children) {
+    if (child.size() > 4 && child.substr(child.size() - 4) == ".sst") {
+      ssts.push_back(child);
+    }
+  }
+  return ssts;
+}
+
+static ino_t Inode(const std::string& path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 ? st.st_ino : 0;
+}
+
+// A second backup links the sst files of the first one from the store
+TEST_F(IncrementalBackupTest, SharedStoreTest) {  // NOLINT
+  WriteKeys("FIRST_", 100);
+  std::string dir1 = dump_path + "/dump1";
+  s = Backup(dir1);
+  ASSERT_TRUE(s.ok());
+  size_t first_store_files = SstFiles(store_dir()).size();
+  ASSERT_GT(first_store_files, 0);
+  for (int index = 0; index < kInstNum; ++index) {
+    ASSERT_TRUE(pstd::FileExists(dir1 + "/" + std::to_string(index) + storage::kBackupManifestSuffix));
+  }
+
+  WriteKeys("SECOND_", 100);
+  std::string dir2 = dump_path + "/dump2";
+  s = Backup(dir2);
+  ASSERT_TRUE(s.ok());
+  // only the new flushes were added, the old files are the same inodes
+  std::vector<std::string> ssts = SstFiles(dir1 + "/0");
+  ASSERT_FALSE(ssts.empty());
+  for (const auto& sst : ssts) {
+    ASSERT_EQ(Inode(dir1 + "/0/" + sst), Inode(dir2 + "/0/" + sst));
+  }
+  ASSERT_EQ(SstFiles(store_dir()).size(), first_store_files + kInstNum);
+
+  // store files left by the dropped backup and the compacted db are purged
+  pstd::DeleteDirIfExist(dir1);
+  ASSERT_TRUE(db->Compact(storage::DataType::kAll, true).ok());
+  s = Backup(dump_path + "/dump3");
+  ASSERT_TRUE(s.ok());
+  for (const auto& sst : SstFiles(store_dir())) {
+    struct stat st;
+    ASSERT_EQ(stat((store_dir() + "/" + sst).c_str(), &st), 0);
+    ASSERT_GT(st.st_nlink, 1);
+  }
+}
+
+// Restore rebuilds every instance from an incremental backup
+TEST_F(IncrementalBackupTest, RestoreTest) {  // NOLINT
+  WriteKeys("FIRST_", 100);
+  s = Backup(dump_path + "/dump1");
+  ASSERT_TRUE(s.ok());
+  WriteKeys("SECOND_", 100);
+  std::string dir2 = dump_path + "/dump2";
+  s = Backup(dir2);
+  ASSERT_TRUE(s.ok());
+
+  std::string restore_path = path + "_restore";
+  pstd::DeleteDirIfExist(restore_path);
+  s = storage::BackupEngine::Restore(dir2, restore_path, kInstNum);
+  ASSERT_TRUE(s.ok());
+  // the instance dirs exist now
+  s = storage::BackupEngine::Restore(dir2, restore_path, kInstNum);
+  ASSERT_TRUE(s.IsInvalidArgument());
+
+  auto restored = std::make_unique<storage::Storage>();
+  s = restored->Open(storage_options, restore_path);
+  ASSERT_TRUE(s.ok());
+  std::string value;
+  ASSERT_TRUE(restored->Get("FIRST_7", &value).ok());
+  ASSERT_TRUE(restored->Get("SECOND_7", &value).ok());
+  ASSERT_EQ(value, "VALUE");
+  restored.reset();
+  storage::DeleteFiles(restore_path.c_str());
+
+  // an sst file that does not match the manifest fails the restore
+  std::string inst_dir = dir2 + "/0";
+  std::vector<std::string> ssts = SstFiles(inst_dir);
+  ASSERT_FALSE(ssts.empty());
+  pstd::DeleteFile(inst_dir + "/" + ssts.front());
+  s = storage::BackupEngine::Restore(dir2, restore_path, kInstNum);
+  ASSERT_TRUE(s.IsCorruption());
+  storage::DeleteFiles(restore_path.c_str());
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("incremental_backup_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,161 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::Slice;
+using storage::Status;
+
+class KeyCountersTest : public ::testing::Test {
+ public:
+  KeyCountersTest() = default;
+  ~KeyCountersTest() override = default;
+
+  void SetUp() override {
+    path = "./db/key_counters";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.key_counters = true;
+    db = std::make_unique<storage::Storage>();
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  std::string path;
+  storage::StorageOptions storage_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+// The counters agree with the full scan
+static bool key_num_match(storage::Storage* const db, const std::vector<uint64_t>& keys,
+                          const std::vector<uint64_t>& expires) {
+  std::vector<storage::KeyInfo> counted;
+  std::vector<storage::KeyInfo> scanned;
+  if (!db->GetKeyNum(&counted).ok() || !db->GetKeyNum(&scanned, true).ok()) {
+    return false;
+  }
+  for (size_t idx = 0; idx < keys.size(); ++idx) {
+    if (counted[idx].keys != keys[idx] || scanned[idx].keys != keys[idx] || counted[idx].expires != expires[idx] ||
+        scanned[idx].expires != expires[idx] || counted[idx].invaild_keys != scanned[idx].invaild_keys) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Set, MSet, Expire, Del of strings and collections
+TEST_F(KeyCountersTest, WriteTest) {  // NOLINT
+  int32_t ret = 0;
+  uint64_t len = 0;
+  for (int idx = 0; idx < 10; ++idx) {
+    s = db->Set("STRING_KEY_" + std::to_string(idx), "v");
+    ASSERT_TRUE(s.ok());
+  }
+  for (int idx = 0; idx < 3; ++idx) {
+    ASSERT_EQ(db->Expire("STRING_KEY_" + std::to_string(idx), 100 * 1000), 1);
+  }
+  s = db->HSet("HASH_KEY_0", "f", "v", &ret);
+  ASSERT_TRUE(s.ok());
+  s = db->HSet("HASH_KEY_1", "f", "v", &ret);
+  ASSERT_TRUE(s.ok());
+  s = db->RPush("LIST_KEY", {"e"}, &len);
+  ASSERT_TRUE(s.ok());
+  s = db->ZAdd("ZSET_KEY", {{1, "m"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db->SAdd("SET_KEY", {"m"}, &ret);
+  ASSERT_TRUE(s.ok());
+  // strings, hashes, lists, zsets, sets
+  ASSERT_TRUE(key_num_match(db.get(), {10, 2, 1, 1, 1}, {3, 0, 0, 0, 0}));
+
+  std::vector<storage::KeyInfo> key_infos;
+  s = db->GetKeyNum(&key_infos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_GT(key_infos[0].avg_ttl, 0);
+  ASSERT_LE(key_infos[0].avg_ttl, 100 * 1000);
+
+  ASSERT_EQ(db->Del({"STRING_KEY_0", "STRING_KEY_9", "HASH_KEY_0"}), 3);
+  s = db->Set("STRING_KEY_1", "v");
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(key_num_match(db.get(), {8, 1, 1, 1, 1}, {1, 0, 0, 0, 0}));
+  s = db->GetKeyNum(&key_infos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(key_infos[1].invaild_keys, 1);
+
+  // a key written twice in one batch is counted once
+  s = db->MSet({{"MSET_KEY", "1"}, {"MSET_KEY", "2"}, {"STRING_KEY_2", "3"}});
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(key_num_match(db.get(), {9, 1, 1, 1, 1}, {0, 0, 0, 0, 0}));
+
+  // a hash taken over by a string after it was deleted
+  s = db->Set("HASH_KEY_0", "v");
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(key_num_match(db.get(), {10, 1, 1, 1, 1}, {0, 0, 0, 0, 0}));
+}
+
+// Keys written with the counters disabled are counted once they are enabled
+TEST_F(KeyCountersTest, ReconcileTest) {  // NOLINT
+  int32_t ret = 0;
+  db.reset();
+  storage_options.key_counters = false;
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  for (int idx = 0; idx < 5; ++idx) {
+    s = db->Set("STRING_KEY_" + std::to_string(idx), "v");
+    ASSERT_TRUE(s.ok());
+  }
+  s = db->HSet("HASH_KEY", "f", "v", &ret);
+  ASSERT_TRUE(s.ok());
+
+  db.reset();
+  storage_options.key_counters = true;
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(key_num_match(db.get(), {5, 1, 0, 0, 0}, {0, 0, 0, 0, 0}));
+
+  s = db->Set("STRING_KEY_5", "v");
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->Del({"HASH_KEY"}), 1);
+  s = db->Compact(storage::DataType::kAll, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(key_num_match(db.get(), {6, 0, 0, 0, 0}, {0, 0, 0, 0, 0}));
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("key_counters_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -5151,6 +5151,27 @@ TEST_F(KeysTest, DelTest) {
   // Strings
   s = db.Get("DEL_KEY", &value);
   ASSERT_TRUE(s.IsNotFound());
+
+  // Multiple types spread over instances, duplicated and missing keys
+  s = db.Set("DEL_MULTI_STRING_KEY", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db.HSet("DEL_MULTI_HASH_KEY", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("DEL_MULTI_SET_KEY", {"MEMBER"}, &ret);
+  ASSERT_TRUE(s.ok());
+  uint64_t llen = 0;
+  s = db.RPush("DEL_MULTI_LIST_KEY", {"NODE"}, &llen);
+  ASSERT_TRUE(s.ok());
+  s = db.ZAdd("DEL_MULTI_ZSET_KEY", {{1, "MEMBER"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  std::vector<std::string> multi_keys{"DEL_MULTI_STRING_KEY", "DEL_MULTI_HASH_KEY", "DEL_MULTI_SET_KEY",
+                                      "DEL_MULTI_LIST_KEY",   "DEL_MULTI_ZSET_KEY", "DEL_MULTI_STRING_KEY",
+                                      "DEL_MULTI_NOT_EXIST_KEY"};
+  ret = db.Del(multi_keys);
+  ASSERT_EQ(ret, 5);
+  ASSERT_EQ(db.Exists(multi_keys), 0);
+  ret = db.Del(multi_keys);
+  ASSERT_EQ(ret, 0);
 }
 
 // Exists
@@ -13,6 +13,7 @@
 #include "src/coding.h"
 #include "src/base_key_format.h"
 #include "src/base_data_key_format.h"
+#include "src/base_data_value_format.h"
 #include "src/zsets_data_key_format.h"
 #include "src/lists_data_key_format.h"
 #include "storage/storage_define.h"
@@ -58,6 +59,58 @@ TEST(KVFormatTest, BaseDataKeyFormat) {
   ASSERT_EQ(pbmk.Version(), version);
 }
 
+TEST(KVFormatTest, BaseDataKeyFormatV2) {
+  rocksdb::Slice slice_key("\u0000\u0001base_data_key\u0000", 16);
+  rocksdb::Slice slice_data("\u0000\u0001data\u0000", 7);
+  uint64_t version = 1701848429;
+
+  BaseDataKey bdk(slice_key, version, slice_data, kDataFormatV2);
+  std::string expect_enc(1, kDataFormatV2Tag);
+  expect_enc.append("\u0000\u0001\u0001base_data_key\u0000\u0001\u0000\u0000", 20);
+  char dst[9];
+  EncodeFixed64(dst, version);
+  expect_enc.append(dst, 8);
+  expect_enc.append("\u0000\u0001data\u0000", 7);
+  // no reserve2, the seek key and the full key are the same
+  ASSERT_EQ(bdk.EncodeSeekKey(), Slice(expect_enc));
+  rocksdb::Slice key_enc = bdk.Encode();
+  ASSERT_EQ(key_enc, Slice(expect_enc));
+  ASSERT_TRUE(IsDataFormatV2Key(key_enc));
+
+  ParsedBaseDataKey pbmk(key_enc);
+  ASSERT_EQ(pbmk.Key(), slice_key);
+  ASSERT_EQ(pbmk.Data(), slice_data);
+  ASSERT_EQ(pbmk.Version(), version);
+
+  // v1 keys are still parsed the same way
+  BaseDataKey v1_bdk(slice_key, version, slice_data);
+  ASSERT_FALSE(IsDataFormatV2Key(v1_bdk.Encode()));
+  ParsedBaseDataKey v1_pbmk(v1_bdk.Encode());
+  ASSERT_EQ(v1_pbmk.Key(), slice_key);
+  ASSERT_EQ(v1_pbmk.Data(), slice_data);
+  ASSERT_EQ(v1_pbmk.Version(), version);
+}
+
+TEST(KVFormatTest, BaseDataValueFormat) {
+  for (const std::string& user_value : {std::string(), std::string("value"), std::string(1, kDataFormatV2Tag)}) {
+    BaseDataValue v1_value(user_value);
+    std::string v1_enc = v1_value.Encode().ToString();
+    ASSERT_EQ(v1_enc.size(), user_value.size() + kSuffixReserveLength + kTimestampLength);
+    ParsedBaseDataValue v1_parsed(&v1_enc);
+    ASSERT_EQ(v1_parsed.Format(), kDataFormatV1);
+    ASSERT_EQ(v1_parsed.UserValue(), Slice(user_value));
+
+    BaseDataValue v2_value(user_value, kDataFormatV2);
+    std::string v2_enc = v2_value.Encode().ToString();
+    ASSERT_EQ(v2_enc.size(), user_value.size() + kDataFormatTagLength);
+    ParsedBaseDataValue v2_parsed(&v2_enc);
+    ASSERT_EQ(v2_parsed.Format(), kDataFormatV2);
+    ASSERT_EQ(v2_parsed.UserValue(), Slice(user_value));
+    v2_parsed.StripSuffix();
+    ASSERT_EQ(v2_enc, user_value);
+  }
+}
+
 TEST(KVFormatTest, ZsetsScoreKeyFormat) {
   rocksdb::Slice slice_key("\u0000\u0001base_data_key\u0000", 16);
   rocksdb::Slice slice_data("\u0000\u0001data\u0000", 7);
@@ -0,0 +1,171 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::Slice;
+using storage::Status;
+
+// collections of at least this many members are range deleted
+static const int32_t kThreshold = 50;
+
+class LazyfreeRangeTest : public ::testing::Test {
+ public:
+  LazyfreeRangeTest() = default;
+  ~LazyfreeRangeTest() override = default;
+
+  void SetUp() override {
+    path = "./db/lazyfree_range";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.lazyfree_range_threshold = kThreshold;
+    storage_options.zset_rank_index_threshold = 16;
+    db = std::make_unique<storage::Storage>();
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  std::string path;
+  storage::StorageOptions storage_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+static bool wait_reclaimed(storage::Storage* const db) {
+  for (int round = 0; round < 100 && db->GetPendingReclaimRanges() != 0; ++round) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  return db->GetPendingReclaimRanges() == 0;
+}
+
+// Member keys left in the hash data cf of every instance
+static int64_t hash_data_keys(storage::Storage* const db) {
+  int64_t count = 0;
+  rocksdb::ReadOptions read_options;
+  read_options.total_order_seek = true;
+  for (int idx = 0; idx < 3; ++idx) {
+    auto handles = db->GetHashCFHandles(idx);
+    std::unique_ptr<rocksdb::Iterator> iter(db->GetDBByIndex(idx)->NewIterator(read_options, handles[1]));
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
+    }
+  }
+  return count;
+}
+
+static void hset_fields(storage::Storage* const db, const Slice& key, int32_t num) {
+  int32_t ret = 0;
+  for (int32_t idx = 0; idx < num; ++idx) {
+    Status s = db->HSet(key, "FIELD_" + std::to_string(idx), "VALUE", &ret);
+    ASSERT_TRUE(s.ok());
+  }
+}
+
+// The member keys of a big hash go with its DEL, the ones of small hashes
+// and of live hashes stay
+TEST_F(LazyfreeRangeTest, HashesTest) {  // NOLINT
+  hset_fields(db.get(), "BIG_HASH", 100);
+  hset_fields(db.get(), "BIG_HASH_KEPT", 100);
+  hset_fields(db.get(), "SMALL_HASH", 10);
+  ASSERT_EQ(hash_data_keys(db.get()), 210);
+
+  ASSERT_EQ(db->Del({"BIG_HASH", "SMALL_HASH"}), 2);
+  ASSERT_TRUE(wait_reclaimed(db.get()));
+  ASSERT_EQ(hash_data_keys(db.get()), 110);
+
+  // the key written again lives under a new version out of the range
+  hset_fields(db.get(), "BIG_HASH", 60);
+  ASSERT_EQ(db->Del({"BIG_HASH_KEPT"}), 1);
+  ASSERT_TRUE(wait_reclaimed(db.get()));
+  int32_t len = 0;
+  s = db->HLen("BIG_HASH", &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, 60);
+  ASSERT_EQ(hash_data_keys(db.get()), 70);
+}
+
+// Score and rank keys of the old version go, the new version keeps its own
+TEST_F(LazyfreeRangeTest, ZsetsTest) {  // NOLINT
+  int32_t ret = 0;
+  std::vector<storage::ScoreMember> score_members;
+  for (int32_t idx = 0; idx < 100; ++idx) {
+    score_members.push_back({static_cast<double>(idx - 50), "MEMBER_" + std::to_string(idx)});
+  }
+  s = db->ZAdd("BIG_ZSET", score_members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->Del({"BIG_ZSET"}), 1);
+
+  s = db->ZAdd("BIG_ZSET", {{-1000, "NEW_LOW"}, {0, "NEW_MID"}, {1000, "NEW_HIGH"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(wait_reclaimed(db.get()));
+
+  s = db->ZCard("BIG_ZSET", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 3);
+  std::vector<storage::ScoreMember> range;
+  s = db->ZRange("BIG_ZSET", 0, -1, &range);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(range.size(), 3);
+  ASSERT_EQ(range[0].member, "NEW_LOW");
+  ASSERT_EQ(range[2].member, "NEW_HIGH");
+}
+
+// Sets go the same way
+TEST_F(LazyfreeRangeTest, SetsTest) {  // NOLINT
+  int32_t ret = 0;
+  std::vector<std::string> members;
+  for (int32_t idx = 0; idx < 100; ++idx) {
+    members.push_back("MEMBER_" + std::to_string(idx));
+  }
+  s = db->SAdd("BIG_SET", members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->Del({"BIG_SET"}), 1);
+  ASSERT_TRUE(wait_reclaimed(db.get()));
+  s = db->SCard("BIG_SET", &ret);
+  ASSERT_TRUE(s.IsNotFound());
+  s = db->SAdd("BIG_SET", {"MEMBER_0"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db->SCard("BIG_SET", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("lazyfree_range_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
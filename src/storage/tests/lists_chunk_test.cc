@@ -0,0 +1,320 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "src/base_data_value_format.h"
+#include "src/lists_chunk.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::Slice;
+using storage::Status;
+
+using ListModel = std::deque<std::string>;
+
+class ListsChunkTest : public ::testing::Test {
+ public:
+  ListsChunkTest() = default;
+  ~ListsChunkTest() override = default;
+
+  void SetUp() override {
+    std::string path = "./db/lists_chunk";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.list_chunk_size = 4;
+    s = db.Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    std::string path = "./db/lists_chunk";
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  storage::StorageOptions storage_options;
+  storage::Storage db;
+  storage::Status s;
+};
+
+static std::string ChunkElement(const std::string& prefix, int idx) { return prefix + std::to_string(idx); }
+
+// Compare LLen, LRange and LIndex of key with the model
+static bool list_match(storage::Storage* const db, const Slice& key, const ListModel& model) {
+  uint64_t len = 0;
+  Status s = db->LLen(key, &len);
+  if (model.empty()) {
+    return s.IsNotFound();
+  }
+  if (!s.ok() || len != model.size()) {
+    return false;
+  }
+  std::vector<std::string> elements;
+  if (!db->LRange(key, 0, -1, &elements).ok() || elements != std::vector<std::string>(model.begin(), model.end())) {
+    return false;
+  }
+  auto size = static_cast<int64_t>(model.size());
+  for (int64_t idx = 0; idx < size; ++idx) {
+    std::string element;
+    if (!db->LIndex(key, idx, &element).ok() || element != model[idx]) {
+      return false;
+    }
+    if (!db->LIndex(key, idx - size, &element).ok() || element != model[idx]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Element count of the largest chunk in the list data cf of every instance
+static uint32_t max_chunk_count(storage::Storage* const db) {
+  uint32_t max_count = 0;
+  rocksdb::ReadOptions read_options;
+  read_options.total_order_seek = true;
+  for (int idx = 0; idx < 3; ++idx) {
+    auto handles = db->GetListCFHandles(idx);
+    std::unique_ptr<rocksdb::Iterator> iter(db->GetDBByIndex(idx)->NewIterator(read_options, handles[1]));
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      storage::ParsedBaseDataValue parsed_value(iter->value());
+      max_count = std::max(max_count, storage::ListsChunk::DecodeCount(parsed_value.UserValue()));
+    }
+  }
+  return max_count;
+}
+
+// Push, Pop
+TEST_F(ListsChunkTest, PushPopTest) {  // NOLINT
+  ListModel model;
+  uint64_t ret = 0;
+  for (int idx = 0; idx < 30; ++idx) {
+    s = db.RPush("CHUNK_KEY", {ChunkElement("r", idx)}, &ret);
+    ASSERT_TRUE(s.ok());
+    model.push_back(ChunkElement("r", idx));
+    s = db.LPush("CHUNK_KEY", {ChunkElement("l", idx), ChunkElement("l", idx + 100)}, &ret);
+    ASSERT_TRUE(s.ok());
+    model.push_front(ChunkElement("l", idx));
+    model.push_front(ChunkElement("l", idx + 100));
+    ASSERT_EQ(ret, model.size());
+  }
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+
+  std::vector<std::string> elements;
+  s = db.LPop("CHUNK_KEY", 7, &elements);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(elements, std::vector<std::string>(model.begin(), model.begin() + 7));
+  model.erase(model.begin(), model.begin() + 7);
+  elements.clear();
+  s = db.RPop("CHUNK_KEY", 5, &elements);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(elements.size(), 5);
+  for (const auto& element : elements) {
+    ASSERT_EQ(element, model.back());
+    model.pop_back();
+  }
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+
+  std::string element;
+  s = db.RPoplpush("CHUNK_KEY", "CHUNK_KEY", &element);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(element, model.back());
+  model.push_front(model.back());
+  model.pop_back();
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+
+  ListModel dst_model;
+  s = db.RPoplpush("CHUNK_KEY", "CHUNK_DST_KEY", &element);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(element, model.back());
+  dst_model.push_front(model.back());
+  model.pop_back();
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+  ASSERT_TRUE(list_match(&db, "CHUNK_DST_KEY", dst_model));
+
+  elements.clear();
+  s = db.LPop("CHUNK_KEY", static_cast<int64_t>(model.size()) + 10, &elements);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(elements, std::vector<std::string>(model.begin(), model.end()));
+  model.clear();
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+}
+
+// LInsert, LRem, LSet, LTrim
+TEST_F(ListsChunkTest, ModifyTest) {  // NOLINT
+  ListModel model;
+  uint64_t ret = 0;
+  std::vector<std::string> values;
+  for (int idx = 0; idx < 40; ++idx) {
+    values.push_back(ChunkElement(idx % 5 == 0 ? "x" : "e", idx % 5 == 0 ? 0 : idx));
+    model.push_back(values.back());
+  }
+  s = db.RPush("CHUNK_KEY", values, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 40);
+
+  // grow one chunk past its size so that it splits
+  int64_t len = 0;
+  for (int idx = 0; idx < 10; ++idx) {
+    s = db.LInsert("CHUNK_KEY", storage::After, "e12", ChunkElement("i", idx), &len);
+    ASSERT_TRUE(s.ok());
+    model.insert(std::find(model.begin(), model.end(), "e12") + 1, ChunkElement("i", idx));
+    ASSERT_EQ(len, model.size());
+  }
+  s = db.LInsert("CHUNK_KEY", storage::Before, "e1", "b", &len);
+  ASSERT_TRUE(s.ok());
+  model.insert(std::find(model.begin(), model.end(), "e1"), "b");
+  s = db.LInsert("CHUNK_KEY", storage::Before, "missing", "b", &len);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(len, -1);
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+
+  // from the tail, then all of the rest
+  s = db.LRem("CHUNK_KEY", -3, "x0", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 3);
+  for (int cnt = 0; cnt < 3; ++cnt) {
+    model.erase(std::find(model.rbegin(), model.rend(), "x0").base() - 1);
+  }
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+  s = db.LRem("CHUNK_KEY", 0, "x0", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 5);
+  model.erase(std::remove(model.begin(), model.end(), "x0"), model.end());
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+
+  s = db.LSet("CHUNK_KEY", 17, "s17");
+  ASSERT_TRUE(s.ok());
+  model[17] = "s17";
+  s = db.LSet("CHUNK_KEY", -2, "s-2");
+  ASSERT_TRUE(s.ok());
+  model[model.size() - 2] = "s-2";
+  s = db.LSet("CHUNK_KEY", 1000, "none");
+  ASSERT_TRUE(s.IsCorruption());
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+
+  std::vector<std::string> elements;
+  s = db.LRange("CHUNK_KEY", 5, 13, &elements);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(elements, std::vector<std::string>(model.begin() + 5, model.begin() + 14));
+
+  s = db.LTrim("CHUNK_KEY", 3, -6);
+  ASSERT_TRUE(s.ok());
+  model.erase(model.end() - 5, model.end());
+  model.erase(model.begin(), model.begin() + 3);
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+
+  s = db.LTrim("CHUNK_KEY", 10, 5);
+  ASSERT_TRUE(s.ok());
+  model.clear();
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+}
+
+// Inserts at one pivot use up the chunk ids next to it
+TEST_F(ListsChunkTest, InsertSplitTest) {  // NOLINT
+  ListModel model;
+  uint64_t ret = 0;
+  s = db.RPush("CHUNK_KEY", {"a", "pivot", "b", "c", "d", "e", "f", "g", "h"}, &ret);
+  ASSERT_TRUE(s.ok());
+  model = {"a", "pivot", "b", "c", "d", "e", "f", "g", "h"};
+
+  int64_t len = 0;
+  for (int idx = 0; idx < 40 * 4; ++idx) {
+    s = db.LInsert("CHUNK_KEY", storage::After, "pivot", ChunkElement("i", idx), &len);
+    ASSERT_TRUE(s.ok());
+    model.insert(model.begin() + 2, ChunkElement("i", idx));
+    ASSERT_EQ(len, model.size());
+    ASSERT_LE(max_chunk_count(&db), static_cast<uint32_t>(storage_options.list_chunk_size));
+  }
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+
+  // and the ones before it
+  for (int idx = 0; idx < 40 * 4; ++idx) {
+    s = db.LInsert("CHUNK_KEY", storage::Before, "pivot", ChunkElement("j", idx), &len);
+    ASSERT_TRUE(s.ok());
+    model.insert(std::find(model.begin(), model.end(), "pivot"), ChunkElement("j", idx));
+    ASSERT_LE(max_chunk_count(&db), static_cast<uint32_t>(storage_options.list_chunk_size));
+  }
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+
+  uint64_t pushed = 0;
+  s = db.RPush("CHUNK_KEY", {"tail"}, &pushed);
+  ASSERT_TRUE(s.ok());
+  model.push_back("tail");
+  s = db.LPush("CHUNK_KEY", {"head"}, &pushed);
+  ASSERT_TRUE(s.ok());
+  model.push_front("head");
+  ASSERT_EQ(pushed, model.size());
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", model));
+}
+
+// Plain lists, emptied chunked lists
+TEST_F(ListsChunkTest, EncodingTest) {  // NOLINT
+  uint64_t ret = 0;
+  // RPoplpush between lists of one entry per element
+  storage::Storage plain_db;
+  std::string path = "./db/lists_chunk_plain";
+  pstd::DeleteDirIfExist(path);
+  mkdir(path.c_str(), 0755);
+  storage::StorageOptions plain_options;
+  plain_options.options.create_if_missing = true;
+  s = plain_db.Open(plain_options, path);
+  ASSERT_TRUE(s.ok());
+  ListModel model;
+  for (int idx = 0; idx < 10; ++idx) {
+    s = plain_db.RPush("PLAIN_KEY", {ChunkElement("p", idx)}, &ret);
+    ASSERT_TRUE(s.ok());
+    model.push_back(ChunkElement("p", idx));
+  }
+  ListModel dst_model;
+  std::string element;
+  s = plain_db.RPoplpush("PLAIN_KEY", "PLAIN_DST_KEY", &element);
+  ASSERT_TRUE(s.ok());
+  dst_model.push_back(model.back());
+  model.pop_back();
+  ASSERT_TRUE(list_match(&plain_db, "PLAIN_KEY", model));
+  ASSERT_TRUE(list_match(&plain_db, "PLAIN_DST_KEY", dst_model));
+  storage::DeleteFiles(path.c_str());
+
+  // an emptied chunked list starts over
+  ListModel chunked_model;
+  s = db.RPush("CHUNK_KEY", {"a", "b", "c", "d", "e", "f"}, &ret);
+  ASSERT_TRUE(s.ok());
+  std::vector<std::string> elements;
+  s = db.RPop("CHUNK_KEY", 6, &elements);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", chunked_model));
+  s = db.LPush("CHUNK_KEY", {"g", "h"}, &ret);
+  ASSERT_TRUE(s.ok());
+  chunked_model = {"h", "g"};
+  ASSERT_TRUE(list_match(&db, "CHUNK_KEY", chunked_model));
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("lists_chunk_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,100 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+
+#include "src/meta_version_cache.h"
+#include "storage/storage.h"
+
+using namespace storage;
+
+TEST(MetaVersionCacheTest, DecideTest) {
+  uint64_t now = pstd::NowMillis();
+  MetaVersionEntry entry;
+
+  // ***************** Nothing known *****************
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 100, now), MetaVersionCache::kMiss);
+
+  // ***************** Dropped version *****************
+  entry.dropped_version = 100;
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 99, now), MetaVersionCache::kDrop);
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 100, now), MetaVersionCache::kDrop);
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 101, now), MetaVersionCache::kMiss);
+
+  // ***************** Live meta *****************
+  entry.version = 101;
+  entry.update_time = now;
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 101, now), MetaVersionCache::kKeep);
+  entry.etime = now + 1000;
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 101, now), MetaVersionCache::kKeep);
+
+  // the meta may have expired since, ask the meta cf again
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 101, now + 1000), MetaVersionCache::kMiss);
+
+  // the keep info is too old to trust
+  entry.etime = 0;
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 101, now + MetaVersionCache::kKeepValidMillis), MetaVersionCache::kMiss);
+}
+
+TEST(MetaVersionCacheTest, UpdateTest) {
+  MetaVersionCache cache(1024);
+  MetaVersionEntry entry;
+  uint64_t now = pstd::NowMillis();
+
+  ASSERT_FALSE(cache.Lookup("key", &entry));
+
+  // ***************** Live meta *****************
+  cache.UpdateMeta("key", 100, 0);
+  ASSERT_TRUE(cache.Lookup("key", &entry));
+  ASSERT_EQ(entry.dropped_version, 99);
+  ASSERT_EQ(entry.version, 100);
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 99, now), MetaVersionCache::kDrop);
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 100, now), MetaVersionCache::kKeep);
+
+  // ***************** Deleted *****************
+  cache.AddDroppedVersion("key", 100);
+  ASSERT_TRUE(cache.Lookup("key", &entry));
+  ASSERT_EQ(entry.dropped_version, 100);
+  ASSERT_EQ(entry.version, 0);
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 100, now), MetaVersionCache::kDrop);
+
+  // dropped version never goes back
+  cache.AddDroppedVersion("key", 50);
+  cache.UpdateMeta("key", 80, 0);
+  ASSERT_TRUE(cache.Lookup("key", &entry));
+  ASSERT_EQ(entry.dropped_version, 100);
+  ASSERT_EQ(entry.version, 0);
+
+  // ***************** Expired meta *****************
+  cache.UpdateMeta("key", 200, 1);
+  ASSERT_TRUE(cache.Lookup("key", &entry));
+  ASSERT_EQ(entry.dropped_version, 200);
+  ASSERT_EQ(entry.version, 0);
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 200, now), MetaVersionCache::kDrop);
+  ASSERT_EQ(MetaVersionCache::Decide(entry, 201, now), MetaVersionCache::kMiss);
+
+  cache.Clear();
+  ASSERT_EQ(cache.Size(), 0);
+  ASSERT_FALSE(cache.Lookup("key", &entry));
+}
+
+TEST(MetaVersionCacheTest, EvictTest) {
+  // 16 shards with one entry each
+  MetaVersionCache cache(16);
+  for (int idx = 0; idx < 1000; ++idx) {
+    cache.AddDroppedVersion("key_" + std::to_string(idx), idx);
+  }
+  ASSERT_LE(cache.Size(), 16);
+  ASSERT_GT(cache.Size(), 0);
+
+  MetaVersionEntry entry;
+  ASSERT_TRUE(cache.Lookup("key_999", &entry));
+  ASSERT_EQ(entry.dropped_version, 999);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,158 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "pstd/include/pika_codis_slot.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::DataType;
+using storage::Slice;
+using storage::Status;
+
+static const int kSlotNum = 1024;
+
+class ParallelOpenTest : public ::testing::Test {
+ public:
+  ParallelOpenTest() = default;
+  ~ParallelOpenTest() override = default;
+
+  void SetUp() override {
+    path = "./db/parallel_open";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.open_worker_num = 2;
+    db = std::make_unique<storage::Storage>(4, kSlotNum, true);
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  void Reopen(bool lazy_open) {
+    db.reset();
+    storage_options.lazy_open = lazy_open;
+    db = std::make_unique<storage::Storage>(4, kSlotNum, true);
+    s = db->Open(storage_options, path);
+  }
+
+  std::string path;
+  storage::StorageOptions storage_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+static std::string OpenKey(int idx) { return "OPEN_KEY_" + std::to_string(idx); }
+
+// Every instance is open once Open returns, the WAL is replayed in each
+TEST_F(ParallelOpenTest, OpenTest) {  // NOLINT
+  int32_t ret = 0;
+  for (int idx = 0; idx < 200; ++idx) {
+    s = db->Set(OpenKey(idx), std::to_string(idx));
+    ASSERT_TRUE(s.ok());
+  }
+  s = db->SAdd("OPEN_SET", {"M1", "M2"}, &ret);
+  ASSERT_TRUE(s.ok());
+
+  Reopen(false);
+  ASSERT_TRUE(s.ok());
+  for (size_t inst_id = 0; inst_id < 4; ++inst_id) {
+    ASSERT_TRUE(db->IsInstanceOpened(inst_id));
+  }
+  std::string value;
+  for (int idx = 0; idx < 200; ++idx) {
+    s = db->Get(OpenKey(idx), &value);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(value, std::to_string(idx));
+  }
+  int32_t card = 0;
+  s = db->SCard("OPEN_SET", &card);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(card, 2);
+
+  std::string info;
+  db->GetRocksDBInfo(info);
+  ASSERT_NE(info.find("instance3_open_micros:"), std::string::npos);
+  ASSERT_NE(info.find("instance3_wal_replay_micros:"), std::string::npos);
+}
+
+// Commands wait for the instances of their keys, the ones walking every
+// instance for all of them
+TEST_F(ParallelOpenTest, LazyOpenTest) {  // NOLINT
+  for (int idx = 0; idx < 200; ++idx) {
+    s = db->Set(OpenKey(idx), std::to_string(idx));
+    ASSERT_TRUE(s.ok());
+  }
+  // instance 0 keeps the table that moves the slot, and routes the key
+  uint32_t slot_id = GetSlotID(kSlotNum, OpenKey(0));
+  uint32_t dst_inst = (db->GetSlotInstance(slot_id) + 1) % 4;
+  s = db->MigrateSlots({slot_id}, dst_inst);
+  ASSERT_TRUE(s.ok());
+
+  Reopen(true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->GetSlotInstance(slot_id), dst_inst);
+  std::string value;
+  s = db->Get(OpenKey(0), &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "0");
+  s = db->Set(OpenKey(200), "200");
+  ASSERT_TRUE(s.ok());
+
+  std::vector<std::string> keys;
+  s = db->Keys(DataType::kStrings, "OPEN_KEY_*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(keys.size(), 201);
+  for (size_t inst_id = 0; inst_id < 4; ++inst_id) {
+    ASSERT_TRUE(db->IsInstanceOpened(inst_id));
+  }
+  std::string info;
+  db->GetRocksDBInfo(info);
+  ASSERT_EQ(info.find("open_state:loading"), std::string::npos);
+}
+
+// An error of the slot table comes out of Open, lazy or not
+TEST_F(ParallelOpenTest, SlotTableErrorTest) {  // NOLINT
+  uint32_t slot_id = GetSlotID(kSlotNum, OpenKey(0));
+  s = db->MigrateSlots({slot_id}, 3);
+  ASSERT_TRUE(s.ok());
+
+  db.reset();
+  storage_options.lazy_open = true;
+  db = std::make_unique<storage::Storage>(3, kSlotNum, true);
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.IsInvalidArgument());
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("parallel_open_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,136 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::DataType;
+using storage::Slice;
+using storage::Status;
+
+class ParallelScanTest : public ::testing::Test {
+ public:
+  ParallelScanTest() = default;
+  ~ParallelScanTest() override = default;
+
+  void SetUp() override {
+    std::string path = "./db/parallel_scan";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.scan_worker_num = 4;
+    s = db.Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    std::string path = "./db/parallel_scan";
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  storage::StorageOptions storage_options;
+  storage::Storage db;
+  storage::Status s;
+};
+
+static std::string ScanKey(const std::string& prefix, int idx) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%s_%04d", prefix.c_str(), idx);
+  return buf;
+}
+
+// Keys, GetKeyNum
+TEST_F(ParallelScanTest, KeysTest) {  // NOLINT
+  int32_t ret = 0;
+  std::vector<std::string> expected;
+  for (int idx = 0; idx < 300; ++idx) {
+    s = db.Set(ScanKey("STRING", idx), "v");
+    ASSERT_TRUE(s.ok());
+    expected.push_back(ScanKey("STRING", idx));
+  }
+  for (int idx = 0; idx < 50; ++idx) {
+    s = db.SAdd(ScanKey("SET", idx), {"m"}, &ret);
+    ASSERT_TRUE(s.ok());
+  }
+
+  // sorted across the instances, as a single merging iterator returned them
+  std::vector<std::string> keys;
+  s = db.Keys(DataType::kStrings, "*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(keys, expected);
+  s = db.Keys(DataType::kAll, "SET_00*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(keys.size(), 10);
+  ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+
+  std::vector<storage::KeyInfo> key_infos;
+  s = db.GetKeyNum(&key_infos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(key_infos[0].keys, 300);
+  ASSERT_EQ(key_infos[4].keys, 50);
+}
+
+// PKPatternMatchDelWithRemoveKeys with a budget shared by the instances
+TEST_F(ParallelScanTest, PatternDelTest) {  // NOLINT
+  for (int idx = 0; idx < 200; ++idx) {
+    s = db.Set(ScanKey("DEL", idx), "v");
+    ASSERT_TRUE(s.ok());
+    s = db.Set(ScanKey("KEEP", idx), "v");
+    ASSERT_TRUE(s.ok());
+  }
+
+  int64_t delete_count = 0;
+  std::vector<std::string> remove_keys;
+  s = db.PKPatternMatchDelWithRemoveKeys("DEL_*", &delete_count, &remove_keys, 150);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(delete_count, 150);
+  ASSERT_EQ(remove_keys.size(), 150);
+  ASSERT_EQ(std::set<std::string>(remove_keys.begin(), remove_keys.end()).size(), 150);
+
+  std::vector<std::string> keys;
+  s = db.Keys(DataType::kStrings, "DEL_*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(keys.size(), 50);
+  for (const auto& key : remove_keys) {
+    ASSERT_FALSE(std::binary_search(keys.begin(), keys.end(), key));
+  }
+
+  remove_keys.clear();
+  s = db.PKPatternMatchDelWithRemoveKeys("DEL_*", &delete_count, &remove_keys, 1000);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(delete_count, 50);
+  s = db.Keys(DataType::kStrings, "*", &keys);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(keys.size(), 200);
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("parallel_scan_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,272 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::Slice;
+using storage::Status;
+
+using SetModel = std::set<std::string>;
+
+class SetsInlineTest : public ::testing::Test {
+ public:
+  SetsInlineTest() = default;
+  ~SetsInlineTest() override = default;
+
+  void SetUp() override {
+    std::string path = "./db/sets_inline";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.set_max_inline_entries = 8;
+    storage_options.set_max_inline_value = 16;
+    s = db.Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    std::string path = "./db/sets_inline";
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  storage::StorageOptions storage_options;
+  storage::Storage db;
+  storage::Status s;
+};
+
+static std::string InlineMember(int idx) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "m%03d", idx);
+  return buf;
+}
+
+// Compare SCard, SMembers, SIsmember and SRandmember of key with the model
+static bool set_match(storage::Storage* const db, const Slice& key, const SetModel& model) {
+  int32_t card = 0;
+  Status s = db->SCard(key, &card);
+  if (model.empty()) {
+    return s.IsNotFound();
+  }
+  if (!s.ok() || card != static_cast<int32_t>(model.size())) {
+    return false;
+  }
+  std::vector<std::string> members;
+  if (!db->SMembers(key, &members).ok() || members != std::vector<std::string>(model.begin(), model.end())) {
+    return false;
+  }
+  int32_t ret = 0;
+  for (const auto& member : model) {
+    if (!db->SIsmember(key, member, &ret).ok() || ret != 1) {
+      return false;
+    }
+  }
+  if (!db->SIsmember(key, "missing", &ret).IsNotFound() || ret != 0) {
+    return false;
+  }
+  members.clear();
+  if (!db->SRandmember(key, static_cast<int32_t>(model.size()) + 1, &members).ok() ||
+      members.size() != model.size()) {
+    return false;
+  }
+  return std::all_of(members.begin(), members.end(),
+                     [&model](const std::string& member) { return model.count(member) != 0; });
+}
+
+// SAdd, SRem, SPop, SMove
+TEST_F(SetsInlineTest, WriteTest) {  // NOLINT
+  SetModel model;
+  int32_t ret = 0;
+  for (int idx = 0; idx < 6; ++idx) {
+    s = db.SAdd("INLINE_KEY", {InlineMember(idx)}, &ret);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(ret, 1);
+    model.insert(InlineMember(idx));
+  }
+  s = db.SAdd("INLINE_KEY", {InlineMember(0), InlineMember(1)}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+
+  // the ninth member moves the set to member keys
+  s = db.SAdd("INLINE_KEY", {InlineMember(6), InlineMember(7), InlineMember(8)}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 3);
+  model.insert({InlineMember(6), InlineMember(7), InlineMember(8)});
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+
+  // and back at half of the limit
+  s = db.SRem("INLINE_KEY", {InlineMember(0), InlineMember(1), InlineMember(2), InlineMember(3), InlineMember(4),
+                             "missing"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 5);
+  for (int idx = 0; idx < 5; ++idx) {
+    model.erase(InlineMember(idx));
+  }
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+
+  // a long member moves it too
+  std::string long_member(32, 'x');
+  s = db.SAdd("INLINE_KEY", {long_member}, &ret);
+  ASSERT_TRUE(s.ok());
+  model.insert(long_member);
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+  s = db.SRem("INLINE_KEY", {long_member}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  model.erase(long_member);
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+
+  // between an inline set and a new one
+  s = db.SMove("INLINE_KEY", "INLINE_DST_KEY", InlineMember(5), &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  model.erase(InlineMember(5));
+  SetModel dst_model{InlineMember(5)};
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+  ASSERT_TRUE(set_match(&db, "INLINE_DST_KEY", dst_model));
+  s = db.SMove("INLINE_KEY", "INLINE_DST_KEY", "missing", &ret);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(ret, 0);
+
+  std::vector<std::string> popped;
+  s = db.SPop("INLINE_KEY", &popped, 2);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(popped.size(), 2);
+  for (const auto& member : popped) {
+    ASSERT_EQ(model.erase(member), 1);
+  }
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+  popped.clear();
+  s = db.SPop("INLINE_KEY", &popped, 10);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(popped.size(), model.size());
+  model.clear();
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+
+  // created from scratch past the limit
+  std::vector<std::string> members;
+  for (int idx = 0; idx < 12; ++idx) {
+    members.push_back(InlineMember(idx));
+    model.insert(InlineMember(idx));
+  }
+  s = db.SAdd("INLINE_KEY", members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 12);
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+}
+
+// Expire, Del, recreate
+TEST_F(SetsInlineTest, LifecycleTest) {  // NOLINT
+  SetModel model;
+  int32_t ret = 0;
+  s = db.SAdd("INLINE_KEY", {"a", "b"}, &ret);
+  ASSERT_TRUE(s.ok());
+  model = {"a", "b"};
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+
+  std::vector<std::string> members;
+  int64_t ttl = 0;
+  ASSERT_EQ(db.Expire("INLINE_KEY", 100 * 1000), 1);
+  s = db.SMembersWithTTL("INLINE_KEY", &members, &ttl);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(members.size(), 2);
+  ASSERT_GT(ttl, 0);
+
+  ASSERT_EQ(db.Del({"INLINE_KEY"}), 1);
+  model.clear();
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+
+  s = db.SAdd("INLINE_KEY", {"c"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  model = {"c"};
+  ASSERT_TRUE(set_match(&db, "INLINE_KEY", model));
+}
+
+// SInter, SUnion, SDiff and their stores, ZUnionstore, SScan
+TEST_F(SetsInlineTest, ReadTest) {  // NOLINT
+  int32_t ret = 0;
+  s = db.SAdd("INLINE_A", {"a", "b", "c", "d"}, &ret);
+  ASSERT_TRUE(s.ok());
+  // one set of member keys among the inline ones
+  std::vector<std::string> members{"b", "d"};
+  for (int idx = 0; idx < 10; ++idx) {
+    members.push_back(InlineMember(idx));
+  }
+  s = db.SAdd("PLAIN_B", members, &ret);
+  ASSERT_TRUE(s.ok());
+
+  std::vector<std::string> result;
+  s = db.SInter({"INLINE_A", "PLAIN_B"}, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(result, std::vector<std::string>({"b", "d"}));
+  result.clear();
+  s = db.SDiff({"INLINE_A", "PLAIN_B"}, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(result, std::vector<std::string>({"a", "c"}));
+  result.clear();
+  s = db.SUnion({"INLINE_A", "PLAIN_B"}, &result);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(result.size(), 14);
+
+  // a small result is stored inline, a big one as member keys
+  std::vector<std::string> value_to_dest;
+  s = db.SInterstore("INLINE_DST", {"INLINE_A", "PLAIN_B"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2);
+  ASSERT_TRUE(set_match(&db, "INLINE_DST", SetModel({"b", "d"})));
+  s = db.SUnionstore("INLINE_DST", {"INLINE_A", "PLAIN_B"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 14);
+  ASSERT_TRUE(set_match(&db, "INLINE_DST", SetModel(value_to_dest.begin(), value_to_dest.end())));
+
+  int32_t zret = 0;
+  std::vector<storage::ScoreMember> score_members;
+  std::vector<storage::ScoreMember> value_to_zdest;
+  s = db.ZUnionstore("ZSET_DST", {"INLINE_A"}, {2}, storage::SUM, value_to_zdest, &zret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(zret, 4);
+  s = db.ZRange("ZSET_DST", 0, -1, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(score_members.size(), 4);
+  ASSERT_EQ(score_members[0].score, 2);
+
+  std::vector<std::string> scanned;
+  int64_t next_cursor = 0;
+  s = db.SScan("INLINE_A", 0, "*", 2, &scanned, &next_cursor);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(scanned, std::vector<std::string>({"a", "b", "c", "d"}));
+  ASSERT_EQ(next_cursor, 0);
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("sets_inline_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1847,6 +1847,98 @@ TEST_F(SetsTest, SUnionstoreTest) {  // NOLINT
   ASSERT_TRUE(members_match(&db, "GP4_SUNIONSTORE_DESTINATION1", {"a", "x", "l"}));
 }
 
+// The multi-way merges over sets larger than a store batch, with members
+// prefixing one another and a destination among the source keys
+TEST_F(SetsTest, SetsMergeTest) {  // NOLINT
+  int32_t ret = 0;
+  std::vector<std::string> multiples_of_2;
+  std::vector<std::string> multiples_of_3;
+  std::vector<std::string> multiples_of_6;
+  std::vector<std::string> multiples_of_2_or_3;
+  std::vector<std::string> multiples_of_2_not_3;
+  for (int idx = 0; idx < 6000; ++idx) {
+    std::string member = std::to_string(idx);
+    if (idx % 2 == 0) {
+      multiples_of_2.push_back(member);
+    }
+    if (idx % 3 == 0) {
+      multiples_of_3.push_back(member);
+    }
+    if (idx % 6 == 0) {
+      multiples_of_6.push_back(member);
+    }
+    if (idx % 2 == 0 || idx % 3 == 0) {
+      multiples_of_2_or_3.push_back(member);
+    }
+    if (idx % 2 == 0 && idx % 3 != 0) {
+      multiples_of_2_not_3.push_back(member);
+    }
+  }
+  s = db.SAdd("SETS_MERGE_KEY2", multiples_of_2, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("SETS_MERGE_KEY3", multiples_of_3, &ret);
+  ASSERT_TRUE(s.ok());
+
+  std::vector<std::string> members;
+  s = db.SInter({"SETS_MERGE_KEY2", "SETS_MERGE_KEY3"}, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(members_match(members, multiples_of_6));
+  s = db.SUnion({"SETS_MERGE_KEY2", "SETS_MERGE_KEY3", "SETS_MERGE_NOT_EXIST"}, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(members_match(members, multiples_of_2_or_3));
+  s = db.SDiff({"SETS_MERGE_KEY2", "SETS_MERGE_NOT_EXIST", "SETS_MERGE_KEY3"}, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(members_match(members, multiples_of_2_not_3));
+  s = db.SInter({"SETS_MERGE_KEY2", "SETS_MERGE_NOT_EXIST"}, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(members.empty());
+
+  std::vector<std::string> value_to_dest;
+  s = db.SUnionstore("SETS_MERGE_DESTINATION", {"SETS_MERGE_KEY2", "SETS_MERGE_KEY3"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, static_cast<int32_t>(multiples_of_2_or_3.size()));
+  ASSERT_TRUE(members_match(value_to_dest, multiples_of_2_or_3));
+  ASSERT_TRUE(members_match(&db, "SETS_MERGE_DESTINATION", multiples_of_2_or_3));
+  // the destination is read as it was before the store
+  s = db.SDiffstore("SETS_MERGE_DESTINATION", {"SETS_MERGE_DESTINATION", "SETS_MERGE_KEY3"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, static_cast<int32_t>(multiples_of_2_not_3.size()));
+  ASSERT_TRUE(members_match(&db, "SETS_MERGE_DESTINATION", multiples_of_2_not_3));
+  s = db.SInterstore("SETS_MERGE_DESTINATION", {"SETS_MERGE_DESTINATION", "SETS_MERGE_KEY3"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+  ASSERT_TRUE(members_match(&db, "SETS_MERGE_DESTINATION", {}));
+
+  // members prefixing one another sort before them
+  std::string zero_member("a\0", 2);
+  s = db.SAdd("SETS_MERGE_PREFIX_KEY1", {"a", zero_member, "ab", "b"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("SETS_MERGE_PREFIX_KEY2", {zero_member, "ab", "abc"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SInter({"SETS_MERGE_PREFIX_KEY1", "SETS_MERGE_PREFIX_KEY2"}, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(members_match(members, {zero_member, "ab"}));
+  s = db.SDiff({"SETS_MERGE_PREFIX_KEY1", "SETS_MERGE_PREFIX_KEY2"}, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(members_match(members, {"a", "b"}));
+  s = db.SUnion({"SETS_MERGE_PREFIX_KEY1", "SETS_MERGE_PREFIX_KEY2"}, &members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(members_match(members, {"a", zero_member, "ab", "abc", "b"}));
+
+  // a destination of another type is overwritten
+  s = db.Set("SETS_MERGE_STRING", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db.SInterstore("SETS_MERGE_STRING", {"SETS_MERGE_PREFIX_KEY1", "SETS_MERGE_PREFIX_KEY2"}, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2);
+  ASSERT_TRUE(members_match(&db, "SETS_MERGE_STRING", {zero_member, "ab"}));
+  // a source of another type is not
+  s = db.Set("SETS_MERGE_STRING_SOURCE", "VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db.SUnion({"SETS_MERGE_KEY2", "SETS_MERGE_STRING_SOURCE"}, &members);
+  ASSERT_TRUE(s.IsInvalidArgument());
+}
+
 // SScan
 TEST_F(SetsTest, SScanTest) {  // NOLINT
   int32_t ret = 0;
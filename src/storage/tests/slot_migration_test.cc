@@ -0,0 +1,350 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "pstd/include/pika_codis_slot.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::Slice;
+using storage::Status;
+
+static const int kSlotNum = 1024;
+
+class SlotMigrationTest : public ::testing::Test {
+ public:
+  SlotMigrationTest() = default;
+  ~SlotMigrationTest() override = default;
+
+  void SetUp() override {
+    path = "./db/slot_migration";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.key_counters = true;
+    db = std::make_unique<storage::Storage>();
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  std::string path;
+  storage::StorageOptions storage_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+static uint32_t slot_of(const std::string& key) { return GetSlotID(kSlotNum, key); }
+
+// Meta keys stored in one instance, owned or not
+static int64_t meta_keys(storage::Storage* const db, int idx) {
+  int64_t count = 0;
+  rocksdb::ReadOptions read_options;
+  std::unique_ptr<rocksdb::Iterator> iter(db->GetDBByIndex(idx)->NewIterator(read_options));
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  return count;
+}
+
+static void write_keys(storage::Storage* const db, const std::string& prefix) {
+  int32_t ret = 0;
+  uint64_t len = 0;
+  Status s = db->Set(prefix + "STRING", "STRING_VALUE");
+  ASSERT_TRUE(s.ok());
+  s = db->HMSet(prefix + "HASH", {{"F1", "V1"}, {"F2", "V2"}});
+  ASSERT_TRUE(s.ok());
+  s = db->RPush(prefix + "LIST", {"E1", "E2", "E3"}, &len);
+  ASSERT_TRUE(s.ok());
+  s = db->ZAdd(prefix + "ZSET", {{1, "M1"}, {2, "M2"}}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db->SAdd(prefix + "SET", {"M1", "M2"}, &ret);
+  ASSERT_TRUE(s.ok());
+}
+
+static void check_keys(storage::Storage* const db, const std::string& prefix) {
+  std::string value;
+  Status s = db->Get(prefix + "STRING", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "STRING_VALUE");
+  s = db->HGet(prefix + "HASH", "F2", &value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(value, "V2");
+  std::vector<std::string> elements;
+  s = db->LRange(prefix + "LIST", 0, -1, &elements);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(elements, std::vector<std::string>({"E1", "E2", "E3"}));
+  std::vector<storage::ScoreMember> score_members;
+  s = db->ZRange(prefix + "ZSET", 0, -1, &score_members);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(score_members.size(), 2);
+  ASSERT_EQ(score_members[1].member, "M2");
+  int32_t card = 0;
+  s = db->SCard(prefix + "SET", &card);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(card, 2);
+}
+
+static std::vector<uint32_t> slots_of(const std::string& prefix) {
+  std::vector<uint32_t> slots;
+  for (const auto& type : {"STRING", "HASH", "LIST", "ZSET", "SET"}) {
+    slots.push_back(slot_of(prefix + type));
+  }
+  return slots;
+}
+
+// Keys of every type move with their slots, the other keys stay
+TEST_F(SlotMigrationTest, MigrateTest) {  // NOLINT
+  write_keys(db.get(), "MOVED_");
+  write_keys(db.get(), "{KEPT}_");
+  std::vector<uint32_t> slots = slots_of("MOVED_");
+  uint32_t kept_slot = slot_of("{KEPT}_STRING");
+  slots.erase(std::remove(slots.begin(), slots.end(), kept_slot), slots.end());
+  uint32_t kept_inst = db->GetSlotInstance(kept_slot);
+  uint32_t dst_inst = (kept_inst + 1) % 3;
+
+  s = db->MigrateSlots(slots, dst_inst);
+  ASSERT_TRUE(s.ok());
+  for (const auto slot_id : slots) {
+    ASSERT_EQ(db->GetSlotInstance(slot_id), dst_inst);
+  }
+  ASSERT_EQ(db->GetSlotInstance(kept_slot), kept_inst);
+  check_keys(db.get(), "MOVED_");
+  check_keys(db.get(), "{KEPT}_");
+  // each key is stored once, in the instance owning its slot
+  ASSERT_EQ(meta_keys(db.get(), 0) + meta_keys(db.get(), 1) + meta_keys(db.get(), 2), 10);
+  ASSERT_EQ(meta_keys(db.get(), static_cast<int>(kept_inst)), 5);
+  std::vector<storage::KeyInfo> key_infos;
+  s = db->GetKeyNum(&key_infos);
+  ASSERT_TRUE(s.ok());
+  for (size_t idx = 0; idx < 5; ++idx) {
+    ASSERT_EQ(key_infos[idx].keys, 2);
+  }
+
+  // writes go to the new instance
+  int32_t ret = 0;
+  s = db->HSet("MOVED_HASH", "F3", "V3", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  int32_t len = 0;
+  s = db->HLen("MOVED_HASH", &len);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(len, 3);
+  ASSERT_EQ(db->Del({"MOVED_STRING"}), 1);
+  ASSERT_EQ(db->Exists({"MOVED_STRING"}), 0);
+}
+
+// The table outlives the storage, and the instances it needs must be there
+TEST_F(SlotMigrationTest, PersistTest) {  // NOLINT
+  write_keys(db.get(), "{KEY}_");
+  uint32_t slot_id = slot_of("{KEY}_STRING");
+  uint32_t dst_inst = (db->GetSlotInstance(slot_id) + 1) % 3;
+  s = db->MigrateSlots({slot_id}, dst_inst);
+  ASSERT_TRUE(s.ok());
+
+  db.reset();
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->GetSlotInstance(slot_id), dst_inst);
+  check_keys(db.get(), "{KEY}_");
+
+  // a fourth instance takes a slot, three instances cannot open it any more
+  db.reset();
+  db = std::make_unique<storage::Storage>(4, kSlotNum, true);
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  s = db->MigrateSlots({slot_id}, 3);
+  ASSERT_TRUE(s.ok());
+  check_keys(db.get(), "{KEY}_");
+  db.reset();
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.IsInvalidArgument());
+}
+
+// Member keys moved between a v1 and a v2 instance take the format of the
+// instance they move into
+TEST_F(SlotMigrationTest, DataFormatTest) {  // NOLINT
+  write_keys(db.get(), "{V1}_");
+  uint32_t v1_slot = slot_of("{V1}_STRING");
+  uint32_t v1_inst = db->GetSlotInstance(v1_slot);
+
+  // the instance holding v1 data stays v1, the empty ones take v2
+  db.reset();
+  storage_options.data_format = storage::kDataFormatV2;
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  std::string v2_prefix;
+  for (int idx = 0; v2_prefix.empty(); ++idx) {
+    std::string prefix = "{V2_" + std::to_string(idx) + "}_";
+    if (db->GetSlotInstance(slot_of(prefix + "STRING")) != v1_inst) {
+      v2_prefix = prefix;
+    }
+  }
+  write_keys(db.get(), v2_prefix);
+  uint32_t v2_slot = slot_of(v2_prefix + "STRING");
+  uint32_t v2_inst = db->GetSlotInstance(v2_slot);
+
+  // v2 -> v1, then v1 -> v2
+  s = db->MigrateSlots({v2_slot}, v1_inst);
+  ASSERT_TRUE(s.ok());
+  check_keys(db.get(), v2_prefix);
+  s = db->MigrateSlots({v1_slot}, v2_inst);
+  ASSERT_TRUE(s.ok());
+  check_keys(db.get(), "{V1}_");
+
+  // each instance holds one format only, the open finds nothing to convert
+  db.reset();
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  check_keys(db.get(), v2_prefix);
+  check_keys(db.get(), "{V1}_");
+  int32_t ret = 0;
+  s = db->SAdd("{V1}_SET", {"M3"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1);
+  s = db->SAdd(v2_prefix + "SET", {"M1"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 0);
+}
+
+// Writes running through the migration all land in the new instance
+TEST_F(SlotMigrationTest, ConcurrentWriteTest) {  // NOLINT
+  std::vector<std::string> keys;
+  for (int idx = 0; idx < 100; ++idx) {
+    keys.push_back("{KEY}_" + std::to_string(idx));
+    s = db->Set(keys.back(), "0");
+    ASSERT_TRUE(s.ok());
+  }
+  uint32_t slot_id = slot_of("{KEY}_0");
+  uint32_t dst_inst = (db->GetSlotInstance(slot_id) + 1) % 3;
+
+  // the lock of the commands, the barrier holds them off
+  std::shared_mutex commands_mutex;
+  std::atomic<bool> stop(false);
+  std::atomic<int64_t> rounds(0);
+  std::thread writer([&]() {
+    int64_t round = 0;
+    while (!stop) {
+      round++;
+      for (const auto& key : keys) {
+        std::shared_lock l(commands_mutex);
+        int32_t ret = 0;
+        db->Set(key, std::to_string(round));
+        db->HSet(key + "_HASH", std::to_string(round), "V", &ret);
+      }
+      rounds = round;
+    }
+  });
+  while (rounds < 2) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  s = db->MigrateSlots({slot_id}, dst_inst, [&](const std::function<Status()>& fn) {
+    std::lock_guard l(commands_mutex);
+    return fn();
+  });
+  stop = true;
+  writer.join();
+  ASSERT_TRUE(s.ok());
+
+  ASSERT_EQ(db->GetSlotInstance(slot_id), dst_inst);
+  int64_t last_round = rounds;
+  std::string value;
+  for (const auto& key : keys) {
+    s = db->Get(key, &value);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(value, std::to_string(last_round));
+    int32_t len = 0;
+    s = db->HLen(key + "_HASH", &len);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(len, last_round);
+  }
+  ASSERT_EQ(meta_keys(db.get(), static_cast<int>(dst_inst)), 200);
+}
+
+static void set_keys(storage::Storage* const db) {
+  for (int idx = 0; idx < 300; ++idx) {
+    Status s = db->Set("KEY_" + std::to_string(idx), std::string(100, 'v'));
+    ASSERT_TRUE(s.ok());
+  }
+}
+
+// An added instance keeps no slot until a rebalance moves slots to it
+TEST_F(SlotMigrationTest, RebalanceTest) {  // NOLINT
+  set_keys(db.get());
+  db.reset();
+  db = std::make_unique<storage::Storage>(4, kSlotNum, true);
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  for (uint32_t slot_id = 0; slot_id < kSlotNum; ++slot_id) {
+    ASSERT_EQ(db->GetSlotInstance(slot_id), slot_id % 3);
+  }
+
+  set_keys(db.get());
+  std::vector<storage::SlotMove> moves;
+  s = db->PlanSlotRebalance(8, &moves);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(moves.size(), 8);
+  for (const auto& move : moves) {
+    ASSERT_EQ(move.dst, 3);
+    ASSERT_EQ(db->GetSlotInstance(move.slot), move.src);
+  }
+
+  // the write rate is the one since the last plan
+  set_keys(db.get());
+  int64_t moved = 0;
+  s = db->RebalanceSlots(8, nullptr, &moved);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(moved, 8);
+  int64_t owned = 0;
+  for (uint32_t slot_id = 0; slot_id < kSlotNum; ++slot_id) {
+    owned += db->GetSlotInstance(slot_id) == 3 ? 1 : 0;
+  }
+  ASSERT_EQ(owned, 8);
+  std::string value;
+  for (int idx = 0; idx < 300; ++idx) {
+    s = db->Get("KEY_" + std::to_string(idx), &value);
+    ASSERT_TRUE(s.ok());
+  }
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("slot_migration_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,175 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <climits>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::Slice;
+using storage::Status;
+
+class StringsMergeTest : public ::testing::Test {
+ public:
+  StringsMergeTest() = default;
+  ~StringsMergeTest() override = default;
+
+  void SetUp() override {
+    path = "./db/strings_merge";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.strings_merge = true;
+    db = std::make_unique<storage::Storage>();
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  std::string path;
+  storage::StorageOptions storage_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+static bool value_match(storage::Storage* const db, const Slice& key, const std::string& expect) {
+  std::string value;
+  Status s = db->Get(key, &value);
+  return s.ok() && value == expect;
+}
+
+// Incrby, Incrbyfloat and their errors
+TEST_F(StringsMergeTest, IncrbyTest) {  // NOLINT
+  int64_t ret = 0;
+  int64_t etime = 0;
+  s = db->Set("INCRBY_KEY", "10");
+  ASSERT_TRUE(s.ok());
+  for (int idx = 0; idx < 1000; ++idx) {
+    s = db->Incrby("INCRBY_KEY", idx % 2 == 0 ? 3 : -1, &ret, &etime);
+    ASSERT_TRUE(s.ok());
+  }
+  ASSERT_EQ(ret, 1010);
+  ASSERT_TRUE(value_match(db.get(), "INCRBY_KEY", "1010"));
+
+  s = db->Set("OVERFLOW_KEY", std::to_string(LLONG_MAX - 1));
+  ASSERT_TRUE(s.ok());
+  s = db->Incrby("OVERFLOW_KEY", 1, &ret, &etime);
+  ASSERT_TRUE(s.ok());
+  s = db->Incrby("OVERFLOW_KEY", 1, &ret, &etime);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  ASSERT_TRUE(value_match(db.get(), "OVERFLOW_KEY", std::to_string(LLONG_MAX)));
+  s = db->Incrby("OVERFLOW_KEY", LLONG_MIN, &ret, &etime);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, -1);
+
+  s = db->Set("NOT_INT_KEY", "abc");
+  ASSERT_TRUE(s.ok());
+  s = db->Incrby("NOT_INT_KEY", 1, &ret, &etime);
+  ASSERT_TRUE(s.IsCorruption());
+  ASSERT_TRUE(value_match(db.get(), "NOT_INT_KEY", "abc"));
+
+  std::string fret;
+  s = db->Set("FLOAT_KEY", "1.5");
+  ASSERT_TRUE(s.ok());
+  s = db->Incrbyfloat("FLOAT_KEY", "0.25", &fret, &etime);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(fret, "1.75");
+  ASSERT_TRUE(value_match(db.get(), "FLOAT_KEY", "1.75"));
+
+  // the folded values survive the compaction
+  s = db->Compact(storage::DataType::kAll, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(value_match(db.get(), "INCRBY_KEY", "1010"));
+  ASSERT_TRUE(value_match(db.get(), "OVERFLOW_KEY", "-1"));
+  ASSERT_TRUE(value_match(db.get(), "FLOAT_KEY", "1.75"));
+}
+
+// Append, Setrange, and the ttl of the string
+TEST_F(StringsMergeTest, AppendTest) {  // NOLINT
+  int32_t ret = 0;
+  int64_t etime = 0;
+  std::string new_value;
+  s = db->Set("APPEND_KEY", "a");
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db->Expire("APPEND_KEY", 100 * 1000), 1);
+  std::string expect = "a";
+  for (int idx = 0; idx < 100; ++idx) {
+    s = db->Append("APPEND_KEY", std::to_string(idx), &ret, &etime, new_value);
+    ASSERT_TRUE(s.ok());
+    expect += std::to_string(idx);
+    ASSERT_EQ(ret, static_cast<int32_t>(expect.size()));
+  }
+  ASSERT_TRUE(value_match(db.get(), "APPEND_KEY", expect));
+  ASSERT_GT(db->TTL("APPEND_KEY"), 0);
+
+  s = db->Set("SETRANGE_KEY", "hello world");
+  ASSERT_TRUE(s.ok());
+  s = db->Setrange("SETRANGE_KEY", 6, "pika", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 11);
+  ASSERT_TRUE(value_match(db.get(), "SETRANGE_KEY", "hello pikad"));
+  s = db->Setrange("SETRANGE_KEY", 14, "!", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 15);
+  ASSERT_TRUE(value_match(db.get(), "SETRANGE_KEY", std::string("hello pikad\0\0\0!", 15)));
+
+  // a Set drops the operands below it
+  s = db->Set("APPEND_KEY", "x");
+  ASSERT_TRUE(s.ok());
+  s = db->Append("APPEND_KEY", "y", &ret, &etime, new_value);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(value_match(db.get(), "APPEND_KEY", "xy"));
+}
+
+// Operands written with strings_merge on are read back with it off
+TEST_F(StringsMergeTest, ReopenTest) {  // NOLINT
+  int64_t ret = 0;
+  int64_t etime = 0;
+  s = db->Set("REOPEN_KEY", "1");
+  ASSERT_TRUE(s.ok());
+  s = db->Incrby("REOPEN_KEY", 41, &ret, &etime);
+  ASSERT_TRUE(s.ok());
+
+  db.reset();
+  storage_options.strings_merge = false;
+  db = std::make_unique<storage::Storage>();
+  s = db->Open(storage_options, path);
+  ASSERT_TRUE(s.ok());
+  ASSERT_TRUE(value_match(db.get(), "REOPEN_KEY", "42"));
+  s = db->Incrby("REOPEN_KEY", 1, &ret, &etime);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 43);
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("strings_merge_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -133,7 +133,7 @@ TEST_F(StringsTest, AppendTest) {
 
 // BitCount
 TEST_F(StringsTest, BitCountTest) {
-  int32_t ret;
+  int64_t ret;
 
   // ***************** Group 1 Test *****************
   s = db.Set("GP1_BITCOUNT_KEY", "foobar");
@@ -569,6 +569,48 @@ TEST_F(StringsTest, MGetTest) {
   ASSERT_EQ(vss[2].value, "");
   ASSERT_TRUE(vss[3].status.IsNotFound());
   ASSERT_EQ(vss[3].value, "");
+
+  // ***************** Group 3 Test *****************
+  // Keys spread over all instances, the result keeps the request order
+  std::vector<storage::KeyValue> kvs3;
+  std::vector<std::string> keys3;
+  for (int idx = 0; idx < 100; ++idx) {
+    kvs3.push_back({"GP3_MGET_KEY" + std::to_string(idx), "VALUE" + std::to_string(idx)});
+    keys3.push_back("GP3_MGET_KEY" + std::to_string(idx));
+  }
+  s = db.MSet(kvs3);
+  ASSERT_TRUE(s.ok());
+  int32_t ret = 0;
+  s = db.HSet("GP3_MGET_HASH_KEY", "FIELD", "VALUE", &ret);
+  ASSERT_TRUE(s.ok());
+  keys3.push_back("GP3_MGET_HASH_KEY");
+  keys3.push_back("GP3_MGET_KEY0");
+
+  vss.clear();
+  s = db.MGet(keys3, &vss);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(vss.size(), 102);
+  for (int idx = 0; idx < 100; ++idx) {
+    ASSERT_TRUE(vss[idx].status.ok());
+    ASSERT_EQ(vss[idx].value, "VALUE" + std::to_string(idx));
+  }
+  ASSERT_TRUE(vss[100].status.IsNotFound());
+  ASSERT_EQ(vss[100].value, "");
+  ASSERT_TRUE(vss[101].status.ok());
+  ASSERT_EQ(vss[101].value, "VALUE0");
+
+  vss.clear();
+  s = db.MGetWithTTL(keys3, &vss);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(vss.size(), 102);
+  for (int idx = 0; idx < 100; ++idx) {
+    ASSERT_TRUE(vss[idx].status.ok());
+    ASSERT_EQ(vss[idx].value, "VALUE" + std::to_string(idx));
+    ASSERT_EQ(vss[idx].ttl_millsec, -1);
+  }
+  ASSERT_TRUE(vss[100].status.IsNotFound());
+  ASSERT_EQ(vss[100].ttl_millsec, -2);
+  ASSERT_EQ(db.Exists(keys3), 102);
 }
 
 // MSet
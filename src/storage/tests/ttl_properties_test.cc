@@ -0,0 +1,129 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "src/ttl_properties.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::Status;
+
+class TTLPropertiesTest : public ::testing::Test {
+ public:
+  TTLPropertiesTest() = default;
+  ~TTLPropertiesTest() override = default;
+
+  void SetUp() override {
+    path = "./db/ttl_properties";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.compact_param_.ttl_compact_horizon_seconds_ = 60;
+    db = std::make_unique<storage::Storage>();
+    s = db->Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    db.reset();
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  // flushes the cf of every instance, cf_pos picks it from the hash cf
+  // handles, 0 for the meta cf and 1 for the hash data cf
+  void Flush(size_t cf_pos) {
+    for (int index = 0; index < kInstNum; ++index) {
+      auto handles = db->GetHashCFHandles(index);
+      ASSERT_TRUE(db->GetDBByIndex(index)->Flush(rocksdb::FlushOptions(), handles[cf_pos]).ok());
+    }
+  }
+
+  // the dead entries of the cf at now, summed over the instances
+  uint64_t DeadEntries(size_t cf_pos, uint64_t now, uint64_t* expiring = nullptr) {
+    uint64_t total = 0;
+    for (int index = 0; index < kInstNum; ++index) {
+      auto handles = db->GetHashCFHandles(index);
+      rocksdb::TablePropertiesCollection props;
+      EXPECT_TRUE(db->GetDBByIndex(index)->GetPropertiesOfAllTables(handles[cf_pos], &props).ok());
+      for (const auto& [name, table_props] : props) {
+        uint64_t dead_entries = 0;
+        uint64_t dead_bytes = 0;
+        storage::GetTTLDeadEntries(*table_props, now, &dead_entries, &dead_bytes);
+        total += dead_entries;
+        if (expiring != nullptr) {
+          const auto& user_props = table_props->user_collected_properties;
+          *expiring += std::stoull(user_props.at(storage::kTTLExpiringEntriesProperty));
+        }
+      }
+    }
+    return total;
+  }
+
+  static const int kInstNum = 3;
+  std::string path;
+  storage::StorageOptions storage_options;
+  std::unique_ptr<storage::Storage> db;
+  storage::Status s;
+};
+
+// Metas expiring within the horizon count as dead once they expired
+TEST_F(TTLPropertiesTest, ExpiringMetaTest) {  // NOLINT
+  for (int idx = 0; idx < 100; ++idx) {
+    ASSERT_TRUE(db->Setex("EXPIRING_" + std::to_string(idx), "VALUE", 1000).ok());
+    ASSERT_TRUE(db->Set("LIVE_" + std::to_string(idx), "VALUE").ok());
+    ASSERT_TRUE(db->Setex("LATER_" + std::to_string(idx), "VALUE", 3600 * 1000).ok());
+  }
+  Flush(0);
+  uint64_t now = pstd::NowMillis();
+  uint64_t expiring = 0;
+  ASSERT_EQ(DeadEntries(0, now, &expiring), 0);
+  // the keys expiring after the horizon are not recorded
+  ASSERT_EQ(expiring, 100);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+  ASSERT_EQ(DeadEntries(0, pstd::NowMillis()), 100);
+}
+
+// Members of a deleted hash flushed afterwards are dead at once
+TEST_F(TTLPropertiesTest, DroppedVersionTest) {  // NOLINT
+  std::vector<storage::FieldValue> fvs;
+  for (int idx = 0; idx < 50; ++idx) {
+    fvs.push_back({"FIELD_" + std::to_string(idx), "VALUE"});
+  }
+  ASSERT_TRUE(db->HMSet("DELETED_HASH", fvs).ok());
+  ASSERT_TRUE(db->HMSet("LIVE_HASH", fvs).ok());
+  ASSERT_EQ(db->Del({"DELETED_HASH"}), 1);
+  Flush(1);
+  ASSERT_EQ(DeadEntries(1, pstd::NowMillis()), 50);
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("ttl_properties_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
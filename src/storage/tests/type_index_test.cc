@@ -0,0 +1,164 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::DataType;
+using storage::Slice;
+using storage::Status;
+
+class TypeIndexTest : public ::testing::Test {
+ public:
+  TypeIndexTest() = default;
+  ~TypeIndexTest() override = default;
+
+  void SetUp() override {
+    std::string path = "./db/type_index";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    s = db.Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    std::string path = "./db/type_index";
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  storage::StorageOptions storage_options;
+  storage::Storage db;
+  storage::Status s;
+};
+
+// All keys of type reached with SCAN, sorted
+static std::vector<std::string> scan_all(storage::Storage* const db, const DataType& type, const std::string& pattern) {
+  std::vector<std::string> keys;
+  int64_t cursor = 0;
+  do {
+    cursor = db->Scan(type, cursor, pattern, 3, &keys);
+  } while (cursor != 0);
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+
+static std::vector<std::string> keys_all(storage::Storage* const db, const DataType& type, const std::string& pattern) {
+  std::vector<std::string> keys;
+  db->Keys(type, pattern, &keys);
+  std::sort(keys.begin(), keys.end());
+  return keys;
+}
+
+// Scan, Keys, GetKeyNum of one type among many strings
+TEST_F(TypeIndexTest, TypedScanTest) {  // NOLINT
+  int32_t ret = 0;
+  uint64_t len = 0;
+  for (int idx = 0; idx < 100; ++idx) {
+    s = db.Set("STRING_KEY_" + std::to_string(idx), "v");
+    ASSERT_TRUE(s.ok());
+  }
+  std::vector<std::string> zset_keys;
+  for (int idx = 0; idx < 7; ++idx) {
+    zset_keys.push_back("ZSET_KEY_" + std::to_string(idx));
+    s = db.ZAdd(zset_keys.back(), {{1, "m"}}, &ret);
+    ASSERT_TRUE(s.ok());
+  }
+  std::sort(zset_keys.begin(), zset_keys.end());
+  s = db.HSet("HASH_KEY", "f", "v", &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("SET_KEY", {"m"}, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.RPush("LIST_KEY", {"e"}, &len);
+  ASSERT_TRUE(s.ok());
+
+  ASSERT_EQ(scan_all(&db, DataType::kZSets, "*"), zset_keys);
+  ASSERT_EQ(keys_all(&db, DataType::kZSets, "*"), zset_keys);
+  ASSERT_EQ(scan_all(&db, DataType::kZSets, "ZSET_KEY_1*"), std::vector<std::string>{"ZSET_KEY_1"});
+  ASSERT_EQ(scan_all(&db, DataType::kHashes, "*"), std::vector<std::string>{"HASH_KEY"});
+  ASSERT_EQ(scan_all(&db, DataType::kSets, "*"), std::vector<std::string>{"SET_KEY"});
+  ASSERT_EQ(scan_all(&db, DataType::kLists, "*"), std::vector<std::string>{"LIST_KEY"});
+  ASSERT_EQ(scan_all(&db, DataType::kStrings, "*").size(), 100);
+  ASSERT_EQ(scan_all(&db, DataType::kAll, "*").size(), 111);
+
+  std::vector<std::string> keys;
+  std::string next_key;
+  s = db.PKScanRange(DataType::kZSets, "ZSET_KEY_2", "", "*", 3, &keys, nullptr, &next_key);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(keys, std::vector<std::string>({"ZSET_KEY_2", "ZSET_KEY_3", "ZSET_KEY_4"}));
+  ASSERT_EQ(next_key, "ZSET_KEY_5");
+  keys.clear();
+  s = db.PKRScanRange(DataType::kZSets, "ZSET_KEY_2", "", "*", 10, &keys, nullptr, &next_key);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(keys, std::vector<std::string>({"ZSET_KEY_2", "ZSET_KEY_1", "ZSET_KEY_0"}));
+
+  std::vector<storage::KeyInfo> key_infos;
+  s = db.GetKeyNum(&key_infos);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(key_infos[0].keys, 100);
+  ASSERT_EQ(key_infos[1].keys, 1);
+  ASSERT_EQ(key_infos[2].keys, 1);
+  ASSERT_EQ(key_infos[3].keys, 7);
+  ASSERT_EQ(key_infos[4].keys, 1);
+}
+
+// Deleted keys and keys taken over by another type
+TEST_F(TypeIndexTest, TypeChangeTest) {  // NOLINT
+  int32_t ret = 0;
+  s = db.HSet("CHANGE_KEY", "f", "v", &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.HSet("STAY_KEY", "f", "v", &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(scan_all(&db, DataType::kHashes, "*"), std::vector<std::string>({"CHANGE_KEY", "STAY_KEY"}));
+
+  ASSERT_EQ(db.Del({"CHANGE_KEY"}), 1);
+  ASSERT_EQ(scan_all(&db, DataType::kHashes, "*"), std::vector<std::string>{"STAY_KEY"});
+  s = db.SAdd("CHANGE_KEY", {"m"}, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(scan_all(&db, DataType::kHashes, "*"), std::vector<std::string>{"STAY_KEY"});
+  ASSERT_EQ(scan_all(&db, DataType::kSets, "*"), std::vector<std::string>{"CHANGE_KEY"});
+
+  // the compaction drops the stale entries, the live ones stay
+  ASSERT_EQ(db.Del({"CHANGE_KEY"}), 1);
+  s = db.Set("CHANGE_KEY", "v");
+  ASSERT_TRUE(s.ok());
+  s = db.Compact(DataType::kAll, true);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(scan_all(&db, DataType::kHashes, "*"), std::vector<std::string>{"STAY_KEY"});
+  ASSERT_TRUE(scan_all(&db, DataType::kSets, "*").empty());
+  ASSERT_EQ(scan_all(&db, DataType::kStrings, "*"), std::vector<std::string>{"CHANGE_KEY"});
+
+  s = db.ZAdd("CHANGE_KEY", {{1, "m"}}, &ret);
+  ASSERT_TRUE(s.IsInvalidArgument());
+  ASSERT_TRUE(scan_all(&db, DataType::kZSets, "*").empty());
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("type_index_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
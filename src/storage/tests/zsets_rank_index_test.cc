@@ -0,0 +1,219 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <vector>
+
+#include "glog/logging.h"
+
+#include "pstd/include/env.h"
+#include "storage/storage.h"
+#include "storage/util.h"
+
+using storage::ScoreMember;
+using storage::Slice;
+using storage::Status;
+
+// score cf order, score first then member bytes
+using ZSetModel = std::set<std::pair<double, std::string>>;
+
+class ZSetsRankIndexTest : public ::testing::Test {
+ public:
+  ZSetsRankIndexTest() = default;
+  ~ZSetsRankIndexTest() override = default;
+
+  void SetUp() override {
+    std::string path = "./db/zsets_rank_index";
+    pstd::DeleteDirIfExist(path);
+    mkdir(path.c_str(), 0755);
+    storage_options.options.create_if_missing = true;
+    storage_options.zset_rank_index_threshold = 128;
+    s = db.Open(storage_options, path);
+    if (!s.ok()) {
+      printf("Open db failed, exit...\n");
+      exit(1);
+    }
+  }
+
+  void TearDown() override {
+    std::string path = "./db/zsets_rank_index";
+    storage::DeleteFiles(path.c_str());
+  }
+
+  static void SetUpTestSuite() {}
+  static void TearDownTestSuite() {}
+
+  storage::StorageOptions storage_options;
+  storage::Storage db;
+  storage::Status s;
+};
+
+static std::string RankMember(const std::string& prefix, int idx) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%08d", idx);
+  return prefix + buf;
+}
+
+// Compare ZRange, ZRevrange, ZRank and ZRevrank of key with the model,
+// probing every step-th rank
+static bool rank_match(storage::Storage* const db, const Slice& key, const ZSetModel& model, int step) {
+  std::vector<std::pair<double, std::string>> expect(model.begin(), model.end());
+  int32_t size = static_cast<int32_t>(expect.size());
+  int32_t card = 0;
+  if (!db->ZCard(key, &card).ok() || card != size) {
+    return false;
+  }
+  for (int32_t rank = 0; rank < size; rank += step) {
+    std::vector<ScoreMember> sm_out;
+    int32_t stop = std::min(rank + 9, size - 1);
+    if (!db->ZRange(key, rank, stop, &sm_out).ok() || sm_out.size() != static_cast<size_t>(stop - rank + 1)) {
+      return false;
+    }
+    for (int32_t idx = rank; idx <= stop; ++idx) {
+      if (sm_out[idx - rank].score != expect[idx].first || sm_out[idx - rank].member != expect[idx].second) {
+        return false;
+      }
+    }
+
+    sm_out.clear();
+    if (!db->ZRevrange(key, rank, stop, &sm_out).ok() || sm_out.size() != static_cast<size_t>(stop - rank + 1)) {
+      return false;
+    }
+    for (int32_t idx = rank; idx <= stop; ++idx) {
+      if (sm_out[idx - rank].member != expect[size - 1 - idx].second) {
+        return false;
+      }
+    }
+
+    int32_t member_rank = -1;
+    if (!db->ZRank(key, expect[rank].second, &member_rank).ok() || member_rank != rank) {
+      return false;
+    }
+    if (!db->ZRevrank(key, expect[rank].second, &member_rank).ok() || member_rank != size - 1 - rank) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// ZAdd, ZRem, ZRemrangebyrank and ZIncrby on a zset large enough to be indexed
+TEST_F(ZSetsRankIndexTest, WriteAndReadTest) {  // NOLINT
+  int32_t ret = 0;
+  ZSetModel model;
+
+  // ***************** Build the index *****************
+  std::vector<ScoreMember> score_members;
+  for (int idx = 0; idx < 5000; ++idx) {
+    score_members.push_back({static_cast<double>(idx / 3), RankMember("m", idx)});
+    model.insert({static_cast<double>(idx / 3), RankMember("m", idx)});
+  }
+  s = db.ZAdd("RANK_KEY", score_members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 5000);
+  ASSERT_TRUE(rank_match(&db, "RANK_KEY", model, 97));
+
+  // ***************** Split *****************
+  // all of them land in one block
+  score_members.clear();
+  for (int idx = 0; idx < 3000; ++idx) {
+    score_members.push_back({100.5, RankMember("n", idx)});
+    model.insert({100.5, RankMember("n", idx)});
+  }
+  for (int idx = 0; idx < 3; ++idx) {
+    std::vector<ScoreMember> part(score_members.begin() + idx * 1000, score_members.begin() + (idx + 1) * 1000);
+    s = db.ZAdd("RANK_KEY", part, &ret);
+    ASSERT_TRUE(s.ok());
+    ASSERT_EQ(ret, 1000);
+  }
+  ASSERT_TRUE(rank_match(&db, "RANK_KEY", model, 89));
+
+  // ***************** Merge *****************
+  std::vector<std::string> members;
+  for (int idx = 1000; idx < 3000; ++idx) {
+    members.push_back(RankMember("m", idx));
+    model.erase({static_cast<double>(idx / 3), RankMember("m", idx)});
+  }
+  s = db.ZRem("RANK_KEY", members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2000);
+  ASSERT_TRUE(rank_match(&db, "RANK_KEY", model, 83));
+
+  // ***************** ZRemrangebyrank *****************
+  s = db.ZRemrangebyrank("RANK_KEY", 300, 1299, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 1000);
+  auto first = std::next(model.begin(), 300);
+  model.erase(first, std::next(first, 1000));
+  ASSERT_TRUE(rank_match(&db, "RANK_KEY", model, 79));
+
+  // ***************** ZIncrby *****************
+  double score = 0;
+  for (int idx = 4000; idx < 4100; ++idx) {
+    s = db.ZIncrby("RANK_KEY", RankMember("m", idx), -1000, &score);
+    ASSERT_TRUE(s.ok());
+    model.erase({static_cast<double>(idx / 3), RankMember("m", idx)});
+    model.insert({score, RankMember("m", idx)});
+  }
+  ASSERT_TRUE(rank_match(&db, "RANK_KEY", model, 71));
+
+  // ***************** Missing member *****************
+  int32_t rank = 0;
+  s = db.ZRank("RANK_KEY", "not_a_member", &rank);
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(rank, -1);
+  s = db.ZRevrank("RANK_KEY", RankMember("m", 1500), &rank);
+  ASSERT_TRUE(s.IsNotFound());
+}
+
+// A deleted zset comes back under a new version, without the old index
+TEST_F(ZSetsRankIndexTest, DelAndReAddTest) {  // NOLINT
+  int32_t ret = 0;
+  ZSetModel model;
+  std::vector<ScoreMember> score_members;
+  for (int idx = 0; idx < 3000; ++idx) {
+    score_members.push_back({static_cast<double>(idx), RankMember("m", idx)});
+  }
+  s = db.ZAdd("RANK_DEL_KEY", score_members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(db.Del({"RANK_DEL_KEY"}), 1);
+
+  // below the threshold, not indexed
+  score_members.clear();
+  for (int idx = 0; idx < 50; ++idx) {
+    score_members.push_back({static_cast<double>(-idx), RankMember("r", idx)});
+    model.insert({static_cast<double>(-idx), RankMember("r", idx)});
+  }
+  s = db.ZAdd("RANK_DEL_KEY", score_members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 50);
+  ASSERT_TRUE(rank_match(&db, "RANK_DEL_KEY", model, 1));
+
+  // indexed again once it grows
+  score_members.clear();
+  for (int idx = 50; idx < 2500; ++idx) {
+    score_members.push_back({static_cast<double>(-idx), RankMember("r", idx)});
+    model.insert({static_cast<double>(-idx), RankMember("r", idx)});
+  }
+  s = db.ZAdd("RANK_DEL_KEY", score_members, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, 2450);
+  ASSERT_TRUE(rank_match(&db, "RANK_DEL_KEY", model, 37));
+}
+
+int main(int argc, char** argv) {
+  if (!pstd::FileExists("./log")) {
+    pstd::CreatePath("./log");
+  }
+  FLAGS_log_dir = "./log";
+  FLAGS_minloglevel = 0;
+  FLAGS_max_log_size = 1800;
+  FLAGS_logbufsecs = 0;
+  ::google::InitGoogleLogging("zsets_rank_index_test");
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -3707,7 +3707,7 @@ TEST_F(ZSetsTest, ZUnionstoreTest) {  // NOLINT
   s = db.ZAdd("GP1_ZUNIONSTORE_SM1", gp1_sm1, &ret);
   s = db.ZAdd("GP1_ZUNIONSTORE_SM2", gp1_sm2, &ret);
   s = db.ZAdd("GP1_ZUNIONSTORE_SM3", gp1_sm3, &ret);
-  std::map<std::string, double> value_to_dest;
+  std::vector<storage::ScoreMember> value_to_dest;
   s = db.ZUnionstore("GP1_ZUNIONSTORE_DESTINATION",
                      {"GP1_ZUNIONSTORE_SM1", "GP1_ZUNIONSTORE_SM2", "GP1_ZUNIONSTORE_SM3"}, {1, 1, 1}, storage::SUM,
                      value_to_dest, &ret);
@@ -4166,6 +4166,50 @@ TEST_F(ZSetsTest, ZInterstoreTest) {  // NOLINT
   ASSERT_TRUE(score_members_match(&db, "GP10_ZINTERSTORE_DESTINATION", {}));
 }
 
+// Stores big enough to take several batches, with a set among the inputs
+TEST_F(ZSetsTest, ZSetsMergeTest) {  // NOLINT
+  int32_t ret = 0;
+  std::vector<storage::ScoreMember> all_sm;
+  std::vector<std::string> even_members;
+  std::vector<storage::ScoreMember> even_sm;
+  for (int idx = 0; idx < 3000; ++idx) {
+    std::string member = std::to_string(idx);
+    all_sm.push_back({static_cast<double>(idx), member});
+    if (idx % 2 == 0) {
+      even_members.push_back(member);
+      even_sm.push_back({static_cast<double>(2 * idx + 1), member});
+    }
+  }
+  s = db.ZAdd("ZSETS_MERGE_ALL", all_sm, &ret);
+  ASSERT_TRUE(s.ok());
+  s = db.SAdd("ZSETS_MERGE_EVEN", even_members, &ret);
+  ASSERT_TRUE(s.ok());
+
+  // the members of a set score 1
+  std::vector<storage::ScoreMember> value_to_dest;
+  s = db.ZInterstore("ZSETS_MERGE_DESTINATION", {"ZSETS_MERGE_ALL", "ZSETS_MERGE_EVEN"}, {2, 1}, storage::SUM,
+                     value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, static_cast<int32_t>(even_sm.size()));
+  ASSERT_EQ(value_to_dest.size(), even_sm.size());
+  ASSERT_TRUE(size_match(&db, "ZSETS_MERGE_DESTINATION", static_cast<int32_t>(even_sm.size())));
+  ASSERT_TRUE(score_members_match(&db, "ZSETS_MERGE_DESTINATION", even_sm));
+
+  // the destination is read as it was before the store
+  s = db.ZUnionstore("ZSETS_MERGE_DESTINATION", {"ZSETS_MERGE_DESTINATION", "ZSETS_MERGE_ALL", "ZSETS_MERGE_NOT_EXIST"},
+                     {1, 1, 1}, storage::MIN, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, static_cast<int32_t>(all_sm.size()));
+  ASSERT_TRUE(size_match(&db, "ZSETS_MERGE_DESTINATION", static_cast<int32_t>(all_sm.size())));
+  ASSERT_TRUE(score_members_match(&db, "ZSETS_MERGE_DESTINATION", all_sm));
+
+  // a destination of another type is overwritten
+  s = db.ZUnionstore("ZSETS_MERGE_EVEN", {"ZSETS_MERGE_ALL"}, {}, storage::SUM, value_to_dest, &ret);
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ(ret, static_cast<int32_t>(all_sm.size()));
+  ASSERT_TRUE(score_members_match(&db, "ZSETS_MERGE_EVEN", all_sm));
+}
+
 // ZRANGEBYLEX
 TEST_F(ZSetsTest, ZRangebylexTest) {  // NOLINT
   int32_t ret;
@@ -0,0 +1,86 @@
+//  Copyright (c) 2023-present, Qihoo, Inc.  All rights reserved.
+//  This source code is licensed under the BSD-style license found in the
+//  LICENSE file in the root directory of this source tree. An additional grant
+//  of patent rights can be found in the PATENTS file in the same directory.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include "storage/storage.h"
+
+int32_t db_instance_num = 3;
+int32_t slot_num = 1024;
+std::string storage_db_path;
+
+void PrintInfo(const std::time_t& now) {
+  std::cout << "================ Pika Data Format Converter ================" << std::endl;
+  std::cout << "Storage_db_path : " << storage_db_path << std::endl;
+  std::cout << "Db_instance_num : " << db_instance_num << std::endl;
+  std::cout << "Target_format : v2" << std::endl;
+  std::cout << "Startup Time : " << asctime(localtime(&now));
+  std::cout << "============================================================" << std::endl;
+}
+
+void Usage() {
+  std::cout << "Usage: " << std::endl;
+  std::cout << "\tdata_format_converter rewrites the hash/set/zset member data of a stopped pika db into the compact"
+            << std::endl;
+  std::cout << "\tv2 data format, it can be run again to resume an interrupted conversion" << std::endl;
+  std::cout << "\t-h    -- displays this help information and exits" << std::endl;
+  std::cout << "\t-n    -- db-instance-num of the db, default = 3" << std::endl;
+  std::cout << "\texample: ./data_format_converter ./db/db0 -n 3" << std::endl;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2 && argc != 4) {
+    Usage();
+    exit(-1);
+  }
+
+  storage_db_path = std::string(argv[1]);
+  if (argc == 4) {
+    if (std::string(argv[2]) == "-n") {
+      db_instance_num = atoi(argv[3]);
+    } else {
+      Usage();
+      exit(-1);
+    }
+  }
+  if (db_instance_num <= 0) {
+    Usage();
+    exit(-1);
+  }
+
+  std::chrono::system_clock::time_point start_time = std::chrono::system_clock::now();
+  std::time_t now = std::chrono::system_clock::to_time_t(start_time);
+  PrintInfo(now);
+
+  storage::StorageOptions storage_options;
+  storage_options.options.create_if_missing = false;
+  // keep the format the db was written with until it is converted
+  storage_options.data_format = storage::kDataFormatV1;
+  auto storage_db = std::make_unique<storage::Storage>(db_instance_num, slot_num, true);
+  rocksdb::Status s = storage_db->Open(storage_options, storage_db_path);
+  if (!s.ok()) {
+    std::cout << "Open Storage db failed, " << s.ToString() << std::endl;
+    return -1;
+  }
+
+  uint64_t converted = 0;
+  s = storage_db->ConvertDataFormat(storage::kDataFormatV2, &converted);
+  if (!s.ok()) {
+    std::cout << "Convert failed after " << converted << " member keys, " << s.ToString() << std::endl;
+    return -1;
+  }
+  std::cout << "Converted " << converted << " member keys, compacting..." << std::endl;
+  // drop the v1 keys deleted by the conversion
+  storage_db->Compact(storage::DataType::kAll, true);
+
+  std::chrono::system_clock::time_point end_time = std::chrono::system_clock::now();
+  now = std::chrono::system_clock::to_time_t(end_time);
+  std::cout << "Finish Time : " << asctime(localtime(&now));
+  auto seconds = std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time).count();
+  std::cout << "Total Time Cost : " << seconds << " seconds" << std::endl;
+  return 0;
+}
@@ -0,0 +1,307 @@
+#include "bulk.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "pstd/include/base_conf.h"
+#include "storage/bulk_loader.h"
+#include "storage/storage.h"
+
+namespace {
+
+enum class KeyType { kNone, kString, kHash, kSet, kList, kZSet };
+
+// the proto-max-bulk-len of redis
+constexpr int64_t kMaxBulkLength = 512LL * 1024 * 1024;
+
+// the commands of the key being read, loaded once the next key starts
+struct PendingKey {
+  std::string key;
+  KeyType type = KeyType::kNone;
+  std::string value;
+  std::vector<storage::FieldValue> fvs;
+  std::vector<std::string> members;
+  std::vector<storage::ScoreMember> score_members;
+  int64_t etime_millsec = 0;
+};
+
+int64_t NowMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// the whole of str must be the number
+bool ParseInt64(const std::string& str, int64_t* value) {
+  if (str.empty()) {
+    return false;
+  }
+  char* end = nullptr;
+  errno = 0;
+  *value = std::strtoll(str.c_str(), &end, 10);
+  return errno == 0 && end == str.c_str() + str.size();
+}
+
+bool ParseDouble(const std::string& str, double* value) {
+  if (str.empty()) {
+    return false;
+  }
+  char* end = nullptr;
+  errno = 0;
+  *value = std::strtod(str.c_str(), &end);
+  return errno == 0 && end == str.c_str() + str.size();
+}
+
+bool ReadLine(std::istream& in, std::string* line) {
+  if (!std::getline(in, *line)) {
+    return false;
+  }
+  if (!line->empty() && line->back() == '\r') {
+    line->pop_back();
+  }
+  return true;
+}
+
+// reads one command in the redis protocol, false at the end of the file.
+// Arguments are read by their length, so they may hold any byte
+bool ReadCommand(std::istream& in, std::vector<std::string>* argv, bool* malformed) {
+  std::string line;
+  argv->clear();
+  if (!ReadLine(in, &line)) {
+    return false;
+  }
+  if (line.empty() || line[0] != '*') {
+    *malformed = true;
+    return false;
+  }
+  int64_t argc = 0;
+  if (!ParseInt64(line.substr(1), &argc) || argc < 0) {
+    *malformed = true;
+    return false;
+  }
+  for (int64_t i = 0; i < argc; i++) {
+    if (!ReadLine(in, &line) || line.empty() || line[0] != '$') {
+      *malformed = true;
+      return false;
+    }
+    int64_t len = 0;
+    if (!ParseInt64(line.substr(1), &len) || len < 0 || len > kMaxBulkLength) {
+      *malformed = true;
+      return false;
+    }
+    std::string arg(len, '\0');
+    if (!in.read(arg.data(), len) || !ReadLine(in, &line)) {
+      *malformed = true;
+      return false;
+    }
+    argv->push_back(std::move(arg));
+  }
+  return true;
+}
+
+storage::Status LoadKey(storage::BulkLoader* loader, const PendingKey& pending, int64_t now, bool* loaded) {
+  *loaded = false;
+  int64_t ttl_millsec = 0;
+  if (pending.etime_millsec > 0) {
+    ttl_millsec = pending.etime_millsec - now;
+    if (ttl_millsec <= 0) {
+      return storage::Status::OK();
+    }
+  }
+  *loaded = true;
+  switch (pending.type) {
+    case KeyType::kString:
+      return loader->Set(pending.key, pending.value, ttl_millsec);
+    case KeyType::kHash:
+      return loader->HMSet(pending.key, pending.fvs, ttl_millsec);
+    case KeyType::kSet:
+      return loader->SAdd(pending.key, pending.members, ttl_millsec);
+    case KeyType::kList:
+      return loader->RPush(pending.key, pending.members, ttl_millsec);
+    case KeyType::kZSet:
+      return loader->ZAdd(pending.key, pending.score_members, ttl_millsec);
+    default:
+      *loaded = false;
+      return storage::Status::OK();
+  }
+}
+
+// folds the command into the pending key, false if it can not be loaded,
+// with malformed set when a score or a timestamp is not a number
+bool AddCommand(const std::vector<std::string>& argv, PendingKey* pending, bool* malformed) {
+  std::string cmd = argv[0];
+  std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+  auto expect = [&](KeyType type) {
+    if (pending->type != KeyType::kNone && pending->type != type) {
+      return false;
+    }
+    pending->type = type;
+    return true;
+  };
+  if (cmd == "set" && argv.size() == 3 && expect(KeyType::kString)) {
+    pending->value = argv[2];
+  } else if ((cmd == "hset" || cmd == "hmset") && argv.size() % 2 == 0 && expect(KeyType::kHash)) {
+    for (size_t i = 2; i < argv.size(); i += 2) {
+      pending->fvs.push_back({argv[i], argv[i + 1]});
+    }
+  } else if (cmd == "sadd" && argv.size() > 2 && expect(KeyType::kSet)) {
+    pending->members.insert(pending->members.end(), argv.begin() + 2, argv.end());
+  } else if (cmd == "rpush" && argv.size() > 2 && expect(KeyType::kList)) {
+    pending->members.insert(pending->members.end(), argv.begin() + 2, argv.end());
+  } else if (cmd == "zadd" && argv.size() % 2 == 0 && expect(KeyType::kZSet)) {
+    for (size_t i = 2; i < argv.size(); i += 2) {
+      double score = 0;
+      if (!ParseDouble(argv[i], &score)) {
+        *malformed = true;
+        return false;
+      }
+      pending->score_members.push_back({score, argv[i + 1]});
+    }
+  } else if (cmd == "expireat" && argv.size() == 3) {
+    int64_t etime = 0;
+    if (!ParseInt64(argv[2], &etime) || etime > INT64_MAX / 1000 || etime < INT64_MIN / 1000) {
+      *malformed = true;
+      return false;
+    }
+    pending->etime_millsec = etime * 1000;
+  } else if (cmd == "pexpireat" && argv.size() == 3) {
+    if (!ParseInt64(argv[2], &pending->etime_millsec)) {
+      *malformed = true;
+      return false;
+    }
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int64_t BulkLoadProtocol(const std::string& filename, const std::string& db_path, int db_instance_num, int slot_num,
+                         storage::DataFormat data_format) {
+  std::ifstream fin(filename, std::ios::binary);
+  if (!fin) {
+    std::cout << "open " << filename << " failed" << std::endl;
+    return -1;
+  }
+  storage::StorageOptions storage_options;
+  storage_options.options.create_if_missing = true;
+  storage_options.data_format = data_format;
+  storage::Storage db(db_instance_num, slot_num, true);
+  storage::Status s = db.Open(storage_options, db_path);
+  if (!s.ok()) {
+    std::cout << "open db failed: " << s.ToString() << std::endl;
+    return -1;
+  }
+  // an instance that already holds member data keeps its format
+  for (int idx = 0; idx < db_instance_num; ++idx) {
+    if (db.GetDataFormat(idx) != data_format) {
+      std::cout << "warning: db instance " << idx << " holds data format v" << static_cast<int>(db.GetDataFormat(idx))
+                << ", not v" << static_cast<int>(data_format) << ", its keys are loaded in its own format" << std::endl;
+    }
+  }
+
+  storage::BulkLoadOptions load_options;
+  load_options.work_dir = db_path + "/bulk_load";
+  std::unique_ptr<storage::BulkLoader> loader;
+  s = storage::BulkLoader::Open(&db, load_options, loader);
+  if (!s.ok()) {
+    std::cout << "open bulk loader failed: " << s.ToString() << std::endl;
+    return -1;
+  }
+
+  int64_t now = NowMillis();
+  int64_t loaded_keys = 0;
+  int64_t expired_keys = 0;
+  PendingKey pending;
+  auto flush = [&]() {
+    bool loaded = false;
+    storage::Status s = LoadKey(loader.get(), pending, now, &loaded);
+    if (loaded) {
+      loaded_keys++;
+    } else if (pending.type != KeyType::kNone) {
+      expired_keys++;
+    }
+    pending = PendingKey();
+    return s;
+  };
+
+  std::vector<std::string> argv;
+  bool malformed = false;
+  while (ReadCommand(fin, &argv, &malformed)) {
+    if (argv.empty()) {
+      continue;
+    }
+    std::string cmd = argv[0];
+    std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::tolower);
+    if (cmd == "select") {
+      continue;
+    }
+    if (argv.size() < 2) {
+      std::cout << "unsupported command: " << argv[0] << std::endl;
+      return -1;
+    }
+    if (argv[1] != pending.key) {
+      s = flush();
+      if (!s.ok()) {
+        std::cout << "load key failed: " << s.ToString() << std::endl;
+        return -1;
+      }
+      pending.key = argv[1];
+    }
+    if (!AddCommand(argv, &pending, &malformed)) {
+      if (!malformed) {
+        std::cout << "unsupported command: " << argv[0] << " of key " << argv[1] << std::endl;
+        return -1;
+      }
+      break;
+    }
+  }
+  if (malformed) {
+    std::cout << "malformed protocol file after " << loaded_keys << " keys" << std::endl;
+    return -1;
+  }
+  s = flush();
+  if (s.ok()) {
+    s = loader->Finish();
+  }
+  if (!s.ok()) {
+    std::cout << "ingest failed: " << s.ToString() << std::endl;
+    return -1;
+  }
+  std::cout << "skipped " << expired_keys << " expired keys" << std::endl;
+  return loaded_keys;
+}
+
+bool ParseDataFormat(const std::string& str, storage::DataFormat* data_format) {
+  if (str == "v1") {
+    *data_format = storage::kDataFormatV1;
+  } else if (str == "v2") {
+    *data_format = storage::kDataFormatV2;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ReadPikaConf(const std::string& conf_path, int* db_instance_num, int* slot_num, storage::DataFormat* data_format) {
+  pstd::BaseConf conf(conf_path);
+  if (conf.LoadConf() != 0) {
+    std::cout << "load conf " << conf_path << " failed" << std::endl;
+    return false;
+  }
+  conf.GetConfInt("db-instance-num", db_instance_num);
+  conf.GetConfInt("default-slot-num", slot_num);
+  std::string format;
+  if (conf.GetConfStr("data-format", &format) && !format.empty() && !ParseDataFormat(format, data_format)) {
+    std::cout << "bad data-format in " << conf_path << ": " << format << std::endl;
+    return false;
+  }
+  return true;
+}
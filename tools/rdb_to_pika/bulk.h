@@ -0,0 +1,22 @@
+#ifndef BULK_H_
+#define BULK_H_
+
+#include <string>
+
+#include "storage/storage_define.h"
+
+// loads the commands of the protocol file straight into the db at db_path,
+// which pika must not have open, instead of sending them to a running pika.
+// The commands of a key are expected one after another, as the rdb tools
+// write them. Returns the number of keys loaded, -1 on error
+int64_t BulkLoadProtocol(const std::string& filename, const std::string& db_path, int db_instance_num, int slot_num,
+                         storage::DataFormat data_format);
+
+// reads db-instance-num, default-slot-num and data-format from the pika.conf
+// at conf_path, the ones it does not set are left as they are. False if the
+// file can not be read or holds a bad data-format
+bool ReadPikaConf(const std::string& conf_path, int* db_instance_num, int* slot_num, storage::DataFormat* data_format);
+// "v1" or "v2"
+bool ParseDataFormat(const std::string& str, storage::DataFormat* data_format);
+
+#endif
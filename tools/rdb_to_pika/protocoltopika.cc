@@ -5,6 +5,8 @@
 #include <string>
 #include "hiredis/hiredis.h"
 
+#include "bulk.h"
+
 void Usage() {
   std::cout << "Usage:" << std::endl;
   std::cout << "      redisConn read protocol_file and send command to pika DB " << std::endl;
@@ -14,12 +16,45 @@ void Usage() {
   std::cout << "      [--a]     password for pika db; default = nullptr" << std::endl;
   std::cout << "example "
             << "./redisConn protocol_file 127.0.0.1 9221  password" << std::endl;
+  std::cout << "      redisConn read protocol_file and load it into the db of a stopped pika " << std::endl;
+  std::cout << "      --b       db path of the pika db, e.g. ./db/db0" << std::endl;
+  std::cout << "      [--n]     db-instance-num of pika; default = 3" << std::endl;
+  std::cout << "      [--s]     default-slot-num of pika; default = 1024" << std::endl;
+  std::cout << "      [--f]     data-format of pika, v1 or v2; default = v1" << std::endl;
+  std::cout << "example "
+            << "./redisConn protocol_file -b ./db/db0 3 1024 v2" << std::endl;
+  std::cout << "      or take db-instance-num, default-slot-num and data-format from the pika.conf of the node" << std::endl;
+  std::cout << "example "
+            << "./redisConn protocol_file -b ./db/db0 -c ./conf/pika.conf" << std::endl;
 }
 int main(int argc, char** argv) {
   if (argc < 4) {
     Usage();
     return -1;
   }
+  if (std::string(argv[2]) == "-b") {
+    int db_instance_num = 3;
+    int slot_num = 1024;
+    storage::DataFormat data_format = storage::kDataFormatV1;
+    if (argc > 5 && std::string(argv[4]) == "-c") {
+      if (!ReadPikaConf(argv[5], &db_instance_num, &slot_num, &data_format)) {
+        return -1;
+      }
+    } else {
+      db_instance_num = argc > 4 ? atoi(argv[4]) : 3;
+      slot_num = argc > 5 ? atoi(argv[5]) : 1024;
+      if (argc > 6 && !ParseDataFormat(argv[6], &data_format)) {
+        Usage();
+        return -1;
+      }
+    }
+    int64_t keys = BulkLoadProtocol(argv[1], argv[3], db_instance_num, slot_num, data_format);
+    if (keys < 0) {
+      return -1;
+    }
+    std::cout << "loaded " << keys << " keys" << std::endl;
+    return 0;
+  }
   const char* filename = argv[1];
   const char* ip = argv[2];
   std::ifstream fin(filename, std::ios::in);
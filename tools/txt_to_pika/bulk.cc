@@ -0,0 +1,96 @@
+#include "bulk.h"
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include "pstd/include/base_conf.h"
+#include "storage/bulk_loader.h"
+#include "storage/storage.h"
+
+int64_t BulkLoadFile(const std::string& filename, const std::string& db_path, int db_instance_num, int slot_num,
+                     storage::DataFormat data_format, int ttl) {
+  storage::StorageOptions storage_options;
+  storage_options.options.create_if_missing = true;
+  storage_options.data_format = data_format;
+  storage::Storage db(db_instance_num, slot_num, true);
+  storage::Status s = db.Open(storage_options, db_path);
+  if (!s.ok()) {
+    std::cout << "open db failed: " << s.ToString() << std::endl;
+    return -1;
+  }
+  // an instance that already holds member data keeps its format
+  for (int idx = 0; idx < db_instance_num; ++idx) {
+    if (db.GetDataFormat(idx) != data_format) {
+      std::cout << "warning: db instance " << idx << " holds data format v" << static_cast<int>(db.GetDataFormat(idx))
+                << ", not v" << static_cast<int>(data_format) << ", its keys are loaded in its own format" << std::endl;
+    }
+  }
+
+  storage::BulkLoadOptions load_options;
+  load_options.work_dir = db_path + "/bulk_load";
+  std::unique_ptr<storage::BulkLoader> loader;
+  s = storage::BulkLoader::Open(&db, load_options, loader);
+  if (!s.ok()) {
+    std::cout << "open bulk loader failed: " << s.ToString() << std::endl;
+    return -1;
+  }
+
+  std::ifstream fin(filename, std::ios::binary);
+  int64_t ttl_millsec = ttl > 0 ? static_cast<int64_t>(ttl) * 1000 : 0;
+  int64_t num = 0;
+  std::string key;
+  std::string value;
+  uint32_t key_len;
+  uint32_t value_len;
+  while (fin.read(reinterpret_cast<char*>(&key_len), sizeof(uint32_t))) {
+    key.resize(key_len);
+    fin.read(key.data(), key_len);
+    fin.read(reinterpret_cast<char*>(&value_len), sizeof(uint32_t));
+    value.resize(value_len);
+    fin.read(value.data(), value_len);
+    if (!fin) {
+      std::cout << "truncated record after " << num << " records" << std::endl;
+      return -1;
+    }
+    s = loader->Set(key, value, ttl_millsec);
+    if (!s.ok()) {
+      std::cout << "load record failed: " << s.ToString() << std::endl;
+      return -1;
+    }
+    num++;
+  }
+
+  s = loader->Finish();
+  if (!s.ok()) {
+    std::cout << "ingest failed: " << s.ToString() << std::endl;
+    return -1;
+  }
+  return num;
+}
+
+bool ParseDataFormat(const std::string& str, storage::DataFormat* data_format) {
+  if (str == "v1") {
+    *data_format = storage::kDataFormatV1;
+  } else if (str == "v2") {
+    *data_format = storage::kDataFormatV2;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool ReadPikaConf(const std::string& conf_path, int* db_instance_num, int* slot_num, storage::DataFormat* data_format) {
+  pstd::BaseConf conf(conf_path);
+  if (conf.LoadConf() != 0) {
+    std::cout << "load conf " << conf_path << " failed" << std::endl;
+    return false;
+  }
+  conf.GetConfInt("db-instance-num", db_instance_num);
+  conf.GetConfInt("default-slot-num", slot_num);
+  std::string format;
+  if (conf.GetConfStr("data-format", &format) && !format.empty() && !ParseDataFormat(format, data_format)) {
+    std::cout << "bad data-format in " << conf_path << ": " << format << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,21 @@
+#ifndef BULK_H_
+#define BULK_H_
+
+#include <string>
+
+#include "storage/storage_define.h"
+
+// loads the records of the txt file straight into the db at db_path, which
+// pika must not have open, instead of sending them to a running pika.
+// Returns the number of records loaded, -1 on error
+int64_t BulkLoadFile(const std::string& filename, const std::string& db_path, int db_instance_num, int slot_num,
+                     storage::DataFormat data_format, int ttl);
+
+// reads db-instance-num, default-slot-num and data-format from the pika.conf
+// at conf_path, the ones it does not set are left as they are. False if the
+// file can not be read or holds a bad data-format
+bool ReadPikaConf(const std::string& conf_path, int* db_instance_num, int* slot_num, storage::DataFormat* data_format);
+// "v1" or "v2"
+bool ParseDataFormat(const std::string& str, storage::DataFormat* data_format);
+
+#endif
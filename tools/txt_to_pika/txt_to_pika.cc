@@ -1,5 +1,6 @@
 #include <chrono>
 #include <iostream>
+#include "bulk.h"
 #include "scan.h"
 #include "sender.h"
 
@@ -9,6 +10,56 @@ void Usage() {
   std::cout << "Usage: " << std::endl;
   std::cout << "    ./txt_to_pika txt pika_ip pika_port -n [thread_num] -t [ttl] -p [password]" << std::endl;
   std::cout << "    example: ./txt_to_pika data.txt 127.0.0.1 9921 -n 10 -t 10 -p 123456" << std::endl;
+  std::cout << "    ./txt_to_pika txt -b db_path -c [pika_conf] -i [db_instance_num] -s [slot_num] -f [v1|v2] -t [ttl]"
+            << std::endl;
+  std::cout << "    loads into the db of a stopped pika, e.g. ./txt_to_pika data.txt -b ./db/db0 -c pika.conf" << std::endl;
+  std::cout << "    -c takes db-instance-num, default-slot-num and data-format from the pika.conf of the node,"
+            << " -i, -s and -f override them" << std::endl;
+}
+
+int BulkMain(int argc, char** argv) {
+  std::string filename = std::string(argv[1]);
+  std::string db_path = std::string(argv[3]);
+  int db_instance_num = 3;
+  int slot_num = 1024;
+  storage::DataFormat data_format = storage::kDataFormatV1;
+  int ttl = -1;
+  // the conf first, the flags override it
+  for (int index = 4; index + 1 < argc; index += 2) {
+    if (std::string(argv[index]) == "-c" &&
+        !ReadPikaConf(argv[index + 1], &db_instance_num, &slot_num, &data_format)) {
+      return -1;
+    }
+  }
+  for (int index = 4; index + 1 < argc; index += 2) {
+    std::string flag(argv[index]);
+    if (flag == "-i") {
+      db_instance_num = std::stoi(std::string(argv[index + 1]));
+    } else if (flag == "-s") {
+      slot_num = std::stoi(std::string(argv[index + 1]));
+    } else if (flag == "-f") {
+      if (!ParseDataFormat(argv[index + 1], &data_format)) {
+        Usage();
+        return -1;
+      }
+    } else if (flag == "-t") {
+      ttl = std::stoi(std::string(argv[index + 1]));
+    }
+  }
+
+  std::cout << "filename: " << filename << std::endl;
+  std::cout << "db_path: " << db_path << std::endl;
+  std::cout << "db_instance_num: " << db_instance_num << std::endl;
+  std::cout << "slot_num: " << slot_num << std::endl;
+  std::cout << "data_format: v" << static_cast<int>(data_format) << std::endl;
+  std::cout << "ttl: " << ttl << std::endl;
+
+  int64_t records = BulkLoadFile(filename, db_path, db_instance_num, slot_num, data_format, ttl);
+  if (records < 0) {
+    return -1;
+  }
+  std::cout << std::endl << "Total " << records << " records has been loaded" << std::endl;
+  return 0;
 }
 
 int main(int argc, char** argv) {
@@ -16,6 +67,9 @@ int main(int argc, char** argv) {
     Usage();
     return 0;
   }
+  if (std::string(argv[2]) == "-b") {
+    return BulkMain(argc, argv);
+  }
 
   high_resolution_clock::time_point start = high_resolution_clock::now();
 